@@ -31,6 +31,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <netif/etharp.h>
+#include <lwip/prot/ieee.h>
 
 #include "bl_tx.h"
 #include "bl_irqs.h"
@@ -38,7 +39,58 @@
 #include "os_hal.h"
 
 
-struct utils_list tx_list_bl;
+/* Classify frames by DSCP / 802.1p, 0 sends everything as best effort */
+#ifndef BL_TX_WMM
+#define BL_TX_WMM               1
+#endif
+
+/* DRR quantum of BK in bytes, at least one full frame; the other ACs get multiples */
+#define BL_TX_DRR_QUANTUM       1600
+
+/* Frames an access category may have waiting, more are dropped on arrival */
+#define BL_TX_QUEUE_LEN_MAX     32
+
+/* Times a frame is handed back to the firmware after hitting the retry limit */
+#define BL_TX_RESEND_MAX        4
+
+#define BL_TX_CHAINED_MAX       (sizeof(((struct hostdesc *)0)->pbuf_chained_ptr) / sizeof(u32_l))
+
+#define BL_TX_FRAME_LEN(txhdr)  ((int32_t)((txhdr)->host.packet_len + sizeof(struct ethhdr)))
+
+/*
+ * Frames waiting for a tx descriptor, one queue per access category.
+ *
+ * The retry list holds frames the firmware confirmed with the retry limit
+ * reached. Only frames owning a descriptor get confirmed, so it never holds
+ * more than NX_TXDESC_CNT0 frames and needs no limit of its own.
+ */
+struct bl_tx_queue {
+    struct utils_list list;
+    struct utils_list retry;
+    int32_t deficit;
+    uint16_t quantum;
+    uint16_t len;
+    uint16_t retry_len;
+    uint32_t queued;
+    uint32_t pushed;
+    uint32_t resent;
+    uint32_t dropped;
+    uint32_t overflow;
+};
+
+static struct bl_tx_queue bl_txq[AC_MAX];
+/* queue the scheduler is serving, and whether it got its quantum for this visit */
+static uint8_t bl_txq_cur = AC_VO;
+static uint8_t bl_txq_credited = 0;
+static uint32_t bl_tx_linearized = 0;
+
+static const u8 bl_tid2ac[TID_MGT] = {
+    AC_BE, AC_BK, AC_BK, AC_BE, AC_VI, AC_VI, AC_VO, AC_VO
+};
+
+static const char * const bl_ac_name[AC_MAX] = {
+    "BK", "BE", "VI", "VO"
+};
 
 int internel_cal_size_tx_hdr = sizeof(struct bl_txhdr);
 
@@ -46,6 +98,21 @@ TaskHandle_t taskHandle_output = NULL;
 extern struct bl_hw wifi_hw;
 static struct bl_hw *bl_hw_static = &wifi_hw;
 
+void bl_tx_init(void)
+{
+    int ac;
+
+    for (ac = 0; ac < AC_MAX; ac++) {
+        memset(&bl_txq[ac], 0, sizeof(bl_txq[ac]));
+        utils_list_init(&bl_txq[ac].list);
+        utils_list_init(&bl_txq[ac].retry);
+        /* VO:VI:BE:BK share 8:4:2:1 of the link when all are backlogged */
+        bl_txq[ac].quantum = BL_TX_DRR_QUANTUM << ac;
+    }
+    bl_txq_cur = AC_VO;
+    bl_txq_credited = 0;
+}
+
 void bl_tx_push(struct bl_hw *bl_hw, struct bl_txhdr *txhdr)
 {
     volatile struct hostdesc *host;
@@ -66,27 +133,77 @@ void bl_tx_push(struct bl_hw *bl_hw, struct bl_txhdr *txhdr)
 
     ipc_host_txdesc_push(bl_hw->ipc_env, p);
     bl_hw->stats.cfm_balance++;
+    bl_txq[txhdr->ac].pushed++;
 }
 
-#define TXHDR_HODLER_LEN (8)
-#define TXHDR_HODLER_MSK (0x7)
-struct bl_txhdr *(txhdr_hodler[8]);
-uint32_t txhdr_pos_r = 0;
-uint32_t txhdr_pos_w = 0;
+/* Frames back from the firmware go out first, VO to BK. Call in critical section */
+static struct bl_txhdr *bl_tx_dequeue_retry(void)
+{
+    struct bl_tx_queue *txq;
+    struct bl_txhdr *txhdr;
+    int ac;
+
+    for (ac = AC_VO; ac >= AC_BK; ac--) {
+        txq = &bl_txq[ac];
+        txhdr = (struct bl_txhdr*)utils_list_pop_front(&txq->retry);
+        if (txhdr) {
+            txq->retry_len--;
+            txhdr->status.value = 0;
+            return txhdr;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Deficit round robin over the access categories, VO first. The quantum of a
+ * queue is at least a full frame, so one visit to a backlogged queue always
+ * sends something. Call in critical section.
+ */
+static struct bl_txhdr *bl_tx_dequeue(void)
+{
+    struct bl_tx_queue *txq;
+    struct bl_txhdr *txhdr;
+    int visits;
+
+    for (visits = 0; visits <= AC_MAX; visits++) {
+        txq = &bl_txq[bl_txq_cur];
+        txhdr = (struct bl_txhdr*)utils_list_pick(&txq->list);
+        if (txhdr) {
+            if (!bl_txq_credited) {
+                txq->deficit += txq->quantum;
+                bl_txq_credited = 1;
+            }
+            if (BL_TX_FRAME_LEN(txhdr) <= txq->deficit) {
+                utils_list_pop_front(&txq->list);
+                txq->len--;
+                txq->deficit -= BL_TX_FRAME_LEN(txhdr);
+                return txhdr;
+            }
+        } else {
+            /* an idle queue doesn't save up credit */
+            txq->deficit = 0;
+        }
+        bl_txq_cur = (AC_BK == bl_txq_cur) ? AC_VO : bl_txq_cur - 1;
+        bl_txq_credited = 0;
+    }
+    return NULL;
+}
 
 void bl_tx_resend()
 {
+    struct bl_txhdr *txhdr;
+
     taskENTER_CRITICAL();
-    while (txhdr_pos_r != txhdr_pos_w) {
-        if (NULL == ipc_host_txdesc_get(bl_hw_static->ipc_env)) {
+    while (ipc_host_txdesc_get(bl_hw_static->ipc_env)) {
+        txhdr = bl_tx_dequeue_retry();
+        if (NULL == txhdr) {
             break;
         }
-        txhdr_hodler[txhdr_pos_r & TXHDR_HODLER_MSK]->status.value = 0;
 #if 0
-        printf("Push back %p\r\n", txhdr_hodler[txhdr_pos_r & TXHDR_HODLER_MSK]);
+        printf("Push back %p\r\n", txhdr);
 #endif
-        bl_tx_push(bl_hw_static, txhdr_hodler[txhdr_pos_r & TXHDR_HODLER_MSK]);
-        txhdr_pos_r++;
+        bl_tx_push(bl_hw_static, txhdr);
     }
     taskEXIT_CRITICAL();
 }
@@ -97,7 +214,10 @@ void bl_tx_try_flush()
 
     taskENTER_CRITICAL();
     while (ipc_host_txdesc_get(bl_hw_static->ipc_env)) {
-        txhdr = (struct bl_txhdr*)utils_list_pop_front(&tx_list_bl);
+        txhdr = bl_tx_dequeue_retry();
+        if (NULL == txhdr) {
+            txhdr = bl_tx_dequeue();
+        }
         if (NULL == txhdr) {
             break;
         }
@@ -111,6 +231,7 @@ int bl_txdatacfm(void *pthis, void *host_id)
 #define RETRY_LIMIT_REACHED_BIT (1 << 16)
     struct pbuf *p = (struct pbuf*)host_id;
     struct bl_txhdr *txhdr;
+    struct bl_tx_queue *txq;
     union bl_hw_txstatus bl_txst;
 
     txhdr = (struct bl_txhdr*)(((uint32_t)p->payload) + RWNX_HWTXHDR_ALIGN_PADS((uint32_t)p->payload));
@@ -122,31 +243,56 @@ int bl_txdatacfm(void *pthis, void *host_id)
     if (bl_txst.value == 0) {
         return -1;
     }
-    if (bl_txst.value & RETRY_LIMIT_REACHED_BIT) {
+    txq = &bl_txq[txhdr->ac];
+    if ((bl_txst.value & RETRY_LIMIT_REACHED_BIT) && txhdr->resend < BL_TX_RESEND_MAX) {
 #if 0
         printf("TX STATUS %08lX", bl_txst.value);
-        printf(" Retry reached %p:%lu:%lu", txhdr, txhdr_pos_r, txhdr_pos_w);
+        printf(" Retry reached %p:%u\r\n", txhdr, txhdr->resend);
 #endif
         /*we don't pbuf_free here, because we will resend this packet*/
-        if (((txhdr_pos_w + 1) & TXHDR_HODLER_MSK) != (txhdr_pos_r & TXHDR_HODLER_MSK)) {
-#if 0
-            puts(" push back\r\n");
-#endif
-            txhdr_hodler[txhdr_pos_w & TXHDR_HODLER_MSK] = txhdr;
-            txhdr_pos_w++;
-        } else {
-#if 0
-            puts(" NOT push back when no mem\r\n");
-#endif
-            pbuf_free(p);
-        }
+        txhdr->resend++;
+        taskENTER_CRITICAL();
+        utils_list_push_back(&txq->retry, &(txhdr->item));
+        txq->retry_len++;
+        txq->resent++;
+        taskEXIT_CRITICAL();
     } else {
+        if (bl_txst.value & RETRY_LIMIT_REACHED_BIT) {
+            txq->dropped++;
+        }
         pbuf_free(p);
     }
 
     return 0;
 }
 
+void bl_tx_dump_stats(void)
+{
+    struct bl_tx_queue txq[AC_MAX];
+    uint32_t linearized;
+    int ac;
+
+    taskENTER_CRITICAL();
+    memcpy(txq, bl_txq, sizeof(txq));
+    linearized = bl_tx_linearized;
+    taskEXIT_CRITICAL();
+
+    printf("[TX] AC queued  pushed   resent   dropped  overflow pending retry\r\n");
+    for (ac = AC_VO; ac >= AC_BK; ac--) {
+        printf("[TX] %s %-8lu %-8lu %-8lu %-8lu %-8lu %-7u %u\r\n",
+                bl_ac_name[ac],
+                (unsigned long)txq[ac].queued,
+                (unsigned long)txq[ac].pushed,
+                (unsigned long)txq[ac].resent,
+                (unsigned long)txq[ac].dropped,
+                (unsigned long)txq[ac].overflow,
+                txq[ac].len,
+                txq[ac].retry_len
+        );
+    }
+    printf("[TX] linearized %lu\r\n", (unsigned long)linearized);
+}
+
 void bl_tx_notify()
 {
     //TODO static alloc taskHandle_output, no if else anymore
@@ -157,6 +303,39 @@ void bl_tx_notify()
     return;
 }
 
+/* TID from the 802.1p priority or the DSCP, RFC 8325 style */
+static u8 bl_tx_classify(struct pbuf *p)
+{
+#if BL_TX_WMM
+    u16_t type;
+    u8 dscp;
+
+    type = ((u16_t)pbuf_get_at(p, 12) << 8) | pbuf_get_at(p, 13);
+    switch (type) {
+        case ETHTYPE_VLAN:
+            return pbuf_get_at(p, 14) >> 5;
+        case ETH_P_PAE:
+            /*key exchange must not wait behind data*/
+            return TID_7;
+        case ETHTYPE_IP:
+            dscp = pbuf_get_at(p, 15) >> 2;
+            break;
+        case ETHTYPE_IPV6:
+            dscp = ((pbuf_get_at(p, 14) & 0x0f) << 2) | (pbuf_get_at(p, 15) >> 6);
+            break;
+        default:
+            return TID_0;
+    }
+    /*EF and VOICE-ADMIT are voice, otherwise the class selector decides*/
+    if (46 == dscp || 44 == dscp) {
+        return TID_6;
+    }
+    return dscp >> 3;
+#else
+    return TID_0;
+#endif
+}
+
 err_t bl_output(struct bl_hw *bl_hw, struct netif *netif, struct pbuf *p, int is_sta)
 {
     struct bl_txhdr *txhdr;
@@ -165,9 +344,11 @@ err_t bl_output(struct bl_hw *bl_hw, struct netif *netif, struct pbuf *p, int is
     uint32_t *eth_header;
     struct ethhdr *eth;
     struct hostdesc *host;
+    struct pbuf *p_org = p;
     int loop = 0;
     u8 tid;
     uint16_t packet_len;
+    int full;
 
     if (NULL == bl_hw || 0 == (NETIF_FLAG_LINK_UP & netif->flags)) {//TODO avoid call output when Wi-Fi is not ready
         printf("[TX] wifi is down, return now\r\n");
@@ -179,12 +360,27 @@ err_t bl_output(struct bl_hw *bl_hw, struct netif *netif, struct pbuf *p, int is
     }
 
     bl_hw_static = bl_hw;
+
+    if (pbuf_clen(p) > BL_TX_CHAINED_MAX) {
+        /*descriptor only takes BL_TX_CHAINED_MAX pieces, send a flat copy instead*/
+        p = pbuf_clone(PBUF_RAW_TX, PBUF_RAM, p_org);
+        if (NULL == p) {
+            printf("[TX] [PBUF] linearize failed, total_len %d\r\n", p_org->tot_len);
+            return ERR_MEM;
+        }
+        bl_tx_linearized++;
+    }
+
+    tid = bl_tx_classify(p);
     eth_header = (uint32_t*)p->payload;
     packet_len = p->tot_len;
 
     /*Make room in the header for tx*/
     if (pbuf_header(p, PBUF_LINK_ENCAPSULATION_HLEN)) {
         printf("[TX] Reserve room failed for header\r\n");
+        if (p != p_org) {
+            pbuf_free(p);
+        }
         return ERR_IF;
     }
     /*Use aligned link_header*/
@@ -196,14 +392,13 @@ err_t bl_output(struct bl_hw *bl_hw, struct netif *netif, struct pbuf *p, int is
         );
     }
 
-    tid = 0;//XXX set TID to 0 for quick test purpose
-
     eth = (struct ethhdr *)(eth_header);
     txhdr = (struct bl_txhdr *)(link_header);
     memset(txhdr, 0, sizeof(struct bl_txhdr));
     host = &(txhdr->host);
 
     txhdr->p         = (uint32_t*)p;//XXX pattention to this filed
+    txhdr->ac        = bl_tid2ac[tid];
     // Fill-in the descriptor
     memcpy(&host->eth_dest_addr, eth->h_dest, ETH_ALEN);
     memcpy(&host->eth_src_addr, eth->h_source, ETH_ALEN);
@@ -227,12 +422,6 @@ err_t bl_output(struct bl_hw *bl_hw, struct netif *netif, struct pbuf *p, int is
             host->pbuf_chained_len[loop] = q->len - sizeof(*eth) - PBUF_LINK_ENCAPSULATION_HLEN;//eth header is skipped in the header
         } else {
             /*Chained pbuf after*/
-            if (loop >= 4) {
-                /*exceed the limit for pbuf chained*/
-                printf("[TX] [PBUF] Please fix for bigger chained pbuf, total_len %d\r\n",
-                        p->tot_len
-                );
-            }
             host->pbuf_chained_ptr[loop] = (uint32_t)(q->payload);
             host->pbuf_chained_len[loop] = q->len;
 #if 0
@@ -259,13 +448,32 @@ err_t bl_output(struct bl_hw *bl_hw, struct netif *netif, struct pbuf *p, int is
     host->packet_addr = (uint32_t)(0x11111111);//FIXME we use this magic for unvaild packet_addr
     host->status_addr = (uint32_t)(&(txhdr->status));
 
-    /*Ref this pbuf to avoid pbuf release*/
-    pbuf_ref(p);
+    /*Ref this pbuf to avoid pbuf release, a linearized copy is ours already*/
+    if (p == p_org) {
+        pbuf_ref(p);
+    }
 
+    /*the cap is checked under the lock that guards len, like the push itself*/
     taskENTER_CRITICAL();
-    utils_list_push_back(&tx_list_bl, &(txhdr->item));
+    full = (bl_txq[txhdr->ac].len >= BL_TX_QUEUE_LEN_MAX);
+    if (full) {
+        bl_txq[txhdr->ac].overflow++;
+    } else {
+        utils_list_push_back(&bl_txq[txhdr->ac].list, &(txhdr->item));
+        bl_txq[txhdr->ac].len++;
+        bl_txq[txhdr->ac].queued++;
+    }
     taskEXIT_CRITICAL();
 
+    if (full) {
+        /*a full queue only delays everything behind it, drop like a full qdisc would*/
+        if (p == p_org) {
+            pbuf_header(p, -PBUF_LINK_ENCAPSULATION_HLEN);
+        }
+        pbuf_free(p);
+        return ERR_MEM;
+    }
+
     bl_irq_handler();
 
     return ERR_OK;
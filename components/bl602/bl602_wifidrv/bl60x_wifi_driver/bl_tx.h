@@ -53,13 +53,19 @@
  *
  * @sw_hdr: Information from driver
  * @hw_hdr: Information for/from hardware
+ * @ac: Access category queue the packet is scheduled on
+ * @resend: Times the packet came back with the retry limit reached
  */
 struct bl_txhdr {
     struct utils_list_hdr item;
     union bl_hw_txstatus status;
     uint32_t *p;
     struct hostdesc host;
+    uint8_t ac;
+    uint8_t resend;
 };
+void bl_tx_init(void);
+void bl_tx_dump_stats(void);
 err_t bl_output(struct bl_hw *bl_hw, struct netif *netif, struct pbuf *p, int is_sta);
 int bl_txdatacfm(void *pthis, void *host_id);
 void bl_tx_notify();
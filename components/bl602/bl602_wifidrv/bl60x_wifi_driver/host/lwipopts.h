@@ -0,0 +1,39 @@
+/*
+ * lwIP for the tx queue model: NO_SYS, pbufs and the heap only, with the
+ * device's link encapsulation headroom that bl_output() puts its
+ * struct bl_txhdr in.
+ */
+#ifndef TX_MODEL_LWIPOPTS_H
+#define TX_MODEL_LWIPOPTS_H
+
+#define NO_SYS                          1
+#define SYS_LIGHTWEIGHT_PROT            0
+#define LWIP_TIMERS                     0
+#define LWIP_SOCKET                     0
+#define LWIP_NETCONN                    0
+
+#define MEM_LIBC_MALLOC                 0
+#define MEM_ALIGNMENT                   8
+#define MEM_SIZE                        (1024 * 1024)
+#define MEMP_NUM_PBUF                   256
+#define PBUF_POOL_SIZE                  16
+#define PBUF_LINK_ENCAPSULATION_HLEN    128u
+
+#define LWIP_IPV4                       1
+#define LWIP_IPV6                       0
+#define LWIP_ARP                        0
+#define LWIP_ETHERNET                   0
+#define LWIP_ICMP                       0
+#define LWIP_RAW                        0
+#define LWIP_UDP                        0
+#define LWIP_TCP                        0
+#define LWIP_DNS                        0
+#define LWIP_DHCP                       0
+
+/* the model checks that every pbuf came back */
+#define LWIP_STATS                      1
+#define MEM_STATS                       1
+#define MEMP_STATS                      1
+#define LWIP_STATS_DISPLAY              0
+
+#endif
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test for the wifi_mgmr scan result table.  A trace of 200000 scan
+ * indications from 160 BSSIDs over 20 SSIDs, hidden ones included, is fed to
+ * the table and to the linear array update it replaced, which is kept below.
+ * Every 97 indications both must hold the same items, the RSSI order must
+ * be strongest first and the best AP for an SSID must match a brute force
+ * search.  Purging the channels above 11 must drop those items from the
+ * table and the RSSI order, and a weaker copy of an item must be skipped
+ * for WIFI_MGMR_SCAN_UPDATE_LIMIT_TIME_MS across the tick wrap and no longer.
+ * Prints the time per indication for both.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../wifi_mgmr_scan.c"
+
+#define TEST_BSSIDS         160
+#define TEST_SSIDS          20
+#define TEST_INDICATIONS    200000
+#define TEST_CHECK_EVERY    97
+#define TEST_BEST_TIMEOUT   15000
+
+static int test_failed;
+
+static wifi_mgmr_scan_table_t table;
+static wifi_mgmr_scan_item_t old_items[WIFI_MGMR_SCAN_ITEMS_MAX];
+static wifi_mgmr_scan_item_t trace[TEST_INDICATIONS];
+static uint32_t trace_time[TEST_INDICATIONS];
+
+/* the scan_items update of stateGlobalGuard_scan_beacon before the table */
+static void old_update(const wifi_mgmr_scan_item_t *scan, uint32_t counter)
+{
+    int i, empty = -1, oldest = -1;
+    uint32_t lastseen = 0xFFFFFFFF;
+    uint32_t lastseen_found = 0;
+
+    for (i = 0; i < WIFI_MGMR_SCAN_ITEMS_MAX; i++) {
+        if (old_items[i].is_used) {
+            if ((0 == lastseen_found) ||
+                ((int32_t)(old_items[i].timestamp_lastseen - lastseen) < 0)) {
+                lastseen_found = 1;
+                lastseen = old_items[i].timestamp_lastseen;
+                oldest = i;
+            }
+            if (0 == memcmp(old_items[i].bssid, scan->bssid, sizeof(scan->bssid)) &&
+                    0 == strcmp(scan->ssid, old_items[i].ssid)) {
+                if ((scan->rssi < old_items[i].rssi) &&
+                    ((int32_t)(counter - old_items[i].timestamp_lastseen) < WIFI_MGMR_SCAN_UPDATE_LIMIT_TIME_MS)) {
+                } else {
+                    old_items[i].channel = scan->channel;
+                    old_items[i].rssi = scan->rssi;
+                    old_items[i].timestamp_lastseen = counter;
+                    old_items[i].auth = scan->auth;
+                }
+                break;
+            }
+        } else {
+            empty = i;
+        }
+    }
+    if (i == WIFI_MGMR_SCAN_ITEMS_MAX) {
+        i = (-1 != empty) ? empty : oldest;
+        memset(&old_items[i], 0, sizeof(old_items[0]));
+        strncpy(old_items[i].ssid, scan->ssid, sizeof(old_items[i].ssid));
+        old_items[i].ssid_len = strlen(old_items[i].ssid);
+        memcpy(old_items[i].bssid, scan->bssid, sizeof(old_items[i].bssid));
+        old_items[i].channel = scan->channel;
+        old_items[i].rssi = scan->rssi;
+        old_items[i].timestamp_lastseen = counter;
+        old_items[i].auth = scan->auth;
+        old_items[i].is_used = 1;
+    }
+}
+
+/* an office: bursts of beacons, some hidden SSIDs */
+static void make_trace(void)
+{
+    uint32_t now = 0;
+    int i, b;
+
+    for (i = 0; i < TEST_INDICATIONS; i++) {
+        b = rand() % TEST_BSSIDS;
+        memset(&trace[i], 0, sizeof(trace[i]));
+        trace[i].bssid[0] = 0x24;
+        trace[i].bssid[1] = 0x0b;
+        trace[i].bssid[2] = 0x0a;
+        trace[i].bssid[3] = b / 16;
+        trace[i].bssid[4] = 0x10;
+        trace[i].bssid[5] = (b % 16) << 4;
+        if (b % 11) {
+            sprintf(trace[i].ssid, "corp-%d", b % TEST_SSIDS);
+        }
+        trace[i].channel = 1 + b % 13;
+        trace[i].rssi = -30 - (b % 60) - rand() % 8;
+        now += 1 + rand() % 40;
+        trace_time[i] = now;
+    }
+}
+
+static int same_item(const wifi_mgmr_scan_item_t *a, const wifi_mgmr_scan_item_t *b)
+{
+    return !memcmp(a->bssid, b->bssid, sizeof(a->bssid)) && !strcmp(a->ssid, b->ssid) &&
+           a->rssi == b->rssi && a->channel == b->channel &&
+           a->timestamp_lastseen == b->timestamp_lastseen;
+}
+
+static int check_order(void)
+{
+    int i;
+
+    for (i = 0; i < table.count; i++) {
+        if (wifi_mgmr_scan_table_by_rssi(&table, i) == NULL ||
+            (i > 0 && wifi_mgmr_scan_table_by_rssi(&table, i - 1)->rssi < wifi_mgmr_scan_table_by_rssi(&table, i)->rssi)) {
+            printf("FAIL rank %d is out of RSSI order\n", i);
+            return -1;
+        }
+    }
+    if (wifi_mgmr_scan_table_by_rssi(&table, table.count) != NULL) {
+        printf("FAIL an item past the last rank\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int check(int n)
+{
+    wifi_mgmr_scan_item_t *best, *ref = NULL;
+    char ssid[16];
+    int i, j, used = 0;
+
+    for (i = 0; i < WIFI_MGMR_SCAN_ITEMS_MAX; i++) {
+        if (!old_items[i].is_used) {
+            continue;
+        }
+        used++;
+        for (j = 0; j < WIFI_MGMR_SCAN_ITEMS_MAX; j++) {
+            if (table.items[j].is_used && same_item(&old_items[i], &table.items[j])) {
+                break;
+            }
+        }
+        if (j == WIFI_MGMR_SCAN_ITEMS_MAX) {
+            printf("FAIL indication %d: '%s' %02x%02x is not in the table\n",
+                   n, old_items[i].ssid, old_items[i].bssid[3], old_items[i].bssid[5]);
+            return -1;
+        }
+    }
+    if (used != table.count) {
+        printf("FAIL indication %d: %d items, %d before\n", n, table.count, used);
+        return -1;
+    }
+    if (check_order()) {
+        return -1;
+    }
+
+    sprintf(ssid, "corp-%d", rand() % TEST_SSIDS);
+    best = wifi_mgmr_scan_table_best(&table, ssid, trace_time[n], TEST_BEST_TIMEOUT);
+    for (i = 0; i < WIFI_MGMR_SCAN_ITEMS_MAX; i++) {
+        if (table.items[i].is_used && !strcmp(table.items[i].ssid, ssid) &&
+            trace_time[n] - table.items[i].timestamp_lastseen < TEST_BEST_TIMEOUT &&
+            (ref == NULL || table.items[i].rssi > ref->rssi)) {
+            ref = &table.items[i];
+        }
+    }
+    if ((best == NULL) != (ref == NULL) || (best && best->rssi != ref->rssi)) {
+        printf("FAIL indication %d: best AP for %s has RSSI %d, %d by search\n",
+               n, ssid, best ? best->rssi : 0, ref ? ref->rssi : 0);
+        return -1;
+    }
+    return 0;
+}
+
+static void test_trace(void)
+{
+    int i;
+
+    for (i = 0; i < TEST_INDICATIONS; i++) {
+        old_update(&trace[i], trace_time[i]);
+        wifi_mgmr_scan_table_update(&table, &trace[i], trace_time[i]);
+        if ((i % TEST_CHECK_EVERY == 0 || i == TEST_INDICATIONS - 1) && check(i)) {
+            test_failed = 1;
+            return;
+        }
+    }
+}
+
+static void test_purge(void)
+{
+    int i;
+
+    wifi_mgmr_scan_table_purge_channel(&table, 11);
+    for (i = 0; i < WIFI_MGMR_SCAN_ITEMS_MAX; i++) {
+        if (table.items[i].is_used && table.items[i].channel > 11) {
+            printf("FAIL channel %d is left after the purge\n", table.items[i].channel);
+            test_failed = 1;
+        }
+    }
+    for (i = 0; i < table.count; i++) {
+        if (wifi_mgmr_scan_table_by_rssi(&table, i)->channel > 11) {
+            printf("FAIL channel %d is left in the RSSI order\n", wifi_mgmr_scan_table_by_rssi(&table, i)->channel);
+            test_failed = 1;
+        }
+    }
+
+    /* the freed slots are taken again */
+    for (i = 0; i < 2000; i++) {
+        wifi_mgmr_scan_table_update(&table, &trace[i], trace_time[TEST_INDICATIONS - 1] + 100000 + i);
+    }
+    if (table.count != WIFI_MGMR_SCAN_ITEMS_MAX || check_order()) {
+        printf("FAIL %d items after the purge\n", table.count);
+        test_failed = 1;
+    }
+}
+
+/* a weaker copy is skipped for WIFI_MGMR_SCAN_UPDATE_LIMIT_TIME_MS only */
+static void test_update_limit(void)
+{
+    wifi_mgmr_scan_item_t scan = trace[0];
+    wifi_mgmr_scan_item_t *item;
+    uint32_t now = 0xFFFFF000;
+
+    memset(&table, 0, sizeof(table));
+    scan.rssi = -50;
+    wifi_mgmr_scan_table_update(&table, &scan, now);
+    scan.rssi = -60;
+    if (wifi_mgmr_scan_table_update(&table, &scan, now + WIFI_MGMR_SCAN_UPDATE_LIMIT_TIME_MS - 1) != NULL) {
+        printf("FAIL a weaker copy replaced the item within the limit\n");
+        test_failed = 1;
+    }
+    item = wifi_mgmr_scan_table_update(&table, &scan, now + WIFI_MGMR_SCAN_UPDATE_LIMIT_TIME_MS);
+    if (item == NULL || item->rssi != -60 || table.count != 1) {
+        printf("FAIL a weaker copy did not replace the item after the limit\n");
+        test_failed = 1;
+    }
+}
+
+static double bench(int hashed)
+{
+    struct timespec start, end;
+    int r, i;
+
+    memset(old_items, 0, sizeof(old_items));
+    memset(&table, 0, sizeof(table));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (r = 0; r < 5; r++) {
+        for (i = 0; i < TEST_INDICATIONS; i++) {
+            if (hashed) {
+                wifi_mgmr_scan_table_update(&table, &trace[i], trace_time[i] + r * 100000000u);
+            } else {
+                old_update(&trace[i], trace_time[i] + r * 100000000u);
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / (5.0 * TEST_INDICATIONS);
+}
+
+int main(void)
+{
+    srand(7);
+    make_trace();
+
+    test_trace();
+    test_purge();
+    test_update_limit();
+    printf("linear %.1f ns, table %.1f ns per indication\n", bench(0), bench(1));
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
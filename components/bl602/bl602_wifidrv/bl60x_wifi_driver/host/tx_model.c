@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Linux model of the tx path: the real bl_tx.c and lwIP pbufs in front of
+ * a 4-entry descriptor ring and a link that sends one frame at a time at a
+ * fixed rate. A share of the frames comes back with the retry limit
+ * reached, as the firmware confirms them. Traffic is mixed:
+ *
+ *   VO  EF,   200 bytes every 20 ms
+ *   VI  AF41, 1000 bytes every 4 ms
+ *   BE  bulk, 1500 bytes, 24 frames in flight like a TCP window, every
+ *       third frame chained in 6 pbufs
+ *   BK  CS1,  1500 bytes every 3 ms
+ *
+ * for 10 s of virtual time, then until everything drained. Prints the
+ * per-class latency from bl_output() to the end of the frame on air and
+ * the drops, and fails if any frame is unaccounted for or lwIP memory is
+ * left in use. An optional bound fails the run if VO p99 is above it.
+ *
+ *   tx_model [link Mbit/s [retry limit % [VO p99 bound ms]]]
+ *
+ * Built with BL_TX_WMM 1 and 0 (everything as TID 0), see README.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lwip/init.h>
+#include <lwip/mem.h>
+#include <lwip/memp.h>
+#include <lwip/pbuf.h>
+#include <lwip/netif.h>
+#include <lwip/stats.h>
+
+/* Only the bits bl_tx.c and os_hal.h use, skip the FreeRTOS headers */
+#define INC_FREERTOS_H
+#define INC_TASK_H
+#define SEMAPHORE_H
+#define EVENT_GROUPS_H
+#define FREERTOS_MESSAGE_BUFFER_H
+#define TIMERS_H
+typedef void *TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef void *SemaphoreHandle_t;
+typedef void *TimerHandle_t;
+typedef struct { int dummy; } StaticEventGroup_t;
+typedef struct { int dummy; } StaticMessageBuffer_t;
+typedef struct { int dummy; } StaticTimer_t;
+#define taskENTER_CRITICAL()    do {} while (0)
+#define taskEXIT_CRITICAL()     do {} while (0)
+#define xTaskGetCurrentTaskHandle()  ((TaskHandle_t)1)
+#define xTaskNotifyGive(h)      ((void)(h))
+
+#include "../bl_tx.c"
+
+#define TEST_RING           4
+#define TEST_RUN_US         10000000ULL
+#define TEST_BE_WINDOW      24
+#define TEST_FRAMES_MAX     400000
+#define TEST_HDR_LEN        (14 + 20 + 4)
+
+enum {
+    TEST_VO,
+    TEST_VI,
+    TEST_BE,
+    TEST_BK,
+    TEST_CLASSES
+};
+
+static const char * const test_name[TEST_CLASSES] = {"VO(EF)", "VI(AF41)", "BE(bulk)", "BK(CS1)"};
+static const uint8_t test_dscp[TEST_CLASSES] = {46, 34, 0, 8};
+static const int test_len[TEST_CLASSES] = {200, 1000, 1500, 1500};
+/* us between frames, 0 for the saturating window */
+static const uint64_t test_period[TEST_CLASSES] = {20000, 4000, 0, 3000};
+
+struct bl_hw wifi_hw;
+
+static struct txdesc_host ring[TEST_RING];
+static void *ring_id[TEST_RING];
+static uint32_t ring_free, ring_used;
+
+static uint64_t now_us;
+static uint64_t frame_time[TEST_FRAMES_MAX];
+static uint8_t frame_class[TEST_FRAMES_MAX];
+static uint32_t frames;
+static uint32_t lat[TEST_CLASSES][TEST_FRAMES_MAX / 2];
+static uint32_t lat_cnt[TEST_CLASSES], drop_cnt[TEST_CLASSES];
+static uint32_t be_out;
+static int be_blocked;
+static struct netif test_netif;
+static unsigned int test_seed = 12345;
+
+void bl_irq_handler(void)
+{
+}
+
+int bl_utils_idx_lookup(struct bl_hw *bl_hw, uint8_t *mac)
+{
+    (void)bl_hw;
+    (void)mac;
+    return 0;
+}
+
+volatile struct txdesc_host *ipc_host_txdesc_get(struct ipc_host_env_tag *env)
+{
+    (void)env;
+    return (ring_free - ring_used < TEST_RING) ? &ring[ring_free % TEST_RING] : NULL;
+}
+
+void ipc_host_txdesc_push(struct ipc_host_env_tag *env, void *host_id)
+{
+    (void)env;
+    ring_id[ring_free % TEST_RING] = host_id;
+    ring_free++;
+}
+
+u32_t sys_now(void)
+{
+    return (u32_t)(now_us / 1000);
+}
+
+/* LWIP_RAND of the unix port's arch/cc.h */
+unsigned int lwip_port_rand(void)
+{
+    return (unsigned int)rand();
+}
+
+static unsigned int test_rand(void)
+{
+    test_seed = test_seed * 1103515245 + 12345;
+    return (test_seed >> 16) & 0x7fff;
+}
+
+static void frame_send(int c)
+{
+    int chained = (TEST_BE == c) && (0 == frames % 3);
+    struct pbuf *p, *q;
+    uint8_t *d;
+    int left, n, l;
+
+    if (frames >= TEST_FRAMES_MAX) {
+        printf("too many frames\n");
+        exit(1);
+    }
+    p = pbuf_alloc(PBUF_RAW_TX, chained ? TEST_HDR_LEN : test_len[c], PBUF_RAM);
+    if (NULL == p) {
+        printf("FAIL: lwIP heap exhausted after %u frames\n", frames);
+        exit(1);
+    }
+    d = p->payload;
+    memset(d, 0, p->len);
+    memcpy(d, "\x02\x00\x00\x00\x00\x01\x02\x00\x00\x00\x00\x02\x08\x00", 14);
+    d[14] = 0x45;
+    d[15] = test_dscp[c] << 2;
+    /* frame number where the IPv4 addresses would be */
+    memcpy(d + 34, &frames, 4);
+    if (chained) {
+        left = test_len[c] - TEST_HDR_LEN;
+        for (n = 5; n > 0; n--) {
+            l = (n > 1) ? left / n : left;
+            q = pbuf_alloc(PBUF_RAW, l, PBUF_RAM);
+            if (NULL == q) {
+                printf("FAIL: lwIP heap exhausted after %u frames\n", frames);
+                exit(1);
+            }
+            memset(q->payload, 0xab, l);
+            pbuf_cat(p, q);
+            left -= l;
+        }
+    }
+    frame_time[frames] = now_us;
+    frame_class[frames] = c;
+    frames++;
+    if (TEST_BE == c) {
+        be_out++;
+    }
+    if (ERR_OK != bl_output(&wifi_hw, &test_netif, p, 1)) {
+        drop_cnt[c]++;
+        if (TEST_BE == c) {
+            be_out--;
+            be_blocked = 1;
+        }
+    }
+    pbuf_free(p);
+}
+
+static void frame_done(uint32_t id, uint64_t end_us, int dropped)
+{
+    int c = frame_class[id];
+
+    if (dropped) {
+        drop_cnt[c]++;
+    } else {
+        lat[c][lat_cnt[c]++] = (uint32_t)(end_us - frame_time[id]);
+    }
+    if (TEST_BE == c) {
+        be_out--;
+    }
+}
+
+static int lat_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x < y) ? -1 : (x > y);
+}
+
+static uint32_t accounted(void)
+{
+    uint32_t n = 0;
+    int c;
+
+    for (c = 0; c < TEST_CLASSES; c++) {
+        n += lat_cnt[c] + drop_cnt[c];
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    double mbps = (argc > 1) ? atof(argv[1]) : 20;
+    int fail_pct = (argc > 2) ? atoi(argv[2]) : 5;
+    double vo_p99_max = (argc > 3) ? atof(argv[3]) : 0;
+    uint64_t next[TEST_CLASSES] = {0, 0, 0, 0};
+    uint64_t air_end = 0, t;
+    uint32_t air_slot = 0, cfm_status = 0, id;
+    int air_busy = 0, failed = 0, c;
+    mem_size_t heap_used;
+    struct hostdesc *h;
+    struct bl_txhdr *txhdr;
+
+    lwip_init();
+    test_netif.flags = NETIF_FLAG_LINK_UP;
+    wifi_hw.ipc_env = (void *)1;
+    bl_tx_init();
+    heap_used = lwip_stats.mem.used;
+
+    while ((now_us < TEST_RUN_US) || be_out || air_busy || (ring_used != ring_free) || (accounted() < frames)) {
+        /* next event: a frame to send or the end of the one on air */
+        t = air_busy ? air_end : (uint64_t)-1;
+        if (now_us < TEST_RUN_US) {
+            for (c = 0; c < TEST_CLASSES; c++) {
+                if (test_period[c] && next[c] < t) {
+                    t = next[c];
+                }
+            }
+            if ((be_out < TEST_BE_WINDOW) && !be_blocked) {
+                t = now_us;
+            }
+        }
+        if ((uint64_t)-1 == t) {
+            break;
+        }
+        now_us = t;
+        if (now_us < TEST_RUN_US) {
+            for (c = 0; c < TEST_CLASSES; c++) {
+                if (test_period[c] && next[c] <= now_us) {
+                    frame_send(c);
+                    next[c] += test_period[c];
+                }
+            }
+            while ((be_out < TEST_BE_WINDOW) && !be_blocked) {
+                frame_send(TEST_BE);
+            }
+        }
+        if (air_busy && air_end <= now_us) {
+            /* the firmware confirms the frame */
+            h = &ring[air_slot % TEST_RING].host;
+            *(volatile uint32_t *)(uintptr_t)h->status_addr = cfm_status;
+            if (0 == bl_txdatacfm(NULL, ring_id[air_slot % TEST_RING])) {
+                ring_id[air_slot % TEST_RING] = NULL;
+                ring_used++;
+            }
+            air_busy = 0;
+            be_blocked = 0;
+            bl_tx_resend();
+        }
+        bl_tx_try_flush();
+        if (!air_busy && (ring_used != ring_free)) {
+            h = &ring[ring_used % TEST_RING].host;
+            memcpy(&id, (uint8_t *)(uintptr_t)h->pbuf_chained_ptr[0] + 20, 4);
+            air_slot = ring_used;
+            air_busy = 1;
+            air_end = now_us + 100 + (uint64_t)((h->packet_len + 14 + 40) * 8 / mbps);
+            cfm_status = ((int)(test_rand() % 100) < fail_pct) ? (1u << 16) | 1 : 1;
+            if (!(cfm_status >> 16)) {
+                frame_done(id, air_end, 0);
+            } else {
+                /* the driver gives up once it resent the frame BL_TX_RESEND_MAX times */
+                txhdr = (struct bl_txhdr *)(uintptr_t)(h->status_addr - offsetof(struct bl_txhdr, status));
+                if (txhdr->resend >= BL_TX_RESEND_MAX) {
+                    frame_done(id, air_end, 1);
+                }
+            }
+        }
+    }
+
+    printf("link %.0f Mbit/s, %d%% retry limit, %s\n", mbps, fail_pct,
+            BL_TX_WMM ? "per-AC queues" : "single queue (TID 0)");
+    printf("%-9s %7s %6s %9s %9s %9s %9s\n", "class", "frames", "drops", "avg ms", "p50 ms", "p99 ms", "max ms");
+    for (c = 0; c < TEST_CLASSES; c++) {
+        double sum = 0;
+        uint32_t i, n = lat_cnt[c];
+
+        if (0 == n) {
+            printf("%-9s %7u %6u\n", test_name[c], n, drop_cnt[c]);
+            continue;
+        }
+        qsort(lat[c], n, sizeof(uint32_t), lat_cmp);
+        for (i = 0; i < n; i++) {
+            sum += lat[c][i];
+        }
+        printf("%-9s %7u %6u %9.2f %9.2f %9.2f %9.2f\n", test_name[c], n, drop_cnt[c], sum / n / 1000,
+                lat[c][n / 2] / 1000.0, lat[c][(uint32_t)(n * 0.99)] / 1000.0, lat[c][n - 1] / 1000.0);
+    }
+    bl_tx_dump_stats();
+
+    if (accounted() != frames) {
+        printf("FAIL: %u frames sent, %u accounted for\n", frames, accounted());
+        failed = 1;
+    }
+    if ((lwip_stats.mem.used != heap_used) || lwip_stats.memp[MEMP_PBUF]->used) {
+        printf("FAIL: lwIP heap %u bytes, %u pbufs left in use\n",
+                (unsigned int)(lwip_stats.mem.used - heap_used), (unsigned int)lwip_stats.memp[MEMP_PBUF]->used);
+        failed = 1;
+    }
+    if (vo_p99_max > 0) {
+        if (!lat_cnt[TEST_VO] || drop_cnt[TEST_VO] ||
+                (lat[TEST_VO][(uint32_t)(lat_cnt[TEST_VO] * 0.99)] / 1000.0 > vo_p99_max)) {
+            printf("FAIL: VO dropped frames or p99 above %.1f ms\n", vo_p99_max);
+            failed = 1;
+        }
+    }
+    printf("%s\n", failed ? "FAILED" : "PASSED");
+    return failed;
+}
@@ -35,6 +35,7 @@
 #include "reg_ipc_app.h"
 #include "bl_cmds.h"
 #include "bl_utils.h"
+#include "bl_tx.h"
 #include "os_hal.h"
 
 #define REG_SW_SET_PROFILING(env, value)   do{  }while(0)
@@ -47,8 +48,6 @@
 #undef os_printf
 #define os_printf(...) do {} while(0)
 
-extern struct utils_list tx_list_bl;
-
 static const int nx_txdesc_cnt[] =
 {
     NX_TXDESC_CNT0,
@@ -84,7 +83,7 @@ extern int internel_cal_size_tx_hdr;
             internel_cal_size_tx_hdr,
             internel_cal_size_tx_desc + internel_cal_size_tx_hdr
     );
-    utils_list_init(&tx_list_bl);
+    bl_tx_init();
 #if 0
 
 /**
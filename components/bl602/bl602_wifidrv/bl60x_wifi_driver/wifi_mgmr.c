@@ -154,12 +154,6 @@ char *wifi_mgmr_cipher_to_str(uint8_t cipher)
 
 static bool stateGlobalGuard_scan_beacon( void *ch, struct event *event )
 {
-#define SCAN_UPDATE_LIMIT_TIME_MS (3000)
-
-    int i, empty = -1, oldest = -1;
-    uint32_t lastseen = 0xFFFFFFFF;
-    uint32_t counter = 0;
-    uint32_t lastseen_found = 0;
     wifi_mgmr_msg_t *msg;
     wifi_mgmr_scan_item_t *scan;
 
@@ -192,65 +186,9 @@ static bool stateGlobalGuard_scan_beacon( void *ch, struct event *event )
         goto __exit;
     }
 
-    /*update scan_items, we just store the newly found item, or update exsiting one*/
-    counter = os_tick_get();
-    for (i = 0; i < sizeof(wifiMgmr.scan_items)/sizeof(wifiMgmr.scan_items[0]); i++) {
-        if(wifiMgmr.scan_items[i].channel > wifiMgmr.channel_nums){
-            memset(&wifiMgmr.scan_items[i], 0, sizeof(wifi_mgmr_scan_item_t));
-            wifiMgmr.scan_items[i].is_used = 0;
-        }
-
-        if (wifiMgmr.scan_items[i].is_used) {
-            /*track the oldest scan_item*/
-            if ((0 == lastseen_found) ||
-                ((int32_t)wifiMgmr.scan_items[i].timestamp_lastseen - (int32_t)lastseen < 0)) {
-                lastseen_found = 1;
-                lastseen = wifiMgmr.scan_items[i].timestamp_lastseen;
-                oldest = i;
-            }
-
-            /*bssid and ssid must be the same at the same time*/
-            if (0 == memcmp(wifiMgmr.scan_items[i].bssid, scan->bssid, sizeof(scan->bssid)) &&
-                    0 == strcmp(scan->ssid, wifiMgmr.scan_items[i].ssid)) {
-
-                /*exactly the same scan item found*/
-                if ((scan->rssi < wifiMgmr.scan_items[i].rssi) &&
-                    ((int32_t)os_tick_get() - (int32_t)wifiMgmr.scan_items[i].timestamp_lastseen < SCAN_UPDATE_LIMIT_TIME_MS)) {
-
-                    blog_info("skip update %s with rssi %d\r\n", scan->ssid, scan->rssi);
-
-                } else {
-
-                    wifiMgmr.scan_items[i].channel = scan->channel;
-                    wifiMgmr.scan_items[i].rssi = scan->rssi;
-                    wifiMgmr.scan_items[i].ppm_abs = scan->ppm_abs;
-                    wifiMgmr.scan_items[i].ppm_rel = scan->ppm_rel;
-                    wifiMgmr.scan_items[i].timestamp_lastseen = counter;
-                    wifiMgmr.scan_items[i].auth = scan->auth;
-                    wifiMgmr.scan_items[i].cipher = scan->cipher;
-                }
-                break;
-            }
-        } else {
-            empty  = i;
-        }
-    }
-    if (i == sizeof(wifiMgmr.scan_items)/sizeof(wifiMgmr.scan_items[0])) {
-        /*no valid item found in database, so try to store this newly found*/
-        i = (-1 != empty) ? empty : oldest;
-        if (-1 != i) {
-            memset(&wifiMgmr.scan_items[i], 0, sizeof(wifiMgmr.scan_items[0]));
-            strncpy(wifiMgmr.scan_items[i].ssid, scan->ssid, sizeof(wifiMgmr.scan_items[0].ssid));
-            wifiMgmr.scan_items[i].ssid_tail[0] = '\0';
-            wifiMgmr.scan_items[i].ssid_len = strlen(wifiMgmr.scan_items[i].ssid);
-            memcpy(wifiMgmr.scan_items[i].bssid, scan->bssid, sizeof(wifiMgmr.scan_items[i].bssid));
-            wifiMgmr.scan_items[i].channel = scan->channel;
-            wifiMgmr.scan_items[i].rssi = scan->rssi;
-            wifiMgmr.scan_items[i].timestamp_lastseen = counter;
-            wifiMgmr.scan_items[i].auth = scan->auth;
-            wifiMgmr.scan_items[i].cipher = scan->cipher;
-            wifiMgmr.scan_items[i].is_used = 1;
-        }
+    /*update scan_table, we just store the newly found item, or update exsiting one*/
+    if (NULL == wifi_mgmr_scan_table_update(&(wifiMgmr.scan_table), scan, os_tick_get())) {
+        blog_info("skip update %s with rssi %d\r\n", scan->ssid, scan->rssi);
     }
 
 __exit:
@@ -1538,6 +1476,7 @@ int wifi_mgmr_set_country_code_internal(char *country_code)
     wifiMgmr.country_code[2] = '\0';
     wifiMgmr.channel_nums = bl_main_get_channel_nums();
     blog_info("country code:%s, support channel nums:%d\r\n", wifiMgmr.country_code, wifiMgmr.channel_nums);
+    wifi_mgmr_scan_table_purge_channel(&(wifiMgmr.scan_table), wifiMgmr.channel_nums);
 
     return 0;
 }
@@ -34,8 +34,8 @@
 #include "include/wifi_mgmr_ext.h"
 #include "stateMachine.h"
 #include "os_hal.h"
+#include "wifi_mgmr_scan.h"
 
-#define WIFI_MGMR_SCAN_ITEMS_MAX (50)
 #define WIFI_MGMR_PROFILES_MAX (2)
 #define WIFI_MGMR_MQ_MSG_SIZE (128 + 64 + 32)
 #define WIFI_MGMR_MQ_MSG_COUNT (10)
@@ -189,21 +189,6 @@ typedef struct
     uint8_t rsvd : 4;
 } wifi_mgmr_cipher_t;
 
-typedef struct wifi_mgmr_scan_item {
-    char ssid[32];
-    char ssid_tail[1];//always put ssid_tail after ssid
-    uint32_t ssid_len;
-    uint8_t bssid[6];
-    uint8_t channel;
-    int8_t rssi;
-    int8_t ppm_abs;
-    int8_t ppm_rel;
-    uint8_t auth;
-    uint8_t cipher;
-    uint8_t is_used;
-    uint32_t timestamp_lastseen;
-} wifi_mgmr_scan_item_t;
-
 struct wlan_netif {
     int mode;//0: sta; 1: ap
     uint8_t vif_index;
@@ -259,7 +244,7 @@ typedef struct wifi_mgmr {
     wifi_mgmr_profile_t profiles[WIFI_MGMR_PROFILES_MAX];
     int profile_active_index;
 
-    wifi_mgmr_scan_item_t scan_items[WIFI_MGMR_SCAN_ITEMS_MAX];
+    wifi_mgmr_scan_table_t scan_table;
     os_messagequeue_t mq;
     uint8_t mq_pool[WIFI_MGMR_MQ_MSG_SIZE*WIFI_MGMR_MQ_MSG_COUNT];
     struct stateMachine m;
@@ -44,6 +44,8 @@
 #include <utils_getopt.h>
 #include <wifi_mgmr_ext.h>
 
+#include "bl_tx.h"
+
 #define WIFI_AP_DATA_RATE_1Mbps      0x00
 #define WIFI_AP_DATA_RATE_2Mbps      0x01
 #define WIFI_AP_DATA_RATE_5_5Mbps    0x02
@@ -259,6 +261,11 @@ static void wifi_edca_dump_cmd(char *buf, int len, int argc, char **argv)
     );
 }
 
+static void wifi_tx_queue_dump_cmd(char *buf, int len, int argc, char **argv)
+{
+    bl_tx_dump_stats();
+}
+
 int wifi_mgmr_cli_powersaving_on()
 {
     wifi_mgmr_api_fw_powersaving(2);
@@ -271,23 +278,23 @@ int wifi_mgmr_cli_scanlist(void)
 
     printf("cached scan list\r\n");
     printf("****************************************************************************************************\r\n");
-    for (i = 0; i < sizeof(wifiMgmr.scan_items)/sizeof(wifiMgmr.scan_items[0]); i++) {
-        if (wifiMgmr.scan_items[i].is_used && (!wifi_mgmr_scan_item_is_timeout(&wifiMgmr, &wifiMgmr.scan_items[i]))) {
+    for (i = 0; i < sizeof(wifiMgmr.scan_table.items)/sizeof(wifiMgmr.scan_table.items[0]); i++) {
+        if (wifiMgmr.scan_table.items[i].is_used && (!wifi_mgmr_scan_item_is_timeout(&wifiMgmr, &wifiMgmr.scan_table.items[i]))) {
             printf("index[%02d]: channel %02u, bssid %02X:%02X:%02X:%02X:%02X:%02X, rssi %3d, ppm abs:rel %3d : %3d, auth %20s, cipher:%12s, SSID %s\r\n",
                     i,
-                    wifiMgmr.scan_items[i].channel,
-                    wifiMgmr.scan_items[i].bssid[0],
-                    wifiMgmr.scan_items[i].bssid[1],
-                    wifiMgmr.scan_items[i].bssid[2],
-                    wifiMgmr.scan_items[i].bssid[3],
-                    wifiMgmr.scan_items[i].bssid[4],
-                    wifiMgmr.scan_items[i].bssid[5],
-                    wifiMgmr.scan_items[i].rssi,
-                    wifiMgmr.scan_items[i].ppm_abs,
-                    wifiMgmr.scan_items[i].ppm_rel,
-                    wifi_mgmr_auth_to_str(wifiMgmr.scan_items[i].auth),
-                    wifi_mgmr_cipher_to_str(wifiMgmr.scan_items[i].cipher),
-                    wifiMgmr.scan_items[i].ssid
+                    wifiMgmr.scan_table.items[i].channel,
+                    wifiMgmr.scan_table.items[i].bssid[0],
+                    wifiMgmr.scan_table.items[i].bssid[1],
+                    wifiMgmr.scan_table.items[i].bssid[2],
+                    wifiMgmr.scan_table.items[i].bssid[3],
+                    wifiMgmr.scan_table.items[i].bssid[4],
+                    wifiMgmr.scan_table.items[i].bssid[5],
+                    wifiMgmr.scan_table.items[i].rssi,
+                    wifiMgmr.scan_table.items[i].ppm_abs,
+                    wifiMgmr.scan_table.items[i].ppm_rel,
+                    wifi_mgmr_auth_to_str(wifiMgmr.scan_table.items[i].auth),
+                    wifi_mgmr_cipher_to_str(wifiMgmr.scan_table.items[i].cipher),
+                    wifiMgmr.scan_table.items[i].ssid
             );
         } else {
             printf("index[%02d]: empty\r\n", i);
@@ -978,6 +985,7 @@ static const struct cli_command cmds_user[] STATIC_CLI_CMD_ATTRIBUTE = {
         { "wifi_sta_list", "get sta list in AP mode", wifi_ap_sta_list_get_cmd},
         { "wifi_sta_del", "delete one sta in AP mode", wifi_ap_sta_delete_cmd},
         { "wifi_edca_dump", "dump EDCA data", wifi_edca_dump_cmd},
+        { "wifi_tx_queue", "dump tx queue statistic per AC", wifi_tx_queue_dump_cmd},
         { "wifi_state", "get wifi_state", cmd_wifi_state_get},
         { "wifi_update_power", "Power table test command", cmd_wifi_power_table_update},
 };
@@ -684,48 +684,34 @@ int wifi_mgmr_scan_complete_callback()
 
 int wifi_mgmr_scan_ap(char *ssid, wifi_mgmr_ap_item_t *item)
 {
-    int i, index = -1;
-    int8_t rssi = -127;//FIXME magic here?
     wifi_mgmr_scan_item_t *scan;
 
-    for (i = 0; i < sizeof(wifiMgmr.scan_items)/sizeof(wifiMgmr.scan_items[0]); i++) {
-        if (wifiMgmr.scan_items[i].is_used &&
-                (!wifi_mgmr_scan_item_is_timeout(&wifiMgmr, &(wifiMgmr.scan_items[i]))) && 0 == strcmp(wifiMgmr.scan_items[i].ssid, ssid)) {
-            /*found the ssid*/
-            index = i;
-            if (wifiMgmr.scan_items[i].rssi > rssi) {
-                /*found ap with better rssi*/
-                rssi = wifiMgmr.scan_items[i].rssi;
-            }
-            break;
-        }
-    }
-    if ((sizeof(wifiMgmr.scan_items)/sizeof(wifiMgmr.scan_items[0]) != i) && (index >= 0)) {
-        /*proper item found, copy back data now*/
-        //TODO FIXME we should scan the ap from the cache within the Wi-Fi manager thread
-        scan = &wifiMgmr.scan_items[index];
-        memcpy(item->ssid, scan->ssid, sizeof(item->ssid));
-        item->ssid_tail[0] = '\0';
-        item->ssid_len = strlen(item->ssid);
-        memcpy(item->bssid, scan->bssid, sizeof(item->bssid));
-        item->channel = scan->channel;
-        item->rssi = scan->rssi;
-    } else {
+    //TODO FIXME we should scan the ap from the cache within the Wi-Fi manager thread
+    scan = wifi_mgmr_scan_table_best(&(wifiMgmr.scan_table), ssid, os_tick_get(), wifiMgmr.scan_item_timeout);
+    if (NULL == scan) {
         return -1;
     }
 
+    /*ap with the best rssi found, copy back data now*/
+    memcpy(item->ssid, scan->ssid, sizeof(item->ssid));
+    item->ssid_tail[0] = '\0';
+    item->ssid_len = strlen(item->ssid);
+    memcpy(item->bssid, scan->bssid, sizeof(item->bssid));
+    item->channel = scan->channel;
+    item->rssi = scan->rssi;
+
     return 0;
 }
 
+/*strongest ap first*/
 int wifi_mgmr_scan_ap_all(wifi_mgmr_ap_item_t *env, uint32_t *param1, scan_item_cb_t cb)
 {
     int i;
     wifi_mgmr_scan_item_t *scan;
     wifi_mgmr_ap_item_t item;
 
-    for (i = 0; i < sizeof(wifiMgmr.scan_items)/sizeof(wifiMgmr.scan_items[0]); i++) {
-        scan = &wifiMgmr.scan_items[i];
-        if (scan->is_used && (!wifi_mgmr_scan_item_is_timeout(&wifiMgmr, &(wifiMgmr.scan_items[i])))) {
+    for (i = 0; NULL != (scan = wifi_mgmr_scan_table_by_rssi(&(wifiMgmr.scan_table), i)); i++) {
+        if (scan->is_used && (!wifi_mgmr_scan_item_is_timeout(&wifiMgmr, scan))) {
             /*convert internal scan results to ext_scan_result*/
             memcpy(item.ssid, scan->ssid, sizeof(item.ssid));
             item.ssid_tail[0] = '\0';
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "wifi_mgmr_scan.h"
+
+#if WIFI_MGMR_SCAN_ITEMS_MAX > 254
+#error "scan table links are uint8_t slot + 1"
+#endif
+
+#define SLOT(link)          ((link) - 1)
+#define LINK(slot)          ((uint8_t)((slot) + 1))
+
+static uint32_t _bssid_hash(const uint8_t bssid[6])
+{
+    uint32_t v;
+
+    /*OUI is shared by many APs, hash the NIC specific part*/
+    v = ((uint32_t)bssid[2] << 24) | ((uint32_t)bssid[3] << 16) | ((uint32_t)bssid[4] << 8) | bssid[5];
+    return ((v * 2654435761U) >> 16) & (WIFI_MGMR_SCAN_BSSID_HASH_SIZE - 1);
+}
+
+static uint32_t _ssid_hash(const char *ssid, uint32_t len)
+{
+    uint32_t h = 2166136261U;
+
+    while (len--) {
+        h = (h ^ (uint8_t)*ssid++) * 16777619U;
+    }
+    return h & (WIFI_MGMR_SCAN_SSID_HASH_SIZE - 1);
+}
+
+static void _chain_unlink(uint8_t *head, uint8_t *next, int slot)
+{
+    uint8_t *link;
+
+    for (link = head; *link; link = &next[SLOT(*link)]) {
+        if (SLOT(*link) == slot) {
+            *link = next[slot];
+            next[slot] = 0;
+            return;
+        }
+    }
+}
+
+static void _lru_unlink(wifi_mgmr_scan_table_t *table, int slot)
+{
+    uint8_t newer = table->lru_newer[slot];
+    uint8_t older = table->lru_older[slot];
+
+    if (newer) {
+        table->lru_older[SLOT(newer)] = older;
+    } else {
+        table->lru_newest = older;
+    }
+    if (older) {
+        table->lru_newer[SLOT(older)] = newer;
+    } else {
+        table->lru_oldest = newer;
+    }
+    table->lru_newer[slot] = 0;
+    table->lru_older[slot] = 0;
+}
+
+static void _lru_push(wifi_mgmr_scan_table_t *table, int slot)
+{
+    table->lru_newer[slot] = 0;
+    table->lru_older[slot] = table->lru_newest;
+    if (table->lru_newest) {
+        table->lru_newer[SLOT(table->lru_newest)] = LINK(slot);
+    } else {
+        table->lru_oldest = LINK(slot);
+    }
+    table->lru_newest = LINK(slot);
+}
+
+static void _rank_set(wifi_mgmr_scan_table_t *table, int pos, int slot)
+{
+    table->by_rssi[pos] = LINK(slot);
+    table->rssi_rank[slot] = pos;
+}
+
+/*move slot to its place in by_rssi after its rssi changed*/
+static void _rank_fix(wifi_mgmr_scan_table_t *table, int slot)
+{
+    int pos = table->rssi_rank[slot];
+    int8_t rssi = table->items[slot].rssi;
+
+    while (pos > 0 && table->items[SLOT(table->by_rssi[pos - 1])].rssi < rssi) {
+        _rank_set(table, pos, SLOT(table->by_rssi[pos - 1]));
+        pos--;
+    }
+    while (pos + 1 < table->count && table->items[SLOT(table->by_rssi[pos + 1])].rssi > rssi) {
+        _rank_set(table, pos, SLOT(table->by_rssi[pos + 1]));
+        pos++;
+    }
+    _rank_set(table, pos, slot);
+}
+
+/*unlink slot from the hash chains and the lru list, it keeps its rank*/
+static void _detach(wifi_mgmr_scan_table_t *table, int slot)
+{
+    wifi_mgmr_scan_item_t *item = &table->items[slot];
+
+    _chain_unlink(&table->bssid_hash[_bssid_hash(item->bssid)], table->bssid_next, slot);
+    _chain_unlink(&table->ssid_hash[_ssid_hash(item->ssid, item->ssid_len)], table->ssid_next, slot);
+    _lru_unlink(table, slot);
+    memset(item, 0, sizeof(wifi_mgmr_scan_item_t));
+}
+
+static void _remove(wifi_mgmr_scan_table_t *table, int slot)
+{
+    int pos;
+
+    _detach(table, slot);
+    for (pos = table->rssi_rank[slot]; pos + 1 < table->count; pos++) {
+        _rank_set(table, pos, SLOT(table->by_rssi[pos + 1]));
+    }
+    table->count--;
+    table->by_rssi[table->count] = 0;
+    table->rssi_rank[slot] = 0;
+
+    table->bssid_next[slot] = table->free_list;
+    table->free_list = LINK(slot);
+}
+
+/*
+ * Get a slot for a new item, it already has a place in by_rssi. When the
+ * table is full the item not seen for the longest time is evicted and its
+ * slot reused in place, so the rank only moves by the rssi difference.
+ */
+static int _alloc(wifi_mgmr_scan_table_t *table)
+{
+    int slot;
+
+    if (table->free_list) {
+        slot = SLOT(table->free_list);
+        table->free_list = table->bssid_next[slot];
+        table->bssid_next[slot] = 0;
+    } else if (table->fresh < WIFI_MGMR_SCAN_ITEMS_MAX) {
+        slot = table->fresh++;
+    } else {
+        slot = SLOT(table->lru_oldest);
+        _detach(table, slot);
+        return slot;
+    }
+    _rank_set(table, table->count++, slot);
+
+    return slot;
+}
+
+wifi_mgmr_scan_item_t *wifi_mgmr_scan_table_update(wifi_mgmr_scan_table_t *table, const wifi_mgmr_scan_item_t *scan, uint32_t now)
+{
+    wifi_mgmr_scan_item_t *item;
+    uint32_t len, hash;
+    uint8_t link;
+    int slot;
+
+    /*hidden SSID may come as zeros, it is the empty SSID then*/
+    len = strlen(scan->ssid);
+    hash = _bssid_hash(scan->bssid);
+
+    /*bssid and ssid must be the same at the same time*/
+    for (link = table->bssid_hash[hash]; link; link = table->bssid_next[SLOT(link)]) {
+        item = &table->items[SLOT(link)];
+        if (0 == memcmp(item->bssid, scan->bssid, sizeof(item->bssid)) &&
+                item->ssid_len == len && 0 == memcmp(item->ssid, scan->ssid, len)) {
+            break;
+        }
+    }
+
+    if (link) {
+        slot = SLOT(link);
+        if ((scan->rssi < item->rssi) &&
+                ((int32_t)(now - item->timestamp_lastseen) < WIFI_MGMR_SCAN_UPDATE_LIMIT_TIME_MS)) {
+            return NULL;
+        }
+        item->channel = scan->channel;
+        item->rssi = scan->rssi;
+        item->ppm_abs = scan->ppm_abs;
+        item->ppm_rel = scan->ppm_rel;
+        item->timestamp_lastseen = now;
+        item->auth = scan->auth;
+        item->cipher = scan->cipher;
+        _lru_unlink(table, slot);
+        _lru_push(table, slot);
+        _rank_fix(table, slot);
+        return item;
+    }
+
+    slot = _alloc(table);
+    item = &table->items[slot];
+    memcpy(item->ssid, scan->ssid, len);
+    item->ssid_tail[0] = '\0';
+    item->ssid_len = len;
+    memcpy(item->bssid, scan->bssid, sizeof(item->bssid));
+    item->channel = scan->channel;
+    item->rssi = scan->rssi;
+    item->ppm_abs = scan->ppm_abs;
+    item->ppm_rel = scan->ppm_rel;
+    item->timestamp_lastseen = now;
+    item->auth = scan->auth;
+    item->cipher = scan->cipher;
+    item->is_used = 1;
+
+    table->bssid_next[slot] = table->bssid_hash[hash];
+    table->bssid_hash[hash] = LINK(slot);
+    hash = _ssid_hash(item->ssid, len);
+    table->ssid_next[slot] = table->ssid_hash[hash];
+    table->ssid_hash[hash] = LINK(slot);
+    _lru_push(table, slot);
+    _rank_fix(table, slot);
+
+    return item;
+}
+
+void wifi_mgmr_scan_table_purge_channel(wifi_mgmr_scan_table_t *table, int channel_max)
+{
+    int slot;
+
+    for (slot = 0; slot < table->fresh; slot++) {
+        if (table->items[slot].is_used && table->items[slot].channel > channel_max) {
+            _remove(table, slot);
+        }
+    }
+}
+
+wifi_mgmr_scan_item_t *wifi_mgmr_scan_table_best(wifi_mgmr_scan_table_t *table, const char *ssid, uint32_t now, uint32_t timeout)
+{
+    wifi_mgmr_scan_item_t *item, *best = NULL;
+    uint32_t len;
+    uint8_t link;
+
+    len = strlen(ssid);
+    if (len > sizeof(item->ssid)) {
+        return NULL;
+    }
+    for (link = table->ssid_hash[_ssid_hash(ssid, len)]; link; link = table->ssid_next[SLOT(link)]) {
+        item = &table->items[SLOT(link)];
+        if (item->ssid_len == len && 0 == memcmp(item->ssid, ssid, len) &&
+                (now - item->timestamp_lastseen) < timeout &&
+                (NULL == best || item->rssi > best->rssi)) {
+            best = item;
+        }
+    }
+
+    return best;
+}
+
+wifi_mgmr_scan_item_t *wifi_mgmr_scan_table_by_rssi(wifi_mgmr_scan_table_t *table, int rank)
+{
+    uint8_t link;
+
+    if (rank < 0 || rank >= table->count) {
+        return NULL;
+    }
+    link = table->by_rssi[rank];
+
+    return link ? &table->items[SLOT(link)] : NULL;
+}
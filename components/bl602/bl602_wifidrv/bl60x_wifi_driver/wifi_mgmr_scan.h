@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __WIFI_MGMR_SCAN_H__
+#define __WIFI_MGMR_SCAN_H__
+#include <stdint.h>
+
+#define WIFI_MGMR_SCAN_ITEMS_MAX (50)
+/*both MUST be power of 2*/
+#define WIFI_MGMR_SCAN_BSSID_HASH_SIZE (64)
+#define WIFI_MGMR_SCAN_SSID_HASH_SIZE (16)
+/*a weaker copy of a known BSS within this time doesn't replace the stronger one*/
+#define WIFI_MGMR_SCAN_UPDATE_LIMIT_TIME_MS (3000)
+
+typedef struct wifi_mgmr_scan_item {
+    char ssid[32];
+    char ssid_tail[1];//always put ssid_tail after ssid
+    uint32_t ssid_len;
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;
+    int8_t ppm_abs;
+    int8_t ppm_rel;
+    uint8_t auth;
+    uint8_t cipher;
+    uint8_t is_used;
+    uint32_t timestamp_lastseen;
+} wifi_mgmr_scan_item_t;
+
+/*
+ * Scan result cache, one item per BSSID and SSID pair, at most
+ * WIFI_MGMR_SCAN_ITEMS_MAX of them.
+ *
+ * Items are found through a hash of the BSSID, grouped by SSID for best AP
+ * lookup, linked from the newest to the oldest seen for eviction, and kept
+ * in an array ordered by RSSI, strongest first. All links are slot + 1 with
+ * 0 for none, so a zeroed table is a valid empty one.
+ *
+ * Nothing here knows about firmware messages or OS ticks, times are passed
+ * in by the caller.
+ */
+typedef struct wifi_mgmr_scan_table {
+    wifi_mgmr_scan_item_t items[WIFI_MGMR_SCAN_ITEMS_MAX];
+    uint8_t bssid_hash[WIFI_MGMR_SCAN_BSSID_HASH_SIZE];
+    uint8_t bssid_next[WIFI_MGMR_SCAN_ITEMS_MAX];//also links the free slots
+    uint8_t ssid_hash[WIFI_MGMR_SCAN_SSID_HASH_SIZE];
+    uint8_t ssid_next[WIFI_MGMR_SCAN_ITEMS_MAX];
+    uint8_t lru_newer[WIFI_MGMR_SCAN_ITEMS_MAX];
+    uint8_t lru_older[WIFI_MGMR_SCAN_ITEMS_MAX];
+    uint8_t lru_newest;
+    uint8_t lru_oldest;
+    uint8_t by_rssi[WIFI_MGMR_SCAN_ITEMS_MAX];
+    uint8_t rssi_rank[WIFI_MGMR_SCAN_ITEMS_MAX];//position in by_rssi of each slot
+    uint8_t count;
+    uint8_t fresh;//slots never used yet start from here
+    uint8_t free_list;
+} wifi_mgmr_scan_table_t;
+
+/*
+ * Store a scan result, inserting it or updating the known item, the oldest
+ * item is evicted when the table is full. Return the item, or NULL when the
+ * update was skipped for a weaker signal.
+ */
+wifi_mgmr_scan_item_t *wifi_mgmr_scan_table_update(wifi_mgmr_scan_table_t *table, const wifi_mgmr_scan_item_t *scan, uint32_t now);
+/*drop the items on a channel above channel_max*/
+void wifi_mgmr_scan_table_purge_channel(wifi_mgmr_scan_table_t *table, int channel_max);
+/*strongest item with this ssid seen within timeout, NULL if none*/
+wifi_mgmr_scan_item_t *wifi_mgmr_scan_table_best(wifi_mgmr_scan_table_t *table, const char *ssid, uint32_t now, uint32_t timeout);
+/*
+ * Item at rank in RSSI order, NULL past the last one. Readers in other tasks
+ * get a loose snapshot, the same as with the plain array before.
+ */
+wifi_mgmr_scan_item_t *wifi_mgmr_scan_table_by_rssi(wifi_mgmr_scan_table_t *table, int rank);
+#endif
@@ -28,6 +28,7 @@ COMPONENT_SRCS := bl60x_wifi_driver/ipc_host.c \
 				  bl60x_wifi_driver/wifi_mgmr_cli.c \
 				  bl60x_wifi_driver/wifi_mgmr_ext.c \
 				  bl60x_wifi_driver/wifi_mgmr_profile.c \
+				  bl60x_wifi_driver/wifi_mgmr_scan.c \
 				  bl60x_wifi_driver/wifi_netif.c \
 				  bl60x_wifi_driver/wifi_mgmr_event.c
 
@@ -15,8 +15,17 @@ COMPONENT_OBJS := $(patsubst %.c,%.o, \
                     panic/panic_c.c \
                     portable/GCC/RISC-V/port.c \
                     portable/GCC/RISC-V/portASM.S \
-                    bl602_port.c \
-                    portable/MemMang/heap_bl602.c)
+                    bl602_port.c)
+
+ifeq ($(CONFIG_FREERTOS_HEAP_TLSF),1)
+COMPONENT_OBJS += portable/MemMang/heap_tlsf.o
+else
+COMPONENT_OBJS += portable/MemMang/heap_bl602.o
+endif
+
+ifeq ($(CONFIG_FREERTOS_HEAP_TRACE),1)
+COMPONENT_OBJS += portable/MemMang/heap_trace.o
+endif
 
 COMPONENT_OBJS := $(patsubst %.S,%.o, $(COMPONENT_OBJS))
 
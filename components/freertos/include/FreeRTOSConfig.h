@@ -114,9 +114,16 @@
 #define configUSE_MALLOC_FAILED_HOOK    1
 #define configUSE_APPLICATION_TASK_TAG  0
 #define configUSE_COUNTING_SEMAPHORES   1
+#ifndef configGENERATE_RUN_TIME_STATS
+//Set by CONFIG_FREERTOS_RUNTIME_STATS in proj_config.mk
 #define configGENERATE_RUN_TIME_STATS   0
+#endif
 #define configUSE_PORT_OPTIMISED_TASK_SELECTION 1
 #define configNUM_THREAD_LOCAL_STORAGE_POINTERS 1
+#ifndef configUSE_HEAP_TRACE
+//Set by CONFIG_FREERTOS_HEAP_TRACE in proj_config.mk
+#define configUSE_HEAP_TRACE            0
+#endif
 
 /* Co-routine definitions. */
 #define configUSE_CO_ROUTINES           0
@@ -145,6 +152,13 @@ to exclude the API function. */
 #define INCLUDE_eTaskGetState           1
 #define INCLUDE_xTimerPendFunctionCall  1
 #define INCLUDE_uxTaskGetStackHighWaterMark 1
+#define INCLUDE_xTaskGetIdleTaskHandle  configGENERATE_RUN_TIME_STATS
+
+#if ( configGENERATE_RUN_TIME_STATS == 1 )
+/* Run time is counted in mtime ticks (10MHz), the low word wraps every ~7min */
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()    ( *( volatile uint32_t * ) ( configMTIME_BASE_ADDRESS ) )
+#endif
 
 /* Normal assert() semantics without relying on the provision of an assert.h
 header file. */
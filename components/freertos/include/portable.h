@@ -138,6 +138,27 @@ typedef struct xHeapStats
 	size_t xNumberOfSuccessfulFrees;		/* The number of calls to vPortFree() that has successfully freed a block of memory. */
 } HeapStats_t;
 
+#if( configUSE_HEAP_TRACE == 1 )
+	/* Used to pass per task heap usage out of uxPortHeapTraceGetTasks(). */
+	typedef struct xHeapTraceTask
+	{
+		char pcTaskName[ configMAX_TASK_NAME_LEN ];	/* The task the blocks were allocated by, "(other)" for allocations made before the scheduler started or once the task table is full. */
+		size_t xCurrentBytes;						/* Bytes, including block headers, the task holds right now.  Blocks keep counting against the task that allocated them even when another task frees them. */
+		size_t xPeakBytes;							/* The highest xCurrentBytes has been. */
+		size_t xNumberOfAllocations;				/* The number of blocks allocated by the task. */
+		size_t xNumberOfFrees;						/* The number of those blocks that have been freed again. */
+	} HeapTraceTask_t;
+
+	/* Used to pass per call site heap usage out of uxPortHeapTraceGetSites(). */
+	typedef struct xHeapTraceSite
+	{
+		void *pvCaller;								/* Return address of the allocation, NULL for sites that did not fit in the site table. */
+		size_t xCurrentBytes;						/* Bytes, including block headers, allocated from this site and not yet freed. */
+		size_t xPeakBytes;							/* The highest xCurrentBytes has been. */
+		size_t xCurrentBlocks;						/* The number of blocks allocated from this site and not yet freed. */
+	} HeapTraceSite_t;
+#endif
+
 /*
  * Used to define multiple heap regions for use by heap_5.c.  This function
  * must be called before any calls to pvPortMalloc() - not creating a task,
@@ -167,6 +188,33 @@ void vPortInitialiseBlocks( void ) PRIVILEGED_FUNCTION;
 size_t xPortGetFreeHeapSize( void ) PRIVILEGED_FUNCTION;
 size_t xPortGetMinimumEverFreeHeapSize( void ) PRIVILEGED_FUNCTION;
 
+/*
+ * Restart the low-water mark returned by xPortGetMinimumEverFreeHeapSize()
+ * from the current free size, to measure the peak of one workload.
+ */
+void vPortResetHeapMinimumEverFreeHeapSize( void ) PRIVILEGED_FUNCTION;
+
+/*
+ * pvPortMalloc() for wrappers such as malloc() or operator new, which pass
+ * their own return address so heap tracing attributes the block to their
+ * caller rather than to the wrapper.
+ */
+void *pvPortMallocFrom( size_t xSize, void *pvCaller ) PRIVILEGED_FUNCTION;
+
+#if( configUSE_HEAP_TRACE == 1 )
+	/*
+	 * Fill pxTaskArray with the heap usage of every task that has allocated
+	 * memory, and return the number of entries written.
+	 */
+	UBaseType_t uxPortHeapTraceGetTasks( HeapTraceTask_t * const pxTaskArray, const UBaseType_t uxArraySize ) PRIVILEGED_FUNCTION;
+
+	/*
+	 * Fill pxSiteArray with the uxArraySize call sites holding the most memory,
+	 * largest first, and return the number of entries written.
+	 */
+	UBaseType_t uxPortHeapTraceGetSites( HeapTraceSite_t * const pxSiteArray, const UBaseType_t uxArraySize ) PRIVILEGED_FUNCTION;
+#endif
+
 /*
  * Setup the hardware ready for the scheduler to take control.  This generally
  * sets up a tick interrupt and sets timers for the correct tick frequency.
@@ -79,6 +79,8 @@ task.h is included from an application file. */
 
 #undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE
 
+#include "heap_trace.h"
+
 #if( configSUPPORT_DYNAMIC_ALLOCATION == 0 )
 	#error This file must not be used if configSUPPORT_DYNAMIC_ALLOCATION is 0
 #endif
@@ -95,6 +97,9 @@ typedef struct A_BLOCK_LINK
 {
 	struct A_BLOCK_LINK *pxNextFreeBlock;	/*<< The next free block in the list. */
 	size_t xBlockSize;						/*<< The size of the free block. */
+	#if( configUSE_HEAP_TRACE == 1 )
+		HeapTraceTag_t xTag;				/*<< Owner of an allocated block, fits in the padding to portBYTE_ALIGNMENT. */
+	#endif
 } BlockLink_t;
 
 /*-----------------------------------------------------------*/
@@ -131,7 +136,7 @@ static size_t xBlockAllocatedBit = 0;
 
 /*-----------------------------------------------------------*/
 
-void *pvPortMalloc( size_t xWantedSize )
+void *pvPortMallocFrom( size_t xWantedSize, [[gnu::unused]] void *pvCaller )
 {
 BlockLink_t *pxBlock, *pxPreviousBlock, *pxNewBlockLink;
 void *pvReturn = NULL;
@@ -237,6 +242,12 @@ void *pvReturn = NULL;
 						mtCOVERAGE_TEST_MARKER();
 					}
 
+					#if( configUSE_HEAP_TRACE == 1 )
+					{
+						vHeapTraceAlloc( &( pxBlock->xTag ), pxBlock->xBlockSize, pvCaller );
+					}
+					#endif
+
 					/* The block is being returned - it is allocated and owned
 					by the application and has no "next" block. */
 					pxBlock->xBlockSize |= xBlockAllocatedBit;
@@ -280,17 +291,28 @@ void *pvReturn = NULL;
 }
 /*-----------------------------------------------------------*/
 
-void* pvPortCalloc(size_t numElements, size_t sizeOfElement)
+void *pvPortMalloc( size_t xWantedSize )
+{
+	return pvPortMallocFrom( xWantedSize, __builtin_return_address( 0 ) );
+}
+/*-----------------------------------------------------------*/
+
+static void *prvCallocFrom( size_t xWantedSize, void *pvCaller )
 {
     void *pv = NULL;
 
-    pv = pvPortMalloc(numElements * sizeOfElement);
+    pv = pvPortMallocFrom(xWantedSize, pvCaller);
     if( pv ){
-        memset(pv, 0, numElements*sizeOfElement);
+        memset(pv, 0, xWantedSize);
     }
     return pv;
 }
 
+void* pvPortCalloc(size_t numElements, size_t sizeOfElement)
+{
+    return prvCallocFrom(numElements * sizeOfElement, __builtin_return_address(0));
+}
+
 void vPortFree( void *pv )
 {
 uint8_t *puc = ( uint8_t * ) pv;
@@ -322,6 +344,13 @@ BlockLink_t *pxLink;
 					/* Add this block to the list of free blocks. */
 					xFreeBytesRemaining += pxLink->xBlockSize;
 					traceFREE( pv, pxLink->xBlockSize );
+
+					#if( configUSE_HEAP_TRACE == 1 )
+					{
+						vHeapTraceFree( &( pxLink->xTag ), pxLink->xBlockSize );
+					}
+					#endif
+
 					prvInsertBlockIntoFreeList( ( ( BlockLink_t * ) pxLink ) );
 					xNumberOfSuccessfulFrees++;
 				}
@@ -341,6 +370,8 @@ BlockLink_t *pxLink;
 
 void *pvPortRealloc (void *pv, size_t xWantedSize )
 {
+	void *pvCaller = __builtin_return_address( 0 );
+
 	/* Check if pointer is null, if this is the case allocate memory with specified size */
 	if ( pv != NULL ) {
 		/* Check if size is zero */
@@ -354,16 +385,16 @@ void *pvPortRealloc (void *pv, size_t xWantedSize )
 			/* Get current data block and obtain its size */
 			uint8_t *ucpMetadataPos = ((uint8_t *) pv ) - xHeapStructSize;
 			BlockLink_t *xpMetadata = (void *) ucpMetadataPos;
-			size_t xOldSize = xpMetadata->xBlockSize - xHeapStructSize;
+			size_t xOldSize = ( xpMetadata->xBlockSize & ~xBlockAllocatedBit ) - xHeapStructSize;
 
 			/* New size equals old size -> just return pointer */
 			if ( xWantedSize == xOldSize) {
 				return pv;
 			} else {
 				/* Check if the old block was actually allocated */
-				if ( ( xOldSize & xBlockAllocatedBit ) != 0 ) {
+				if ( ( xpMetadata->xBlockSize & xBlockAllocatedBit ) != 0 ) {
 					/* Allocate new storage block */
-					void *pvNew = pvPortCalloc( 1, xWantedSize );
+					void *pvNew = prvCallocFrom( xWantedSize, pvCaller );
 
 					/* Check if allocation was successful */
 					if (pvNew) {
@@ -387,13 +418,13 @@ void *pvPortRealloc (void *pv, size_t xWantedSize )
 					}
 				} else {
 					/* Old block had no data, just create new pointer */
-					return pvPortCalloc( 1, xWantedSize );				
+					return prvCallocFrom( xWantedSize, pvCaller );				
 				}
 			}
 		}
 	} else {
 		/* Just create new pointer if the original pointer was null */
-		return pvPortCalloc( 1, xWantedSize );
+		return prvCallocFrom( xWantedSize, pvCaller );
 	}
 }
 /*-----------------------------------------------------------*/
@@ -410,6 +441,16 @@ size_t xPortGetMinimumEverFreeHeapSize( void )
 }
 /*-----------------------------------------------------------*/
 
+void vPortResetHeapMinimumEverFreeHeapSize( void )
+{
+	taskENTER_CRITICAL();
+	{
+		xMinimumEverFreeBytesRemaining = xFreeBytesRemaining;
+	}
+	taskEXIT_CRITICAL();
+}
+/*-----------------------------------------------------------*/
+
 static void prvInsertBlockIntoFreeList( BlockLink_t *pxBlockToInsert )
 {
 BlockLink_t *pxIterator;
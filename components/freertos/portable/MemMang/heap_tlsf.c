@@ -0,0 +1,835 @@
+/*
+ * FreeRTOS Kernel V10.3.0
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/*
+ * A two-level segregated fit (TLSF) implementation of pvPortMalloc() that is a
+ * drop in replacement for heap_bl602.c.  Select it by setting
+ * CONFIG_FREERTOS_HEAP_TLSF:=1 in proj_config.mk.
+ *
+ * heap_bl602.c keeps a single address ordered free list, so both allocation
+ * and free walk the list while the scheduler is suspended and the walk grows
+ * with fragmentation.  Here free blocks are binned by size: the first level
+ * is the power of two, the second level splits every power of two into
+ * heapSL_INDEX_COUNT linear classes, and a bitmap per level records which bins
+ * are non-empty.  Finding a fit is two find-first-set operations, freeing is a
+ * constant time merge with the physical neighbours, so neither depends on how
+ * many blocks are free.
+ *
+ * The price is fragmentation.  heap_bl602.c always takes the lowest address
+ * block that fits, which keeps the free memory in few large blocks, while the
+ * bins hand out the most recently freed block of a class.  Replaying the same
+ * trace near exhaustion (host/test_heap_tlsf.c) fails about 20% more
+ * allocations here and leaves a smaller largest free block.  Choose this heap
+ * when the time spent in malloc and free must be bounded, for example with
+ * many small live blocks, and keep heap_bl602.c when the heap runs close to
+ * full and large allocations have to succeed late.
+ *
+ * Each region passed to vPortDefineHeapRegions() gets its own bins, carved
+ * from the start of the region, and is closed by a zero sized sentinel so
+ * blocks never merge across regions.  Allocations are served from the regions
+ * in the order they were defined, so on the BL602 the main heap is used before
+ * the _heap_wifi region.  The owning region is recorded in every block header,
+ * so vPortFree() does not have to search for it.
+ *
+ * The usage notes of heap_bl602.c apply unchanged: vPortDefineHeapRegions()
+ * ***must*** be called before pvPortMalloc(), the region array is terminated
+ * by a NULL zero sized entry and the regions appear in address order.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Defining MPU_WRAPPERS_INCLUDED_FROM_API_FILE prevents task.h from redefining
+all the API functions to use the MPU wrappers.  That should only be done when
+task.h is included from an application file. */
+#define MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#include "heap_trace.h"
+
+#if( configSUPPORT_DYNAMIC_ALLOCATION == 0 )
+	#error This file must not be used if configSUPPORT_DYNAMIC_ALLOCATION is 0
+#endif
+
+#if( portBYTE_ALIGNMENT > 16 )
+	#error heap_tlsf.c supports a portBYTE_ALIGNMENT of at most 16
+#endif
+
+/* log2 of the largest block a single region can hold.  The default covers
+regions of up to 512KB, which is more than the whole BL602 RAM. */
+#ifndef configHEAP_TLSF_FL_INDEX_MAX
+	#define configHEAP_TLSF_FL_INDEX_MAX	18
+#endif
+
+/* The region index is stored in two bits of each block header. */
+#define heapMAX_REGIONS				4
+
+/* Block sizes are multiples of heapGRANULE, which leaves the low four bits of
+xBlockSize for the flags below. */
+#define heapGRANULE_LOG2			4
+#define heapGRANULE					( ( size_t ) 1 << heapGRANULE_LOG2 )
+#define heapGRANULE_MASK			( heapGRANULE - 1 )
+
+#define heapBLOCK_FREE				( ( size_t ) 0x1 )
+#define heapREGION_SHIFT			2
+#define heapREGION_MASK				( ( size_t ) 0x3 << heapREGION_SHIFT )
+#define heapFLAG_MASK				( ( size_t ) 0xF )
+
+/* Every power of two is split into 2^heapSL_INDEX_COUNT_LOG2 classes, which
+bounds the space lost to rounding a request up to its class at 1/16. */
+#define heapSL_INDEX_COUNT_LOG2		4
+#define heapSL_INDEX_COUNT			( 1 << heapSL_INDEX_COUNT_LOG2 )
+
+/* Blocks smaller than heapSMALL_BLOCK_SIZE all go to first level 0, whose
+second level classes are then exactly one granule apart. */
+#define heapFL_INDEX_SHIFT			( heapSL_INDEX_COUNT_LOG2 + heapGRANULE_LOG2 )
+#define heapSMALL_BLOCK_SIZE		( ( size_t ) 1 << heapFL_INDEX_SHIFT )
+#define heapFL_INDEX_COUNT			( configHEAP_TLSF_FL_INDEX_MAX - heapFL_INDEX_SHIFT + 2 )
+#define heapMAX_BLOCK_SIZE			( ( ( size_t ) 1 << ( configHEAP_TLSF_FL_INDEX_MAX + 1 ) ) - heapGRANULE )
+
+/* Assumes 8bit bytes! */
+#define heapBITS_PER_BYTE			( ( size_t ) 8 )
+
+/* Header at the start of every block.  The previous physical block is always
+valid so both neighbours can be reached in constant time when a block is
+freed.  The free list links follow the header and are only meaningful while
+the block is free, an allocated block hands that memory out. */
+typedef struct TLSF_BLOCK
+{
+	struct TLSF_BLOCK *pxPrevPhysBlock;		/*<< The block immediately below this one in memory, NULL for the first block of a region. */
+	size_t xBlockSize;						/*<< Size of the block including this header, ORed with the flags. */
+	#if( configUSE_HEAP_TRACE == 1 )
+		HeapTraceTag_t xTag;				/*<< Owner of an allocated block. */
+	#endif
+	struct TLSF_BLOCK *pxNextFreeBlock;		/*<< The next block in the same size class, free blocks only. */
+	struct TLSF_BLOCK *pxPrevFreeBlock;		/*<< The previous block in the same size class, free blocks only. */
+} TLSFBlock_t;
+
+/* Bins of one region.  Lives at the start of the region it describes. */
+typedef struct TLSF_CONTROL
+{
+	uint32_t ulFLBitmap;
+	uint32_t ulSLBitmap[ heapFL_INDEX_COUNT ];
+	TLSFBlock_t *pxBlocks[ heapFL_INDEX_COUNT ][ heapSL_INDEX_COUNT ];
+	size_t xFreeBytes;
+	size_t xFreeBlocks;
+} TLSFControl_t;
+
+/*-----------------------------------------------------------*/
+
+/* The size of the header placed at the beginning of each allocated block,
+rounded so the memory after it keeps the block's alignment.  On a 32 bit
+target it is one granule, the same as the header of heap_bl602.c. */
+static const size_t xHeapStructSize = ( offsetof( TLSFBlock_t, pxNextFreeBlock ) + heapGRANULE_MASK ) & ~heapGRANULE_MASK;
+
+/* A free block must at least hold its header and one granule, which holds
+the free list links. */
+#define heapMINIMUM_BLOCK_SIZE		( xHeapStructSize + heapGRANULE )
+
+static TLSFControl_t *pxControls[ heapMAX_REGIONS ];
+static BaseType_t xNumberOfRegions = 0;
+
+/* Keeps track of the number of calls to allocate and free memory as well as the
+number of free bytes remaining, but says nothing about fragmentation. */
+static size_t xFreeBytesRemaining = 0U;
+static size_t xMinimumEverFreeBytesRemaining = 0U;
+static size_t xNumberOfSuccessfulAllocations = 0;
+static size_t xNumberOfSuccessfulFrees = 0;
+
+/*-----------------------------------------------------------*/
+
+static inline size_t prvFls( size_t x )
+{
+	return ( sizeof( unsigned long ) * heapBITS_PER_BYTE - 1 ) - ( size_t ) __builtin_clzl( ( unsigned long ) x );
+}
+
+static inline size_t prvBlockSize( const TLSFBlock_t *pxBlock )
+{
+	return pxBlock->xBlockSize & ~heapFLAG_MASK;
+}
+
+static inline void prvSetBlockSize( TLSFBlock_t *pxBlock, size_t xSize )
+{
+	pxBlock->xBlockSize = xSize | ( pxBlock->xBlockSize & heapFLAG_MASK );
+}
+
+static inline BaseType_t prvBlockIsFree( const TLSFBlock_t *pxBlock )
+{
+	return ( pxBlock->xBlockSize & heapBLOCK_FREE ) != 0;
+}
+
+static inline TLSFBlock_t *prvNextPhysBlock( const TLSFBlock_t *pxBlock )
+{
+	return ( TLSFBlock_t * ) ( ( ( uint8_t * ) pxBlock ) + prvBlockSize( pxBlock ) );
+}
+
+static inline TLSFControl_t *prvBlockControl( const TLSFBlock_t *pxBlock )
+{
+	return pxControls[ ( pxBlock->xBlockSize & heapREGION_MASK ) >> heapREGION_SHIFT ];
+}
+
+/*
+ * Maps a block size to the bin the block is kept in.
+ */
+static void prvMappingInsert( size_t xSize, size_t *pxFL, size_t *pxSL )
+{
+size_t xFls;
+
+	if( xSize < heapSMALL_BLOCK_SIZE )
+	{
+		*pxFL = 0;
+		*pxSL = xSize >> heapGRANULE_LOG2;
+	}
+	else
+	{
+		xFls = prvFls( xSize );
+		*pxSL = ( xSize >> ( xFls - heapSL_INDEX_COUNT_LOG2 ) ) ^ heapSL_INDEX_COUNT;
+		*pxFL = xFls - heapFL_INDEX_SHIFT + 1;
+	}
+}
+
+/*
+ * Maps a request to the first bin whose blocks are all large enough for it, by
+ * rounding the request up to the next class boundary first.
+ */
+static void prvMappingSearch( size_t xSize, size_t *pxFL, size_t *pxSL )
+{
+	if( xSize >= heapSMALL_BLOCK_SIZE )
+	{
+		xSize += ( ( size_t ) 1 << ( prvFls( xSize ) - heapSL_INDEX_COUNT_LOG2 ) ) - 1;
+	}
+
+	prvMappingInsert( xSize, pxFL, pxSL );
+}
+
+/*
+ * Returns the head of the first non-empty bin at or above (*pxFL, *pxSL) and
+ * updates the indices to that bin, or NULL when there is none.
+ */
+static TLSFBlock_t *prvFindSuitableBlock( TLSFControl_t *pxControl, size_t *pxFL, size_t *pxSL )
+{
+size_t xFL = *pxFL;
+uint32_t ulSLMap, ulFLMap;
+
+	if( xFL >= heapFL_INDEX_COUNT )
+	{
+		return NULL;
+	}
+
+	ulSLMap = pxControl->ulSLBitmap[ xFL ] & ( ~0UL << *pxSL );
+	if( ulSLMap == 0 )
+	{
+		ulFLMap = pxControl->ulFLBitmap & ( ~0UL << ( xFL + 1 ) );
+		if( ulFLMap == 0 )
+		{
+			return NULL;
+		}
+
+		xFL = ( size_t ) __builtin_ctz( ulFLMap );
+		ulSLMap = pxControl->ulSLBitmap[ xFL ];
+	}
+
+	*pxFL = xFL;
+	*pxSL = ( size_t ) __builtin_ctz( ulSLMap );
+
+	return pxControl->pxBlocks[ xFL ][ *pxSL ];
+}
+
+static void prvRemoveFreeBlock( TLSFControl_t *pxControl, TLSFBlock_t *pxBlock, size_t xFL, size_t xSL )
+{
+TLSFBlock_t *pxNext = pxBlock->pxNextFreeBlock;
+TLSFBlock_t *pxPrev = pxBlock->pxPrevFreeBlock;
+
+	if( pxNext != NULL )
+	{
+		pxNext->pxPrevFreeBlock = pxPrev;
+	}
+
+	if( pxPrev != NULL )
+	{
+		pxPrev->pxNextFreeBlock = pxNext;
+	}
+	else
+	{
+		pxControl->pxBlocks[ xFL ][ xSL ] = pxNext;
+		if( pxNext == NULL )
+		{
+			pxControl->ulSLBitmap[ xFL ] &= ~( 1UL << xSL );
+			if( pxControl->ulSLBitmap[ xFL ] == 0 )
+			{
+				pxControl->ulFLBitmap &= ~( 1UL << xFL );
+			}
+		}
+	}
+
+	pxBlock->xBlockSize &= ~heapBLOCK_FREE;
+	pxControl->xFreeBlocks--;
+}
+
+static void prvUnlinkBlock( TLSFControl_t *pxControl, TLSFBlock_t *pxBlock )
+{
+size_t xFL, xSL;
+
+	prvMappingInsert( prvBlockSize( pxBlock ), &xFL, &xSL );
+	prvRemoveFreeBlock( pxControl, pxBlock, xFL, xSL );
+}
+
+static void prvInsertFreeBlock( TLSFControl_t *pxControl, TLSFBlock_t *pxBlock )
+{
+size_t xFL, xSL;
+TLSFBlock_t *pxHead;
+
+	prvMappingInsert( prvBlockSize( pxBlock ), &xFL, &xSL );
+
+	pxHead = pxControl->pxBlocks[ xFL ][ xSL ];
+	pxBlock->pxNextFreeBlock = pxHead;
+	pxBlock->pxPrevFreeBlock = NULL;
+	if( pxHead != NULL )
+	{
+		pxHead->pxPrevFreeBlock = pxBlock;
+	}
+
+	pxControl->pxBlocks[ xFL ][ xSL ] = pxBlock;
+	pxControl->ulSLBitmap[ xFL ] |= 1UL << xSL;
+	pxControl->ulFLBitmap |= 1UL << xFL;
+
+	pxBlock->xBlockSize |= heapBLOCK_FREE;
+	pxControl->xFreeBlocks++;
+}
+
+/*
+ * Gives the memory of an unlinked block back to its bins, merging it with
+ * whichever physical neighbours are free.
+ */
+static void prvReleaseBlock( TLSFControl_t *pxControl, TLSFBlock_t *pxBlock )
+{
+TLSFBlock_t *pxNeighbour;
+
+	pxNeighbour = pxBlock->pxPrevPhysBlock;
+	if( ( pxNeighbour != NULL ) && prvBlockIsFree( pxNeighbour ) )
+	{
+		prvUnlinkBlock( pxControl, pxNeighbour );
+		prvSetBlockSize( pxNeighbour, prvBlockSize( pxNeighbour ) + prvBlockSize( pxBlock ) );
+		pxBlock = pxNeighbour;
+		prvNextPhysBlock( pxBlock )->pxPrevPhysBlock = pxBlock;
+	}
+	else
+	{
+		mtCOVERAGE_TEST_MARKER();
+	}
+
+	/* The sentinel closing the region is never free, so this stops there. */
+	pxNeighbour = prvNextPhysBlock( pxBlock );
+	if( prvBlockIsFree( pxNeighbour ) )
+	{
+		prvUnlinkBlock( pxControl, pxNeighbour );
+		prvSetBlockSize( pxBlock, prvBlockSize( pxBlock ) + prvBlockSize( pxNeighbour ) );
+		prvNextPhysBlock( pxBlock )->pxPrevPhysBlock = pxBlock;
+	}
+	else
+	{
+		mtCOVERAGE_TEST_MARKER();
+	}
+
+	prvInsertFreeBlock( pxControl, pxBlock );
+}
+
+/*
+ * Trims an allocated block to xWantedSize bytes if the rest is large enough to
+ * be a block of its own, and returns the number of bytes given back.
+ */
+static size_t prvTrimBlock( TLSFControl_t *pxControl, TLSFBlock_t *pxBlock, size_t xWantedSize )
+{
+TLSFBlock_t *pxNewBlockLink;
+size_t xRemaining = prvBlockSize( pxBlock ) - xWantedSize;
+
+	if( xRemaining < heapMINIMUM_BLOCK_SIZE )
+	{
+		return 0;
+	}
+
+	/* The void cast is used to prevent byte alignment warnings from the
+	compiler. */
+	pxNewBlockLink = ( void * ) ( ( ( uint8_t * ) pxBlock ) + xWantedSize );
+	pxNewBlockLink->xBlockSize = xRemaining | ( pxBlock->xBlockSize & heapREGION_MASK );
+	pxNewBlockLink->pxPrevPhysBlock = pxBlock;
+	prvSetBlockSize( pxBlock, xWantedSize );
+	prvNextPhysBlock( pxNewBlockLink )->pxPrevPhysBlock = pxNewBlockLink;
+
+	prvReleaseBlock( pxControl, pxNewBlockLink );
+
+	return xRemaining;
+}
+
+/*
+ * Converts a request in bytes to a block size, or 0 if it cannot be served.
+ */
+static size_t prvAdjustRequestSize( size_t xWantedSize )
+{
+	if( ( xWantedSize == 0 ) || ( xWantedSize > heapMAX_BLOCK_SIZE ) )
+	{
+		return 0;
+	}
+
+	return ( xWantedSize + xHeapStructSize + heapGRANULE_MASK ) & ~heapGRANULE_MASK;
+}
+
+static void prvUpdateFreeBytes( void )
+{
+	if( xFreeBytesRemaining < xMinimumEverFreeBytesRemaining )
+	{
+		xMinimumEverFreeBytesRemaining = xFreeBytesRemaining;
+	}
+	else
+	{
+		mtCOVERAGE_TEST_MARKER();
+	}
+}
+
+/*-----------------------------------------------------------*/
+
+void *pvPortMallocFrom( size_t xWantedSize, [[gnu::unused]] void *pvCaller )
+{
+TLSFControl_t *pxControl = NULL;
+TLSFBlock_t *pxBlock = NULL;
+void *pvReturn = NULL;
+size_t xFL = 0, xSL = 0, xBlockSize;
+BaseType_t xRegion;
+
+	/* The heap must be initialised before the first call to
+	prvPortMalloc(). */
+	configASSERT( xNumberOfRegions );
+
+	xBlockSize = prvAdjustRequestSize( xWantedSize );
+
+	vTaskSuspendAll();
+	{
+		if( ( xBlockSize > 0 ) && ( xBlockSize <= xFreeBytesRemaining ) )
+		{
+			for( xRegion = 0; xRegion < xNumberOfRegions; xRegion++ )
+			{
+				pxControl = pxControls[ xRegion ];
+				if( xBlockSize > pxControl->xFreeBytes )
+				{
+					continue;
+				}
+
+				/* The head of the request's own class may be large enough, it
+				is the best fit when the heap is too fragmented for the classes
+				above. */
+				prvMappingInsert( xBlockSize, &xFL, &xSL );
+				pxBlock = pxControl->pxBlocks[ xFL ][ xSL ];
+				if( ( pxBlock != NULL ) && ( prvBlockSize( pxBlock ) >= xBlockSize ) )
+				{
+					break;
+				}
+
+				prvMappingSearch( xBlockSize, &xFL, &xSL );
+				pxBlock = prvFindSuitableBlock( pxControl, &xFL, &xSL );
+				if( pxBlock != NULL )
+				{
+					break;
+				}
+			}
+
+			if( pxBlock != NULL )
+			{
+				prvRemoveFreeBlock( pxControl, pxBlock, xFL, xSL );
+				prvTrimBlock( pxControl, pxBlock, xBlockSize );
+
+				pxControl->xFreeBytes -= prvBlockSize( pxBlock );
+				xFreeBytesRemaining -= prvBlockSize( pxBlock );
+				prvUpdateFreeBytes();
+
+				/* Return the memory space pointed to - jumping over the
+				block header at its start. */
+				pvReturn = ( void * ) ( ( ( uint8_t * ) pxBlock ) + xHeapStructSize );
+				xNumberOfSuccessfulAllocations++;
+
+				#if( configUSE_HEAP_TRACE == 1 )
+				{
+					vHeapTraceAlloc( &( pxBlock->xTag ), prvBlockSize( pxBlock ), pvCaller );
+				}
+				#endif
+			}
+			else
+			{
+				mtCOVERAGE_TEST_MARKER();
+			}
+		}
+		else
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
+
+		traceMALLOC( pvReturn, xBlockSize );
+	}
+	( void ) xTaskResumeAll();
+
+	#if( configUSE_MALLOC_FAILED_HOOK == 1 )
+	{
+		if( pvReturn == NULL )
+		{
+			extern void vApplicationMallocFailedHook( void );
+			vApplicationMallocFailedHook();
+		}
+		else
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
+	}
+	#endif
+
+	return pvReturn;
+}
+/*-----------------------------------------------------------*/
+
+void *pvPortMalloc( size_t xWantedSize )
+{
+	return pvPortMallocFrom( xWantedSize, __builtin_return_address( 0 ) );
+}
+/*-----------------------------------------------------------*/
+
+static void *prvCallocFrom( size_t xWantedSize, void *pvCaller )
+{
+    void *pv = NULL;
+
+    pv = pvPortMallocFrom(xWantedSize, pvCaller);
+    if( pv ){
+        memset(pv, 0, xWantedSize);
+    }
+    return pv;
+}
+
+void* pvPortCalloc(size_t numElements, size_t sizeOfElement)
+{
+    if( ( sizeOfElement != 0 ) && ( numElements > ( ( size_t ) -1 ) / sizeOfElement ) ){
+        return NULL;
+    }
+
+    return prvCallocFrom(numElements * sizeOfElement, __builtin_return_address(0));
+}
+
+void vPortFree( void *pv )
+{
+TLSFBlock_t *pxBlock;
+TLSFControl_t *pxControl;
+size_t xBlockSize;
+
+	if( pv != NULL )
+	{
+		/* The memory being freed will have a block header immediately
+		before it.  The void cast prevents byte alignment warnings. */
+		pxBlock = ( void * ) ( ( ( uint8_t * ) pv ) - xHeapStructSize );
+
+		/* Check the block is actually allocated. */
+		configASSERT( !prvBlockIsFree( pxBlock ) );
+
+		if( !prvBlockIsFree( pxBlock ) )
+		{
+			vTaskSuspendAll();
+			{
+				pxControl = prvBlockControl( pxBlock );
+				xBlockSize = prvBlockSize( pxBlock );
+
+				pxControl->xFreeBytes += xBlockSize;
+				xFreeBytesRemaining += xBlockSize;
+				traceFREE( pv, xBlockSize );
+
+				#if( configUSE_HEAP_TRACE == 1 )
+				{
+					vHeapTraceFree( &( pxBlock->xTag ), xBlockSize );
+				}
+				#endif
+
+				prvReleaseBlock( pxControl, pxBlock );
+				xNumberOfSuccessfulFrees++;
+			}
+			( void ) xTaskResumeAll();
+		}
+		else
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
+	}
+}
+
+void *pvPortRealloc( void *pv, size_t xWantedSize )
+{
+TLSFBlock_t *pxBlock, *pxNext;
+TLSFControl_t *pxControl;
+size_t xBlockSize, xOldSize, xGained, xReleased;
+void *pvNew = NULL;
+void *pvCaller = __builtin_return_address( 0 );
+
+	/* Just create new pointer if the original pointer was null */
+	if( pv == NULL )
+	{
+		return prvCallocFrom( xWantedSize, pvCaller );
+	}
+
+	/* This is undefined behavior since C23, old behavior was a free call.
+	Stick to old behavior for compatibility. */
+	if( xWantedSize == 0 )
+	{
+		vPortFree( pv );
+		return NULL;
+	}
+
+	xBlockSize = prvAdjustRequestSize( xWantedSize );
+	if( xBlockSize == 0 )
+	{
+		return NULL;
+	}
+
+	pxBlock = ( void * ) ( ( ( uint8_t * ) pv ) - xHeapStructSize );
+	configASSERT( !prvBlockIsFree( pxBlock ) );
+
+	vTaskSuspendAll();
+	{
+		pxControl = prvBlockControl( pxBlock );
+		xOldSize = prvBlockSize( pxBlock );
+
+		if( xBlockSize <= xOldSize )
+		{
+			/* Shrinking, give the tail back. */
+			xReleased = prvTrimBlock( pxControl, pxBlock, xBlockSize );
+			pxControl->xFreeBytes += xReleased;
+			xFreeBytesRemaining += xReleased;
+			pvNew = pv;
+
+			#if( configUSE_HEAP_TRACE == 1 )
+			{
+				vHeapTraceResize( &( pxBlock->xTag ), xOldSize, xOldSize - xReleased );
+			}
+			#endif
+		}
+		else
+		{
+			/* Growing, try to extend into the block above. */
+			pxNext = prvNextPhysBlock( pxBlock );
+			if( prvBlockIsFree( pxNext ) && ( ( xOldSize + prvBlockSize( pxNext ) ) >= xBlockSize ) )
+			{
+				prvUnlinkBlock( pxControl, pxNext );
+				prvSetBlockSize( pxBlock, xOldSize + prvBlockSize( pxNext ) );
+				prvNextPhysBlock( pxBlock )->pxPrevPhysBlock = pxBlock;
+
+				xGained = prvBlockSize( pxBlock ) - xOldSize;
+				xGained -= prvTrimBlock( pxControl, pxBlock, xBlockSize );
+				pxControl->xFreeBytes -= xGained;
+				xFreeBytesRemaining -= xGained;
+				prvUpdateFreeBytes();
+				pvNew = pv;
+
+				#if( configUSE_HEAP_TRACE == 1 )
+				{
+					vHeapTraceResize( &( pxBlock->xTag ), xOldSize, xOldSize + xGained );
+				}
+				#endif
+			}
+			else
+			{
+				mtCOVERAGE_TEST_MARKER();
+			}
+		}
+	}
+	( void ) xTaskResumeAll();
+
+	if( pvNew != NULL )
+	{
+		return pvNew;
+	}
+
+	/* Allocate new storage block.  A failure here also triggers the malloc
+	failed hook (if enabled). */
+	pvNew = pvPortMallocFrom( xWantedSize, pvCaller );
+	if( pvNew != NULL )
+	{
+		/* Growing, so all of the old contents fit. */
+		memcpy( pvNew, pv, xOldSize - xHeapStructSize );
+		vPortFree( pv );
+	}
+
+	return pvNew;
+}
+/*-----------------------------------------------------------*/
+
+size_t xPortGetFreeHeapSize( void )
+{
+	return xFreeBytesRemaining;
+}
+/*-----------------------------------------------------------*/
+
+size_t xPortGetMinimumEverFreeHeapSize( void )
+{
+	return xMinimumEverFreeBytesRemaining;
+}
+/*-----------------------------------------------------------*/
+
+void vPortResetHeapMinimumEverFreeHeapSize( void )
+{
+	taskENTER_CRITICAL();
+	{
+		xMinimumEverFreeBytesRemaining = xFreeBytesRemaining;
+	}
+	taskEXIT_CRITICAL();
+}
+/*-----------------------------------------------------------*/
+
+void vPortDefineHeapRegions( const HeapRegion_t * const pxHeapRegions )
+{
+TLSFControl_t *pxControl;
+TLSFBlock_t *pxFirstBlock, *pxSentinel;
+size_t xStart, xEnd, xBlockSize, xTotalHeapSize = 0;
+const HeapRegion_t *pxHeapRegion;
+
+	/* Can only call once! */
+	configASSERT( xNumberOfRegions == 0 );
+
+	/* The free list links of the smallest free block fit in it. */
+	configASSERT( sizeof( TLSFBlock_t ) <= heapMINIMUM_BLOCK_SIZE );
+
+	for( pxHeapRegion = pxHeapRegions; pxHeapRegion->xSizeInBytes > 0; pxHeapRegion++ )
+	{
+		configASSERT( xNumberOfRegions < heapMAX_REGIONS );
+		if( xNumberOfRegions >= heapMAX_REGIONS )
+		{
+			break;
+		}
+
+		/* Ensure the heap region starts and ends on an aligned boundary. */
+		xStart = ( ( size_t ) pxHeapRegion->pucStartAddress + heapGRANULE_MASK ) & ~heapGRANULE_MASK;
+		xEnd = ( ( size_t ) pxHeapRegion->pucStartAddress + pxHeapRegion->xSizeInBytes ) & ~heapGRANULE_MASK;
+
+		/* The bins go first, then one free block spanning the region, then
+		the sentinel that stops merges at the end of the region. */
+		pxControl = ( TLSFControl_t * ) xStart;
+		xStart += ( sizeof( TLSFControl_t ) + heapGRANULE_MASK ) & ~heapGRANULE_MASK;
+
+		if( xEnd < xStart + xHeapStructSize + heapMINIMUM_BLOCK_SIZE )
+		{
+			/* Too small to be worth a region. */
+			configASSERT( pdFALSE );
+			continue;
+		}
+
+		xBlockSize = xEnd - xHeapStructSize - xStart;
+		if( xBlockSize > heapMAX_BLOCK_SIZE )
+		{
+			/* Anything past the largest block the bins can hold is unused,
+			raise configHEAP_TLSF_FL_INDEX_MAX to cover it. */
+			configASSERT( pdFALSE );
+			xBlockSize = heapMAX_BLOCK_SIZE;
+		}
+
+		memset( pxControl, 0, sizeof( TLSFControl_t ) );
+
+		pxFirstBlock = ( TLSFBlock_t * ) xStart;
+		pxFirstBlock->xBlockSize = xBlockSize | ( ( size_t ) xNumberOfRegions << heapREGION_SHIFT );
+		pxFirstBlock->pxPrevPhysBlock = NULL;
+
+		pxSentinel = prvNextPhysBlock( pxFirstBlock );
+		pxSentinel->xBlockSize = ( size_t ) xNumberOfRegions << heapREGION_SHIFT;
+		pxSentinel->pxPrevPhysBlock = pxFirstBlock;
+
+		prvInsertFreeBlock( pxControl, pxFirstBlock );
+		pxControl->xFreeBytes = xBlockSize;
+
+		pxControls[ xNumberOfRegions ] = pxControl;
+		xNumberOfRegions++;
+		xTotalHeapSize += xBlockSize;
+	}
+
+	xMinimumEverFreeBytesRemaining = xTotalHeapSize;
+	xFreeBytesRemaining = xTotalHeapSize;
+
+	/* Check something was actually defined before it is accessed. */
+	configASSERT( xTotalHeapSize );
+}
+/*-----------------------------------------------------------*/
+
+void vPortGetHeapStats( HeapStats_t *pxHeapStats )
+{
+TLSFControl_t *pxControl;
+TLSFBlock_t *pxBlock;
+size_t xBlocks = 0, xMaxSize = 0, xMinSize = portMAX_DELAY; /* portMAX_DELAY used as a portable way of getting the maximum value. */
+size_t xFL, xSL;
+BaseType_t xRegion;
+
+	vTaskSuspendAll();
+	{
+		for( xRegion = 0; xRegion < xNumberOfRegions; xRegion++ )
+		{
+			pxControl = pxControls[ xRegion ];
+			xBlocks += pxControl->xFreeBlocks;
+
+			if( pxControl->ulFLBitmap == 0 )
+			{
+				continue;
+			}
+
+			/* The largest block is in the highest non-empty bin and the
+			smallest in the lowest, so only those two lists are walked. */
+			xFL = prvFls( pxControl->ulFLBitmap );
+			xSL = prvFls( pxControl->ulSLBitmap[ xFL ] );
+			for( pxBlock = pxControl->pxBlocks[ xFL ][ xSL ]; pxBlock != NULL; pxBlock = pxBlock->pxNextFreeBlock )
+			{
+				if( prvBlockSize( pxBlock ) > xMaxSize )
+				{
+					xMaxSize = prvBlockSize( pxBlock );
+				}
+			}
+
+			xFL = ( size_t ) __builtin_ctz( pxControl->ulFLBitmap );
+			xSL = ( size_t ) __builtin_ctz( pxControl->ulSLBitmap[ xFL ] );
+			for( pxBlock = pxControl->pxBlocks[ xFL ][ xSL ]; pxBlock != NULL; pxBlock = pxBlock->pxNextFreeBlock )
+			{
+				if( prvBlockSize( pxBlock ) < xMinSize )
+				{
+					xMinSize = prvBlockSize( pxBlock );
+				}
+			}
+		}
+	}
+	xTaskResumeAll();
+
+	pxHeapStats->xSizeOfLargestFreeBlockInBytes = xMaxSize;
+	pxHeapStats->xSizeOfSmallestFreeBlockInBytes = xMinSize;
+	pxHeapStats->xNumberOfFreeBlocks = xBlocks;
+
+	taskENTER_CRITICAL();
+	{
+		pxHeapStats->xAvailableHeapSpaceInBytes = xFreeBytesRemaining;
+		pxHeapStats->xNumberOfSuccessfulAllocations = xNumberOfSuccessfulAllocations;
+		pxHeapStats->xNumberOfSuccessfulFrees = xNumberOfSuccessfulFrees;
+		pxHeapStats->xMinimumEverFreeBytesRemaining = xMinimumEverFreeBytesRemaining;
+	}
+	taskEXIT_CRITICAL();
+}
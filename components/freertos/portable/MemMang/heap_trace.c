@@ -0,0 +1,296 @@
+/*
+ * FreeRTOS Kernel V10.3.0
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/*
+ * Heap accounting shared by heap_bl602.c and heap_tlsf.c.  Enable it with
+ * CONFIG_FREERTOS_HEAP_TRACE:=1 in proj_config.mk.
+ *
+ * Every allocated block carries a HeapTraceTag_t naming the task that
+ * allocated it and the return address of the allocation.  The tag lives in
+ * header space the heaps already pad to portBYTE_ALIGNMENT, so enabling the
+ * trace does not make any block larger.  Totals are kept per task and per
+ * call site in fixed tables, so no memory is allocated here and every update
+ * is a short, bounded lookup done while the heap has the scheduler suspended.
+ *
+ * Once a table is full further tasks or sites are charged to an "(other)"
+ * entry, so the totals always add up to what the heap has handed out.
+ */
+#include <string.h>
+
+/* Defining MPU_WRAPPERS_INCLUDED_FROM_API_FILE prevents task.h from redefining
+all the API functions to use the MPU wrappers.  That should only be done when
+task.h is included from an application file. */
+#define MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#include "heap_trace.h"
+
+#if( configUSE_HEAP_TRACE == 1 )
+
+/* Number of tasks tracked individually, including the "(other)" entry. */
+#ifndef configHEAP_TRACE_MAX_TASKS
+	#define configHEAP_TRACE_MAX_TASKS		24
+#endif
+
+/* Number of call sites tracked individually.  Must be a power of two. */
+#ifndef configHEAP_TRACE_MAX_SITES
+	#define configHEAP_TRACE_MAX_SITES		64
+#endif
+
+#if( configHEAP_TRACE_MAX_TASKS > 255 ) || ( configHEAP_TRACE_MAX_SITES > 255 )
+	#error Task and site indices must fit in the uint8_t fields of HeapTraceTag_t
+#endif
+
+#if( ( configHEAP_TRACE_MAX_SITES & ( configHEAP_TRACE_MAX_SITES - 1 ) ) != 0 )
+	#error configHEAP_TRACE_MAX_SITES must be a power of two
+#endif
+
+/* Index of the entry that collects everything not tracked individually. */
+#define heapTRACE_OTHER_TASK			0
+#define heapTRACE_OTHER_SITE			configHEAP_TRACE_MAX_SITES
+
+typedef struct HEAP_TRACE_TASK_ENTRY
+{
+	TaskHandle_t xHandle;
+	HeapTraceTask_t xStats;
+} HeapTraceTaskEntry_t;
+
+static HeapTraceTaskEntry_t xTasks[ configHEAP_TRACE_MAX_TASKS ] =
+{
+	[ heapTRACE_OTHER_TASK ] = { NULL, { "(other)", 0, 0, 0, 0 } },
+};
+static UBaseType_t uxNumberOfTasks = 1;
+
+/* Open addressed on the return address, plus the "(other)" entry at the end. */
+static HeapTraceSite_t xSites[ configHEAP_TRACE_MAX_SITES + 1 ];
+static UBaseType_t uxNumberOfSites = 0;
+
+/*-----------------------------------------------------------*/
+
+static void prvCharge( size_t *pxCurrent, size_t *pxPeak, size_t xBytes )
+{
+	*pxCurrent += xBytes;
+	if( *pxCurrent > *pxPeak )
+	{
+		*pxPeak = *pxCurrent;
+	}
+}
+
+static uint8_t prvTaskIndex( void )
+{
+TaskHandle_t xHandle;
+const char *pcName;
+UBaseType_t ux;
+
+	if( xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED )
+	{
+		return heapTRACE_OTHER_TASK;
+	}
+
+	xHandle = xTaskGetCurrentTaskHandle();
+	pcName = pcTaskGetName( xHandle );
+
+	/* A deleted task's TCB may be reused by the next task created, so the
+	name has to match as well. */
+	for( ux = 1; ux < uxNumberOfTasks; ux++ )
+	{
+		if( ( xTasks[ ux ].xHandle == xHandle ) &&
+			( strncmp( xTasks[ ux ].xStats.pcTaskName, pcName, configMAX_TASK_NAME_LEN ) == 0 ) )
+		{
+			return ( uint8_t ) ux;
+		}
+	}
+
+	if( uxNumberOfTasks >= configHEAP_TRACE_MAX_TASKS )
+	{
+		return heapTRACE_OTHER_TASK;
+	}
+
+	xTasks[ ux ].xHandle = xHandle;
+	strncpy( xTasks[ ux ].xStats.pcTaskName, pcName, configMAX_TASK_NAME_LEN - 1 );
+	uxNumberOfTasks++;
+
+	return ( uint8_t ) ux;
+}
+
+static uint8_t prvSiteIndex( void *pvCaller )
+{
+UBaseType_t uxIndex, uxProbe;
+
+	/* An empty slot is marked by a NULL caller. */
+	if( pvCaller == NULL )
+	{
+		return heapTRACE_OTHER_SITE;
+	}
+
+	/* Return addresses are at least two byte aligned, drop the bit that is
+	always clear before hashing. */
+	uxIndex = ( UBaseType_t ) ( ( ( ( size_t ) pvCaller ) >> 1 ) * 2654435761UL );
+	uxIndex = ( uxIndex >> 16 ) & ( configHEAP_TRACE_MAX_SITES - 1 );
+
+	/* The table is never allowed to fill up completely, so the probe always
+	ends at either the site or an empty slot. */
+	for( uxProbe = 0; uxProbe < configHEAP_TRACE_MAX_SITES; uxProbe++ )
+	{
+		if( xSites[ uxIndex ].pvCaller == pvCaller )
+		{
+			return ( uint8_t ) uxIndex;
+		}
+
+		if( xSites[ uxIndex ].pvCaller == NULL )
+		{
+			break;
+		}
+
+		uxIndex = ( uxIndex + 1 ) & ( configHEAP_TRACE_MAX_SITES - 1 );
+	}
+
+	if( uxNumberOfSites >= ( configHEAP_TRACE_MAX_SITES - 1 ) )
+	{
+		return heapTRACE_OTHER_SITE;
+	}
+
+	xSites[ uxIndex ].pvCaller = pvCaller;
+	uxNumberOfSites++;
+
+	return ( uint8_t ) uxIndex;
+}
+
+/*-----------------------------------------------------------*/
+
+void vHeapTraceAlloc( HeapTraceTag_t *pxTag, size_t xBlockSize, void *pvCaller )
+{
+HeapTraceTask_t *pxTask;
+HeapTraceSite_t *pxSite;
+
+	pxTag->ucTask = prvTaskIndex();
+	pxTag->ucSite = prvSiteIndex( pvCaller );
+	pxTag->usReserved = 0;
+
+	pxTask = &( xTasks[ pxTag->ucTask ].xStats );
+	prvCharge( &( pxTask->xCurrentBytes ), &( pxTask->xPeakBytes ), xBlockSize );
+	pxTask->xNumberOfAllocations++;
+
+	pxSite = &( xSites[ pxTag->ucSite ] );
+	prvCharge( &( pxSite->xCurrentBytes ), &( pxSite->xPeakBytes ), xBlockSize );
+	pxSite->xCurrentBlocks++;
+}
+/*-----------------------------------------------------------*/
+
+void vHeapTraceFree( const HeapTraceTag_t *pxTag, size_t xBlockSize )
+{
+HeapTraceTask_t *pxTask = &( xTasks[ pxTag->ucTask ].xStats );
+HeapTraceSite_t *pxSite = &( xSites[ pxTag->ucSite ] );
+
+	configASSERT( pxTag->ucTask < uxNumberOfTasks );
+	configASSERT( pxTask->xCurrentBytes >= xBlockSize );
+	configASSERT( pxSite->xCurrentBlocks > 0 );
+
+	pxTask->xCurrentBytes -= xBlockSize;
+	pxTask->xNumberOfFrees++;
+
+	pxSite->xCurrentBytes -= xBlockSize;
+	pxSite->xCurrentBlocks--;
+}
+/*-----------------------------------------------------------*/
+
+void vHeapTraceResize( const HeapTraceTag_t *pxTag, size_t xOldBlockSize, size_t xNewBlockSize )
+{
+HeapTraceTask_t *pxTask = &( xTasks[ pxTag->ucTask ].xStats );
+HeapTraceSite_t *pxSite = &( xSites[ pxTag->ucSite ] );
+
+	pxTask->xCurrentBytes -= xOldBlockSize;
+	prvCharge( &( pxTask->xCurrentBytes ), &( pxTask->xPeakBytes ), xNewBlockSize );
+
+	pxSite->xCurrentBytes -= xOldBlockSize;
+	prvCharge( &( pxSite->xCurrentBytes ), &( pxSite->xPeakBytes ), xNewBlockSize );
+}
+/*-----------------------------------------------------------*/
+
+UBaseType_t uxPortHeapTraceGetTasks( HeapTraceTask_t * const pxTaskArray, const UBaseType_t uxArraySize )
+{
+UBaseType_t ux, uxCount = 0;
+
+	vTaskSuspendAll();
+	{
+		for( ux = 0; ( ux < uxNumberOfTasks ) && ( uxCount < uxArraySize ); ux++ )
+		{
+			pxTaskArray[ uxCount++ ] = xTasks[ ux ].xStats;
+		}
+	}
+	( void ) xTaskResumeAll();
+
+	return uxCount;
+}
+/*-----------------------------------------------------------*/
+
+UBaseType_t uxPortHeapTraceGetSites( HeapTraceSite_t * const pxSiteArray, const UBaseType_t uxArraySize )
+{
+UBaseType_t ux, uxPos, uxCount = 0;
+const HeapTraceSite_t *pxSite;
+
+	if( uxArraySize == 0 )
+	{
+		return 0;
+	}
+
+	vTaskSuspendAll();
+	{
+		/* Insertion into the sorted output keeps only the largest
+		uxArraySize sites without a second buffer. */
+		for( ux = 0; ux <= configHEAP_TRACE_MAX_SITES; ux++ )
+		{
+			pxSite = &( xSites[ ux ] );
+			if( pxSite->xCurrentBlocks == 0 )
+			{
+				continue;
+			}
+
+			if( ( uxCount == uxArraySize ) && ( pxSite->xCurrentBytes <= pxSiteArray[ uxCount - 1 ].xCurrentBytes ) )
+			{
+				continue;
+			}
+
+			uxPos = ( uxCount < uxArraySize ) ? uxCount++ : uxCount - 1;
+			while( ( uxPos > 0 ) && ( pxSiteArray[ uxPos - 1 ].xCurrentBytes < pxSite->xCurrentBytes ) )
+			{
+				pxSiteArray[ uxPos ] = pxSiteArray[ uxPos - 1 ];
+				uxPos--;
+			}
+
+			pxSiteArray[ uxPos ] = *pxSite;
+		}
+	}
+	( void ) xTaskResumeAll();
+
+	return uxCount;
+}
+
+#endif /* configUSE_HEAP_TRACE */
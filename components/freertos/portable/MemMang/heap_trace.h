@@ -0,0 +1,68 @@
+/*
+ * FreeRTOS Kernel V10.3.0
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/*
+ * Interface between the heap implementations and heap_trace.c.  Only the heap
+ * files include this; applications read the results through
+ * uxPortHeapTraceGetTasks() and uxPortHeapTraceGetSites() in portable.h.
+ */
+#ifndef HEAP_TRACE_H
+#define HEAP_TRACE_H
+
+#if( configUSE_HEAP_TRACE == 1 )
+
+/* Stored in the header of every allocated block.  Both indices refer to the
+tables in heap_trace.c, so the tag stays valid after the task that made the
+allocation is deleted. */
+typedef struct HEAP_TRACE_TAG
+{
+	uint8_t ucTask;
+	uint8_t ucSite;
+	uint16_t usReserved;
+} HeapTraceTag_t;
+
+/*
+ * Called by the heap, with the scheduler suspended, once a block of
+ * xBlockSize bytes has been handed out.  Records the calling task and
+ * pvCaller in pxTag and charges the block to both.
+ */
+void vHeapTraceAlloc( HeapTraceTag_t *pxTag, size_t xBlockSize, void *pvCaller );
+
+/*
+ * Called by the heap, with the scheduler suspended, before a block tagged by
+ * vHeapTraceAlloc() is returned to the free memory.
+ */
+void vHeapTraceFree( const HeapTraceTag_t *pxTag, size_t xBlockSize );
+
+/*
+ * Called by the heap, with the scheduler suspended, when a block is resized
+ * in place by pvPortRealloc().
+ */
+void vHeapTraceResize( const HeapTraceTag_t *pxTag, size_t xOldBlockSize, size_t xNewBlockSize );
+
+#endif /* configUSE_HEAP_TRACE */
+
+#endif /* HEAP_TRACE_H */
@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host trace replay for the FreeRTOS heaps.  A seeded mix of lwIP, TLS and
+ * cJSON sized malloc, free and realloc runs on a 120K and a 100K region,
+ * with the live bytes swinging up to near exhaustion.  Every block is
+ * filled with its own pattern and checked before it is freed or after it is
+ * moved, so overlapping blocks are found.  Blocks must be aligned and inside
+ * a region, TLSF calloc must reject an overflowing count, and once everything is
+ * freed the free bytes must be back to the start and, for TLSF, each region
+ * must be one free block.  Prints the mean malloc and free time, the failed
+ * allocations and the largest free block at the peaks.  Replays on
+ * heap_tlsf.c, or on heap_bl602.c with TEST_HEAP_BL602.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* FreeRTOS.h and task.h need the port, only the heap types and hooks are used */
+#define INC_FREERTOS_H
+#define INC_TASK_H
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+typedef struct HeapRegion
+{
+    uint8_t *pucStartAddress;
+    size_t xSizeInBytes;
+} HeapRegion_t;
+
+typedef struct xHeapStats
+{
+    size_t xAvailableHeapSpaceInBytes;
+    size_t xSizeOfLargestFreeBlockInBytes;
+    size_t xSizeOfSmallestFreeBlockInBytes;
+    size_t xNumberOfFreeBlocks;
+    size_t xMinimumEverFreeBytesRemaining;
+    size_t xNumberOfSuccessfulAllocations;
+    size_t xNumberOfSuccessfulFrees;
+} HeapStats_t;
+
+#define pdFALSE                             ( ( BaseType_t ) 0 )
+#define pdTRUE                              ( ( BaseType_t ) 1 )
+#define portMAX_DELAY                       ( ( size_t ) -1 )
+#define portBYTE_ALIGNMENT                  16
+#define portBYTE_ALIGNMENT_MASK             ( 0x000f )
+#define portPOINTER_SIZE_TYPE               uintptr_t
+#define configSUPPORT_DYNAMIC_ALLOCATION    1
+#define configUSE_HEAP_TRACE                0
+#define configUSE_MALLOC_FAILED_HOOK        0
+#define configASSERT( x )                   do { if( !( x ) ) { printf( "FAIL assert %s:%d\n", __FILE__, __LINE__ ); exit( 1 ); } } while( 0 )
+#define mtCOVERAGE_TEST_MARKER()
+#define traceMALLOC( pvAddress, uiSize )
+#define traceFREE( pvAddress, uiSize )
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define vTaskSuspendAll()
+
+static BaseType_t xTaskResumeAll( void )
+{
+    return pdTRUE;
+}
+
+#ifdef TEST_HEAP_BL602
+#include "../heap_bl602.c"
+#define TEST_HEAP_NAME      "heap_bl602"
+#else
+#include "../heap_tlsf.c"
+#define TEST_HEAP_NAME      "heap_tlsf"
+#endif
+
+#define TEST_OPS            2000000
+#define TEST_LIVE_MAX       1024
+#define TEST_PHASE_OPS      20000
+
+static int test_failed;
+
+/* heap_bl602.c wants the regions in address order, with a gap between them */
+static uint8_t heap_mem[224 * 1024] __attribute__((aligned(16)));
+#define region0             heap_mem
+#define region0_size        (120 * 1024)
+#define region1             (heap_mem + 124 * 1024)
+#define region1_size        (100 * 1024)
+static const HeapRegion_t regions[] = {
+    {region0, region0_size},
+    {region1, region1_size},
+    {NULL, 0},
+};
+
+static struct {
+    uint8_t *p;
+    size_t len;
+    uint8_t seed;
+} live[TEST_LIVE_MAX];
+static int live_num;
+static size_t live_bytes;
+
+static unsigned long malloc_num, malloc_fail, free_num;
+static double malloc_ns, free_ns;
+static size_t peak_largest_min = (size_t)-1;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* the mix of lwIP, TLS and cJSON sizes */
+static size_t random_size(void)
+{
+    int r = rand() % 100;
+
+    if (r < 55) {
+        return 16 + rand() % 112;       //cJSON nodes and strings
+    } else if (r < 85) {
+        return 128 + rand() % 1600;     //lwIP pcbs and pbufs
+    } else if (r < 97) {
+        return 1024 + rand() % 3072;    //TLS records and certificates
+    }
+    return 16 * 1024 + rand() % 1024;   //TLS in/out buffers
+}
+
+static void fill(int i)
+{
+    size_t j;
+
+    for (j = 0; j < live[i].len; j++) {
+        live[i].p[j] = live[i].seed + j * 7;
+    }
+}
+
+static int check(int i, size_t len)
+{
+    size_t j;
+
+    for (j = 0; j < len; j++) {
+        if (live[i].p[j] != (uint8_t)(live[i].seed + j * 7)) {
+            printf("FAIL block %p/%zu is overwritten at %zu\n", (void *)live[i].p, live[i].len, j);
+            test_failed = 1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int in_region(const uint8_t *p, size_t len)
+{
+    return (p >= region0 && p + len <= region0 + region0_size) ||
+           (p >= region1 && p + len <= region1 + region1_size);
+}
+
+static void do_malloc(void)
+{
+    size_t len = random_size();
+    double t;
+    void *p;
+
+    t = now_ns();
+    p = pvPortMalloc(len);
+    malloc_ns += now_ns() - t;
+    malloc_num++;
+    if (p == NULL) {
+        malloc_fail++;
+        return;
+    }
+    if (((uintptr_t)p & portBYTE_ALIGNMENT_MASK) || !in_region(p, len)) {
+        printf("FAIL block %p/%zu is not aligned or outside the heap\n", p, len);
+        test_failed = 1;
+    }
+    live[live_num].p = p;
+    live[live_num].len = len;
+    live[live_num].seed = rand();
+    fill(live_num);
+    live_bytes += len;
+    live_num++;
+}
+
+static void do_free(int i)
+{
+    double t;
+
+    check(i, live[i].len);
+    t = now_ns();
+    vPortFree(live[i].p);
+    free_ns += now_ns() - t;
+    free_num++;
+    live_bytes -= live[i].len;
+    live[i] = live[--live_num];
+}
+
+static void do_realloc(int i)
+{
+    size_t len = (rand() % 2) ? live[i].len / 2 + 1 : live[i].len + 1 + rand() % 512;
+    void *p;
+
+    p = pvPortRealloc(live[i].p, len);
+    if (p == NULL) {
+        /* the old block is kept */
+        check(i, live[i].len);
+        return;
+    }
+    if (((uintptr_t)p & portBYTE_ALIGNMENT_MASK) || !in_region(p, len)) {
+        printf("FAIL realloc %p/%zu is not aligned or outside the heap\n", p, len);
+        test_failed = 1;
+    }
+    live[i].p = p;
+    check(i, len < live[i].len ? len : live[i].len);
+    live_bytes += len - live[i].len;
+    live[i].len = len;
+    fill(i);
+}
+
+static void replay(void)
+{
+    HeapStats_t stats;
+    size_t target;
+    int op, phase_peak = 0;
+
+    for (op = 0; op < TEST_OPS && !test_failed; op++) {
+        /* the live bytes swing from 10% to 85% of the heap */
+        target = (region0_size + region1_size) / 20 *
+                 (2 + 15 * ((op / TEST_PHASE_OPS) % 2 ? TEST_PHASE_OPS - op % TEST_PHASE_OPS : op % TEST_PHASE_OPS) / TEST_PHASE_OPS);
+        if (op % TEST_PHASE_OPS == 0 && op / TEST_PHASE_OPS % 2 == 1) {
+            phase_peak = 1;
+        }
+        if (phase_peak) {
+            vPortGetHeapStats(&stats);
+            if (stats.xSizeOfLargestFreeBlockInBytes < peak_largest_min) {
+                peak_largest_min = stats.xSizeOfLargestFreeBlockInBytes;
+            }
+            phase_peak = 0;
+        }
+
+        if (live_num > 0 && rand() % 10 == 0) {
+            do_realloc(rand() % live_num);
+        } else if (live_num < TEST_LIVE_MAX && (live_bytes < target || live_num == 0)) {
+            do_malloc();
+        } else {
+            do_free(rand() % live_num);
+        }
+    }
+}
+
+int main(void)
+{
+    HeapStats_t stats;
+    size_t free_start;
+
+    srand(1);
+    vPortDefineHeapRegions(regions);
+    free_start = xPortGetFreeHeapSize();
+
+#ifndef TEST_HEAP_BL602
+    /* heap_bl602.c does not check the count, it only runs the trace */
+    if (pvPortCalloc((size_t)-1 / 2 + 2, 2) != NULL) {
+        printf("FAIL calloc overflow\n");
+        test_failed = 1;
+    }
+#endif
+
+    replay();
+    while (live_num > 0) {
+        do_free(live_num - 1);
+    }
+
+    vPortGetHeapStats(&stats);
+    if (xPortGetFreeHeapSize() != free_start) {
+        printf("FAIL %zu bytes free, %zu at start\n", xPortGetFreeHeapSize(), free_start);
+        test_failed = 1;
+    }
+#ifndef TEST_HEAP_BL602
+    if (stats.xNumberOfFreeBlocks != 2) {
+        printf("FAIL %zu free blocks left, the regions are not merged\n", stats.xNumberOfFreeBlocks);
+        test_failed = 1;
+    }
+#endif
+    printf("%s: malloc %.1f ns, free %.1f ns, %lu of %lu mallocs failed, largest free at peaks %zu, min free %zu\n",
+           TEST_HEAP_NAME, malloc_ns / malloc_num, free_ns / free_num, malloc_fail, malloc_num,
+           peak_largest_min, stats.xMinimumEverFreeBytesRemaining);
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
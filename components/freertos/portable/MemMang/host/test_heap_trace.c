@@ -0,0 +1,515 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test of the heap trace accounting (../heap_trace.c).  Malloc, free and
+ * realloc run on a static region from 30 fake tasks and 80 fake call sites,
+ * first with the scheduler not started, and tasks are renamed to model a
+ * deleted TCB being reused.  The size of every block is taken from the drop
+ * in free bytes, and a model keeps the same per task and per site totals.
+ * uxPortHeapTraceGetTasks() must match the model, including the "(other)"
+ * entry once the tables are full, uxPortHeapTraceGetSites() must match it and
+ * be sorted, a short array must get the largest sites, and the task and site
+ * totals must both add up to the bytes the heap has handed out.  Runs on
+ * heap_tlsf.c, or on heap_bl602.c with TEST_HEAP_BL602.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS.h and task.h need the port, only the heap types and hooks are used */
+#define INC_FREERTOS_H
+#define INC_TASK_H
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define configMAX_TASK_NAME_LEN             16
+
+typedef struct HeapRegion
+{
+    uint8_t *pucStartAddress;
+    size_t xSizeInBytes;
+} HeapRegion_t;
+
+typedef struct xHeapStats
+{
+    size_t xAvailableHeapSpaceInBytes;
+    size_t xSizeOfLargestFreeBlockInBytes;
+    size_t xSizeOfSmallestFreeBlockInBytes;
+    size_t xNumberOfFreeBlocks;
+    size_t xMinimumEverFreeBytesRemaining;
+    size_t xNumberOfSuccessfulAllocations;
+    size_t xNumberOfSuccessfulFrees;
+} HeapStats_t;
+
+typedef struct xHeapTraceTask
+{
+    char pcTaskName[configMAX_TASK_NAME_LEN];
+    size_t xCurrentBytes;
+    size_t xPeakBytes;
+    size_t xNumberOfAllocations;
+    size_t xNumberOfFrees;
+} HeapTraceTask_t;
+
+typedef struct xHeapTraceSite
+{
+    void *pvCaller;
+    size_t xCurrentBytes;
+    size_t xPeakBytes;
+    size_t xCurrentBlocks;
+} HeapTraceSite_t;
+
+#define pdFALSE                             ( ( BaseType_t ) 0 )
+#define pdTRUE                              ( ( BaseType_t ) 1 )
+#define portMAX_DELAY                       ( ( size_t ) -1 )
+#define portBYTE_ALIGNMENT                  16
+#define portBYTE_ALIGNMENT_MASK             ( 0x000f )
+#define portPOINTER_SIZE_TYPE               uintptr_t
+#define configSUPPORT_DYNAMIC_ALLOCATION    1
+#define configUSE_HEAP_TRACE                1
+#define configUSE_MALLOC_FAILED_HOOK        0
+#define configASSERT( x )                   do { if( !( x ) ) { printf( "FAIL assert %s:%d\n", __FILE__, __LINE__ ); exit( 1 ); } } while( 0 )
+#define mtCOVERAGE_TEST_MARKER()
+#define traceMALLOC( pvAddress, uiSize )
+#define traceFREE( pvAddress, uiSize )
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define vTaskSuspendAll()
+#define taskSCHEDULER_NOT_STARTED           ( ( BaseType_t ) 1 )
+#define taskSCHEDULER_RUNNING               ( ( BaseType_t ) 2 )
+
+/* a fake TCB is just the name, the handle is its address */
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+} test_tcb_t;
+typedef test_tcb_t *TaskHandle_t;
+
+static BaseType_t scheduler_state = taskSCHEDULER_NOT_STARTED;
+static TaskHandle_t current_task;
+
+static BaseType_t xTaskResumeAll( void )
+{
+    return pdTRUE;
+}
+
+static BaseType_t xTaskGetSchedulerState( void )
+{
+    return scheduler_state;
+}
+
+static TaskHandle_t xTaskGetCurrentTaskHandle( void )
+{
+    return current_task;
+}
+
+static char *pcTaskGetName( TaskHandle_t xTask )
+{
+    return xTask->name;
+}
+
+#include "../heap_trace.c"
+#ifdef TEST_HEAP_BL602
+#include "../heap_bl602.c"
+#define TEST_HEAP_NAME      "heap_bl602"
+#else
+#include "../heap_tlsf.c"
+#define TEST_HEAP_NAME      "heap_tlsf"
+#endif
+
+#define TEST_OPS            200000
+#define TEST_LIVE_MAX       256
+#define TEST_TASKS          30
+#define TEST_SITES          80
+#define TEST_CHECK_OPS      64
+/* the pvPortRealloc() call in do_realloc() is one more site */
+#define TEST_SITE_REALLOC   TEST_SITES
+
+static int test_failed;
+
+static uint8_t heap_mem[64 * 1024] __attribute__((aligned(16)));
+static const HeapRegion_t regions[] = {
+    {heap_mem, sizeof(heap_mem)},
+    {NULL, 0},
+};
+static size_t free_start;
+
+static test_tcb_t tcbs[TEST_TASKS];
+static int tcb_renames[TEST_TASKS];
+
+/* the model of the trace tables, filled in the same first come order */
+static struct {
+    TaskHandle_t handle;
+    HeapTraceTask_t stats;
+} model_tasks[configHEAP_TRACE_MAX_TASKS];
+static int model_task_num = 1;
+static HeapTraceSite_t model_sites[TEST_SITES + 2];
+static int model_site_entry[TEST_SITES + 1];
+static int model_site_num;
+#define MODEL_OTHER_SITE    (TEST_SITES + 1)
+static void *realloc_caller;
+
+typedef struct {
+    uint8_t *p;
+    size_t size;
+    int task;
+    int site;
+} test_block_t;
+static test_block_t live[TEST_LIVE_MAX];
+static int live_num;
+
+static void *site_caller(int site)
+{
+    return (void *)(uintptr_t)(0x23000000 + site * 6);
+}
+
+static void charge(size_t *cur, size_t *peak, size_t bytes)
+{
+    *cur += bytes;
+    if (*cur > *peak) {
+        *peak = *cur;
+    }
+}
+
+static int model_task(void)
+{
+    int i;
+
+    if (scheduler_state == taskSCHEDULER_NOT_STARTED) {
+        return 0;
+    }
+    for (i = 1; i < model_task_num; i++) {
+        if (model_tasks[i].handle == current_task &&
+            strcmp(model_tasks[i].stats.pcTaskName, current_task->name) == 0) {
+            return i;
+        }
+    }
+    if (model_task_num == configHEAP_TRACE_MAX_TASKS) {
+        return 0;
+    }
+    model_tasks[i].handle = current_task;
+    strcpy(model_tasks[i].stats.pcTaskName, current_task->name);
+    model_task_num++;
+    return i;
+}
+
+static int model_site(int site)
+{
+    if (model_site_entry[site] < 0) {
+        if (model_site_num == configHEAP_TRACE_MAX_SITES - 1) {
+            return MODEL_OTHER_SITE;
+        }
+        model_site_entry[site] = site;
+        model_site_num++;
+    }
+    return model_site_entry[site];
+}
+
+static void model_alloc(test_block_t *b, int site, size_t size)
+{
+    b->size = size;
+    b->task = model_task();
+    b->site = model_site(site);
+    charge(&model_tasks[b->task].stats.xCurrentBytes, &model_tasks[b->task].stats.xPeakBytes, size);
+    model_tasks[b->task].stats.xNumberOfAllocations++;
+    charge(&model_sites[b->site].xCurrentBytes, &model_sites[b->site].xPeakBytes, size);
+    model_sites[b->site].xCurrentBlocks++;
+}
+
+static void model_free(const test_block_t *b)
+{
+    model_tasks[b->task].stats.xCurrentBytes -= b->size;
+    model_tasks[b->task].stats.xNumberOfFrees++;
+    model_sites[b->site].xCurrentBytes -= b->size;
+    model_sites[b->site].xCurrentBlocks--;
+}
+
+static void model_resize(test_block_t *b, size_t size)
+{
+    model_tasks[b->task].stats.xCurrentBytes -= b->size;
+    charge(&model_tasks[b->task].stats.xCurrentBytes, &model_tasks[b->task].stats.xPeakBytes, size);
+    model_sites[b->site].xCurrentBytes -= b->size;
+    charge(&model_sites[b->site].xCurrentBytes, &model_sites[b->site].xPeakBytes, size);
+    b->size = size;
+}
+
+static size_t random_size(void)
+{
+    int r = rand() % 100;
+
+    if (r < 60) {
+        return 1 + rand() % 128;
+    } else if (r < 95) {
+        return 128 + rand() % 1024;
+    }
+    return 1024 + rand() % 4096;
+}
+
+/* a few sites allocate most of the blocks, like on the device */
+static int random_site(void)
+{
+    return (rand() % 2) ? rand() % 8 : rand() % TEST_SITES;
+}
+
+static void do_malloc(void)
+{
+    size_t free_before = xPortGetFreeHeapSize();
+    int site = random_site();
+    void *p;
+
+    p = pvPortMallocFrom(random_size(), site_caller(site));
+    if (p == NULL) {
+        if (xPortGetFreeHeapSize() != free_before) {
+            printf("FAIL failed malloc changed the free bytes\n");
+            test_failed = 1;
+        }
+        return;
+    }
+    live[live_num].p = p;
+    model_alloc(&live[live_num], site, free_before - xPortGetFreeHeapSize());
+    live_num++;
+}
+
+static void do_free(int i)
+{
+    vPortFree(live[i].p);
+    model_free(&live[i]);
+    live[i] = live[--live_num];
+}
+
+static void __attribute__((noinline)) do_realloc(int i)
+{
+    size_t len = (rand() % 2) ? rand() % 64 + 1 : rand() % 2048 + 1;
+    size_t free_before = xPortGetFreeHeapSize();
+    test_block_t old = live[i];
+    void *p;
+
+    p = pvPortRealloc(live[i].p, len);
+    if (p == NULL) {
+        if (xPortGetFreeHeapSize() != free_before) {
+            printf("FAIL failed realloc changed the free bytes\n");
+            test_failed = 1;
+        }
+        return;
+    }
+    if (p == live[i].p) {
+        /* resized in place, still charged to the task and site that allocated it */
+        model_resize(&live[i], live[i].size + free_before - xPortGetFreeHeapSize());
+        return;
+    }
+    /* moved, the new block comes from this call and is charged before the
+     * old one is freed */
+    live[i].p = p;
+    model_alloc(&live[i], TEST_SITE_REALLOC, old.size + free_before - xPortGetFreeHeapSize());
+    model_free(&old);
+}
+
+static int site_of(const HeapTraceSite_t *site)
+{
+    int i;
+
+    if (site->pvCaller == NULL) {
+        return MODEL_OTHER_SITE;
+    }
+    for (i = 0; i < TEST_SITES; i++) {
+        if (site->pvCaller == site_caller(i)) {
+            return i;
+        }
+    }
+    if (realloc_caller == NULL) {
+        realloc_caller = site->pvCaller;
+    }
+    return site->pvCaller == realloc_caller ? TEST_SITE_REALLOC : -1;
+}
+
+static void check_tasks(void)
+{
+    HeapTraceTask_t tasks[configHEAP_TRACE_MAX_TASKS + 1];
+    UBaseType_t num;
+    size_t total = 0;
+    int i;
+
+    num = uxPortHeapTraceGetTasks(tasks, configHEAP_TRACE_MAX_TASKS + 1);
+    if ((int)num != model_task_num) {
+        printf("FAIL %lu tasks traced, %d expected\n", num, model_task_num);
+        test_failed = 1;
+        return;
+    }
+    for (i = 0; i < model_task_num; i++) {
+        if (memcmp(&tasks[i], &model_tasks[i].stats, sizeof(tasks[i])) != 0) {
+            printf("FAIL task %d %s: %zu/%zu bytes, %zu/%zu allocs, %zu/%zu frees, %zu/%zu peak\n",
+                   i, tasks[i].pcTaskName,
+                   tasks[i].xCurrentBytes, model_tasks[i].stats.xCurrentBytes,
+                   tasks[i].xNumberOfAllocations, model_tasks[i].stats.xNumberOfAllocations,
+                   tasks[i].xNumberOfFrees, model_tasks[i].stats.xNumberOfFrees,
+                   tasks[i].xPeakBytes, model_tasks[i].stats.xPeakBytes);
+            test_failed = 1;
+        }
+        total += tasks[i].xCurrentBytes;
+    }
+    if (total != free_start - xPortGetFreeHeapSize()) {
+        printf("FAIL tasks hold %zu bytes, the heap handed out %zu\n", total, free_start - xPortGetFreeHeapSize());
+        test_failed = 1;
+    }
+}
+
+static void check_sites(void)
+{
+    HeapTraceSite_t sites[configHEAP_TRACE_MAX_SITES + 1], top[5];
+    UBaseType_t num, top_num;
+    size_t total = 0;
+    int i, s, expect = 0;
+
+    for (i = 0; i <= MODEL_OTHER_SITE; i++) {
+        expect += model_sites[i].xCurrentBlocks != 0;
+    }
+    num = uxPortHeapTraceGetSites(sites, configHEAP_TRACE_MAX_SITES + 1);
+    if ((int)num != expect) {
+        printf("FAIL %lu sites traced, %d expected\n", num, expect);
+        test_failed = 1;
+        return;
+    }
+    for (i = 0; i < (int)num; i++) {
+        s = site_of(&sites[i]);
+        if (s < 0 || sites[i].xCurrentBytes != model_sites[s].xCurrentBytes ||
+            sites[i].xPeakBytes != model_sites[s].xPeakBytes ||
+            sites[i].xCurrentBlocks != model_sites[s].xCurrentBlocks) {
+            printf("FAIL site %p: %zu bytes, %zu peak, %zu blocks\n", sites[i].pvCaller,
+                   sites[i].xCurrentBytes, sites[i].xPeakBytes, sites[i].xCurrentBlocks);
+            test_failed = 1;
+        }
+        if (i > 0 && sites[i].xCurrentBytes > sites[i - 1].xCurrentBytes) {
+            printf("FAIL sites are not sorted at %d\n", i);
+            test_failed = 1;
+        }
+        total += sites[i].xCurrentBytes;
+    }
+    if (total != free_start - xPortGetFreeHeapSize()) {
+        printf("FAIL sites hold %zu bytes, the heap handed out %zu\n", total, free_start - xPortGetFreeHeapSize());
+        test_failed = 1;
+    }
+
+    top_num = uxPortHeapTraceGetSites(top, 5);
+    if (top_num != (num < 5 ? num : 5)) {
+        printf("FAIL %lu top sites, %lu traced\n", top_num, num);
+        test_failed = 1;
+        return;
+    }
+    for (i = 0; i < (int)top_num; i++) {
+        if (top[i].xCurrentBytes != sites[i].xCurrentBytes) {
+            printf("FAIL top site %d holds %zu bytes, %zu expected\n", i, top[i].xCurrentBytes, sites[i].xCurrentBytes);
+            test_failed = 1;
+        }
+    }
+}
+
+static void run(int ops)
+{
+    int op, t;
+
+    for (op = 0; op < ops && !test_failed; op++) {
+        if (scheduler_state == taskSCHEDULER_RUNNING) {
+            t = rand() % TEST_TASKS;
+            current_task = &tcbs[t];
+            /* the task is deleted and its TCB is reused by a new one */
+            if (rand() % 1000 == 0) {
+                snprintf(tcbs[t].name, sizeof(tcbs[t].name), "task%02d.%03d", t % 100, ++tcb_renames[t] % 1000);
+            }
+        }
+
+        if (live_num > 0 && rand() % 8 == 0) {
+            do_realloc(rand() % live_num);
+        } else if (live_num < TEST_LIVE_MAX && rand() % 2 == 0) {
+            do_malloc();
+        } else if (live_num > 0) {
+            do_free(rand() % live_num);
+        }
+        if (op % TEST_CHECK_OPS == 0) {
+            check_tasks();
+            check_sites();
+        }
+    }
+    check_tasks();
+    check_sites();
+}
+
+int main(void)
+{
+    int i;
+
+    srand(1);
+    for (i = 0; i <= TEST_SITES; i++) {
+        model_site_entry[i] = -1;
+    }
+    for (i = 0; i < TEST_TASKS; i++) {
+        snprintf(tcbs[i].name, sizeof(tcbs[i].name), "task%d", i);
+    }
+    strcpy(model_tasks[0].stats.pcTaskName, "(other)");
+
+    vPortDefineHeapRegions(regions);
+    free_start = xPortGetFreeHeapSize();
+
+    /* before the scheduler starts everything goes to "(other)" */
+    run(200);
+    scheduler_state = taskSCHEDULER_RUNNING;
+
+    /* a reused TCB with a new name is a new task, the old blocks stay with the old one */
+    current_task = &tcbs[0];
+    do_malloc();
+    snprintf(tcbs[0].name, sizeof(tcbs[0].name), "task00.000");
+    do_malloc();
+    if (model_task_num != 3) {
+        printf("FAIL the renamed task is not a new entry\n");
+        test_failed = 1;
+    }
+    run(TEST_OPS);
+
+    while (live_num > 0 && !test_failed) {
+        do_free(live_num - 1);
+    }
+    check_tasks();
+    check_sites();
+    if (xPortGetFreeHeapSize() != free_start) {
+        printf("FAIL %zu bytes free, %zu at start\n", xPortGetFreeHeapSize(), free_start);
+        test_failed = 1;
+    }
+    if (model_task_num != configHEAP_TRACE_MAX_TASKS || model_site_num != configHEAP_TRACE_MAX_SITES - 1 ||
+        model_tasks[0].stats.xNumberOfAllocations == 0 || model_sites[MODEL_OTHER_SITE].xPeakBytes == 0) {
+        printf("FAIL the task and site tables did not fill up\n");
+        test_failed = 1;
+    }
+    printf("%s: %d tasks, %d sites, %zu bytes peak in (other) task, %zu in (other) site\n", TEST_HEAP_NAME,
+           model_task_num, model_site_num, model_tasks[0].stats.xPeakBytes, model_sites[MODEL_OTHER_SITE].xPeakBytes);
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test for the romfs path index.  Romfs images are built in memory
+ * below 4 GB, as romfs keeps XIP addresses in uint32_t.  Every file and dir
+ * must be found by the index at the same start and end as the linear walk,
+ * misses must not be found, and mounting again and again, also a different
+ * image, must keep exactly one index allocated and match the new image.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+/* utils_log.h needs FreeRTOS */
+#define __UTILS_LOG_H__
+#define log_error(...)
+#define log_warn(...)
+#define log_info(...)
+#define log_buf(...)
+
+#include "../src/bl_romfs.c"
+
+#define TEST_IMAGE_SIZE     (64 * 1024)
+#define TEST_MANY_NUM       100
+
+static int test_failed;
+
+/* mtd and aos stubs */
+static char *image;
+static int malloc_live;
+
+int bl_mtd_open(const char *name, bl_mtd_handle_t *handle, unsigned int flags)
+{
+    (void)name;
+    (void)flags;
+    *handle = image;
+    return 0;
+}
+
+int bl_mtd_info(bl_mtd_handle_t handle, bl_mtd_info_t *info)
+{
+    info->xip_addr = handle;
+    return 0;
+}
+
+void *aos_malloc(unsigned int size)
+{
+    malloc_live++;
+    return malloc(size);
+}
+
+void aos_free(void *mem)
+{
+    if (mem) {
+        malloc_live--;
+    }
+    free(mem);
+}
+
+int aos_register_fs(const char *path, fs_ops_t *fops, void *arg)
+{
+    (void)path;
+    (void)fops;
+    (void)arg;
+    return 0;
+}
+
+int aos_open(const char *path, int flags)
+{
+    (void)path;
+    (void)flags;
+    return -1;
+}
+
+int aos_close(int fd)
+{
+    (void)fd;
+    return -1;
+}
+
+ssize_t aos_read(int fd, void *buf, size_t nbytes)
+{
+    (void)fd;
+    (void)buf;
+    (void)nbytes;
+    return -1;
+}
+
+int aos_ioctl(int fd, int cmd, unsigned long arg)
+{
+    (void)fd;
+    (void)cmd;
+    (void)arg;
+    return -1;
+}
+
+off_t aos_lseek(int fd, off_t offset, int whence)
+{
+    (void)fd;
+    (void)offset;
+    (void)whence;
+    return -1;
+}
+
+aos_dir_t *aos_opendir(const char *path)
+{
+    (void)path;
+    return NULL;
+}
+
+aos_dirent_t *aos_readdir(aos_dir_t *dir)
+{
+    (void)dir;
+    return NULL;
+}
+
+int aos_closedir(aos_dir_t *dir)
+{
+    (void)dir;
+    return -1;
+}
+
+/* image tree, a dir has child and no data, a list ends with a NULL name */
+struct tnode {
+    const char *name;
+    const char *data;
+    const struct tnode *child;
+};
+
+static const struct tnode empty_dir[] = {{NULL, NULL, NULL}};
+static const struct tnode img_dir[] = {
+    {"logo.png", "PNG..", NULL},
+    {"a.bin", "0123456789abcdef0123", NULL},
+    {NULL, NULL, NULL},
+};
+static const struct tnode css_dir[] = {
+    {"style.css", "body{}", NULL},
+    {"img", NULL, img_dir},
+    {NULL, NULL, NULL},
+};
+static const struct tnode child_dir[] = {
+    {"aa.bin", "aa", NULL},
+    {"bb.bin", "bbbb", NULL},
+    {NULL, NULL, NULL},
+};
+static const struct tnode tree_web[] = {
+    {"index.html", "<html></html>", NULL},
+    {"css", NULL, css_dir},
+    {"empty", NULL, empty_dir},
+    {"child", NULL, child_dir},
+    {"readme.txt", "romfs", NULL},
+    {NULL, NULL, NULL},
+};
+static char many_names[TEST_MANY_NUM][16];
+static struct tnode many_dir[TEST_MANY_NUM + 1];
+static const struct tnode tree_many[] = {
+    {"many", NULL, many_dir},
+    {"child", NULL, child_dir},
+    {NULL, NULL, NULL},
+};
+
+static void put_be32(char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/* write a file header, returns the offset behind name */
+static uint32_t put_hdr(uint32_t off, int type, uint32_t spec, uint32_t size, const char *name)
+{
+    put_be32(image + off, type);
+    put_be32(image + off + 4, spec);
+    put_be32(image + off + 8, size);
+    strcpy(image + off + 16, name);
+    return off + 16 + ALIGNUP16(strlen(name) + 1);
+}
+
+/* chain the header at prev to off, keep the type bits */
+static void put_next(uint32_t prev, uint32_t off)
+{
+    put_be32(image + prev, off | (U32HTONL(*(uint32_t *)(image + prev)) & 0x0F));
+}
+
+/* write "." and ".." then the list, depth first as genromfs, returns the end offset */
+static uint32_t put_list(uint32_t off, uint32_t self, const struct tnode *list)
+{
+    uint32_t prev;
+
+    prev = off;
+    off = put_hdr(off, ROMFH_HRD, self, 0, ".");
+    put_next(prev, off);
+    prev = off;
+    off = put_hdr(off, ROMFH_HRD, self, 0, "..");
+    for (; list->name; list++) {
+        put_next(prev, off);
+        prev = off;
+        if (list->child) {
+            off = put_hdr(off, ROMFH_DIR, 0, 0, list->name);
+            put_be32(image + prev + 4, off);
+            off = put_list(off, prev, list->child);
+        } else {
+            off = put_hdr(off, ROMFH_REG, 0, strlen(list->data), list->name);
+            memcpy(image + off, list->data, strlen(list->data));
+            off += ALIGNUP16(strlen(list->data));
+        }
+    }
+    return off;
+}
+
+static void make_image(const struct tnode *tree)
+{
+    uint32_t off;
+
+    memset(image, 0, TEST_IMAGE_SIZE);
+    memcpy(image, "-rom1fs-", 8);
+    strcpy(image + 16, "test");
+    off = put_list(16 + ALIGNUP16(strlen("test") + 1), 0, tree);
+    put_be32(image + 8, off);
+}
+
+static int count_nodes(const struct tnode *list)
+{
+    int n = 0;
+
+    for (; list->name; list++) {
+        n += 1 + (list->child ? count_nodes(list->child) : 0);
+    }
+    return n;
+}
+
+static int lookup(const char *path, bool use_index, void **start, void **end)
+{
+    romfs_index_node_t *index = romfs_index;
+    char buf[128];
+    int ret;
+
+    snprintf(buf, sizeof(buf), "%s", path);
+    if (!use_index) {
+        romfs_index = NULL;
+    }
+    ret = dirent_file(buf, start, end);
+    romfs_index = index;
+    return ret;
+}
+
+/* every node is found by the index as the linear walk finds it */
+static void check_tree(const char *dir, const struct tnode *list)
+{
+    char path[128];
+    void *start, *end, *start_linear, *end_linear;
+
+    for (; list->name; list++) {
+        snprintf(path, sizeof(path), "%s/%s%s", dir, list->name, list->child ? "/" : "");
+        if (lookup(path, true, &start, &end) || lookup(path, false, &start_linear, &end_linear)
+                || start != start_linear || end != end_linear || strcmp((char *)start + 16, list->name)) {
+            printf("FAIL lookup %s\n", path);
+            test_failed = 1;
+        }
+        if (list->child) {
+            path[strlen(path) - 1] = '\0';
+            check_tree(path, list->child);
+        }
+    }
+}
+
+static void check_miss(const char *path)
+{
+    void *start, *end;
+
+    if (0 == lookup(path, true, &start, &end)) {
+        printf("FAIL found %s\n", path);
+        test_failed = 1;
+    }
+}
+
+static void mount(const struct tnode *tree)
+{
+    make_image(tree);
+    if (romfs_register() || NULL == romfs_index) {
+        printf("FAIL mount\n");
+        test_failed = 1;
+        return;
+    }
+    if (romfs_index_num != count_nodes(tree) || malloc_live != 1) {
+        printf("FAIL index has %u nodes, %d allocations\n", romfs_index_num, malloc_live);
+        test_failed = 1;
+    }
+    check_tree("/romfs", tree);
+}
+
+int main(void)
+{
+    int i;
+
+    image = mmap(NULL, TEST_IMAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (MAP_FAILED == image) {
+        printf("FAIL image\n");
+        return 1;
+    }
+    for (i = 0; i < TEST_MANY_NUM; i++) {
+        snprintf(many_names[i], sizeof(many_names[i]), "f%03d.txt", i);
+        many_dir[i].name = many_names[i];
+        many_dir[i].data = many_names[i];
+    }
+
+    mount(tree_web);
+    check_miss("/romfs/nope");
+    check_miss("/romfs/css/nope");
+    check_miss("/romfs/logo.png");
+    check_miss("/romfs/img/logo.png");
+    check_miss("/romfs/css/style.css/x");
+    check_miss("/romfs/cs");
+
+    /* mount again, the old index is freed */
+    for (i = 0; i < 1000 && !test_failed; i++) {
+        mount((i & 1) ? tree_web : tree_many);
+    }
+    printf("remount: %d mounts, %d allocations\n", i, malloc_live);
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
@@ -28,6 +28,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <vfs.h>
 #include <vfs_inode.h>
@@ -51,6 +52,10 @@
 #define ROMFH_REG       2
 #define ROMFH_UNKNOW    3
 
+#define ROMFS_INDEX_ROOT        (0xFFFF)       /* parent of the node in root dir */
+#define ROMFS_INDEX_MAX_DEPTH   (16)
+#define ROMFS_HASH_INIT         (0x811C9DC5)   /* FNV-1a offset basis */
+
 struct romfh {
     int32_t nextfh;
     int32_t spec;
@@ -67,9 +72,20 @@ typedef struct _rom_dir_t
     aos_dirent_t cur_dirent;
 } romfs_dir_t;
 
+typedef struct _romfs_index_node {
+    uint32_t hash;                      /* FNV-1a hash of the path under mountpoint, such as "dir/a.bin" */
+    uint32_t start;                     /* dirent offset */
+    uint32_t end;                       /* end offset, the same as file_info() */
+    uint16_t parent;                    /* parent node, ROMFS_INDEX_ROOT: in root dir */
+} romfs_index_node_t;
+
 static char *romfs_root = NULL;         /* The mount point of the physical addr */
 static bl_mtd_handle_t handle_romfs;
 
+static romfs_index_node_t *romfs_index = NULL;  /* path index built at mount, in romfs order */
+static uint16_t *romfs_index_sorted = NULL;     /* node number sorted by hash */
+static uint16_t romfs_index_num = 0;
+
 static int is_path_ch(char ch)
 {
     if (((ch >= 'a') && (ch <= 'z')) ||
@@ -125,6 +141,8 @@ static int filter_format(const char *path, uint32_t size)
     return 0;
 }
 
+static int romfs_index_build(void);
+
 static int romfs_mount(void)
 {
     int ret;
@@ -151,6 +169,10 @@ static int romfs_mount(void)
     ROMFS_DUBUG("xip addr = %p\r\n", romfs_root);
     log_buf(romfs_root, 64);
 
+    if (0 != romfs_index_build()) {
+        log_warn("romfs path index is not built, use linear lookup\r\n");
+    }
+
     return 0;
 }
 
@@ -187,6 +209,195 @@ static uint32_t dirent_size(void *addr)
     return U32HTONL(*((uint32_t *)addr + 2));
 }
 
+static char *dirent_payload(void *addr)
+{
+    return ((char *)addr) + ALIGNUP16(strlen(((char *)addr) + 16) + 1) + 16;
+}
+
+static uint32_t romfs_hash(uint32_t hash, const char *str, size_t len)
+{
+    while (len--) {
+        hash ^= (uint8_t)*str++;
+        hash *= 0x01000193;
+    }
+
+    return hash;
+}
+
+/*
+ * walk the dir entries from addr to end, count the nodes or fill them when romfs_index is allocated
+ */
+static int romfs_index_walk(char *addr, char *end, uint16_t parent, uint32_t hash, int depth)
+{
+    romfs_index_node_t *node;
+    char *name;
+    char *child;
+    int type;
+
+    if (depth > ROMFS_INDEX_MAX_DEPTH) {
+        log_error("romfs dir is too deep.\r\n");
+        return -1;
+    }
+
+    while (addr < end) {
+        type = dirent_type(addr);
+        name = addr + 16;
+        if (((ROMFH_DIR == type) || (ROMFH_REG == type)) && strcmp(name, ".") && strcmp(name, "..")) {
+            if (romfs_index_num == ROMFS_INDEX_ROOT) {
+                log_error("romfs has too many files.\r\n");
+                return -1;
+            }
+            node = romfs_index ? &romfs_index[romfs_index_num] : NULL;
+            if (node) {
+                node->hash = romfs_hash((ROMFS_INDEX_ROOT == parent) ? hash : romfs_hash(hash, "/", 1), name, strlen(name));
+                node->start = addr - romfs_root;
+                node->end = dirent_hardfh(addr);
+                node->parent = parent;
+            }
+            romfs_index_num++;
+
+            if (ROMFH_DIR == type) {
+                child = romfs_root + dirent_childaddr(addr);
+                if (node && (0 == dirent_hardfh(addr))) {
+                    /* the dir is the last dirent */
+                    node->end = end - romfs_root;
+                }
+                if ((0 != dirent_childaddr(addr)) && (child != addr) &&
+                        (0 != romfs_index_walk(child, dirent_hardfh(addr) ? romfs_root + dirent_hardfh(addr) : end,
+                                               romfs_index_num - 1, node ? node->hash : 0, depth + 1))) {
+                    return -1;
+                }
+            }
+        }
+
+        if (0 == dirent_hardfh(addr)) {
+            break;
+        }
+        addr = romfs_root + dirent_hardfh(addr);
+    }
+
+    return 0;
+}
+
+static int romfs_index_cmp(const void *a, const void *b)
+{
+    uint32_t hash_a = romfs_index[*(const uint16_t *)a].hash;
+    uint32_t hash_b = romfs_index[*(const uint16_t *)b].hash;
+
+    return (hash_a > hash_b) - (hash_a < hash_b);
+}
+
+static void romfs_index_free(void)
+{
+    aos_free(romfs_index);
+    romfs_index = NULL;
+    romfs_index_sorted = NULL;
+    romfs_index_num = 0;
+}
+
+/*
+ * build the path index, the nodes are counted first, then filled and sorted by path hash
+ */
+static int romfs_index_build(void)
+{
+    char *start = romfs_root + ALIGNUP16(strlen(romfs_root + 16) + 1) + 16 + 64;
+    char *end = (char *)romfs_endaddr();
+    uint16_t i, num;
+
+    /* the index of the last mount, the walk only counts the nodes without index */
+    romfs_index_free();
+    if (0 != romfs_index_walk(start, end, ROMFS_INDEX_ROOT, ROMFS_HASH_INIT, 0)) {
+        return -1;
+    }
+    num = romfs_index_num;
+    if (0 == num) {
+        return 0;
+    }
+
+    romfs_index = aos_malloc(num * (sizeof(romfs_index_node_t) + sizeof(uint16_t)));
+    if (NULL == romfs_index) {
+        return -1;
+    }
+    romfs_index_sorted = (uint16_t *)(romfs_index + num);
+
+    romfs_index_num = 0;
+    if ((0 != romfs_index_walk(start, end, ROMFS_INDEX_ROOT, ROMFS_HASH_INIT, 0)) || (romfs_index_num != num)) {
+        romfs_index_free();
+        return -1;
+    }
+
+    for (i = 0; i < num; i++) {
+        romfs_index_sorted[i] = i;
+    }
+    qsort(romfs_index_sorted, num, sizeof(uint16_t), romfs_index_cmp);
+    ROMFS_DUBUG("romfs index has %u nodes\r\n", num);
+
+    return 0;
+}
+
+/*
+ * check the node path, compare the names from the last one to the first one
+ */
+static int romfs_index_match(uint16_t idx, const char *path, size_t len)
+{
+    const char *name;
+    size_t name_len;
+
+    while (ROMFS_INDEX_ROOT != idx) {
+        name = romfs_root + romfs_index[idx].start + 16;
+        name_len = strlen(name);
+        if ((name_len > len) || (0 != memcmp(path + len - name_len, name, name_len))) {
+            return 0;
+        }
+        len -= name_len;
+        idx = romfs_index[idx].parent;
+        if (0 == len) {
+            return (ROMFS_INDEX_ROOT == idx);
+        }
+        if ('/' != path[--len]) {
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * find the path under mountpoint in index, O(log n)
+ */
+static int romfs_index_find(const char *path, char **p_addr_start_input, char **p_addr_end_input)
+{
+    size_t len = strlen(path);
+    uint32_t hash;
+    int low = 0, high = romfs_index_num, mid;
+
+    /* the dir path may end with '/' */
+    while ((len > 0) && ('/' == path[len - 1])) {
+        len--;
+    }
+    hash = romfs_hash(ROMFS_HASH_INIT, path, len);
+
+    /* find the first node which hash is not less than path hash */
+    while (low < high) {
+        mid = (low + high) / 2;
+        if (romfs_index[romfs_index_sorted[mid]].hash < hash) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    for (; (low < romfs_index_num) && (romfs_index[romfs_index_sorted[low]].hash == hash); low++) {
+        if (romfs_index_match(romfs_index_sorted[low], path, len)) {
+            *p_addr_start_input = romfs_root + romfs_index[romfs_index_sorted[low]].start;
+            *p_addr_end_input = romfs_root + romfs_index[romfs_index_sorted[low]].end;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
 static int file_info(char *path, char **p_addr_start_input, char **p_addr_end_input)
 {
     char *addr_start = *p_addr_start_input;
@@ -291,6 +502,17 @@ uint32_t dirent_file(char *path, void **p_addr_start_input, void **p_addr_end_in
     addr_end = (char *)romfs_endaddr();
     ROMFS_DUBUG("romfs start_addr:%p, end_addr:%p, p_name = %s\r\n", addr_start, addr_end, p_name);
 
+    /* search the index */
+    if (romfs_index && (0 != *p_name)) {
+        if (0 != romfs_index_find(p_name, &addr_start, &addr_end)) {
+            log_warn("not found path = %s\r\n", path);
+            return -1;
+        }
+        *p_addr_start_input = addr_start;
+        *p_addr_end_input = addr_end;
+        return 0;
+    }
+
     while (1) {
         if (0 == *p_name) {
             break;
@@ -388,7 +610,7 @@ static ssize_t romfs_read(file_t *fp, char *buf, size_t length)
     int len;
 
     /* init payload_buf and payload_size */
-    payload_buf  = ((char *)fp->f_arg) + ALIGNUP16(strlen(((char *)fp->f_arg) + 16) + 1) + 16;
+    payload_buf  = dirent_payload(fp->f_arg);
     payload_size = dirent_size(fp->f_arg);
 
     /* check arg */
@@ -423,11 +645,27 @@ int romfs_ioctl(file_t *fp, int cmd, unsigned long arg)
         case (IOCTL_ROMFS_GET_FILEBUF):
         {
             ROMFS_DUBUG("IOCTL_ROMFS_GET_FILEBUF.\r\n");
-            file_buf->buf= ((char *)fp->f_arg) + ALIGNUP16(strlen(((char *)fp->f_arg) + 16) + 1) + 16;
+            file_buf->buf= dirent_payload(fp->f_arg);
             file_buf->bufsize = dirent_size(fp->f_arg);
             return 0;
         }
         break;
+        case (IOCTL_ROMFS_MMAP):
+        {
+            /* read without copy, bufsize is the max length (0: no limit) in and the mapped length out */
+            uint32_t payload_size = dirent_size(fp->f_arg);
+            uint32_t len = (fp->offset < payload_size) ? (payload_size - fp->offset) : 0;
+
+            ROMFS_DUBUG("IOCTL_ROMFS_MMAP.\r\n");
+            if ((0 != file_buf->bufsize) && (file_buf->bufsize < len)) {
+                len = file_buf->bufsize;
+            }
+            file_buf->buf = dirent_payload(fp->f_arg) + fp->offset;
+            file_buf->bufsize = len;
+            fp->offset += len;
+            return 0;
+        }
+        break;
         default:
         {
             ret =  -3;
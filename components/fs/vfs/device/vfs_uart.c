@@ -26,6 +26,39 @@ const struct file_ops uart_ops =
     .sync = vfs_uart_sync,
 };
 
+/* bytes moved from the TX stream buffer per TX FIFO interrupt, the FIFO depth */
+#define UART_TX_BURST           (32)
+
+#ifndef UART_DMA_TX_SIZE
+#define UART_DMA_TX_SIZE        (256)
+#endif
+#ifndef UART_DMA_RX_SIZE
+#define UART_DMA_RX_SIZE        (512) /* ping-pong halves of 256 bytes */
+#endif
+/* bytes left in rx_buf when the stream buffer is full, the DMA reaches them after
+ * UART_DMA_RX_SIZE - UART_DMA_RX_KEEP bytes, later than the next half interrupt */
+#define UART_DMA_RX_KEEP        (UART_DMA_RX_SIZE / 4)
+
+#define UART_USE_DMA(uart)      ((uart)->tx_dma_ch != UART_DMA_CH_NONE || \
+                                 (uart)->rx_dma_ch != UART_DMA_CH_NONE)
+
+typedef struct uart_dma {
+    volatile uint8_t tx_busy;   /* a DMA transfer owns tx_buf */
+    uint32_t         rx_tail;   /* next byte of rx_buf to hand to the stream buffer */
+    volatile uint8_t rx_left;   /* bytes are left in rx_buf, the stream buffer was full */
+    uint32_t         rx_overflow; /* bytes dropped, the stream buffer was full too long */
+    uint8_t          tx_buf[UART_DMA_TX_SIZE];
+    uint8_t          rx_buf[UART_DMA_RX_SIZE];
+} uart_dma_t;
+
+static void __uart_poll_notify(uart_dev_t *uart)
+{
+    if (uart->poll_cb != NULL) {
+        ((struct pollfd*)uart->fd)->revents |= POLLIN;
+        ((poll_notify_t)uart->poll_cb)(uart->fd, uart->poll_data);
+    }
+}
+
 static void __uart_rx_irq(void *p_arg)
 {
     uint8_t tmp_buf[64];
@@ -39,29 +72,174 @@ static void __uart_rx_irq(void *p_arg)
                 length, &xHigherPriorityTaskWoken);
         portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
     }
-    if (uart->poll_cb != NULL) {
-        ((struct pollfd*)uart->fd)->revents |= POLLIN;
-        ((poll_notify_t)uart->poll_cb)(uart->fd, uart->poll_data);
-    }
+    __uart_poll_notify(uart);
 }
 
 static void __uart_tx_irq(void *p_arg)
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     uart_dev_t *uart = (uart_dev_t *)p_arg;
-    uint8_t ch;
-    size_t ret;
+    uint8_t buf[UART_TX_BURST];
+    size_t avail, ret;
+
+    /* refill the whole free FIFO with one stream buffer call */
+    avail = hal_uart_send_avail(uart);
+    if (avail > sizeof(buf)) {
+        avail = sizeof(buf);
+    }
+    if (avail == 0) {
+        return;
+    }
 
-    ret = xStreamBufferReceiveFromISR(uart->tx_ringbuf_handle, &ch, 1,
+    ret = xStreamBufferReceiveFromISR(uart->tx_ringbuf_handle, buf, avail,
                                       &xHigherPriorityTaskWoken);
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
-    if (ret == 1) {
-        hal_uart_send(uart, (const void *)&ch, 1, 0);
+    if (ret > 0) {
+        hal_uart_send(uart, (const void *)buf, ret, 0);
     } else {
         hal_uart_send_trigger_off(uart);
     }
 }
 
+/* length of the next contiguous piece between tail and the DMA write offset */
+static uint32_t __uart_dma_rx_span(uint32_t tail, uint32_t pos)
+{
+    return (pos >= tail) ? (pos - tail) : (UART_DMA_RX_SIZE - tail);
+}
+
+/* hand the bytes up to the DMA write offset to the stream buffer, with interrupts masked */
+static void __uart_dma_rx_push(uart_dev_t *uart, uart_dma_t *dma, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    uint32_t pos, len, sent;
+
+    pos = hal_uart_dma_rx_pos(uart) % UART_DMA_RX_SIZE;
+    dma->rx_left = 0;
+    while ((len = __uart_dma_rx_span(dma->rx_tail, pos)) > 0) {
+        sent = xStreamBufferSendFromISR(uart->rx_ringbuf_handle, dma->rx_buf + dma->rx_tail,
+                len, pxHigherPriorityTaskWoken);
+        dma->rx_tail = (dma->rx_tail + sent) % UART_DMA_RX_SIZE;
+        if (sent < len) {
+            /* keep the rest for the reader, drop the oldest bytes the DMA may overwrite */
+            len = (pos + UART_DMA_RX_SIZE - dma->rx_tail) % UART_DMA_RX_SIZE;
+            if (len > UART_DMA_RX_KEEP) {
+                dma->rx_overflow += len - UART_DMA_RX_KEEP;
+                dma->rx_tail = (pos + UART_DMA_RX_SIZE - UART_DMA_RX_KEEP) % UART_DMA_RX_SIZE;
+            }
+            dma->rx_left = 1;
+            break;
+        }
+    }
+}
+
+/* called on RX DMA half complete and on RX line idle (RTO) */
+static void __uart_dma_rx_irq(void *p_arg)
+{
+    uart_dev_t *uart = (uart_dev_t *)p_arg;
+    uart_dma_t *dma = (uart_dma_t *)uart->dma;
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    if (dma == NULL || uart->rx_dma_ch == UART_DMA_CH_NONE) {
+        return;
+    }
+
+    __uart_dma_rx_push(uart, dma, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    __uart_poll_notify(uart);
+}
+
+/* called by the reader, the bytes left in rx_buf have no interrupt to push them */
+static void __uart_dma_rx_pull(uart_dev_t *uart)
+{
+    uart_dma_t *dma = (uart_dma_t *)uart->dma;
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    if (dma == NULL || uart->rx_dma_ch == UART_DMA_CH_NONE || !dma->rx_left) {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    __uart_dma_rx_push(uart, dma, &xHigherPriorityTaskWoken);
+    taskEXIT_CRITICAL();
+    if (xHigherPriorityTaskWoken) {
+        taskYIELD();
+    }
+}
+
+/* called on TX DMA complete, chain the next block from the stream buffer */
+static void __uart_dma_tx_irq(void *p_arg)
+{
+    uart_dev_t *uart = (uart_dev_t *)p_arg;
+    uart_dma_t *dma = (uart_dma_t *)uart->dma;
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    size_t ret;
+
+    if (dma == NULL || !dma->tx_busy) {
+        return;
+    }
+
+    ret = xStreamBufferReceiveFromISR(uart->tx_ringbuf_handle, dma->tx_buf,
+                                      sizeof(dma->tx_buf), &xHigherPriorityTaskWoken);
+    if (ret > 0) {
+        hal_uart_dma_send(uart, dma->tx_buf, ret);
+    } else {
+        dma->tx_busy = 0;
+    }
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/* start TX DMA from task context if it is idle */
+static void __uart_dma_tx_kick(uart_dev_t *uart)
+{
+    uart_dma_t *dma = (uart_dma_t *)uart->dma;
+    size_t ret;
+    int claim;
+
+    do {
+        taskENTER_CRITICAL();
+        claim = !dma->tx_busy;
+        dma->tx_busy = 1;
+        taskEXIT_CRITICAL();
+        if (!claim) {
+            /* running transfer will pick the data up on complete */
+            return;
+        }
+
+        ret = xStreamBufferReceive(uart->tx_ringbuf_handle, dma->tx_buf, sizeof(dma->tx_buf), 0);
+        if (ret > 0) {
+            hal_uart_dma_send(uart, dma->tx_buf, ret);
+            return;
+        }
+        dma->tx_busy = 0;
+        /* data sent by others between receive and release must not be stranded */
+    } while (xStreamBufferIsEmpty(uart->tx_ringbuf_handle) != pdTRUE);
+}
+
+static int __uart_dma_open(uart_dev_t *uart_dev)
+{
+    uart_dma_t *dma;
+
+    dma = (uart_dma_t *)pvPortMalloc(sizeof(uart_dma_t));
+    if (dma == NULL) {
+        return -ENOMEM;
+    }
+    memset(dma, 0, sizeof(uart_dma_t));
+    uart_dev->dma = dma;
+
+    hal_uart_notify_register(uart_dev, UART_TX_INT,
+            uart_dev->tx_dma_ch != UART_DMA_CH_NONE ? __uart_dma_tx_irq : __uart_tx_irq);
+    hal_uart_notify_register(uart_dev, UART_RX_INT,
+            uart_dev->rx_dma_ch != UART_DMA_CH_NONE ? __uart_dma_rx_irq : __uart_rx_irq);
+
+    return VFS_SUCCESS;
+}
+
+static void __uart_dma_close(uart_dev_t *uart_dev)
+{
+    hal_uart_dma_finalize(uart_dev);
+    vPortFree(uart_dev->dma);
+    uart_dev->dma = NULL;
+}
+
 int vfs_uart_open([[gnu::unused]] inode_t *inode, file_t *fp)
 {
     int ret = -1;                /* return value */
@@ -83,9 +261,24 @@ int vfs_uart_open([[gnu::unused]] inode_t *inode, file_t *fp)
             }
 
             /*  init uart device. */
-            hal_uart_notify_register(uart_dev, UART_TX_INT, __uart_tx_irq);
-            hal_uart_notify_register(uart_dev, UART_RX_INT, __uart_rx_irq);
-            ret = hal_uart_init(uart_dev);
+            if (UART_USE_DMA(uart_dev)) {
+                ret = __uart_dma_open(uart_dev);
+                if (ret != VFS_SUCCESS) {
+                    return ret;
+                }
+                ret = hal_uart_init(uart_dev);
+                if (ret == 0) {
+                    ret = hal_uart_dma_init(uart_dev, ((uart_dma_t *)uart_dev->dma)->rx_buf,
+                                            UART_DMA_RX_SIZE);
+                }
+                if (ret != 0) {
+                    __uart_dma_close(uart_dev);
+                }
+            } else {
+                hal_uart_notify_register(uart_dev, UART_TX_INT, __uart_tx_irq);
+                hal_uart_notify_register(uart_dev, UART_RX_INT, __uart_rx_irq);
+                ret = hal_uart_init(uart_dev);
+            }
         } else {
             ret = VFS_SUCCESS;
         }
@@ -111,11 +304,14 @@ int vfs_uart_close(file_t *fp)
 
             if (uart_dev != NULL) {
 
+                if (uart_dev->dma != NULL) {
+                    __uart_dma_close(uart_dev);
+                }
+                /* turns off hardware. */
+                ret = hal_uart_finalize(uart_dev);
                 aos_mutex_free((aos_mutex_t*)&(uart_dev->mutex));
                 vStreamBufferDelete(uart_dev->rx_ringbuf_handle);
                 vStreamBufferDelete(uart_dev->tx_ringbuf_handle);
-                /* turns off hardware. */
-                ret = hal_uart_finalize(uart_dev);
             } else {
                 ret = -EINVAL;
             }
@@ -160,6 +356,7 @@ ssize_t vfs_uart_read(file_t *fp, void *buf, size_t nbytes)
             timeout = (UART_READ_CFG_BLOCK == uart_dev->read_block_flag) ? AOS_WAIT_FOREVER : 0;
 
             while (1) {
+                __uart_dma_rx_pull(uart_dev);
                 ret += xStreamBufferReceive(uart_dev->rx_ringbuf_handle,
                                             buf + ret, nbytes - ret, timeout);
                 if ((ret == nbytes) || (timeout == 0)) {
@@ -203,7 +400,11 @@ ssize_t vfs_uart_write(file_t *fp, const void *buf, size_t nbytes)
 
             /*Trigger UART Write Now*/
             if (ret > 0) {
-                hal_uart_send_trigger(uart_dev);
+                if (uart_dev->tx_dma_ch != UART_DMA_CH_NONE && uart_dev->dma != NULL) {
+                    __uart_dma_tx_kick(uart_dev);
+                } else {
+                    hal_uart_send_trigger(uart_dev);
+                }
             }
         } else {
             ret = -EINVAL;
@@ -265,6 +466,7 @@ int uart_ioctl_cmd_waimode(uart_dev_t *uart_dev, int cmd, unsigned long arg)
     timeout = pdMS_TO_TICKS(waitr_arg->timeout);
 
     while (1) {
+        __uart_dma_rx_pull(uart_dev);
         ret += xStreamBufferReceive(uart_dev->rx_ringbuf_handle,
                                     (uint8_t*)waitr_arg->buf + ret,
                                     nbytes - ret,
@@ -354,6 +556,22 @@ int vfs_uart_ioctl(file_t *fp, int cmd, unsigned long arg)
             uart_dev->read_block_flag = UART_READ_CFG_NOBLOCK;
         }
         break;
+        case IOCTL_UART_IOC_RX_OVERFLOW:
+        {
+            if (NULL == (uint32_t *)arg) {
+                ret = -EINVAL;
+                break;
+            }
+            *(uint32_t *)arg = 0;
+            if (uart_dev->dma != NULL) {
+                taskENTER_CRITICAL();
+                *(uint32_t *)arg = ((uart_dma_t *)uart_dev->dma)->rx_overflow;
+                ((uart_dma_t *)uart_dev->dma)->rx_overflow = 0;
+                taskEXIT_CRITICAL();
+            }
+            ret = 0;
+        }
+        break;
         default:
         {
             ret =  -EINVAL;
@@ -382,6 +600,11 @@ int vfs_uart_sync(file_t *fp)
     }
 
     aos_mutex_lock((aos_mutex_t*)&(uart_dev->mutex), AOS_WAIT_FOREVER);
+    if (uart_dev->dma != NULL) {
+        while (((uart_dma_t *)uart_dev->dma)->tx_busy) {
+            vTaskDelay(1);
+        }
+    }
     hal_uart_send_flush(uart_dev, 0);
     aos_mutex_unlock((aos_mutex_t*)&(uart_dev->mutex));
 
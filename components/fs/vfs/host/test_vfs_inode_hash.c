@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test for the VFS inode name hash and the file slot hint.  Device and
+ * FS nodes with names that are prefixes of each other, and duplicates, are
+ * registered and released at random, and inode_open() must return the same
+ * node as the linear scan it replaced for random paths.  new_file() must
+ * return the lowest free slot, as the full scan did.  Prints the lookup time
+ * of both.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* only pvPortMalloc() and vPortFree() are used */
+#define INC_FREERTOS_H
+
+void *pvPortMalloc(size_t size)
+{
+    return malloc(size);
+}
+
+void vPortFree(void *pv)
+{
+    free(pv);
+}
+
+#include "../src/vfs_inode.c"
+#include "../src/vfs_file.c"
+
+#define TEST_OPS            200000
+#define TEST_BENCH_LOOKUPS  1000000
+
+static int test_failed;
+
+static const char *const parts[] = {"a", "ab", "b", "dev", "romfs", "ttyS0"};
+
+/* the linear scan inode_open() used before the hash */
+static inode_t *inode_open_linear(const char *path)
+{
+    int e = 0;
+    inode_t *node;
+
+    for (e = 0; e < AOS_CONFIG_VFS_DEV_NODES; e++) {
+        node = &g_vfs_dev_nodes[e];
+
+        if (node->i_name == NULL) {
+            continue;
+        }
+        if (INODE_IS_TYPE(node, VFS_TYPE_FS_DEV)) {
+            if ((strncmp(node->i_name, path, strlen(node->i_name)) == 0) &&
+                (*(path + strlen(node->i_name)) == '/')) {
+                return node;
+            }
+        }
+        if (strcmp(node->i_name, path) == 0) {
+            return node;
+        }
+    }
+
+    return NULL;
+}
+
+static void random_path(char *path, size_t size, int max_depth)
+{
+    int i, depth = 1 + rand() % max_depth;
+
+    path[0] = '\0';
+    for (i = 0; i < depth; i++) {
+        snprintf(path + strlen(path), size - strlen(path), "/%s", parts[rand() % (sizeof(parts) / sizeof(parts[0]))]);
+    }
+    switch (rand() % 8) {
+    case 0:
+        snprintf(path + strlen(path), size - strlen(path), "/");
+        break;
+    case 1:
+        snprintf(path + strlen(path), size - strlen(path), "//x");
+        break;
+    default:
+        break;
+    }
+}
+
+static void release_all(void)
+{
+    int e;
+
+    for (e = 0; e < AOS_CONFIG_VFS_DEV_NODES; e++) {
+        if (g_vfs_dev_nodes[e].i_name != NULL) {
+            inode_del(&g_vfs_dev_nodes[e]);
+        }
+    }
+}
+
+static void test_inode(void)
+{
+    char path[64];
+    inode_t *node;
+    int i, e;
+
+    for (i = 0; i < TEST_OPS; i++) {
+        if (rand() % 3 == 0) {
+            random_path(path, sizeof(path), 2);
+            if (inode_reserve(path, &node) == VFS_SUCCESS) {
+                INODE_SET_TYPE(node, (rand() % 2) ? VFS_TYPE_FS_DEV : VFS_TYPE_CHAR_DEV);
+            }
+        } else if (rand() % 3 == 0) {
+            e = rand() % AOS_CONFIG_VFS_DEV_NODES;
+            if (g_vfs_dev_nodes[e].i_name != NULL) {
+                inode_del(&g_vfs_dev_nodes[e]);
+            }
+        }
+        random_path(path, sizeof(path), 4);
+        if (inode_open(path) != inode_open_linear(path)) {
+            printf("FAIL inode_open %s\n", path);
+            test_failed = 1;
+            break;
+        }
+    }
+    release_all();
+}
+
+static void test_file(void)
+{
+    file_t *f;
+    inode_t node;
+    int i, idx, lowest;
+
+    memset(&node, 0, sizeof(node));
+    for (i = 0; i < TEST_OPS; i++) {
+        idx = rand() % MAX_FILE_NUM;
+        if (files[idx].node) {
+            del_file(&files[idx]);
+            continue;
+        }
+        for (lowest = 0; lowest < MAX_FILE_NUM && files[lowest].node; lowest++) {
+        }
+        f = new_file(&node);
+        if ((lowest == MAX_FILE_NUM) ? (f != NULL) : (f != &files[lowest])) {
+            printf("FAIL new_file %d, the lowest free is %d\n", f ? (int)(f - files) : -1, lowest);
+            test_failed = 1;
+            return;
+        }
+    }
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench(void)
+{
+    static const char *const names[] = {
+        "/dev/ttyS0", "/dev/ttyS1", "/dev/ttyS2", "/dev/i2c0", "/dev/spi0", "/dev/gpio", "/dev/adc",
+        "/dev/pwm0", "/dev/pwm1", "/dev/dac", "/dev/ir", "/dev/wdt", "/dev/rtc", "/dev/timer0",
+        "/dev/timer1", "/dev/sdio", "/dev/usb", "/dev/led", "/dev/key",
+    };
+    char path[32];
+    inode_t *node;
+    inode_t *volatile sink;
+    double t0, t1, t2;
+    int i, n = sizeof(names) / sizeof(names[0]);
+
+    for (i = 0; i < n; i++) {
+        inode_reserve(names[i], &node);
+        INODE_SET_CHAR(node);
+    }
+    inode_reserve("/romfs", &node);
+    INODE_SET_FS(node);
+
+    snprintf(path, sizeof(path), "/romfs/index.html");
+    t0 = now_ns();
+    for (i = 0; i < TEST_BENCH_LOOKUPS; i++) {
+        path[8] = 'a' + i % 16;
+        sink = inode_open_linear(i & 1 ? path : names[i % n]);
+    }
+    t1 = now_ns();
+    for (i = 0; i < TEST_BENCH_LOOKUPS; i++) {
+        path[8] = 'a' + i % 16;
+        sink = inode_open(i & 1 ? path : names[i % n]);
+    }
+    t2 = now_ns();
+    (void)sink;
+    release_all();
+    printf("lookup with %d nodes: linear %.1f ns, hash %.1f ns\n", n + 1,
+            (t1 - t0) / TEST_BENCH_LOOKUPS, (t2 - t1) / TEST_BENCH_LOOKUPS);
+}
+
+int main(void)
+{
+    srand(1);
+    inode_init();
+    test_inode();
+    test_file();
+    bench();
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
@@ -0,0 +1,570 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test for the UART device of the VFS, vfs_uart.c with the FreeRTOS
+ * stream buffers, on a fake hal_uart with a 32 byte TX and RX FIFO and a
+ * simulated DMA.  The line moves a random number of bytes per tick in random
+ * bursts and idle gaps, and the interrupts fire as on the device.
+ * - Interrupt mode: every TX FIFO interrupt refills the whole free FIFO from
+ *   the stream buffer, and all bytes written and received arrive in order.
+ * - DMA TX: a transfer is only started when none runs, its buffer is not
+ *   touched until it completes, and vfs_uart_sync() waits for the last one.
+ * - DMA RX: the DMA never overwrites bytes which are not handed over yet.
+ *   With a reader that keeps up every byte arrives; with a slow reader the
+ *   bytes that arrive are the sent ones in order, the rest is counted by
+ *   IOCTL_UART_IOC_RX_OVERFLOW, and the bytes left in the DMA ring when the
+ *   line goes idle are read without another interrupt.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* utils_log.h needs the blog component, vfs_uart.c logs nothing */
+#define __UTILS_LOG_H__
+
+#include "../../../freertos/stream_buffer.c"
+
+/* the RISC-V port yields with ecall, the tasks are not switched here */
+#undef portYIELD
+#define portYIELD()
+
+#include "../device/vfs_uart.c"
+
+#define TEST_FIFO_SIZE      32
+#define TEST_RX_BUF_SIZE    1024
+#define TEST_TX_BUF_SIZE    512
+#define TEST_STREAM_LEN     200000
+
+static int test_failed;
+
+/* FreeRTOS, one task and no blocking */
+void *pvPortMalloc(size_t xWantedSize)
+{
+    return malloc(xWantedSize);
+}
+
+void vPortFree(void *pv)
+{
+    free(pv);
+}
+
+void vAssertCalled(void)
+{
+    printf("FAIL configASSERT\n");
+    exit(1);
+}
+
+static int critical_depth;
+
+void vTaskEnterCritical(void)
+{
+    critical_depth++;
+}
+
+void vTaskExitCritical(void)
+{
+    critical_depth--;
+}
+
+void vTaskSuspendAll(void)
+{
+}
+
+BaseType_t xTaskResumeAll(void)
+{
+    return pdFALSE;
+}
+
+void vTaskSwitchContext(void)
+{
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return (TaskHandle_t)&test_failed;
+}
+
+void vTaskSetTimeOutState(TimeOut_t * const pxTimeOut)
+{
+    (void)pxTimeOut;
+}
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t * const pxTimeOut, TickType_t * const pxTicksToWait)
+{
+    (void)pxTimeOut;
+    (void)pxTicksToWait;
+    return pdTRUE;
+}
+
+BaseType_t xTaskNotifyStateClear(TaskHandle_t xTask)
+{
+    (void)xTask;
+    return pdFALSE;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit,
+        uint32_t *pulNotificationValue, TickType_t xTicksToWait)
+{
+    (void)ulBitsToClearOnEntry;
+    (void)ulBitsToClearOnExit;
+    (void)pulNotificationValue;
+    (void)xTicksToWait;
+    printf("FAIL a task blocks on the stream buffer\n");
+    test_failed = 1;
+    return pdFALSE;
+}
+
+BaseType_t xTaskGenericNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction,
+        uint32_t *pulPreviousNotificationValue)
+{
+    (void)xTaskToNotify;
+    (void)ulValue;
+    (void)eAction;
+    (void)pulPreviousNotificationValue;
+    return pdPASS;
+}
+
+BaseType_t xTaskGenericNotifyFromISR(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction,
+        uint32_t *pulPreviousNotificationValue, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    (void)xTaskToNotify;
+    (void)ulValue;
+    (void)eAction;
+    (void)pulPreviousNotificationValue;
+    (void)pxHigherPriorityTaskWoken;
+    return pdPASS;
+}
+
+static void line_tick(void);
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    (void)xTicksToDelay;
+    line_tick();
+}
+
+/* aos mutex, only the lock depth is checked */
+static int mutex_depth;
+
+int aos_mutex_new(aos_mutex_t *mutex)
+{
+    mutex->hdl = &mutex_depth;
+    return 0;
+}
+
+void aos_mutex_free(aos_mutex_t *mutex)
+{
+    mutex->hdl = NULL;
+}
+
+int aos_mutex_lock(aos_mutex_t *mutex, unsigned int timeout)
+{
+    (void)timeout;
+    if (mutex->hdl != &mutex_depth || mutex_depth++) {
+        printf("FAIL uart mutex lock\n");
+        test_failed = 1;
+    }
+    return 0;
+}
+
+int aos_mutex_unlock(aos_mutex_t *mutex)
+{
+    if (mutex->hdl != &mutex_depth || 0 == mutex_depth--) {
+        printf("FAIL uart mutex unlock\n");
+        test_failed = 1;
+    }
+    return 0;
+}
+
+/* the fake UART: FIFOs, line and DMA channels */
+static struct {
+    void (*tx_cb)(void *arg);
+    void (*rx_cb)(void *arg);
+    int tx_int_on;
+    int tx_fifo;                    /* bytes in the TX FIFO */
+    uint8_t rx_fifo[TEST_FIFO_SIZE];
+    int rx_fifo_cnt;
+    int rx_fifo_overrun;
+    const uint8_t *dma_tx_data;     /* the running TX transfer, NULL when idle */
+    uint32_t dma_tx_size;
+    uint8_t *dma_rx_buf;
+    uint32_t dma_rx_size;
+    uint32_t dma_rx_pos;            /* bytes written by the RX DMA */
+    int dma_overwrite;
+    uint8_t *out;                   /* bytes sent on the line */
+    size_t out_len;
+    unsigned long tx_irqs, tx_short_irqs;
+} hw;
+
+static uart_dev_t uart;
+static inode_t node;
+static file_t fp;
+
+int32_t hal_uart_init(uart_dev_t *dev)
+{
+    (void)dev;
+    return 0;
+}
+
+int32_t hal_uart_finalize(uart_dev_t *dev)
+{
+    (void)dev;
+    return 0;
+}
+
+int32_t hal_uart_notify_register(uart_dev_t *dev, hal_uart_int_t type, void (*cb)(void *arg))
+{
+    (void)dev;
+    if (type == UART_TX_INT) {
+        hw.tx_cb = cb;
+    } else {
+        hw.rx_cb = cb;
+    }
+    return 0;
+}
+
+int32_t hal_uart_send_trigger(uart_dev_t *dev)
+{
+    (void)dev;
+    hw.tx_int_on = 1;
+    return 0;
+}
+
+int32_t hal_uart_send_trigger_off(uart_dev_t *dev)
+{
+    (void)dev;
+    hw.tx_int_on = 0;
+    return 0;
+}
+
+int32_t hal_uart_send_avail(uart_dev_t *dev)
+{
+    (void)dev;
+    return TEST_FIFO_SIZE - hw.tx_fifo;
+}
+
+int32_t hal_uart_send(uart_dev_t *dev, const void *data, uint32_t size, uint32_t timeout)
+{
+    (void)dev;
+    (void)timeout;
+    if (hw.tx_fifo + size > TEST_FIFO_SIZE) {
+        printf("FAIL TX FIFO overrun, %u bytes for %d free\n", (unsigned)size, TEST_FIFO_SIZE - hw.tx_fifo);
+        test_failed = 1;
+    }
+    memcpy(hw.out + hw.out_len, data, size);
+    hw.out_len += size;
+    hw.tx_fifo += size;
+    return 0;
+}
+
+int32_t hal_uart_send_flush(uart_dev_t *dev, uint32_t timeout)
+{
+    (void)dev;
+    (void)timeout;
+    hw.tx_fifo = 0;
+    return 0;
+}
+
+int32_t hal_uart_recv_II(uart_dev_t *dev, void *data, uint32_t expect_size, uint32_t *recv_size, uint32_t timeout)
+{
+    uint32_t n = expect_size < (uint32_t)hw.rx_fifo_cnt ? expect_size : (uint32_t)hw.rx_fifo_cnt;
+
+    (void)dev;
+    (void)timeout;
+    memcpy(data, hw.rx_fifo, n);
+    memmove(hw.rx_fifo, hw.rx_fifo + n, hw.rx_fifo_cnt - n);
+    hw.rx_fifo_cnt -= n;
+    *recv_size = n;
+    return 0;
+}
+
+int32_t hal_uart_dma_init(uart_dev_t *dev, void *rx_buf, uint32_t rx_size)
+{
+    (void)dev;
+    hw.dma_rx_buf = rx_buf;
+    hw.dma_rx_size = rx_size;
+    hw.dma_rx_pos = 0;
+    return 0;
+}
+
+int32_t hal_uart_dma_finalize(uart_dev_t *dev)
+{
+    (void)dev;
+    hw.dma_rx_buf = NULL;
+    hw.dma_tx_data = NULL;
+    return 0;
+}
+
+int32_t hal_uart_dma_send(uart_dev_t *dev, const void *data, uint32_t size)
+{
+    (void)dev;
+    if (hw.dma_tx_data != NULL) {
+        printf("FAIL TX DMA started while a transfer runs\n");
+        test_failed = 1;
+    }
+    if (0 == size || size > UART_DMA_TX_SIZE) {
+        printf("FAIL TX DMA of %u bytes\n", (unsigned)size);
+        test_failed = 1;
+    }
+    hw.dma_tx_data = data;
+    hw.dma_tx_size = size;
+    return 0;
+}
+
+uint32_t hal_uart_dma_rx_pos(uart_dev_t *dev)
+{
+    (void)dev;
+    return hw.dma_rx_pos;
+}
+
+void hal_uart_setbaud(uart_dev_t *dev, uint32_t baud)
+{
+    (void)dev;
+    (void)baud;
+}
+
+void hal_uart_setconfig(uart_dev_t *dev, uint32_t baud, hal_uart_parity_t parity)
+{
+    (void)dev;
+    (void)baud;
+    (void)parity;
+}
+
+/* the TX side of the line, moves up to a FIFO of bytes or completes a DMA transfer */
+static void line_tick(void)
+{
+    int n;
+
+    if (uart.tx_dma_ch != UART_DMA_CH_NONE) {
+        if (hw.dma_tx_data != NULL && rand() % 2) {
+            /* the buffer is read when the bytes go out, it must be kept until the transfer completes */
+            memcpy(hw.out + hw.out_len, hw.dma_tx_data, hw.dma_tx_size);
+            hw.out_len += hw.dma_tx_size;
+            hw.dma_tx_data = NULL;
+            hw.tx_cb(&uart);
+        }
+        return;
+    }
+    n = rand() % (TEST_FIFO_SIZE + 1);
+    hw.tx_fifo = hw.tx_fifo > n ? hw.tx_fifo - n : 0;
+    if (hw.tx_int_on && hw.tx_fifo < TEST_FIFO_SIZE / 2) {
+        size_t before = hw.out_len;
+        int room = TEST_FIFO_SIZE - hw.tx_fifo;
+
+        hw.tx_cb(&uart);
+        hw.tx_irqs++;
+        if ((int)(hw.out_len - before) < room && !xStreamBufferIsEmpty(uart.tx_ringbuf_handle)) {
+            /* the free FIFO must be filled while the stream buffer has bytes */
+            hw.tx_short_irqs++;
+        }
+    }
+}
+
+/* the RX side of the line, a byte arrives in the FIFO or the DMA ring */
+static void line_rx(uint8_t c)
+{
+    if (uart.rx_dma_ch != UART_DMA_CH_NONE) {
+        uart_dma_t *dma = (uart_dma_t *)uart.dma;
+        uint32_t pos = hw.dma_rx_pos % hw.dma_rx_size;
+
+        if ((pos + 1) % hw.dma_rx_size == dma->rx_tail) {
+            hw.dma_overwrite++;
+        }
+        hw.dma_rx_buf[pos] = c;
+        hw.dma_rx_pos++;
+        if (0 == hw.dma_rx_pos % (hw.dma_rx_size / 2)) {
+            /* half complete */
+            hw.rx_cb(&uart);
+        }
+        return;
+    }
+    if (hw.rx_fifo_cnt == TEST_FIFO_SIZE) {
+        hw.rx_fifo_overrun++;
+        return;
+    }
+    hw.rx_fifo[hw.rx_fifo_cnt++] = c;
+    if (hw.rx_fifo_cnt >= TEST_FIFO_SIZE / 2) {
+        /* FIFO threshold */
+        hw.rx_cb(&uart);
+    }
+}
+
+/* the line goes idle, the RX time-out interrupt */
+static void line_rx_idle(void)
+{
+    if (uart.rx_dma_ch != UART_DMA_CH_NONE || hw.rx_fifo_cnt) {
+        hw.rx_cb(&uart);
+    }
+}
+
+static uint8_t test_byte(size_t i)
+{
+    return (uint8_t)((i * 2654435761u) >> 13);
+}
+
+static void uart_open(uint8_t tx_dma_ch, uint8_t rx_dma_ch)
+{
+    memset(&hw, 0, sizeof(hw));
+    hw.out = malloc(TEST_STREAM_LEN + UART_DMA_TX_SIZE);
+    memset(&uart, 0, sizeof(uart));
+    uart.rx_buf_size = TEST_RX_BUF_SIZE;
+    uart.tx_buf_size = TEST_TX_BUF_SIZE;
+    uart.tx_dma_ch = tx_dma_ch;
+    uart.rx_dma_ch = rx_dma_ch;
+    node.i_arg = &uart;
+    node.refs = 1;
+    fp.node = &node;
+    if (vfs_uart_open(&node, &fp) != 0) {
+        printf("FAIL open\n");
+        test_failed = 1;
+    }
+}
+
+static void uart_close(void)
+{
+    vfs_uart_close(&fp);
+    free(hw.out);
+    if (critical_depth || mutex_depth) {
+        printf("FAIL critical depth %d, mutex depth %d\n", critical_depth, mutex_depth);
+        test_failed = 1;
+    }
+}
+
+/* random writes, the line drains them, every byte goes out in order */
+static void test_tx(const char *name, uint8_t tx_dma_ch)
+{
+    size_t sent = 0, n, i;
+    uint8_t buf[300];
+    ssize_t ret;
+
+    uart_open(tx_dma_ch, UART_DMA_CH_NONE);
+    while (sent < TEST_STREAM_LEN) {
+        n = 1 + rand() % sizeof(buf);
+        if (n > TEST_STREAM_LEN - sent) {
+            n = TEST_STREAM_LEN - sent;
+        }
+        for (i = 0; i < n; i++) {
+            buf[i] = test_byte(sent + i);
+        }
+        ret = vfs_uart_write(&fp, buf, n);
+        sent += ret > 0 ? ret : 0;
+        for (i = rand() % 4; i > 0; i--) {
+            line_tick();
+        }
+    }
+    vfs_uart_sync(&fp);
+    while (hw.tx_int_on && hw.out_len < sent) {
+        line_tick();
+    }
+    for (i = 0; i < hw.out_len && i < sent; i++) {
+        if (hw.out[i] != test_byte(i)) {
+            break;
+        }
+    }
+    printf("%s: %u bytes sent, %lu FIFO interrupts, %lu not refilling the FIFO\n", name, (unsigned)hw.out_len,
+            hw.tx_irqs, hw.tx_short_irqs);
+    if (hw.out_len != sent || i != sent || hw.tx_short_irqs || (tx_dma_ch != UART_DMA_CH_NONE && hw.dma_tx_data)) {
+        printf("FAIL %s: %u of %u bytes on the line, first bad byte %u\n", name, (unsigned)hw.out_len,
+                (unsigned)sent, (unsigned)i);
+        test_failed = 1;
+    }
+    uart_close();
+}
+
+/*
+ * Random bursts and idle gaps arrive, the reader reads every read_every bytes.
+ * The bytes read must be the sent ones in order, each dropped byte counted.
+ */
+static void test_rx(const char *name, uint8_t rx_dma_ch, int read_every, int expect_drop)
+{
+    size_t sent = 0, got = 0, match = 0, burst;
+    uint32_t overflow = 0, dropped = 0;
+    uint8_t buf[256];
+    ssize_t ret;
+    int j;
+
+    uart_open(UART_DMA_CH_NONE, rx_dma_ch);
+    while (sent < TEST_STREAM_LEN) {
+        burst = 1 + rand() % 700;
+        while (burst-- && sent < TEST_STREAM_LEN) {
+            line_rx(test_byte(sent++));
+            if (0 == rand() % read_every) {
+                ret = vfs_uart_read(&fp, buf, 1 + rand() % sizeof(buf));
+                for (j = 0; j < ret; j++, got++) {
+                    /* dropped bytes are skipped */
+                    while (match < sent && buf[j] != test_byte(match)) {
+                        match++;
+                    }
+                    match++;
+                }
+            }
+        }
+        line_rx_idle();
+    }
+    line_rx_idle();
+    /* the bytes left in the DMA ring are pulled by the reader */
+    while ((ret = vfs_uart_read(&fp, buf, sizeof(buf))) > 0) {
+        for (j = 0; j < ret; j++, got++) {
+            while (match < sent && buf[j] != test_byte(match)) {
+                match++;
+            }
+            match++;
+        }
+    }
+    vfs_uart_ioctl(&fp, IOCTL_UART_IOC_RX_OVERFLOW, (unsigned long)&overflow);
+    dropped = sent - got;
+    printf("%s: %u bytes received, %u dropped, %u counted\n", name, (unsigned)got, (unsigned)dropped,
+            (unsigned)overflow);
+    if (match > sent || hw.dma_overwrite || hw.rx_fifo_overrun) {
+        printf("FAIL %s: bytes out of order or overwritten (%d overwrites, %d FIFO overruns)\n", name,
+                hw.dma_overwrite, hw.rx_fifo_overrun);
+        test_failed = 1;
+    }
+    if (expect_drop ? (0 == dropped || dropped != overflow) : (dropped || overflow)) {
+        printf("FAIL %s: %u bytes dropped, %u counted\n", name, (unsigned)dropped, (unsigned)overflow);
+        test_failed = 1;
+    }
+    uart_close();
+}
+
+int main(void)
+{
+    srand(1);
+
+    test_tx("interrupt TX", UART_DMA_CH_NONE);
+    test_tx("DMA TX", 1);
+    test_rx("interrupt RX", UART_DMA_CH_NONE, 4, 0);
+    test_rx("DMA RX", 2, 64, 0);
+    test_rx("DMA RX slow reader", 2, 2000, 1);
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
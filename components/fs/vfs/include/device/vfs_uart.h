@@ -20,6 +20,7 @@ extern "C" {
 #define IOCTL_UART_IOC_READ_BLOCK                6 /* read block */
 #define IOCTL_UART_IOC_READ_NOBLOCK              7 /* read noblock */
 #define IOCTL_UART_IOC_CONFIG_MODE               8 /* config baud parity */
+#define IOCTL_UART_IOC_RX_OVERFLOW               9 /* get and clear the rx bytes dropped in DMA mode, arg: uint32_t * */
 
 typedef enum {
     IO_UART_PARITY_NONE,
@@ -9,8 +9,8 @@ extern "C" {
 
 /* romfs ioctl struct */
 typedef struct _romfs_file_buf {
-    char *buf;
-    uint32_t bufsize;
+    char *buf;          /* XIP address of the file data */
+    uint32_t bufsize;   /* IOCTL_ROMFS_MMAP: max length in (0: no limit), mapped length out */
 } romfs_filebuf_t;
 
 #ifdef __cplusplus
@@ -89,9 +89,14 @@ typedef struct {
     void         *poll_data;
     void         *taskhdl;
     uint8_t      read_block_flag; /* 1 or 2 from IOCTL_UART_IOC_READ_BLOCK, IOCTL_UART_IOC_READ_NOBLOCK */
+    uint8_t      tx_dma_ch; /* UART_DMA_CH_NONE for interrupt driven TX */
+    uint8_t      rx_dma_ch; /* UART_DMA_CH_NONE for interrupt driven RX */
+    void         *dma;     /* DMA buffers, valid while opened with a DMA channel */
     void         *priv;    /* priv data */
 } uart_dev_t;
 
+#define UART_DMA_CH_NONE      0xFF
+
 /**
  * Initialises a UART interface
  *
@@ -147,6 +152,58 @@ void hal_uart_setconfig(uart_dev_t *uart, uint32_t baud, hal_uart_parity_t parit
  */
 int32_t hal_uart_send(uart_dev_t *uart, const void *data, uint32_t size, uint32_t timeout);
 
+/**
+ * Get free space of the TX hardware FIFO on a UART interface
+ *
+ * @param[in]  uart     the UART interface
+ *
+ * @return  number of bytes that can be sent without waiting
+ */
+int32_t hal_uart_send_avail(uart_dev_t *uart);
+
+/**
+ * Start DMA mode on a UART interface, for the channels set in tx_dma_ch/rx_dma_ch
+ *
+ * RX runs forever as a ring over rx_buf split in two halves, TX and RX
+ * notify callbacks are invoked on DMA transfer complete, RX also on line idle.
+ *
+ * @param[in]  uart     the UART interface
+ * @param[in]  rx_buf   ring buffer for RX DMA
+ * @param[in]  rx_size  size of rx_buf, even, each half at most 4095 bytes
+ *
+ * @return  0 : on success, EIO : if an error occurred with any step
+ */
+int32_t hal_uart_dma_init(uart_dev_t *uart, void *rx_buf, uint32_t rx_size);
+
+/**
+ * Stop DMA mode on a UART interface
+ *
+ * @param[in]  uart     the UART interface
+ *
+ * @return  0 : on success, EIO : if an error occurred with any step
+ */
+int32_t hal_uart_dma_finalize(uart_dev_t *uart);
+
+/**
+ * Transmit data by DMA on a UART interface, data must stay valid until TX notify
+ *
+ * @param[in]  uart     the UART interface
+ * @param[in]  data     pointer to the start of data
+ * @param[in]  size     number of bytes to transmit, at most 4095
+ *
+ * @return  0 : on success, EIO : if an error occurred with any step
+ */
+int32_t hal_uart_dma_send(uart_dev_t *uart, const void *data, uint32_t size);
+
+/**
+ * Get write offset of RX DMA in the ring buffer
+ *
+ * @param[in]  uart     the UART interface
+ *
+ * @return  offset in rx_buf of the next byte DMA will write
+ */
+uint32_t hal_uart_dma_rx_pos(uart_dev_t *uart);
+
 /**
  * Transmit data Trigger on a UART interface
  *
@@ -23,6 +23,7 @@ extern "C" {
 
 /* section for ROMFS IOCCTRL */
 #define IOCTL_ROMFS_GET_FILEBUF                        (1)
+#define IOCTL_ROMFS_MMAP                               (2)  /* map from offset, see romfs_filebuf_t */
 
 /*section for GPIO IOCTRL*/
 #define IOCTL_GPIO_PULL_UP                             (0)  /* PULLUP */
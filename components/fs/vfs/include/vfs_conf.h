@@ -13,6 +13,8 @@ extern "C"
 #define VFS_TRUE 1u
 
 #define AOS_CONFIG_VFS_DEV_NODES 30
+/*buckets of the inode name hash, power of 2*/
+#define AOS_CONFIG_VFS_INODE_HASH_SIZE 16
 /*mem 1000 byte*/
 #define AOS_CONFIG_VFS_POLL_SUPPORT 1
 #define AOS_CONFIG_VFS_FD_OFFSET 2
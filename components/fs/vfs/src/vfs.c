@@ -98,7 +98,13 @@ int aos_open(const char *path, int flags)
     }
 
     if (ret != VFS_SUCCESS) {
+        if (pdTRUE != xSemaphoreTake(g_vfs_mutex, portMAX_DELAY)) {
+            return -1;
+        }
+
         del_file(file);
+
+        xSemaphoreGive(g_vfs_mutex);
         return ret;
     }
 
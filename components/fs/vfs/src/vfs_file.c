@@ -8,13 +8,15 @@
 #include <stdio.h>
 
 static file_t files[MAX_FILE_NUM];
+/* every slot below this index is in use */
+static int files_free_hint;
 
 file_t *new_file(inode_t *node)
 {
     file_t *f;
     int idx;
 
-    for (idx = 0; idx < MAX_FILE_NUM; idx++) {
+    for (idx = files_free_hint; idx < MAX_FILE_NUM; idx++) {
         f = &files[idx];
 
         if (f->node == NULL) {
@@ -25,6 +27,7 @@ file_t *new_file(inode_t *node)
     return NULL;
 
 got_file:
+    files_free_hint = idx + 1;
     f->node = node;
     f->f_arg = NULL;
     f->offset = 0;
@@ -34,8 +37,13 @@ got_file:
 
 void del_file(file_t *file)
 {
+    int idx = file - files;
+
     inode_unref(file->node);
     file->node = NULL;
+    if (idx < files_free_hint) {
+        files_free_hint = idx;
+    }
 }
 
 int get_fd(file_t *file)
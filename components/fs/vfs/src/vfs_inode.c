@@ -11,11 +11,109 @@
 
 #define VFS_NULL_PARA_CHK(para)     do { if (!(para)) return -EINVAL; } while(0)
 
+#if AOS_CONFIG_VFS_DEV_NODES > 127
+#error "inode hash chains use int8_t node indexes"
+#endif
+
+#if (AOS_CONFIG_VFS_INODE_HASH_SIZE & (AOS_CONFIG_VFS_INODE_HASH_SIZE - 1)) != 0
+#error "AOS_CONFIG_VFS_INODE_HASH_SIZE must be a power of 2"
+#endif
+
+#define VFS_HASH_INIT       0x811C9DC5u /* FNV-1a offset basis */
+#define VFS_HASH_PRIME      0x01000193u
+#define VFS_HASH_NONE       (-1)
+
+/* per node name hash, kept beside the inode so inode_t layout is unchanged */
+typedef struct {
+    uint32_t hash;
+    uint16_t len;
+    int8_t   next; /* next node index in the same bucket */
+} inode_hash_t;
+
 static inode_t g_vfs_dev_nodes[AOS_CONFIG_VFS_DEV_NODES];
+static inode_hash_t g_vfs_node_hash[AOS_CONFIG_VFS_DEV_NODES];
+static int8_t g_vfs_hash_head[AOS_CONFIG_VFS_INODE_HASH_SIZE];
+/* bit (len % 32) is set when some node name has that length, lets
+ * inode_open skip mount prefix probes that can never match */
+static uint32_t g_vfs_len_mask;
+
+static uint32_t inode_hash_step(uint32_t hash, char c)
+{
+    return (hash ^ (uint8_t)c) * VFS_HASH_PRIME;
+}
+
+static void inode_hash_add(int idx)
+{
+    inode_hash_t *h = &g_vfs_node_hash[idx];
+    const char *p;
+    int8_t *head;
+
+    h->hash = VFS_HASH_INIT;
+    for (p = g_vfs_dev_nodes[idx].i_name; *p != '\0'; p++) {
+        h->hash = inode_hash_step(h->hash, *p);
+    }
+    h->len = p - g_vfs_dev_nodes[idx].i_name;
+
+    head = &g_vfs_hash_head[h->hash & (AOS_CONFIG_VFS_INODE_HASH_SIZE - 1)];
+    h->next = *head;
+    *head = idx;
+    g_vfs_len_mask |= 1u << (h->len & 31);
+}
+
+static void inode_hash_del(int idx)
+{
+    int8_t *link;
+    int e;
+
+    link = &g_vfs_hash_head[g_vfs_node_hash[idx].hash & (AOS_CONFIG_VFS_INODE_HASH_SIZE - 1)];
+    while (*link != VFS_HASH_NONE && *link != idx) {
+        link = &g_vfs_node_hash[(int)*link].next;
+    }
+    if (*link == VFS_HASH_NONE) {
+        return;
+    }
+    *link = g_vfs_node_hash[idx].next;
+    g_vfs_node_hash[idx].next = VFS_HASH_NONE;
+
+    g_vfs_len_mask = 0;
+    for (e = 0; e < AOS_CONFIG_VFS_DEV_NODES; e++) {
+        if (g_vfs_dev_nodes[e].i_name != NULL && e != idx) {
+            g_vfs_len_mask |= 1u << (g_vfs_node_hash[e].len & 31);
+        }
+    }
+}
+
+/* lowest node index named path[0, len), or AOS_CONFIG_VFS_DEV_NODES */
+static int inode_hash_find(const char *path, size_t len, uint32_t hash, int fs_only)
+{
+    const inode_hash_t *h;
+    const inode_t *node;
+    int e, found = AOS_CONFIG_VFS_DEV_NODES;
+
+    for (e = g_vfs_hash_head[hash & (AOS_CONFIG_VFS_INODE_HASH_SIZE - 1)];
+         e != VFS_HASH_NONE; e = h->next) {
+        h = &g_vfs_node_hash[e];
+        node = &g_vfs_dev_nodes[e];
+
+        if (e >= found || h->hash != hash || h->len != len || node->i_name == NULL) {
+            continue;
+        }
+        if (fs_only && !INODE_IS_FS(node)) {
+            continue;
+        }
+        if (memcmp(node->i_name, path, len) == 0) {
+            found = e;
+        }
+    }
+
+    return found;
+}
 
 int inode_init()
 {
     memset(g_vfs_dev_nodes, 0, sizeof(inode_t) * AOS_CONFIG_VFS_DEV_NODES);
+    memset(g_vfs_hash_head, VFS_HASH_NONE, sizeof(g_vfs_hash_head));
+    g_vfs_len_mask = 0;
     return 0;
 }
 
@@ -40,6 +138,7 @@ int inode_del(inode_t *node)
 
     if (node->refs == 0) {
         if (node->i_name != NULL) {
+            inode_hash_del(node - g_vfs_dev_nodes);
             vPortFree(node->i_name);
         }
 
@@ -52,29 +151,36 @@ int inode_del(inode_t *node)
     return VFS_SUCCESS;
 }
 
+/*
+ * Resolve path to the registered node: either a node named exactly path, or
+ * an FS node whose name is a prefix of path followed by '/'. When several
+ * nodes qualify the one with the lowest index wins, as with the old scan.
+ * The hash of each '/'-terminated prefix falls out of hashing path once.
+ */
 inode_t *inode_open(const char *path)
 {
-    int e = 0;
-    inode_t *node;
-
-    for (e = 0; e < AOS_CONFIG_VFS_DEV_NODES; e++) {
-        node = &g_vfs_dev_nodes[e];
-
-        if (node->i_name == NULL) {
-            continue;
-        }
-        if (INODE_IS_TYPE(node, VFS_TYPE_FS_DEV)) {
-            if ((strncmp(node->i_name, path, strlen(node->i_name)) == 0) &&
-                (*(path + strlen(node->i_name)) == '/')) {
-                return node;
+    uint32_t hash = VFS_HASH_INIT;
+    const char *p;
+    size_t len;
+    int e, found = AOS_CONFIG_VFS_DEV_NODES;
+
+    for (p = path; *p != '\0'; p++) {
+        len = p - path;
+        if (*p == '/' && len > 0 && (g_vfs_len_mask & (1u << (len & 31)))) {
+            e = inode_hash_find(path, len, hash, 1);
+            if (e < found) {
+                found = e;
             }
         }
-        if (strcmp(node->i_name, path) == 0) {
-            return node;
-        }
+        hash = inode_hash_step(hash, *p);
     }
 
-    return NULL;
+    e = inode_hash_find(path, p - path, hash, 0);
+    if (e < found) {
+        found = e;
+    }
+
+    return found < AOS_CONFIG_VFS_DEV_NODES ? &g_vfs_dev_nodes[found] : NULL;
 }
 
 int inode_forearch_name(int (*cb)(void *arg, inode_t *node), void *arg)
@@ -186,6 +292,8 @@ int inode_reserve(const char *path, inode_t **inode)
         return ret;
     }
 
+    inode_hash_add(node - g_vfs_dev_nodes);
+
     *inode = node;
     return VFS_SUCCESS;
 }
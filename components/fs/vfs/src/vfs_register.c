@@ -33,11 +33,10 @@ int aos_register_driver(const char *path, file_ops_t *ops, void *arg)
     /* step out critical area for type is allocated */
     if (pdTRUE != xSemaphoreGive(g_vfs_mutex)) {
         err = -1;
-        if (node->i_name != NULL) {
-            vPortFree(node->i_name);
+        if (node != NULL) {
+            inode_del(node);
+            memset(node, 0, sizeof(inode_t));
         }
-
-        memset(node, 0, sizeof(inode_t));
         return err;
     }
 
@@ -83,11 +82,10 @@ int aos_register_fs(const char *path, fs_ops_t *ops, void *arg)
 
     if (pdTRUE != xSemaphoreGive(g_vfs_mutex)) {
         err = -1;
-        if (node->i_name != NULL) {
-            vPortFree(node->i_name);
+        if (node != NULL) {
+            inode_del(node);
+            memset(node, 0, sizeof(inode_t));
         }
-
-        memset(node, 0, sizeof(inode_t));
         return err;
     }
 
@@ -25,7 +25,10 @@ COMPONENT_SRCS := bl602_hal/bl_uart.c \
                   bl602_hal/bl_flash.c \
                   bl602_hal/bl_pwm.c \
                   bl602_hal/bl_sec_aes.c \
+                  bl602_hal/bl_sec_aes_sw.c \
                   bl602_hal/bl_sec_sha.c \
+                  bl602_hal/bl_sec_sha_sw.c \
+                  bl602_hal/bl_sec_hash.c \
                   bl602_hal/bl_wifi.c \
                   bl602_hal/bl_wdt.c \
                   bl602_hal/bl_wdt_cli.c \
@@ -49,6 +52,7 @@ COMPONENT_SRCS := bl602_hal/bl_uart.c \
                   bl602_hal/bl_rtc.c \
                   bl602_hal/hal_hwtimer.c \
                   bl602_hal/hal_spi.c \
+                  bl602_hal/hal_spi_lli.c \
                   bl602_hal/hal_adc.c \
                   bl602_hal/hal_wifi.c \
                   platform_hal/platform_hal_device.cpp \
@@ -181,7 +181,7 @@ void sec_trng_IRQHandler(void)
 
 int bl_sec_init(void)
 {
-    g_bl_sec_sha_mutex = xSemaphoreCreateMutexStatic(&sha_mutex_buf);
+    g_bl_sec_sha_mutex = xSemaphoreCreateRecursiveMutexStatic(&sha_mutex_buf);
     _trng_trigger();
     wait_trng4feed();
     /*Trigger again*/
@@ -35,13 +35,20 @@
 #include <FreeRTOS.h>
 #include <semphr.h>
 
-/* copied SEC_Eng_SHA256_Ctx from stddrv */
+/* copied SEC_Eng_SHA_Link_Config_Type from stddrv */
 typedef struct {
-    uint32_t total[2];
-    uint32_t *shaBuf;
-    uint32_t *shaPadding;
-    uint8_t  shaFeed;
-} _bl_sha_SEC_Eng_SHA256_Ctx_t;
+    uint32_t :2;
+    uint32_t shaMode:3;
+    uint32_t :1;
+    uint32_t shaHashSel:1;      /* 0 start from IV, 1 continue from result */
+    uint32_t :2;
+    uint32_t shaIntClr:1;
+    uint32_t shaIntSet:1;
+    uint32_t :5;
+    uint32_t shaMsgLen:16;      /* number of 64 byte blocks */
+    uint32_t shaSrcAddr;
+    uint32_t result[8];         /* running hash, big endian bytes */
+} __attribute__ ((aligned(4))) _bl_sha_link_cfg_t;
 
 /* copied SEC_ENG_SHA_Type from stddrv, SHA1_RSVD removed */
 typedef enum {
@@ -50,13 +57,88 @@ typedef enum {
     BL_SHA1,
 } bl_sha_type_t;
 
+/*
+ * The whole state of a hash lives here, SEC_ENG link mode reloads it from
+ * link.result for every run, so any number of contexts can be open at once
+ * and a context may be copied to save and restore it.
+ */
 typedef struct bl_sha_ctx {
-    _bl_sha_SEC_Eng_SHA256_Ctx_t sha_ctx;
-    uint32_t tmp[16];
-    uint32_t pad[16];
+    _bl_sha_link_cfg_t link;
+    uint32_t total[2];          /* bytes hashed */
+    uint32_t buf[16];           /* partial block */
 } bl_sha_ctx_t;
 
+/*
+ * SHA backend, process hashes nblk whole 64 byte blocks into ctx->link.result
+ * and MUST leave it in the format SEC_ENG uses, so the backends can take
+ * turns on one context
+ */
+typedef struct bl_sha_backend {
+    const char *name;
+    int (*process)(bl_sha_ctx_t *ctx, const uint8_t *input, uint32_t nblk);
+} bl_sha_backend_t;
+
+extern const bl_sha_backend_t bl_sha_backend_hw;
+extern const bl_sha_backend_t bl_sha_backend_sw;
+
+/* HMAC keeps the keyed inner and outer states, so a key is set up only once */
+typedef struct bl_hmac_ctx {
+    bl_sha_ctx_t ipad;
+    bl_sha_ctx_t opad;
+    bl_sha_ctx_t sha;
+} bl_hmac_ctx_t;
+
+/* same order as SEC_ENG_AES_Type in driver */
+typedef enum {
+    BL_AES_ECB,
+    BL_AES_CTR,
+    BL_AES_CBC,
+} bl_aes_mode_t;
+
+typedef enum {
+    BL_AES_ENCRYPT,
+    BL_AES_DECRYPT,
+} bl_aes_dir_t;
+
+typedef struct bl_aes_ctx {
+    uint32_t key[8];
+    uint32_t iv[4];         /* chained iv for CBC, counter block for CTR */
+    int keysize;            /* in bytes, 16/24/32 */
+    bl_aes_mode_t mode;
+    bl_aes_dir_t dir;
+    uint8_t stream[16];     /* CTR keystream left from last partial block */
+    uint8_t stream_left;
+    /* expanded key, only used by software backend */
+    uint32_t rk[60];
+    int nr;
+} bl_aes_ctx_t;
+
+/*
+ * AES backend, crypt works on whole blocks only and MUST update ctx->iv
+ * the same way SEC_ENG does, in/out may be the same buffer
+ */
+typedef struct bl_aes_backend {
+    const char *name;
+    int (*setkey)(bl_aes_ctx_t *ctx);
+    int (*crypt)(bl_aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, size_t len);
+} bl_aes_backend_t;
+
+extern const bl_aes_backend_t bl_aes_backend_hw;
+extern const bl_aes_backend_t bl_aes_backend_sw;
+
+typedef struct bl_aes_gcm_ctx {
+    bl_aes_ctx_t aes;
+    bl_aes_dir_t dir;
+    uint64_t HL[16];        /* GHASH 4-bit table */
+    uint64_t HH[16];
+    uint8_t ek_j0[16];      /* E(K, J0) for tag */
+    uint8_t y[16];          /* GHASH accumulator */
+    uint64_t len;
+    uint64_t add_len;
+} bl_aes_gcm_ctx_t;
+
 extern SemaphoreHandle_t g_bl_sec_sha_mutex;
+extern SemaphoreHandle_t g_bl_sec_aes_mutex;
 
 int bl_sec_init(void);
 int bl_sec_test(void);
@@ -64,16 +146,46 @@ int bl_pka_test(void);
 int bl_sec_aes_init(void);
 int bl_sec_aes_enc(uint8_t *key, int keysize, uint8_t *input, uint8_t *output);
 int bl_sec_aes_test(void);
+/*AES Engine API*/
+int bl_aes_mutex_take();
+int bl_aes_mutex_give();
+int bl_aes_backend_set(const bl_aes_backend_t *backend);
+const bl_aes_backend_t *bl_aes_backend_get(void);
+int bl_aes_setkey(bl_aes_ctx_t *ctx, bl_aes_mode_t mode, bl_aes_dir_t dir, const uint8_t *key, int keysize);
+int bl_aes_setiv(bl_aes_ctx_t *ctx, const uint8_t iv[16]);
+int bl_aes_update(bl_aes_ctx_t *ctx, const uint8_t *input, uint8_t *output, size_t len);
+void bl_aes_free(bl_aes_ctx_t *ctx);
+int bl_aes_gcm_setkey(bl_aes_gcm_ctx_t *ctx, const uint8_t *key, int keysize);
+int bl_aes_gcm_starts(bl_aes_gcm_ctx_t *ctx, bl_aes_dir_t dir, const uint8_t *iv, size_t iv_len, const uint8_t *add, size_t add_len);
+int bl_aes_gcm_update(bl_aes_gcm_ctx_t *ctx, const uint8_t *input, uint8_t *output, size_t len);
+int bl_aes_gcm_finish(bl_aes_gcm_ctx_t *ctx, uint8_t *tag, size_t tag_len);
+void bl_aes_gcm_free(bl_aes_gcm_ctx_t *ctx);
+/* interrupt driven link mode, cb runs in the AES IRQ after each descriptor with aesIntSet */
+int bl_aes_irq_register(void (*cb)(void *arg), void *arg);
+int bl_aes_link_trigger(void *link);
 uint32_t bl_sec_get_random_word(void);
 void bl_rand_stream(uint8_t *buf, int len);
 int bl_rand(void);
 /*SHA Engine API*/
 int bl_sec_sha_test(void);
 
+/* optional, holds SEC_ENG across many calls, e.g. a PBKDF2 loop */
 int bl_sha_mutex_take();
 int bl_sha_mutex_give();
+int bl_sha_backend_set(const bl_sha_backend_t *backend);
+const bl_sha_backend_t *bl_sha_backend_get(void);
+int bl_sha_digest_size(bl_sha_type_t type);
 void bl_sha_init(bl_sha_ctx_t *ctx, const bl_sha_type_t type);
 int bl_sha_update(bl_sha_ctx_t *ctx, const uint8_t *input, uint32_t len);
 int bl_sha_finish(bl_sha_ctx_t *ctx, uint8_t *hash);
+void bl_sha_clone(bl_sha_ctx_t *dst, const bl_sha_ctx_t *src);
+void bl_sha_free(bl_sha_ctx_t *ctx);
+int bl_sha(bl_sha_type_t type, const uint8_t *input, uint32_t len, uint8_t *hash);
+/*HMAC API*/
+int bl_hmac_init(bl_hmac_ctx_t *ctx, bl_sha_type_t type, const uint8_t *key, uint32_t key_len);
+int bl_hmac_update(bl_hmac_ctx_t *ctx, const uint8_t *input, uint32_t len);
+int bl_hmac_finish(bl_hmac_ctx_t *ctx, uint8_t *mac);
+void bl_hmac_free(bl_hmac_ctx_t *ctx);
+int bl_hmac(bl_sha_type_t type, const uint8_t *key, uint32_t key_len, const uint8_t *input, uint32_t len, uint8_t *mac);
 
 #endif
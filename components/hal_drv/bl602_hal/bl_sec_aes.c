@@ -33,17 +33,483 @@
 #include <sec_eng_reg.h>
 #include <bl602_sec_eng.h>
 
+#include <FreeRTOS.h>
+#include <task.h>
+
 #include "bl_irq.h"
 #include "bl_sec.h"
 
 #include <blog.h>
 #define USER_UNUSED(a) ((void)(a))
 
-int bl_sec_aes_enc([[gnu::unused]] uint8_t *key, [[gnu::unused]] int keysize, [[gnu::unused]] uint8_t *input, [[gnu::unused]] uint8_t *output)
+/* max blocks in one link descriptor, aesMsgLen is 16 bits */
+#define AES_HW_LINK_MAX_LEN     (0xFFFF * 16)
+/* bounce buffer for buffers NOT word aligned */
+#define AES_HW_BOUNCE_SIZE      (64)
+
+static const bl_aes_backend_t *aes_backend = &bl_aes_backend_hw;
+static void (*aes_irq_cb)(void *arg);
+static void *aes_irq_cb_arg;
+static StaticSemaphore_t aes_mutex_buf;
+SemaphoreHandle_t g_bl_sec_aes_mutex = NULL;
+
+/* created on first use, bl_aes API may be called before bl_sec_init */
+static SemaphoreHandle_t _aes_mutex_get(void)
+{
+    if (NULL == g_bl_sec_aes_mutex) {
+        taskENTER_CRITICAL();
+        if (NULL == g_bl_sec_aes_mutex) {
+            g_bl_sec_aes_mutex = xSemaphoreCreateMutexStatic(&aes_mutex_buf);
+        }
+        taskEXIT_CRITICAL();
+    }
+    return g_bl_sec_aes_mutex;
+}
+
+int bl_aes_mutex_take()
+{
+    if (pdPASS != xSemaphoreTake(_aes_mutex_get(), portMAX_DELAY)) {
+        blog_error("aes semphr take failed\r\n");
+        return -1;
+    }
+    return 0;
+}
+
+int bl_aes_mutex_give()
+{
+    if (pdPASS != xSemaphoreGive(_aes_mutex_get())) {
+        blog_error("aes semphr give failed\r\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int _aes_hw_setkey([[gnu::unused]] bl_aes_ctx_t *ctx)
+{
+    /* key is loaded by link descriptor for each call */
+    return 0;
+}
+
+static int _aes_hw_crypt(bl_aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+    SEC_Eng_AES_Link_Config_Type linkCfg;
+    uint32_t bounce[AES_HW_BOUNCE_SIZE / 4];
+    size_t pos, chunk;
+    int aligned, ret = 0;
+
+    memset(&linkCfg, 0, sizeof(linkCfg));
+    switch (ctx->keysize) {
+        case 16:
+        {
+            linkCfg.aesMode = SEC_ENG_AES_KEY_128BITS;
+        }
+        break;
+        case 24:
+        {
+            linkCfg.aesMode = SEC_ENG_AES_KEY_192BITS;
+        }
+        break;
+        case 32:
+        {
+            linkCfg.aesMode = SEC_ENG_AES_KEY_256BITS;
+        }
+        break;
+        default:
+        {
+            return -1;
+        }
+    }
+    linkCfg.aesBlockMode = ctx->mode;
+    /* CTR mode is symmetric, always run the forward cipher */
+    linkCfg.aesDecEn = (BL_AES_DECRYPT == ctx->dir && BL_AES_CTR != ctx->mode) ?
+        SEC_ENG_AES_DECRYPTION : SEC_ENG_AES_ENCRYPTION;
+    linkCfg.aesDecKeySel = SEC_ENG_AES_USE_NEW;
+    linkCfg.aesIVSel = SEC_ENG_AES_USE_NEW;
+    memcpy(&(linkCfg.aesKey0), ctx->key, sizeof(ctx->key));
+    memcpy(&(linkCfg.aesIV0), ctx->iv, sizeof(ctx->iv));
+
+    aligned = (0 == (((uint32_t)in | (uint32_t)out) & 0x03));
+
+    bl_aes_mutex_take();
+    Sec_Eng_AES_Enable_BE(SEC_ENG_AES_ID0);
+    Sec_Eng_AES_Enable_Link(SEC_ENG_AES_ID0);
+    for (pos = 0; pos < len; pos += chunk) {
+        chunk = len - pos;
+        if (aligned) {
+            if (chunk > AES_HW_LINK_MAX_LEN) {
+                chunk = AES_HW_LINK_MAX_LEN;
+            }
+            if (SUCCESS != Sec_Eng_AES_Link_Work(SEC_ENG_AES_ID0, (uint32_t)&linkCfg, in + pos, chunk, out + pos)) {
+                ret = -1;
+                break;
+            }
+        } else {
+            if (chunk > sizeof(bounce)) {
+                chunk = sizeof(bounce);
+            }
+            memcpy(bounce, in + pos, chunk);
+            if (SUCCESS != Sec_Eng_AES_Link_Work(SEC_ENG_AES_ID0, (uint32_t)&linkCfg, (uint8_t*)bounce, chunk, (uint8_t*)bounce)) {
+                ret = -1;
+                break;
+            }
+            memcpy(out + pos, bounce, chunk);
+        }
+        /* engine keeps key and chained iv in linkCfg */
+        linkCfg.aesDecKeySel = SEC_ENG_AES_USE_OLD;
+    }
+    Sec_Eng_AES_Disable_Link(SEC_ENG_AES_ID0);
+    bl_aes_mutex_give();
+
+    memcpy(ctx->iv, &(linkCfg.aesIV0), sizeof(ctx->iv));
+
+    return ret;
+}
+
+const bl_aes_backend_t bl_aes_backend_hw = {
+    .name = "sec_eng",
+    .setkey = _aes_hw_setkey,
+    .crypt = _aes_hw_crypt,
+};
+
+int bl_aes_backend_set(const bl_aes_backend_t *backend)
+{
+    if (NULL == backend) {
+        backend = &bl_aes_backend_hw;
+    }
+    if (NULL == backend->setkey || NULL == backend->crypt) {
+        return -1;
+    }
+    aes_backend = backend;
+    return 0;
+}
+
+const bl_aes_backend_t *bl_aes_backend_get(void)
+{
+    return aes_backend;
+}
+
+int bl_aes_setkey(bl_aes_ctx_t *ctx, bl_aes_mode_t mode, bl_aes_dir_t dir, const uint8_t *key, int keysize)
+{
+    if (16 != keysize && 24 != keysize && 32 != keysize) {
+        return -1;
+    }
+    if (BL_AES_ECB != mode && BL_AES_CTR != mode && BL_AES_CBC != mode) {
+        return -1;
+    }
+    memset(ctx, 0, sizeof(bl_aes_ctx_t));
+    memcpy(ctx->key, key, keysize);
+    ctx->keysize = keysize;
+    ctx->mode = mode;
+    ctx->dir = dir;
+
+    return aes_backend->setkey(ctx);
+}
+
+int bl_aes_setiv(bl_aes_ctx_t *ctx, const uint8_t iv[16])
+{
+    memcpy(ctx->iv, iv, sizeof(ctx->iv));
+    ctx->stream_left = 0;
+    return 0;
+}
+
+int bl_aes_update(bl_aes_ctx_t *ctx, const uint8_t *input, uint8_t *output, size_t len)
+{
+    size_t full;
+
+    if (BL_AES_CTR != ctx->mode) {
+        if (len & 0x0F) {
+            return -1;
+        }
+        return len ? aes_backend->crypt(ctx, input, output, len) : 0;
+    }
+
+    /* CTR mode works on any length, use keystream left from the last call first */
+    while (len && ctx->stream_left) {
+        *output++ = *input++ ^ ctx->stream[16 - ctx->stream_left];
+        ctx->stream_left--;
+        len--;
+    }
+    full = len & (~0x0F);
+    if (full) {
+        if (aes_backend->crypt(ctx, input, output, full)) {
+            return -1;
+        }
+        input += full;
+        output += full;
+        len -= full;
+    }
+    if (len) {
+        /* encrypt zero block to get keystream of the next counter */
+        memset(ctx->stream, 0, sizeof(ctx->stream));
+        if (aes_backend->crypt(ctx, ctx->stream, ctx->stream, 16)) {
+            return -1;
+        }
+        ctx->stream_left = 16;
+        while (len) {
+            *output++ = *input++ ^ ctx->stream[16 - ctx->stream_left];
+            ctx->stream_left--;
+            len--;
+        }
+    }
+
+    return 0;
+}
+
+void bl_aes_free(bl_aes_ctx_t *ctx)
+{
+    /* clean key material */
+    memset(ctx, 0, sizeof(bl_aes_ctx_t));
+}
+
+int bl_sec_aes_enc(uint8_t *key, int keysize, uint8_t *input, uint8_t *output)
+{
+    bl_aes_ctx_t ctx;
+    int ret;
+
+    if (bl_aes_setkey(&ctx, BL_AES_ECB, BL_AES_ENCRYPT, key, keysize)) {
+        return -1;
+    }
+    ret = bl_aes_update(&ctx, input, output, 16);
+    bl_aes_free(&ctx);
+
+    return ret;
+}
+
+/* GCM, CTR part runs on the AES backend and GHASH runs in software */
+#define AES_GET_UINT32_BE(b, i)             \
+    (((uint32_t)(b)[(i)] << 24)             \
+    | ((uint32_t)(b)[(i) + 1] << 16)        \
+    | ((uint32_t)(b)[(i) + 2] << 8)         \
+    | ((uint32_t)(b)[(i) + 3]))
+
+#define AES_PUT_UINT32_BE(n, b, i)          \
+do {                                        \
+    (b)[(i)] = (uint8_t)((n) >> 24);        \
+    (b)[(i) + 1] = (uint8_t)((n) >> 16);    \
+    (b)[(i) + 2] = (uint8_t)((n) >> 8);     \
+    (b)[(i) + 3] = (uint8_t)(n);            \
+} while (0)
+
+static const uint64_t gcm_last4[16] =
+{
+    0x0000, 0x1c20, 0x3840, 0x2460,
+    0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560,
+    0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+static void _gcm_gen_table(bl_aes_gcm_ctx_t *ctx, const uint8_t h[16])
+{
+    uint64_t vh, vl;
+    uint32_t T;
+    int i, j;
+
+    vh = ((uint64_t)AES_GET_UINT32_BE(h, 0) << 32) | AES_GET_UINT32_BE(h, 4);
+    vl = ((uint64_t)AES_GET_UINT32_BE(h, 8) << 32) | AES_GET_UINT32_BE(h, 12);
+
+    ctx->HL[8] = vl;
+    ctx->HH[8] = vh;
+    ctx->HH[0] = 0;
+    ctx->HL[0] = 0;
+
+    for (i = 4; i > 0; i >>= 1) {
+        T = (vl & 1) * 0xe1000000U;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ ((uint64_t)T << 32);
+        ctx->HL[i] = vl;
+        ctx->HH[i] = vh;
+    }
+    for (i = 2; i <= 8; i *= 2) {
+        for (j = 1; j < i; j++) {
+            ctx->HH[i + j] = ctx->HH[i] ^ ctx->HH[j];
+            ctx->HL[i + j] = ctx->HL[i] ^ ctx->HL[j];
+        }
+    }
+}
+
+/* output = x * H, in GF(2^128) */
+static void _gcm_mult(bl_aes_gcm_ctx_t *ctx, const uint8_t x[16], uint8_t output[16])
+{
+    int i;
+    uint8_t lo, hi, rem;
+    uint64_t zh, zl;
+
+    lo = x[15] & 0x0F;
+    zh = ctx->HH[lo];
+    zl = ctx->HL[lo];
+
+    for (i = 15; i >= 0; i--) {
+        lo = x[i] & 0x0F;
+        hi = (x[i] >> 4) & 0x0F;
+
+        if (i != 15) {
+            rem = (uint8_t)(zl & 0x0F);
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ (gcm_last4[rem] << 48);
+            zh ^= ctx->HH[lo];
+            zl ^= ctx->HL[lo];
+        }
+        rem = (uint8_t)(zl & 0x0F);
+        zl = (zh << 60) | (zl >> 4);
+        zh = (zh >> 4) ^ (gcm_last4[rem] << 48);
+        zh ^= ctx->HH[hi];
+        zl ^= ctx->HL[hi];
+    }
+
+    AES_PUT_UINT32_BE(zh >> 32, output, 0);
+    AES_PUT_UINT32_BE(zh, output, 4);
+    AES_PUT_UINT32_BE(zl >> 32, output, 8);
+    AES_PUT_UINT32_BE(zl, output, 12);
+}
+
+/* absorb data into GHASH, pos is the byte offset inside the current block */
+static void _gcm_ghash(bl_aes_gcm_ctx_t *ctx, const uint8_t *data, size_t len, size_t pos)
+{
+    while (len--) {
+        ctx->y[pos++] ^= *data++;
+        if (16 == pos) {
+            _gcm_mult(ctx, ctx->y, ctx->y);
+            pos = 0;
+        }
+    }
+}
+
+static int _gcm_ecb_encrypt(bl_aes_gcm_ctx_t *ctx, const uint8_t in[16], uint8_t out[16])
+{
+    bl_aes_mode_t mode = ctx->aes.mode;
+    int ret;
+
+    ctx->aes.mode = BL_AES_ECB;
+    ret = aes_backend->crypt(&(ctx->aes), in, out, 16);
+    ctx->aes.mode = mode;
+
+    return ret;
+}
+
+int bl_aes_gcm_setkey(bl_aes_gcm_ctx_t *ctx, const uint8_t *key, int keysize)
+{
+    uint8_t h[16];
+
+    memset(ctx, 0, sizeof(bl_aes_gcm_ctx_t));
+    if (bl_aes_setkey(&(ctx->aes), BL_AES_CTR, BL_AES_ENCRYPT, key, keysize)) {
+        return -1;
+    }
+    memset(h, 0, sizeof(h));
+    if (_gcm_ecb_encrypt(ctx, h, h)) {
+        return -1;
+    }
+    _gcm_gen_table(ctx, h);
+
+    return 0;
+}
+
+int bl_aes_gcm_starts(bl_aes_gcm_ctx_t *ctx, bl_aes_dir_t dir, const uint8_t *iv, size_t iv_len, const uint8_t *add, size_t add_len)
+{
+    uint8_t j0[16];
+    uint8_t work_buf[16];
+    uint32_t counter;
+
+    if (0 == iv_len) {
+        return -1;
+    }
+    ctx->dir = dir;
+    ctx->len = 0;
+    ctx->add_len = 0;
+    memset(ctx->y, 0, sizeof(ctx->y));
+
+    if (12 == iv_len) {
+        memcpy(j0, iv, 12);
+        memset(j0 + 12, 0, 4);
+        j0[15] = 1;
+    } else {
+        /* J0 = GHASH(IV || 0-pad || [len(IV)]64) */
+        _gcm_ghash(ctx, iv, iv_len, 0);
+        if (iv_len & 0x0F) {
+            _gcm_mult(ctx, ctx->y, ctx->y);
+        }
+        memset(work_buf, 0, sizeof(work_buf));
+        AES_PUT_UINT32_BE((uint32_t)(iv_len >> 29), work_buf, 8);
+        AES_PUT_UINT32_BE((uint32_t)(iv_len << 3), work_buf, 12);
+        _gcm_ghash(ctx, work_buf, 16, 0);
+        memcpy(j0, ctx->y, 16);
+        memset(ctx->y, 0, sizeof(ctx->y));
+    }
+    if (_gcm_ecb_encrypt(ctx, j0, ctx->ek_j0)) {
+        return -1;
+    }
+
+    /* data starts from inc32(J0) */
+    counter = AES_GET_UINT32_BE(j0, 12) + 1;
+    AES_PUT_UINT32_BE(counter, j0, 12);
+    bl_aes_setiv(&(ctx->aes), j0);
+
+    if (add_len) {
+        _gcm_ghash(ctx, add, add_len, 0);
+        if (add_len & 0x0F) {
+            _gcm_mult(ctx, ctx->y, ctx->y);
+        }
+    }
+    ctx->add_len = add_len;
+
+    return 0;
+}
+
+int bl_aes_gcm_update(bl_aes_gcm_ctx_t *ctx, const uint8_t *input, uint8_t *output, size_t len)
 {
+    size_t pos = (size_t)(ctx->len & 0x0F);
+
+    /* Total length is restricted to 2^39 - 256 bits */
+    if (ctx->len + len < ctx->len || ctx->len + len > 0xFFFFFFFE0ULL) {
+        return -1;
+    }
+
+    /* GHASH always runs over ciphertext, input may be the same as output */
+    if (BL_AES_DECRYPT == ctx->dir) {
+        _gcm_ghash(ctx, input, len, pos);
+    }
+    if (bl_aes_update(&(ctx->aes), input, output, len)) {
+        return -1;
+    }
+    if (BL_AES_ENCRYPT == ctx->dir) {
+        _gcm_ghash(ctx, output, len, pos);
+    }
+    ctx->len += len;
+
+    return 0;
+}
+
+int bl_aes_gcm_finish(bl_aes_gcm_ctx_t *ctx, uint8_t *tag, size_t tag_len)
+{
+    uint8_t work_buf[16];
+    uint64_t orig_len = ctx->len * 8;
+    uint64_t orig_add_len = ctx->add_len * 8;
+    size_t i;
+
+    if (tag_len > 16 || tag_len < 4) {
+        return -1;
+    }
+    if (ctx->len & 0x0F) {
+        _gcm_mult(ctx, ctx->y, ctx->y);
+    }
+
+    AES_PUT_UINT32_BE(orig_add_len >> 32, work_buf, 0);
+    AES_PUT_UINT32_BE(orig_add_len, work_buf, 4);
+    AES_PUT_UINT32_BE(orig_len >> 32, work_buf, 8);
+    AES_PUT_UINT32_BE(orig_len, work_buf, 12);
+    _gcm_ghash(ctx, work_buf, 16, 0);
+
+    for (i = 0; i < tag_len; i++) {
+        tag[i] = ctx->y[i] ^ ctx->ek_j0[i];
+    }
+
     return 0;
 }
 
+void bl_aes_gcm_free(bl_aes_gcm_ctx_t *ctx)
+{
+    memset(ctx, 0, sizeof(bl_aes_gcm_ctx_t));
+}
+
 static void Aes_Compare_Data(const uint8_t *expected, uint8_t *input, uint32_t len)
 {
     int i = 0, is_failed = 0;
@@ -292,6 +758,43 @@ static void _clear_aes_int()
 
 void bl_sec_aes_IRQHandler(void)
 {
-    blog_print("--->>> AES IRQ\r\n");
     _clear_aes_int();
+    if (aes_irq_cb) {
+        aes_irq_cb(aes_irq_cb_arg);
+    } else {
+        blog_print("--->>> AES IRQ\r\n");
+    }
+}
+
+int bl_aes_irq_register(void (*cb)(void *arg), void *arg)
+{
+    aes_irq_cb = cb;
+    aes_irq_cb_arg = arg;
+    bl_irq_register(SEC_AES_IRQn, bl_sec_aes_IRQHandler);
+    bl_irq_enable(SEC_AES_IRQn);
+    SEC_Eng_IntMask(SEC_ENG_INT_AES, UNMASK);
+
+    return 0;
+}
+
+/* start one link descriptor and return, completion is reported by the AES IRQ */
+int bl_aes_link_trigger(void *link)
+{
+    uint32_t AESx = SEC_ENG_BASE;
+    uint32_t val;
+
+    if ((uint32_t)link & 0x03) {
+        return -1;
+    }
+    val = BL_RD_REG(AESx, SEC_ENG_SE_AES_0_CTRL);
+    if (BL_IS_REG_BIT_SET(val, SEC_ENG_SE_AES_0_BUSY)) {
+        return -1;
+    }
+    BL_WR_REG(AESx, SEC_ENG_SE_AES_0_LINK, (uint32_t)link);
+    val = BL_SET_REG_BIT(val, SEC_ENG_SE_AES_0_EN);
+    BL_WR_REG(AESx, SEC_ENG_SE_AES_0_CTRL, val);
+    val = BL_SET_REG_BIT(val, SEC_ENG_SE_AES_0_TRIG_1T);
+    BL_WR_REG(AESx, SEC_ENG_SE_AES_0_CTRL, val);
+
+    return 0;
 }
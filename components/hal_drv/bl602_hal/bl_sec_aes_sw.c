@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Software reference backend for bl_aes API.
+ *
+ * Plain byte oriented AES, it's slow but has no dependency on SEC_ENG, so it's
+ * used for cross checking the hardware backend and on platforms without one.
+ * Chaining follows SEC_ENG link mode, CTR mode increases the low 32 bits of the
+ * counter block only.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "bl_sec.h"
+
+static const uint8_t aes_sbox[256] =
+{
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+static const uint8_t aes_rsbox[256] =
+{
+    0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
+    0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
+    0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
+    0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
+    0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
+    0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
+    0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
+    0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
+    0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
+    0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
+    0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
+    0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
+    0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
+    0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
+    0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
+    0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d,
+};
+
+static const uint8_t aes_rcon[11] =
+{
+    0x8d, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36
+};
+
+#define AES_XTIME(x) ((uint8_t)(((x) << 1) ^ ((((x) >> 7) & 1) * 0x1b)))
+
+static uint8_t _aes_mul(uint8_t x, uint8_t y)
+{
+    uint8_t r = 0;
+
+    while (y) {
+        if (y & 1) {
+            r ^= x;
+        }
+        x = AES_XTIME(x);
+        y >>= 1;
+    }
+    return r;
+}
+
+static int _aes_sw_setkey(bl_aes_ctx_t *ctx)
+{
+    uint8_t *rk = (uint8_t*)ctx->rk;
+    const uint8_t *key = (const uint8_t*)ctx->key;
+    int nk, i, j;
+    uint8_t t[4], tmp;
+
+    nk = ctx->keysize / 4;
+    ctx->nr = nk + 6;
+    memcpy(rk, key, ctx->keysize);
+
+    for (i = nk; i < 4 * (ctx->nr + 1); i++) {
+        for (j = 0; j < 4; j++) {
+            t[j] = rk[(i - 1) * 4 + j];
+        }
+        if (0 == i % nk) {
+            tmp = t[0];
+            t[0] = aes_sbox[t[1]] ^ aes_rcon[i / nk];
+            t[1] = aes_sbox[t[2]];
+            t[2] = aes_sbox[t[3]];
+            t[3] = aes_sbox[tmp];
+        } else if (nk > 6 && 4 == i % nk) {
+            for (j = 0; j < 4; j++) {
+                t[j] = aes_sbox[t[j]];
+            }
+        }
+        for (j = 0; j < 4; j++) {
+            rk[i * 4 + j] = rk[(i - nk) * 4 + j] ^ t[j];
+        }
+    }
+
+    return 0;
+}
+
+static void _aes_add_round_key(uint8_t s[16], const uint8_t *rk)
+{
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        s[i] ^= rk[i];
+    }
+}
+
+static void _aes_encrypt_block(const bl_aes_ctx_t *ctx, uint8_t s[16])
+{
+    const uint8_t *rk = (const uint8_t*)ctx->rk;
+    uint8_t t[16], a0, a1, a2, a3;
+    int round, i;
+
+    _aes_add_round_key(s, rk);
+    for (round = 1; round <= ctx->nr; round++) {
+        /* SubBytes and ShiftRows */
+        for (i = 0; i < 16; i++) {
+            t[i] = aes_sbox[s[(i + 4 * (i % 4)) % 16]];
+        }
+        if (round != ctx->nr) {
+            /* MixColumns */
+            for (i = 0; i < 16; i += 4) {
+                a0 = t[i];
+                a1 = t[i + 1];
+                a2 = t[i + 2];
+                a3 = t[i + 3];
+                s[i] = AES_XTIME(a0) ^ AES_XTIME(a1) ^ a1 ^ a2 ^ a3;
+                s[i + 1] = a0 ^ AES_XTIME(a1) ^ AES_XTIME(a2) ^ a2 ^ a3;
+                s[i + 2] = a0 ^ a1 ^ AES_XTIME(a2) ^ AES_XTIME(a3) ^ a3;
+                s[i + 3] = AES_XTIME(a0) ^ a0 ^ a1 ^ a2 ^ AES_XTIME(a3);
+            }
+        } else {
+            memcpy(s, t, 16);
+        }
+        _aes_add_round_key(s, rk + round * 16);
+    }
+}
+
+static void _aes_decrypt_block(const bl_aes_ctx_t *ctx, uint8_t s[16])
+{
+    const uint8_t *rk = (const uint8_t*)ctx->rk;
+    uint8_t t[16], a0, a1, a2, a3;
+    int round, i;
+
+    _aes_add_round_key(s, rk + ctx->nr * 16);
+    for (round = ctx->nr - 1; round >= 0; round--) {
+        /* InvShiftRows and InvSubBytes */
+        for (i = 0; i < 16; i++) {
+            t[(i + 4 * (i % 4)) % 16] = aes_rsbox[s[i]];
+        }
+        memcpy(s, t, 16);
+        _aes_add_round_key(s, rk + round * 16);
+        if (round) {
+            /* InvMixColumns */
+            for (i = 0; i < 16; i += 4) {
+                a0 = s[i];
+                a1 = s[i + 1];
+                a2 = s[i + 2];
+                a3 = s[i + 3];
+                s[i] = _aes_mul(a0, 0x0e) ^ _aes_mul(a1, 0x0b) ^ _aes_mul(a2, 0x0d) ^ _aes_mul(a3, 0x09);
+                s[i + 1] = _aes_mul(a0, 0x09) ^ _aes_mul(a1, 0x0e) ^ _aes_mul(a2, 0x0b) ^ _aes_mul(a3, 0x0d);
+                s[i + 2] = _aes_mul(a0, 0x0d) ^ _aes_mul(a1, 0x09) ^ _aes_mul(a2, 0x0e) ^ _aes_mul(a3, 0x0b);
+                s[i + 3] = _aes_mul(a0, 0x0b) ^ _aes_mul(a1, 0x0d) ^ _aes_mul(a2, 0x09) ^ _aes_mul(a3, 0x0e);
+            }
+        }
+    }
+}
+
+static void _aes_ctr_inc32(uint8_t counter[16])
+{
+    int i;
+
+    for (i = 15; i >= 12; i--) {
+        if (++counter[i]) {
+            break;
+        }
+    }
+}
+
+static int _aes_sw_crypt(bl_aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+    uint8_t *iv = (uint8_t*)ctx->iv;
+    uint8_t block[16], chain[16];
+    size_t pos;
+    int i;
+
+    if (0 == ctx->nr) {
+        _aes_sw_setkey(ctx);
+    }
+
+    for (pos = 0; pos < len; pos += 16) {
+        memcpy(block, in + pos, 16);
+        switch (ctx->mode) {
+            case BL_AES_ECB:
+            {
+                if (BL_AES_ENCRYPT == ctx->dir) {
+                    _aes_encrypt_block(ctx, block);
+                } else {
+                    _aes_decrypt_block(ctx, block);
+                }
+            }
+            break;
+            case BL_AES_CBC:
+            {
+                if (BL_AES_ENCRYPT == ctx->dir) {
+                    for (i = 0; i < 16; i++) {
+                        block[i] ^= iv[i];
+                    }
+                    _aes_encrypt_block(ctx, block);
+                    memcpy(iv, block, 16);
+                } else {
+                    /* keep ciphertext before in-place output overwrites it */
+                    memcpy(chain, block, 16);
+                    _aes_decrypt_block(ctx, block);
+                    for (i = 0; i < 16; i++) {
+                        block[i] ^= iv[i];
+                    }
+                    memcpy(iv, chain, 16);
+                }
+            }
+            break;
+            case BL_AES_CTR:
+            {
+                memcpy(chain, iv, 16);
+                _aes_encrypt_block(ctx, chain);
+                for (i = 0; i < 16; i++) {
+                    block[i] ^= chain[i];
+                }
+                _aes_ctr_inc32(iv);
+            }
+            break;
+            default:
+            {
+                return -1;
+            }
+        }
+        memcpy(out + pos, block, 16);
+    }
+
+    return 0;
+}
+
+const bl_aes_backend_t bl_aes_backend_sw = {
+    .name = "software",
+    .setkey = _aes_sw_setkey,
+    .crypt = _aes_sw_crypt,
+};
@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * SHA and HMAC front end for bl_sha API, shared by the SEC_ENG and software
+ * backends.
+ *
+ * Whole blocks go to the backend straight from the caller's buffer, only a
+ * partial block and the final padding pass through ctx->buf. Nothing here
+ * touches SEC_ENG, so it builds on a host together with bl_sec_sha_sw.c.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "bl_sec.h"
+
+#define SHA_BLOCK_SIZE          (64)
+
+#define SHA_PUT_UINT32_BE(n, b, i)          \
+do {                                        \
+    (b)[(i)] = (uint8_t)((n) >> 24);        \
+    (b)[(i) + 1] = (uint8_t)((n) >> 16);    \
+    (b)[(i) + 2] = (uint8_t)((n) >> 8);     \
+    (b)[(i) + 3] = (uint8_t)(n);            \
+} while (0)
+
+static const bl_sha_backend_t *sha_backend = &bl_sha_backend_hw;
+
+int bl_sha_backend_set(const bl_sha_backend_t *backend)
+{
+    if (NULL == backend) {
+        backend = &bl_sha_backend_hw;
+    }
+    if (NULL == backend->process) {
+        return -1;
+    }
+    sha_backend = backend;
+    return 0;
+}
+
+const bl_sha_backend_t *bl_sha_backend_get(void)
+{
+    return sha_backend;
+}
+
+int bl_sha_digest_size(bl_sha_type_t type)
+{
+    switch (type) {
+        case BL_SHA256:
+        {
+            return 32;
+        }
+        case BL_SHA224:
+        {
+            return 28;
+        }
+        case BL_SHA1:
+        {
+            return 20;
+        }
+        default:
+        {
+            return -1;
+        }
+    }
+}
+
+void bl_sha_init(bl_sha_ctx_t *ctx, const bl_sha_type_t type)
+{
+    memset(ctx, 0, sizeof(bl_sha_ctx_t));
+    ctx->link.shaMode = type;
+}
+
+int bl_sha_update(bl_sha_ctx_t *ctx, const uint8_t *input, uint32_t len)
+{
+    uint32_t left, fill, nblk;
+
+    if (0 == len) {
+        return 0;
+    }
+    left = ctx->total[0] & (SHA_BLOCK_SIZE - 1);
+    fill = SHA_BLOCK_SIZE - left;
+
+    ctx->total[0] += len;
+    if (ctx->total[0] < len) {
+        ctx->total[1]++;
+    }
+
+    if (left) {
+        if (len < fill) {
+            memcpy((uint8_t*)ctx->buf + left, input, len);
+            return 0;
+        }
+        memcpy((uint8_t*)ctx->buf + left, input, fill);
+        if (sha_backend->process(ctx, (uint8_t*)ctx->buf, 1)) {
+            return -1;
+        }
+        input += fill;
+        len -= fill;
+    }
+
+    nblk = len / SHA_BLOCK_SIZE;
+    if (nblk) {
+        if (sha_backend->process(ctx, input, nblk)) {
+            return -1;
+        }
+        input += nblk * SHA_BLOCK_SIZE;
+        len -= nblk * SHA_BLOCK_SIZE;
+    }
+    if (len) {
+        memcpy(ctx->buf, input, len);
+    }
+
+    return 0;
+}
+
+int bl_sha_finish(bl_sha_ctx_t *ctx, uint8_t *hash)
+{
+    uint8_t *buf = (uint8_t*)ctx->buf;
+    uint32_t last = ctx->total[0] & (SHA_BLOCK_SIZE - 1);
+    uint32_t high = (ctx->total[0] >> 29) | (ctx->total[1] << 3);
+    uint32_t low = ctx->total[0] << 3;
+    int size = bl_sha_digest_size(ctx->link.shaMode);
+
+    if (size < 0) {
+        return -1;
+    }
+
+    /* 0x80, zeros up to byte 56, then the length in bits */
+    buf[last++] = 0x80;
+    if (last > SHA_BLOCK_SIZE - 8) {
+        memset(buf + last, 0, SHA_BLOCK_SIZE - last);
+        if (sha_backend->process(ctx, buf, 1)) {
+            return -1;
+        }
+        last = 0;
+    }
+    memset(buf + last, 0, SHA_BLOCK_SIZE - 8 - last);
+    SHA_PUT_UINT32_BE(high, buf, 56);
+    SHA_PUT_UINT32_BE(low, buf, 60);
+    if (sha_backend->process(ctx, buf, 1)) {
+        return -1;
+    }
+    memcpy(hash, ctx->link.result, size);
+
+    return 0;
+}
+
+void bl_sha_clone(bl_sha_ctx_t *dst, const bl_sha_ctx_t *src)
+{
+    memcpy(dst, src, sizeof(bl_sha_ctx_t));
+}
+
+void bl_sha_free(bl_sha_ctx_t *ctx)
+{
+    memset(ctx, 0, sizeof(bl_sha_ctx_t));
+}
+
+int bl_sha(bl_sha_type_t type, const uint8_t *input, uint32_t len, uint8_t *hash)
+{
+    bl_sha_ctx_t ctx;
+    int ret;
+
+    bl_sha_init(&ctx, type);
+    ret = bl_sha_update(&ctx, input, len);
+    if (0 == ret) {
+        ret = bl_sha_finish(&ctx, hash);
+    }
+    bl_sha_free(&ctx);
+
+    return ret;
+}
+
+/* keyed states are hashed once here, each message then costs two blocks less */
+int bl_hmac_init(bl_hmac_ctx_t *ctx, bl_sha_type_t type, const uint8_t *key, uint32_t key_len)
+{
+    uint32_t pad[SHA_BLOCK_SIZE / 4];
+    int i, ret = -1;
+
+    if (bl_sha_digest_size(type) < 0) {
+        return -1;
+    }
+    memset(ctx, 0, sizeof(bl_hmac_ctx_t));
+    memset(pad, 0, sizeof(pad));
+    if (key_len > SHA_BLOCK_SIZE) {
+        if (bl_sha(type, key, key_len, (uint8_t*)pad)) {
+            goto exit;
+        }
+    } else {
+        memcpy(pad, key, key_len);
+    }
+
+    for (i = 0; i < SHA_BLOCK_SIZE / 4; i++) {
+        pad[i] ^= 0x36363636;
+    }
+    bl_sha_init(&(ctx->ipad), type);
+    if (bl_sha_update(&(ctx->ipad), (uint8_t*)pad, SHA_BLOCK_SIZE)) {
+        goto exit;
+    }
+
+    for (i = 0; i < SHA_BLOCK_SIZE / 4; i++) {
+        pad[i] ^= 0x36363636 ^ 0x5c5c5c5c;
+    }
+    bl_sha_init(&(ctx->opad), type);
+    if (bl_sha_update(&(ctx->opad), (uint8_t*)pad, SHA_BLOCK_SIZE)) {
+        goto exit;
+    }
+
+    bl_sha_clone(&(ctx->sha), &(ctx->ipad));
+    ret = 0;
+
+exit:
+    /* clean key material */
+    memset(pad, 0, sizeof(pad));
+    return ret;
+}
+
+int bl_hmac_update(bl_hmac_ctx_t *ctx, const uint8_t *input, uint32_t len)
+{
+    return bl_sha_update(&(ctx->sha), input, len);
+}
+
+/* ctx is ready for the next message under the same key afterwards */
+int bl_hmac_finish(bl_hmac_ctx_t *ctx, uint8_t *mac)
+{
+    uint32_t digest[8];
+    int size = bl_sha_digest_size(ctx->sha.link.shaMode);
+    int ret = -1;
+
+    if (bl_sha_finish(&(ctx->sha), (uint8_t*)digest)) {
+        goto exit;
+    }
+    bl_sha_clone(&(ctx->sha), &(ctx->opad));
+    if (bl_sha_update(&(ctx->sha), (uint8_t*)digest, size)) {
+        goto exit;
+    }
+    if (bl_sha_finish(&(ctx->sha), mac)) {
+        goto exit;
+    }
+    ret = 0;
+
+exit:
+    bl_sha_clone(&(ctx->sha), &(ctx->ipad));
+    return ret;
+}
+
+void bl_hmac_free(bl_hmac_ctx_t *ctx)
+{
+    /* clean key material */
+    memset(ctx, 0, sizeof(bl_hmac_ctx_t));
+}
+
+int bl_hmac(bl_sha_type_t type, const uint8_t *key, uint32_t key_len, const uint8_t *input, uint32_t len, uint8_t *mac)
+{
+    bl_hmac_ctx_t ctx;
+    int ret;
+
+    ret = bl_hmac_init(&ctx, type, key, key_len);
+    if (0 == ret) {
+        ret = bl_hmac_update(&ctx, input, len);
+    }
+    if (0 == ret) {
+        ret = bl_hmac_finish(&ctx, mac);
+    }
+    bl_hmac_free(&ctx);
+
+    return ret;
+}
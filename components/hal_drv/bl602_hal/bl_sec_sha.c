@@ -28,7 +28,9 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <stdio.h>
+#include <string.h>
 
+#include <sec_eng_reg.h>
 #include <bl602_sec_eng.h>
 
 #include <FreeRTOS.h>
@@ -48,9 +50,25 @@ typedef struct sha256_link_item {
 
 #define BL_SHA_ID SEC_ENG_SHA_ID0 // this is the only valid value
 
+/* max blocks in one link descriptor, shaMsgLen is 16 bits */
+#define SHA_HW_LINK_MAX_BLOCKS  (0xFFFF)
+/* bounce buffer for input NOT word aligned */
+#define SHA_HW_BOUNCE_SIZE      (256)
+/* same as SEC_ENG_SHA_BUSY_TIMEOUT_COUNT in driver */
+#define SHA_HW_BUSY_TIMEOUT     (100 * 160 * 1000)
+
+/*
+ * Runs shorter than this are hashed in software when another stream is
+ * using the engine, waiting would cost more than the work itself
+ */
+#ifndef BL_SHA_HW_MIN_BLOCKS
+#define BL_SHA_HW_MIN_BLOCKS    (4)
+#endif
+
+/* recursive, the engine is also taken inside every bl_sha call */
 int bl_sha_mutex_take()
 {
-    if (pdPASS != xSemaphoreTake(g_bl_sec_sha_mutex, portMAX_DELAY)) {
+    if (pdPASS != xSemaphoreTakeRecursive(g_bl_sec_sha_mutex, portMAX_DELAY)) {
         blog_error("sha semphr take failed\r\n");
         return -1;
     }
@@ -59,31 +77,80 @@ int bl_sha_mutex_take()
 
 int bl_sha_mutex_give()
 {
-    if (pdPASS != xSemaphoreGive(g_bl_sec_sha_mutex)) {
-        blog_error("sha semphr give failed\\n");
+    if (pdPASS != xSemaphoreGiveRecursive(g_bl_sec_sha_mutex)) {
+        blog_error("sha semphr give failed\r\n");
         return -1;
     }
     return 0;
 }
 
-void bl_sha_init(bl_sha_ctx_t *ctx, const bl_sha_type_t type)
+static int _sha_hw_run(_bl_sha_link_cfg_t *link, const uint8_t *input, uint32_t nblk)
 {
-    const SEC_ENG_SHA_Type sha_type = (SEC_ENG_SHA_Type) type; // bl_sha_type_t is the same as SEC_ENG_SHA_Type in driver
+    uint32_t SHAx = SEC_ENG_BASE;
+    uint32_t tmpVal;
+    uint32_t timeoutCnt = SHA_HW_BUSY_TIMEOUT;
+
+    link->shaSrcAddr = (uint32_t)input;
+    link->shaMsgLen = nblk;
+    /* descriptor must be in memory before the engine fetches it */
+    __asm__ volatile ("" ::: "memory");
+
+    BL_WR_REG(SHAx, SEC_ENG_SE_SHA_0_LINK, (uint32_t)link);
+    tmpVal = BL_RD_REG(SHAx, SEC_ENG_SE_SHA_0_CTRL);
+    BL_WR_REG(SHAx, SEC_ENG_SE_SHA_0_CTRL, BL_SET_REG_BIT(tmpVal, SEC_ENG_SE_SHA_0_TRIG_1T));
+    do {
+        tmpVal = BL_RD_REG(SHAx, SEC_ENG_SE_SHA_0_CTRL);
+        if (0 == --timeoutCnt) {
+            return -1;
+        }
+    } while (BL_IS_REG_BIT_SET(tmpVal, SEC_ENG_SE_SHA_0_BUSY));
 
-    Sec_Eng_SHA256_Init((SEC_Eng_SHA256_Ctx *)&ctx->sha_ctx, BL_SHA_ID, sha_type, ctx->tmp, ctx->pad);
-    Sec_Eng_SHA_Start(BL_SHA_ID);
-}
+    /* engine wrote the hash back to link->result, continue from it next time */
+    link->shaHashSel = 1;
 
-int bl_sha_update(bl_sha_ctx_t *ctx, const uint8_t *input, uint32_t len)
-{
-    return Sec_Eng_SHA256_Update((SEC_Eng_SHA256_Ctx *)&ctx->sha_ctx, BL_SHA_ID, input, len);
+    return 0;
 }
 
-int bl_sha_finish(bl_sha_ctx_t *ctx, uint8_t *hash)
+static int _sha_hw_process(bl_sha_ctx_t *ctx, const uint8_t *input, uint32_t nblk)
 {
-    return Sec_Eng_SHA256_Finish((SEC_Eng_SHA256_Ctx *)&ctx->sha_ctx, BL_SHA_ID, hash);
+    uint32_t bounce[SHA_HW_BOUNCE_SIZE / 4];
+    uint32_t chunk;
+    int ret = 0;
+
+    /* before bl_sec_init, or a short run while another stream has the engine */
+    if (NULL == g_bl_sec_sha_mutex ||
+            pdPASS != xSemaphoreTakeRecursive(g_bl_sec_sha_mutex, (nblk < BL_SHA_HW_MIN_BLOCKS) ? 0 : portMAX_DELAY)) {
+        return bl_sha_backend_sw.process(ctx, input, nblk);
+    }
+
+    Sec_Eng_SHA_Enable_Link(BL_SHA_ID);
+    while (nblk) {
+        if (0 == ((uint32_t)input & 0x03)) {
+            chunk = (nblk > SHA_HW_LINK_MAX_BLOCKS) ? SHA_HW_LINK_MAX_BLOCKS : nblk;
+            ret = _sha_hw_run(&(ctx->link), input, chunk);
+        } else {
+            chunk = (nblk > SHA_HW_BOUNCE_SIZE / 64) ? SHA_HW_BOUNCE_SIZE / 64 : nblk;
+            memcpy(bounce, input, chunk * 64);
+            ret = _sha_hw_run(&(ctx->link), (uint8_t*)bounce, chunk);
+        }
+        if (ret) {
+            blog_error("sha engine timeout\r\n");
+            break;
+        }
+        input += chunk * 64;
+        nblk -= chunk;
+    }
+    Sec_Eng_SHA_Disable_Link(BL_SHA_ID);
+    xSemaphoreGiveRecursive(g_bl_sec_sha_mutex);
+
+    return ret;
 }
 
+const bl_sha_backend_t bl_sha_backend_hw = {
+    .name = "sec_eng",
+    .process = _sha_hw_process,
+};
+
 static const uint8_t shaSrcBuf1[64] =
 {
     '1', '1', '1', '1', '1', '1', '1', '1', '1', '1', '1', '1', '1', '1', '1', '1',
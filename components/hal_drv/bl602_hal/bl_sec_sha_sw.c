@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Software reference backend for bl_sha API.
+ *
+ * Plain SHA-1 and SHA-224/256 block functions on the state layout SEC_ENG
+ * link mode uses, big endian words in link.result and link.shaHashSel set
+ * once the state is no longer the IV. It has no dependency on SEC_ENG, so
+ * it's used for cross checking the hardware backend and on a host, and the
+ * hardware backend hands it short runs while the engine is busy.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "bl_sec.h"
+
+#define SHA_GET_UINT32_BE(b, i)             \
+    (((uint32_t)(b)[(i)] << 24)             \
+    | ((uint32_t)(b)[(i) + 1] << 16)        \
+    | ((uint32_t)(b)[(i) + 2] << 8)         \
+    | ((uint32_t)(b)[(i) + 3]))
+
+#define SHA_PUT_UINT32_BE(n, b, i)          \
+do {                                        \
+    (b)[(i)] = (uint8_t)((n) >> 24);        \
+    (b)[(i) + 1] = (uint8_t)((n) >> 16);    \
+    (b)[(i) + 2] = (uint8_t)((n) >> 8);     \
+    (b)[(i) + 3] = (uint8_t)(n);            \
+} while (0)
+
+#define SHA_ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define SHA_ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static const uint32_t sha256_iv[8] =
+{
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t sha224_iv[8] =
+{
+    0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939, 0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4,
+};
+
+static const uint32_t sha1_iv[5] =
+{
+    0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0,
+};
+
+static const uint32_t sha256_k[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void _sha256_block(uint32_t s[8], const uint8_t *p)
+{
+    uint32_t w[16];
+    uint32_t a, b, c, d, e, f, g, h, t1, t2;
+    int i;
+
+    a = s[0]; b = s[1]; c = s[2]; d = s[3];
+    e = s[4]; f = s[5]; g = s[6]; h = s[7];
+
+    /* message schedule kept as a 16 word window */
+    for (i = 0; i < 64; i++) {
+        if (i < 16) {
+            w[i] = SHA_GET_UINT32_BE(p, i * 4);
+        } else {
+            t1 = w[(i - 2) & 15];
+            t2 = w[(i - 15) & 15];
+            w[i & 15] += (SHA_ROR(t1, 17) ^ SHA_ROR(t1, 19) ^ (t1 >> 10)) + w[(i - 7) & 15] +
+                (SHA_ROR(t2, 7) ^ SHA_ROR(t2, 18) ^ (t2 >> 3));
+        }
+        t1 = h + (SHA_ROR(e, 6) ^ SHA_ROR(e, 11) ^ SHA_ROR(e, 25)) + (g ^ (e & (f ^ g))) + sha256_k[i] + w[i & 15];
+        t2 = (SHA_ROR(a, 2) ^ SHA_ROR(a, 13) ^ SHA_ROR(a, 22)) + ((a & b) | (c & (a | b)));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    s[0] += a; s[1] += b; s[2] += c; s[3] += d;
+    s[4] += e; s[5] += f; s[6] += g; s[7] += h;
+}
+
+static void _sha1_block(uint32_t s[5], const uint8_t *p)
+{
+    uint32_t w[16];
+    uint32_t a, b, c, d, e, t;
+    int i;
+
+    a = s[0]; b = s[1]; c = s[2]; d = s[3]; e = s[4];
+
+    for (i = 0; i < 80; i++) {
+        if (i < 16) {
+            w[i] = SHA_GET_UINT32_BE(p, i * 4);
+        } else {
+            t = w[(i - 3) & 15] ^ w[(i - 8) & 15] ^ w[(i - 14) & 15] ^ w[i & 15];
+            w[i & 15] = SHA_ROL(t, 1);
+        }
+        if (i < 20) {
+            t = (d ^ (b & (c ^ d))) + 0x5a827999;
+        } else if (i < 40) {
+            t = (b ^ c ^ d) + 0x6ed9eba1;
+        } else if (i < 60) {
+            t = ((b & c) | (d & (b | c))) + 0x8f1bbcdc;
+        } else {
+            t = (b ^ c ^ d) + 0xca62c1d6;
+        }
+        t += SHA_ROL(a, 5) + e + w[i & 15];
+        e = d; d = c; c = SHA_ROL(b, 30); b = a; a = t;
+    }
+
+    s[0] += a; s[1] += b; s[2] += c; s[3] += d; s[4] += e;
+}
+
+static int _sha_sw_process(bl_sha_ctx_t *ctx, const uint8_t *input, uint32_t nblk)
+{
+    uint8_t *result = (uint8_t*)ctx->link.result;
+    uint32_t s[8];
+    int i, words;
+
+    switch (ctx->link.shaMode) {
+        case BL_SHA256:
+        case BL_SHA224:
+        {
+            words = 8;
+        }
+        break;
+        case BL_SHA1:
+        {
+            words = 5;
+        }
+        break;
+        default:
+        {
+            return -1;
+        }
+    }
+
+    if (ctx->link.shaHashSel) {
+        for (i = 0; i < words; i++) {
+            s[i] = SHA_GET_UINT32_BE(result, i * 4);
+        }
+    } else if (BL_SHA256 == ctx->link.shaMode) {
+        memcpy(s, sha256_iv, sizeof(sha256_iv));
+    } else if (BL_SHA224 == ctx->link.shaMode) {
+        memcpy(s, sha224_iv, sizeof(sha224_iv));
+    } else {
+        memcpy(s, sha1_iv, sizeof(sha1_iv));
+    }
+
+    while (nblk--) {
+        if (5 == words) {
+            _sha1_block(s, input);
+        } else {
+            _sha256_block(s, input);
+        }
+        input += 64;
+    }
+
+    for (i = 0; i < words; i++) {
+        SHA_PUT_UINT32_BE(s[i], result, i * 4);
+    }
+    ctx->link.shaHashSel = 1;
+
+    return 0;
+}
+
+const bl_sha_backend_t bl_sha_backend_sw = {
+    .name = "software",
+    .process = _sha_sw_process,
+};
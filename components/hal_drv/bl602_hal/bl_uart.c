@@ -27,11 +27,14 @@
  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include <string.h>
 #include <bl602_uart.h>
 #include <bl602_glb.h>
+#include <bl602_dma.h>
 
 #include "bl_uart.h"
 #include "bl_irq.h"
+#include "bl_dma.h"
 
 #ifdef BL602_USE_HAL_DRIVER
 void UART0_IRQHandler(void);
@@ -54,6 +57,23 @@ typedef struct bl_uart_notify {
 
 static bl_uart_notify_t g_uart_notify_arg[UART_NUMBER_SUPPORTED];
 
+#define DMA_Get_Channel(ch)     (DMA_BASE + 0x100 + (ch) * 0x100)
+#define UART_DMA_SIZE_MAX       (4095) /* 12 bits TransferSize */
+
+typedef struct bl_uart_dma {
+    uint8_t           tx_ch;
+    uint8_t           rx_ch;
+    uint8_t          *rx_buf;
+    /*LLI must stay alive while the channel runs, rx ring is rx_lli[0] <-> rx_lli[1]*/
+    DMA_LLI_Ctrl_Type tx_lli;
+    DMA_LLI_Ctrl_Type rx_lli[2];
+} bl_uart_dma_t;
+
+static bl_uart_dma_t g_uart_dma[UART_NUMBER_SUPPORTED] = {
+    {.tx_ch = BL_UART_DMA_CH_NONE, .rx_ch = BL_UART_DMA_CH_NONE},
+    {.tx_ch = BL_UART_DMA_CH_NONE, .rx_ch = BL_UART_DMA_CH_NONE},
+};
+
 static void gpio_init(uint8_t id, uint8_t tx_pin, uint8_t rx_pin, [[gnu::unused]] uint8_t cts_pin, [[gnu::unused]] uint8_t rts_pin)
 {
     GLB_GPIO_Cfg_Type cfg;
@@ -363,6 +383,216 @@ int bl_uart_int_tx_notify_unregister(uint8_t id, [[gnu::unused]] cb_uart_notify_
     return 0;
 }
 
+int bl_uart_tx_fifo_avail(uint8_t id)
+{
+    return UART_GetTxFifoCount(id);
+}
+
+static void uart_dma_notify(uint8_t id, int tx)
+{
+    cb_uart_notify_t cb;
+    void *arg;
+
+    if (tx) {
+        bl_dma_int_clear(g_uart_dma[id].tx_ch);
+        cb = g_uart_notify_arg[id].tx_cb;
+        arg = g_uart_notify_arg[id].tx_cb_arg;
+    } else {
+        bl_dma_int_clear(g_uart_dma[id].rx_ch);
+        cb = g_uart_notify_arg[id].rx_cb;
+        arg = g_uart_notify_arg[id].rx_cb_arg;
+    }
+
+    if (cb) {
+        /*notify up layer*/
+        cb(arg);
+    }
+}
+
+/*bl_dma handlers carry no argument, so keep one per UART and direction*/
+static void uart0_dma_tx_handler(void)
+{
+    uart_dma_notify(0, 1);
+}
+
+static void uart0_dma_rx_handler(void)
+{
+    uart_dma_notify(0, 0);
+}
+
+static void uart1_dma_tx_handler(void)
+{
+    uart_dma_notify(1, 1);
+}
+
+static void uart1_dma_rx_handler(void)
+{
+    uart_dma_notify(1, 0);
+}
+
+static void uart_dma_ctrl_set(struct DMA_Control_Reg *ctrl, uint32_t len, int tx)
+{
+    memset(ctrl, 0, sizeof(*ctrl));
+    ctrl->TransferSize = len;
+    ctrl->SBSize = DMA_BURST_SIZE_1;
+    ctrl->DBSize = DMA_BURST_SIZE_1;
+    ctrl->SWidth = DMA_TRNS_WIDTH_8BITS;
+    ctrl->DWidth = DMA_TRNS_WIDTH_8BITS;
+    ctrl->SI = tx ? DMA_MINC_ENABLE : DMA_MINC_DISABLE;
+    ctrl->DI = tx ? DMA_MINC_DISABLE : DMA_MINC_ENABLE;
+    ctrl->I = 1;
+}
+
+int bl_uart_dma_init(uint8_t id, uint8_t tx_ch, uint8_t rx_ch, void *rx_buf, uint32_t rx_size)
+{
+    bl_uart_dma_t *dma;
+    uint32_t UARTx, half, i;
+    DMA_LLI_Cfg_Type txcfg = {DMA_TRNS_M2P, DMA_REQ_NONE, DMA_REQ_UART0_TX};
+    DMA_LLI_Cfg_Type rxcfg = {DMA_TRNS_P2M, DMA_REQ_UART0_RX, DMA_REQ_NONE};
+    UART_FifoCfg_Type fifoCfg =
+    {
+        .txFifoDmaThreshold     = 0x10,
+        .rxFifoDmaThreshold     = 0x01, /* every received byte goes to DMA */
+        .txFifoDmaEnable        = DISABLE,
+        .rxFifoDmaEnable        = DISABLE,
+    };
+    static void (* const handlers[UART_NUMBER_SUPPORTED][2])(void) = {
+        {uart0_dma_tx_handler, uart0_dma_rx_handler},
+        {uart1_dma_tx_handler, uart1_dma_rx_handler},
+    };
+
+    if (!(id < UART_NUMBER_SUPPORTED)) {
+        return -1;
+    }
+    half = rx_size / 2;
+    if (rx_ch != BL_UART_DMA_CH_NONE && (rx_buf == NULL || half == 0 || half > UART_DMA_SIZE_MAX)) {
+        return -1;
+    }
+
+    dma = &g_uart_dma[id];
+    dma->tx_ch = tx_ch;
+    dma->rx_ch = rx_ch;
+    dma->rx_buf = rx_buf;
+    UARTx = uartAddr[id];
+
+    if (tx_ch != BL_UART_DMA_CH_NONE) {
+        /*TX FIFO refill comes from DMA now*/
+        UART_IntMask(id, UART_INT_TX_FIFO_REQ, MASK);
+        txcfg.dstPeriph = (DMA_Periph_Req_Type)(DMA_REQ_UART0_TX + 2 * id);
+        DMA_Channel_Disable(tx_ch);
+        bl_dma_int_clear(tx_ch);
+        DMA_IntMask(tx_ch, DMA_INT_ALL, MASK);
+        DMA_IntMask(tx_ch, DMA_INT_TCOMPLETED, UNMASK);
+        DMA_LLI_Init(tx_ch, &txcfg);
+        bl_dma_irq_register(tx_ch, handlers[id][0], NULL, NULL);
+        fifoCfg.txFifoDmaEnable = ENABLE;
+    }
+
+    if (rx_ch != BL_UART_DMA_CH_NONE) {
+        /*Keep RTO for idle line detection, FIFO level interrupt is DMA's job*/
+        UART_IntMask(id, UART_INT_RX_FIFO_REQ, MASK);
+        UART_IntMask(id, UART_INT_RX_END, MASK);
+        rxcfg.srcPeriph = (DMA_Periph_Req_Type)(DMA_REQ_UART0_RX + 2 * id);
+        for (i = 0; i < 2; i++) {
+            dma->rx_lli[i].srcDmaAddr = UARTx + UART_FIFO_RDATA_OFFSET;
+            dma->rx_lli[i].destDmaAddr = (uint32_t)dma->rx_buf + i * half;
+            dma->rx_lli[i].nextLLI = (uint32_t)&dma->rx_lli[i ^ 1];
+            uart_dma_ctrl_set(&dma->rx_lli[i].dmaCtrl, half, 0);
+        }
+        DMA_Channel_Disable(rx_ch);
+        bl_dma_int_clear(rx_ch);
+        DMA_IntMask(rx_ch, DMA_INT_ALL, MASK);
+        DMA_IntMask(rx_ch, DMA_INT_TCOMPLETED, UNMASK);
+        DMA_LLI_Init(rx_ch, &rxcfg);
+        DMA_LLI_Update(rx_ch, (uint32_t)&dma->rx_lli[0]);
+        bl_dma_irq_register(rx_ch, handlers[id][1], NULL, NULL);
+        fifoCfg.rxFifoDmaEnable = ENABLE;
+    }
+
+    UART_FifoConfig(id, &fifoCfg);
+
+    if (rx_ch != BL_UART_DMA_CH_NONE) {
+        DMA_Channel_Enable(rx_ch);
+    }
+
+    return 0;
+}
+
+int bl_uart_dma_deinit(uint8_t id)
+{
+    bl_uart_dma_t *dma;
+    UART_FifoCfg_Type fifoCfg =
+    {
+        .txFifoDmaThreshold     = 0x10,
+        .rxFifoDmaThreshold     = 0x10,
+        .txFifoDmaEnable        = DISABLE,
+        .rxFifoDmaEnable        = DISABLE,
+    };
+
+    if (!(id < UART_NUMBER_SUPPORTED)) {
+        return -1;
+    }
+
+    dma = &g_uart_dma[id];
+    UART_FifoConfig(id, &fifoCfg);
+    if (dma->tx_ch != BL_UART_DMA_CH_NONE) {
+        DMA_Channel_Disable(dma->tx_ch);
+        bl_dma_int_clear(dma->tx_ch);
+        bl_dma_irq_unregister(dma->tx_ch);
+        dma->tx_ch = BL_UART_DMA_CH_NONE;
+    }
+    if (dma->rx_ch != BL_UART_DMA_CH_NONE) {
+        DMA_Channel_Disable(dma->rx_ch);
+        bl_dma_int_clear(dma->rx_ch);
+        bl_dma_irq_unregister(dma->rx_ch);
+        dma->rx_ch = BL_UART_DMA_CH_NONE;
+    }
+    dma->rx_buf = NULL;
+
+    return 0;
+}
+
+/*This function is NOT thread safe, caller waits for TX done notify before next call*/
+int bl_uart_dma_send(uint8_t id, const void *data, uint32_t len)
+{
+    bl_uart_dma_t *dma;
+
+    if (!(id < UART_NUMBER_SUPPORTED) || len == 0 || len > UART_DMA_SIZE_MAX) {
+        return -1;
+    }
+    dma = &g_uart_dma[id];
+    if (dma->tx_ch == BL_UART_DMA_CH_NONE) {
+        return -1;
+    }
+
+    dma->tx_lli.srcDmaAddr = (uint32_t)data;
+    dma->tx_lli.destDmaAddr = uartAddr[id] + UART_FIFO_WDATA_OFFSET;
+    dma->tx_lli.nextLLI = 0;
+    uart_dma_ctrl_set(&dma->tx_lli.dmaCtrl, len, 1);
+
+    DMA_Channel_Disable(dma->tx_ch);
+    DMA_LLI_Update(dma->tx_ch, (uint32_t)&dma->tx_lli);
+    DMA_Channel_Enable(dma->tx_ch);
+
+    return 0;
+}
+
+uint32_t bl_uart_dma_rx_pos(uint8_t id)
+{
+    bl_uart_dma_t *dma;
+
+    if (!(id < UART_NUMBER_SUPPORTED)) {
+        return 0;
+    }
+    dma = &g_uart_dma[id];
+    if (dma->rx_ch == BL_UART_DMA_CH_NONE) {
+        return 0;
+    }
+
+    /*destination address register advances with each byte written*/
+    return BL_RD_REG(DMA_Get_Channel(dma->rx_ch), DMA_DSTADDR) - (uint32_t)dma->rx_buf;
+}
+
 static inline void uart_generic_notify_handler(uint8_t id)
 {
     cb_uart_notify_t cb;
@@ -33,6 +33,8 @@
 #include <bl602_uart.h>
 #define BL_UART_BUFFER_SIZE_MIN   (128)
 #define BL_UART_BUFFER_SIZE_MASK  (128 - 1)
+#define BL_UART_FIFO_DEPTH        (32)
+#define BL_UART_DMA_CH_NONE       (0xFF)
 typedef void (*cb_uart_notify_t)(void *arg);
 int bl_uart_init(uint8_t id, uint8_t tx_pin, uint8_t rx_pin, uint8_t cts_pin, uint8_t rts_pin, uint32_t baudrate);
 int bl_uart_int_rx_enable(uint8_t id);
@@ -45,6 +47,11 @@ void bl_uart_setconfig(uint8_t id, uint32_t baudrate, UART_Parity_Type parity);
 void bl_uart_setbaud(uint8_t id, uint32_t baud);
 int bl_uart_data_send(uint8_t id, uint8_t data);
 int bl_uart_data_recv(uint8_t id);
+int bl_uart_tx_fifo_avail(uint8_t id);
+int bl_uart_dma_init(uint8_t id, uint8_t tx_ch, uint8_t rx_ch, void *rx_buf, uint32_t rx_size);
+int bl_uart_dma_deinit(uint8_t id);
+int bl_uart_dma_send(uint8_t id, const void *data, uint32_t len);
+uint32_t bl_uart_dma_rx_pos(uint8_t id);
 int bl_uart_int_enable(uint8_t id);
 int bl_uart_int_disable(uint8_t id);
 int bl_uart_int_rx_notify_register(uint8_t id, cb_uart_notify_t cb, void *arg);
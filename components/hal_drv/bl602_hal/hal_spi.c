@@ -44,10 +44,14 @@
 #include <bl_irq.h>
 #include <bl_dma.h>
 
+#include "hal_spi.h"
+#include "hal_spi_lli.h"
+
 #include <FreeRTOS.h>
 #include <task.h>
 #include <timers.h>
 #include <event_groups.h>
+#include <semphr.h>
 
 #include <libfdt.h>
 #include <utils_log.h>
@@ -57,11 +61,15 @@
 #define HAL_SPI_HARDCS      (1)
 
 #define SPI_NUM_MAX         1 /* only support spi0 */
-#define LLI_BUFF_SIZE       2048
+
+#ifndef HAL_SPI_LLI_POOL_NUM
+#define HAL_SPI_LLI_POOL_NUM    16 /* descriptor pairs per port, HAL_SPI_LLI_SIZE bytes each */
+#endif
 
 #define EVT_GROUP_SPI_DMA_TX    (1<<0)
 #define EVT_GROUP_SPI_DMA_RX    (1<<1)
 #define EVT_GROUP_SPI_DMA_TR    (EVT_GROUP_SPI_DMA_TX | EVT_GROUP_SPI_DMA_RX)
+#define EVT_GROUP_SPI_DMA_FREE  (1<<2) /* a request completed and gave back its descriptors */
 
 typedef struct _spi_hw {
     uint8_t used;
@@ -76,6 +84,12 @@ typedef struct _spi_hw {
     uint8_t pin_mosi;
     uint8_t pin_miso;
     EventGroupHandle_t spi_dma_event_group;
+    SemaphoreHandle_t submit_mutex; /* descriptors are queued in the order they are handed out */
+    StaticSemaphore_t submit_mutex_buf;
+    hal_spi_lli_pool_t lli_pool;
+    hal_spi_queue_t queue;
+    DMA_LLI_Ctrl_Type lli_tx[HAL_SPI_LLI_POOL_NUM];
+    DMA_LLI_Ctrl_Type lli_rx[HAL_SPI_LLI_POOL_NUM];
 } spi_hw_t;
 
 typedef struct spi_priv_data {
@@ -112,85 +126,6 @@ static void hal_gpio_init(spi_hw_t *arg)
     return;
 }
 
-static int lli_list_init(DMA_LLI_Ctrl_Type **pptxlli, DMA_LLI_Ctrl_Type **pprxlli, uint8_t *ptx_data, uint8_t *prx_data, uint32_t length)
-{
-    uint32_t i = 0;
-    uint32_t count;
-    uint32_t remainder;
-    struct DMA_Control_Reg dmactrl;
-
-
-    count = length / LLI_BUFF_SIZE;
-    remainder = length % LLI_BUFF_SIZE;
-
-    if (remainder != 0) {
-        count = count + 1;
-    }
-
-    dmactrl.SBSize = DMA_BURST_SIZE_1;
-    dmactrl.DBSize = DMA_BURST_SIZE_1;
-    dmactrl.SWidth = DMA_TRNS_WIDTH_8BITS;
-    dmactrl.DWidth = DMA_TRNS_WIDTH_8BITS;
-    dmactrl.Prot = 0;
-    dmactrl.SLargerD = 0;
-
-    *pptxlli = pvPortMalloc(sizeof(DMA_LLI_Ctrl_Type) * count);
-    if (*pptxlli == NULL) {
-        blog_error("malloc lli failed. \r\n");
-
-        return -1;
-    }
-
-    *pprxlli = pvPortMalloc(sizeof(DMA_LLI_Ctrl_Type) * count);
-    if (*pprxlli == NULL) {
-        blog_error("malloc lli failed.");
-        vPortFree(*pptxlli);
-
-        return -1;
-    }
-
-    for (i = 0; i < count; i++) {
-        if (remainder == 0) {
-            dmactrl.TransferSize = LLI_BUFF_SIZE;
-        } else {
-            if (i == count - 1) {
-                dmactrl.TransferSize = remainder;
-            } else {
-                dmactrl.TransferSize = LLI_BUFF_SIZE;
-            }
-        }
-
-        dmactrl.SI = DMA_MINC_ENABLE;
-        dmactrl.DI = DMA_MINC_DISABLE;
-
-        if (i == count - 1) {
-            dmactrl.I = 1;
-        } else {
-            dmactrl.I = 0;
-        }
-
-        (*pptxlli)[i].srcDmaAddr = (uint32_t)(ptx_data + i * LLI_BUFF_SIZE);
-        (*pptxlli)[i].destDmaAddr = (uint32_t)(SPI_BASE+SPI_FIFO_WDATA_OFFSET);
-        (*pptxlli)[i].dmaCtrl = dmactrl;
-
-        dmactrl.SI = DMA_MINC_DISABLE;
-        dmactrl.DI = DMA_MINC_ENABLE;
-        (*pprxlli)[i].srcDmaAddr = (uint32_t)(SPI_BASE+SPI_FIFO_RDATA_OFFSET);
-        (*pprxlli)[i].destDmaAddr = (uint32_t)(prx_data + i * LLI_BUFF_SIZE);
-        (*pprxlli)[i].dmaCtrl = dmactrl;
-
-        if (i != 0) {
-            (*pptxlli)[i-1].nextLLI = (uint32_t)&(*pptxlli)[i];
-            (*pprxlli)[i-1].nextLLI = (uint32_t)&(*pprxlli)[i];
-        }
-
-        (*pptxlli)[i].nextLLI = 0;
-        (*pprxlli)[i].nextLLI = 0;
-    }
-
-    return 0;
-}
-
 static void hal_spi_dma_init(spi_hw_t *arg)
 {
     spi_hw_t *hw_arg = arg;
@@ -199,6 +134,8 @@ static void hal_spi_dma_init(spi_hw_t *arg)
     SPI_FifoCfg_Type fifocfg;
     SPI_ID_Type spi_id;
     uint8_t clk_div;
+    DMA_LLI_Cfg_Type txllicfg = {DMA_TRNS_M2P, DMA_REQ_NONE, DMA_REQ_SPI_TX};
+    DMA_LLI_Cfg_Type rxllicfg = {DMA_TRNS_P2M, DMA_REQ_SPI_RX, DMA_REQ_NONE};
 
     spi_id = hw_arg->ssp_id;
 
@@ -258,7 +195,6 @@ static void hal_spi_dma_init(spi_hw_t *arg)
     fifocfg.rxFifoDmaEnable = ENABLE;
     SPI_FifoConfig(spi_id,&fifocfg);
 
-    DMA_Disable();
     DMA_IntMask(hw_arg->tx_dma_ch, DMA_INT_ALL, MASK);
     DMA_IntMask(hw_arg->tx_dma_ch, DMA_INT_TCOMPLETED, UNMASK);
     DMA_IntMask(hw_arg->tx_dma_ch, DMA_INT_ERR, UNMASK);
@@ -267,6 +203,11 @@ static void hal_spi_dma_init(spi_hw_t *arg)
     DMA_IntMask(hw_arg->rx_dma_ch, DMA_INT_TCOMPLETED, UNMASK);
     DMA_IntMask(hw_arg->rx_dma_ch, DMA_INT_ERR, UNMASK);
 
+    /* channel direction and request lines never change, set them once */
+    DMA_LLI_Init(hw_arg->tx_dma_ch, &txllicfg);
+    DMA_LLI_Init(hw_arg->rx_dma_ch, &rxllicfg);
+    DMA_Enable();
+
     bl_irq_enable(DMA_ALL_IRQn);
     bl_dma_irq_register(hw_arg->tx_dma_ch, bl_spi0_dma_int_handler_tx, NULL, NULL);
     bl_dma_irq_register(hw_arg->rx_dma_ch, bl_spi0_dma_int_handler_rx, NULL, NULL);
@@ -274,36 +215,13 @@ static void hal_spi_dma_init(spi_hw_t *arg)
     return;
 }
 
-static void hal_spi_dma_trans(spi_hw_t *arg, uint8_t *TxData, uint8_t *RxData, uint32_t Len)
+/* called with the queue locked, or from the DMA ISR */
+static void hal_spi_dma_start(spi_hw_t *arg, hal_spi_req_t *req)
 {
-    EventBits_t uxBits;
-    DMA_LLI_Cfg_Type txllicfg;
-    DMA_LLI_Cfg_Type rxllicfg;
-    DMA_LLI_Ctrl_Type *ptxlli;
-    DMA_LLI_Ctrl_Type *prxlli;
-    int ret;
-
-    if (!arg) {
-        blog_error("arg err.\r\n");
-        return;
-    }
-
-    txllicfg.dir = DMA_TRNS_M2P;
-    txllicfg.srcPeriph = DMA_REQ_NONE;
-    txllicfg.dstPeriph = DMA_REQ_SPI_TX;
-
-    rxllicfg.dir = DMA_TRNS_P2M;
-    rxllicfg.srcPeriph = DMA_REQ_SPI_RX;
-    rxllicfg.dstPeriph = DMA_REQ_NONE;
-
-
-    xEventGroupClearBits(arg->spi_dma_event_group, EVT_GROUP_SPI_DMA_TR);
-
     DMA_Channel_Disable(arg->tx_dma_ch);
     DMA_Channel_Disable(arg->rx_dma_ch);
     bl_dma_int_clear(arg->tx_dma_ch);
     bl_dma_int_clear(arg->rx_dma_ch);
-    DMA_Enable();
 
     if (arg->mode == 0) {
         SPI_Enable(arg->ssp_id, SPI_WORK_MODE_MASTER);
@@ -311,32 +229,101 @@ static void hal_spi_dma_trans(spi_hw_t *arg, uint8_t *TxData, uint8_t *RxData, u
         SPI_Enable(arg->ssp_id, SPI_WORK_MODE_SLAVE);
     }
 
-    ret = lli_list_init(&ptxlli, &prxlli, TxData, RxData, Len);
-    if (ret < 0) {
-        blog_error("init lli failed. \r\n");
+    DMA_LLI_Update(arg->tx_dma_ch, (uint32_t)&arg->lli_pool.tx[req->lli_first]);
+    DMA_LLI_Update(arg->rx_dma_ch, (uint32_t)&arg->lli_pool.rx[req->lli_first]);
+    DMA_Channel_Enable(arg->rx_dma_ch);
+    DMA_Channel_Enable(arg->tx_dma_ch);
+}
 
-        return;
+static int hal_spi_dma_submit(spi_hw_t *arg, hal_spi_req_t *req)
+{
+    int count, first, idle;
+
+    count = hal_spi_lli_count(req->xfer, req->num);
+    if (count < 0 || count > HAL_SPI_LLI_POOL_NUM) {
+        return -EINVAL;
     }
 
-    DMA_LLI_Init(arg->tx_dma_ch, &txllicfg);
-    DMA_LLI_Init(arg->rx_dma_ch, &rxllicfg);
-    DMA_LLI_Update(arg->tx_dma_ch,(uint32_t)ptxlli);
-    DMA_LLI_Update(arg->rx_dma_ch,(uint32_t)prxlli);
-    DMA_Channel_Enable(arg->tx_dma_ch);
-    DMA_Channel_Enable(arg->rx_dma_ch);
+    /*
+     * The ISR gives descriptors back by count in queue order, so the request
+     * must be queued before anyone else takes descriptors after it.
+     */
+    xSemaphoreTake(arg->submit_mutex, portMAX_DELAY);
+
+    /* the ISR only gives back descriptors of finished requests */
+    taskENTER_CRITICAL();
+    first = hal_spi_lli_alloc(&arg->lli_pool, count);
+    taskEXIT_CRITICAL();
+    if (first < 0) {
+        xSemaphoreGive(arg->submit_mutex);
+        return -EBUSY;
+    }
 
-    uxBits = xEventGroupWaitBits(arg->spi_dma_event_group,
-                                     EVT_GROUP_SPI_DMA_TR,
-                                     pdTRUE,
-                                     pdTRUE,
-                                     portMAX_DELAY);
+    req->lli_first = first;
+    req->lli_num = count;
+    hal_spi_lli_build(&arg->lli_pool, req, SPI_BASE + SPI_FIFO_WDATA_OFFSET,
+                      SPI_BASE + SPI_FIFO_RDATA_OFFSET);
 
-    if ((uxBits & EVT_GROUP_SPI_DMA_TR) == EVT_GROUP_SPI_DMA_TR) {
-        blog_info("recv all event group.\r\n");
+    taskENTER_CRITICAL();
+    idle = hal_spi_req_push(&arg->queue, req);
+    if (idle) {
+        hal_spi_dma_start(arg, req);
     }
+    taskEXIT_CRITICAL();
+
+    xSemaphoreGive(arg->submit_mutex);
 
-    vPortFree(ptxlli);
-    vPortFree(prxlli);
+    return 0;
+}
+
+static void hal_spi_dma_trans_done([[gnu::unused]] hal_spi_req_t *req, void *arg)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    if (xEventGroupSetBitsFromISR((EventGroupHandle_t)arg, EVT_GROUP_SPI_DMA_TR,
+                                  &xHigherPriorityTaskWoken) != pdFAIL) {
+        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    }
+}
+
+/* blocking transfer of one request worth of segments */
+static int hal_spi_dma_trans(spi_hw_t *arg, const spi_ioc_transfer_t *xfer, uint8_t num)
+{
+    hal_spi_req_t req;
+    int ret;
+
+    if (!arg) {
+        blog_error("arg err.\r\n");
+        return -EINVAL;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.xfer = xfer;
+    req.num = num;
+    req.cb = hal_spi_dma_trans_done;
+    req.arg = arg->spi_dma_event_group;
+
+    xEventGroupClearBits(arg->spi_dma_event_group, EVT_GROUP_SPI_DMA_TR | EVT_GROUP_SPI_DMA_FREE);
+
+    /* pool may be held by queued requests, wait for one of them to complete */
+    while ((ret = hal_spi_dma_submit(arg, &req)) == -EBUSY) {
+        xEventGroupWaitBits(arg->spi_dma_event_group,
+                            EVT_GROUP_SPI_DMA_FREE,
+                            pdTRUE,
+                            pdTRUE,
+                            portMAX_DELAY);
+    }
+    if (ret < 0) {
+        return ret;
+    }
+
+    xEventGroupWaitBits(arg->spi_dma_event_group,
+                        EVT_GROUP_SPI_DMA_TR,
+                        pdTRUE,
+                        pdTRUE,
+                        portMAX_DELAY);
+
+    return 0;
 }
 
 int32_t hal_spi_init(spi_dev_t *spi)
@@ -464,7 +451,11 @@ int hal_spi_transfer(spi_dev_t *spi_dev, void *xfer, uint8_t size)
 {
     uint16_t i;
     spi_ioc_transfer_t * s_xfer;
+    spi_ioc_transfer_t seg;
     spi_priv_data_t *priv_data;
+    spi_hw_t *hw_arg;
+    uint32_t off;
+    int count, ret = 0;
 
     if ((!spi_dev) || (!xfer)) {
         blog_error("arg err.\r\n");
@@ -486,18 +477,50 @@ int hal_spi_transfer(spi_dev_t *spi_dev, void *xfer, uint8_t size)
 #if (0 == HAL_SPI_HARDCS)
     bl_gpio_output_set(priv_data->hwspi[spi_dev->port].pin_cs, 0);
 #endif
-    for (i = 0; i < size; i++) {
+    hw_arg = &priv_data->hwspi[spi_dev->port];
+    count = hal_spi_lli_count(s_xfer, size);
+    if (count > 0 && count <= HAL_SPI_LLI_POOL_NUM) {
+        /* all segments in one DMA run */
+        ret = hal_spi_dma_trans(hw_arg, s_xfer, size);
+    } else {
+        /* too long for the pool, go through it a pool at a time */
+        for (i = 0; i < size && ret == 0; i++) {
 #if (HAL_SPI_DEBUG)
-        blog_info("transfer xfer[%d].len = %ld\r\n", i, s_xfer[i].len);
+            blog_info("transfer xfer[%d].len = %ld\r\n", i, s_xfer[i].len);
 #endif
-        hal_spi_dma_trans(&priv_data->hwspi[spi_dev->port],
-                (uint8_t *)s_xfer[i].tx_buf, (uint8_t *)s_xfer[i].rx_buf, s_xfer[i].len);
+            seg = s_xfer[i];
+            for (off = 0; off < s_xfer[i].len && ret == 0; off += seg.len) {
+                seg.len = s_xfer[i].len - off;
+                if (seg.len > HAL_SPI_LLI_POOL_NUM * HAL_SPI_LLI_SIZE) {
+                    seg.len = HAL_SPI_LLI_POOL_NUM * HAL_SPI_LLI_SIZE;
+                }
+                seg.tx_buf = s_xfer[i].tx_buf ? s_xfer[i].tx_buf + off : 0;
+                seg.rx_buf = s_xfer[i].rx_buf ? s_xfer[i].rx_buf + off : 0;
+                ret = hal_spi_dma_trans(hw_arg, &seg, 1);
+            }
+        }
     }
 #if (0 == HAL_SPI_HARDCS)
     bl_gpio_output_set(priv_data->hwspi[spi_dev->port].pin_cs, 1);
 #endif
 
-    return 0;
+    return ret;
+}
+
+int hal_spi_transfer_submit(spi_dev_t *spi_dev, hal_spi_req_t *req)
+{
+    spi_priv_data_t *priv_data;
+
+    if ((!spi_dev) || (!req) || (!req->xfer)) {
+        return -EINVAL;
+    }
+
+    priv_data = (spi_priv_data_t *)spi_dev->priv;
+    if (priv_data == NULL) {
+        return -EINVAL;
+    }
+
+    return hal_spi_dma_submit(&priv_data->hwspi[spi_dev->port], req);
 }
 
 int vfs_spi_init_fullname(const char *fullname, uint8_t port,
@@ -553,6 +576,10 @@ int vfs_spi_init_fullname(const char *fullname, uint8_t port,
     g_hal_buf->hwspi[port].pin_cs = pin_cs;
     g_hal_buf->hwspi[port].pin_mosi = pin_mosi;
     g_hal_buf->hwspi[port].pin_miso = pin_miso;
+    g_hal_buf->hwspi[port].submit_mutex = xSemaphoreCreateMutexStatic(&g_hal_buf->hwspi[port].submit_mutex_buf);
+    hal_spi_lli_pool_init(&g_hal_buf->hwspi[port].lli_pool,
+                          g_hal_buf->hwspi[port].lli_tx, g_hal_buf->hwspi[port].lli_rx,
+                          HAL_SPI_LLI_POOL_NUM);
     spi->priv = g_hal_buf;
 
     blog_info("[HAL] [SPI] Register Under %s for :\r\nport=%d, mode=%d, polar_phase = %d, freq=%ld, tx_dma_ch=%d, rx_dma_ch=%d, pin_clk=%d, pin_cs=%d, pin_mosi=%d, pin_miso=%d\r\n",
@@ -747,21 +774,9 @@ int vfs_spi_fdt_init(uint32_t fdt, uint32_t dtb_spi_offset)
 
 void bl_spi0_dma_int_handler_tx(void)
 {
-    BaseType_t xResult = pdFAIL;
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-
+    /* TX descriptors don't interrupt, completion is tracked on RX */
     if (NULL != g_hal_buf) {
         bl_dma_int_clear(g_hal_buf->hwspi[0].tx_dma_ch);
-
-        if (g_hal_buf->hwspi[0].spi_dma_event_group != NULL) {
-            xResult = xEventGroupSetBitsFromISR(g_hal_buf->hwspi[0].spi_dma_event_group,
-                                                EVT_GROUP_SPI_DMA_TX,
-                                                &xHigherPriorityTaskWoken);
-        }
-
-        if(xResult != pdFAIL) {
-            portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
-        }
     } else {
         blog_error("bl_spi0_dma_int_handler_tx no clear isr.\r\n");
     }
@@ -771,20 +786,29 @@ void bl_spi0_dma_int_handler_tx(void)
 
 void bl_spi0_dma_int_handler_rx(void)
 {
-    BaseType_t xResult = pdFAIL;
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    spi_hw_t *arg;
+    hal_spi_req_t *req;
 
     if (NULL != g_hal_buf) {
-        bl_dma_int_clear(g_hal_buf->hwspi[0].rx_dma_ch);
-
-        if (g_hal_buf->hwspi[0].spi_dma_event_group != NULL) {
-            xResult = xEventGroupSetBitsFromISR(g_hal_buf->hwspi[0].spi_dma_event_group,
-                                                EVT_GROUP_SPI_DMA_RX,
-                                                &xHigherPriorityTaskWoken);
-        }
-
-        if(xResult != pdFAIL) {
-            portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+        arg = &g_hal_buf->hwspi[0];
+        bl_dma_int_clear(arg->rx_dma_ch);
+
+        req = hal_spi_req_pop(&arg->queue);
+        if (req != NULL) {
+            hal_spi_lli_free(&arg->lli_pool, req->lli_num);
+            /* next chain was built at submit time, start it before the callback */
+            if (arg->queue.head != NULL) {
+                hal_spi_dma_start(arg, arg->queue.head);
+            }
+            /* wake the blocking transfers waiting for descriptors */
+            if (xEventGroupSetBitsFromISR(arg->spi_dma_event_group, EVT_GROUP_SPI_DMA_FREE,
+                                          &xHigherPriorityTaskWoken) != pdFAIL) {
+                portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+            }
+            if (req->cb) {
+                req->cb(req, req->arg);
+            }
         }
     } else {
         blog_error("bl_spi0_dma_int_handler_rx no clear isr.\r\n");
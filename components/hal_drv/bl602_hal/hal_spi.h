@@ -30,6 +30,18 @@
 #ifndef __HAL_SPI_H
 #define __HAL_SPI_H
 
+#include <hal/soc/spi.h>
+#include "hal_spi_lli.h"
+
 int vfs_spi_fdt_init(uint32_t fdt, uint32_t dtb_uart_offset);
 
+/*
+ * Queue req for DMA without waiting. Segments of req run back to back in
+ * one descriptor chain and queued requests start from the completion ISR.
+ * req and its segments must stay valid until req->cb is called from ISR.
+ * Returns -EBUSY when the descriptor pool is used up by queued requests.
+ * Task context only, submits to a port are serialized by a mutex.
+ */
+int hal_spi_transfer_submit(spi_dev_t *spi_dev, hal_spi_req_t *req);
+
 #endif
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <string.h>
+
+#include "hal_spi_lli.h"
+
+void hal_spi_lli_pool_init(hal_spi_lli_pool_t *pool, DMA_LLI_Ctrl_Type *tx, DMA_LLI_Ctrl_Type *rx, uint16_t num)
+{
+    memset(pool, 0, sizeof(hal_spi_lli_pool_t));
+    pool->tx = tx;
+    pool->rx = rx;
+    pool->num = num;
+}
+
+/* descriptors needed by the segments, -1 for an empty request */
+int hal_spi_lli_count(const spi_ioc_transfer_t *xfer, uint8_t num)
+{
+    int count = 0;
+    uint8_t i;
+
+    for (i = 0; i < num; i++) {
+        count += (xfer[i].len + HAL_SPI_LLI_SIZE - 1) / HAL_SPI_LLI_SIZE;
+    }
+
+    return count > 0 ? count : -1;
+}
+
+/*
+ * Requests complete in submit order, so descriptors are handed out and
+ * given back as a ring. Returns the first index, -1 when not enough are free.
+ */
+int hal_spi_lli_alloc(hal_spi_lli_pool_t *pool, uint16_t num)
+{
+    int first;
+
+    if (num == 0 || num > pool->num - pool->used) {
+        return -1;
+    }
+
+    first = pool->head;
+    pool->head = (pool->head + num) % pool->num;
+    pool->used += num;
+
+    return first;
+}
+
+void hal_spi_lli_free(hal_spi_lli_pool_t *pool, uint16_t num)
+{
+    pool->used = (num > pool->used) ? 0 : pool->used - num;
+}
+
+static void lli_ctrl_set(struct DMA_Control_Reg *ctrl, uint32_t len, uint8_t si, uint8_t di)
+{
+    memset(ctrl, 0, sizeof(struct DMA_Control_Reg));
+    ctrl->TransferSize = len;
+    ctrl->SBSize = DMA_BURST_SIZE_1;
+    ctrl->DBSize = DMA_BURST_SIZE_1;
+    ctrl->SWidth = DMA_TRNS_WIDTH_8BITS;
+    ctrl->DWidth = DMA_TRNS_WIDTH_8BITS;
+    ctrl->SI = si;
+    ctrl->DI = di;
+}
+
+/*
+ * Fill req->lli_num descriptors from req->lli_first with all segments of
+ * req linked back to back. Only the last RX descriptor raises an interrupt,
+ * RX always finishes after TX on SPI.
+ */
+void hal_spi_lli_build(hal_spi_lli_pool_t *pool, hal_spi_req_t *req, uint32_t tx_fifo, uint32_t rx_fifo)
+{
+    DMA_LLI_Ctrl_Type *tx = NULL, *rx = NULL;
+    uint32_t off, len;
+    uint16_t idx = req->lli_first;
+    uint8_t i;
+
+    for (i = 0; i < req->num; i++) {
+        for (off = 0; off < req->xfer[i].len; off += len) {
+            len = req->xfer[i].len - off;
+            if (len > HAL_SPI_LLI_SIZE) {
+                len = HAL_SPI_LLI_SIZE;
+            }
+
+            if (tx != NULL) {
+                tx->nextLLI = (uint32_t)(uintptr_t)&pool->tx[idx];
+                rx->nextLLI = (uint32_t)(uintptr_t)&pool->rx[idx];
+            }
+            tx = &pool->tx[idx];
+            rx = &pool->rx[idx];
+
+            if (req->xfer[i].tx_buf) {
+                tx->srcDmaAddr = req->xfer[i].tx_buf + off;
+                lli_ctrl_set(&tx->dmaCtrl, len, DMA_MINC_ENABLE, DMA_MINC_DISABLE);
+            } else {
+                tx->srcDmaAddr = (uint32_t)(uintptr_t)&pool->dummy;
+                lli_ctrl_set(&tx->dmaCtrl, len, DMA_MINC_DISABLE, DMA_MINC_DISABLE);
+            }
+            tx->destDmaAddr = tx_fifo;
+
+            rx->srcDmaAddr = rx_fifo;
+            if (req->xfer[i].rx_buf) {
+                rx->destDmaAddr = req->xfer[i].rx_buf + off;
+                lli_ctrl_set(&rx->dmaCtrl, len, DMA_MINC_DISABLE, DMA_MINC_ENABLE);
+            } else {
+                rx->destDmaAddr = (uint32_t)(uintptr_t)&pool->sink;
+                lli_ctrl_set(&rx->dmaCtrl, len, DMA_MINC_DISABLE, DMA_MINC_DISABLE);
+            }
+
+            idx = (idx + 1) % pool->num;
+        }
+    }
+
+    if (tx != NULL) {
+        tx->nextLLI = 0;
+        rx->nextLLI = 0;
+        rx->dmaCtrl.I = 1;
+    }
+}
+
+/* returns 1 when the queue was idle and req must be started by the caller */
+int hal_spi_req_push(hal_spi_queue_t *queue, hal_spi_req_t *req)
+{
+    req->next = NULL;
+    if (queue->tail != NULL) {
+        queue->tail->next = req;
+        queue->tail = req;
+        return 0;
+    }
+
+    queue->head = req;
+    queue->tail = req;
+    return 1;
+}
+
+/* remove the finished head, queue->head is the next one to start */
+hal_spi_req_t *hal_spi_req_pop(hal_spi_queue_t *queue)
+{
+    hal_spi_req_t *req = queue->head;
+
+    if (req != NULL) {
+        queue->head = req->next;
+        if (queue->head == NULL) {
+            queue->tail = NULL;
+        }
+        req->next = NULL;
+    }
+
+    return req;
+}
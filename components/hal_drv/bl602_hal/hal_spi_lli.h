@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __HAL_SPI_LLI_H__
+#define __HAL_SPI_LLI_H__
+
+#include <stdint.h>
+#include <bl602_dma.h>
+#include <device/vfs_spi.h>
+
+/*
+ * DMA descriptor pool and request queue for SPI. Nothing here touches the
+ * peripheral, so it builds and runs on a host as well.
+ */
+
+#define HAL_SPI_LLI_SIZE        (2048) /* bytes per descriptor, TransferSize is 12 bits */
+
+typedef struct hal_spi_lli_pool {
+    DMA_LLI_Ctrl_Type *tx;      /* tx[i] and rx[i] are used as a pair */
+    DMA_LLI_Ctrl_Type *rx;
+    uint16_t           num;
+    uint16_t           head;    /* next descriptor handed out */
+    uint16_t           used;    /* descriptors owned by queued requests */
+    uint32_t           dummy;   /* source when tx_buf is 0, stays 0 */
+    uint32_t           sink;    /* sink when rx_buf is 0 */
+} hal_spi_lli_pool_t;
+
+typedef struct hal_spi_req hal_spi_req_t;
+
+struct hal_spi_req {
+    hal_spi_req_t            *next;
+    const spi_ioc_transfer_t *xfer;     /* segments, chained into one DMA run */
+    uint8_t                   num;
+    void                    (*cb)(hal_spi_req_t *req, void *arg); /* called from ISR */
+    void                     *arg;
+    /* owned by the driver while queued */
+    uint16_t                  lli_first;
+    uint16_t                  lli_num;
+};
+
+typedef struct hal_spi_queue {
+    hal_spi_req_t *head;        /* running on DMA when not NULL */
+    hal_spi_req_t *tail;
+} hal_spi_queue_t;
+
+void hal_spi_lli_pool_init(hal_spi_lli_pool_t *pool, DMA_LLI_Ctrl_Type *tx, DMA_LLI_Ctrl_Type *rx, uint16_t num);
+int hal_spi_lli_count(const spi_ioc_transfer_t *xfer, uint8_t num);
+int hal_spi_lli_alloc(hal_spi_lli_pool_t *pool, uint16_t num);
+void hal_spi_lli_free(hal_spi_lli_pool_t *pool, uint16_t num);
+void hal_spi_lli_build(hal_spi_lli_pool_t *pool, hal_spi_req_t *req, uint32_t tx_fifo, uint32_t rx_fifo);
+
+int hal_spi_req_push(hal_spi_queue_t *queue, hal_spi_req_t *req);
+hal_spi_req_t *hal_spi_req_pop(hal_spi_queue_t *queue);
+
+#endif
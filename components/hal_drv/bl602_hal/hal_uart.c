@@ -90,9 +90,12 @@ static void uart_dev_setdef(uart_dev_t **pdev, uint8_t id)
     (*pdev)->config.stop_bits = STOP_BITS_1;
     (*pdev)->config.flow_control = FLOW_CONTROL_DISABLED;
     (*pdev)->config.mode = MODE_TX_RX;
+    (*pdev)->tx_dma_ch = UART_DMA_CH_NONE;
+    (*pdev)->rx_dma_ch = UART_DMA_CH_NONE;
 }
 
-static int dev_uart_init(uint8_t id, const char *path, uint32_t rx_buf_size, uint32_t tx_buf_size)
+static int dev_uart_init(uint8_t id, const char *path, uint32_t rx_buf_size, uint32_t tx_buf_size,
+        uint8_t tx_dma_ch, uint8_t rx_dma_ch)
 {
     uart_dev_t **pdev = NULL;
     int ret;
@@ -131,6 +134,8 @@ static int dev_uart_init(uint8_t id, const char *path, uint32_t rx_buf_size, uin
    // }
 
     uart_dev_setdef(pdev, id);
+    (*pdev)->tx_dma_ch = tx_dma_ch;
+    (*pdev)->rx_dma_ch = rx_dma_ch;
     ret = aos_register_driver(path, &uart_ops, *pdev);
     if (ret != VFS_SUCCESS) {
         return ret;
@@ -151,6 +156,31 @@ int32_t hal_uart_send_trigger_off(uart_dev_t *uart)
     return 0;
 }
 
+int32_t hal_uart_send_avail(uart_dev_t *uart)
+{
+    return bl_uart_tx_fifo_avail(uart->port);
+}
+
+int32_t hal_uart_dma_init(uart_dev_t *uart, void *rx_buf, uint32_t rx_size)
+{
+    return bl_uart_dma_init(uart->port, uart->tx_dma_ch, uart->rx_dma_ch, rx_buf, rx_size);
+}
+
+int32_t hal_uart_dma_finalize(uart_dev_t *uart)
+{
+    return bl_uart_dma_deinit(uart->port);
+}
+
+int32_t hal_uart_dma_send(uart_dev_t *uart, const void *data, uint32_t size)
+{
+    return bl_uart_dma_send(uart->port, data, size);
+}
+
+uint32_t hal_uart_dma_rx_pos(uart_dev_t *uart)
+{
+    return bl_uart_dma_rx_pos(uart->port);
+}
+
 int32_t hal_uart_init(uart_dev_t *uart)
 {
     uart_priv_data_t *data;
@@ -257,6 +287,7 @@ static void fdt_uart_module_init(const void *fdt, int uart_offset)
     int countindex = 0;
     int i, j;
     uint32_t rx_buf_size, tx_buf_size;
+    uint8_t tx_dma_ch, rx_dma_ch;
 
     uint8_t id;
     char *path = NULL;
@@ -363,6 +394,22 @@ static void fdt_uart_module_init(const void *fdt, int uart_offset)
         }
         blog_info("uart[%d] rx_buf_size %d, tx_buf_size %d\r\n", i, rx_buf_size, tx_buf_size);
 
+        /* set dma channel, optional */
+        tx_dma_ch = UART_DMA_CH_NONE;
+        rx_dma_ch = UART_DMA_CH_NONE;
+        offset2 = fdt_subnode_offset(fdt, offset1, "dma_cfg");
+        if (0 < offset2) {
+            addr_prop = fdt_getprop(fdt, offset2, "tx_dma_ch", &lentmp);
+            if (addr_prop != NULL) {
+                tx_dma_ch = BL_FDT32_TO_U8(addr_prop, 0);
+            }
+            addr_prop = fdt_getprop(fdt, offset2, "rx_dma_ch", &lentmp);
+            if (addr_prop != NULL) {
+                rx_dma_ch = BL_FDT32_TO_U8(addr_prop, 0);
+            }
+            blog_info("uart[%d] tx_dma_ch %d, rx_dma_ch %d\r\n", i, tx_dma_ch, rx_dma_ch);
+        }
+
         for (j = 0; j < 4; j++) {
             offset2 = fdt_subnode_offset(fdt, offset1, "feature");
             if (0 >= offset2) {
@@ -410,7 +457,7 @@ static void fdt_uart_module_init(const void *fdt, int uart_offset)
         blog_info("bl_uart_init %d ok.\r\n", id);
         blog_info("bl_uart_init %d baudrate = %ld ok.\r\n", id, baudrate);
 
-        if (dev_uart_init(id, (const char *)path, rx_buf_size, tx_buf_size) != 0) {
+        if (dev_uart_init(id, (const char *)path, rx_buf_size, tx_buf_size, tx_dma_ch, rx_dma_ch) != 0) {
             blog_error("dev_uart_init err.\r\n");
         }
     }
@@ -424,7 +471,7 @@ int vfs_uart_init_simple_mode(uint8_t id, uint8_t pin_tx, uint8_t pin_rx, int ba
 
     bl_uart_init(id, pin_tx, pin_rx, 255, 255, baudrate);
 
-    if (dev_uart_init(id, path, 128, 128) != 0) {
+    if (dev_uart_init(id, path, 128, 128, UART_DMA_CH_NONE, UART_DMA_CH_NONE) != 0) {
         blog_error("dev_uart_init err.\r\n");
     }
 
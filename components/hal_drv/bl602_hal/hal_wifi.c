@@ -32,7 +32,12 @@
 #include "hal_wifi.h"
 
 
+#ifdef CONF_USER_LWIP_PROFILE_THROUGHPUT
+/*lwIP input runs on this task with LWIP_TCPIP_CORE_LOCKING_INPUT*/
+#define WIFI_STACK_SIZE     (2048)
+#else
 #define WIFI_STACK_SIZE     (1536)
+#endif
 #define TASK_PRIORITY_FW    (30)
 
 #ifndef FEATURE_WIFI_DISABLE
@@ -0,0 +1,454 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test for the bl_aes API.  Checks the software backend against SP
+ * 800-38A and GCM vectors, then runs the SEC_ENG backend on a fake
+ * Sec_Eng_AES_Link_Work that computes with the software backend and records
+ * every descriptor: runs over 0xFFFF blocks are split, unaligned buffers go
+ * through the bounce buffer, in-place and streaming CTR/GCM calls with random
+ * splits match one-shot software results, and the AES mutex is created on
+ * first use.  The link descriptor lives on the stack and SEC_ENG takes its
+ * 32 bit address, so the test runs on a thread with a stack below 4GB.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "../bl_sec_aes.c"
+#include "../bl_sec_aes_sw.c"
+
+static int test_failed;
+
+/* FreeRTOS, the mutex is only counted */
+static int mutex_created, mutex_depth;
+
+QueueHandle_t xQueueCreateMutexStatic(const uint8_t ucQueueType, StaticQueue_t *pxStaticQueue)
+{
+    (void)ucQueueType;
+    mutex_created++;
+    return (QueueHandle_t)pxStaticQueue;
+}
+
+BaseType_t xQueueSemaphoreTake(QueueHandle_t xQueue, TickType_t xTicksToWait)
+{
+    (void)xTicksToWait;
+    if (NULL == xQueue || mutex_depth++) {
+        printf("FAIL aes mutex take %p depth %d\n", (void*)xQueue, mutex_depth);
+        test_failed = 1;
+    }
+    return pdPASS;
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void * const pvItemToQueue, TickType_t xTicksToWait, const BaseType_t xCopyPosition)
+{
+    (void)pvItemToQueue;
+    (void)xTicksToWait;
+    (void)xCopyPosition;
+    if (NULL == xQueue || 0 == mutex_depth--) {
+        printf("FAIL aes mutex give\n");
+        test_failed = 1;
+    }
+    return pdPASS;
+}
+
+void vTaskEnterCritical(void)
+{
+}
+
+void vTaskExitCritical(void)
+{
+}
+
+void Sec_Eng_AES_Enable_BE(SEC_ENG_AES_ID_Type aesNo)
+{
+    (void)aesNo;
+}
+
+void Sec_Eng_AES_Enable_Link(SEC_ENG_AES_ID_Type aesNo)
+{
+    (void)aesNo;
+}
+
+void Sec_Eng_AES_Disable_Link(SEC_ENG_AES_ID_Type aesNo)
+{
+    (void)aesNo;
+}
+
+void SEC_Eng_IntMask(SEC_ENG_INT_Type intType, BL_Mask_Type intMask)
+{
+    (void)intType;
+    (void)intMask;
+}
+
+void bl_irq_register(int irqnum, void *handler)
+{
+    (void)irqnum;
+    (void)handler;
+}
+
+void bl_irq_enable(unsigned int source)
+{
+    (void)source;
+}
+
+/* SEC_ENG stand in, keeps the key like the engine does */
+static bl_aes_ctx_t hw_key;
+static uint32_t hw_runs, hw_max_len, hw_min_len;
+
+BL_Err_Type Sec_Eng_AES_Link_Work(SEC_ENG_AES_ID_Type aesNo, uint32_t linkAddr, const uint8_t *in, uint32_t len, uint8_t *out)
+{
+    static const int keysize[] = {16, 32, 24};
+    SEC_Eng_AES_Link_Config_Type *link = (SEC_Eng_AES_Link_Config_Type*)(uintptr_t)linkAddr;
+
+    (void)aesNo;
+    if ((linkAddr & 0x03) || (len & 0x0F) || 0 == len || len > 0xFFFF * 16 ||
+            (((uintptr_t)in | (uintptr_t)out) & 0x03)) {
+        printf("FAIL link run %p %u %p %p\n", (void*)link, len, (void*)in, (void*)out);
+        test_failed = 1;
+        return ERROR;
+    }
+    if (SEC_ENG_AES_USE_NEW == link->aesDecKeySel) {
+        memset(&hw_key, 0, sizeof(hw_key));
+        hw_key.keysize = keysize[link->aesMode];
+        memcpy(hw_key.key, &(link->aesKey0), hw_key.keysize);
+        bl_aes_backend_sw.setkey(&hw_key);
+    }
+    hw_key.mode = (bl_aes_mode_t)link->aesBlockMode;
+    hw_key.dir = (SEC_ENG_AES_ENCRYPTION == link->aesDecEn) ? BL_AES_ENCRYPT : BL_AES_DECRYPT;
+    memcpy(hw_key.iv, &(link->aesIV0), sizeof(hw_key.iv));
+    bl_aes_backend_sw.crypt(&hw_key, in, out, len);
+    memcpy(&(link->aesIV0), hw_key.iv, sizeof(hw_key.iv));
+
+    hw_runs++;
+    if (len > hw_max_len) {
+        hw_max_len = len;
+    }
+    if (len < hw_min_len) {
+        hw_min_len = len;
+    }
+    return SUCCESS;
+}
+
+static void hex2bin(const char *hex, uint8_t *bin, size_t *len)
+{
+    size_t n = 0;
+
+    while (hex[0] && hex[1]) {
+        sscanf(hex, "%2hhx", &bin[n++]);
+        hex += 2;
+    }
+    if (len) {
+        *len = n;
+    }
+}
+
+static void check(const char *name, const uint8_t *out, const char *expect_hex)
+{
+    uint8_t expect[128];
+    size_t len;
+
+    hex2bin(expect_hex, expect, &len);
+    if (memcmp(out, expect, len)) {
+        printf("FAIL %s (%s)\n", name, bl_aes_backend_get()->name);
+        test_failed = 1;
+    }
+}
+
+/* NIST SP 800-38A F.1/F.2/F.5 and GCM spec test case 4 */
+static void test_vectors(void)
+{
+    static const char *plain =
+        "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51";
+    static const char *key128 = "2b7e151628aed2a6abf7158809cf4f3c";
+    static const char *key256 = "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4";
+    uint8_t key[32], iv[16], in[64], out[64], tag[16], add[20];
+    size_t len, add_len;
+    bl_aes_ctx_t ctx;
+    bl_aes_gcm_ctx_t gcm;
+
+    hex2bin(plain, in, &len);
+
+    hex2bin(key128, key, NULL);
+    bl_aes_setkey(&ctx, BL_AES_ECB, BL_AES_ENCRYPT, key, 16);
+    bl_aes_update(&ctx, in, out, 32);
+    check("ECB-AES128", out, "3ad77bb40d7a3660a89ecaf32466ef97f5d3d58503b9699de785895a96fdbaaf");
+    bl_aes_setkey(&ctx, BL_AES_ECB, BL_AES_DECRYPT, key, 16);
+    bl_aes_update(&ctx, out, out, 32);
+    check("ECB-AES128 decrypt", out, plain);
+
+    hex2bin(key256, key, NULL);
+    bl_aes_setkey(&ctx, BL_AES_ECB, BL_AES_ENCRYPT, key, 32);
+    bl_aes_update(&ctx, in, out, 32);
+    check("ECB-AES256", out, "f3eed1bdb5d2a03c064b5a7e3db181f8591ccb10d410ed26dc5ba74a31362870");
+
+    hex2bin(key128, key, NULL);
+    hex2bin("000102030405060708090a0b0c0d0e0f", iv, NULL);
+    bl_aes_setkey(&ctx, BL_AES_CBC, BL_AES_ENCRYPT, key, 16);
+    bl_aes_setiv(&ctx, iv);
+    /* two calls, the chained iv carries over */
+    bl_aes_update(&ctx, in, out, 16);
+    bl_aes_update(&ctx, in + 16, out + 16, 16);
+    check("CBC-AES128", out, "7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b2");
+    bl_aes_setkey(&ctx, BL_AES_CBC, BL_AES_DECRYPT, key, 16);
+    bl_aes_setiv(&ctx, iv);
+    bl_aes_update(&ctx, out, out, 32);
+    check("CBC-AES128 decrypt", out, plain);
+
+    hex2bin("f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff", iv, NULL);
+    bl_aes_setkey(&ctx, BL_AES_CTR, BL_AES_ENCRYPT, key, 16);
+    bl_aes_setiv(&ctx, iv);
+    /* odd lengths, keystream left over is used by the next call */
+    bl_aes_update(&ctx, in, out, 5);
+    bl_aes_update(&ctx, in + 5, out + 5, 20);
+    bl_aes_update(&ctx, in + 25, out + 25, 7);
+    check("CTR-AES128", out, "874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff");
+
+    hex2bin("feffe9928665731c6d6a8f9467308308", key, NULL);
+    hex2bin("cafebabefacedbaddecaf888", iv, NULL);
+    hex2bin("feedfacedeadbeeffeedfacedeadbeefabaddad2", add, &add_len);
+    hex2bin("d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+            "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39", in, &len);
+    bl_aes_gcm_setkey(&gcm, key, 16);
+    bl_aes_gcm_starts(&gcm, BL_AES_ENCRYPT, iv, 12, add, add_len);
+    bl_aes_gcm_update(&gcm, in, out, 17);
+    bl_aes_gcm_update(&gcm, in + 17, out + 17, len - 17);
+    bl_aes_gcm_finish(&gcm, tag, 16);
+    check("GCM-AES128", out, "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+            "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091");
+    check("GCM-AES128 tag", tag, "5bc94fbc3221a5db94fae95ae7121a47");
+    bl_aes_gcm_starts(&gcm, BL_AES_DECRYPT, iv, 12, add, add_len);
+    bl_aes_gcm_update(&gcm, out, out, len);
+    bl_aes_gcm_finish(&gcm, tag, 16);
+    check("GCM-AES128 decrypt", out, "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+            "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39");
+    check("GCM-AES128 decrypt tag", tag, "5bc94fbc3221a5db94fae95ae7121a47");
+}
+
+/* one shot on the software backend, the reference for everything else */
+static void reference(bl_aes_mode_t mode, bl_aes_dir_t dir, const uint8_t *key, int keysize,
+        const uint8_t *iv, const uint8_t *in, uint8_t *out, size_t len)
+{
+    const bl_aes_backend_t *backend = bl_aes_backend_get();
+    bl_aes_ctx_t ctx;
+
+    bl_aes_backend_set(&bl_aes_backend_sw);
+    bl_aes_setkey(&ctx, mode, dir, key, keysize);
+    bl_aes_setiv(&ctx, iv);
+    bl_aes_update(&ctx, in, out, len);
+    bl_aes_backend_set(backend);
+}
+
+#define HUGE_LEN    (0xFFFF * 16 * 2 + 4096)
+
+static void test_chunking(void)
+{
+    static const int keysizes[] = {16, 24, 32};
+    uint8_t *src = malloc(HUGE_LEN + 8), *dst = malloc(HUGE_LEN + 8), *expect = malloc(HUGE_LEN);
+    uint8_t key[32], iv[16];
+    size_t i, pos, chunk, len;
+    uint32_t runs;
+    bl_aes_ctx_t ctx;
+    int round, mode, dir, offset;
+
+    for (i = 0; i < HUGE_LEN + 8; i++) {
+        src[i] = rand();
+    }
+    for (i = 0; i < sizeof(key); i++) {
+        key[i] = rand();
+    }
+    for (i = 0; i < sizeof(iv); i++) {
+        iv[i] = rand();
+    }
+
+    /* aligned, over 0xFFFF blocks, split into full descriptors */
+    reference(BL_AES_CBC, BL_AES_ENCRYPT, key, 32, iv, src, expect, HUGE_LEN);
+    bl_aes_setkey(&ctx, BL_AES_CBC, BL_AES_ENCRYPT, key, 32);
+    bl_aes_setiv(&ctx, iv);
+    runs = hw_runs;
+    hw_max_len = 0;
+    hw_min_len = UINT32_MAX;
+    if (bl_aes_update(&ctx, src, dst, HUGE_LEN) || memcmp(dst, expect, HUGE_LEN)) {
+        printf("FAIL huge CBC\n");
+        test_failed = 1;
+    }
+    printf("huge:      %u bytes in %u runs, %u..%u bytes\n", HUGE_LEN, hw_runs - runs, hw_min_len, hw_max_len);
+    if (3 != hw_runs - runs || 0xFFFF * 16 != hw_max_len) {
+        printf("FAIL huge CBC split\n");
+        test_failed = 1;
+    }
+
+    /* unaligned and in-place, all modes and key sizes, random streaming splits */
+    runs = hw_runs;
+    hw_max_len = 0;
+    for (round = 0; round < 300; round++) {
+        mode = rand() % 3;
+        dir = rand() % 2;
+        offset = rand() % 4;
+        len = 16 * (1 + rand() % 256);
+        if (BL_AES_CTR == mode) {
+            len += rand() % 16;
+        }
+        memcpy(dst, src, len + 8);
+        reference(mode, dir, key, keysizes[round % 3], iv, src + offset, expect, len);
+
+        bl_aes_setkey(&ctx, mode, dir, key, keysizes[round % 3]);
+        bl_aes_setiv(&ctx, iv);
+        /* in place when offset is odd */
+        for (pos = 0; pos < len; pos += chunk) {
+            chunk = 16 * (rand() % 8);
+            if (BL_AES_CTR == mode) {
+                chunk += rand() % 16;
+            }
+            if (chunk > len - pos) {
+                chunk = len - pos;
+            }
+            if (bl_aes_update(&ctx, (offset & 1) ? dst + offset + pos : src + offset + pos, dst + offset + pos, chunk)) {
+                printf("FAIL update mode %d len %zu\n", mode, chunk);
+                test_failed = 1;
+            }
+        }
+        if (memcmp(dst + offset, expect, len)) {
+            printf("FAIL streaming mode %d dir %d keysize %d offset %d len %zu\n", mode, dir, keysizes[round % 3], offset, len);
+            test_failed = 1;
+        }
+    }
+    printf("streaming: %u runs, largest %u bytes\n", hw_runs - runs, hw_max_len);
+
+    /* non block sizes only work in CTR mode */
+    bl_aes_setkey(&ctx, BL_AES_CBC, BL_AES_ENCRYPT, key, 16);
+    if (0 == bl_aes_update(&ctx, src, dst, 17)) {
+        printf("FAIL CBC accepted a partial block\n");
+        test_failed = 1;
+    }
+    if (0 == bl_aes_setkey(&ctx, BL_AES_CBC, BL_AES_ENCRYPT, key, 20)) {
+        printf("FAIL bad keysize accepted\n");
+        test_failed = 1;
+    }
+
+    free(src);
+    free(dst);
+    free(expect);
+}
+
+/* GCM on SEC_ENG with random splits against one shot in software */
+static void test_gcm_streaming(void)
+{
+    uint8_t key[32], iv[16], add[40], in[600], out[600], expect[600], tag[16], tag_expect[16];
+    bl_aes_gcm_ctx_t gcm;
+    size_t i, pos, chunk, len;
+    int round;
+
+    for (round = 0; round < 100; round++) {
+        for (i = 0; i < sizeof(key); i++) {
+            key[i] = rand();
+        }
+        for (i = 0; i < sizeof(iv); i++) {
+            iv[i] = rand();
+        }
+        for (i = 0; i < sizeof(add); i++) {
+            add[i] = rand();
+        }
+        len = rand() % sizeof(in);
+        for (i = 0; i < len; i++) {
+            in[i] = rand();
+        }
+
+        bl_aes_backend_set(&bl_aes_backend_sw);
+        bl_aes_gcm_setkey(&gcm, key, 16 + 8 * (round % 3));
+        bl_aes_gcm_starts(&gcm, BL_AES_ENCRYPT, iv, 1 + round % 16, add, round % 40);
+        bl_aes_gcm_update(&gcm, in, expect, len);
+        bl_aes_gcm_finish(&gcm, tag_expect, 16);
+
+        bl_aes_backend_set(NULL);
+        bl_aes_gcm_setkey(&gcm, key, 16 + 8 * (round % 3));
+        bl_aes_gcm_starts(&gcm, BL_AES_ENCRYPT, iv, 1 + round % 16, add, round % 40);
+        for (pos = 0; pos < len; pos += chunk) {
+            chunk = rand() % 70;
+            if (chunk > len - pos) {
+                chunk = len - pos;
+            }
+            bl_aes_gcm_update(&gcm, in + pos, out + pos, chunk);
+        }
+        bl_aes_gcm_finish(&gcm, tag, 16);
+        if (memcmp(out, expect, len) || memcmp(tag, tag_expect, 16)) {
+            printf("FAIL GCM streaming round %d len %zu\n", round, len);
+            test_failed = 1;
+        }
+    }
+}
+
+static void *test_thread(void *arg)
+{
+    (void)arg;
+
+    /* bl_sec_init is never called, the mutex comes with the first call */
+    bl_aes_backend_set(NULL);
+    test_vectors();
+    if (1 != mutex_created || mutex_depth) {
+        printf("FAIL aes mutex created %d times, depth %d\n", mutex_created, mutex_depth);
+        test_failed = 1;
+    }
+    bl_aes_backend_set(&bl_aes_backend_sw);
+    test_vectors();
+
+    bl_aes_backend_set(NULL);
+    test_chunking();
+    test_gcm_streaming();
+    if (1 != mutex_created || mutex_depth) {
+        printf("FAIL aes mutex created %d times, depth %d\n", mutex_created, mutex_depth);
+        test_failed = 1;
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_attr_t attr;
+    pthread_t th;
+    size_t size = 1024 * 1024;
+    void *stack;
+
+    /* link descriptors live on the stack and SEC_ENG takes a 32 bit address */
+    stack = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (MAP_FAILED == stack) {
+        perror("mmap");
+        return 2;
+    }
+    srand(1);
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, size);
+    pthread_create(&th, &attr, test_thread, NULL);
+    pthread_join(th, NULL);
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test for the SPI DMA descriptor pool and request queue.  A simulated
+ * DMA follows the TX and RX LLI chains of a request when it completes, with
+ * a loopback slave which answers each byte XOR 0x5A.  Random requests of 1
+ * to 4 segments, empty buffers included, are queued until the pool is full
+ * and complete in random bursts.  Every request must complete in submit
+ * order with the right data, a segment without tx_buf must send zeros, only
+ * its last RX descriptor may interrupt, and no descriptor may be handed out
+ * while a queued request owns it.  The pool and buffers sit below 4 GB as
+ * the descriptors hold 32 bit addresses.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/* bl602_dma.h needs the SoC headers, only the LLI types are used */
+#define __BL602_DMA_H__
+
+struct DMA_Control_Reg {
+    uint32_t TransferSize                   : 12;
+    uint32_t SBSize                         :  3;
+    uint32_t DBSize                         :  3;
+    uint32_t SWidth                         :  3;
+    uint32_t DWidth                         :  3;
+    uint32_t SLargerD                       :  1;
+    uint32_t reserved_25                    :  1;
+    uint32_t SI                             :  1;
+    uint32_t DI                             :  1;
+    uint32_t Prot                           :  3;
+    uint32_t I                              :  1;
+};
+
+typedef struct {
+    uint32_t srcDmaAddr;
+    uint32_t destDmaAddr;
+    uint32_t nextLLI;
+    struct DMA_Control_Reg dmaCtrl;
+} DMA_LLI_Ctrl_Type;
+
+#define DMA_TRNS_WIDTH_8BITS    0
+#define DMA_BURST_SIZE_1        0
+#define DMA_MINC_ENABLE         1
+#define DMA_MINC_DISABLE        0
+
+#include "../hal_spi_lli.c"
+
+#define TEST_POOL_NUM       16
+#define TEST_REQ_MAX        TEST_POOL_NUM
+#define TEST_SEG_MAX        4
+#define TEST_SEG_LEN_MAX    (3 * HAL_SPI_LLI_SIZE + 100)
+#define TEST_ROUNDS         200000
+#define TEST_TX_FIFO        0x4000A488u
+#define TEST_RX_FIFO        0x4000A48Cu
+
+static int test_failed;
+
+typedef struct {
+    DMA_LLI_Ctrl_Type tx[TEST_POOL_NUM];
+    DMA_LLI_Ctrl_Type rx[TEST_POOL_NUM];
+    hal_spi_lli_pool_t pool;
+    uint8_t tx_buf[TEST_REQ_MAX][TEST_SEG_MAX][TEST_SEG_LEN_MAX];
+    uint8_t rx_buf[TEST_REQ_MAX][TEST_SEG_MAX][TEST_SEG_LEN_MAX];
+} test_mem_t;
+
+static test_mem_t *mem;
+static hal_spi_queue_t queue;
+static hal_spi_req_t reqs[TEST_REQ_MAX];
+static spi_ioc_transfer_t xfers[TEST_REQ_MAX][TEST_SEG_MAX];
+static int owner[TEST_POOL_NUM];//request owning the descriptor, -1 for free
+static uint8_t wire[TEST_SEG_MAX * TEST_SEG_LEN_MAX];
+static unsigned long submitted, completed, busy;
+
+static void *addr_ptr(uint32_t addr)
+{
+    return (void *)(uintptr_t)addr;
+}
+
+static DMA_LLI_Ctrl_Type *check_lli(uint32_t addr, DMA_LLI_Ctrl_Type *base, int slot)
+{
+    DMA_LLI_Ctrl_Type *lli = addr_ptr(addr);
+
+    if (lli < base || lli >= base + TEST_POOL_NUM || owner[lli - base] != slot) {
+        printf("FAIL request %d links to a descriptor it does not own\n", slot);
+        test_failed = 1;
+        return NULL;
+    }
+    return lli;
+}
+
+/* run the chains of the head request as the DMA does, then check the data */
+static void dma_complete(void)
+{
+    hal_spi_req_t *req = queue.head;
+    DMA_LLI_Ctrl_Type *lli;
+    uint32_t n = 0, m = 0, i, j, len;
+    int slot = req - reqs;
+
+    /* TX: memory to the FIFO, the slave answers into the wire */
+    for (lli = check_lli((uint32_t)(uintptr_t)&mem->pool.tx[req->lli_first], mem->tx, slot); lli != NULL;
+            lli = lli->nextLLI ? check_lli(lli->nextLLI, mem->tx, slot) : NULL) {
+        if (lli->destDmaAddr != TEST_TX_FIFO || lli->dmaCtrl.DI || lli->dmaCtrl.I) {
+            printf("FAIL tx descriptor of request %d\n", slot);
+            test_failed = 1;
+        }
+        for (i = 0; i < lli->dmaCtrl.TransferSize; i++) {
+            wire[n++] = ((uint8_t *)addr_ptr(lli->srcDmaAddr))[lli->dmaCtrl.SI ? i : 0] ^ 0x5A;
+        }
+    }
+    /* RX: the FIFO to memory, the last one interrupts */
+    for (lli = check_lli((uint32_t)(uintptr_t)&mem->pool.rx[req->lli_first], mem->rx, slot); lli != NULL;
+            lli = lli->nextLLI ? check_lli(lli->nextLLI, mem->rx, slot) : NULL) {
+        if (lli->srcDmaAddr != TEST_RX_FIFO || lli->dmaCtrl.SI || lli->dmaCtrl.I != (lli->nextLLI == 0)) {
+            printf("FAIL rx descriptor of request %d\n", slot);
+            test_failed = 1;
+        }
+        for (i = 0; i < lli->dmaCtrl.TransferSize && m < n; i++) {
+            ((uint8_t *)addr_ptr(lli->destDmaAddr))[lli->dmaCtrl.DI ? i : 0] = wire[m++];
+        }
+    }
+
+    for (i = 0, len = 0; i < req->num; i++) {
+        len += req->xfer[i].len;
+        if (req->xfer[i].rx_buf == 0) {
+            continue;
+        }
+        for (j = 0; j < req->xfer[i].len; j++) {
+            if (mem->rx_buf[slot][i][j] != ((req->xfer[i].tx_buf ? mem->tx_buf[slot][i][j] : 0) ^ 0x5A)) {
+                printf("FAIL request %d segment %u byte %u\n", slot, i, j);
+                test_failed = 1;
+                break;
+            }
+        }
+    }
+    if (n != len || m != len) {
+        printf("FAIL request %d moved %u/%u bytes for %u\n", slot, n, m, len);
+        test_failed = 1;
+    }
+
+    /* what the RX ISR does */
+    if (hal_spi_req_pop(&queue) != req) {
+        printf("FAIL queue order\n");
+        test_failed = 1;
+    }
+    hal_spi_lli_free(&mem->pool, req->lli_num);
+    for (i = 0; i < TEST_POOL_NUM; i++) {
+        if (owner[i] == slot) {
+            owner[i] = -1;
+        }
+    }
+    req->cb = NULL;
+    completed++;
+}
+
+/* build a random request in the free slot, returns 0 when the pool is busy */
+static int submit(int slot)
+{
+    hal_spi_req_t *req = &reqs[slot];
+    int i, j, count, first;
+
+    req->num = 1 + rand() % TEST_SEG_MAX;
+    req->xfer = xfers[slot];
+    for (i = 0; i < req->num; i++) {
+        xfers[slot][i].len = (rand() % 4) ? 1 + rand() % 64 : 1 + rand() % TEST_SEG_LEN_MAX;
+        if (rand() % 4 == 0) {
+            xfers[slot][i].len = HAL_SPI_LLI_SIZE * (1 + rand() % 3);
+        }
+        xfers[slot][i].tx_buf = (rand() % 5) ? (uint32_t)(uintptr_t)mem->tx_buf[slot][i] : 0;
+        xfers[slot][i].rx_buf = (rand() % 5) ? (uint32_t)(uintptr_t)mem->rx_buf[slot][i] : 0;
+        for (j = 0; j < (int)xfers[slot][i].len; j++) {
+            mem->tx_buf[slot][i][j] = rand();
+        }
+        memset(mem->rx_buf[slot][i], 0, xfers[slot][i].len);
+    }
+
+    count = hal_spi_lli_count(req->xfer, req->num);
+    if (count > TEST_POOL_NUM) {
+        return 1;
+    }
+    first = hal_spi_lli_alloc(&mem->pool, count);
+    if (first < 0) {
+        busy++;
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        if (owner[(first + i) % TEST_POOL_NUM] != -1) {
+            printf("FAIL descriptor %d is handed out twice\n", (first + i) % TEST_POOL_NUM);
+            test_failed = 1;
+        }
+        owner[(first + i) % TEST_POOL_NUM] = slot;
+    }
+    req->lli_first = first;
+    req->lli_num = count;
+    req->cb = (void (*)(hal_spi_req_t *, void *))1;//in use
+    hal_spi_lli_build(&mem->pool, req, TEST_TX_FIFO, TEST_RX_FIFO);
+    hal_spi_req_push(&queue, req);
+    submitted++;
+    return 1;
+}
+
+static void test_count(void)
+{
+    spi_ioc_transfer_t seg[3];
+
+    memset(seg, 0, sizeof(seg));
+    seg[0].len = HAL_SPI_LLI_SIZE;
+    seg[1].len = HAL_SPI_LLI_SIZE + 1;
+    if (hal_spi_lli_count(seg, 0) != -1 || hal_spi_lli_count(&seg[2], 1) != -1
+            || hal_spi_lli_count(seg, 1) != 1 || hal_spi_lli_count(seg, 3) != 3) {
+        printf("FAIL hal_spi_lli_count\n");
+        test_failed = 1;
+    }
+}
+
+int main(void)
+{
+    int i, slot;
+
+    mem = mmap(NULL, sizeof(test_mem_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (MAP_FAILED == mem) {
+        printf("FAIL mmap\n");
+        return 1;
+    }
+    srand(1);
+    test_count();
+    hal_spi_lli_pool_init(&mem->pool, mem->tx, mem->rx, TEST_POOL_NUM);
+    memset(owner, -1, sizeof(owner));
+
+    for (i = 0; i < TEST_ROUNDS && !test_failed; i++) {
+        if (rand() % 3 == 0 && queue.head != NULL) {
+            dma_complete();
+            continue;
+        }
+        for (slot = 0; slot < TEST_REQ_MAX && reqs[slot].cb != NULL; slot++) {
+        }
+        if (slot == TEST_REQ_MAX || !submit(slot)) {
+            /* the blocking path waits for a completion */
+            if (queue.head != NULL) {
+                dma_complete();
+            }
+        }
+    }
+    while (queue.head != NULL && !test_failed) {
+        dma_complete();
+    }
+    if (mem->pool.used != 0) {
+        printf("FAIL %u descriptors are still used\n", mem->pool.used);
+        test_failed = 1;
+    }
+    printf("%lu requests submitted, %lu completed, %lu waited for the pool\n", submitted, completed, busy);
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
@@ -0,0 +1,742 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test for BLAesEngine.  FreeRTOS tasks are threads, critical sections
+ * and the AES IRQ share one lock, and SEC_ENG is a thread that runs each link
+ * descriptor with the software AES backend and then raises the IRQ.  The
+ * fake engine keeps the loaded key like SEC_ENG does, so a wrong
+ * SEC_ENG_AES_USE_OLD shows up as wrong output.  Several tasks submit random
+ * ECB/CBC/CTR requests, synchronous and with done_cb; every result and the
+ * chained IV is checked against the software backend.  Then it checks
+ * batching (worker wakeups per request), huge requests that take several
+ * descriptors, bad requests in the middle of a chain, a lost IRQ and
+ * BLAesEngineSw.  Descriptors hold 32 bit addresses, so everything SEC_ENG
+ * sees is allocated below 4GB.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../platform_hal_device.cpp"
+extern "C" {
+#include "../../bl602_hal/bl_sec_aes_sw.c"
+}
+
+/* memory below 4GB, link descriptors only hold 32 bit addresses */
+static uint8_t *low_mem;
+static size_t low_used;
+static pthread_mutex_t low_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define LOW_MEM_SIZE    (64 * 1024 * 1024)
+
+static void *low_alloc(size_t size)
+{
+    void *ptr;
+
+    pthread_mutex_lock(&low_mutex);
+    if (NULL == low_mem) {
+        low_mem = (uint8_t*)mmap(NULL, LOW_MEM_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+        if (MAP_FAILED == low_mem) {
+            perror("mmap");
+            exit(2);
+        }
+    }
+    size = (size + 15) & (~15);
+    if (low_used + size > LOW_MEM_SIZE) {
+        printf("low memory exhausted\n");
+        exit(2);
+    }
+    ptr = low_mem + low_used;
+    low_used += size;
+    pthread_mutex_unlock(&low_mutex);
+
+    return ptr;
+}
+
+void *pvPortMallocFrom(size_t xSize, void *pvCaller)
+{
+    (void)pvCaller;
+    return low_alloc(xSize);
+}
+
+void vPortFree(void *pv)
+{
+    (void)pv;
+}
+
+/* FreeRTOS on threads, critical sections and the IRQ share one lock */
+static pthread_mutex_t crit;
+BaseType_t TrapNetCounter;
+
+struct tskTaskControlBlock {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint32_t value;
+    int state;
+    TaskFunction_t fn;
+    void *arg;
+};
+
+enum {
+    NOTIFY_NONE,
+    NOTIFY_WAITING,
+    NOTIFY_RECEIVED,
+};
+
+static __thread TaskHandle_t current_task;
+static TaskHandle_t worker_task;
+static volatile uint32_t worker_wakeups;
+
+static TaskHandle_t task_new(void)
+{
+    TaskHandle_t task = (TaskHandle_t)calloc(1, sizeof(struct tskTaskControlBlock));
+
+    pthread_mutex_init(&task->mutex, NULL);
+    pthread_cond_init(&task->cond, NULL);
+    return task;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (NULL == current_task) {
+        current_task = task_new();
+    }
+    return current_task;
+}
+
+static void *task_thread(void *arg)
+{
+    current_task = (TaskHandle_t)arg;
+    current_task->fn(current_task->arg);
+    return NULL;
+}
+
+/* thread stacks below 4GB too, requests live on them */
+static void thread_low(pthread_t *th, void *(*fn)(void *), void *arg)
+{
+    pthread_attr_t attr;
+    size_t size = 256 * 1024;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, low_alloc(size), size);
+    pthread_create(th, &attr, fn, arg);
+    pthread_attr_destroy(&attr);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char * const pcName, const configSTACK_DEPTH_TYPE usStackDepth,
+        void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask)
+{
+    TaskHandle_t task = task_new();
+    pthread_t th;
+
+    (void)pcName;
+    (void)usStackDepth;
+    (void)uxPriority;
+    task->fn = pxTaskCode;
+    task->arg = pvParameters;
+    if (pxCreatedTask) {
+        *pxCreatedTask = task;
+    }
+    worker_task = task;
+    thread_low(&th, task_thread, task);
+    pthread_detach(th);
+
+    return pdPASS;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static int task_block(TaskHandle_t task, TickType_t ticks)
+{
+    struct timespec ts;
+
+    task->state = NOTIFY_WAITING;
+    if (portMAX_DELAY == ticks) {
+        while (NOTIFY_RECEIVED != task->state) {
+            pthread_cond_wait(&task->cond, &task->mutex);
+        }
+        return 1;
+    }
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (ticks % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    while (NOTIFY_RECEIVED != task->state) {
+        if (pthread_cond_timedwait(&task->cond, &task->mutex, &ts)) {
+            break;
+        }
+    }
+    return NOTIFY_RECEIVED == task->state;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit, uint32_t *pulNotificationValue, TickType_t xTicksToWait)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    BaseType_t ret;
+
+    pthread_mutex_lock(&task->mutex);
+    if (NOTIFY_RECEIVED != task->state) {
+        task->value &= ~ulBitsToClearOnEntry;
+        task_block(task, xTicksToWait);
+    }
+    if (pulNotificationValue) {
+        *pulNotificationValue = task->value;
+    }
+    ret = (NOTIFY_RECEIVED == task->state) ? pdTRUE : pdFALSE;
+    if (ret) {
+        task->value &= ~ulBitsToClearOnExit;
+    }
+    task->state = NOTIFY_NONE;
+    pthread_mutex_unlock(&task->mutex);
+    if (task == worker_task) {
+        __atomic_add_fetch(&worker_wakeups, 1, __ATOMIC_RELAXED);
+    }
+
+    return ret;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    uint32_t ret;
+
+    pthread_mutex_lock(&task->mutex);
+    if (0 == task->value) {
+        task_block(task, xTicksToWait);
+    }
+    ret = task->value;
+    if (ret) {
+        task->value = xClearCountOnExit ? 0 : ret - 1;
+    }
+    task->state = NOTIFY_NONE;
+    pthread_mutex_unlock(&task->mutex);
+
+    return ret;
+}
+
+BaseType_t xTaskGenericNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction, uint32_t *pulPreviousNotificationValue)
+{
+    pthread_mutex_lock(&xTaskToNotify->mutex);
+    if (pulPreviousNotificationValue) {
+        *pulPreviousNotificationValue = xTaskToNotify->value;
+    }
+    switch (eAction) {
+        case eSetBits:
+        {
+            xTaskToNotify->value |= ulValue;
+        }
+        break;
+        case eIncrement:
+        {
+            xTaskToNotify->value++;
+        }
+        break;
+        case eSetValueWithOverwrite:
+        case eSetValueWithoutOverwrite:
+        {
+            xTaskToNotify->value = ulValue;
+        }
+        break;
+        default:
+        {
+        }
+    }
+    xTaskToNotify->state = NOTIFY_RECEIVED;
+    pthread_cond_signal(&xTaskToNotify->cond);
+    pthread_mutex_unlock(&xTaskToNotify->mutex);
+
+    return pdPASS;
+}
+
+BaseType_t xTaskGenericNotifyFromISR(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction, uint32_t *pulPreviousNotificationValue, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    if (!TrapNetCounter) {
+        printf("FAIL FromISR call outside of IRQ\n");
+        exit(1);
+    }
+    *pxHigherPriorityTaskWoken = pdTRUE;
+    return xTaskGenericNotify(xTaskToNotify, ulValue, eAction, pulPreviousNotificationValue);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    xTaskGenericNotifyFromISR(xTaskToNotify, 0, eIncrement, NULL, pxHigherPriorityTaskWoken);
+}
+
+void vTaskSwitchContext(void)
+{
+}
+
+void vTaskEnterCritical(void)
+{
+    pthread_mutex_lock(&crit);
+}
+
+void vTaskExitCritical(void)
+{
+    pthread_mutex_unlock(&crit);
+}
+
+/* bl_sec AES mutex, the engine holds it for a whole chain */
+static int aes_mutex_depth;
+
+int bl_aes_mutex_take()
+{
+    if (aes_mutex_depth++) {
+        printf("FAIL aes mutex nested\n");
+        exit(1);
+    }
+    return 0;
+}
+
+int bl_aes_mutex_give()
+{
+    aes_mutex_depth--;
+    return 0;
+}
+
+void Sec_Eng_AES_Enable_BE(SEC_ENG_AES_ID_Type aesNo)
+{
+    (void)aesNo;
+}
+
+void Sec_Eng_AES_Enable_Link(SEC_ENG_AES_ID_Type aesNo)
+{
+    (void)aesNo;
+}
+
+void Sec_Eng_AES_Disable_Link(SEC_ENG_AES_ID_Type aesNo)
+{
+    (void)aesNo;
+}
+
+/* SEC_ENG stand in, one descriptor at a time, then the IRQ */
+static pthread_mutex_t hw_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t hw_cond = PTHREAD_COND_INITIALIZER;
+static SEC_Eng_AES_Link_Config_Type *hw_link;
+static bl_aes_ctx_t hw_key;
+static int hw_key_forward = -1;
+static void (*hw_irq_cb)(void *arg);
+static void *hw_irq_arg;
+static volatile uint32_t hw_descriptors, hw_key_reuses, hw_irq_drop;
+static int test_failed;
+
+int bl_aes_irq_register(void (*cb)(void *arg), void *arg)
+{
+    hw_irq_cb = cb;
+    hw_irq_arg = arg;
+    return 0;
+}
+
+int bl_aes_link_trigger(void *link)
+{
+    pthread_mutex_lock(&hw_mutex);
+    if (hw_link) {
+        pthread_mutex_unlock(&hw_mutex);
+        printf("FAIL trigger while busy\n");
+        test_failed = 1;
+        return -1;
+    }
+    hw_link = (SEC_Eng_AES_Link_Config_Type*)link;
+    pthread_cond_signal(&hw_cond);
+    pthread_mutex_unlock(&hw_mutex);
+
+    return 0;
+}
+
+static void *hw_thread(void *arg)
+{
+    static const int keysize[] = {16, 32, 24};
+    SEC_Eng_AES_Link_Config_Type *link;
+    int forward;
+
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&hw_mutex);
+        while (NULL == hw_link) {
+            pthread_cond_wait(&hw_cond, &hw_mutex);
+        }
+        link = hw_link;
+        pthread_mutex_unlock(&hw_mutex);
+
+        forward = (SEC_ENG_AES_ENCRYPTION == link->aesDecEn);
+        if (SEC_ENG_AES_USE_NEW == link->aesDecKeySel) {
+            memset(&hw_key, 0, sizeof(hw_key));
+            hw_key.keysize = keysize[link->aesMode];
+            memcpy(hw_key.key, &(link->aesKey0), hw_key.keysize);
+            bl_aes_backend_sw.setkey(&hw_key);
+            hw_key_forward = forward;
+        } else {
+            hw_key_reuses = hw_key_reuses + 1;
+            if (hw_key_forward != forward) {
+                printf("FAIL old key used for the other direction\n");
+                test_failed = 1;
+            }
+        }
+        hw_key.mode = (bl_aes_mode_t)link->aesBlockMode;
+        hw_key.dir = forward ? BL_AES_ENCRYPT : BL_AES_DECRYPT;
+        memcpy(hw_key.iv, &(link->aesIV0), sizeof(hw_key.iv));
+        bl_aes_backend_sw.crypt(&hw_key, (uint8_t*)(uintptr_t)link->aesSrcAddr,
+                (uint8_t*)(uintptr_t)link->aesDstAddr, link->aesMsgLen * 16);
+        memcpy(&(link->aesIV0), hw_key.iv, sizeof(hw_key.iv));
+        hw_descriptors = hw_descriptors + 1;
+
+        pthread_mutex_lock(&hw_mutex);
+        hw_link = NULL;
+        pthread_mutex_unlock(&hw_mutex);
+
+        if (hw_irq_drop) {
+            hw_irq_drop = hw_irq_drop - 1;
+            continue;
+        }
+        if (link->aesIntSet) {
+            vTaskEnterCritical();
+            TrapNetCounter = 1;
+            hw_irq_cb(hw_irq_arg);
+            TrapNetCounter = 0;
+            vTaskExitCritical();
+        }
+    }
+
+    return NULL;
+}
+
+/* expected output straight from the software backend */
+static void reference(BLAesRequest &req, const uint8_t *src, uint8_t *dst, uint32_t iv_out[4])
+{
+    bl_aes_ctx_t ctx;
+
+    memset(&ctx, 0, sizeof(ctx));
+    memcpy(ctx.key, req.key, req.keysize);
+    ctx.keysize = req.keysize;
+    ctx.mode = (bl_aes_mode_t)req.mode;
+    ctx.dir = req.is_encryption ? BL_AES_ENCRYPT : BL_AES_DECRYPT;
+    memcpy(ctx.iv, req.iv, sizeof(ctx.iv));
+    bl_aes_backend_sw.setkey(&ctx);
+    bl_aes_backend_sw.crypt(&ctx, src, dst, req.len);
+    memcpy(iv_out, ctx.iv, sizeof(ctx.iv));
+}
+
+static void test_vector(BLAesEngine &engine)
+{
+    /* NIST SP 800-38A F.2.1 CBC-AES128.Encrypt, first two blocks */
+    static const uint8_t key[16] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    static const uint8_t iv[16] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    };
+    static const uint8_t plain[32] = {
+        0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+        0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    };
+    static const uint8_t cipher[32] = {
+        0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d,
+        0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72, 0x19, 0xee, 0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2,
+    };
+    uint8_t *buf = (uint8_t*)low_alloc(32);
+    BLAesRequest *req;
+
+    memcpy(buf, plain, 32);
+    req = new BLAesRequest((uint8_t*)key, (uint8_t*)iv, buf, buf, 32, 16, BLAesRequest::MODE_CBC);
+    if (engine.encryption(*req) || memcmp(buf, cipher, 32) || memcmp(req->iv, cipher + 16, 16)) {
+        printf("FAIL CBC-AES128 vector\n");
+        test_failed = 1;
+    }
+    memcpy(req->iv, iv, 16);
+    if (engine.decryption(*req) || memcmp(buf, plain, 32)) {
+        printf("FAIL CBC-AES128 vector decryption\n");
+        test_failed = 1;
+    }
+    delete req;
+}
+
+#define STRESS_TASKS        (6)
+#define STRESS_REQUESTS     (400)
+#define STRESS_MAX_LEN      (4096)
+
+struct stress_arg {
+    BLAesEngine *engine;
+    unsigned int seed;
+    volatile uint32_t async_done;
+};
+
+static void stress_done(BLAesRequest &req, void *arg)
+{
+    (void)req;
+    __atomic_add_fetch(&((struct stress_arg*)arg)->async_done, 1, __ATOMIC_RELAXED);
+}
+
+static void *stress_task(void *arg)
+{
+    struct stress_arg *sa = (struct stress_arg*)arg;
+    static const int keysizes[] = {16, 24, 32};
+    uint8_t key[32], iv[16];
+    uint8_t *src, *dst, *expect;
+    uint32_t iv_expect[4];
+    BLAesRequest *req, *async;
+    int i, j, n, len, status;
+
+    src = (uint8_t*)low_alloc(STRESS_MAX_LEN);
+    dst = (uint8_t*)low_alloc(STRESS_MAX_LEN);
+    expect = (uint8_t*)low_alloc(STRESS_MAX_LEN);
+
+    for (i = 0; i < STRESS_REQUESTS; i++) {
+        for (j = 0; j < 32; j++) {
+            key[j] = rand_r(&sa->seed);
+        }
+        for (j = 0; j < 16; j++) {
+            iv[j] = rand_r(&sa->seed);
+        }
+        len = 16 * (1 + rand_r(&sa->seed) % (STRESS_MAX_LEN / 16));
+        for (j = 0; j < len; j++) {
+            src[j] = rand_r(&sa->seed);
+        }
+        req = new BLAesRequest(key, iv, src, (rand_r(&sa->seed) & 1) ? dst : src, len,
+                keysizes[rand_r(&sa->seed) % 3], rand_r(&sa->seed) % 3);
+        req->is_encryption = rand_r(&sa->seed) & 1;
+        reference(*req, src, expect, iv_expect);
+
+        status = req->is_encryption ? sa->engine->encryption(*req) : sa->engine->decryption(*req);
+        if (status || memcmp(req->dst, expect, len) || memcmp(req->iv, iv_expect, 16)) {
+            printf("FAIL request mode %d keysize %d len %d enc %d\n", req->mode, req->keysize, len, req->is_encryption);
+            test_failed = 1;
+        }
+        delete req;
+
+        /* a burst of asynchronous requests with the same key, completed by done_cb */
+        if (0 == i % 16) {
+            n = 1 + rand_r(&sa->seed) % 8;
+            for (j = 0; j < n; j++) {
+                async = new BLAesRequest(key, iv, (uint8_t*)low_alloc(64), (uint8_t*)low_alloc(64), 64, 16, BLAesRequest::MODE_CTR);
+                async->done_cb = stress_done;
+                async->done_cb_arg = sa;
+                sa->engine->submit_encryption(*async);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void test_stress(BLAesEngine &engine, const char *name)
+{
+    struct stress_arg sa[STRESS_TASKS];
+    pthread_t th[STRESS_TASKS];
+    uint32_t requests, wakeups, async = 0, async_done = 0;
+    int i;
+
+    requests = engine.stat_requests;
+    wakeups = worker_wakeups;
+    for (i = 0; i < STRESS_TASKS; i++) {
+        sa[i].engine = &engine;
+        sa[i].seed = i + 1;
+        sa[i].async_done = 0;
+        thread_low(&th[i], stress_task, &sa[i]);
+    }
+    for (i = 0; i < STRESS_TASKS; i++) {
+        pthread_join(th[i], NULL);
+    }
+    /* async requests finish in the background */
+    for (i = 0; i < 1000; i++) {
+        async = engine.stat_requests - requests - STRESS_TASKS * STRESS_REQUESTS;
+        async_done = 0;
+        for (int t = 0; t < STRESS_TASKS; t++) {
+            async_done += sa[t].async_done;
+        }
+        if (async == async_done && async) {
+            break;
+        }
+        usleep(1000);
+    }
+    if (async != async_done || 0 == async) {
+        printf("FAIL %s async requests %u done %u\n", name, async, async_done);
+        test_failed = 1;
+    }
+    requests = engine.stat_requests - requests;
+    wakeups = worker_wakeups - wakeups;
+    printf("%-8s %u requests, %u worker wakeups, %u batches, max batch %u, errors %u\n",
+            name, requests, wakeups, engine.stat_batches, engine.stat_batch_max, engine.stat_errors);
+    if (engine.stat_batch_max < 2 || wakeups >= requests) {
+        printf("FAIL %s requests are not batched\n", name);
+        test_failed = 1;
+    }
+}
+
+/* a chain with bad requests in it, good ones around them still complete */
+static void test_errors(BLAesEngine &engine)
+{
+    uint8_t key[16] = {1}, iv[16] = {2};
+    uint8_t *buf = (uint8_t*)low_alloc(64), *expect = (uint8_t*)low_alloc(64);
+    uint32_t iv_expect[4], errors = engine.stat_errors;
+    BLAesRequest *req[4];
+    int i;
+
+    for (i = 0; i < 64; i++) {
+        buf[i] = i;
+    }
+    for (i = 0; i < 4; i++) {
+        req[i] = new BLAesRequest(key, iv, buf, buf, (i & 1) ? 33 : 64, 16, BLAesRequest::MODE_CBC);
+    }
+    req[0]->done_pre(1);
+    reference(*req[0], buf, expect, iv_expect);
+    /* hold the critical section so all four go in one chain */
+    vTaskEnterCritical();
+    for (i = 0; i < 4; i++) {
+        engine.submit_encryption(*req[i]);
+    }
+    vTaskExitCritical();
+    for (i = 0; i < 4; i++) {
+        if ((i & 1) != !!req[i]->done_wait()) {
+            printf("FAIL bad request %d status %d\n", i, req[i]->status);
+            test_failed = 1;
+        }
+    }
+    if (engine.stat_errors - errors != 2) {
+        printf("FAIL bad requests counted %u\n", engine.stat_errors - errors);
+        test_failed = 1;
+    }
+    for (i = 0; i < 4; i++) {
+        delete req[i];
+    }
+
+    /* a bad keysize is refused, not run with a 16 byte key */
+    req[0] = new BLAesRequest(key, iv, buf, buf, 64, 20, BLAesRequest::MODE_CBC);
+    memcpy(expect, buf, 64);
+    if (0 == req[0]->status || 0 == engine.encryption(*req[0]) ||
+            0 == req[0]->status || memcmp(buf, expect, 64)) {
+        printf("FAIL bad keysize status %d\n", req[0]->status);
+        test_failed = 1;
+    }
+    delete req[0];
+}
+
+/* more than 0xFFFF blocks takes several descriptors, chained iv carries over */
+static void test_huge(BLAesEngine &engine)
+{
+    size_t len = 0xFFFF * 16 * 2 + 4096;
+    uint8_t key[32], iv[16];
+    uint8_t *buf = (uint8_t*)low_alloc(len), *expect = (uint8_t*)low_alloc(len);
+    uint32_t iv_expect[4], descriptors = hw_descriptors;
+    BLAesRequest *req;
+    size_t i;
+
+    for (i = 0; i < sizeof(key); i++) {
+        key[i] = i * 7;
+    }
+    memset(iv, 0xFF, sizeof(iv));
+    for (i = 0; i < len; i++) {
+        buf[i] = i * 13;
+    }
+    req = new BLAesRequest(key, iv, buf, buf, len, 32, BLAesRequest::MODE_CTR);
+    req->is_encryption = 1;
+    reference(*req, buf, expect, iv_expect);
+    if (engine.encryption(*req) || memcmp(buf, expect, len) || memcmp(req->iv, iv_expect, 16)) {
+        printf("FAIL huge request\n");
+        test_failed = 1;
+    }
+    if (hw_descriptors - descriptors != 3) {
+        printf("FAIL huge request took %u descriptors\n", hw_descriptors - descriptors);
+        test_failed = 1;
+    }
+    delete req;
+}
+
+/* IRQ never comes, the chain times out and the engine keeps working */
+static void test_lost_irq(BLAesEngine &engine)
+{
+    uint8_t key[16] = {3}, iv[16] = {4};
+    uint8_t *buf = (uint8_t*)low_alloc(32);
+    BLAesRequest *req = new BLAesRequest(key, iv, buf, buf, 32, 16, BLAesRequest::MODE_ECB);
+    TickType_t t;
+
+    hw_irq_drop = 1;
+    t = xTaskGetTickCount();
+    if (0 == engine.encryption(*req)) {
+        printf("FAIL lost IRQ not reported\n");
+        test_failed = 1;
+    }
+    t = xTaskGetTickCount() - t;
+    if (t < AES_ENGINE_CHAIN_TIMEOUT_MS || t > 2 * AES_ENGINE_CHAIN_TIMEOUT_MS) {
+        printf("FAIL lost IRQ reported after %u ms\n", (unsigned int)t);
+        test_failed = 1;
+    }
+    if (engine.encryption(*req)) {
+        printf("FAIL engine stuck after lost IRQ\n");
+        test_failed = 1;
+    }
+    delete req;
+}
+
+int main(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_t th;
+    BLAesEngine *engine;
+    BLAesEngineSw *engine_sw;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&crit, &attr);
+    pthread_create(&th, NULL, hw_thread, NULL);
+
+    engine = new BLAesEngine();
+    engine->start();
+    test_vector(*engine);
+    test_stress(*engine, "sec_eng");
+    test_errors(*engine);
+    test_huge(*engine);
+    test_lost_irq(*engine);
+    printf("sec_eng  %u descriptors, %u with the key kept\n", hw_descriptors, hw_key_reuses);
+    engine->stat_dump();
+
+    engine_sw = new BLAesEngineSw();
+    engine_sw->start();
+    test_vector(*engine_sw);
+    test_stress(*engine_sw, "software");
+    test_errors(*engine_sw);
+    engine_sw->stat_dump();
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
@@ -30,16 +30,21 @@
 #include <stdio.h>
 #include <platform_hal_device.h>
 
+extern "C" {
+#include <bl602_sec_eng.h>
+#include <bl_sec.h>
+}
+
 extern "C" void* operator new(size_t size) 
 {
     /* printf("[C++] new %d\r\n", size); */
-    return pvPortMalloc(size); 
+    return pvPortMallocFrom(size, __builtin_return_address(0));
 }
 
 extern "C" void* operator new[](size_t size) 
 {
     /* printf("[C++] new[] %d\r\n", size); */
-    return pvPortMalloc(size); 
+    return pvPortMallocFrom(size, __builtin_return_address(0));
 }
 
 extern "C" void operator delete(void* ptr) {
@@ -99,16 +104,12 @@ BLLinkedList::BLLinkedList()
 
 BLLinkedList* BLLinkedList::push(class BLLinkedItem &item) 
 {
-    printf("[BLLinkedList] push %p\r\n", &item);
-
     if (NULL == this->head) {
-        printf("new push\r\n");
         this->head = &item;
         this->tail = &item;
         return this;
     }
     /*tail should NOT be NULL, assert here if tail is NULL?*/
-    printf("continue push\r\n");
     if (NULL == this->tail->attach(item)) {
         return NULL;
     }
@@ -122,17 +123,39 @@ BLLinkedItem* BLLinkedList::pop()
     BLLinkedItem *item;
 
     if (NULL == this->head) {
-        printf("NULL HEAD\r\n");
         return NULL;
     }
     item = this->head;
     this->head = item->detach();
+    if (NULL == this->head) {
+        this->tail = NULL;
+    }
 
-    printf("[POP] POP %p\r\n", item);
+    return item;
+}
+
+BLLinkedItem* BLLinkedList::pop_all()
+{
+    BLLinkedItem *item;
+
+    /*items are still chained, use detach to walk through them*/
+    item = this->head;
+    this->head = NULL;
+    this->tail = NULL;
 
     return item;
 }
 
+int BLLinkedList::empty()
+{
+    return NULL == this->head;
+}
+
+static inline int aes_request_keysize_valid(int keysize)
+{
+    return 16 == keysize || 24 == keysize || 32 == keysize;
+}
+
 BLAesRequest::BLAesRequest()
 {
     memset(this->key, 0, sizeof(this->key));
@@ -140,25 +163,50 @@ BLAesRequest::BLAesRequest()
     this->src = NULL;
     this->dst = NULL;
     this->len = 0;
+    this->keysize = 16;
+    this->mode = MODE_CBC;
     this->first_use = 0;
+    this->is_encryption = 1;
+    this->status = 0;
+    this->task_handle = NULL;
+    this->done = 0;
+    this->done_cb = NULL;
+    this->done_cb_arg = NULL;
 }
 
-BLAesRequest::BLAesRequest(uint8_t *key, uint8_t *iv, uint8_t *src, uint8_t *dst, int len)
+BLAesRequest::BLAesRequest(uint8_t *key, uint8_t *iv, uint8_t *src, uint8_t *dst, int len, int keysize, int mode)
 {
-    memcpy(this->key, key, sizeof(this->key));
+    memset(this->key, 0, sizeof(this->key));
+    memset(this->iv, 0, sizeof(this->iv));
+    /*a bad keysize fails the request, never fall back to another key length*/
+    this->status = 0;
+    if (aes_request_keysize_valid(keysize)) {
+        memcpy(this->key, key, keysize);
+    } else {
+        printf("[ERR] invalid AES keysize %d\r\n", keysize);
+        this->status = -1;
+    }
     if (iv) {
         memcpy(this->iv, iv, sizeof(this->iv));
     }
     this->src = src;
     this->dst = dst;
     this->len = len;
+    this->keysize = keysize;
+    this->mode = mode;
     this->first_use = 0;
+    this->is_encryption = 1;
+    this->task_handle = NULL;
+    this->done = 0;
+    this->done_cb = NULL;
+    this->done_cb_arg = NULL;
 }
 
 int BLAesRequest::done_pre(int use_encryption)
 {
     this->task_handle = xTaskGetCurrentTaskHandle();
     this->done = 0;
+    this->status = 0;
     this->is_encryption = use_encryption;
 
     return 0;
@@ -169,93 +217,491 @@ int BLAesRequest::done_wait()
     while (0 == this->done) {
         ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     }
-    return 0;
+    return this->status;
 }
 
 int BLAesRequest::done_set()
 {
     this->done = 1;
-    xTaskNotifyGive(this->task_handle);
+    if (this->done_cb) {
+        this->done_cb(*this, this->done_cb_arg);
+    } else {
+        xTaskNotifyGive(this->task_handle);
+    }
 
     return 0;
 }
 
 int BLAesRequest::done_set_auto()
 {
-    this->done = 1;
-    //TODO 
-    printf("[C++] [%s] ongoing...\r\n", __PRETTY_FUNCTION__);
-
-    return 0;
+    if (xPortIsInsideInterrupt()) {
+        return this->done_set_FromISR();
+    }
+    return this->done_set();
 }
 
 int BLAesRequest::done_set_FromISR()
 {
-    BaseType_t xHigherPriorityTaskWoken;
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
     this->done = 1;
+    if (this->done_cb) {
+        this->done_cb(*this, this->done_cb_arg);
+        return 0;
+    }
     vTaskNotifyGiveFromISR(this->task_handle, &xHigherPriorityTaskWoken);
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 
     return 0;
 }
 
-int BLAesEngine::encryption(BLAesRequest &req)
+/*worker notification bits*/
+#define AES_ENGINE_EVENT_SUBMIT     (1 << 0)
+#define AES_ENGINE_EVENT_CHAIN_DONE (1 << 1)
+/*aesMsgLen is 16 bits wide*/
+#define AES_ENGINE_LINK_MAX_LEN     (0xFFFF * 16)
+/*a chain never takes this long, SEC_ENG runs about 1MB per 10ms*/
+#define AES_ENGINE_CHAIN_TIMEOUT_MS (1000)
+
+BLAesEngine::BLAesEngine()
 {
-    printf("%s %p...\r\n", __PRETTY_FUNCTION__, &req);
+    this->worker = NULL;
+    memset(this->key_loaded, 0, sizeof(this->key_loaded));
+    this->keysize_loaded = 0;
+    this->is_encryption_loaded = -1;
+    this->running_req = NULL;
+    this->stat_requests = 0;
+    this->stat_batches = 0;
+    this->stat_blocks = 0;
+    this->stat_errors = 0;
+    this->stat_batch_max = 0;
+}
 
-    /*request prepare*/
-    req.done_pre(1);
-    /*push to queue and trigger if necessary*/
-    if (NULL == this->push(req)) {
+int BLAesEngine::start(int priority, int stack_depth)
+{
+    if (this->worker) {
+        return 0;
+    }
+    if (pdPASS != xTaskCreate(BLAesEngine::worker_entry, "aes_engine", stack_depth, this, priority, &(this->worker))) {
+        printf("[ERR] [AES] create worker failed\r\n");
+        this->worker = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void BLAesEngine::worker_entry(void *arg)
+{
+    static_cast<BLAesEngine*>(arg)->worker_loop();
+}
+
+void BLAesEngine::worker_loop()
+{
+    BLLinkedItem *item;
+    uint32_t batch;
+
+    while (1) {
+        xTaskNotifyWait(0, 0xFFFFFFFF, NULL, portMAX_DELAY);
+
+        /*take every pending request at once, new ones will wake us up again*/
+        while (1) {
+            taskENTER_CRITICAL();
+            item = this->pop_all();
+            taskEXIT_CRITICAL();
+            if (NULL == item) {
+                break;
+            }
+
+            this->is_encryption_loaded = -1;
+            this->crypt_begin();
+            batch = this->crypt_chain(static_cast<BLAesRequest*>(item));
+            this->crypt_end();
+
+            this->stat_batches++;
+            if (batch > this->stat_batch_max) {
+                this->stat_batch_max = batch;
+            }
+        }
+    }
+}
+
+/*SEC_ENG direction, CTR mode is symmetric and always runs the forward cipher*/
+static inline int aes_engine_forward(BLAesRequest &req)
+{
+    return req.is_encryption || BLAesRequest::MODE_CTR == req.mode;
+}
+
+/*back-to-back requests with the same key skip the key expansion*/
+int BLAesEngine::key_reusable(BLAesRequest &req)
+{
+    return (this->is_encryption_loaded == aes_engine_forward(req) &&
+            this->keysize_loaded == req.keysize &&
+            0 == memcmp(this->key_loaded, req.key, req.keysize));
+}
+
+void BLAesEngine::key_loaded_set(BLAesRequest *req)
+{
+    if (NULL == req) {
+        this->is_encryption_loaded = -1;
+        return;
+    }
+    memcpy(this->key_loaded, req->key, sizeof(this->key_loaded));
+    this->keysize_loaded = req->keysize;
+    this->is_encryption_loaded = aes_engine_forward(*req);
+}
+
+void BLAesEngine::complete(BLAesRequest &req, int status)
+{
+    this->stat_requests++;
+    if (status) {
+        this->stat_errors++;
+    } else {
+        this->stat_blocks += req.len / 16;
+    }
+    req.status = status;
+    /*req may be released by its owner as soon as done is set*/
+    req.done_set();
+}
+
+void BLAesEngine::complete_FromISR(BLAesRequest &req, int status)
+{
+    this->stat_requests++;
+    if (status) {
+        this->stat_errors++;
+    } else {
+        this->stat_blocks += req.len / 16;
+    }
+    req.status = status;
+    req.done_set_FromISR();
+}
+
+void BLAesEngine::crypt_begin()
+{
+    /*SEC_ENG AES is shared with bl_aes API, hold it for the whole batch*/
+    bl_aes_mutex_take();
+    bl_aes_irq_register(BLAesEngine::irq_entry, this);
+    Sec_Eng_AES_Enable_BE(SEC_ENG_AES_ID0);
+    Sec_Eng_AES_Enable_Link(SEC_ENG_AES_ID0);
+}
+
+int BLAesEngine::link_setup(BLAesRequest &req, int reuse_key)
+{
+    SEC_Eng_AES_Link_Config_Type *linkCfg = &(req.link);
+
+    if (0 == req.len || 0 != (req.len % 16) || NULL == req.src || NULL == req.dst) {
+        return -1;
+    }
+    memset(linkCfg, 0, sizeof(SEC_Eng_AES_Link_Config_Type));
+    switch (req.keysize) {
+        case 16:
+        {
+            linkCfg->aesMode = SEC_ENG_AES_KEY_128BITS;
+        }
+        break;
+        case 24:
+        {
+            linkCfg->aesMode = SEC_ENG_AES_KEY_192BITS;
+        }
+        break;
+        case 32:
+        {
+            linkCfg->aesMode = SEC_ENG_AES_KEY_256BITS;
+        }
+        break;
+        default:
+        {
+            return -1;
+        }
+    }
+    linkCfg->aesBlockMode = req.mode;
+    linkCfg->aesDecEn = aes_engine_forward(req) ? SEC_ENG_AES_ENCRYPTION : SEC_ENG_AES_DECRYPTION;
+    linkCfg->aesDecKeySel = reuse_key ? SEC_ENG_AES_USE_OLD : SEC_ENG_AES_USE_NEW;
+    linkCfg->aesIVSel = SEC_ENG_AES_USE_NEW;
+    /*every descriptor raises the AES IRQ, which starts the next one*/
+    linkCfg->aesIntSet = 1;
+    /*key and iv words are already in the byte order link mode expects*/
+    memcpy(&(linkCfg->aesKey0), req.key, sizeof(req.key));
+    memcpy(&(linkCfg->aesIV0), req.iv, sizeof(req.iv));
+    req.pos = 0;
+    this->link_next(req);
+
+    return 0;
+}
+
+/*point descriptor at the next chunk, iv chained by SEC_ENG stays in descriptor*/
+void BLAesEngine::link_next(BLAesRequest &req)
+{
+    SEC_Eng_AES_Link_Config_Type *linkCfg = &(req.link);
+    size_t chunk;
+
+    chunk = req.len - req.pos;
+    if (chunk > AES_ENGINE_LINK_MAX_LEN) {
+        chunk = AES_ENGINE_LINK_MAX_LEN;
+    }
+    linkCfg->aesMsgLen = chunk / 16;
+    linkCfg->aesSrcAddr = (uint32_t)(uintptr_t)(req.src + req.pos);
+    linkCfg->aesDstAddr = (uint32_t)(uintptr_t)(req.dst + req.pos);
+}
+
+uint32_t BLAesEngine::crypt_chain(BLAesRequest *head)
+{
+    BLLinkedItem *item, *next;
+    BLAesRequest *req, *last;
+    uint32_t batch;
+    TickType_t now, deadline;
+
+    /*set up one descriptor per request, bad ones are completed right away*/
+    batch = 0;
+    last = NULL;
+    for (item = head; item; item = next) {
+        next = item->detach();
+        req = static_cast<BLAesRequest*>(item);
+        batch++;
+        if (this->link_setup(*req, last && this->key_reusable(*req))) {
+            this->complete(*req, -1);
+            continue;
+        }
+        this->key_loaded_set(req);
+        this->running.push(*req);
+        last = req;
+    }
+    this->key_loaded_set(NULL);
+    if (NULL == last) {
+        return batch;
+    }
+
+    /*the IRQ walks the chain from here on, worker sleeps until it is drained*/
+    taskENTER_CRITICAL();
+    this->running_req = static_cast<BLAesRequest*>(this->running.pop());
+    if (bl_aes_link_trigger(&(this->running_req->link))) {
+        this->running.push(*(this->running_req));
+        this->running_req = NULL;
+    }
+    taskEXIT_CRITICAL();
+
+    deadline = xTaskGetTickCount() + pdMS_TO_TICKS(AES_ENGINE_CHAIN_TIMEOUT_MS);
+    while (this->running_req) {
+        now = xTaskGetTickCount();
+        if ((int32_t)(now - deadline) >= 0) {
+            printf("[ERR] [AES] chain timeout\r\n");
+            break;
+        }
+        xTaskNotifyWait(0, AES_ENGINE_EVENT_CHAIN_DONE, NULL, deadline - now);
+    }
+
+    /*fail whatever the IRQ did not get to, trigger error or timeout*/
+    taskENTER_CRITICAL();
+    if (this->running_req) {
+        this->running.push(*(this->running_req));
+        this->running_req = NULL;
+    }
+    item = this->running.pop_all();
+    taskEXIT_CRITICAL();
+    for (; item; item = next) {
+        next = item->detach();
+        this->complete(*static_cast<BLAesRequest*>(item), -1);
+    }
+
+    return batch;
+}
+
+void BLAesEngine::irq_entry(void *arg)
+{
+    static_cast<BLAesEngine*>(arg)->irq_handler();
+}
+
+void BLAesEngine::irq_handler()
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    BLAesRequest *req = this->running_req;
+
+    if (NULL == req) {
+        return;
+    }
+    req->pos += req->link.aesMsgLen * 16;
+    if (req->pos < req->len) {
+        /*huge request, same descriptor goes again with key kept in engine*/
+        this->link_next(*req);
+        req->link.aesDecKeySel = SEC_ENG_AES_USE_OLD;
+        if (0 == bl_aes_link_trigger(&(req->link))) {
+            return;
+        }
+        req->status = -1;
+    } else {
+        /*write back chained iv/counter, so the next request continues the stream*/
+        memcpy(req->iv, &(req->link.aesIV0), sizeof(req->iv));
+        req->status = 0;
+    }
+
+    /*start the next descriptor first, req is NOT accessible after completion*/
+    this->running_req = static_cast<BLAesRequest*>(this->running.pop());
+    if (this->running_req && bl_aes_link_trigger(&(this->running_req->link))) {
+        this->running.push(*(this->running_req));
+        this->running_req = NULL;
+    }
+    this->complete_FromISR(*req, req->status);
+
+    if (NULL == this->running_req) {
+        xTaskNotifyFromISR(this->worker, AES_ENGINE_EVENT_CHAIN_DONE, eSetBits, &xHigherPriorityTaskWoken);
+        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    }
+}
+
+void BLAesEngine::crypt_end()
+{
+    Sec_Eng_AES_Disable_Link(SEC_ENG_AES_ID0);
+    bl_aes_mutex_give();
+}
+
+void BLAesEngineSw::crypt_begin()
+{
+}
+
+uint32_t BLAesEngineSw::crypt_chain(BLAesRequest *head)
+{
+    BLLinkedItem *item, *next;
+    BLAesRequest *req;
+    bl_aes_ctx_t ctx;
+    uint32_t batch = 0;
+    int status;
+
+    /*ctx keeps the expanded key, so back-to-back requests with the same key reuse it*/
+    memset(&ctx, 0, sizeof(ctx));
+    for (item = head; item; item = next) {
+        next = item->detach();
+        req = static_cast<BLAesRequest*>(item);
+        batch++;
+
+        status = -1;
+        if (0 != req->len && 0 == (req->len % 16) && req->src && req->dst &&
+                aes_request_keysize_valid(req->keysize)) {
+            if (!this->key_reusable(*req)) {
+                memset(&ctx, 0, sizeof(ctx));
+                memcpy(ctx.key, req->key, req->keysize);
+                ctx.keysize = req->keysize;
+                status = bl_aes_backend_sw.setkey(&ctx);
+            } else {
+                status = 0;
+            }
+        }
+        if (0 == status) {
+            ctx.mode = (bl_aes_mode_t)req->mode;
+            ctx.dir = req->is_encryption ? BL_AES_ENCRYPT : BL_AES_DECRYPT;
+            memcpy(ctx.iv, req->iv, sizeof(ctx.iv));
+            status = bl_aes_backend_sw.crypt(&ctx, req->src, req->dst, req->len);
+            memcpy(req->iv, ctx.iv, sizeof(req->iv));
+        }
+        this->key_loaded_set(status ? NULL : req);
+        /*req is NOT accessible after completion*/
+        this->complete(*req, status);
+    }
+    memset(&ctx, 0, sizeof(ctx));
+    this->key_loaded_set(NULL);
+
+    return batch;
+}
+
+void BLAesEngineSw::crypt_end()
+{
+}
+
+int BLAesEngine::enqueue(BLAesRequest &req, int use_encryption)
+{
+    BLLinkedList *ret;
+
+    if (NULL == this->worker) {
+        printf("[ERR] [AES] engine is NOT started\r\n");
+        return -1;
+    }
+    if (!aes_request_keysize_valid(req.keysize)) {
+        req.status = -1;
+        return -1;
+    }
+    req.done_pre(use_encryption);
+    taskENTER_CRITICAL();
+    ret = this->push(req);
+    taskEXIT_CRITICAL();
+    if (NULL == ret) {
         return -1;
     }
-    this->encryption_trigger();
-    /*request wait*/
-    req.done_wait();
 
     return 0;
 }
 
 void BLAesEngine::encryption_trigger()
 {
-    /*Trigger SOFTIRQ if necessary*/
-    return;
+    xTaskNotify(this->worker, AES_ENGINE_EVENT_SUBMIT, eSetBits);
 }
 
 void BLAesEngine::decryption_trigger()
 {
-    /*Trigger SOFTIRQ if necessary*/
-    return;
+    xTaskNotify(this->worker, AES_ENGINE_EVENT_SUBMIT, eSetBits);
 }
 
-int BLAesEngine::decryption(BLAesRequest &req)
+int BLAesEngine::submit_encryption(BLAesRequest &req)
 {
-    printf("%s %p...\r\n", __PRETTY_FUNCTION__, &req);
+    if (this->enqueue(req, 1)) {
+        return -1;
+    }
+    this->encryption_trigger();
+
+    return 0;
+}
 
-    /*request prepare*/
-    req.done_pre(0);
-    /*push to queue and trigger if necessary*/
-    if (NULL == this->push(req)) {
+int BLAesEngine::submit_decryption(BLAesRequest &req)
+{
+    if (this->enqueue(req, 0)) {
         return -1;
     }
     this->decryption_trigger();
-    /*request wait*/
-    req.done_wait();
 
     return 0;
 }
 
+int BLAesEngine::encryption(BLAesRequest &req)
+{
+    if (this->submit_encryption(req)) {
+        return -1;
+    }
+    return req.done_wait();
+}
+
+int BLAesEngine::decryption(BLAesRequest &req)
+{
+    if (this->submit_decryption(req)) {
+        return -1;
+    }
+    return req.done_wait();
+}
+
+void BLAesEngine::stat_dump()
+{
+    printf("[AES] requests %lu, blocks %lu, batches %lu, max batch %lu, errors %lu\r\n",
+            (unsigned long)this->stat_requests,
+            (unsigned long)this->stat_blocks,
+            (unsigned long)this->stat_batches,
+            (unsigned long)this->stat_batch_max,
+            (unsigned long)this->stat_errors
+    );
+}
+
 static class BLAesEngine *aes_engine;
+
+class BLAesEngine* platform_hal_aes_engine_get()
+{
+    return aes_engine;
+}
+
 extern "C" int platform_hal_device_init(void)
 {
-    class BLAesRequest *aes_request = new BLAesRequest[6];
+    if (aes_engine) {
+        return 0;
+    }
     aes_engine = new BLAesEngine();
+    if (NULL == aes_engine) {
+        return -1;
+    }
 
-    (void)aes_request;
-#if 0
-    aes_engine->encryption(aes_request[0]);
-#endif
-
-    return 0;
+    return aes_engine->start();
 }
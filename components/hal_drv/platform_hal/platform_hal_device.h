@@ -49,6 +49,9 @@ void *memset(void *s, int c, size_t n);
 
 #ifdef __cplusplus
 #include <stdint.h>
+extern "C" {
+#include <bl602_sec_eng.h>
+}
 
 class BLLinkedItem {
 private:
@@ -61,20 +64,36 @@ public:
 
 class BLAesRequest : public BLLinkedItem {
 public:
-    uint32_t key[4];
+    /*same order as SEC_ENG_AES_Type*/
+    enum {
+        MODE_ECB = 0,
+        MODE_CTR = 1,
+        MODE_CBC = 2,
+    };
+
+    uint32_t key[8];
     uint32_t iv[4];
     uint8_t *src;
     uint8_t *dst;
     size_t len;
+    int keysize;//key length in bytes, 16/24/32
+    int mode;
     int first_use;
 
-    int is_encryption;//0 for encryption, 1 for decryption
+    int is_encryption;//1 for encryption, 0 for decryption
+    int status;//0 for success, negative for error, valid after done and, for a bad keysize, after construction
     /*section for task control*/
     TaskHandle_t task_handle;
-    int done;
+    volatile int done;
+    /*called from engine context when set, may be the AES IRQ, NO task notification is sent then*/
+    void (*done_cb)(class BLAesRequest &req, void *arg);
+    void *done_cb_arg;
+    /*section for engine, descriptor is owned by SEC_ENG until done*/
+    SEC_Eng_AES_Link_Config_Type link;
+    size_t pos;
 public:
     BLAesRequest();
-    BLAesRequest(uint8_t *key, uint8_t *iv, uint8_t *src, uint8_t *dst, int len);
+    BLAesRequest(uint8_t *key, uint8_t *iv, uint8_t *src, uint8_t *dst, int len, int keysize = 16, int mode = MODE_CBC);
     int done_pre(int use_encryption);
     int done_wait();
     int done_set();
@@ -90,20 +109,76 @@ public:
     BLLinkedList();
     class BLLinkedList* push(class BLLinkedItem &item);
     class BLLinkedItem* pop();
+    class BLLinkedItem* pop_all();
+    int empty();
     class BLLinkedList* dump();
 };
 
 class BLAesEngine : public BLLinkedList {
 private:
-    class BLLinkedList head;
+    TaskHandle_t worker;
+    /*key currently loaded in engine, used for skipping key reload*/
+    uint32_t key_loaded[8];
+    int keysize_loaded;
+    int is_encryption_loaded;
+    /*chain walked by the AES IRQ, head is the request in flight*/
+    BLLinkedList running;
+    BLAesRequest *running_req;
 
     void encryption_trigger();
     void decryption_trigger();
+    int enqueue(BLAesRequest &req, int use_encryption);
+    int link_setup(BLAesRequest &req, int reuse_key);
+    void link_next(BLAesRequest &req);
+    void irq_handler();
+    static void irq_entry(void *arg);
+    void worker_loop();
+    static void worker_entry(void *arg);
+
+protected:
+    int key_reusable(BLAesRequest &req);
+    void key_loaded_set(BLAesRequest *req);
+    void complete(BLAesRequest &req, int status);
+    void complete_FromISR(BLAesRequest &req, int status);
+    /*
+     * backend hooks, crypt_chain runs every request chained from head and
+     * completes each of them, returns the number of requests.
+     * Default implementation runs on SEC_ENG link mode, driven by the AES IRQ
+     */
+    virtual void crypt_begin();
+    virtual uint32_t crypt_chain(BLAesRequest *head);
+    virtual void crypt_end();
+
 public:
+    /*statistic*/
+    uint32_t stat_requests;
+    uint32_t stat_batches;
+    uint32_t stat_blocks;
+    uint32_t stat_errors;
+    uint32_t stat_batch_max;
+
+    BLAesEngine();
+    virtual ~BLAesEngine() {}
+    int start(int priority = 20, int stack_depth = 512);
+    /*asynchronous, request is completed by done_cb or task notification*/
+    int submit_encryption(BLAesRequest &req);
+    int submit_decryption(BLAesRequest &req);
+    /*synchronous, wait until request is done*/
     int encryption(BLAesRequest &req);
     int decryption(BLAesRequest &req);
+    void stat_dump();
 };
 
+/*software reference backend, runs requests in the worker task*/
+class BLAesEngineSw : public BLAesEngine {
+protected:
+    virtual void crypt_begin();
+    virtual uint32_t crypt_chain(BLAesRequest *head);
+    virtual void crypt_end();
+};
+
+class BLAesEngine* platform_hal_aes_engine_get();
+
 #endif
 
 #endif
@@ -7,7 +7,7 @@ COMPONENT_ADD_INCLUDEDIRS += include
 COMPONENT_PRIV_INCLUDEDIRS :=
 
 ## This component's src
-COMPONENT_SRCS := http_client.c
+COMPONENT_SRCS := http_client.c http_client_parse.c
 
 
 COMPONENT_OBJS := $(patsubst %.c,%.o, $(COMPONENT_SRCS))
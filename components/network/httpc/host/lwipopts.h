@@ -0,0 +1,49 @@
+/*
+ * lwIP for the http client host tests: NO_SYS, TCP over the loopback
+ * netif only, a small MSS so responses span many segments and pbufs.
+ */
+#ifndef HTTPC_HOST_LWIPOPTS_H
+#define HTTPC_HOST_LWIPOPTS_H
+
+#define NO_SYS                          1
+#define SYS_LIGHTWEIGHT_PROT            0
+#define LWIP_TIMERS                     1
+#define LWIP_SOCKET                     0
+#define LWIP_NETCONN                    0
+
+#define MEM_LIBC_MALLOC                 0
+#define MEM_ALIGNMENT                   8
+#define MEM_SIZE                        (256 * 1024)
+#define MEMP_NUM_PBUF                   256
+#define PBUF_POOL_SIZE                  256
+#define MEMP_NUM_TCP_PCB                16
+#define MEMP_NUM_TCP_SEG                256
+
+#define LWIP_IPV4                       1
+#define LWIP_IPV6                       0
+#define LWIP_ARP                        0
+#define LWIP_ETHERNET                   0
+#define LWIP_ICMP                       0
+#define LWIP_UDP                        0
+#define LWIP_DNS                        0
+#define LWIP_DHCP                       0
+#define LWIP_HAVE_LOOPIF                1
+#define LWIP_NETIF_LOOPBACK             1
+#define LWIP_LOOPBACK_MAX_PBUFS         0
+
+#define LWIP_TCP                        1
+#define LWIP_ALTCP                      1
+#define LWIP_ALTCP_TLS                  0
+#define LWIP_CALLBACK_API               1
+#define TCP_MSS                         128
+#define TCP_WND                         (16 * TCP_MSS)
+#define TCP_SND_BUF                     (8 * TCP_MSS)
+#define TCP_SND_QUEUELEN                64
+
+/* the tests check that the heap and the pcb pool are back to empty */
+#define LWIP_STATS                      1
+#define MEM_STATS                       1
+#define MEMP_STATS                      1
+#define LWIP_STATS_DISPLAY              0
+
+#endif
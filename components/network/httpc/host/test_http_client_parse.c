@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Host test of the HTTP/1.x response framing (http_client_parse.c).
+ *
+ * Random sequences of responses on one connection are cut at random points
+ * and fed the way http_client.c does: framing through httpc_parse_feed(),
+ * body bytes taken by the caller as httpc_parse_body_left() allows. Bodies,
+ * status codes and keep-alive must come out as they went in, however the
+ * bytes were split. Then the chunk size limits and malformed framing.
+ *
+ * Built and run by ctest, see README.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <http_client_parse.h>
+
+#define TEST_STREAM_MAX     (64 * 1024)
+#define TEST_BODY_MAX       2000
+#define TEST_RESP_MAX       8
+#define TEST_ROUNDS         10000
+
+typedef struct test_resp {
+  uint16_t status;
+  uint8_t keep_alive;
+  uint32_t body_len;
+  uint8_t body[TEST_BODY_MAX];
+} test_resp_t;
+
+static int test_failed;
+
+static uint8_t stream[TEST_STREAM_MAX];
+static uint32_t stream_len;
+static test_resp_t want[TEST_RESP_MAX], got[TEST_RESP_MAX];
+static int want_cnt, got_cnt, interim_cnt, want_interim;
+
+#define EXPECT(cond) do { \
+  if (!(cond)) { \
+    printf("FAIL line %d: %s\n", __LINE__, #cond); \
+    test_failed = 1; \
+  } \
+} while (0)
+
+static void
+put(const void *data, uint32_t len)
+{
+  if (stream_len + len > sizeof(stream)) {
+    printf("stream overflow\n");
+    exit(1);
+  }
+  memcpy(stream + stream_len, data, len);
+  stream_len += len;
+}
+
+static void
+put_str(const char *s)
+{
+  put(s, (uint32_t)strlen(s));
+}
+
+static void
+putf(const char *fmt, unsigned int v)
+{
+  char buf[128];
+
+  put(buf, (uint32_t)snprintf(buf, sizeof(buf), fmt, v));
+}
+
+/* Header lines that must not change the framing, some past the line limit */
+static void
+put_noise(void)
+{
+  static const char *noise[] = {
+    "Server: test\r\n",
+    "X-Content-Length: 12\r\n",
+    "Content-Type: text/plain; charset=utf-8\r\n",
+    "Set-Cookie: aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa=1\r\n",
+    "X-Long: transfer-encoding: chunked; connection: close; content-length: 5\r\n",
+  };
+  int n = rand() % 3;
+
+  while (n--) {
+    const char *s = noise[rand() % (int)(sizeof(noise) / sizeof(noise[0]))];
+    put_str(s);
+  }
+}
+
+static void
+put_chunked(const test_resp_t *r)
+{
+  uint32_t off = 0;
+
+  while (off < r->body_len) {
+    uint32_t k = 1 + (uint32_t)rand() % 400;
+
+    if (k > r->body_len - off) {
+      k = r->body_len - off;
+    }
+    switch (rand() % 4) {
+      case 0: putf("%x\r\n", k); break;
+      case 1: putf("%X;name=value\r\n", k); break;
+      case 2: putf("000%x ; a=b;c\r\n", k); break;
+      default: putf("%X;x=aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\r\n", k); break;
+    }
+    put(r->body + off, k);
+    put_str("\r\n");
+    off += k;
+  }
+  if (rand() & 1) {
+    put_str("0\r\n\r\n");
+  } else {
+    put_str("0;end\r\nX-Trailer: 1\r\nContent-Length: 99\r\n\r\n");
+  }
+}
+
+/* One random response, close_ok allows one framed by the close */
+static int
+put_response(test_resp_t *r, int close_ok)
+{
+  uint32_t i;
+  int kind = rand() % (close_ok ? 7 : 6);
+
+  r->body_len = (uint32_t)rand() % TEST_BODY_MAX;
+  for (i = 0; i < r->body_len; i++) {
+    r->body[i] = (uint8_t)rand();
+  }
+  r->status = 200;
+  r->keep_alive = 1;
+  if (rand() % 4 == 0) {
+    put_str("HTTP/1.1 100 Continue\r\n\r\n");
+    want_interim++;
+  }
+  switch (kind) {
+    case 0:
+    case 1:
+      put_str("HTTP/1.1 200 OK\r\n");
+      put_noise();
+      putf("content-length: %u\r\n", r->body_len);
+      put_noise();
+      put_str("\r\n");
+      put(r->body, r->body_len);
+      break;
+    case 2:
+    case 3:
+      put_str("HTTP/1.1 200 OK\r\n");
+      put_noise();
+      /* chunked wins over a Content-Length */
+      put_str((rand() & 1) ? "Transfer-Encoding: gzip, Chunked\r\n" : "Content-Length: 3\r\ntransfer-encoding: chunked\r\n");
+      put_str("\r\n");
+      put_chunked(r);
+      break;
+    case 4:
+      r->status = (rand() & 1) ? 204 : 304;
+      r->body_len = 0;
+      putf("HTTP/1.1 %u X\r\n", r->status);
+      put_noise();
+      put_str("\r\n");
+      break;
+    case 5:
+      /* HTTP/1.0 stays open only when the server says so */
+      put_str("HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\n");
+      putf("Content-Length: %u\r\n\r\n", r->body_len);
+      put(r->body, r->body_len);
+      break;
+    default:
+      r->keep_alive = 0;
+      put_str("HTTP/1.1 200 OK\r\n");
+      put_noise();
+      put_str("\r\n");
+      put(r->body, r->body_len);
+      return 1;
+  }
+  return 0;
+}
+
+static void
+done(const httpc_parse_t *ps)
+{
+  if (got_cnt >= TEST_RESP_MAX) {
+    EXPECT(0);
+    return;
+  }
+  got[got_cnt].status = ps->status;
+  got[got_cnt].keep_alive = ps->keep_alive;
+  got_cnt++;
+}
+
+/*
+ * Feed the stream as pieces ending at the given cut points, returns 0 or -1
+ * on a framing error. Body bytes go to the current response.
+ */
+static int
+feed(const uint32_t *cut, int cuts)
+{
+  httpc_parse_t ps;
+  uint32_t pos = 0;
+  int c;
+
+  httpc_parse_init(&ps);
+  got_cnt = 0;
+  interim_cnt = 0;
+  got[0].body_len = 0;
+  for (c = 0; c <= cuts; c++) {
+    uint32_t end = (c < cuts) ? cut[c] : stream_len;
+
+    while (pos < end) {
+      uint32_t left = httpc_parse_body_left(&ps);
+
+      if (left) {
+        uint32_t n = end - pos;
+        test_resp_t *r = &got[got_cnt < TEST_RESP_MAX ? got_cnt : TEST_RESP_MAX - 1];
+
+        if (n > left) {
+          n = left;
+        }
+        if (r->body_len + n > TEST_BODY_MAX) {
+          return -1;
+        }
+        memcpy(r->body + r->body_len, stream + pos, n);
+        r->body_len += n;
+        httpc_parse_body_consumed(&ps, n);
+        pos += n;
+      } else {
+        uint16_t used;
+        uint32_t n = end - pos;
+        httpc_parse_ev_t ev;
+
+        ev = httpc_parse_feed(&ps, stream + pos, (uint16_t)(n > 0xFFFF ? 0xFFFF : n), &used);
+        pos += used;
+        if (ev == HTTPC_PARSE_EV_ERROR) {
+          return -1;
+        }
+        if (ev == HTTPC_PARSE_EV_INTERIM) {
+          interim_cnt++;
+        }
+        if ((ev == HTTPC_PARSE_EV_NONE) && (used == 0) && !httpc_parse_is_done(&ps) &&
+            !httpc_parse_body_left(&ps)) {
+          printf("no progress at %u\n", (unsigned)pos);
+          return -1;
+        }
+      }
+      if (httpc_parse_is_done(&ps)) {
+        done(&ps);
+        httpc_parse_init(&ps);
+        if (got_cnt < TEST_RESP_MAX) {
+          got[got_cnt].body_len = 0;
+        }
+      }
+    }
+  }
+  if (httpc_parse_body_left(&ps) == HTTPC_PARSE_UNTIL_CLOSE) {
+    EXPECT(httpc_parse_closed(&ps));
+    done(&ps);
+  }
+  return 0;
+}
+
+static void
+test_random_splits(void)
+{
+  uint32_t cut[64];
+  int round, i;
+
+  for (round = 0; round < TEST_ROUNDS; round++) {
+    int cuts = rand() % 64;
+    int closed = 0;
+
+    stream_len = 0;
+    want_cnt = 1 + rand() % TEST_RESP_MAX;
+    want_interim = 0;
+    for (i = 0; i < want_cnt && !closed; i++) {
+      closed = put_response(&want[i], i == want_cnt - 1);
+    }
+    for (i = 0; i < cuts; i++) {
+      /* mostly small pieces, as out of a pbuf chain */
+      cut[i] = (rand() & 1) ? (uint32_t)rand() % (stream_len + 1) : (uint32_t)(i * 17) % (stream_len + 1);
+    }
+    for (i = 1; i < cuts; i++) {
+      uint32_t v = cut[i];
+      int j = i;
+
+      while (j > 0 && cut[j - 1] > v) {
+        cut[j] = cut[j - 1];
+        j--;
+      }
+      cut[j] = v;
+    }
+    if (feed(cut, cuts) != 0) {
+      printf("FAIL round %d: framing error\n", round);
+      test_failed = 1;
+      return;
+    }
+    EXPECT(got_cnt == want_cnt);
+    EXPECT(interim_cnt == want_interim);
+    for (i = 0; i < want_cnt && i < got_cnt; i++) {
+      if ((got[i].status != want[i].status) || (got[i].keep_alive != want[i].keep_alive) ||
+          (got[i].body_len != want[i].body_len) ||
+          memcmp(got[i].body, want[i].body, want[i].body_len) != 0) {
+        printf("FAIL round %d response %d: status %u/%u keep_alive %u/%u len %u/%u\n", round, i,
+               got[i].status, want[i].status, got[i].keep_alive, want[i].keep_alive,
+               (unsigned)got[i].body_len, (unsigned)want[i].body_len);
+        test_failed = 1;
+        return;
+      }
+    }
+    if (test_failed) {
+      return;
+    }
+  }
+}
+
+/* Feed a whole string of framing, returns the last event */
+static httpc_parse_ev_t
+feed_str(httpc_parse_t *ps, const char *s)
+{
+  uint16_t len = (uint16_t)strlen(s);
+  uint16_t used;
+  httpc_parse_ev_t ev = HTTPC_PARSE_EV_NONE;
+
+  while (len && !httpc_parse_body_left(ps) && !httpc_parse_is_done(ps)) {
+    ev = httpc_parse_feed(ps, (const uint8_t *)s, len, &used);
+    if (ev == HTTPC_PARSE_EV_ERROR) {
+      break;
+    }
+    s += used;
+    len = (uint16_t)(len - used);
+  }
+  return ev;
+}
+
+static void
+test_chunk_size(void)
+{
+  static const char *bad[] = {
+    "zz\r\n", "\r\n", ";ext\r\n", "-1\r\n", "0x10\r\n", "80000000\r\n", "FFFFFFFFF\r\n", "1 0\r\n1",
+  };
+  httpc_parse_t ps;
+  unsigned int i;
+
+  for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    httpc_parse_init(&ps);
+    EXPECT(feed_str(&ps, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n") == HTTPC_PARSE_EV_HEADERS);
+    if (feed_str(&ps, bad[i]) != HTTPC_PARSE_EV_ERROR) {
+      /* a size followed by junk where the next line should be is caught there */
+      if (httpc_parse_body_left(&ps) == 1) {
+        httpc_parse_body_consumed(&ps, 1);
+        if (feed_str(&ps, "x\r\n") == HTTPC_PARSE_EV_ERROR) {
+          continue;
+        }
+      }
+      printf("FAIL chunk size \"%s\" accepted\n", bad[i]);
+      test_failed = 1;
+    }
+  }
+
+  /* the largest chunk accepted, and upper case hex */
+  httpc_parse_init(&ps);
+  feed_str(&ps, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n7FFFFFFF\r\n");
+  EXPECT(httpc_parse_body_left(&ps) == 0x7FFFFFFF);
+  httpc_parse_init(&ps);
+  feed_str(&ps, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\naBc\r\n");
+  EXPECT(httpc_parse_body_left(&ps) == 0xABC);
+
+  /* chunk data must end with CRLF */
+  httpc_parse_init(&ps);
+  feed_str(&ps, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n2\r\n");
+  EXPECT(httpc_parse_body_left(&ps) == 2);
+  httpc_parse_body_consumed(&ps, 2);
+  EXPECT(feed_str(&ps, "xx\r\n") == HTTPC_PARSE_EV_ERROR);
+
+  /* a bare LF ends a line too */
+  httpc_parse_init(&ps);
+  feed_str(&ps, "HTTP/1.1 200 OK\nTransfer-Encoding: chunked\n\n3\n");
+  EXPECT(httpc_parse_body_left(&ps) == 3);
+  httpc_parse_body_consumed(&ps, 3);
+  EXPECT(feed_str(&ps, "\n0\n\n") == HTTPC_PARSE_EV_DONE);
+  EXPECT(httpc_parse_is_done(&ps));
+}
+
+static void
+test_malformed(void)
+{
+  httpc_parse_t ps;
+  char big[1024];
+  uint32_t i;
+
+  httpc_parse_init(&ps);
+  EXPECT(feed_str(&ps, "ICY 200 OK\r\n") == HTTPC_PARSE_EV_ERROR);
+  httpc_parse_init(&ps);
+  EXPECT(feed_str(&ps, "HTTP/1.1 2x0 OK\r\n") == HTTPC_PARSE_EV_ERROR);
+  httpc_parse_init(&ps);
+  EXPECT(feed_str(&ps, "HTTP/1.1 200 OK\r\nContent-Length: x\r\n") == HTTPC_PARSE_EV_ERROR);
+  httpc_parse_init(&ps);
+  EXPECT(feed_str(&ps, "HTTP/1.1 200 OK\r\nContent-Length: 4294967295\r\n") == HTTPC_PARSE_EV_ERROR);
+  httpc_parse_init(&ps);
+  EXPECT(feed_str(&ps, "HTTP/1.1 200 OK\r\nContent-Length: 4000000000\r\n\r\n") == HTTPC_PARSE_EV_HEADERS);
+  EXPECT(httpc_parse_body_left(&ps) == 4000000000u);
+
+  /* Connection: close and 101 end the connection after the response */
+  httpc_parse_init(&ps);
+  feed_str(&ps, "HTTP/1.1 200 OK\r\nconnection: Close\r\ncontent-length: 0\r\n\r\n");
+  EXPECT(httpc_parse_is_done(&ps) && !ps.keep_alive);
+  httpc_parse_init(&ps);
+  feed_str(&ps, "HTTP/1.1 101 Switching Protocols\r\n\r\n");
+  EXPECT(httpc_parse_is_done(&ps) && !ps.keep_alive);
+  httpc_parse_init(&ps);
+  feed_str(&ps, "HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n");
+  EXPECT(httpc_parse_is_done(&ps) && !ps.keep_alive);
+
+  /* headers are bounded, 1xx ones included */
+  httpc_parse_init(&ps);
+  EXPECT(feed_str(&ps, "HTTP/1.1 200 OK\r\n") == HTTPC_PARSE_EV_NONE);
+  memset(big, 'a', sizeof(big) - 3);
+  memcpy(big + sizeof(big) - 3, "\r\n", 3);
+  for (i = 0; i < HTTPC_PARSE_HDR_MAX / (sizeof(big) - 1) + 1; i++) {
+    if (feed_str(&ps, big) == HTTPC_PARSE_EV_ERROR) {
+      break;
+    }
+  }
+  EXPECT(i == HTTPC_PARSE_HDR_MAX / (sizeof(big) - 1));
+}
+
+int
+main(void)
+{
+  srand(1);
+  test_random_splits();
+  test_chunk_size();
+  test_malformed();
+  printf("%s\n", test_failed ? "FAILED" : "PASSED");
+  return test_failed;
+}
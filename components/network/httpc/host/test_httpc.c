@@ -0,0 +1,701 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Host test of the http client keep-alive pool (http_client.c).
+ *
+ * lwIP runs NO_SYS on the loopback netif with a virtual clock. A raw-API
+ * server on 127.0.0.1 answers the client in random 1..60 byte pieces, so
+ * status lines, headers, chunk framing and bodies end up split across
+ * segments. Response bodies are a known pattern and are checked byte for
+ * byte. The server counts accepted connections, which tells whether the
+ * client reused one or opened another.
+ *
+ * Built twice by ctest, with HTTPC_PIPELINING 0 and 1, see README.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/init.h"
+#include "lwip/tcp.h"
+#include "lwip/netif.h"
+#include "lwip/timeouts.h"
+#include "lwip/stats.h"
+#include "lwip/memp.h"
+
+#include <http_client.h>
+
+#define TEST_PORT           8080
+#define TEST_TICK_MS        5
+#define TEST_WAIT_TICKS     20000
+#define TEST_REQ_MAX        20
+
+typedef struct test_srv {
+  struct tcp_pcb *pcb;
+  char in[4096];
+  int in_len;
+  int nreq;
+  int closing;
+  int tx_closed, rx_closed;
+  char *out;
+  int out_len, out_off, out_cap;
+} test_srv_t;
+
+typedef struct test_req {
+  char uri[64];
+  u32_t expect;
+  u32_t got;
+  int done;
+  int bad;
+  httpc_result_t result;
+  u32_t status;
+} test_req_t;
+
+static int test_failed;
+
+static u32_t now_ms;
+static int srv_accepts, srv_closes;
+/* bytes the client sent after the server said it closes */
+static int srv_late_bytes;
+/* the server drops a connection on its n-th request instead of answering */
+static int srv_drop_nth;
+/* the server closes after each response without saying so */
+static int srv_idle_close;
+
+static httpc_connection_t settings;
+static ip_addr_t srv_addr;
+static int outstanding;
+static int hdr_calls, hdr_bad;
+
+#define EXPECT(cond) do { \
+  if (!(cond)) { \
+    printf("FAIL line %d: %s (accepts %d)\n", __LINE__, #cond, srv_accepts); \
+    test_failed = 1; \
+  } \
+} while (0)
+
+u32_t
+sys_now(void)
+{
+  return now_ms;
+}
+
+/* LWIP_RAND of the unix port's arch/cc.h */
+unsigned int
+lwip_port_rand(void)
+{
+  return (unsigned int)rand();
+}
+
+static u8_t
+pattern(u32_t i)
+{
+  return (u8_t)(i * 7 + 3);
+}
+
+static void
+srv_free(test_srv_t *s)
+{
+  free(s->out);
+  free(s);
+}
+
+static void
+srv_put(test_srv_t *s, const void *data, int len)
+{
+  if (s->out_len + len > s->out_cap) {
+    s->out_cap = (s->out_len + len) * 2;
+    s->out = realloc(s->out, (size_t)s->out_cap);
+  }
+  memcpy(s->out + s->out_len, data, (size_t)len);
+  s->out_len += len;
+}
+
+static void
+srv_put_str(test_srv_t *s, const char *str)
+{
+  srv_put(s, str, (int)strlen(str));
+}
+
+static void
+srv_put_body(test_srv_t *s, u32_t len)
+{
+  u8_t buf[256];
+  u32_t off = 0, i, k;
+
+  while (off < len) {
+    k = (len - off > sizeof(buf)) ? (u32_t)sizeof(buf) : len - off;
+    for (i = 0; i < k; i++) {
+      buf[i] = pattern(off + i);
+    }
+    srv_put(s, buf, (int)k);
+    off += k;
+  }
+}
+
+/*
+ * Send what is queued in random pieces. If asked to close, send the FIN
+ * once all is out but keep reading until the client closes too.
+ */
+static void
+srv_flush(test_srv_t *s)
+{
+  while (s->out_off < s->out_len) {
+    int k = 1 + rand() % 60;
+
+    if (k > s->out_len - s->out_off) {
+      k = s->out_len - s->out_off;
+    }
+    if ((tcp_sndbuf(s->pcb) < k) || (tcp_sndqueuelen(s->pcb) > TCP_SND_QUEUELEN - 4)) {
+      break;
+    }
+    if (tcp_write(s->pcb, s->out + s->out_off, (u16_t)k, TCP_WRITE_FLAG_COPY) != ERR_OK) {
+      break;
+    }
+    tcp_output(s->pcb);
+    s->out_off += k;
+  }
+  if ((s->out_off == s->out_len) && s->closing && !s->tx_closed) {
+    s->tx_closed = 1;
+    srv_closes++;
+    if (!s->rx_closed) {
+      tcp_shutdown(s->pcb, 0, 1);
+      return;
+    }
+  }
+  if (s->tx_closed && s->rx_closed) {
+    tcp_arg(s->pcb, NULL);
+    tcp_recv(s->pcb, NULL);
+    tcp_sent(s->pcb, NULL);
+    tcp_err(s->pcb, NULL);
+    tcp_close(s->pcb);
+    srv_free(s);
+  }
+}
+
+/* Queue the answer to one request, returns 1 if the connection closes after it */
+static int
+srv_answer(test_srv_t *s, const char *req)
+{
+  char uri[128], hdr[256];
+  unsigned int n = 0;
+
+  s->nreq++;
+  if (sscanf(req, "GET %127s", uri) != 1) {
+    printf("bad request\n");
+    exit(1);
+  }
+  if (strstr(req, "Connection: keep-alive") == NULL && strstr(req, "Connection: Close") == NULL) {
+    printf("no Connection header\n");
+    exit(1);
+  }
+  if (s->nreq == srv_drop_nth) {
+    s->closing = 1;
+    return 1;
+  }
+  if (sscanf(uri, "/cl/%u", &n) == 1) {
+    snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\ncontent-length: %u\r\nServer: test\r\n\r\n", n);
+    srv_put_str(s, hdr);
+    srv_put_body(s, n);
+  } else if (sscanf(uri, "/chunk/%u", &n) == 1) {
+    u32_t off = 0, k, i;
+    u8_t buf[300];
+
+    srv_put_str(s, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+    while (off < n) {
+      k = 1 + (u32_t)rand() % sizeof(buf);
+      if (k > n - off) {
+        k = n - off;
+      }
+      snprintf(hdr, sizeof(hdr), "%X;ext=1\r\n", (unsigned int)k);
+      srv_put_str(s, hdr);
+      for (i = 0; i < k; i++) {
+        buf[i] = pattern(off + i);
+      }
+      srv_put(s, buf, (int)k);
+      srv_put_str(s, "\r\n");
+      off += k;
+    }
+    srv_put_str(s, "0\r\nX-Trailer: y\r\n\r\n");
+  } else if (sscanf(uri, "/close/%u", &n) == 1) {
+    srv_put_str(s, "HTTP/1.1 200 OK\r\n\r\n");
+    srv_put_body(s, n);
+    s->closing = 1;
+    return 1;
+  } else if (sscanf(uri, "/connclose/%u", &n) == 1) {
+    snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: %u\r\n\r\n", n);
+    srv_put_str(s, hdr);
+    srv_put_body(s, n);
+    s->closing = 1;
+    return 1;
+  } else if (sscanf(uri, "/interim/%u", &n) == 1) {
+    snprintf(hdr, sizeof(hdr), "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK\r\nContent-Length: %u\r\n\r\n", n);
+    srv_put_str(s, hdr);
+    srv_put_body(s, n);
+  } else if (sscanf(uri, "/short/%u", &n) == 1) {
+    snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Length: %u\r\n\r\n", n * 2);
+    srv_put_str(s, hdr);
+    srv_put_body(s, n);
+    s->closing = 1;
+    return 1;
+  } else if (strcmp(uri, "/nocontent") == 0) {
+    srv_put_str(s, "HTTP/1.1 204 No Content\r\n\r\n");
+  } else if (strcmp(uri, "/garbage") == 0) {
+    srv_put_str(s, "ICY 200 OK\r\n\r\n");
+  } else {
+    printf("unknown uri %s\n", uri);
+    exit(1);
+  }
+  if (srv_idle_close) {
+    s->closing = 1;
+    return 1;
+  }
+  return 0;
+}
+
+static err_t
+srv_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(len);
+  if (arg != NULL) {
+    srv_flush((test_srv_t *)arg);
+  }
+  return ERR_OK;
+}
+
+static err_t
+srv_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  test_srv_t *s = (test_srv_t *)arg;
+  char req[sizeof(s->in)];
+  char *end;
+  int len;
+
+  LWIP_UNUSED_ARG(err);
+  if (p == NULL) {
+    s->rx_closed = 1;
+    s->closing = 1;
+    srv_flush(s);
+    return ERR_OK;
+  }
+  tcp_recved(pcb, p->tot_len);
+  if (s->closing) {
+    srv_late_bytes += p->tot_len;
+    pbuf_free(p);
+    return ERR_OK;
+  }
+  if (s->in_len + p->tot_len >= (int)sizeof(s->in)) {
+    printf("requests too long\n");
+    exit(1);
+  }
+  pbuf_copy_partial(p, s->in + s->in_len, p->tot_len, 0);
+  s->in_len += p->tot_len;
+  s->in[s->in_len] = '\0';
+  pbuf_free(p);
+  while ((end = strstr(s->in, "\r\n\r\n")) != NULL) {
+    len = (int)(end + 4 - s->in);
+    memcpy(req, s->in, (size_t)len);
+    req[len] = '\0';
+    memmove(s->in, s->in + len, (size_t)(s->in_len - len + 1));
+    s->in_len -= len;
+    if (srv_answer(s, req)) {
+      break;
+    }
+  }
+  srv_flush(s);
+  return ERR_OK;
+}
+
+static void
+srv_err(void *arg, err_t err)
+{
+  LWIP_UNUSED_ARG(err);
+  /* reset by the client, the pcb is already gone */
+  srv_free((test_srv_t *)arg);
+}
+
+static err_t
+srv_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  test_srv_t *s = (test_srv_t *)calloc(1, sizeof(test_srv_t));
+
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(err);
+  s->pcb = pcb;
+  srv_accepts++;
+  tcp_nagle_disable(pcb);
+  tcp_arg(pcb, s);
+  tcp_recv(pcb, srv_recv);
+  tcp_sent(pcb, srv_sent);
+  tcp_err(pcb, srv_err);
+  return ERR_OK;
+}
+
+static err_t
+client_recv(void *arg, struct altcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  test_req_t *r = (test_req_t *)arg;
+  struct pbuf *q;
+  u16_t i;
+
+  LWIP_UNUSED_ARG(err);
+  for (q = p; q != NULL; q = q->next) {
+    for (i = 0; i < q->len; i++) {
+      if (((u8_t *)q->payload)[i] != pattern(r->got + i)) {
+        r->bad = 1;
+      }
+    }
+    r->got += q->len;
+  }
+  altcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+static void
+client_result(void *arg, httpc_result_t httpc_result, u32_t rx_content_len, u32_t srv_res, err_t err)
+{
+  test_req_t *r = (test_req_t *)arg;
+
+  LWIP_UNUSED_ARG(err);
+  if (r->done) {
+    printf("FAIL %s: second result\n", r->uri);
+    test_failed = 1;
+    return;
+  }
+  r->done = 1;
+  r->result = httpc_result;
+  r->status = srv_res;
+  if (rx_content_len != r->got) {
+    r->bad = 1;
+  }
+  outstanding--;
+}
+
+static err_t
+client_headers(httpc_state_t *connection, void *arg, struct pbuf *hdr, u16_t hdr_len, u32_t content_len)
+{
+  LWIP_UNUSED_ARG(connection);
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(content_len);
+  hdr_calls++;
+  /* the final response's headers only, 1xx ones are dropped */
+  if ((pbuf_memcmp(hdr, 0, "HTTP/1.1 ", 9) != 0) ||
+      (pbuf_memcmp(hdr, 9, "100", 3) == 0) ||
+      (pbuf_memfind(hdr, "\r\n\r\n", 4, 0) + 4 != hdr_len)) {
+    hdr_bad++;
+  }
+  return ERR_OK;
+}
+
+static void
+start(test_req_t *r, const char *uri, u32_t expect)
+{
+  memset(r, 0, sizeof(test_req_t));
+  snprintf(r->uri, sizeof(r->uri), "%s", uri);
+  r->expect = expect;
+  outstanding++;
+  if (httpc_get_file(&srv_addr, TEST_PORT, r->uri, &settings, client_recv, r, NULL) != ERR_OK) {
+    printf("httpc_get_file %s failed\n", uri);
+    exit(1);
+  }
+}
+
+static void
+run(u32_t ms)
+{
+  u32_t end = now_ms + ms;
+
+  while (now_ms < end) {
+    netif_poll_all();
+    sys_check_timeouts();
+    now_ms += TEST_TICK_MS;
+  }
+}
+
+static void
+wait_all(void)
+{
+  int ticks = 0;
+
+  while (outstanding && (ticks++ < TEST_WAIT_TICKS)) {
+    netif_poll_all();
+    sys_check_timeouts();
+    now_ms += TEST_TICK_MS;
+  }
+  if (outstanding) {
+    printf("FAIL: %d requests stuck\n", outstanding);
+    exit(1);
+  }
+}
+
+static void
+check(const test_req_t *r, httpc_result_t result)
+{
+  if (!r->done || (r->result != result) ||
+      ((result == HTTPC_RESULT_OK) && (r->bad || (r->got != r->expect)))) {
+    printf("FAIL %s: done %d result %d want %d, got %u of %u bad %d\n",
+           r->uri, r->done, r->result, result, (unsigned int)r->got, (unsigned int)r->expect, r->bad);
+    test_failed = 1;
+  }
+}
+
+/* Keep-alive requests one after the other share one connection */
+static void
+test_sequential(test_req_t *r)
+{
+  char uri[64];
+  u32_t n;
+  int i;
+
+  srv_accepts = 0;
+  for (i = 0; i < TEST_REQ_MAX; i++) {
+    n = (u32_t)rand() % 5000;
+    snprintf(uri, sizeof(uri), (i & 1) ? "/chunk/%u" : "/cl/%u", (unsigned int)n);
+    start(&r[i], uri, n);
+    wait_all();
+    check(&r[i], HTTPC_RESULT_OK);
+  }
+  EXPECT(srv_accepts == 1);
+}
+
+/* Requests started together queue on it, more than the queue holds open another */
+static void
+test_queue(test_req_t *r)
+{
+  char uri[64];
+  u32_t n;
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    n = (u32_t)rand() % 3000;
+    snprintf(uri, sizeof(uri), (i & 1) ? "/chunk/%u" : "/cl/%u", (unsigned int)n);
+    start(&r[i], uri, n);
+  }
+  wait_all();
+  for (i = 0; i < 4; i++) {
+    check(&r[i], HTTPC_RESULT_OK);
+  }
+  EXPECT(srv_accepts == 1);
+
+  for (i = 0; i < 6; i++) {
+    snprintf(uri, sizeof(uri), "/cl/%u", 100u * i);
+    start(&r[i], uri, 100u * i);
+  }
+  wait_all();
+  for (i = 0; i < 6; i++) {
+    check(&r[i], HTTPC_RESULT_OK);
+  }
+  EXPECT(srv_accepts == 2);
+}
+
+/* 1xx, 204, close-delimited bodies and Connection: close */
+static void
+test_framing(test_req_t *r)
+{
+  start(&r[0], "/interim/77", 77);
+  wait_all();
+  check(&r[0], HTTPC_RESULT_OK);
+  start(&r[0], "/nocontent", 0);
+  wait_all();
+  check(&r[0], HTTPC_RESULT_OK);
+  EXPECT(r[0].status == 204);
+
+  srv_accepts = 0;
+  start(&r[0], "/close/999", 999);
+  wait_all();
+  check(&r[0], HTTPC_RESULT_OK);
+  start(&r[0], "/connclose/50", 50);
+  wait_all();
+  check(&r[0], HTTPC_RESULT_OK);
+  EXPECT(srv_accepts <= 2);
+  srv_accepts = 0;
+  start(&r[0], "/cl/10", 10);
+  wait_all();
+  check(&r[0], HTTPC_RESULT_OK);
+  EXPECT(srv_accepts == 1);
+
+  /* requests queued behind a Connection: close response move to a new connection */
+  srv_late_bytes = 0;
+  start(&r[0], "/connclose/30", 30);
+  start(&r[1], "/cl/40", 40);
+  start(&r[2], "/chunk/50", 50);
+  wait_all();
+  check(&r[0], HTTPC_RESULT_OK);
+  check(&r[1], HTTPC_RESULT_OK);
+  check(&r[2], HTTPC_RESULT_OK);
+  /* only pipelined ones may have been sent before the response came */
+  EXPECT(HTTPC_PIPELINING || (srv_late_bytes == 0));
+}
+
+/* The server closed a reused connection: the request is sent again once */
+static void
+test_retry(test_req_t *r)
+{
+  int i;
+
+  httpc_close_idle();
+  run(100);
+  srv_accepts = 0;
+  srv_drop_nth = 2;
+  start(&r[0], "/cl/20", 20);
+  wait_all();
+  check(&r[0], HTTPC_RESULT_OK);
+  start(&r[1], "/cl/21", 21);
+  wait_all();
+  check(&r[1], HTTPC_RESULT_OK);
+  EXPECT(srv_accepts == 2);
+  srv_drop_nth = 0;
+
+  /* the server closes idle connections without telling */
+  httpc_close_idle();
+  run(100);
+  srv_idle_close = 1;
+  srv_accepts = 0;
+  for (i = 0; i < 5; i++) {
+    start(&r[i], "/cl/5", 5);
+    wait_all();
+    check(&r[i], HTTPC_RESULT_OK);
+  }
+  EXPECT(srv_accepts == 5);
+  srv_idle_close = 0;
+}
+
+static void
+test_errors(test_req_t *r)
+{
+  start(&r[0], "/short/100", 200);
+  wait_all();
+  check(&r[0], HTTPC_RESULT_ERR_CONTENT_LEN);
+  start(&r[0], "/garbage", 0);
+  wait_all();
+  check(&r[0], HTTPC_RESULT_ERR_SVR_RESP);
+}
+
+/* Without keep_alive every request has its own connection */
+static void
+test_no_keep_alive(test_req_t *r)
+{
+  char uri[64];
+  int i;
+
+  settings.keep_alive = 0;
+  srv_accepts = 0;
+  for (i = 0; i < 5; i++) {
+    snprintf(uri, sizeof(uri), (i & 1) ? "/chunk/%u" : "/cl/%u", 300u);
+    start(&r[i], uri, 300);
+  }
+  wait_all();
+  for (i = 0; i < 5; i++) {
+    check(&r[i], HTTPC_RESULT_OK);
+  }
+  EXPECT(srv_accepts == 5);
+  settings.keep_alive = 1;
+}
+
+/* No more than HTTPC_KEEPALIVE_IDLE_MAX (2) connections are kept idle */
+static void
+test_idle_max(test_req_t *r)
+{
+  int i;
+
+  httpc_close_idle();
+  run(100);
+  srv_accepts = 0;
+  srv_closes = 0;
+  for (i = 0; i < 12; i++) {
+    start(&r[i], "/cl/10", 10);
+  }
+  wait_all();
+  for (i = 0; i < 12; i++) {
+    check(&r[i], HTTPC_RESULT_OK);
+  }
+  run(100);
+  EXPECT(srv_accepts == 3);
+  EXPECT(srv_closes == 1);
+}
+
+/* Idle connections are closed by the client after a while */
+static void
+test_idle_timeout(test_req_t *r)
+{
+  start(&r[0], "/cl/1", 1);
+  wait_all();
+  srv_closes = 0;
+  run(12000);
+  EXPECT(srv_closes >= 1);
+  srv_accepts = 0;
+  start(&r[0], "/cl/1", 1);
+  wait_all();
+  check(&r[0], HTTPC_RESULT_OK);
+  EXPECT(srv_accepts == 1);
+}
+
+int
+main(void)
+{
+  static test_req_t r[TEST_REQ_MAX];
+  struct tcp_pcb *listen_pcb;
+
+  srand(1);
+  lwip_init();
+  IP_ADDR4(&srv_addr, 127, 0, 0, 1);
+  listen_pcb = tcp_new();
+  tcp_bind(listen_pcb, &srv_addr, TEST_PORT);
+  listen_pcb = tcp_listen(listen_pcb);
+  tcp_accept(listen_pcb, srv_accept);
+
+  settings.result_fn = client_result;
+  settings.headers_done_fn = client_headers;
+  settings.keep_alive = 1;
+
+  test_sequential(r);
+  test_queue(r);
+  test_framing(r);
+  test_retry(r);
+  test_errors(r);
+  test_no_keep_alive(r);
+  test_idle_max(r);
+  test_idle_timeout(r);
+
+  /* everything closed and freed, TIME_WAIT included */
+  httpc_close_idle();
+  run(200000);
+  EXPECT(hdr_bad == 0);
+  EXPECT(hdr_calls > 0);
+  EXPECT(lwip_stats.mem.used == 0);
+  EXPECT(lwip_stats.memp[MEMP_TCP_PCB]->used == 0);
+  tcp_close(listen_pcb);
+
+  printf("%s (HTTPC_PIPELINING %d)\n", test_failed ? "FAILED" : "PASSED", HTTPC_PIPELINING);
+  return test_failed;
+}
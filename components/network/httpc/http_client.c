@@ -38,7 +38,6 @@
  * @defgroup httpc HTTP client
  * @ingroup apps
  * @todo:
- * - persistent connections
  * - select outgoing http version
  * - optionally follow redirect
  * - check request uri for invalid characters? (e.g. encode spaces)
@@ -46,6 +45,7 @@
  */
 
 #include <http_client.h>
+#include <http_client_parse.h>
 
 #include "lwip/altcp_tcp.h"
 #include "lwip/dns.h"
@@ -104,60 +104,78 @@ const char *g_cont_type[] = {
     "User-Agent: %s\r\n" /* User-Agent */ \
     "Host: %s\r\n" \
     "Accept: */*\r\n" \
-    "Connection: Close\r\n" /* we don't support persistent connections, yet */ \
+    "Connection: %s\r\n" \
     "\r\n" \
     "%s"
-#define HTTPC_REQ_POST_11_HOST_FORMAT(uri, type, srv_name, body, len) HTTPC_REQ_POST_11, uri, HTTPC_CONT_TYPE(type), len, HTTPC_CLIENT_AGENT, srv_name, body
+#define HTTPC_REQ_POST_11_HOST_FORMAT(uri, type, srv_name, body, len, conn) HTTPC_REQ_POST_11, uri, HTTPC_CONT_TYPE(type), len, HTTPC_CLIENT_AGENT, srv_name, conn, body
 
 /* GET request basic */
 #define HTTPC_REQ_11 "GET %s HTTP/1.1\r\n" /* URI */\
     "User-Agent: %s\r\n" /* User-Agent */ \
     "Accept: */*\r\n" \
-    "Connection: Close\r\n" /* we don't support persistent connections, yet */ \
+    "Connection: %s\r\n" \
     "\r\n"
-#define HTTPC_REQ_11_FORMAT(uri) HTTPC_REQ_11, uri, HTTPC_CLIENT_AGENT
+#define HTTPC_REQ_11_FORMAT(uri, conn) HTTPC_REQ_11, uri, HTTPC_CLIENT_AGENT, conn
 
 /* GET request with host */
 #define HTTPC_REQ_11_HOST "GET %s HTTP/1.1\r\n" /* URI */\
     "User-Agent: %s\r\n" /* User-Agent */ \
     "Accept: */*\r\n" \
     "Host: %s\r\n" /* server name */ \
-    "Connection: Close\r\n" /* we don't support persistent connections, yet */ \
+    "Connection: %s\r\n" \
     "\r\n"
-#define HTTPC_REQ_11_HOST_FORMAT(uri, srv_name) HTTPC_REQ_11_HOST, uri, HTTPC_CLIENT_AGENT, srv_name
+#define HTTPC_REQ_11_HOST_FORMAT(uri, srv_name, conn) HTTPC_REQ_11_HOST, uri, HTTPC_CLIENT_AGENT, srv_name, conn
 
 /* GET request with proxy */
 #define HTTPC_REQ_11_PROXY "GET http://%s%s HTTP/1.1\r\n" /* HOST, URI */\
     "User-Agent: %s\r\n" /* User-Agent */ \
     "Accept: */*\r\n" \
     "Host: %s\r\n" /* server name */ \
-    "Connection: Close\r\n" /* we don't support persistent connections, yet */ \
+    "Connection: %s\r\n" \
     "\r\n"
-#define HTTPC_REQ_11_PROXY_FORMAT(host, uri, srv_name) HTTPC_REQ_11_PROXY, host, uri, HTTPC_CLIENT_AGENT, srv_name
+#define HTTPC_REQ_11_PROXY_FORMAT(host, uri, srv_name, conn) HTTPC_REQ_11_PROXY, host, uri, HTTPC_CLIENT_AGENT, srv_name, conn
 
 /* GET request with proxy (non-default server port) */
 #define HTTPC_REQ_11_PROXY_PORT "GET http://%s:%d%s HTTP/1.1\r\n" /* HOST, host-port, URI */\
     "User-Agent: %s\r\n" /* User-Agent */ \
     "Accept: */*\r\n" \
     "Host: %s\r\n" /* server name */ \
-    "Connection: Close\r\n" /* we don't support persistent connections, yet */ \
+    "Connection: %s\r\n" \
     "\r\n"
-#define HTTPC_REQ_11_PROXY_PORT_FORMAT(host, host_port, uri, srv_name) HTTPC_REQ_11_PROXY_PORT, host, host_port, uri, HTTPC_CLIENT_AGENT, srv_name
+#define HTTPC_REQ_11_PROXY_PORT_FORMAT(host, host_port, uri, srv_name, conn) HTTPC_REQ_11_PROXY_PORT, host, host_port, uri, HTTPC_CLIENT_AGENT, srv_name, conn
 
-typedef enum ehttpc_parse_state {
-  HTTPC_PARSE_WAIT_FIRST_LINE = 0,
-  HTTPC_PARSE_WAIT_HEADERS,
-  HTTPC_PARSE_RX_DATA
-} httpc_parse_state_t;
+/** Requests queued on one connection, including the one being answered */
+#ifndef HTTPC_CONN_QUEUE_MAX
+#define HTTPC_CONN_QUEUE_MAX        4
+#endif
+
+/** Set this to 1 to write queued requests without waiting for the previous response */
+#ifndef HTTPC_PIPELINING
+#define HTTPC_PIPELINING            0
+#endif
+
+/** Idle keep-alive connections kept open, the least recently used one is closed beyond this */
+#ifndef HTTPC_KEEPALIVE_IDLE_MAX
+#define HTTPC_KEEPALIVE_IDLE_MAX    2
+#endif
+
+/** Poll ticks an idle keep-alive connection is kept open */
+#ifndef HTTPC_KEEPALIVE_IDLE_TIMEOUT
+#define HTTPC_KEEPALIVE_IDLE_TIMEOUT  20 /* 10 seconds */
+#endif
+
+#define HTTPC_CONNECTION_HDR(settings) ((settings)->keep_alive ? "keep-alive" : "Close")
+
+typedef struct _httpc_conn httpc_conn_t;
 
 typedef struct _httpc_state
 {
-  struct altcp_pcb* pcb;
-  ip_addr_t remote_addr;
-  u16_t remote_port;
-  int timeout_ticks;
+  struct _httpc_state *next;
+  /* kept until the response starts when it may have to be sent again */
   struct pbuf *request;
-  struct pbuf *rx_hdrs;
+  u8_t sent;
+  u8_t retried;
+  u8_t rx_started;
   u16_t rx_http_version;
   u16_t rx_status;
   altcp_recv_fn recv_fn;
@@ -165,220 +183,469 @@ typedef struct _httpc_state
   void* callback_arg;
   u32_t rx_content_len;
   u32_t hdr_content_len;
-  httpc_parse_state_t parse_state;
 #if HTTPC_DEBUG_REQUEST
   char* server_name;
   char* uri;
 #endif
 } httpc_state_t;
 
-/** Free http client state and deallocate all resources within */
-static err_t
-httpc_free_state(httpc_state_t* req)
+/** A connection to one server (or proxy), shared by keep-alive requests */
+struct _httpc_conn
 {
-  struct altcp_pcb* tpcb;
+  httpc_conn_t *next;
+  struct altcp_pcb* pcb;
+  altcp_allocator_t *allocator;
+  ip_addr_t remote_addr;
+  u16_t remote_port;
+  u8_t keep_alive;
+  u8_t connected;
+  /* a response has been completed on this connection */
+  u8_t reused;
+  u8_t idle;
+  u8_t hdrs_done;
+  u8_t num_reqs;
+  int timeout_ticks;
+  /* the head is the request being answered */
+  httpc_state_t *reqs;
+  struct pbuf *rx;
+  /* header bytes at the start of rx, kept for headers_done_fn */
+  u16_t rx_hdr_len;
+  httpc_parse_t parse;
+  char *host;
+};
+
+/** Open connections, most recently used first */
+static httpc_conn_t *httpc_conns;
 
+static err_t httpc_req_attach(httpc_state_t *req, const char *host, const ip_addr_t *addr, u16_t port);
+
+/** Free a request that is not queued on a connection */
+static void
+httpc_free_state(httpc_state_t* req)
+{
   if (req->request != NULL) {
     pbuf_free(req->request);
     req->request = NULL;
   }
-  if (req->rx_hdrs != NULL) {
-    pbuf_free(req->rx_hdrs);
-    req->rx_hdrs = NULL;
+  mem_free(req);
+}
+
+/** Call the finished callback and free the request */
+static void
+httpc_finish(httpc_state_t* req, httpc_result_t result, err_t err)
+{
+  if (req->conn_settings != NULL) {
+    if (req->conn_settings->result_fn != NULL) {
+      req->conn_settings->result_fn(req->callback_arg, result, req->rx_content_len, req->rx_status, err);
+    }
+  }
+  httpc_free_state(req);
+}
+
+static void
+httpc_conn_unlink(httpc_conn_t *conn)
+{
+  httpc_conn_t **pp;
+
+  for (pp = &httpc_conns; *pp != NULL; pp = &(*pp)->next) {
+    if (*pp == conn) {
+      *pp = conn->next;
+      break;
+    }
   }
+  conn->next = NULL;
+}
 
-  tpcb = req->pcb;
-  mem_free(req);
-  req = NULL;
-
-  if (tpcb != NULL) {
-    err_t r;
-    altcp_arg(tpcb, NULL);
-    altcp_recv(tpcb, NULL);
-    altcp_err(tpcb, NULL);
-    altcp_poll(tpcb, NULL, 0);
-    altcp_sent(tpcb, NULL);
-    r = altcp_close(tpcb);
+static void
+httpc_conn_enqueue(httpc_conn_t *conn, httpc_state_t *req)
+{
+  httpc_state_t **pp;
+
+  for (pp = &conn->reqs; *pp != NULL; pp = &(*pp)->next);
+  *pp = req;
+  req->next = NULL;
+  conn->num_reqs++;
+}
+
+static httpc_state_t *
+httpc_conn_dequeue(httpc_conn_t *conn)
+{
+  httpc_state_t *req = conn->reqs;
+
+  conn->reqs = req->next;
+  conn->num_reqs--;
+  req->next = NULL;
+  return req;
+}
+
+/** Close the connection and settle its requests: the ones the server can't
+ * have acted on go to a new connection, the others are finished with result.
+ * Returns ERR_ABRT if the pcb had to be aborted. */
+static err_t
+httpc_conn_free(httpc_conn_t *conn, httpc_result_t result, err_t err)
+{
+  httpc_state_t *req, *next;
+  httpc_state_t *retry = NULL, **retry_tail = &retry;
+  err_t r = ERR_OK;
+
+  httpc_conn_unlink(conn);
+  if (conn->pcb != NULL) {
+    altcp_arg(conn->pcb, NULL);
+    altcp_recv(conn->pcb, NULL);
+    altcp_err(conn->pcb, NULL);
+    altcp_poll(conn->pcb, NULL, 0);
+    altcp_sent(conn->pcb, NULL);
+    r = altcp_close(conn->pcb);
     if (r != ERR_OK) {
-      altcp_abort(tpcb);
-      return ERR_ABRT;
+      altcp_abort(conn->pcb);
+      r = ERR_ABRT;
     }
+    conn->pcb = NULL;
   }
-  return ERR_OK;
+  if (conn->rx != NULL) {
+    pbuf_free(conn->rx);
+    conn->rx = NULL;
+  }
+
+  /* A request that got no response byte was either never sent or sent on a
+     connection the server may have closed while it was under way. The
+     latter is tried once more only. */
+  while (conn->reqs != NULL) {
+    req = httpc_conn_dequeue(conn);
+    if (conn->connected && !req->rx_started && (req->request != NULL) &&
+        (!req->sent || (conn->reused && !req->retried))) {
+      req->retried |= req->sent;
+      req->sent = 0;
+      *retry_tail = req;
+      retry_tail = &req->next;
+    } else {
+      httpc_finish(req, result, err);
+    }
+  }
+  for (req = retry; req != NULL; req = next) {
+    next = req->next;
+    req->next = NULL;
+    LWIP_DEBUGF(HTTPC_DEBUG_STATE, ("httpc: retrying request on a new connection\n"));
+    err = httpc_req_attach(req, conn->host, &conn->remote_addr, conn->remote_port);
+    if (err != ERR_OK) {
+      httpc_finish(req, HTTPC_RESULT_ERR_CONNECT, err);
+    }
+  }
+  mem_free(conn);
+  return r;
+}
+
+/** Like httpc_conn_free(), but returns ERR_CLSD unless the pcb was aborted.
+ * The connection handlers below return ERR_OK only while conn is still valid. */
+static err_t
+httpc_conn_drop(httpc_conn_t *conn, httpc_result_t result, err_t err)
+{
+  return (httpc_conn_free(conn, result, err) == ERR_ABRT) ? ERR_ABRT : ERR_CLSD;
 }
 
-/** Close the connection: call finished callback and free the state */
+/** Translate a connection handler result for lwIP */
 static err_t
-httpc_close(httpc_state_t* req, httpc_result_t result, u32_t server_response, err_t err)
+httpc_conn_cb_result(err_t err)
 {
-  if (req != NULL) {
-    if (req->conn_settings != NULL) {
-      if (req->conn_settings->result_fn != NULL) {
-        req->conn_settings->result_fn(req->callback_arg, result, req->rx_content_len, server_response, err);
+  return (err == ERR_ABRT) ? ERR_ABRT : ERR_OK;
+}
+
+/** Write the requests that may go out now, the rest waits for sent or poll */
+static err_t
+httpc_conn_send(httpc_conn_t *conn)
+{
+  httpc_state_t *req;
+  err_t err = ERR_OK;
+  u8_t written = 0;
+
+  if (!conn->connected) {
+    return ERR_OK;
+  }
+  for (req = conn->reqs; req != NULL; req = req->next) {
+    if (!req->sent) {
+      /* send request; last char is zero termination */
+      err = altcp_write(conn->pcb, req->request->payload, req->request->len - 1, TCP_WRITE_FLAG_COPY);
+      if (err != ERR_OK) {
+        break;
+      }
+      req->sent = 1;
+      written = 1;
+      if (!conn->keep_alive) {
+        /* never sent twice, we can free the request */
+        pbuf_free(req->request);
+        req->request = NULL;
       }
     }
-    return httpc_free_state(req);
+#if !HTTPC_PIPELINING
+    /* the next one goes out when this response is done */
+    break;
+#endif
+  }
+  if (written) {
+    altcp_output(conn->pcb);
+  }
+  if ((err == ERR_MEM) && (written || (altcp_sndqueuelen(conn->pcb) != 0))) {
+    /* try again once the send buffer drains */
+    err = ERR_OK;
+  }
+  return err;
+}
+
+/** httpc_conn_send() from a callback, failing the connection if a request can't be written */
+static err_t
+httpc_conn_kick(httpc_conn_t *conn)
+{
+  err_t err = httpc_conn_send(conn);
+  if (err != ERR_OK) {
+    /* could not write the request -> fail, don't retry */
+    conn->connected = 0;
+    return httpc_conn_drop(conn, HTTPC_RESULT_ERR_MEM, err);
   }
   return ERR_OK;
 }
 
-/** Parse http header response line 1 */
+/** The connection has nothing to do: keep it for later requests */
 static err_t
-http_parse_response_status(struct pbuf *p, u16_t *http_version, u16_t *http_status, u16_t *http_status_str_offset)
-{
-  u16_t end1 = pbuf_memfind(p, "\r\n", 2, 0);
-  if (end1 != 0xFFFF) {
-    /* get parts of first line */
-    u16_t space1, space2;
-    space1 = pbuf_memfind(p, " ", 1, 0);
-    if (space1 != 0xFFFF) {
-      if ((pbuf_memcmp(p, 0, "HTTP/", 5) == 0)  && (pbuf_get_at(p, 6) == '.')) {
-        char status_num[10];
-        size_t status_num_len;
-        /* parse http version */
-        u16_t version = pbuf_get_at(p, 5) - '0';
-        version <<= 8;
-        version |= pbuf_get_at(p, 7) - '0';
-        *http_version = version;
-
-        /* parse http status number */
-        space2 = pbuf_memfind(p, " ", 1, space1 + 1);
-        if (space2 != 0xFFFF) {
-          *http_status_str_offset = space2 + 1;
-          status_num_len = space2 - space1 - 1;
-        } else {
-          status_num_len = end1 - space1 - 1;
-        }
-        memset(status_num, 0, sizeof(status_num));
-        if (pbuf_copy_partial(p, status_num, (u16_t)status_num_len, space1 + 1) == status_num_len) {
-          int status = atoi(status_num);
-          if ((status > 0) && (status <= 0xFFFF)) {
-            *http_status = (u16_t)status;
-            return ERR_OK;
-          }
-        }
-      }
+httpc_conn_idle(httpc_conn_t *conn)
+{
+  httpc_conn_t *c, *lru = NULL;
+  int num_idle = 0;
+
+  conn->idle = 1;
+  conn->timeout_ticks = HTTPC_KEEPALIVE_IDLE_TIMEOUT;
+  httpc_conn_unlink(conn);
+  conn->next = httpc_conns;
+  httpc_conns = conn;
+
+  for (c = httpc_conns; c != NULL; c = c->next) {
+    if (c->idle) {
+      num_idle++;
+      lru = c;
     }
   }
-  return ERR_VAL;
+  if (num_idle > HTTPC_KEEPALIVE_IDLE_MAX) {
+    if (lru == conn) {
+      return httpc_conn_drop(conn, HTTPC_RESULT_OK, ERR_OK);
+    }
+    httpc_conn_free(lru, HTTPC_RESULT_OK, ERR_OK);
+  }
+  return ERR_OK;
 }
 
-/** Wait for all headers to be received, return its length and content-length (if available) */
+/** The response to the head request is complete: report it and go on with the next one */
 static err_t
-http_wait_headers(struct pbuf *p, u32_t *content_length, u16_t *total_header_len)
-{
-  u16_t end1 = pbuf_memfind(p, "\r\n\r\n", 4, 0);
-  if (end1 < (0xFFFF - 2)) {
-    /* all headers received */
-    /* check if we have a content length (@todo: case insensitive?) */
-    u16_t content_len_hdr;
-    *content_length = HTTPC_CONTENT_LEN_INVALID;
-    *total_header_len = end1 + 4;
-
-    content_len_hdr = pbuf_memfind(p, "Content-Length: ", 16, 0);
-    if (content_len_hdr != 0xFFFF) {
-      u16_t content_len_line_end = pbuf_memfind(p, "\r\n", 2, content_len_hdr);
-      if (content_len_line_end != 0xFFFF) {
-        char content_len_num[16];
-        u16_t content_len_num_len = (u16_t)(content_len_line_end - content_len_hdr - 16);
-        memset(content_len_num, 0, sizeof(content_len_num));
-        if (pbuf_copy_partial(p, content_len_num, content_len_num_len, content_len_hdr + 16) == content_len_num_len) {
-          int len = atoi(content_len_num);
-          if ((len >= 0) && ((u32_t)len < HTTPC_CONTENT_LEN_INVALID)) {
-            *content_length = (u32_t)len;
-          }
-        }
-      }
+httpc_conn_response_done(httpc_conn_t *conn)
+{
+  httpc_state_t *req = httpc_conn_dequeue(conn);
+  u8_t keep = conn->keep_alive && conn->parse.keep_alive;
+
+  httpc_parse_init(&conn->parse);
+  conn->hdrs_done = 0;
+  conn->reused = 1;
+  if (!keep) {
+    /* keep requests started from the result callback off this connection */
+    httpc_conn_unlink(conn);
+  }
+  httpc_finish(req, HTTPC_RESULT_OK, ERR_OK);
+
+  if (!keep) {
+    return httpc_conn_drop(conn, HTTPC_RESULT_ERR_CLOSED, ERR_OK);
+  }
+  if (conn->reqs == NULL) {
+    return httpc_conn_idle(conn);
+  }
+  conn->timeout_ticks = HTTPC_POLL_TIMEOUT;
+  return httpc_conn_kick(conn);
+}
+
+/** Drop len framing bytes from the front of rx */
+static void
+httpc_conn_skip(httpc_conn_t *conn, u16_t len)
+{
+  if (len != 0) {
+    altcp_recved(conn->pcb, len);
+    conn->rx = pbuf_free_header(conn->rx, len);
+  }
+}
+
+/** Headers of the head request complete: pass them to the client callback */
+static err_t
+httpc_conn_headers(httpc_conn_t *conn, httpc_state_t *req)
+{
+  err_t err;
+
+  conn->hdrs_done = 1;
+  req->rx_http_version = conn->parse.http_version;
+  req->rx_status = conn->parse.status;
+  req->hdr_content_len = conn->parse.chunked ? HTTPC_CONTENT_LEN_INVALID : conn->parse.content_len;
+  if (req->conn_settings->headers_done_fn) {
+    err = req->conn_settings->headers_done_fn(req, req->callback_arg, conn->rx, conn->rx_hdr_len, req->hdr_content_len);
+    if (err != ERR_OK) {
+      httpc_finish(httpc_conn_dequeue(conn), HTTPC_RESULT_LOCAL_ABORT, err);
+      return httpc_conn_drop(conn, HTTPC_RESULT_ERR_CLOSED, ERR_OK);
     }
-    return ERR_OK;
   }
-  return ERR_VAL;
+  /* hide header bytes in pbuf */
+  httpc_conn_skip(conn, conn->rx_hdr_len);
+  conn->rx_hdr_len = 0;
+  return ERR_OK;
 }
 
-/** http client tcp recv callback */
+/** Pass len body bytes from the front of rx to the head request */
 static err_t
-httpc_tcp_recv(void *arg, struct altcp_pcb *pcb, struct pbuf *p, err_t r)
+httpc_conn_deliver(httpc_conn_t *conn, httpc_state_t *req, u32_t len)
 {
-  httpc_state_t* req = (httpc_state_t*)arg;
-  LWIP_UNUSED_ARG(r);
+  struct pbuf *p;
+  err_t err;
 
-  req->timeout_ticks = HTTPC_POLL_TIMEOUT;//reset timer to 15 second
+  if (len == conn->rx->tot_len) {
+    p = conn->rx;
+    conn->rx = NULL;
+  } else {
+    /* the rest is framing or belongs to the next response */
+    p = pbuf_alloc(PBUF_RAW, (u16_t)len, PBUF_RAM);
+    if (p == NULL) {
+      return httpc_conn_drop(conn, HTTPC_RESULT_ERR_MEM, ERR_MEM);
+    }
+    pbuf_copy_partial(conn->rx, p->payload, (u16_t)len, 0);
+    conn->rx = pbuf_free_header(conn->rx, (u16_t)len);
+  }
+  httpc_parse_body_consumed(&conn->parse, len);
+  req->rx_content_len += len;
 
-  if (p == NULL) {
-    httpc_result_t result;
-    if (req->parse_state != HTTPC_PARSE_RX_DATA) {
-      /* did not get RX data yet */
-      result = HTTPC_RESULT_ERR_CLOSED;
-    } else if ((req->hdr_content_len != HTTPC_CONTENT_LEN_INVALID) &&
-      (req->hdr_content_len != req->rx_content_len)) {
-      /* header has been received with content length but not all data received */
-      result = HTTPC_RESULT_ERR_CONTENT_LEN;
-    } else {
-      /* receiving data and either all data received or no content length header */
-      result = HTTPC_RESULT_OK;
+  if (req->recv_fn != NULL) {
+    err = req->recv_fn(req->callback_arg, conn->pcb, p, ERR_OK);
+    if (err == ERR_ABRT) {
+      /* the connection has been aborted from the callback, conn is gone */
+      return ERR_ABRT;
+    }
+    if (err != ERR_OK) {
+      pbuf_free(p);
+      httpc_finish(httpc_conn_dequeue(conn), HTTPC_RESULT_LOCAL_ABORT, err);
+      return httpc_conn_drop(conn, HTTPC_RESULT_ERR_CLOSED, ERR_OK);
     }
-    return httpc_close(req, result, req->rx_status, ERR_OK);
+  } else {
+    altcp_recved(conn->pcb, (u16_t)len);
+    pbuf_free(p);
   }
-  if (req->parse_state != HTTPC_PARSE_RX_DATA) {
-    if (req->rx_hdrs == NULL) {
-      req->rx_hdrs = p;
-    } else {
-      pbuf_cat(req->rx_hdrs, p);
+  return ERR_OK;
+}
+
+/** Run the received bytes through the response parser */
+static err_t
+httpc_conn_input(httpc_conn_t *conn)
+{
+  httpc_state_t *req;
+  httpc_parse_ev_t ev;
+  struct pbuf *q;
+  u32_t left;
+  u16_t off, used;
+  err_t err;
+
+  while (conn->rx != NULL) {
+    req = conn->reqs;
+    if (req == NULL) {
+      /* nothing has been asked for */
+      return httpc_conn_drop(conn, HTTPC_RESULT_ERR_CLOSED, ERR_OK);
     }
-    if (req->parse_state == HTTPC_PARSE_WAIT_FIRST_LINE) {
-      u16_t status_str_off;
-      err_t err = http_parse_response_status(req->rx_hdrs, &req->rx_http_version, &req->rx_status, &status_str_off);
-      if (err == ERR_OK) {
-        /* don't care status string */
-        req->parse_state = HTTPC_PARSE_WAIT_HEADERS;
+
+    left = httpc_parse_body_left(&conn->parse);
+    if (left != 0) {
+      err = httpc_conn_deliver(conn, req, LWIP_MIN(left, conn->rx->tot_len));
+    } else if (conn->rx_hdr_len < conn->rx->tot_len) {
+      for (q = conn->rx, off = conn->rx_hdr_len; off >= q->len; q = q->next) {
+        off -= q->len;
       }
-    }
-    if (req->parse_state == HTTPC_PARSE_WAIT_HEADERS) {
-      u16_t total_header_len;
-      err_t err = http_wait_headers(req->rx_hdrs, &req->hdr_content_len, &total_header_len);
-      if (err == ERR_OK) {
-        struct pbuf *q;
-        /* full header received, send window update for header bytes and call into client callback */
-        altcp_recved(pcb, total_header_len);
-        if (req->conn_settings) {
-          if (req->conn_settings->headers_done_fn) {
-            err = req->conn_settings->headers_done_fn(req, req->callback_arg, req->rx_hdrs, total_header_len, req->hdr_content_len);
-            if (err != ERR_OK) {
-              return httpc_close(req, HTTPC_RESULT_LOCAL_ABORT, req->rx_status, err);
-            }
-          }
+      ev = httpc_parse_feed(&conn->parse, (const u8_t *)q->payload + off, (u16_t)(q->len - off), &used);
+      if ((used != 0) && !req->rx_started) {
+        /* the server has seen the request, it must not be sent again */
+        req->rx_started = 1;
+        if (req->request != NULL) {
+          pbuf_free(req->request);
+          req->request = NULL;
         }
-        /* hide header bytes in pbuf */
-        q = pbuf_free_header(req->rx_hdrs, total_header_len);
-        p = q;
-        req->rx_hdrs = NULL;
-        /* go on with data */
-        req->parse_state = HTTPC_PARSE_RX_DATA;
       }
-    }
-  }
-  if ((p != NULL) && (req->parse_state == HTTPC_PARSE_RX_DATA)) {
-    req->rx_content_len += p->tot_len;
-    if (req->recv_fn != NULL) {
-      /* directly return here: the connection migth already be aborted from the callback! */
-      return req->recv_fn(req->callback_arg, pcb, p, r);
+      err = ERR_OK;
+      if (conn->hdrs_done) {
+        /* chunk framing */
+        httpc_conn_skip(conn, used);
+      } else {
+        conn->rx_hdr_len += used;
+        if (ev == HTTPC_PARSE_EV_HEADERS) {
+          err = httpc_conn_headers(conn, req);
+        } else if (ev == HTTPC_PARSE_EV_INTERIM) {
+          /* 1xx response, the real one follows */
+          httpc_conn_skip(conn, conn->rx_hdr_len);
+          conn->rx_hdr_len = 0;
+        }
+      }
+      if (ev == HTTPC_PARSE_EV_ERROR) {
+        LWIP_DEBUGF(HTTPC_DEBUG_WARN_STATE, ("httpc: malformed response\n"));
+        return httpc_conn_drop(conn, HTTPC_RESULT_ERR_SVR_RESP, ERR_VAL);
+      }
     } else {
-      altcp_recved(pcb, p->tot_len);
-      pbuf_free(p);
+      /* wait for the rest of the headers */
+      break;
+    }
+    if (err != ERR_OK) {
+      return err;
+    }
+    if (httpc_parse_is_done(&conn->parse)) {
+      err = httpc_conn_response_done(conn);
+      if (err != ERR_OK) {
+        return err;
+      }
     }
   }
   return ERR_OK;
 }
 
+/** The server closed the connection */
+static err_t
+httpc_conn_eof(httpc_conn_t *conn)
+{
+  httpc_result_t result = HTTPC_RESULT_ERR_CLOSED;
+
+  if ((conn->reqs != NULL) && conn->hdrs_done) {
+    if (httpc_parse_closed(&conn->parse)) {
+      /* body delimited by the close */
+      return httpc_conn_response_done(conn);
+    }
+    /* header has been received with content length or chunked but not all data received */
+    result = HTTPC_RESULT_ERR_CONTENT_LEN;
+  }
+  return httpc_conn_drop(conn, result, ERR_OK);
+}
+
+/** http client tcp recv callback */
+static err_t
+httpc_tcp_recv(void *arg, struct altcp_pcb *pcb, struct pbuf *p, err_t r)
+{
+  httpc_conn_t* conn = (httpc_conn_t*)arg;
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(r);
+
+  if (p == NULL) {
+    return httpc_conn_cb_result(httpc_conn_eof(conn));
+  }
+  conn->timeout_ticks = HTTPC_POLL_TIMEOUT;//reset timer to 15 second
+  if (conn->rx == NULL) {
+    conn->rx = p;
+  } else {
+    pbuf_cat(conn->rx, p);
+  }
+  return httpc_conn_cb_result(httpc_conn_input(conn));
+}
+
 /** http client tcp err callback */
 static void
 httpc_tcp_err(void *arg, err_t err)
 {
-  httpc_state_t* req = (httpc_state_t*)arg;
-  if (req != NULL) {
+  httpc_conn_t* conn = (httpc_conn_t*)arg;
+  if (conn != NULL) {
     /* pcb has already been deallocated */
-    req->pcb = NULL;
-    httpc_close(req, HTTPC_RESULT_ERR_CLOSED, 0, err);
+    conn->pcb = NULL;
+    httpc_conn_free(conn, HTTPC_RESULT_ERR_CLOSED, err);
   }
 }
 
@@ -387,15 +654,16 @@ static err_t
 httpc_tcp_poll(void *arg, struct altcp_pcb *pcb)
 {
   /* implement timeout */
-  httpc_state_t* req = (httpc_state_t*)arg;
+  httpc_conn_t* conn = (httpc_conn_t*)arg;
   LWIP_UNUSED_ARG(pcb);
-  if (req != NULL) {
-    if (req->timeout_ticks) {
-      req->timeout_ticks--;
+  if (conn != NULL) {
+    if (conn->timeout_ticks) {
+      conn->timeout_ticks--;
     }
-    if (!req->timeout_ticks) {
-      return httpc_close(req, HTTPC_RESULT_ERR_TIMEOUT, 0, ERR_OK);
+    if (!conn->timeout_ticks) {
+      return httpc_conn_free(conn, HTTPC_RESULT_ERR_TIMEOUT, ERR_OK);
     }
+    return httpc_conn_cb_result(httpc_conn_kick(conn));
   }
   return ERR_OK;
 }
@@ -404,49 +672,38 @@ httpc_tcp_poll(void *arg, struct altcp_pcb *pcb)
 static err_t
 httpc_tcp_sent(void *arg, struct altcp_pcb *pcb, u16_t len)
 {
-  /* nothing to do here for now */
-  LWIP_UNUSED_ARG(arg);
+  httpc_conn_t* conn = (httpc_conn_t*)arg;
   LWIP_UNUSED_ARG(pcb);
   LWIP_UNUSED_ARG(len);
-  return ERR_OK;
+
+  /* requests that did not fit into the send buffer before */
+  return httpc_conn_cb_result(httpc_conn_kick(conn));
 }
 
 /** http client tcp connected callback */
 static err_t
 httpc_tcp_connected(void *arg, struct altcp_pcb *pcb, err_t err)
 {
-  err_t r;
-  httpc_state_t* req = (httpc_state_t*)arg;
+  httpc_conn_t* conn = (httpc_conn_t*)arg;
   LWIP_UNUSED_ARG(pcb);
   LWIP_UNUSED_ARG(err);
 
-  /* send request; last char is zero termination */
-  r = altcp_write(req->pcb, req->request->payload, req->request->len - 1, TCP_WRITE_FLAG_COPY);
-  if (r != ERR_OK) {
-     /* could not write the single small request -> fail, don't retry */
-     return httpc_close(req, HTTPC_RESULT_ERR_MEM, 0, r);
-  }
-  /* everything written, we can free the request */
-  pbuf_free(req->request);
-  req->request = NULL;
-
-  altcp_output(req->pcb);
-  return ERR_OK;
+  conn->connected = 1;
+  return httpc_conn_cb_result(httpc_conn_kick(conn));
 }
 
-/** Start the http request when the server IP addr is known */
+/** Connect when the server IP addr is known */
 static err_t
-httpc_get_internal_addr(httpc_state_t* req, const ip_addr_t *ipaddr)
+httpc_conn_connect(httpc_conn_t *conn, const ip_addr_t *ipaddr)
 {
   err_t err;
-  LWIP_ASSERT("req != NULL", req != NULL);
 
-  if (&req->remote_addr != ipaddr) {
+  if (&conn->remote_addr != ipaddr) {
     /* fill in remote addr if called externally */
-    req->remote_addr = *ipaddr;
+    conn->remote_addr = *ipaddr;
   }
 
-  err = altcp_connect(req->pcb, &req->remote_addr, req->remote_port, httpc_tcp_connected);
+  err = altcp_connect(conn->pcb, &conn->remote_addr, conn->remote_port, httpc_tcp_connected);
   if (err == ERR_OK) {
     return ERR_OK;
   }
@@ -456,19 +713,19 @@ httpc_get_internal_addr(httpc_state_t* req, const ip_addr_t *ipaddr)
 
 #if LWIP_DNS
 /** DNS callback
- * If ipaddr is non-NULL, resolving succeeded and the request can be sent, otherwise it failed.
+ * If ipaddr is non-NULL, resolving succeeded and the connection can be made, otherwise it failed.
  */
 static void
 httpc_dns_found(const char* hostname, const ip_addr_t *ipaddr, void *arg)
 {
-  httpc_state_t* req = (httpc_state_t*)arg;
+  httpc_conn_t* conn = (httpc_conn_t*)arg;
   err_t err;
   httpc_result_t result;
 
   LWIP_UNUSED_ARG(hostname);
 
   if (ipaddr != NULL) {
-    err = httpc_get_internal_addr(req, ipaddr);
+    err = httpc_conn_connect(conn, ipaddr);
     if (err == ERR_OK) {
       return;
     }
@@ -479,32 +736,119 @@ httpc_dns_found(const char* hostname, const ip_addr_t *ipaddr, void *arg)
     result = HTTPC_RESULT_ERR_HOSTNAME;
     err = ERR_ARG;
   }
-  httpc_close(req, result, 0, err);
+  httpc_conn_free(conn, result, err);
 }
 #endif /* LWIP_DNS */
 
-/** Start the http request after converting 'server_name' to ip address (DNS or address string) */
+/** Connect after converting the host name to ip address (DNS or address string) */
 static err_t
-httpc_get_internal_dns(httpc_state_t* req, const char* server_name)
+httpc_conn_resolve(httpc_conn_t *conn)
 {
   err_t err;
-  LWIP_ASSERT("req != NULL", req != NULL);
 
 #if LWIP_DNS
-  err = dns_gethostbyname(server_name, &req->remote_addr, httpc_dns_found, req);
+  err = dns_gethostbyname(conn->host, &conn->remote_addr, httpc_dns_found, conn);
 #else
-  err = ipaddr_aton(server_name, &req->remote_addr) ? ERR_OK : ERR_ARG;
+  err = ipaddr_aton(conn->host, &conn->remote_addr) ? ERR_OK : ERR_ARG;
 #endif
 
   if (err == ERR_OK) {
     /* cached or IP-string */
-    err = httpc_get_internal_addr(req, &req->remote_addr);
+    err = httpc_conn_connect(conn, &conn->remote_addr);
   } else if (err == ERR_INPROGRESS) {
     return ERR_OK;
   }
   return err;
 }
 
+/** Queue the request on an open keep-alive connection to host:port, or on a
+ * new connection. addr may be NULL to resolve host first. */
+static err_t
+httpc_req_attach(httpc_state_t *req, const char *host, const ip_addr_t *addr, u16_t port)
+{
+  const httpc_connection_t *settings = req->conn_settings;
+  httpc_conn_t *conn;
+  size_t host_len;
+  err_t err;
+
+  if (settings->keep_alive) {
+    for (conn = httpc_conns; conn != NULL; conn = conn->next) {
+      if (conn->keep_alive && (conn->remote_port == port) && (conn->allocator == settings->altcp_allocator) &&
+          (conn->num_reqs < HTTPC_CONN_QUEUE_MAX) && (strcmp(conn->host, host) == 0)) {
+        if (conn->idle) {
+          conn->idle = 0;
+          conn->timeout_ticks = HTTPC_POLL_TIMEOUT;
+        }
+        httpc_conn_enqueue(conn, req);
+        /* errors show up in the pcb callbacks, which move or fail the request */
+        httpc_conn_send(conn);
+        return ERR_OK;
+      }
+    }
+  }
+
+  host_len = strlen(host);
+  conn = (httpc_conn_t*)mem_malloc((mem_size_t)(sizeof(httpc_conn_t) + host_len + 1));
+  if (conn == NULL) {
+    return ERR_MEM;
+  }
+  memset(conn, 0, sizeof(httpc_conn_t));
+  conn->host = (char*)(conn + 1);
+  memcpy(conn->host, host, host_len + 1);
+  conn->allocator = settings->altcp_allocator;
+  conn->remote_port = port;
+  conn->keep_alive = settings->keep_alive;
+  conn->timeout_ticks = HTTPC_POLL_TIMEOUT;
+  httpc_parse_init(&conn->parse);
+
+  conn->pcb = altcp_new(settings->altcp_allocator);
+  if (conn->pcb == NULL) {
+    mem_free(conn);
+    return ERR_MEM;
+  }
+  altcp_arg(conn->pcb, conn);
+  altcp_recv(conn->pcb, httpc_tcp_recv);
+  altcp_err(conn->pcb, httpc_tcp_err);
+  altcp_poll(conn->pcb, httpc_tcp_poll, HTTPC_POLL_INTERVAL);
+  altcp_sent(conn->pcb, httpc_tcp_sent);
+
+  if (addr != NULL) {
+    err = httpc_conn_connect(conn, addr);
+  } else {
+    err = httpc_conn_resolve(conn);
+  }
+  if (err != ERR_OK) {
+    /* no request queued yet, nothing is reported */
+    httpc_conn_free(conn, HTTPC_RESULT_ERR_CONNECT, err);
+    return err;
+  }
+  conn->next = httpc_conns;
+  httpc_conns = conn;
+  httpc_conn_enqueue(conn, req);
+  return ERR_OK;
+}
+
+/** Start the request on a connection to the server (or the proxy).
+ * server_addr may be NULL to look up server_name. */
+static err_t
+httpc_req_start(httpc_state_t *req, const char *server_name, const ip_addr_t *server_addr, u16_t port)
+{
+  const httpc_connection_t *settings = req->conn_settings;
+  const char *host = server_name;
+
+  if (settings->use_proxy) {
+    server_addr = &settings->proxy_addr;
+    port = settings->proxy_port;
+  }
+  if (server_addr != NULL) {
+    host = ipaddr_ntoa(server_addr);
+    if (host == NULL) {
+      return ERR_VAL;
+    }
+  }
+  return httpc_req_attach(req, host, server_addr, port);
+}
+
 static int
 httpc_create_request_string(const httpc_connection_t *settings, const char* server_name, int server_port, const char* uri,
                             int use_host, char *buffer, size_t buffer_size)
@@ -512,19 +856,22 @@ httpc_create_request_string(const httpc_connection_t *settings, const char* serv
   if (settings->use_proxy) {
     LWIP_ASSERT("server_name != NULL", server_name != NULL);
     if (server_port != HTTP_DEFAULT_PORT) {
-      return snprintf(buffer, buffer_size, HTTPC_REQ_11_PROXY_PORT_FORMAT(server_name, server_port, uri, server_name));
+      return snprintf(buffer, buffer_size, HTTPC_REQ_11_PROXY_PORT_FORMAT(server_name, server_port, uri, server_name,
+        HTTPC_CONNECTION_HDR(settings)));
     } else {
-      return snprintf(buffer, buffer_size, HTTPC_REQ_11_PROXY_FORMAT(server_name, uri, server_name));
+      return snprintf(buffer, buffer_size, HTTPC_REQ_11_PROXY_FORMAT(server_name, uri, server_name,
+        HTTPC_CONNECTION_HDR(settings)));
     }
   } else if (use_host) {
     LWIP_ASSERT("server_name != NULL", server_name != NULL);
     if (settings->req_type == REQ_TYPE_POST) {
         return snprintf(buffer, buffer_size,
-                HTTPC_REQ_POST_11_HOST_FORMAT(uri, settings->content_type, server_name, settings->data, strlen((const char *)settings->data)));
+                HTTPC_REQ_POST_11_HOST_FORMAT(uri, settings->content_type, server_name, settings->data, strlen((const char *)settings->data),
+                  HTTPC_CONNECTION_HDR(settings)));
     }
-    return snprintf(buffer, buffer_size, HTTPC_REQ_11_HOST_FORMAT(uri, server_name));
+    return snprintf(buffer, buffer_size, HTTPC_REQ_11_HOST_FORMAT(uri, server_name, HTTPC_CONNECTION_HDR(settings)));
   } else {
-    return snprintf(buffer, buffer_size, HTTPC_REQ_11_FORMAT(uri));
+    return snprintf(buffer, buffer_size, HTTPC_REQ_11_FORMAT(uri, HTTPC_CONNECTION_HDR(settings)));
   }
 }
 
@@ -565,7 +912,6 @@ httpc_init_connection_common(httpc_state_t **connection, const httpc_connection_
     return ERR_MEM;
   }
   memset(req, 0, sizeof(httpc_state_t));
-  req->timeout_ticks = HTTPC_POLL_TIMEOUT;
   req->request = pbuf_alloc(PBUF_RAW, (u16_t)(req_len + 1), PBUF_RAM);
   if (req->request == NULL) {
     httpc_free_state(req);
@@ -585,17 +931,6 @@ httpc_init_connection_common(httpc_state_t **connection, const httpc_connection_
   req->uri = req->server_name + server_name_len + 1;
   memcpy(req->uri, uri, uri_len + 1);
 #endif
-  req->pcb = altcp_new(settings->altcp_allocator);
-  if(req->pcb == NULL) {
-    httpc_free_state(req);
-    return ERR_MEM;
-  }
-  req->remote_port = settings->use_proxy ? settings->proxy_port : server_port;
-  altcp_arg(req->pcb, req);
-  altcp_recv(req->pcb, httpc_tcp_recv);
-  altcp_err(req->pcb, httpc_tcp_err);
-  altcp_poll(req->pcb, httpc_tcp_poll, HTTPC_POLL_INTERVAL);
-  altcp_sent(req->pcb, httpc_tcp_sent);
 
   /* set up request buffer */
   req_len2 = httpc_create_request_string(settings, server_name, server_port, uri, use_host,
@@ -669,11 +1004,7 @@ httpc_get_file(const ip_addr_t* server_addr, u16_t port, const char* uri, const
     return err;
   }
 
-  if (settings->use_proxy) {
-    err = httpc_get_internal_addr(req, &settings->proxy_addr);
-  } else {
-    err = httpc_get_internal_addr(req, server_addr);
-  }
+  err = httpc_req_start(req, NULL, server_addr, port);
   if(err != ERR_OK) {
     httpc_free_state(req);
     return err;
@@ -713,11 +1044,7 @@ httpc_get_file_dns(const char* server_name, u16_t port, const char* uri, const h
     return err;
   }
 
-  if (settings->use_proxy) {
-    err = httpc_get_internal_addr(req, &settings->proxy_addr);
-  } else {
-    err = httpc_get_internal_dns(req, server_name);
-  }
+  err = httpc_req_start(req, server_name, NULL, port);
   if(err != ERR_OK) {
     httpc_free_state(req);
     return err;
@@ -729,6 +1056,25 @@ httpc_get_file_dns(const char* server_name, u16_t port, const char* uri, const h
   return ERR_OK;
 }
 
+/**
+ * @ingroup httpc
+ * HTTP client API: close the keep-alive connections that have no request
+ * queued, e.g. before the network goes down. Connections still answering
+ * requests are closed once they are done.
+ */
+void
+httpc_close_idle(void)
+{
+  httpc_conn_t *conn, *next;
+
+  for (conn = httpc_conns; conn != NULL; conn = next) {
+    next = conn->next;
+    if (conn->idle) {
+      httpc_conn_free(conn, HTTPC_RESULT_OK, ERR_OK);
+    }
+  }
+}
+
 #if LWIP_HTTPC_HAVE_FILE_IO
 /* Implementation to disk via fopen/fwrite/fclose follows */
 
@@ -862,11 +1208,7 @@ httpc_get_file_to_disk(const ip_addr_t* server_addr, u16_t port, const char* uri
     return err;
   }
 
-  if (settings->use_proxy) {
-    err = httpc_get_internal_addr(req, &settings->proxy_addr);
-  } else {
-    err = httpc_get_internal_addr(req, server_addr);
-  }
+  err = httpc_req_start(req, NULL, server_addr, port);
   if(err != ERR_OK) {
     httpc_fs_free(filestate);
     httpc_free_state(req);
@@ -914,11 +1256,7 @@ httpc_get_file_dns_to_disk(const char* server_name, u16_t port, const char* uri,
     return err;
   }
 
-  if (settings->use_proxy) {
-    err = httpc_get_internal_addr(req, &settings->proxy_addr);
-  } else {
-    err = httpc_get_internal_dns(req, server_name);
-  }
+  err = httpc_req_start(req, server_name, NULL, port);
   if(err != ERR_OK) {
     httpc_fs_free(filestate);
     httpc_free_state(req);
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * HTTP/1.x response framing for the http client
+ */
+
+#include <http_client_parse.h>
+
+#include <string.h>
+
+enum {
+  HTTPC_PS_STATUS = 0,
+  HTTPC_PS_HEADER,
+  HTTPC_PS_BODY,
+  HTTPC_PS_BODY_CLOSE,
+  HTTPC_PS_CHUNK_SIZE,
+  HTTPC_PS_CHUNK_DATA,
+  HTTPC_PS_CHUNK_END,
+  HTTPC_PS_TRAILER,
+  HTTPC_PS_DONE,
+  HTTPC_PS_ERROR
+};
+
+static int
+httpc_parse_lower(int c)
+{
+  return ((c >= 'A') && (c <= 'Z')) ? (c - 'A' + 'a') : c;
+}
+
+/** Case insensitive prefix match, returns the value after the name and spaces */
+static const char *
+httpc_parse_header_value(const char *line, const char *name)
+{
+  while (*name) {
+    if (httpc_parse_lower(*line++) != *name++) {
+      return NULL;
+    }
+  }
+  while ((*line == ' ') || (*line == '\t')) {
+    line++;
+  }
+  return line;
+}
+
+/** Case insensitive search of token in a header value */
+static int
+httpc_parse_has_token(const char *value, const char *token)
+{
+  size_t len = strlen(token);
+  size_t i;
+
+  for (; *value; value++) {
+    for (i = 0; i < len; i++) {
+      if (httpc_parse_lower(value[i]) != token[i]) {
+        break;
+      }
+    }
+    if (i == len) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int
+httpc_parse_status_line(httpc_parse_t *ps, const char *line)
+{
+  int i;
+
+  if ((memcmp(line, "HTTP/", 5) != 0) ||
+      (line[5] < '0') || (line[5] > '9') || (line[6] != '.') ||
+      (line[7] < '0') || (line[7] > '9') || (line[8] != ' ')) {
+    return -1;
+  }
+  ps->http_version = (uint16_t)(((line[5] - '0') << 8) | (line[7] - '0'));
+  ps->status = 0;
+  for (i = 9; i < 12; i++) {
+    if ((line[i] < '0') || (line[i] > '9')) {
+      return -1;
+    }
+    ps->status = (uint16_t)(ps->status * 10 + (line[i] - '0'));
+  }
+  return 0;
+}
+
+static httpc_parse_ev_t
+httpc_parse_headers_end(httpc_parse_t *ps)
+{
+  if ((ps->status >= 100) && (ps->status < 200) && (ps->status != 101)) {
+    /* interim response, the real one follows */
+    ps->state = HTTPC_PS_STATUS;
+    ps->hdr_len = 0;
+    return HTTPC_PARSE_EV_INTERIM;
+  }
+
+  if (ps->http_version >= 0x0101) {
+    ps->keep_alive = !ps->conn_close;
+  } else {
+    ps->keep_alive = ps->conn_keep && !ps->conn_close;
+  }
+
+  if ((ps->status == 101) || (ps->status == 204) || (ps->status == 304)) {
+    /* no body */
+    ps->keep_alive = ps->keep_alive && (ps->status != 101);
+    ps->state = HTTPC_PS_DONE;
+  } else if (ps->chunked) {
+    /* chunked wins over Content-Length */
+    ps->state = HTTPC_PS_CHUNK_SIZE;
+  } else if (ps->content_len != HTTPC_PARSE_LEN_INVALID) {
+    ps->left = ps->content_len;
+    ps->state = ps->left ? HTTPC_PS_BODY : HTTPC_PS_DONE;
+  } else {
+    /* framed by close only */
+    ps->keep_alive = 0;
+    ps->state = HTTPC_PS_BODY_CLOSE;
+  }
+  return HTTPC_PARSE_EV_HEADERS;
+}
+
+static httpc_parse_ev_t
+httpc_parse_header_line(httpc_parse_t *ps, const char *line)
+{
+  const char *value;
+  uint32_t len;
+
+  if (line[0] == '\0') {
+    return httpc_parse_headers_end(ps);
+  }
+  if ((value = httpc_parse_header_value(line, "content-length:")) != NULL) {
+    if ((*value < '0') || (*value > '9')) {
+      return HTTPC_PARSE_EV_ERROR;
+    }
+    for (len = 0; (*value >= '0') && (*value <= '9'); value++) {
+      if (len > (HTTPC_PARSE_LEN_INVALID - 1 - 9) / 10) {
+        return HTTPC_PARSE_EV_ERROR;
+      }
+      len = len * 10 + (uint32_t)(*value - '0');
+    }
+    ps->content_len = len;
+  } else if ((value = httpc_parse_header_value(line, "transfer-encoding:")) != NULL) {
+    ps->chunked = (uint8_t)httpc_parse_has_token(value, "chunked");
+  } else if ((value = httpc_parse_header_value(line, "connection:")) != NULL) {
+    ps->conn_close |= (uint8_t)httpc_parse_has_token(value, "close");
+    ps->conn_keep |= (uint8_t)httpc_parse_has_token(value, "keep-alive");
+  }
+  return HTTPC_PARSE_EV_NONE;
+}
+
+static httpc_parse_ev_t
+httpc_parse_chunk_size(httpc_parse_t *ps, const char *line)
+{
+  uint32_t size = 0;
+  int digits = 0;
+  int c;
+
+  /* chunk extensions after ';' are ignored */
+  for (; *line && (*line != ';') && (*line != ' ') && (*line != '\t'); line++, digits++) {
+    c = httpc_parse_lower(*line);
+    if (size > 0x07FFFFFF) {
+      return HTTPC_PARSE_EV_ERROR;
+    }
+    if ((c >= '0') && (c <= '9')) {
+      size = (size << 4) | (uint32_t)(c - '0');
+    } else if ((c >= 'a') && (c <= 'f')) {
+      size = (size << 4) | (uint32_t)(c - 'a' + 10);
+    } else {
+      return HTTPC_PARSE_EV_ERROR;
+    }
+  }
+  if (!digits) {
+    return HTTPC_PARSE_EV_ERROR;
+  }
+  if (size) {
+    ps->left = size;
+    ps->state = HTTPC_PS_CHUNK_DATA;
+  } else {
+    ps->state = HTTPC_PS_TRAILER;
+  }
+  return HTTPC_PARSE_EV_NONE;
+}
+
+static httpc_parse_ev_t
+httpc_parse_line(httpc_parse_t *ps)
+{
+  const char *line = ps->line;
+
+  switch (ps->state) {
+    case HTTPC_PS_STATUS:
+      if (line[0] == '\0') {
+        /* tolerate empty lines before the status line */
+        return HTTPC_PARSE_EV_NONE;
+      }
+      if (httpc_parse_status_line(ps, line) != 0) {
+        return HTTPC_PARSE_EV_ERROR;
+      }
+      ps->chunked = 0;
+      ps->conn_close = 0;
+      ps->conn_keep = 0;
+      ps->content_len = HTTPC_PARSE_LEN_INVALID;
+      ps->state = HTTPC_PS_HEADER;
+      return HTTPC_PARSE_EV_NONE;
+    case HTTPC_PS_HEADER:
+      return httpc_parse_header_line(ps, line);
+    case HTTPC_PS_CHUNK_SIZE:
+      return httpc_parse_chunk_size(ps, line);
+    case HTTPC_PS_CHUNK_END:
+      if (line[0] != '\0') {
+        return HTTPC_PARSE_EV_ERROR;
+      }
+      ps->state = HTTPC_PS_CHUNK_SIZE;
+      return HTTPC_PARSE_EV_NONE;
+    case HTTPC_PS_TRAILER:
+      if (line[0] == '\0') {
+        ps->state = HTTPC_PS_DONE;
+        return HTTPC_PARSE_EV_DONE;
+      }
+      return HTTPC_PARSE_EV_NONE;
+    default:
+      return HTTPC_PARSE_EV_ERROR;
+  }
+}
+
+void
+httpc_parse_init(httpc_parse_t *ps)
+{
+  memset(ps, 0, sizeof(httpc_parse_t));
+  ps->content_len = HTTPC_PARSE_LEN_INVALID;
+  ps->state = HTTPC_PS_STATUS;
+}
+
+httpc_parse_ev_t
+httpc_parse_feed(httpc_parse_t *ps, const uint8_t *data, uint16_t len, uint16_t *used)
+{
+  httpc_parse_ev_t ev = HTTPC_PARSE_EV_NONE;
+  uint16_t i = 0;
+  uint8_t c;
+
+  while ((i < len) && (ev == HTTPC_PARSE_EV_NONE)) {
+    if ((ps->state != HTTPC_PS_STATUS) && (ps->state != HTTPC_PS_HEADER) &&
+        (ps->state != HTTPC_PS_CHUNK_SIZE) && (ps->state != HTTPC_PS_CHUNK_END) &&
+        (ps->state != HTTPC_PS_TRAILER)) {
+      /* body bytes or the response is done */
+      break;
+    }
+    c = data[i++];
+    if ((ps->state == HTTPC_PS_STATUS) || (ps->state == HTTPC_PS_HEADER)) {
+      if (++ps->hdr_len > HTTPC_PARSE_HDR_MAX) {
+        ev = HTTPC_PARSE_EV_ERROR;
+        break;
+      }
+    }
+    if (c == '\n') {
+      if ((ps->line_len > 0) && (ps->line[ps->line_len - 1] == '\r')) {
+        ps->line_len--;
+      }
+      ps->line[ps->line_len] = '\0';
+      ps->line_len = 0;
+      ev = httpc_parse_line(ps);
+    } else if (ps->line_len < HTTPC_PARSE_LINE_MAX - 1) {
+      ps->line[ps->line_len++] = (char)c;
+    }
+  }
+  if (ev == HTTPC_PARSE_EV_ERROR) {
+    ps->state = HTTPC_PS_ERROR;
+  }
+  *used = i;
+  return ev;
+}
+
+uint32_t
+httpc_parse_body_left(const httpc_parse_t *ps)
+{
+  switch (ps->state) {
+    case HTTPC_PS_BODY:
+    case HTTPC_PS_CHUNK_DATA:
+      return ps->left;
+    case HTTPC_PS_BODY_CLOSE:
+      return HTTPC_PARSE_UNTIL_CLOSE;
+    default:
+      return 0;
+  }
+}
+
+void
+httpc_parse_body_consumed(httpc_parse_t *ps, uint32_t len)
+{
+  if (ps->state == HTTPC_PS_BODY) {
+    ps->left -= len;
+    if (ps->left == 0) {
+      ps->state = HTTPC_PS_DONE;
+    }
+  } else if (ps->state == HTTPC_PS_CHUNK_DATA) {
+    ps->left -= len;
+    if (ps->left == 0) {
+      ps->state = HTTPC_PS_CHUNK_END;
+    }
+  }
+}
+
+int
+httpc_parse_is_done(const httpc_parse_t *ps)
+{
+  return ps->state == HTTPC_PS_DONE;
+}
+
+int
+httpc_parse_closed(httpc_parse_t *ps)
+{
+  if (ps->state == HTTPC_PS_BODY_CLOSE) {
+    ps->state = HTTPC_PS_DONE;
+  }
+  return ps->state == HTTPC_PS_DONE;
+}
@@ -135,6 +135,9 @@ typedef struct _httpc_connection {
 #define CONTENT_TYPE_MULT  2 // multipart/form-data
 #define CONTENT_TYPE_TEXT  3 // text/xml
   u8_t content_type;
+  /* set to 1 to keep the connection open after the response and reuse it for
+     later keep_alive requests to the same server (see HTTPC_PIPELINING) */
+  u8_t keep_alive;
   /* @todo: add username:pass? */
 
 #if LWIP_ALTCP
@@ -153,6 +156,8 @@ err_t httpc_get_file(const ip_addr_t* server_addr, u16_t port, const char* uri,
 err_t httpc_get_file_dns(const char* server_name, u16_t port, const char* uri, const httpc_connection_t *settings,
                      altcp_recv_fn recv_fn, void* callback_arg, httpc_state_t **connection);
 
+void  httpc_close_idle(void);
+
 #if LWIP_HTTPC_HAVE_FILE_IO
 err_t httpc_get_file_to_disk(const ip_addr_t* server_addr, u16_t port, const char* uri, const httpc_connection_t *settings,
                      void* callback_arg, const char* local_file_name, httpc_state_t **connection);
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * HTTP/1.x response framing, used by the http client and the https component
+ *
+ * Works on plain bytes and keeps no pointer into them, so responses may be
+ * split anywhere between calls. The caller feeds the status line, headers
+ * and chunk framing through httpc_parse_feed() and moves body bytes itself,
+ * asking httpc_parse_body_left() how many belong to the current response.
+ */
+
+#ifndef HTTP_CLIENT_PARSE_H
+#define HTTP_CLIENT_PARSE_H
+
+#include <stdint.h>
+
+/** Longest header line that is looked at, the rest of a line is skipped */
+#ifndef HTTPC_PARSE_LINE_MAX
+#define HTTPC_PARSE_LINE_MAX      48
+#endif
+
+/** Headers must fit in a pbuf chain addressed by u16_t */
+#define HTTPC_PARSE_HDR_MAX       0xFFF0
+
+/** No Content-Length header */
+#define HTTPC_PARSE_LEN_INVALID   0xFFFFFFFF
+/** httpc_parse_body_left(): body runs until the server closes */
+#define HTTPC_PARSE_UNTIL_CLOSE   0xFFFFFFFF
+
+typedef enum ehttpc_parse_ev {
+  /** bytes consumed, more needed */
+  HTTPC_PARSE_EV_NONE = 0,
+  /** a 1xx response was skipped, its bytes are not part of any header */
+  HTTPC_PARSE_EV_INTERIM,
+  /** headers complete, body framing known */
+  HTTPC_PARSE_EV_HEADERS,
+  /** response complete */
+  HTTPC_PARSE_EV_DONE,
+  /** malformed response, the connection can't be used any more */
+  HTTPC_PARSE_EV_ERROR
+} httpc_parse_ev_t;
+
+typedef struct _httpc_parse
+{
+  uint8_t state;
+  uint8_t chunked;
+  /** connection may carry another request once this response is done */
+  uint8_t keep_alive;
+  uint8_t conn_close;
+  uint8_t conn_keep;
+  uint16_t http_version;    /* major << 8 | minor */
+  uint16_t status;
+  uint32_t content_len;     /* HTTPC_PARSE_LEN_INVALID if none */
+  uint32_t left;            /* body or chunk bytes still to come */
+  uint32_t hdr_len;         /* header bytes so far, including 1xx ones */
+  uint16_t line_len;
+  char line[HTTPC_PARSE_LINE_MAX];
+} httpc_parse_t;
+
+/** Prepare for the next response */
+void httpc_parse_init(httpc_parse_t *ps);
+/**
+ * Consume framing bytes from data, stopping at the first event or where
+ * body bytes start. *used is set to the bytes consumed.
+ */
+httpc_parse_ev_t httpc_parse_feed(httpc_parse_t *ps, const uint8_t *data, uint16_t len, uint16_t *used);
+/** Body bytes the caller may take now, 0 when framing is expected */
+uint32_t httpc_parse_body_left(const httpc_parse_t *ps);
+/** The caller took len body bytes */
+void httpc_parse_body_consumed(httpc_parse_t *ps, uint32_t len);
+/** Response complete, no more bytes belong to it */
+int httpc_parse_is_done(const httpc_parse_t *ps);
+/** The server closed the connection, returns 1 if that completes the response */
+int httpc_parse_closed(httpc_parse_t *ps);
+
+#endif /* HTTP_CLIENT_PARSE_H */
@@ -7,6 +7,7 @@ COMPONENT_ADD_INCLUDEDIRS += include
 COMPONENT_PRIV_INCLUDEDIRS := include
 
 ## This component's src
+## (response framing comes from http_client_parse of the httpc component)
 COMPONENT_SRCS := src/bl_https.c \
                   src/https.c \
 
@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Host test of the TLS client (../src/https.c) against an OpenSSL server.
+ *
+ * https.c is built with the Linux socket API standing in for lwIP's and a
+ * pthread mutex for the FreeRTOS one. The server runs in a thread on
+ * 127.0.0.1 with a self-signed RSA 2048 certificate generated at start, and
+ * echoes what it reads. It counts handshakes and how many of them resumed a
+ * session, which tells whether the client offered its cached session.
+ *
+ * Times TEST_ROUNDS full handshakes, with the cache cleared before each, and
+ * TEST_ROUNDS resumed ones, and prints the means; a resumed handshake has to
+ * be faster. Also covers the echo through blTcpSslSend/WaitRead/Read, a server
+ * that lost the session (new ticket keys and an empty cache: a full handshake,
+ * then resuming the new session) and a connect to a closed port.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+/* The FreeRTOS, aos and lwIP headers https.c includes are replaced below */
+#define INC_FREERTOS_H
+#define INC_TASK_H
+#define QUEUE_H
+#define TIMERS_H
+#define SEMAPHORE_H
+#define AOS_KERNEL_H
+#define AOS_YLOOP_H
+#define LWIP_HDR_SOCKETS_H
+#define LWIP_HDR_TCP_H
+#define LWIP_HDR_ERR_H
+#define LWIP_HDR_DNS_H
+#define LWIP_HDR_NETDB_H
+
+typedef uint32_t TickType_t;
+typedef pthread_mutex_t *SemaphoreHandle_t;
+
+#define portMAX_DELAY       ((TickType_t)0xffffffffUL)
+
+static TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static void vTaskSuspendAll(void)
+{
+}
+
+static long xTaskResumeAll(void)
+{
+    return 1;
+}
+
+static SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    return &mutex;
+}
+
+static long xSemaphoreTake(SemaphoreHandle_t mutex, [[gnu::unused]] TickType_t wait)
+{
+    return 0 == pthread_mutex_lock(mutex);
+}
+
+static long xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+    return 0 == pthread_mutex_unlock(mutex);
+}
+
+/*
+ * Connection handles are int32_t pointers, as on the device. The contexts
+ * come from a static arena, which a non-PIE build (see CMakeLists.txt) links
+ * below 2G.
+ */
+#define TEST_ARENA_SLOTS    4
+#define TEST_ARENA_SLOT     (512 * 1024)
+
+static uint8_t test_arena[TEST_ARENA_SLOTS][TEST_ARENA_SLOT] __attribute__((aligned(16)));
+static int test_arena_used[TEST_ARENA_SLOTS];
+
+static void *aos_malloc(size_t size)
+{
+    int i;
+
+    if (size > TEST_ARENA_SLOT) {
+        printf("FAIL aos_malloc %zu bytes, the arena slots are %d\n", size, TEST_ARENA_SLOT);
+        exit(1);
+    }
+    for (i = 0; i < TEST_ARENA_SLOTS; i++) {
+        if (!test_arena_used[i]) {
+            if ((intptr_t)(int32_t)(intptr_t)test_arena[i] != (intptr_t)test_arena[i]) {
+                printf("FAIL arena at %p does not fit an int32_t handle, build without PIE\n", (void *)test_arena[i]);
+                exit(1);
+            }
+            test_arena_used[i] = 1;
+            return test_arena[i];
+        }
+    }
+    return NULL;
+}
+
+static void aos_free(void *p)
+{
+    int i;
+
+    for (i = 0; i < TEST_ARENA_SLOTS; i++) {
+        if (p == test_arena[i]) {
+            test_arena_used[i] = 0;
+        }
+    }
+}
+
+#include "../src/https.c"
+
+#define TEST_ROUNDS         20
+
+static int test_failed;
+
+#define TEST_CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d %s\n", __FILE__, __LINE__, #cond); \
+        test_failed = 1; \
+    } \
+} while (0)
+
+/*
+ * The server. Moving on to the second context forgets every session the
+ * client holds.
+ */
+static SSL_CTX *srv_ctx[2];
+static int srv_ctx_cur;
+static int srv_fd;
+static uint16_t srv_port;
+static pthread_mutex_t srv_lock = PTHREAD_MUTEX_INITIALIZER;
+static int srv_handshakes;
+static int srv_resumed;
+
+static SSL_CTX *srv_ctx_create(EVP_PKEY *key, X509 *crt)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+
+    if (NULL == ctx || 1 != SSL_CTX_use_certificate(ctx, crt) || 1 != SSL_CTX_use_PrivateKey(ctx, key)) {
+        ERR_print_errors_fp(stdout);
+        exit(1);
+    }
+    /* the mbed TLS 2.x client offers TLS 1.2 at most */
+    SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    return ctx;
+}
+
+static void srv_create(void)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    EVP_PKEY *key;
+    X509 *crt;
+    X509_NAME *name;
+
+    key = EVP_RSA_gen(2048);
+    crt = X509_new();
+    if (NULL == key || NULL == crt) {
+        ERR_print_errors_fp(stdout);
+        exit(1);
+    }
+    X509_set_version(crt, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(crt), 1);
+    X509_gmtime_adj(X509_getm_notBefore(crt), 0);
+    X509_gmtime_adj(X509_getm_notAfter(crt), 24 * 3600);
+    X509_set_pubkey(crt, key);
+    name = X509_get_subject_name(crt);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"localhost", -1, -1, 0);
+    X509_set_issuer_name(crt, name);
+    if (0 == X509_sign(crt, key, EVP_sha256())) {
+        ERR_print_errors_fp(stdout);
+        exit(1);
+    }
+
+    srv_ctx[0] = srv_ctx_create(key, crt);
+    srv_ctx[1] = srv_ctx_create(key, crt);
+    X509_free(crt);
+    EVP_PKEY_free(key);
+
+    srv_fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (srv_fd < 0 || bind(srv_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(srv_fd, 4) != 0 || getsockname(srv_fd, (struct sockaddr *)&addr, &len) != 0) {
+        printf("FAIL server socket: %s\n", strerror(errno));
+        exit(1);
+    }
+    srv_port = ntohs(addr.sin_port);
+}
+
+static void *srv_task([[gnu::unused]] void *arg)
+{
+    char buf[256];
+    SSL *ssl;
+    int fd, n;
+
+    while ((fd = accept(srv_fd, NULL, NULL)) >= 0) {
+        pthread_mutex_lock(&srv_lock);
+        ssl = SSL_new(srv_ctx[srv_ctx_cur]);
+        pthread_mutex_unlock(&srv_lock);
+        SSL_set_fd(ssl, fd);
+
+        if (1 == SSL_accept(ssl)) {
+            pthread_mutex_lock(&srv_lock);
+            srv_handshakes++;
+            srv_resumed += SSL_session_reused(ssl);
+            pthread_mutex_unlock(&srv_lock);
+
+            while ((n = SSL_read(ssl, buf, sizeof(buf))) > 0) {
+                SSL_write(ssl, buf, n);
+            }
+            SSL_shutdown(ssl);
+        }
+        SSL_free(ssl);
+        close(fd);
+    }
+    return NULL;
+}
+
+static void srv_counts(int *handshakes, int *resumed)
+{
+    pthread_mutex_lock(&srv_lock);
+    *handshakes = srv_handshakes;
+    *resumed = srv_resumed;
+    pthread_mutex_unlock(&srv_lock);
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Connect, echo one message, disconnect. Returns the handshake time in ms. */
+static double test_connect(void)
+{
+    static const char msg[] = "hello over tls";
+    uint8_t buf[64];
+    int32_t fd, ret;
+    double start, elapsed;
+    int got = 0;
+
+    start = now_ms();
+    fd = blTcpSslConnect("127.0.0.1", srv_port);
+    TEST_CHECK(fd > 0);
+    if (fd <= 0) {
+        return 0;
+    }
+    while (BL_TCP_CONNECTING == (ret = blTcpSslState(fd))) {
+    }
+    elapsed = now_ms() - start;
+    TEST_CHECK(BL_TCP_NO_ERROR == ret);
+
+    if (BL_TCP_NO_ERROR == ret) {
+        TEST_CHECK(sizeof(msg) == blTcpSslSend(fd, (const uint8_t *)msg, sizeof(msg)));
+        while (got < (int)sizeof(msg)) {
+            if (blTcpSslWaitRead(fd, 1000) != 1) {
+                break;
+            }
+            ret = blTcpSslRead(fd, buf + got, sizeof(buf) - got);
+            if (ret < 0) {
+                break;
+            }
+            got += ret;
+        }
+        TEST_CHECK(sizeof(msg) == got && 0 == memcmp(buf, msg, sizeof(msg)));
+    }
+
+    blTcpSslDisconnect(fd);
+    return elapsed;
+}
+
+static void test_handshakes(void)
+{
+    double full = 0, resumed = 0;
+    int handshakes, reused, handshakes0, reused0;
+    int i;
+
+    srv_counts(&handshakes0, &reused0);
+    for (i = 0; i < TEST_ROUNDS; i++) {
+        blTcpSslSessionClear();
+        full += test_connect();
+    }
+    srv_counts(&handshakes, &reused);
+    TEST_CHECK(handshakes == handshakes0 + TEST_ROUNDS);
+    TEST_CHECK(reused == reused0);
+
+    /* the last full handshake left a session in the cache */
+    for (i = 0; i < TEST_ROUNDS; i++) {
+        resumed += test_connect();
+    }
+    srv_counts(&handshakes, &reused);
+    TEST_CHECK(handshakes == handshakes0 + 2 * TEST_ROUNDS);
+    TEST_CHECK(reused == reused0 + TEST_ROUNDS);
+
+    printf("handshake: full %.3f ms, resumed %.3f ms, mean of %d\n",
+           full / TEST_ROUNDS, resumed / TEST_ROUNDS, TEST_ROUNDS);
+    TEST_CHECK(resumed < full);
+}
+
+static void test_server_forgot(void)
+{
+    int handshakes0, reused0, handshakes, reused;
+
+    test_connect();
+    srv_counts(&handshakes0, &reused0);
+
+    pthread_mutex_lock(&srv_lock);
+    srv_ctx_cur = 1;
+    pthread_mutex_unlock(&srv_lock);
+
+    /* the session offered is refused, then the new one is kept */
+    test_connect();
+    test_connect();
+    srv_counts(&handshakes, &reused);
+    TEST_CHECK(handshakes == handshakes0 + 2);
+    TEST_CHECK(reused == reused0 + 1);
+}
+
+static void test_closed_port(void)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int32_t fd, ret = BL_TCP_CREATE_CONNECT_ERR;
+    int s;
+
+    /* a port nothing listens on: bound but never listened */
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(s, (struct sockaddr *)&addr, sizeof(addr));
+    getsockname(s, (struct sockaddr *)&addr, &len);
+
+    fd = blTcpSslConnect("127.0.0.1", ntohs(addr.sin_port));
+    if (fd > 0) {
+        while (BL_TCP_CONNECTING == (ret = blTcpSslState(fd))) {
+        }
+        blTcpSslDisconnect(fd);
+    }
+    TEST_CHECK(BL_TCP_CONNECT_ERR == ret || BL_TCP_CREATE_CONNECT_ERR == ret);
+    close(s);
+}
+
+int main(void)
+{
+    pthread_t srv;
+    int i;
+
+    setvbuf(stdout, NULL, _IONBF, 0);
+    srv_create();
+    pthread_create(&srv, NULL, srv_task, NULL);
+
+    test_handshakes();
+    test_server_forgot();
+    test_closed_port();
+
+    shutdown(srv_fd, SHUT_RDWR);
+    pthread_join(srv, NULL);
+    close(srv_fd);
+    SSL_CTX_free(srv_ctx[0]);
+    SSL_CTX_free(srv_ctx[1]);
+
+    for (i = 0; i < TEST_ARENA_SLOTS; i++) {
+        /* only the shared config is left */
+        TEST_CHECK(test_arena[i] == (uint8_t *)https_shared || !test_arena_used[i]);
+    }
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
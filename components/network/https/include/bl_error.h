@@ -11,6 +11,7 @@
 #define BL_TCP_CONNECT_ERR            (-27)      /**< TCP连接失败 */
 #define BL_TCP_CONNECTING             (-28)      /**< TCP连接中    */
 #define BL_TCP_READ_INCOMPLETED       (-29)      /**< TCP读包不完整 */
+#define BL_TCP_PEER_CLOSED            (-30)      /**< 对端已关闭连接 */
 #define BL_TCP_CREATE_SERVER_ERR      (-31)      /**< 创建TCP服务错误 */
 #define BL_TCP_SERVER_WAIT_CONNECT    (-32)      /**< tcp等待客户端连接 */
 #define BL_TCP_DNS_PARSING            (-35)      /**< DNS解析中 */
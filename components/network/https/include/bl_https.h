@@ -12,6 +12,18 @@
 #define BL_HTTPSC_RET_HTTP_ERR              (-4)    /* response do not look like http */
 #define BL_HTTPSC_RET_ERR_BUF_TOO_SMALL     (-5)
 #define BL_HTTPSC_HEAD_END_NOT_FOUND        (-6)
+#define BL_HTTPSC_RET_ABORTED               (-7)    /* body callback returned non-zero */
+
+/* Called for each piece of the response body, a non-zero return aborts the request */
+typedef int (*https_body_fn_t)(void *arg, const uint8_t *data, int len);
+
+/* Send request and stream the response body to body_fn, returns the HTTP
+ * status code or a BL_HTTPSC error code */
+int https_request_stream(const char *server, uint16_t port, const uint8_t *request, int req_len,
+                         https_body_fn_t body_fn, void *arg);
+/* Same, collecting the body in response, *res_len is its capacity on entry
+ * and the body length on return */
+int https_request(const char *server, uint16_t port, const uint8_t *request, int req_len, uint8_t *response, int *res_len);
 
 void cmd_https_test(char *buf, int len, int argc, char **arg);
 
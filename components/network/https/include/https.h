@@ -7,7 +7,9 @@
  * @brief 创建加密tcp连接
  *
  * @par 描述:
- * 创建非阻塞模式加密tcp连接
+ * 创建非阻塞模式加密tcp连接。所有连接共用同一份TLS配置、CA证书和随机数生成器，
+ * 首次调用时初始化。若之前与同一服务器(dst, port)完成过握手，会尝试用缓存的会话
+ * (session ID或session ticket)进行简化握手。
  *
  * @param dst      [IN] 接收方ip地址。
  * @param port     [IN] 接收方端口号。
@@ -22,7 +24,7 @@ int32_t blTcpSslConnect(const char* dst, uint16_t port);
  * @brief 加密tcp连接状态
  *
  * @par 描述:
- * 查询加密tcp连接状态
+ * 查询加密tcp连接状态，推进握手，最多等待100ms。
  *
  * @param fd      [IN] tcp套接字。
  *
@@ -68,9 +70,38 @@ int32_t blTcpSslSend(int32_t fd, const uint8_t* buf, uint16_t len);
  * @param buf     [IN] 指向存放接收数据缓冲区的指针。
  * @param len     [IN] 存放接收数据缓冲区的最大长度，范围为[0，512)。
  *
+ * @retval 大于0                 读取的字节数。
+ * @retval 0                    暂无数据。
+ * @retval BL_TCP_PEER_CLOSED   对端已关闭连接。
  * @retval blTcpErrorCode  bl tcp错误码。
  * @see blTcpErrorCode
  */
 int32_t blTcpSslRead(int32_t fd, uint8_t* buf, uint16_t len);
 
+/**
+ * @brief 等待加密tcp数据
+ *
+ * @par 描述:
+ * 等待连接上有数据可读，已解密未读取的数据也算在内。
+ *
+ * @param fd          [IN] tcp套接字。
+ * @param timeout_ms  [IN] 最长等待时间，单位毫秒。
+ *
+ * @retval 1    有数据可读，或连接已关闭，调用blTcpSslRead获取结果。
+ * @retval 0    超时。
+ * @retval blTcpErrorCode  bl tcp错误码。
+ * @see blTcpErrorCode
+ */
+int32_t blTcpSslWaitRead(int32_t fd, uint32_t timeout_ms);
+
+/**
+ * @brief 清除TLS会话缓存
+ *
+ * @par 描述:
+ * 丢弃所有缓存的会话，之后的连接都进行完整握手。
+ *
+ * @retval 无。
+ */
+void blTcpSslSessionClear(void);
+
 #endif
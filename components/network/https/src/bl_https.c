@@ -10,155 +10,220 @@
 #include <https.h>
 #include <bl_error.h>
 #include <bl_https.h>
-#include <mbedtls/ssl.h>
+#include <http_client_parse.h>
 
-void *memmem(const void *haystack, size_t n, const void *needle, size_t m);
+/* Receive buffer of https_request_stream(), body chunks are at most this long */
+#ifndef HTTPS_RX_BUF_SIZE
+#define HTTPS_RX_BUF_SIZE       1024
+#endif
+
+/* How long one blTcpSslWaitRead() waits before the timeout is checked */
+#define HTTPS_POLL_MS           100
 
-static int isdigit(int c)
+typedef struct _https_copy {
+    uint8_t *buf;
+    int size;
+    int len;
+} https_copy_t;
+
+static int https_timeout(TickType_t start)
 {
-    return c >= '0' && c <= '9';
+    return (xTaskGetTickCount() - start) > pdMS_TO_TICKS(BL_HTTPS_RET_TIMEOUT);
 }
 
-static int proc_http_head(const uint8_t *buf, int buf_len, int *status_code, int *body_start_off)
+static int https_send_all(int32_t fd, const uint8_t *request, int req_len)
 {
-    char status_code_buf[4] = { '\0', '\0', '\0', '\0' };
-    void *head_end_pos = NULL;
-
-    if (buf_len < 16) { // "HTTP/1.1 XYZ\r\n\r\n"
-        return BL_HTTPSC_RET_HTTP_ERR;
-    }
-    if (!((memcmp(buf, "HTTP/1.0 ", 9) == 0) || (0 == memcmp(buf, "HTTP/1.1 ", 9)))) {
-        return BL_HTTPSC_RET_HTTP_ERR;
+    TickType_t start = xTaskGetTickCount();
+    int32_t send_ret;
+    int off = 0;
+    int n;
+
+    while (off < req_len) {
+        n = req_len - off;
+        if (n > 0xFFFF) {
+            n = 0xFFFF;
+        }
+        send_ret = blTcpSslSend(fd, request + off, n);
+        if (send_ret < 0) {
+            log_error("ssl tcp send data failed\r\n");
+            return BL_HTTPSC_RET_ERR;
+        }
+        if (send_ret > 0) {
+            off += send_ret;
+            start = xTaskGetTickCount();
+        } else if (https_timeout(start)) {
+            log_error("ssl tcp send timeout\r\n");
+            return BL_HTTPSC_RET_TIMEOUT;
+        } else {
+            vTaskDelay(1);
+        }
     }
 
-    memcpy(status_code_buf, buf + 9, 3);
-    if (!(isdigit(status_code_buf[0]) && isdigit(status_code_buf[1]) && isdigit(status_code_buf[2]))) {
-        return BL_HTTPSC_RET_HTTP_ERR;
-    }
-    *status_code = atoi(status_code_buf);
+    return BL_HTTPSC_OK;
+}
+
+/* Read one response, handing its body to body_fn as it arrives */
+static int https_recv_response(int32_t fd, uint8_t *rcv_buf, https_body_fn_t body_fn, void *arg)
+{
+    TickType_t start = xTaskGetTickCount();
+    httpc_parse_t ps;
+    httpc_parse_ev_t ev;
+    int32_t rcv_ret;
+    int rcv_len = 0;
+    int rcv_off = 0;
+    int status_code = BL_HTTPSC_RET_HTTP_ERR;
+    uint32_t left;
+    uint16_t used;
+
+    httpc_parse_init(&ps);
+
+    while (!httpc_parse_is_done(&ps)) {
+        if (rcv_off == rcv_len) {
+            rcv_ret = blTcpSslWaitRead(fd, HTTPS_POLL_MS);
+            if (rcv_ret > 0) {
+                rcv_ret = blTcpSslRead(fd, rcv_buf, HTTPS_RX_BUF_SIZE);
+            }
+            if (BL_TCP_PEER_CLOSED == rcv_ret) {
+                if (httpc_parse_closed(&ps)) {
+                    /* body delimited by the close */
+                    break;
+                }
+                log_error("connection closed before the response was complete\r\n");
+                return BL_HTTPSC_RET_HTTP_ERR;
+            }
+            if (rcv_ret < 0) {
+                log_info("rcv_ret = %ld\r\n", rcv_ret);
+                return BL_HTTPSC_RET_ERR;
+            }
+            if (0 == rcv_ret) {
+                if (https_timeout(start)) {
+                    log_error("ssl tcp read timeout\r\n");
+                    return BL_HTTPSC_RET_TIMEOUT;
+                }
+                continue;
+            }
+            rcv_len = rcv_ret;
+            rcv_off = 0;
+            start = xTaskGetTickCount();
+        }
 
-    if ((head_end_pos = memmem(buf, buf_len, "\r\n\r\n", 4)) == NULL) {
-        return BL_HTTPSC_HEAD_END_NOT_FOUND;
+        left = httpc_parse_body_left(&ps);
+        if (left != 0) {
+            if (left > (uint32_t)(rcv_len - rcv_off)) {
+                left = rcv_len - rcv_off;
+            }
+            if (body_fn != NULL && body_fn(arg, rcv_buf + rcv_off, left) != 0) {
+                return BL_HTTPSC_RET_ABORTED;
+            }
+            httpc_parse_body_consumed(&ps, left);
+            rcv_off += left;
+            continue;
+        }
+
+        ev = httpc_parse_feed(&ps, rcv_buf + rcv_off, rcv_len - rcv_off, &used);
+        rcv_off += used;
+        if (HTTPC_PARSE_EV_HEADERS == ev) {
+            status_code = ps.status;
+            log_info("status_code %d, content_len %ld, chunked %d\r\n",
+                     status_code, (long)ps.content_len, ps.chunked);
+        } else if (HTTPC_PARSE_EV_ERROR == ev) {
+            return BL_HTTPSC_RET_HTTP_ERR;
+        }
     }
-    *body_start_off = (uint8_t *)head_end_pos - buf + 4;
 
-    return BL_HTTPSC_OK;
+    return status_code;
 }
 
-/* parm server(in):       hostname or ip address of https server
- * parm port(in):         https server port
- * parm request(in):      https request
- * parm req_len(in):      https request len(excluding '\0')
- * parm response(out):    https response(excluding http header)
- * parm res_len(in, out): pass in addr of A, A stores capacity of buffer response
- *                        pass out https response body length(ie no http header)
- * out:                   HTTP status code or BL_HTTPSC error code
- */
-int https_request(const char *server, uint16_t port, const uint8_t *request, int req_len, uint8_t *response, int *res_len)
+int https_request_stream(const char *server, uint16_t port, const uint8_t *request, int req_len,
+                         https_body_fn_t body_fn, void *arg)
 {
-    int count = 0;
-    int ret_val = BL_HTTPSC_OK;
+    int ret_val;
     uint8_t *rcv_buf = NULL;
-    int buf_sz = 16*1024;
-    int32_t fd, ret, send_ret, rcv_ret;
-    int resp_write_off = 0;
-    int http_head_proced = 0;
-    int status_code = BL_HTTPSC_RET_ERR;
-    int write_len;
-
-    rcv_buf = pvPortMalloc(buf_sz);
+    int32_t fd, ret;
+    TickType_t start;
+
+    rcv_buf = pvPortMalloc(HTTPS_RX_BUF_SIZE);
     if (rcv_buf == NULL) {
-        vPortFree(rcv_buf);
         log_error("rcv_buf do not have space\r\n");
         return BL_HTTPSC_RET_ERR_MEM;
     }
-    memset(rcv_buf, 0, sizeof(rcv_buf));
 
     fd = blTcpSslConnect(server, port);
 
     log_info("bl connect fd = 0x%08lx\r\n", fd);
 
-    if (fd == BL_TCP_CREATE_CONNECT_ERR) {
+    if (fd == BL_TCP_CREATE_CONNECT_ERR || fd == BL_TCP_ARG_INVALID) {
         log_error("ssl connect error\r\n");
-        ret_val = BL_HTTPSC_RET_ERR;
-        goto exit;
-    } else {
-        ret = blTcpSslState(fd);
+        vPortFree(rcv_buf);
+        return BL_HTTPSC_RET_ERR;
     }
 
-    log_info("ret = %ld\r\n", ret);
-
-    while (ret != BL_TCP_NO_ERROR)
-    {
-        count += 100;
-        aos_msleep(100);
-        if (ret == BL_TCP_CONNECTING) {
-            ret = blTcpSslState(fd);
-        } else if(ret == BL_TCP_CONNECT_ERR) {
-            log_error("ssl tcp connect failed\r\n");
-            ret_val = BL_HTTPSC_RET_ERR;
-            goto exit;
-        }
-        if (BL_HTTPS_RET_TIMEOUT < count) {
-            log_error("ssl tcp connect timeout\r\n");
-            ret_val = BL_HTTPSC_RET_TIMEOUT;
-            goto exit;
+    start = xTaskGetTickCount();
+    while ((ret = blTcpSslState(fd)) == BL_TCP_CONNECTING) {
+        if (https_timeout(start)) {
+            break;
         }
     }
 
     log_info("ret = %ld\r\n", ret);
 
-    if (ret == BL_TCP_NO_ERROR) {
-        send_ret = blTcpSslSend(fd, request, req_len);
-        if (send_ret > 0) {
-            while(1) {
-                rcv_ret = blTcpSslRead(fd, rcv_buf, buf_sz);
-                if (rcv_ret > 0) {
-                    log_info("rcv_ret = %ld\r\n", rcv_ret);
-                    if (!http_head_proced) {
-                        int body_start_off = -1;
-                        int proc_head_r = proc_http_head(rcv_buf, rcv_ret, &status_code, &body_start_off);
-                        log_info("proc_head_r %d, status_code %d, body_start_off %d\r\n", proc_head_r, status_code, body_start_off);
-                        if (proc_head_r == BL_HTTPSC_OK) {
-                            write_len = rcv_ret - body_start_off;
-                            if (write_len + resp_write_off > *res_len) {
-                                ret_val = BL_HTTPSC_RET_ERR_BUF_TOO_SMALL;
-                                break;
-                            }
-                            http_head_proced = 1;
-                            log_info("Copy to resp @off %d, len %d, 1st char %02X\r\n", resp_write_off, write_len, *(rcv_buf + body_start_off));
-                            memcpy(response, rcv_buf + body_start_off, write_len);
-                            resp_write_off += write_len;
-                        }
-                    } else {
-                        write_len = rcv_ret;
-                        if (write_len + resp_write_off > *res_len) {
-                            ret_val = BL_HTTPSC_RET_ERR_BUF_TOO_SMALL;
-                            break;
-                        }
-                        log_info("Copy to resp @off %d, len %d, 1st char %02X\r\n", resp_write_off, write_len, *rcv_buf);
-                        memcpy(response + resp_write_off, rcv_buf, write_len);
-                        resp_write_off += write_len;
-                    }
-                    ret_val = status_code;
-                    break;
-                } else if (rcv_ret < 0) {
-                    log_info("rcv_ret = %ld\r\n", rcv_ret);
-                    ret_val = BL_HTTPSC_RET_ERR;
-                    break;
-                } // rcv_ret>0
-            } // while(1)
-        } else {
-            log_error("ssl tcp send data failed\r\n");
+    if (ret == BL_TCP_CONNECTING) {
+        log_error("ssl tcp connect timeout\r\n");
+        ret_val = BL_HTTPSC_RET_TIMEOUT;
+    } else if (ret != BL_TCP_NO_ERROR) {
+        log_error("ssl tcp connect failed\r\n");
+        ret_val = BL_HTTPSC_RET_ERR;
+    } else {
+        ret_val = https_send_all(fd, request, req_len);
+        if (ret_val == BL_HTTPSC_OK) {
+            ret_val = https_recv_response(fd, rcv_buf, body_fn, arg);
         }
     }
-exit:
+
     blTcpSslDisconnect(fd);
-    *res_len = resp_write_off;
     vPortFree(rcv_buf);
     return ret_val;
 }
 
+static int https_copy_body(void *arg, const uint8_t *data, int len)
+{
+    https_copy_t *copy = (https_copy_t *)arg;
+
+    if (len > copy->size - copy->len) {
+        return -1;
+    }
+    memcpy(copy->buf + copy->len, data, len);
+    copy->len += len;
+    return 0;
+}
+
+/* parm server(in):       hostname or ip address of https server
+ * parm port(in):         https server port
+ * parm request(in):      https request
+ * parm req_len(in):      https request len(excluding '\0')
+ * parm response(out):    https response(excluding http header)
+ * parm res_len(in, out): pass in addr of A, A stores capacity of buffer response
+ *                        pass out https response body length(ie no http header)
+ * out:                   HTTP status code or BL_HTTPSC error code
+ */
+int https_request(const char *server, uint16_t port, const uint8_t *request, int req_len, uint8_t *response, int *res_len)
+{
+    https_copy_t copy;
+    int ret_val;
+
+    copy.buf = response;
+    copy.size = *res_len;
+    copy.len = 0;
+
+    ret_val = https_request_stream(server, port, request, req_len, https_copy_body, &copy);
+    if (ret_val == BL_HTTPSC_RET_ABORTED) {
+        ret_val = BL_HTTPSC_RET_ERR_BUF_TOO_SMALL;
+    }
+
+    *res_len = copy.len;
+    return ret_val;
+}
+
 void test_0(void)
 {
     const char *host = "10.89.110.120";
@@ -203,7 +268,8 @@ static void test_1(void)
         return;
     }
 
-    resp_len = 16 * 1024;
+    /* one byte left for the terminating '\0' */
+    resp_len = 16 * 1024 - 1;
     status_code = https_request(host, 443, send_buf, sizeof(send_buf) - 1, buf, &resp_len);
 
     log_info("test_1: status_code %d, resp_len %d\r\n", status_code, resp_len);
@@ -4,6 +4,7 @@
 #include <task.h>
 #include <queue.h>
 #include <timers.h>
+#include <semphr.h>
 #include <aos/kernel.h>
 #include <aos/yloop.h>
 #include <lwip/sockets.h>
@@ -52,18 +53,52 @@ const char bl_test_cli_key_rsa[] =
 const int32_t bl_test_cas_pem_len = sizeof(bl_test_cli_key_rsa);
 #endif
 
-typedef struct _https_context {
-    mbedtls_ssl_context ssl;
-    mbedtls_ssl_config conf;
+/* Sessions kept for abbreviated handshakes, one per server */
+#ifndef HTTPS_SESSION_CACHE_SIZE
+#define HTTPS_SESSION_CACHE_SIZE    2
+#endif
+
+/* Longer server names connect fine but are not cached */
+#define HTTPS_SESSION_HOST_MAX      64
+
+/* How long blTcpSslState waits for the socket before reporting BL_TCP_CONNECTING */
+#define HTTPS_STATE_POLL_MS         100
+
+typedef struct _https_session {
+    char host[HTTPS_SESSION_HOST_MAX];
+    uint16_t port;
+    uint8_t valid;
+    TickType_t last_used;
+    mbedtls_ssl_session session;
+} https_session_t;
+
+/* Set up by the first connect and shared by all connections after it: the
+ * config is read-only once built, the DRBG and the sessions are used under
+ * https_lock. */
+typedef struct _https_shared {
     mbedtls_entropy_context entropy;
     mbedtls_ctr_drbg_context ctr_drbg;
-    mbedtls_net_context server_fd;
+    mbedtls_ssl_config conf;
 #if defined(BL_VERIFY)
     mbedtls_x509_crt cacert;
 #endif
+    https_session_t sessions[HTTPS_SESSION_CACHE_SIZE];
+} https_shared_t;
+
+typedef struct _https_context {
+    /* first member: the connection handle points here */
+    mbedtls_ssl_context ssl;
+    mbedtls_net_context server_fd;
+    char host[HTTPS_SESSION_HOST_MAX];
+    uint16_t port;
+    uint8_t handshake_done;
+    uint8_t resuming;
+    /* what the handshake waits for, 0 while the tcp connect is pending */
+    int want;
 } https_context_t;
 
-https_context_t *bl_hsbuf = NULL;
+static SemaphoreHandle_t https_lock = NULL;
+static https_shared_t *https_shared = NULL;
 
 static void bl_debug( void *ctx, int level,
                       const char *file, int line,
@@ -82,54 +117,47 @@ static int is_valid_ip_address(const char *ipAddress)
     return result != 0;
 }
 
-int32_t blTcpSslConnect(const char *dst, uint16_t port)
+static int https_rng(void *p_rng, unsigned char *output, size_t output_len)
 {
-    in_addr_t dst_addr;
     int ret;
 
-    struct sockaddr_in servaddr;
-    int flags;
-    int reuse = 1;
+    xSemaphoreTake(https_lock, portMAX_DELAY);
+    ret = mbedtls_ctr_drbg_random(p_rng, output, output_len);
+    xSemaphoreGive(https_lock);
 
-    if (NULL != bl_hsbuf) {
-        return -1;
-    }
-    bl_hsbuf = aos_malloc(sizeof(https_context_t));
-    if (NULL == bl_hsbuf) {
-        return -1;
-    }
-    if (NULL == dst) {
-        return BL_TCP_ARG_INVALID;
-    }
+    return ret;
+}
 
-    if (is_valid_ip_address(dst)) {
-        dst_addr = inet_addr(dst);
-    } else {
-        struct hostent *hostinfo = gethostbyname(dst);
-        if (!hostinfo) {
-            return -1;
-        }
-        dst_addr = ((struct in_addr *) hostinfo->h_addr)->s_addr;
-        printf("dst_addr is %08lX\n", *(uint32_t *)&dst_addr);
-    }
+static https_shared_t *https_shared_create(void)
+{
+    https_shared_t *sh;
+    int ret;
+    int i;
 
-    mbedtls_ssl_init(&bl_hsbuf->ssl);
+    sh = aos_malloc(sizeof(https_shared_t));
+    if (NULL == sh) {
+        return NULL;
+    }
+    memset(sh, 0, sizeof(https_shared_t));
 
 #if defined(BL_VERIFY)
-    mbedtls_x509_crt_init( &bl_hsbuf->cacert );
+    mbedtls_x509_crt_init( &sh->cacert );
 #endif
+    mbedtls_ctr_drbg_init(&sh->ctr_drbg);
+    mbedtls_ssl_config_init(&sh->conf);
+    mbedtls_entropy_init(&sh->entropy);
+    for (i = 0; i < HTTPS_SESSION_CACHE_SIZE; i++) {
+        mbedtls_ssl_session_init(&sh->sessions[i].session);
+    }
 
-    mbedtls_ctr_drbg_init(&bl_hsbuf->ctr_drbg);
-    mbedtls_ssl_config_init(&bl_hsbuf->conf);
-    mbedtls_entropy_init(&bl_hsbuf->entropy);
-
-    if ((ret = mbedtls_ctr_drbg_seed(&bl_hsbuf->ctr_drbg, mbedtls_entropy_func, &bl_hsbuf->entropy,
+    if ((ret = mbedtls_ctr_drbg_seed(&sh->ctr_drbg, mbedtls_entropy_func, &sh->entropy,
                                      NULL, 0)) != 0) {
-        return BL_TCP_CREATE_CONNECT_ERR;
+        printf("mbedtls_ctr_drbg_seed returned -0x%x\r\n", -ret);
+        goto fail;
     }
 
 #if defined(BL_VERIFY)
-    ret = mbedtls_x509_crt_parse( &bl_hsbuf->cacert, (const unsigned char *)bl_test_cli_key_rsa,
+    ret = mbedtls_x509_crt_parse( &sh->cacert, (const unsigned char *)bl_test_cli_key_rsa,
                                    bl_test_cas_pem_len );
 
     if (ret < 0) {
@@ -137,56 +165,261 @@ int32_t blTcpSslConnect(const char *dst, uint16_t port)
     }
 #endif
 
-    if ((ret = mbedtls_ssl_config_defaults(&bl_hsbuf->conf,
+    if ((ret = mbedtls_ssl_config_defaults(&sh->conf,
                                            MBEDTLS_SSL_IS_CLIENT,
                                            MBEDTLS_SSL_TRANSPORT_STREAM,
                                            MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
         printf("mbedtls_ssl_config_defaults returned %d", ret);
-        return BL_TCP_CREATE_CONNECT_ERR;
+        goto fail;
     }
 
 #if defined(BL_VERIFY)
-    mbedtls_ssl_conf_authmode(&bl_hsbuf->conf, MBEDTLS_SSL_VERIFY_REQUIRED/*MBEDTLS_SSL_VERIFY_OPTIONAL*/);
-    mbedtls_ssl_conf_ca_chain( &bl_hsbuf->conf, &bl_hsbuf->cacert, NULL );
+    mbedtls_ssl_conf_authmode(&sh->conf, MBEDTLS_SSL_VERIFY_REQUIRED/*MBEDTLS_SSL_VERIFY_OPTIONAL*/);
+    mbedtls_ssl_conf_ca_chain( &sh->conf, &sh->cacert, NULL );
 #else
-    mbedtls_ssl_conf_authmode(&bl_hsbuf->conf, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_authmode(&sh->conf, MBEDTLS_SSL_VERIFY_NONE);
 #endif
 
-    mbedtls_ssl_conf_rng(&bl_hsbuf->conf, mbedtls_ctr_drbg_random, &bl_hsbuf->ctr_drbg);
+    mbedtls_ssl_conf_rng(&sh->conf, https_rng, &sh->ctr_drbg);
+
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&sh->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
 
     //todo
-    mbedtls_ssl_conf_read_timeout(&bl_hsbuf->conf, 0);
+    mbedtls_ssl_conf_read_timeout(&sh->conf, 0);
     //mbedtls_ssl_set_timer_cb(&ssl, &ssl_timer, f_set_timer, f_get_timer);
 
-    mbedtls_ssl_conf_dbg( &bl_hsbuf->conf, bl_debug, stdout );
+    mbedtls_ssl_conf_dbg( &sh->conf, bl_debug, stdout );
 
     // mbedtls_debug_set_threshold(2);
 
-    if ((ret = mbedtls_ssl_setup(&bl_hsbuf->ssl, &bl_hsbuf->conf)) != 0) {
+    return sh;
+
+fail:
+#if defined(BL_VERIFY)
+    mbedtls_x509_crt_free( &sh->cacert );
+#endif
+    mbedtls_ssl_config_free( &sh->conf );
+    mbedtls_ctr_drbg_free( &sh->ctr_drbg );
+    mbedtls_entropy_free( &sh->entropy );
+    aos_free(sh);
+    return NULL;
+}
+
+static https_shared_t *https_shared_get(void)
+{
+    if (NULL == https_lock) {
+        vTaskSuspendAll();
+        if (NULL == https_lock) {
+            https_lock = xSemaphoreCreateMutex();
+        }
+        xTaskResumeAll();
+        if (NULL == https_lock) {
+            return NULL;
+        }
+    }
+
+    xSemaphoreTake(https_lock, portMAX_DELAY);
+    if (NULL == https_shared) {
+        https_shared = https_shared_create();
+    }
+    xSemaphoreGive(https_lock);
+
+    return https_shared;
+}
+
+/* call with https_lock held */
+static https_session_t *https_session_find(const char *host, uint16_t port)
+{
+    https_session_t *s;
+    int i;
+
+    for (i = 0; i < HTTPS_SESSION_CACHE_SIZE; i++) {
+        s = &https_shared->sessions[i];
+        if (s->valid && s->port == port && 0 == strcmp(s->host, host)) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+/* Offer the session from the last connection to this server, if any */
+static void https_session_load(https_context_t *ctx)
+{
+    https_session_t *s;
+
+    if ('\0' == ctx->host[0]) {
+        return;
+    }
+
+    xSemaphoreTake(https_lock, portMAX_DELAY);
+    s = https_session_find(ctx->host, ctx->port);
+    if (s != NULL && 0 == mbedtls_ssl_set_session(&ctx->ssl, &s->session)) {
+        s->last_used = xTaskGetTickCount();
+        ctx->resuming = 1;
+    }
+    xSemaphoreGive(https_lock);
+}
+
+/* Keep the session of a finished handshake, replacing the least recently used one */
+static void https_session_save(https_context_t *ctx)
+{
+    https_session_t *s;
+    TickType_t now;
+    int i;
+
+    if ('\0' == ctx->host[0]) {
+        return;
+    }
+
+    xSemaphoreTake(https_lock, portMAX_DELAY);
+    s = https_session_find(ctx->host, ctx->port);
+    for (i = 0; NULL == s && i < HTTPS_SESSION_CACHE_SIZE; i++) {
+        if (!https_shared->sessions[i].valid) {
+            s = &https_shared->sessions[i];
+        }
+    }
+    if (NULL == s) {
+        now = xTaskGetTickCount();
+        s = &https_shared->sessions[0];
+        for (i = 1; i < HTTPS_SESSION_CACHE_SIZE; i++) {
+            if (now - https_shared->sessions[i].last_used > now - s->last_used) {
+                s = &https_shared->sessions[i];
+            }
+        }
+    }
+    mbedtls_ssl_session_free(&s->session);
+    mbedtls_ssl_session_init(&s->session);
+    s->valid = (0 == mbedtls_ssl_get_session(&ctx->ssl, &s->session));
+    if (s->valid) {
+        strcpy(s->host, ctx->host);
+        s->port = ctx->port;
+        s->last_used = xTaskGetTickCount();
+    }
+    xSemaphoreGive(https_lock);
+}
+
+/* A handshake that started from a cached session failed: don't offer it again */
+static void https_session_drop(https_context_t *ctx)
+{
+    https_session_t *s;
+
+    if (!ctx->resuming) {
+        return;
+    }
+
+    xSemaphoreTake(https_lock, portMAX_DELAY);
+    s = https_session_find(ctx->host, ctx->port);
+    if (s != NULL) {
+        mbedtls_ssl_session_free(&s->session);
+        mbedtls_ssl_session_init(&s->session);
+        s->valid = 0;
+    }
+    xSemaphoreGive(https_lock);
+}
+
+void blTcpSslSessionClear(void)
+{
+    int i;
+
+    if (NULL == https_lock || NULL == https_shared) {
+        return;
+    }
+
+    xSemaphoreTake(https_lock, portMAX_DELAY);
+    for (i = 0; i < HTTPS_SESSION_CACHE_SIZE; i++) {
+        mbedtls_ssl_session_free(&https_shared->sessions[i].session);
+        mbedtls_ssl_session_init(&https_shared->sessions[i].session);
+        https_shared->sessions[i].valid = 0;
+    }
+    xSemaphoreGive(https_lock);
+}
+
+static void https_context_free(https_context_t *ctx)
+{
+    mbedtls_net_free(&ctx->server_fd);
+    mbedtls_ssl_free(&ctx->ssl);
+    aos_free(ctx);
+}
+
+int32_t blTcpSslConnect(const char *dst, uint16_t port)
+{
+    https_context_t *ctx;
+    in_addr_t dst_addr;
+    int ret;
+    int is_ip;
+
+    struct sockaddr_in servaddr;
+    int flags;
+    int reuse = 1;
+
+    if (NULL == dst) {
+        return BL_TCP_ARG_INVALID;
+    }
+
+    if (NULL == https_shared_get()) {
+        return BL_TCP_CREATE_CONNECT_ERR;
+    }
+
+    is_ip = is_valid_ip_address(dst);
+    if (is_ip) {
+        dst_addr = inet_addr(dst);
+    } else {
+        struct hostent *hostinfo = gethostbyname(dst);
+        if (!hostinfo) {
+            return BL_TCP_CREATE_CONNECT_ERR;
+        }
+        dst_addr = ((struct in_addr *) hostinfo->h_addr)->s_addr;
+        printf("dst_addr is %08lX\n", *(uint32_t *)&dst_addr);
+    }
+
+    ctx = aos_malloc(sizeof(https_context_t));
+    if (NULL == ctx) {
+        return BL_TCP_CREATE_CONNECT_ERR;
+    }
+    memset(ctx, 0, sizeof(https_context_t));
+    if (strlen(dst) < sizeof(ctx->host)) {
+        strcpy(ctx->host, dst);
+    }
+    ctx->port = port;
+
+    mbedtls_ssl_init(&ctx->ssl);
+    mbedtls_net_init(&ctx->server_fd);
+
+    if ((ret = mbedtls_ssl_setup(&ctx->ssl, &https_shared->conf)) != 0) {
         printf("mbedtls_ssl_setup returned -0x%x\r\n", -ret);
+        https_context_free(ctx);
         return BL_TCP_CREATE_CONNECT_ERR;
     }
 
-    mbedtls_net_init(&bl_hsbuf->server_fd);
+    if (!is_ip && (ret = mbedtls_ssl_set_hostname(&ctx->ssl, dst)) != 0) {
+        printf("mbedtls_ssl_set_hostname returned -0x%x\r\n", -ret);
+        https_context_free(ctx);
+        return BL_TCP_CREATE_CONNECT_ERR;
+    }
 
-    bl_hsbuf->server_fd.fd = socket(AF_INET, SOCK_STREAM, 0);
+    https_session_load(ctx);
 
-    if (bl_hsbuf->server_fd.fd < 0) {
+    ctx->server_fd.fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (ctx->server_fd.fd < 0) {
         printf("ssl creat socket fd failed\r\n");
+        https_context_free(ctx);
         return BL_TCP_CREATE_CONNECT_ERR;
     }
 
-    flags = fcntl(bl_hsbuf->server_fd.fd, F_GETFL, 0);
-    if (flags < 0 || fcntl(bl_hsbuf->server_fd.fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    flags = fcntl(ctx->server_fd.fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(ctx->server_fd.fd, F_SETFL, flags | O_NONBLOCK) < 0) {
         printf("ssl fcntl: %s\r\n", strerror(errno));
-        close(bl_hsbuf->server_fd.fd);
+        https_context_free(ctx);
         return BL_TCP_CREATE_CONNECT_ERR;
     }
 
-    if (setsockopt(bl_hsbuf->server_fd.fd, SOL_SOCKET, SO_REUSEADDR,
+    if (setsockopt(ctx->server_fd.fd, SOL_SOCKET, SO_REUSEADDR,
                    (const char*) &reuse, sizeof(reuse)) != 0) {
-        close(bl_hsbuf->server_fd.fd);
         printf("ssl set SO_REUSEADDR failed\r\n");
+        https_context_free(ctx);
         return BL_TCP_CREATE_CONNECT_ERR;
     }
 
@@ -195,48 +428,38 @@ int32_t blTcpSslConnect(const char *dst, uint16_t port)
     servaddr.sin_addr.s_addr = dst_addr;
     servaddr.sin_port = htons(port);
 
-    if (connect(bl_hsbuf->server_fd.fd, (struct sockaddr*)&servaddr, sizeof(struct sockaddr_in)) == 0) {
+    if (connect(ctx->server_fd.fd, (struct sockaddr*)&servaddr, sizeof(struct sockaddr_in)) == 0) {
         //printf("ssl dst %s errno %d\r\n", dst, errno);
     } else {
         //printf("ssl dst %s errno %d\r\n", dst, errno);
         if (errno == EINPROGRESS) {
             //printf("ssl tcp conncet noblock\r\n");
         } else {
-            close(bl_hsbuf->server_fd.fd);
+            https_context_free(ctx);
             return BL_TCP_CREATE_CONNECT_ERR;
         }
     }
 
     //todo
-    //mbedtls_ssl_set_bio(&bl_hsbuf->ssl, &bl_hsbuf->server_fd, mbedtls_net_send, mbedtls_net_recv, mbedtls_net_recv_timeout); //noblock
-    mbedtls_ssl_set_bio(&bl_hsbuf->ssl, &bl_hsbuf->server_fd, mbedtls_net_send, mbedtls_net_recv, NULL);
-    return (int32_t)&bl_hsbuf->ssl;
+    //mbedtls_ssl_set_bio(&ctx->ssl, &ctx->server_fd, mbedtls_net_send, mbedtls_net_recv, mbedtls_net_recv_timeout); //noblock
+    mbedtls_ssl_set_bio(&ctx->ssl, &ctx->server_fd, mbedtls_net_send, mbedtls_net_recv, NULL);
+    return (int32_t)&ctx->ssl;
 }
 
 void blTcpSslDisconnect(int32_t fd)
 {
-    mbedtls_ssl_context *pssl = (mbedtls_ssl_context *)fd;
+    https_context_t *ctx = (https_context_t *)fd;
 
-    if (NULL == pssl) {
+    if (NULL == ctx) {
         printf("blTcpSslDisconnect\r\n");
+        return;
     }
 
-    mbedtls_ssl_close_notify(pssl);
-
-    mbedtls_net_free((mbedtls_net_context*)(pssl->p_bio));
-
-#if defined(BL_VERIFY)
-    mbedtls_x509_crt_free( &bl_hsbuf->cacert );
-#endif
-
-    mbedtls_ssl_free( pssl );
-    mbedtls_ssl_config_free( &bl_hsbuf->conf );
-    mbedtls_ctr_drbg_free( &bl_hsbuf->ctr_drbg );
-    mbedtls_entropy_free( &bl_hsbuf->entropy );
-
-    aos_free(bl_hsbuf);
+    if (ctx->handshake_done) {
+        mbedtls_ssl_close_notify(&ctx->ssl);
+    }
 
-    bl_hsbuf = NULL;
+    https_context_free(ctx);
     printf("blTcpSslDisconnect end\r\n");
 }
 
@@ -244,8 +467,8 @@ int32_t blTcpSslState(int32_t fd)
 {
     //printf("blTcpSslState start\r\n");
     int errcode = BL_TCP_NO_ERROR;
-    mbedtls_ssl_context *pssl = (mbedtls_ssl_context *)fd;
-    int tcp_fd = ((mbedtls_net_context*)(pssl->p_bio))->fd;
+    https_context_t *ctx = (https_context_t *)fd;
+    int tcp_fd;
     int ret;
 
     fd_set rset, wset;
@@ -255,19 +478,24 @@ int32_t blTcpSslState(int32_t fd)
 
     socklen_t len =  sizeof(int);
 
-    if (tcp_fd < 0 || NULL == pssl) {
+    if (NULL == ctx || ctx->server_fd.fd < 0) {
         return BL_TCP_ARG_INVALID;
     }
+    if (ctx->handshake_done) {
+        return BL_TCP_NO_ERROR;
+    }
+    tcp_fd = ctx->server_fd.fd;
 
     FD_ZERO(&rset);
     FD_ZERO(&wset);
-    FD_CLR(tcp_fd, &rset);
-    FD_CLR(tcp_fd, &wset);
-    FD_SET(tcp_fd, &rset);
-    FD_SET(tcp_fd, &wset);
+    if (MBEDTLS_ERR_SSL_WANT_READ == ctx->want) {
+        FD_SET(tcp_fd, &rset);
+    } else {
+        FD_SET(tcp_fd, &wset);
+    }
 
-    timeout.tv_sec = 2;
-    timeout.tv_usec = 0;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = HTTPS_STATE_POLL_MS * 1000;
 
     ready_n = select(tcp_fd + 1, &rset, &wset, NULL, &timeout);
 
@@ -276,26 +504,27 @@ int32_t blTcpSslState(int32_t fd)
     } else if (ready_n < 0) {
         errcode = BL_TCP_CONNECT_ERR;
     } else {
-        if (FD_ISSET(tcp_fd, &wset) != 0) {
-            errcode = BL_TCP_CONNECTING;
+        if (0 == ctx->want) {
+            /* tcp connect finished, successfully or not */
+            ret = 0;
+            if (0 != getsockopt(tcp_fd, SOL_SOCKET, SO_ERROR, &ret, &len) || 0 != ret) {
+                return BL_TCP_CONNECT_ERR;
+            }
+        }
 
-            if(pssl->state != MBEDTLS_SSL_HANDSHAKE_OVER) {
-                ret = mbedtls_ssl_handshake_step( pssl );
-                //printf("mbedtls_ssl_handshake_step return = 0X%X\r\n", -ret);
+        /* runs until the handshake has to wait for the peer */
+        ret = mbedtls_ssl_handshake(&ctx->ssl);
+        //printf("mbedtls_ssl_handshake return = 0X%X\r\n", -ret);
 
-                if ((0 != ret) && (MBEDTLS_ERR_SSL_WANT_READ != ret)) {
-                    errcode = BL_TCP_CONNECT_ERR;
-                }
-            } else {
-                errcode = BL_TCP_NO_ERROR;
-            }
+        if (0 == ret) {
+            ctx->handshake_done = 1;
+            https_session_save(ctx);
+            errcode = BL_TCP_NO_ERROR;
+        } else if (MBEDTLS_ERR_SSL_WANT_READ == ret || MBEDTLS_ERR_SSL_WANT_WRITE == ret) {
+            ctx->want = ret;
+            errcode = BL_TCP_CONNECTING;
         } else {
-            if (0 != getsockopt(tcp_fd, SOL_SOCKET, SO_ERROR, &ret, &len)) {
-                errcode = BL_TCP_CONNECT_ERR;
-            }
-            if (0 != ret) {
-                errcode = BL_TCP_CONNECT_ERR;
-            }
+            https_session_drop(ctx);
             errcode = BL_TCP_CONNECT_ERR;
         }
     }
@@ -303,6 +532,34 @@ int32_t blTcpSslState(int32_t fd)
     return errcode;
 }
 
+int32_t blTcpSslWaitRead(int32_t fd, uint32_t timeout_ms)
+{
+    https_context_t *ctx = (https_context_t *)fd;
+    fd_set rset;
+    struct timeval timeout;
+    int ready_n;
+
+    if (NULL == ctx || ctx->server_fd.fd < 0) {
+        return BL_TCP_ARG_INVALID;
+    }
+
+    /* a record may already be decrypted and waiting */
+    if (mbedtls_ssl_get_bytes_avail(&ctx->ssl) > 0) {
+        return 1;
+    }
+
+    FD_ZERO(&rset);
+    FD_SET(ctx->server_fd.fd, &rset);
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+    ready_n = select(ctx->server_fd.fd + 1, &rset, NULL, NULL, &timeout);
+    if (ready_n < 0) {
+        return BL_TCP_READ_ERR;
+    }
+    return ready_n > 0 ? 1 : 0;
+}
+
 int32_t blTcpSslSend(int32_t fd, const uint8_t* buf, uint16_t len)
 {
     //puts("blTcpSslSend start\r\n");
@@ -317,6 +574,8 @@ int32_t blTcpSslSend(int32_t fd, const uint8_t* buf, uint16_t len)
 
     if(ret > 0) {
         return ret;
+    } else if (MBEDTLS_ERR_SSL_WANT_WRITE == ret) {
+        return 0;
     } else {
         printf("blTcpSslsend error ret = 0X%X\r\n", -ret);
         return BL_TCP_SEND_ERR;
@@ -339,6 +598,8 @@ int32_t blTcpSslRead(int32_t fd, uint8_t* buf, uint16_t len)
         return ret;
     } else if(MBEDTLS_ERR_SSL_WANT_READ == ret) {
         return 0;
+    } else if (0 == ret || MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY == ret) {
+        return BL_TCP_PEER_CLOSED;
     } else {
         printf("blTcpSslRead ret = 0X%X\r\n", ret);
         return BL_TCP_READ_ERR;
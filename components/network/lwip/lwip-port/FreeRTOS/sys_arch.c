@@ -147,13 +147,20 @@ u32_t sys_arch_mbox_fetch(sys_mbox_t *mbox, void **msg, u32_t timeout)
 void *dummyptr;
 portTickType StartTime, EndTime, Elapsed;
 
-    StartTime = xTaskGetTickCount();
-
     if ( msg == NULL )
     {
         msg = &dummyptr;
     }
 
+    /* Fast path: a message is already waiting, no tick bookkeeping needed.
+       lwIP only checks the result against SYS_ARCH_TIMEOUT. */
+    if ( pdTRUE == xQueueReceive( *mbox, &(*msg), 0 ) )
+    {
+        return 0;
+    }
+
+    StartTime = xTaskGetTickCount();
+
     if ( timeout != 0 )
     {
         if ( pdTRUE == xQueueReceive( *mbox, &(*msg), timeout / portTICK_RATE_MS ) )
@@ -266,6 +273,12 @@ u32_t sys_arch_sem_wait(sys_sem_t *sem, u32_t timeout)
 {
 portTickType StartTime, EndTime, Elapsed;
 
+    /* Fast path: already signaled */
+    if( xSemaphoreTake( *sem, 0 ) == pdTRUE )
+    {
+        return 0;
+    }
+
     StartTime = xTaskGetTickCount();
 
     if( timeout != 0)
@@ -371,7 +384,8 @@ void sys_mutex_free(sys_mutex_t *mutex)
 /* Lock a mutex*/
 void sys_mutex_lock(sys_mutex_t *mutex)
 {
-    sys_arch_sem_wait(mutex, 0);
+    /* Taken on every LOCK_TCPIP_CORE(), skip the elapsed time accounting */
+    while( xSemaphoreTake(*mutex, portMAX_DELAY) != pdTRUE){}
 }
 
 /*-----------------------------------------------------------------------------------*/
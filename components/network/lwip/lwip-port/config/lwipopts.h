@@ -1,6 +1,25 @@
 #ifndef __LWIPOPTS_H__
 #define __LWIPOPTS_H__
 
+/**
+ * LWIP_PROFILE_THROUGHPUT==1: trade RAM for bulk TCP/UDP throughput.
+ * Selected with CONFIG_LWIP_PROFILE_THROUGHPUT:=1 in proj_config.mk, which
+ * defines CONF_USER_LWIP_PROFILE_THROUGHPUT for every component, so the
+ * pcb layout stays the same across the whole image.
+ *
+ * The profile turns on core locking (sockets and input), a full-MTU MSS,
+ * window scaling and IP fragmentation/reassembly. lwIP memory and pools are
+ * placed in .wifi_ram (see LWIP_DECLARE_MEMORY_ALIGNED in arch.h), so every
+ * byte added here comes out of the _heap_wifi region. The profile costs
+ * about 8KB of it, nearly all MEM_SIZE; the reassembly pools are paid for
+ * by the tcpip input message pool that core locking no longer needs.
+ */
+#ifdef CONF_USER_LWIP_PROFILE_THROUGHPUT
+#define LWIP_PROFILE_THROUGHPUT 1
+#else
+#define LWIP_PROFILE_THROUGHPUT 0
+#endif
+
 /**
  * SYS_LIGHTWEIGHT_PROT==1: if you want inter-task protection for certain
  * critical regions during buffer allocation, deallocation and memory
@@ -10,8 +29,16 @@
 
 #define LWIP_NETIF_HOSTNAME     1
 #define ETHARP_TRUST_IP_MAC     0
+#if LWIP_PROFILE_THROUGHPUT
+#define IP_REASSEMBLY           1
+#define IP_FRAG                 1
+/* RX pbufs are firmware buffers (zero copy), don't let reassembly pin many */
+#define IP_REASS_MAX_PBUFS      8
+#define MEMP_NUM_REASSDATA      2
+#else
 #define IP_REASSEMBLY           0
 #define IP_FRAG                 0
+#endif
 #define ARP_QUEUEING            0
 #define LWIP_NETIF_API          1
 
@@ -29,7 +56,9 @@
  */
 #define NO_SYS                  0
 
+#ifndef LWIP_TIMEVAL_PRIVATE
 #define LWIP_TIMEVAL_PRIVATE    1
+#endif
 
 /**
  * LWIP_TCPIP_CORE_LOCKING_INPUT: when LWIP_TCPIP_CORE_LOCKING is enabled,
@@ -38,8 +67,16 @@
  *
  * ATTENTION: this does not work when tcpip_input() is called from
  * interrupt context!
+ *
+ * Wi-Fi frames are handed over by tcpip_stack_input() from the "fw" task,
+ * so with the throughput profile the whole RX path (IP, TCP, socket event
+ * callbacks) runs on that task, see WIFI_STACK_SIZE in hal_wifi.c.
  */
+#if LWIP_PROFILE_THROUGHPUT
+#define LWIP_TCPIP_CORE_LOCKING_INPUT   1
+#else
 #define LWIP_TCPIP_CORE_LOCKING_INPUT   0
+#endif
 
 /* ---------- Memory options ---------- */
 /* MEM_ALIGNMENT: should be set to the alignment of the CPU for which
@@ -51,6 +88,9 @@
 a lot of data that needs to be copied, this should be set high. */
 #if defined(WITH_COAP) && WITH_COAP
 #define MEM_SIZE                (4*1024)
+#elif LWIP_PROFILE_THROUGHPUT
+/* TCP_SND_BUF of one bulk sender plus frames waiting in the Wi-Fi TX queues */
+#define MEM_SIZE                (16*1024)
 #else
 #define MEM_SIZE                (8*1024)
 #endif
@@ -100,18 +140,28 @@ a lot of data that needs to be copied, this should be set high. */
 #define TCP_QUEUE_OOSEQ         1
 
 /* TCP Maximum segment size. */
-//#define TCP_MSS                 (1500 - 40)     /* TCP_MSS = (Ethernet MTU - IP header size - TCP header size) */
+#if LWIP_PROFILE_THROUGHPUT
+#define TCP_MSS                 (1500 - 40)     /* TCP_MSS = (Ethernet MTU - IP header size - TCP header size) */
+#else
 //#define TCP_MSS                 (1500 - 80)     /* TCP_MSS = (Ethernet MTU - IP header size - TCP header size) */
 #define TCP_MSS                 (800 - 40 - 80 + 8)   /* TCP_MSS = (Ethernet MTU - IP header size - TCP header size) */
+#endif
 
 /* TCP sender buffer space (bytes). */
+#if LWIP_PROFILE_THROUGHPUT
+#define TCP_SND_BUF             (6*TCP_MSS)
+#else
 #define TCP_SND_BUF             (8*TCP_MSS)
+#endif
 
 /*  TCP_SND_QUEUELEN: TCP sender buffer space (pbufs). This must be at least
   as much as (2 * TCP_SND_BUF/TCP_MSS) for things to work. */
 #define TCP_SND_QUEUELEN        ((2 * (TCP_SND_BUF) + (TCP_MSS - 1))/(TCP_MSS))
 
-#if defined(WITH_COAP) && !WITH_COAP
+#if LWIP_TCPIP_CORE_LOCKING_INPUT
+/* tcpip_input() no longer queues packets to tcpip_thread */
+#define MEMP_NUM_TCPIP_MSG_INPKT        (4)
+#elif defined(WITH_COAP) && !WITH_COAP
 #define MEMP_NUM_TCPIP_MSG_INPKT        (32)
 #endif
 
@@ -123,7 +173,21 @@ a lot of data that needs to be copied, this should be set high. */
 #define TCP_SNDQUEUELOWAT               ((TCP_SND_QUEUELEN)/2)
 
 /* TCP receive window. */
+#if LWIP_PROFILE_THROUGHPUT
+#define TCP_WND                 (4*TCP_MSS)
+#else
 #define TCP_WND                 (3*TCP_MSS)
+#endif
+
+#if LWIP_PROFILE_THROUGHPUT
+/* LWIP_WND_SCALE: advertise window scaling so the peer's send window is not
+ * capped at 64KB. TCP_RCV_SCALE stays 0 as long as TCP_WND fits in 16 bits,
+ * received data sits in firmware RX buffers so our own window is small. */
+#define LWIP_WND_SCALE          1
+#define TCP_RCV_SCALE           0
+/* TCP_OOSEQ_MAX_PBUFS: out-of-order segments pin firmware RX buffers too */
+#define TCP_OOSEQ_MAX_PBUFS     8
+#endif
 
 /**
  * TCP_WND_UPDATE_THRESHOLD: difference in window to trigger an
@@ -263,7 +327,11 @@ a lot of data that needs to be copied, this should be set high. */
 #define TCPIP_THREAD_PRIO               (configMAX_PRIORITIES - 2)
 
 #define LWIP_COMPAT_MUTEX               0
+#if LWIP_PROFILE_THROUGHPUT
+#define LWIP_TCPIP_CORE_LOCKING         1
+#else
 #define LWIP_TCPIP_CORE_LOCKING         0
+#endif
 #define LWIP_SOCKET_SET_ERRNO           1
 #define SO_REUSE                        1
 #define LWIP_TCP_KEEPALIVE              1
@@ -294,7 +362,9 @@ a lot of data that needs to be copied, this should be set high. */
  */
 extern int bl_rand();
 #define LWIP_RANDOMIZE_INITIAL_LOCAL_PORTS 1
+#ifndef LWIP_RAND
 #define LWIP_RAND() ((u32_t)bl_rand())
+#endif
 
 // Custom memory pools
 #if defined(WITH_COAP) && WITH_COAP
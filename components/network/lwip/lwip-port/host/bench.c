@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Linux benchmark of the lwipopts.h profiles, see README. The lwIP side of
+ * runs shaped like the device iperf commands: ipc (TCP send), ips (TCP
+ * receive), ipu (UDP send) and ipus (UDP receive), with the same buffer
+ * sizes, over the netif stand-in of netutils/iperf/host.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <lwip/tcpip.h>
+#include <lwip/sockets.h>
+#include <lwip/netif.h>
+#include <lwip/stats.h>
+
+#include "fwnetif.h"
+
+#define BENCH_PORT              5001
+/* as IPERF_BUFSZ and IPERF_BUFSZ_UDP of iperf.c */
+#define BENCH_BUFSZ             (4 * 1300)
+#define BENCH_BUFSZ_UDP         (1 * 1300)
+
+#if !defined(CONF_USER_LWIP_PROFILE_THROUGHPUT)
+#define BENCH_PROFILE           "default"
+#elif defined(HOST_NO_CORE_LOCKING)
+#define BENCH_PROFILE           "throughput without core locking"
+#else
+#define BENCH_PROFILE           "throughput"
+#endif
+
+static struct netif bench_netif;
+static char bench_buf[BENCH_BUFSZ];
+
+static double bench_clock(clockid_t clk)
+{
+    struct timespec ts;
+
+    clock_gettime(clk, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_usage(void)
+{
+    fprintf(stderr,
+            "usage: lwip_profile_bench (--tap name | --wire local_path peer_path) --ip addr\n"
+            "                          (ipc | ipu) peer_addr [seconds]\n"
+            "                          (ips | ipus)\n"
+            "  ipc/ipu send to peer_addr:5001 for seconds (8), ips/ipus receive on\n"
+            "  port 5001 until the sender stops for 1 s\n");
+}
+
+static void bench_tcpip_ready(void *arg)
+{
+    sys_sem_signal((sys_sem_t *)arg);
+}
+
+/* Send for secs seconds, returns the bytes sent */
+static long long bench_send(int tcp, const char *peer, int secs, double *elapsed)
+{
+    struct sockaddr_in sa;
+    long long bytes = 0;
+    double t0, t;
+    int s, r, one = 1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = lwip_htons(BENCH_PORT);
+    sa.sin_addr.s_addr = inet_addr(peer);
+    s = lwip_socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    while (lwip_connect(s, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        /* the receiver may not be up yet */
+        lwip_close(s);
+        usleep(200000);
+        s = lwip_socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    }
+    if (tcp) {
+        lwip_setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    t0 = t = bench_clock(CLOCK_MONOTONIC);
+    while (t - t0 < secs) {
+        r = lwip_send(s, bench_buf, tcp ? BENCH_BUFSZ : BENCH_BUFSZ_UDP, 0);
+        if (r > 0) {
+            bytes += r;
+        } else if (tcp) {
+            break;
+        }
+        t = bench_clock(CLOCK_MONOTONIC);
+    }
+    lwip_close(s);
+    *elapsed = t - t0;
+    return bytes;
+}
+
+/* Receive until the sender stops, returns the bytes received */
+static long long bench_recv(int tcp, double *elapsed)
+{
+    struct sockaddr_in sa;
+    struct timeval tv = {1, 0};
+    long long bytes = 0;
+    double t0, t;
+    int s, c, r;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = lwip_htons(BENCH_PORT);
+    s = lwip_socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    lwip_bind(s, (struct sockaddr *)&sa, sizeof(sa));
+    if (tcp) {
+        lwip_listen(s, 1);
+        c = lwip_accept(s, NULL, NULL);
+    } else {
+        c = s;
+    }
+    printf("ready\n");
+    fflush(stdout);
+    /* the clock starts with the first data */
+    r = lwip_recv(c, bench_buf, sizeof(bench_buf), 0);
+    t0 = t = bench_clock(CLOCK_MONOTONIC);
+    lwip_setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    while (r > 0) {
+        bytes += r;
+        t = bench_clock(CLOCK_MONOTONIC);
+        r = lwip_recv(c, bench_buf, sizeof(bench_buf), 0);
+    }
+    if (c != s) {
+        lwip_close(c);
+    }
+    lwip_close(s);
+    *elapsed = t - t0;
+    return bytes;
+}
+
+int main(int argc, char **argv)
+{
+    fwnetif_cfg_t fw;
+    fwnetif_stats_t stats;
+    ip4_addr_t addr, netmask, gateway;
+    const char *ip = NULL, *mode = NULL, *peer = NULL;
+    long long bytes;
+    double elapsed = 0, cpu;
+    int secs = 8, i, tcp;
+    sys_sem_t ready;
+
+    memset(&fw, 0, sizeof(fw));
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--tap") && i + 1 < argc) {
+            fw.tap = argv[++i];
+        } else if (!strcmp(argv[i], "--wire") && i + 2 < argc) {
+            fw.wire_local = argv[++i];
+            fw.wire_peer = argv[++i];
+        } else if (!strcmp(argv[i], "--ip") && i + 1 < argc) {
+            ip = argv[++i];
+        } else if (mode == NULL) {
+            mode = argv[i];
+        } else if (peer == NULL) {
+            peer = argv[i];
+        } else {
+            secs = atoi(argv[i]);
+        }
+    }
+    if ((fw.tap == NULL && fw.wire_local == NULL) || ip == NULL || mode == NULL ||
+            !ip4addr_aton(ip, &addr) || secs <= 0 ||
+            (strcmp(mode, "ipc") && strcmp(mode, "ipu") && strcmp(mode, "ips") && strcmp(mode, "ipus")) ||
+            ((!strcmp(mode, "ipc") || !strcmp(mode, "ipu")) && peer == NULL)) {
+        bench_usage();
+        return 2;
+    }
+    IP4_ADDR(&netmask, 255, 255, 255, 0);
+    ip4_addr_set_zero(&gateway);
+    fw.mac[0] = 0x02;
+    memcpy(&fw.mac[2], &addr, 4);
+    memset(bench_buf, 0x5a, sizeof(bench_buf));
+
+    sys_sem_new(&ready, 0);
+    tcpip_init(bench_tcpip_ready, &ready);
+    sys_sem_wait(&ready);
+    sys_sem_free(&ready);
+
+    LOCK_TCPIP_CORE();
+    if (netif_add(&bench_netif, &addr, &netmask, &gateway, &fw, fwnetif_init, tcpip_input) == NULL) {
+        UNLOCK_TCPIP_CORE();
+        return 1;
+    }
+    netif_set_default(&bench_netif);
+    netif_set_up(&bench_netif);
+    UNLOCK_TCPIP_CORE();
+
+    tcp = !strcmp(mode, "ipc") || !strcmp(mode, "ips");
+    cpu = bench_clock(CLOCK_PROCESS_CPUTIME_ID);
+    if (peer != NULL) {
+        bytes = bench_send(tcp, peer, secs, &elapsed);
+    } else {
+        bytes = bench_recv(tcp, &elapsed);
+    }
+    cpu = bench_clock(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+
+    fwnetif_get_stats(&stats);
+    printf("%s (%s, TCP_MSS %d, TCP_WND %d): %.1f Mbit/s, cpu %.2f us/KB, "
+            "fw rx %lu drop %lu tx %lu, tcp xmit %u drop %u\n",
+            mode, BENCH_PROFILE, TCP_MSS, (int)TCP_WND,
+            elapsed > 0 ? bytes * 8 / elapsed / 1e6 : 0.0,
+            bytes > 0 ? cpu * 1e6 / (bytes / 1024.0) : 0.0,
+            stats.rx_frames, stats.rx_drop, stats.tx_frames,
+            (unsigned int)lwip_stats.tcp.xmit, (unsigned int)lwip_stats.tcp.drop);
+    return bytes > 0 ? 0 : 1;
+}
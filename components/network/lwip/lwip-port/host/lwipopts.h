@@ -0,0 +1,41 @@
+/*
+ * The device lwipopts.h, with the few changes needed to build it against
+ * lwIP's unix port and the host C library. HOST_NO_CORE_LOCKING takes core
+ * locking out of the throughput profile, to tell its share from the MSS
+ * and window changes.
+ */
+#ifndef LWIP_PROFILE_HOST_LWIPOPTS_H
+#define LWIP_PROFILE_HOST_LWIPOPTS_H
+
+#define configMAX_PRIORITIES            32
+
+#include "../config/lwipopts.h"
+
+/* arch/cc.h of the unix port sets these too. sys_arch.c includes it before
+ * this file, then the device file keeps its values, elsewhere they are
+ * replaced here. */
+#undef LWIP_TIMEVAL_PRIVATE
+#define LWIP_TIMEVAL_PRIVATE            0
+#undef LWIP_PROVIDE_ERRNO
+#define LWIP_ERRNO_STDINCLUDE           1
+#undef LWIP_COMPAT_SOCKETS
+#define LWIP_COMPAT_SOCKETS             0
+#undef MEM_ALIGNMENT
+#define MEM_ALIGNMENT                   8
+#undef LWIP_ALTCP_TLS
+#define LWIP_ALTCP_TLS                  0
+#undef LWIP_NETIF_LOOPBACK
+#define LWIP_NETIF_LOOPBACK             0
+/* arch/cc.h of the unix port provides it */
+#undef LWIP_RAND
+
+#ifdef HOST_NO_CORE_LOCKING
+#undef LWIP_TCPIP_CORE_LOCKING
+#define LWIP_TCPIP_CORE_LOCKING         0
+#undef LWIP_TCPIP_CORE_LOCKING_INPUT
+#define LWIP_TCPIP_CORE_LOCKING_INPUT   0
+#undef MEMP_NUM_TCPIP_MSG_INPKT
+#define MEMP_NUM_TCPIP_MSG_INPKT        32
+#endif
+
+#endif
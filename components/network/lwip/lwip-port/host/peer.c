@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Host side of the lwip_profile_bench runs over a TAP device: a plain
+ * socket sink or source on port 5001, see README.
+ *
+ *   lwip_profile_peer tcp-sink | udp-sink
+ *   lwip_profile_peer tcp-src | udp-src addr [seconds [UDP bit/s]]
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PEER_PORT               5001
+
+int main(int argc, char **argv)
+{
+    static char buf[65536];
+    struct sockaddr_in sa;
+    struct timeval tv = {2, 0};
+    struct timespec t0, t;
+    long long sent = 0;
+    long rate;
+    double elapsed;
+    int tcp, src, secs, s, r, one = 1;
+
+    if (argc < 2 || (strstr(argv[1], "src") != NULL && argc < 3)) {
+        fprintf(stderr, "usage: lwip_profile_peer tcp-sink | udp-sink | (tcp-src | udp-src) addr [seconds [UDP bit/s]]\n");
+        return 2;
+    }
+    tcp = strstr(argv[1], "tcp") != NULL;
+    src = strstr(argv[1], "src") != NULL;
+    secs = argc > 3 ? atoi(argv[3]) : 8;
+    rate = argc > 4 ? atol(argv[4]) : 0;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(PEER_PORT);
+    s = socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(buf, 0xa5, sizeof(buf));
+
+    if (src) {
+        sa.sin_addr.s_addr = inet_addr(argv[2]);
+        while (connect(s, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+            usleep(100000);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (;;) {
+            clock_gettime(CLOCK_MONOTONIC, &t);
+            elapsed = t.tv_sec - t0.tv_sec + (t.tv_nsec - t0.tv_nsec) / 1e9;
+            if (elapsed > secs) {
+                break;
+            }
+            if (rate && sent * 8 > rate * elapsed) {
+                usleep(100);
+                continue;
+            }
+            r = send(s, buf, tcp ? sizeof(buf) : 1300, 0);
+            if (r > 0) {
+                sent += r;
+            }
+        }
+    } else {
+        sa.sin_addr.s_addr = INADDR_ANY;
+        if (bind(s, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+            perror("bind");
+            return 1;
+        }
+        if (tcp) {
+            listen(s, 1);
+            r = accept(s, NULL, NULL);
+            close(s);
+            s = r;
+        }
+        setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        while (recv(s, buf, sizeof(buf), 0) > 0) {
+        }
+    }
+    close(s);
+    return 0;
+}
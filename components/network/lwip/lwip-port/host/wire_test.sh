@@ -0,0 +1,22 @@
+#!/bin/sh
+# wire_test.sh <lwip_profile_bench> <tcp|udp>
+# A receiver and a sender connected over the wire, both must move data.
+
+bin=$1
+dir=$(mktemp -d)
+rcv=
+trap '[ -n "$rcv" ] && kill $rcv 2>/dev/null; rm -rf "$dir"' EXIT
+
+case $2 in
+    tcp)    rmode=ips;  smode=ipc ;;
+    udp)    rmode=ipus; smode=ipu ;;
+    *)      echo "unknown mode $2"; exit 2 ;;
+esac
+
+timeout 30 "$bin" --wire "$dir/r" "$dir/s" --ip 10.10.0.1 $rmode > "$dir/rcv.txt" &
+rcv=$!
+sleep 1
+timeout 30 "$bin" --wire "$dir/s" "$dir/r" --ip 10.10.0.2 $smode 10.10.0.1 2 || exit 1
+wait $rcv || { cat "$dir/rcv.txt"; exit 1; }
+rcv=
+cat "$dir/rcv.txt"
@@ -1393,8 +1393,9 @@ tcp_output(struct tcp_pcb *pcb)
           }
           seg->next = (*cur_seg);
           (*cur_seg) = seg;
-        } else {
+        } else if (useg != NULL) {
           /* add segment to tail of unacked list */
+          useg->next = seg;
           useg = seg;
         }
       }
@@ -10,6 +10,7 @@ COMPONENT_PRIV_INCLUDEDIRS :=
 COMPONENT_SRCS := tcpclient/tcpclient.c \
                 tcpserver/tcpserver.c \
                 iperf/iperf.c \
+                iperf/iperf_bench.c \
                 netstat/netstat.c \
                 ping/ping.c \
 
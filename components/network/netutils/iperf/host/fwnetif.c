@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Host stand-in for the BL602 Wi-Fi netif.
+ *
+ * RX is zero copy out of a small fixed pool of "firmware" buffers handed to
+ * tcpip_input() from a reader thread, the way tcpip_stack_input() runs on the
+ * fw task; frames are dropped when the pool is empty. Frames go out over a TAP
+ * device, or over a pair of UNIX datagram sockets ("wire") so that two host
+ * binaries can talk without root.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+
+#include <lwip/opt.h>
+#include <lwip/pbuf.h>
+#include <lwip/netif.h>
+#include <lwip/sys.h>
+#include <lwip/tcpip.h>
+#include <netif/etharp.h>
+
+#include "fwnetif.h"
+
+#define FW_RXBUF_SZ     1600
+
+typedef struct fw_buf {
+    struct pbuf_custom pc;
+    struct fw_buf *next;
+    uint8_t data[FW_RXBUF_SZ];
+} fw_buf_t;
+
+static fw_buf_t fw_bufs[FWNETIF_RXBUF_CNT];
+static fw_buf_t *fw_free;
+static pthread_mutex_t fw_lock = PTHREAD_MUTEX_INITIALIZER;
+static const fwnetif_cfg_t *fw_cfg;
+static int fw_fd = -1;
+static struct sockaddr_un fw_peer;
+static fwnetif_stats_t fw_stats;
+
+static void fw_buf_free(struct pbuf *p)
+{
+    fw_buf_t *b = (fw_buf_t *)p;
+
+    pthread_mutex_lock(&fw_lock);
+    b->next = fw_free;
+    fw_free = b;
+    pthread_mutex_unlock(&fw_lock);
+}
+
+static fw_buf_t *fw_buf_alloc(void)
+{
+    fw_buf_t *b;
+
+    pthread_mutex_lock(&fw_lock);
+    b = fw_free;
+    if (b) {
+        fw_free = b->next;
+    }
+    pthread_mutex_unlock(&fw_lock);
+    return b;
+}
+
+static err_t fw_linkoutput(struct netif *netif, struct pbuf *p)
+{
+    uint8_t buf[FW_RXBUF_SZ];
+    ssize_t n;
+
+    (void)netif;
+    if (p->tot_len > sizeof(buf)) {
+        return ERR_IF;
+    }
+    pbuf_copy_partial(p, buf, p->tot_len, 0);
+    if (fw_cfg->tap) {
+        n = write(fw_fd, buf, p->tot_len);
+    } else {
+        /* blocks while the peer queue is full, like a slow link */
+        n = sendto(fw_fd, buf, p->tot_len, 0, (struct sockaddr *)&fw_peer, sizeof(fw_peer));
+    }
+    if (n != p->tot_len) {
+        /* peer not up yet, the frame is lost in the air */
+        fw_stats.tx_err++;
+        return ERR_OK;
+    }
+    fw_stats.tx_frames++;
+    return ERR_OK;
+}
+
+static void fw_rx_thread(void *arg)
+{
+    struct netif *netif = (struct netif *)arg;
+    uint8_t sink[FW_RXBUF_SZ];
+    struct pbuf *p;
+    fw_buf_t *b;
+    ssize_t n;
+
+    for (;;) {
+        b = fw_buf_alloc();
+        if (b == NULL) {
+            /* firmware out of RX buffers */
+            if (read(fw_fd, sink, sizeof(sink)) > 0) {
+                fw_stats.rx_drop++;
+            }
+            continue;
+        }
+        n = read(fw_fd, b->data, sizeof(b->data));
+        if (n <= 0 || (fw_cfg->loss_permille && (unsigned)(rand() % 1000) < fw_cfg->loss_permille)) {
+            if (n > 0) {
+                fw_stats.rx_loss++;
+            }
+            fw_buf_free(&b->pc.pbuf);
+            continue;
+        }
+        b->pc.custom_free_function = fw_buf_free;
+        p = pbuf_alloced_custom(PBUF_RAW, (u16_t)n, PBUF_REF, &b->pc, b->data, sizeof(b->data));
+        fw_stats.rx_frames++;
+        if (netif->input(p, netif) != ERR_OK) {
+            pbuf_free(p);
+        }
+    }
+}
+
+static int fw_open_tap(const char *name)
+{
+    struct ifreq ifr;
+    int fd;
+
+    fd = open("/dev/net/tun", O_RDWR);
+    if (fd < 0) {
+        return -errno;
+    }
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, sizeof(ifr.ifr_name) - 1);
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    if (ioctl(fd, TUNSETIFF, &ifr) < 0) {
+        close(fd);
+        return -errno;
+    }
+    return fd;
+}
+
+static int fw_open_wire(const char *local, const char *peer)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, local, sizeof(addr.sun_path) - 1);
+    unlink(local);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -errno;
+    }
+    memset(&fw_peer, 0, sizeof(fw_peer));
+    fw_peer.sun_family = AF_UNIX;
+    strncpy(fw_peer.sun_path, peer, sizeof(fw_peer.sun_path) - 1);
+    return fd;
+}
+
+err_t fwnetif_init(struct netif *netif)
+{
+    const fwnetif_cfg_t *cfg = (const fwnetif_cfg_t *)netif->state;
+    int i;
+
+    fw_cfg = cfg;
+    for (i = 0; i < FWNETIF_RXBUF_CNT; i++) {
+        fw_bufs[i].next = fw_free;
+        fw_free = &fw_bufs[i];
+    }
+    fw_fd = cfg->tap ? fw_open_tap(cfg->tap) : fw_open_wire(cfg->wire_local, cfg->wire_peer);
+    if (fw_fd < 0) {
+        fprintf(stderr, "fwnetif: %s: %s\n", cfg->tap ? cfg->tap : cfg->wire_local, strerror(-fw_fd));
+        return ERR_IF;
+    }
+
+    netif->name[0] = 'w';
+    netif->name[1] = 'l';
+    netif->hwaddr_len = ETH_HWADDR_LEN;
+    memcpy(netif->hwaddr, cfg->mac, ETH_HWADDR_LEN);
+    netif->mtu = 1500;
+    netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP;
+    netif->output = etharp_output;
+    netif->linkoutput = fw_linkoutput;
+    sys_thread_new("fw", fw_rx_thread, netif, 0, 0);
+    return ERR_OK;
+}
+
+void fwnetif_get_stats(fwnetif_stats_t *stats)
+{
+    *stats = fw_stats;
+}
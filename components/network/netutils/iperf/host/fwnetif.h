@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __FWNETIF_H__
+#define __FWNETIF_H__
+
+#include <stdint.h>
+#include <lwip/netif.h>
+
+/* Same order of magnitude as the firmware RX descriptors */
+#ifndef FWNETIF_RXBUF_CNT
+#define FWNETIF_RXBUF_CNT       16
+#endif
+
+typedef struct fwnetif_cfg {
+    const char *tap;            /* TAP device name, or NULL for the wire */
+    const char *wire_local;     /* UNIX datagram socket paths */
+    const char *wire_peer;
+    unsigned int loss_permille; /* RX frames dropped on purpose */
+    uint8_t mac[6];
+} fwnetif_cfg_t;
+
+typedef struct fwnetif_stats {
+    unsigned long rx_frames;
+    unsigned long rx_drop;      /* no free RX buffer */
+    unsigned long rx_loss;      /* loss_permille */
+    unsigned long tx_frames;
+    unsigned long tx_err;
+} fwnetif_stats_t;
+
+/* netif_add() init function, netif->state points to a fwnetif_cfg_t */
+err_t fwnetif_init(struct netif *netif);
+void fwnetif_get_stats(fwnetif_stats_t *stats);
+
+#endif
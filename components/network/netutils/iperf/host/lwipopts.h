@@ -0,0 +1,10 @@
+/*
+ * The device lwipopts.h with the host changes of the lwIP throughput
+ * harness, so both build against lwIP's unix port the same way.
+ */
+#ifndef IPERF_HOST_LWIPOPTS_H
+#define IPERF_HOST_LWIPOPTS_H
+
+#include "../../../lwip/lwip-port/host/lwipopts.h"
+
+#endif
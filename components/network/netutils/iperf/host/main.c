@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Linux build of the iperf benchmark on lwIP's unix port, so lwIP and
+ * lwipopts.h changes can be measured without a radio. See README.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <lwip/tcpip.h>
+#include <lwip/netif.h>
+#include <lwip/stats.h>
+
+#include "iperf_bench.h"
+#include "fwnetif.h"
+
+typedef struct host_thread {
+    void (*fn)(void *arg);
+    void *arg;
+} host_thread_t;
+
+static struct netif host_netif;
+static uint64_t cpu_us, wall_us;
+static volatile int run_done;
+static iperf_cfg_t run_cfg;
+static int run_ret;
+
+static uint64_t host_clock_us(clockid_t clk)
+{
+    struct timespec ts;
+
+    clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t iperf_port_now_us(void)
+{
+    return host_clock_us(CLOCK_MONOTONIC);
+}
+
+void iperf_port_sys_begin(void)
+{
+    cpu_us = host_clock_us(CLOCK_PROCESS_CPUTIME_ID);
+    wall_us = host_clock_us(CLOCK_MONOTONIC);
+}
+
+/* Idle is what this process leaves of one CPU, the heap is lwIP's own */
+void iperf_port_sys_sample(iperf_sys_t *sys)
+{
+    uint64_t cpu = host_clock_us(CLOCK_PROCESS_CPUTIME_ID);
+    uint64_t wall = host_clock_us(CLOCK_MONOTONIC);
+    int64_t idle = -1;
+
+    if (wall != wall_us) {
+        idle = 1000 - (int64_t)((cpu - cpu_us) * 1000 / (wall - wall_us));
+        if (idle < 0) {
+            idle = 0;
+        }
+    }
+    cpu_us = cpu;
+    wall_us = wall;
+    sys->idle_permille = (int32_t)idle;
+    sys->heap_free = lwip_stats.mem.avail - lwip_stats.mem.used;
+    sys->heap_min = lwip_stats.mem.avail - lwip_stats.mem.max;
+}
+
+void *iperf_port_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void iperf_port_free(void *ptr)
+{
+    free(ptr);
+}
+
+static void *host_thread_entry(void *arg)
+{
+    host_thread_t t = *(host_thread_t *)arg;
+
+    free(arg);
+    t.fn(t.arg);
+    return NULL;
+}
+
+int iperf_port_thread_new(const char *name, void (*fn)(void *arg), void *arg)
+{
+    host_thread_t *t = malloc(sizeof(*t));
+    pthread_t tid;
+
+    (void)name;
+    if (t == NULL) {
+        return -1;
+    }
+    t->fn = fn;
+    t->arg = arg;
+    if (pthread_create(&tid, NULL, host_thread_entry, t)) {
+        free(t);
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+void iperf_port_output(const char *line)
+{
+    printf("%s\n", line);
+    fflush(stdout);
+}
+
+static void host_usage(void)
+{
+    fprintf(stderr,
+            "usage: iperf_lwip (--tap name | --wire local_path peer_path) --ip addr\n"
+            "                  [--mask mask] [--gw addr] [--loss permille] iperf options\n"
+            "  --tap   use an existing TAP device, e.g. set up with contrib/ports/unix/setup-tapif\n"
+            "  --wire  exchange frames with another iperf_lwip over UNIX datagram sockets\n"
+            "  --loss  drop received frames on purpose, per 1000\n");
+    iperf_bench_usage();
+}
+
+static void host_tcpip_ready(void *arg)
+{
+    sys_sem_signal((sys_sem_t *)arg);
+}
+
+static void *host_run(void *arg)
+{
+    (void)arg;
+    run_ret = iperf_bench_run(&run_cfg);
+    run_done = 1;
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    static fwnetif_cfg_t fw;
+    const char *ip = NULL, *mask = "255.255.255.0", *gw = NULL;
+    char **args;
+    int i, nargs = 1;
+    ip4_addr_t addr, netmask, gateway;
+    struct timespec poll = { 0, 100 * 1000 * 1000 };
+    fwnetif_stats_t stats;
+    sys_sem_t ready;
+    sigset_t sigs;
+    pthread_t tid;
+    char line[160];
+
+    args = calloc(argc + 1, sizeof(*args));
+    if (args == NULL) {
+        return 1;
+    }
+    args[0] = argv[0];
+    for (i = 1; i < argc; i++) {
+        const char *arg = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (!strcmp(argv[i], "--tap") && arg) {
+            fw.tap = argv[++i];
+        } else if (!strcmp(argv[i], "--wire") && arg && i + 2 < argc) {
+            fw.wire_local = argv[++i];
+            fw.wire_peer = argv[++i];
+        } else if (!strcmp(argv[i], "--ip") && arg) {
+            ip = argv[++i];
+        } else if (!strcmp(argv[i], "--mask") && arg) {
+            mask = argv[++i];
+        } else if (!strcmp(argv[i], "--gw") && arg) {
+            gw = argv[++i];
+        } else if (!strcmp(argv[i], "--loss") && arg) {
+            fw.loss_permille = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else {
+            args[nargs++] = argv[i];
+        }
+    }
+    if ((fw.tap == NULL && fw.wire_local == NULL) || ip == NULL ||
+            !ip4addr_aton(ip, &addr) || !ip4addr_aton(mask, &netmask) ||
+            (gw && !ip4addr_aton(gw, &gateway)) || iperf_bench_parse(&run_cfg, nargs, args)) {
+        host_usage();
+        return 2;
+    }
+    if (gw == NULL) {
+        ip4_addr_set_zero(&gateway);
+    }
+    fw.mac[0] = 0x02;
+    memcpy(&fw.mac[2], &addr, 4);
+
+    /* every thread inherits the mask, signals are only taken below */
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+    sys_sem_new(&ready, 0);
+    tcpip_init(host_tcpip_ready, &ready);
+    sys_sem_wait(&ready);
+    sys_sem_free(&ready);
+
+    LOCK_TCPIP_CORE();
+    if (netif_add(&host_netif, &addr, &netmask, &gateway, &fw, fwnetif_init, tcpip_input) == NULL) {
+        UNLOCK_TCPIP_CORE();
+        return 1;
+    }
+    netif_set_default(&host_netif);
+    netif_set_up(&host_netif);
+    UNLOCK_TCPIP_CORE();
+
+    if (pthread_create(&tid, NULL, host_run, NULL)) {
+        return 1;
+    }
+    while (!run_done) {
+        if (sigtimedwait(&sigs, NULL, &poll) > 0) {
+            iperf_bench_stop();
+        }
+    }
+    pthread_join(tid, NULL);
+
+    fwnetif_get_stats(&stats);
+    snprintf(line, sizeof(line), "{\"event\":\"netif\",\"rx_frames\":%lu,\"rx_drop\":%lu,\"rx_loss\":%lu,"
+            "\"tx_frames\":%lu,\"tx_err\":%lu}", stats.rx_frames, stats.rx_drop, stats.rx_loss,
+            stats.tx_frames, stats.tx_err);
+    iperf_port_output(line);
+    if (run_ret) {
+        fprintf(stderr, "iperf_lwip: %s\n", strerror(-run_ret));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+#!/bin/sh
+# wire_test.sh <iperf_lwip> <tcp|tcp_bidir|udp|udp_bidir>
+# Runs a server and a client connected over the wire and checks both summaries.
+
+bin=$1
+mode=$2
+dir=$(mktemp -d)
+srv=
+trap '[ -n "$srv" ] && kill $srv 2>/dev/null; rm -rf "$dir"' EXIT
+
+case $mode in
+    tcp)        sopts="";   copts="-P 2" ;;
+    tcp_bidir)  sopts="";   copts="-P 2 -d" ;;
+    udp)        sopts="-u"; copts="-u -P 2 -b 20M" ;;
+    udp_bidir)  sopts="-u"; copts="-u -b 10M -d" ;;
+    *)          echo "unknown mode $mode"; exit 2 ;;
+esac
+
+timeout 30 "$bin" --wire "$dir/s" "$dir/c" --ip 10.10.0.1 -s -1 $sopts > "$dir/server.json" &
+srv=$!
+sleep 1
+timeout 30 "$bin" --wire "$dir/c" "$dir/s" --ip 10.10.0.2 -c 10.10.0.1 -t 3 $copts > "$dir/client.json" || exit 1
+wait $srv || exit 1
+srv=
+
+# "sum":{"tx_kbps":N,"rx_kbps":M} of the summary line
+sum() {
+    grep '"event":"summary"' "$1" | sed -n "s/.*\"sum\":{\"tx_kbps\":\([0-9]*\),\"rx_kbps\":\([0-9]*\)}.*/\\$2/p"
+}
+
+cat "$dir/client.json" "$dir/server.json"
+fail=0
+[ "$(sum "$dir/client.json" 1)" -gt 0 ] || { echo "client sent nothing"; fail=1; }
+[ "$(sum "$dir/server.json" 2)" -gt 0 ] || { echo "server received nothing"; fail=1; }
+case $mode in
+    *_bidir)
+        [ "$(sum "$dir/client.json" 2)" -gt 0 ] || { echo "client received nothing back"; fail=1; }
+        [ "$(sum "$dir/server.json" 1)" -gt 0 ] || { echo "server sent nothing back"; fail=1; } ;;
+esac
+case $mode in
+    udp*)
+        grep '"event":"summary"' "$dir/client.json" | grep -q '"server":{' || { echo "no server report"; fail=1; } ;;
+esac
+exit $fail
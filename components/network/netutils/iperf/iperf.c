@@ -47,47 +47,14 @@
 #include <netutils/netutils.h>
 #include <bl_timer.h>
 
+#include "iperf_bench.h"
+
 #define IPERF_PORT_LOCAL    5002
-#define IPERF_PORT          5001
 #define IPERF_BUFSZ         (4 * 1300)
 #define IPERF_BUFSZ_UDP     (1 * 1300)
 #define DEBUG_HEADER        "[NET] [IPC] "
 #define DEFAULT_HOST_IP     "192.168.11.1"
 
-typedef struct UDP_datagram {
-    uint32_t id;
-    uint32_t tv_sec;
-    uint32_t tv_usec;
-} UDP_datagram;
-
-/*
- * The server_hdr structure facilitates the server
- * report of jitter and loss on the client side.
- * It piggy_backs on the existing clear to close
- * packet.
- */
-typedef struct server_hdr_v1 {
-    /*
-     * flags is a bitmap for different options
-     * the most significant bits are for determining
-     * which information is available. So 1.7 uses
-     * 0x80000000 and the next time information is added
-     * the 1.7 bit will be set and 0x40000000 will be
-     * set signifying additional information. If no
-     * information bits are set then the header is ignored.
-     */
-    int32_t flags;
-    int32_t total_len1;
-    int32_t total_len2;
-    int32_t stop_sec;
-    int32_t stop_usec;
-    int32_t error_cnt;
-    int32_t outorder_cnt;
-    int32_t datagrams;
-    int32_t jitter1;
-    int32_t jitter2;
-} server_hdr;
-
 static void iperf_client_tcp(void *arg)
 {
     int i;
@@ -689,12 +656,107 @@ static void ipus_test_cmd([[gnu::unused]] char *buf, [[gnu::unused]] int len, in
     }
 }
 
+uint64_t iperf_port_now_us(void)
+{
+    return bl_timer_now_us64();
+}
+
+#if ( configGENERATE_RUN_TIME_STATS == 1 )
+static uint32_t idle_run_time, total_run_time;
+#endif
+
+void iperf_port_sys_begin(void)
+{
+    vPortResetHeapMinimumEverFreeHeapSize();
+#if ( configGENERATE_RUN_TIME_STATS == 1 )
+    idle_run_time = ulTaskGetIdleRunTimeCounter();
+    total_run_time = portGET_RUN_TIME_COUNTER_VALUE();
+#endif
+}
+
+void iperf_port_sys_sample(iperf_sys_t *sys)
+{
+#if ( configGENERATE_RUN_TIME_STATS == 1 )
+    uint32_t idle, total;
+
+    idle = ulTaskGetIdleRunTimeCounter();
+    total = portGET_RUN_TIME_COUNTER_VALUE();
+    sys->idle_permille = total != total_run_time ?
+        (int32_t)((uint64_t)(idle - idle_run_time) * 1000 / (total - total_run_time)) : -1;
+    idle_run_time = idle;
+    total_run_time = total;
+#else
+    sys->idle_permille = -1;
+#endif
+    sys->heap_free = xPortGetFreeHeapSize();
+    sys->heap_min = xPortGetMinimumEverFreeHeapSize();
+}
+
+void *iperf_port_malloc(size_t size)
+{
+    return pvPortMalloc(size);
+}
+
+void iperf_port_free(void *ptr)
+{
+    vPortFree(ptr);
+}
+
+int iperf_port_thread_new(const char *name, void (*fn)(void *arg), void *arg)
+{
+    return aos_task_new(name, fn, arg, 2048);
+}
+
+void iperf_port_output(const char *line)
+{
+    printf("%s\r\n", line);
+}
+
+static void iperf_bench_task(void *arg)
+{
+    int ret;
+
+    ret = iperf_bench_run((iperf_cfg_t *)arg);
+    if (ret) {
+        printf(DEBUG_HEADER "[IPERF] failed %d\r\n", ret);
+    }
+    vPortFree(arg);
+}
+
+static void iperf_test_cmd([[gnu::unused]] char *buf, [[gnu::unused]] int len, int argc, char **argv)
+{
+    iperf_cfg_t *cfg;
+
+    if (2 == argc && 0 == strcmp(argv[1], "-k")) {
+        iperf_bench_stop();
+        return;
+    }
+    if (iperf_bench_running()) {
+        printf(DEBUG_HEADER "[IPERF] already running, stop it with iperf -k\r\n");
+        return;
+    }
+    cfg = pvPortMalloc(sizeof(*cfg));
+    if (NULL == cfg) {
+        return;
+    }
+    if (1 == argc || iperf_bench_parse(cfg, argc, argv)) {
+        iperf_bench_usage();
+        iperf_port_output("iperf -k    stop the running test");
+        vPortFree(cfg);
+        return;
+    }
+    if (aos_task_new("iperf", iperf_bench_task, cfg, 4096)) {
+        vPortFree(cfg);
+    }
+}
+
 // STATIC_CLI_CMD_ATTRIBUTE makes this(these) command(s) static
 static const struct cli_command cmds_user[] STATIC_CLI_CMD_ATTRIBUTE = {
     { "ipc", "iperf TCP client", ipc_test_cmd},
     { "ips", "iperf TCP server", ips_test_cmd},
     { "ipu", "iperf UDP client", ipu_test_cmd},
     { "ipus", "iperf UDP server", ipus_test_cmd},
+    { "iperf", "iperf multi-stream benchmark, JSON output", iperf_test_cmd},
 };
 
 int network_netutils_iperf_cli_register()
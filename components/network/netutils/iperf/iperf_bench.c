@@ -0,0 +1,1444 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+* Multi-stream iperf benchmark engine, see iperf_bench.h
+*
+*/
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lwip/sockets.h>
+#include <lwip/sys.h>
+#include <lwip/tcpip.h>
+#include <lwip/api.h>
+#include <lwip/tcp.h>
+#include <lwip/stats.h>
+#include <lwip/priv/sockets_priv.h>
+
+#include "iperf_bench.h"
+
+#define IPERF_POLL_MS           50
+#define IPERF_UDP_RX_LEN        1600
+#define IPERF_UDP_FIN_TRIES     10
+#define IPERF_UDP_FIN_WAIT_MS   250
+#define IPERF_UDP_IDLE_MS       2000
+#define IPERF_REVERSE_MS_DEF    10000
+#define IPERF_CONNECT_WAIT_MS   3000
+#define IPERF_LINE_SIZE         4096
+
+#define IPERF_STR_(x)           #x
+#define IPERF_STR(x)            IPERF_STR_(x)
+
+#define IPERF_SEQ_GEQ(a, b)     ((int32_t)((uint32_t)(a) - (uint32_t)(b)) >= 0)
+
+struct iperf_run;
+
+typedef struct iperf_stream {
+    struct iperf_run *run;
+    int sock;
+    uint8_t used;
+    uint8_t tx;
+    uint8_t done;
+    uint8_t header;             /* TX: first write carries client_hdr */
+    uint8_t connected;
+    uint32_t peer_addr;         /* network order */
+    uint16_t peer_port;         /* host order */
+    uint16_t len;
+    uint32_t rate_kbps;
+    uint64_t t_end;             /* TX: stop sending at, 0 runs until stopped */
+    uint64_t t_last;            /* UDP RX: last datagram, for the idle timeout */
+
+    /* Interval counters, updated by the stream under SYS_ARCH_PROTECT */
+    uint32_t bytes;
+    uint32_t datagrams;
+    int32_t lost;               /* negative when late datagrams were counted lost earlier */
+    uint32_t ooo;
+    uint32_t send_err;
+    uint32_t rtt_cnt;
+    uint32_t rtt_sum;
+    uint32_t rtt_min;
+    uint32_t rtt_max;
+    uint32_t jitter_us;
+
+    /* Run totals, only touched by the reporter */
+    uint64_t total_bytes;
+    uint32_t total_datagrams;
+    uint32_t total_lost;
+    uint32_t total_ooo;
+    uint32_t total_send_err;
+    uint32_t total_rtt_cnt;
+    uint64_t total_rtt_sum;
+    uint32_t total_rtt_min;
+    uint32_t total_rtt_max;
+
+    /* UDP RX state, receiver only */
+    int32_t last_id;
+    int32_t transit_prev;
+    uint8_t transit_valid;
+    uint32_t jitter16;          /* RFC 3550 estimate, scaled by 16 */
+    uint32_t jitter_hist[IPERF_JITTER_HIST_CNT];
+    uint32_t loss_hist[IPERF_LOSS_HIST_CNT];
+
+    /* UDP TX: the server's view, from its report */
+    uint8_t have_report;
+    uint32_t rep_datagrams;
+    uint32_t rep_lost;
+    uint32_t rep_ooo;
+    uint32_t rep_jitter_us;
+
+    /* TCP TX RTT sampler, sender only */
+    uint8_t rtt_pending;
+    uint32_t rtt_seq;
+    uint64_t rtt_t0;
+} iperf_stream_t;
+
+typedef struct iperf_run {
+    iperf_cfg_t cfg;
+    volatile uint8_t stop;
+    volatile uint8_t tx_go;     /* TX streams are all connected */
+    uint8_t started;
+    uint8_t reverse_pending;    /* server: reverse test waits for the forward one */
+    uint8_t reverse_done;
+    client_hdr reverse;         /* host order */
+    uint32_t reverse_addr;
+    int threads;                /* live stream threads, under SYS_ARCH_PROTECT */
+    uint64_t t_start;
+    uint64_t t_end;
+    uint64_t t_report;
+    uint64_t idle_sum;          /* idle permille * ms */
+    uint64_t idle_ms;
+    uint32_t heap_min;
+    char *line;
+    size_t line_len;
+    iperf_stream_t streams[2 * IPERF_STREAMS_MAX];
+} iperf_run_t;
+
+static iperf_run_t *volatile iperf_run_active;
+
+static void iperf_line_reset(iperf_run_t *run)
+{
+    run->line_len = 0;
+    run->line[0] = '\0';
+}
+
+static void iperf_line_add(iperf_run_t *run, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (run->line_len >= IPERF_LINE_SIZE - 1) {
+        return;
+    }
+    va_start(ap, fmt);
+    n = vsnprintf(run->line + run->line_len, IPERF_LINE_SIZE - run->line_len, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        run->line_len += n;
+        if (run->line_len > IPERF_LINE_SIZE - 1) {
+            run->line_len = IPERF_LINE_SIZE - 1;
+        }
+    }
+}
+
+/* %llu is not available everywhere */
+static const char *iperf_u64(char *buf, uint64_t v)
+{
+    char tmp[21];
+    int i = 0, j = 0;
+
+    do {
+        tmp[i++] = '0' + (v % 10);
+        v /= 10;
+    } while (v);
+    while (i) {
+        buf[j++] = tmp[--i];
+    }
+    buf[j] = '\0';
+    return buf;
+}
+
+static uint32_t iperf_kbps(uint64_t bytes, uint64_t us)
+{
+    if (us == 0) {
+        return 0;
+    }
+    return (uint32_t)(bytes * 8000 / us);
+}
+
+/* 1, 2, 3-4, 5-8, ... */
+static uint32_t iperf_loss_bucket(uint32_t gap)
+{
+    uint32_t b = 0;
+
+    while (gap > 1 && b < IPERF_LOSS_HIST_CNT - 1) {
+        gap = (gap + 1) >> 1;
+        b++;
+    }
+    return b;
+}
+
+/* below 1 << SHIFT, then one bucket per power of two */
+static uint32_t iperf_jitter_bucket(uint32_t d)
+{
+    uint32_t b = 0;
+
+    d >>= IPERF_JITTER_HIST_SHIFT;
+    while (d && b < IPERF_JITTER_HIST_CNT - 1) {
+        d >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static void iperf_fill_pattern(uint8_t *buf, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = '0' + (i % 10);
+    }
+}
+
+static void iperf_client_hdr_put(const iperf_cfg_t *cfg, uint8_t *p)
+{
+    client_hdr hdr;
+
+    hdr.flags = lwip_htonl(IPERF_HEADER_VERSION1 | IPERF_RUN_NOW);
+    hdr.numThreads = lwip_htonl(cfg->parallel);
+    hdr.mPort = lwip_htonl(cfg->port);
+    hdr.bufferlen = lwip_htonl(cfg->len);
+    hdr.mWinBand = lwip_htonl(cfg->rate_kbps * 1000);
+    hdr.mAmount = lwip_htonl(-(int32_t)(cfg->duration_ms / 10));
+    memcpy(p, &hdr, sizeof(hdr));
+}
+
+static int iperf_client_hdr_get(const uint8_t *p, int len, client_hdr *hdr)
+{
+    if (len < (int)sizeof(*hdr)) {
+        return -1;
+    }
+    memcpy(hdr, p, sizeof(*hdr));
+    hdr->flags = lwip_ntohl(hdr->flags);
+    if (!(hdr->flags & IPERF_HEADER_VERSION1)) {
+        return -1;
+    }
+    hdr->numThreads = lwip_ntohl(hdr->numThreads);
+    hdr->mPort = lwip_ntohl(hdr->mPort);
+    hdr->bufferlen = lwip_ntohl(hdr->bufferlen);
+    hdr->mWinBand = lwip_ntohl(hdr->mWinBand);
+    hdr->mAmount = lwip_ntohl(hdr->mAmount);
+    return 0;
+}
+
+static void iperf_thread_done(iperf_stream_t *s)
+{
+    iperf_run_t *run = s->run;
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    if (s->sock >= 0) {
+        lwip_close(s->sock);
+        s->sock = -1;
+    }
+    SYS_ARCH_PROTECT(lev);
+    s->done = 1;
+    run->threads--;
+    SYS_ARCH_UNPROTECT(lev);
+}
+
+static int iperf_stream_start(iperf_run_t *run, iperf_stream_t *s, void (*fn)(void *arg))
+{
+    static const char * const names[2][2] = {
+        { "iperf_tcp_rx", "iperf_tcp_tx" },
+        { "iperf_udp_rx", "iperf_udp_tx" },
+    };
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    SYS_ARCH_PROTECT(lev);
+    run->threads++;
+    SYS_ARCH_UNPROTECT(lev);
+    if (iperf_port_thread_new(names[run->cfg.proto][s->tx], fn, s)) {
+        s->done = 1;
+        SYS_ARCH_PROTECT(lev);
+        run->threads--;
+        SYS_ARCH_UNPROTECT(lev);
+        if (s->sock >= 0) {
+            lwip_close(s->sock);
+            s->sock = -1;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static iperf_stream_t *iperf_stream_alloc(iperf_run_t *run, int tx)
+{
+    iperf_stream_t *s;
+    int i;
+
+    for (i = 0; i < IPERF_STREAMS_MAX; i++) {
+        s = &run->streams[tx ? i : IPERF_STREAMS_MAX + i];
+        if (!s->used) {
+            memset(s, 0, sizeof(*s));
+            s->run = run;
+            s->sock = -1;
+            s->used = 1;
+            s->tx = tx;
+            s->last_id = -1;
+            s->rtt_min = UINT32_MAX;
+            s->total_rtt_min = UINT32_MAX;
+            s->len = run->cfg.len;
+            s->rate_kbps = run->cfg.rate_kbps;
+            if (!run->started) {
+                run->started = 1;
+                run->t_start = iperf_port_now_us();
+                run->t_report = run->t_start;
+            }
+            return s;
+        }
+    }
+    return NULL;
+}
+
+static void iperf_tcp_rtt_sample(iperf_stream_t *s)
+{
+    struct lwip_sock *sock;
+    struct tcp_pcb *pcb;
+    uint32_t lastack = 0, snd_nxt = 0, rtt;
+    uint64_t now;
+    int have = 0;
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    /* lastack/snd_nxt are read under the core lock when there is one,
+     * without it they are single word reads of a live pcb */
+    sock = lwip_socket_dbg_get_socket(s->sock);
+    if (sock == NULL || sock->conn == NULL) {
+        return;
+    }
+    LOCK_TCPIP_CORE();
+    pcb = sock->conn->pcb.tcp;
+    if (pcb != NULL) {
+        lastack = pcb->lastack;
+        snd_nxt = pcb->snd_nxt;
+        have = 1;
+    }
+    UNLOCK_TCPIP_CORE();
+    if (!have) {
+        return;
+    }
+
+    now = iperf_port_now_us();
+    if (s->rtt_pending && IPERF_SEQ_GEQ(lastack, s->rtt_seq)) {
+        rtt = (uint32_t)(now - s->rtt_t0);
+        SYS_ARCH_PROTECT(lev);
+        s->rtt_cnt++;
+        s->rtt_sum += rtt;
+        if (rtt < s->rtt_min) {
+            s->rtt_min = rtt;
+        }
+        if (rtt > s->rtt_max) {
+            s->rtt_max = rtt;
+        }
+        SYS_ARCH_UNPROTECT(lev);
+        s->rtt_pending = 0;
+    }
+    if (!s->rtt_pending && snd_nxt != lastack) {
+        /* time the highest byte on the wire until it is acked */
+        s->rtt_seq = snd_nxt;
+        s->rtt_t0 = now;
+        s->rtt_pending = 1;
+    }
+}
+
+static int iperf_connect(iperf_stream_t *s, int type)
+{
+    struct sockaddr_in addr;
+    int wait;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = lwip_htons(s->peer_port);
+    addr.sin_addr.s_addr = s->peer_addr;
+    for (wait = 0; ; wait += IPERF_POLL_MS) {
+        s->sock = lwip_socket(AF_INET, type, 0);
+        if (s->sock < 0) {
+            return -1;
+        }
+        if (lwip_connect(s->sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            break;
+        }
+        /* the SYN needs heap, which busy streams may hold for a while */
+        if ((errno != ENOBUFS && errno != ENOMEM) || wait >= IPERF_CONNECT_WAIT_MS || s->run->stop) {
+            return -1;
+        }
+        lwip_close(s->sock);
+        s->sock = -1;
+        sys_msleep(IPERF_POLL_MS);
+    }
+    s->connected = 1;
+    return 0;
+}
+
+/* Streams start together once all of them are connected, like iperf2 */
+static void iperf_tx_barrier(iperf_stream_t *s)
+{
+    while (!s->run->tx_go && !s->run->stop) {
+        sys_msleep(1);
+    }
+}
+
+static void iperf_stream_error(iperf_stream_t *s, const char *what)
+{
+    char line[96];
+    iperf_run_t *run = s->run;
+
+    snprintf(line, sizeof(line), "{\"event\":\"error\",\"stream\":%d,\"what\":\"%s\",\"errno\":%d}",
+            (int)(s - run->streams), what, errno);
+    iperf_port_output(line);
+}
+
+static void iperf_tcp_tx(void *arg)
+{
+    iperf_stream_t *s = (iperf_stream_t *)arg;
+    iperf_run_t *run = s->run;
+    uint8_t *buf;
+    int ret;
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    buf = iperf_port_malloc(s->len);
+    if (buf == NULL) {
+        iperf_stream_error(s, "nomem");
+        goto exit;
+    }
+    iperf_fill_pattern(buf, s->len);
+    if (iperf_connect(s, SOCK_STREAM)) {
+        iperf_stream_error(s, "connect");
+        goto exit;
+    }
+    iperf_tx_barrier(s);
+    if (s->header) {
+        iperf_client_hdr_put(&run->cfg, buf);
+    }
+
+    while (!run->stop && (s->t_end == 0 || iperf_port_now_us() < s->t_end)) {
+        ret = lwip_send(s->sock, buf, s->len, 0);
+        if (ret <= 0) {
+            break;
+        }
+        if (s->header) {
+            s->header = 0;
+            iperf_fill_pattern(buf, sizeof(client_hdr));
+        }
+        SYS_ARCH_PROTECT(lev);
+        s->bytes += ret;
+        SYS_ARCH_UNPROTECT(lev);
+        iperf_tcp_rtt_sample(s);
+    }
+
+exit:
+    if (buf) {
+        iperf_port_free(buf);
+    }
+    iperf_thread_done(s);
+}
+
+static void iperf_reverse_request(iperf_run_t *run, const client_hdr *hdr, uint32_t addr)
+{
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    if (run->cfg.role != IPERF_ROLE_SERVER) {
+        return;
+    }
+    SYS_ARCH_PROTECT(lev);
+    if (!run->reverse_pending && !run->reverse_done) {
+        run->reverse = *hdr;
+        run->reverse_addr = addr;
+        run->reverse_pending = 1;
+    }
+    SYS_ARCH_UNPROTECT(lev);
+}
+
+static void iperf_tcp_rx(void *arg)
+{
+    iperf_stream_t *s = (iperf_stream_t *)arg;
+    iperf_run_t *run = s->run;
+    struct timeval tv = { 0, IPERF_POLL_MS * 1000 };
+    uint8_t *buf;
+    client_hdr hdr;
+    int ret, first = 1;
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    buf = iperf_port_malloc(s->len);
+    if (buf == NULL) {
+        iperf_stream_error(s, "nomem");
+        goto exit;
+    }
+    lwip_setsockopt(s->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    while (!run->stop) {
+        ret = lwip_recv(s->sock, buf, s->len, 0);
+        if (ret < 0 && errno == EWOULDBLOCK) {
+            continue;
+        }
+        if (ret <= 0) {
+            break;
+        }
+        if (first) {
+            first = 0;
+            if (iperf_client_hdr_get(buf, ret, &hdr) == 0) {
+                iperf_reverse_request(run, &hdr, s->peer_addr);
+            }
+        }
+        SYS_ARCH_PROTECT(lev);
+        s->bytes += ret;
+        SYS_ARCH_UNPROTECT(lev);
+    }
+
+exit:
+    if (buf) {
+        iperf_port_free(buf);
+    }
+    iperf_thread_done(s);
+}
+
+static void iperf_udp_fin(iperf_stream_t *s, uint8_t *buf, int32_t id)
+{
+    struct timeval tv = { 0, IPERF_UDP_FIN_WAIT_MS * 1000 };
+    UDP_datagram *dgram = (UDP_datagram *)buf;
+    server_hdr hdr;
+    uint64_t now;
+    int i, ret;
+
+    lwip_setsockopt(s->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    for (i = 0; i < IPERF_UDP_FIN_TRIES; i++) {
+        now = iperf_port_now_us();
+        dgram->id = lwip_htonl((uint32_t)-id);
+        dgram->tv_sec = lwip_htonl((uint32_t)(now / 1000000));
+        dgram->tv_usec = lwip_htonl((uint32_t)(now % 1000000));
+        lwip_send(s->sock, buf, s->len, 0);
+
+        ret = lwip_recv(s->sock, buf, s->len, 0);
+        if (ret >= (int)(sizeof(UDP_datagram) + sizeof(server_hdr))) {
+            memcpy(&hdr, buf + sizeof(UDP_datagram), sizeof(hdr));
+            if (lwip_ntohl(hdr.flags) & IPERF_HEADER_VERSION1) {
+                s->rep_datagrams = lwip_ntohl(hdr.datagrams);
+                s->rep_lost = lwip_ntohl(hdr.error_cnt);
+                s->rep_ooo = lwip_ntohl(hdr.outorder_cnt);
+                s->rep_jitter_us = lwip_ntohl(hdr.jitter1) * 1000000 + lwip_ntohl(hdr.jitter2);
+                s->have_report = 1;
+            }
+            return;
+        }
+    }
+}
+
+static void iperf_udp_tx(void *arg)
+{
+    iperf_stream_t *s = (iperf_stream_t *)arg;
+    iperf_run_t *run = s->run;
+    UDP_datagram *dgram;
+    uint8_t *buf;
+    uint64_t now, t0, due, ipg = 0;
+    int32_t id = 0;
+    int ret;
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    if (s->len < sizeof(UDP_datagram) + sizeof(client_hdr)) {
+        s->len = sizeof(UDP_datagram) + sizeof(client_hdr);
+    }
+    buf = iperf_port_malloc(s->len);
+    if (buf == NULL) {
+        iperf_stream_error(s, "nomem");
+        goto exit;
+    }
+    iperf_fill_pattern(buf, s->len);
+    if (s->header) {
+        iperf_client_hdr_put(&run->cfg, buf + sizeof(UDP_datagram));
+    } else {
+        /* datagram header only, iperf2 ignores a client_hdr without flags */
+        memset(buf + sizeof(UDP_datagram), 0, sizeof(client_hdr));
+    }
+    if (iperf_connect(s, SOCK_DGRAM)) {
+        iperf_stream_error(s, "connect");
+        goto exit;
+    }
+    iperf_tx_barrier(s);
+    if (s->rate_kbps) {
+        ipg = (uint64_t)s->len * 8 * 1000 / s->rate_kbps;
+    }
+
+    dgram = (UDP_datagram *)buf;
+    t0 = iperf_port_now_us();
+    due = t0;
+    while (!run->stop) {
+        now = iperf_port_now_us();
+        if (s->t_end && now >= s->t_end) {
+            break;
+        }
+        if (ipg) {
+            /* sleep only when a whole tick ahead, otherwise send now */
+            if (due > now + 1000) {
+                sys_msleep((uint32_t)((due - now) / 1000));
+                continue;
+            }
+            due += ipg;
+        }
+        dgram->id = lwip_htonl((uint32_t)id);
+        dgram->tv_sec = lwip_htonl((uint32_t)(now / 1000000));
+        dgram->tv_usec = lwip_htonl((uint32_t)(now % 1000000));
+        ret = lwip_send(s->sock, buf, s->len, 0);
+        if (ret < 0) {
+            if (errno != ENOMEM && errno != ENOBUFS) {
+                break;
+            }
+            SYS_ARCH_PROTECT(lev);
+            s->send_err++;
+            SYS_ARCH_UNPROTECT(lev);
+            sys_msleep(1);
+            continue;
+        }
+        id++;
+        SYS_ARCH_PROTECT(lev);
+        s->bytes += ret;
+        s->datagrams++;
+        SYS_ARCH_UNPROTECT(lev);
+    }
+    iperf_udp_fin(s, buf, id);
+
+exit:
+    if (buf) {
+        iperf_port_free(buf);
+    }
+    iperf_thread_done(s);
+}
+
+/* Account one datagram of a UDP receive stream, iperf2 style */
+static void iperf_udp_rx_account(iperf_stream_t *s, const uint8_t *buf, int len, uint64_t now)
+{
+    UDP_datagram dgram;
+    int32_t id, transit, d;
+    uint32_t gap, jitter;
+    int lost = 0, ooo = 0;
+    uint64_t sent;
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    memcpy(&dgram, buf, sizeof(dgram));
+    id = (int32_t)lwip_ntohl(dgram.id);
+    if (id < 0) {
+        id = -id;
+    }
+    sent = (uint64_t)lwip_ntohl(dgram.tv_sec) * 1000000 + lwip_ntohl(dgram.tv_usec);
+
+    /* clocks are not synchronized, only the transit variation matters */
+    transit = (int32_t)(now - sent);
+    if (s->transit_valid) {
+        d = transit - s->transit_prev;
+        if (d < 0) {
+            d = -d;
+        }
+        s->jitter16 += d - ((s->jitter16 + 8) >> 4);
+        s->jitter_hist[iperf_jitter_bucket((uint32_t)d)]++;
+    }
+    s->transit_prev = transit;
+    s->transit_valid = 1;
+    jitter = s->jitter16 >> 4;
+
+    if (id != s->last_id + 1) {
+        if (id < s->last_id + 1) {
+            /* it was counted lost when the gap opened, as in iperf2 */
+            ooo = 1;
+            lost = -1;
+        } else {
+            gap = id - s->last_id - 1;
+            lost = gap;
+            s->loss_hist[iperf_loss_bucket(gap)]++;
+        }
+    }
+    if (id > s->last_id) {
+        s->last_id = id;
+    }
+    s->t_last = now;
+
+    SYS_ARCH_PROTECT(lev);
+    s->bytes += len;
+    s->datagrams++;
+    s->lost += lost;
+    s->ooo += ooo;
+    s->jitter_us = jitter;
+    SYS_ARCH_UNPROTECT(lev);
+}
+
+static void iperf_udp_rx_report(iperf_run_t *run, iperf_stream_t *s, int sock, uint8_t *buf, int len,
+        const struct sockaddr_in *from)
+{
+    server_hdr hdr;
+    uint64_t now = iperf_port_now_us() - run->t_start;
+    uint32_t jitter = s->jitter16 >> 4;
+
+    if (len < (int)(sizeof(UDP_datagram) + sizeof(server_hdr))) {
+        len = sizeof(UDP_datagram) + sizeof(server_hdr);
+    }
+    /* totals are folded in by the reporter, add what it has not seen yet */
+    hdr.flags = lwip_htonl(IPERF_HEADER_VERSION1);
+    hdr.total_len1 = lwip_htonl((uint32_t)((s->total_bytes + s->bytes) >> 32));
+    hdr.total_len2 = lwip_htonl((uint32_t)(s->total_bytes + s->bytes));
+    hdr.stop_sec = lwip_htonl((uint32_t)(now / 1000000));
+    hdr.stop_usec = lwip_htonl((uint32_t)(now % 1000000));
+    hdr.error_cnt = lwip_htonl(s->total_lost + s->lost);
+    hdr.outorder_cnt = lwip_htonl(s->total_ooo + s->ooo);
+    hdr.datagrams = lwip_htonl(s->total_datagrams + s->datagrams);
+    hdr.jitter1 = lwip_htonl(jitter / 1000000);
+    hdr.jitter2 = lwip_htonl(jitter % 1000000);
+    memcpy(buf + sizeof(UDP_datagram), &hdr, sizeof(hdr));
+    lwip_sendto(sock, buf, len, 0, (const struct sockaddr *)from, sizeof(*from));
+}
+
+/* Receive and demultiplex UDP streams by source address */
+static void iperf_udp_rx_poll(iperf_run_t *run, int sock, uint8_t *buf)
+{
+    struct sockaddr_in from;
+    socklen_t fromlen = sizeof(from);
+    iperf_stream_t *s = NULL;
+    client_hdr hdr;
+    uint64_t now;
+    int i, len;
+
+    len = lwip_recvfrom(sock, buf, IPERF_UDP_RX_LEN, 0, (struct sockaddr *)&from, &fromlen);
+    if (len < (int)sizeof(UDP_datagram)) {
+        return;
+    }
+    now = iperf_port_now_us();
+
+    for (i = IPERF_STREAMS_MAX; i < 2 * IPERF_STREAMS_MAX; i++) {
+        if (run->streams[i].used && run->streams[i].peer_addr == from.sin_addr.s_addr &&
+                run->streams[i].peer_port == lwip_ntohs(from.sin_port)) {
+            s = &run->streams[i];
+            break;
+        }
+    }
+    if (s == NULL) {
+        if ((int32_t)lwip_ntohl(((UDP_datagram *)buf)->id) < 0) {
+            return;
+        }
+        s = iperf_stream_alloc(run, 0);
+        if (s == NULL) {
+            return;
+        }
+        s->peer_addr = from.sin_addr.s_addr;
+        s->peer_port = lwip_ntohs(from.sin_port);
+        if (iperf_client_hdr_get(buf + sizeof(UDP_datagram), len - sizeof(UDP_datagram), &hdr) == 0) {
+            iperf_reverse_request(run, &hdr, s->peer_addr);
+        }
+    }
+
+    if ((int32_t)lwip_ntohl(((UDP_datagram *)buf)->id) < 0) {
+        /* the client repeats its FIN until it gets the report */
+        if (!s->done) {
+            iperf_udp_rx_account(s, buf, len, now);
+            s->done = 1;
+        }
+        iperf_udp_rx_report(run, s, sock, buf, len, &from);
+        return;
+    }
+    if (!s->done) {
+        iperf_udp_rx_account(s, buf, len, now);
+    }
+}
+
+static void iperf_sys_json(iperf_run_t *run, const iperf_sys_t *sys, uint64_t dt_ms)
+{
+    int32_t idle = sys->idle_permille;
+
+    if (sys->heap_min < run->heap_min) {
+        run->heap_min = sys->heap_min;
+    }
+    if (idle >= 0 && dt_ms) {
+        run->idle_sum += (uint64_t)idle * dt_ms;
+        run->idle_ms += dt_ms;
+    }
+    iperf_line_add(run, ",\"sys\":{\"idle_permille\":%ld,\"heap_free\":%lu,\"heap_min\":%lu",
+            (long)idle, (unsigned long)sys->heap_free, (unsigned long)sys->heap_min);
+#if MEM_STATS
+    iperf_line_add(run, ",\"lwip_mem_used\":%lu,\"lwip_mem_max\":%lu,\"lwip_mem_err\":%lu",
+            (unsigned long)lwip_stats.mem.used, (unsigned long)lwip_stats.mem.max,
+            (unsigned long)lwip_stats.mem.err);
+#endif
+    iperf_line_add(run, "}");
+}
+
+/* Fold the interval counters into the totals and print them, a final
+ * partial interval is only printed when it carried data */
+static void iperf_report_interval(iperf_run_t *run, uint64_t now, int partial)
+{
+    iperf_stream_t *s;
+    iperf_sys_t sys;
+    uint32_t bytes, datagrams, ooo, send_err, rtt_cnt, rtt_sum, rtt_min, rtt_max, jitter;
+    int32_t lost;
+    uint64_t dt = now - run->t_report;
+    uint64_t tx = 0, rx = 0;
+    int i, n = 0;
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    iperf_port_sys_sample(&sys);
+    iperf_line_reset(run);
+    iperf_line_add(run, "{\"event\":\"interval\",\"t_ms\":%lu,\"dt_ms\":%lu,\"streams\":[",
+            (unsigned long)((now - run->t_start) / 1000), (unsigned long)(dt / 1000));
+
+    for (i = 0; i < 2 * IPERF_STREAMS_MAX; i++) {
+        s = &run->streams[i];
+        if (!s->used) {
+            continue;
+        }
+        SYS_ARCH_PROTECT(lev);
+        bytes = s->bytes;
+        datagrams = s->datagrams;
+        lost = s->lost;
+        ooo = s->ooo;
+        send_err = s->send_err;
+        rtt_cnt = s->rtt_cnt;
+        rtt_sum = s->rtt_sum;
+        rtt_min = s->rtt_min;
+        rtt_max = s->rtt_max;
+        jitter = s->jitter_us;
+        s->bytes = 0;
+        s->datagrams = 0;
+        s->lost = 0;
+        s->ooo = 0;
+        s->send_err = 0;
+        s->rtt_cnt = 0;
+        s->rtt_sum = 0;
+        s->rtt_min = UINT32_MAX;
+        s->rtt_max = 0;
+        SYS_ARCH_UNPROTECT(lev);
+
+        s->total_bytes += bytes;
+        s->total_datagrams += datagrams;
+        s->total_lost += lost;
+        s->total_ooo += ooo;
+        s->total_send_err += send_err;
+        s->total_rtt_cnt += rtt_cnt;
+        s->total_rtt_sum += rtt_sum;
+        if (rtt_cnt && rtt_min < s->total_rtt_min) {
+            s->total_rtt_min = rtt_min;
+        }
+        if (rtt_max > s->total_rtt_max) {
+            s->total_rtt_max = rtt_max;
+        }
+        if (s->tx) {
+            tx += bytes;
+        } else {
+            rx += bytes;
+        }
+
+        iperf_line_add(run, "%s{\"id\":%d,\"dir\":\"%s\",\"bytes\":%lu,\"kbps\":%lu",
+                n++ ? "," : "", i, s->tx ? "tx" : "rx",
+                (unsigned long)bytes, (unsigned long)iperf_kbps(bytes, dt));
+        if (run->cfg.proto == IPERF_PROTO_UDP) {
+            if (s->tx) {
+                iperf_line_add(run, ",\"datagrams\":%lu,\"send_err\":%lu",
+                        (unsigned long)datagrams, (unsigned long)send_err);
+            } else {
+                iperf_line_add(run, ",\"datagrams\":%lu,\"lost\":%ld,\"ooo\":%lu,\"jitter_us\":%lu",
+                        (unsigned long)datagrams, (long)lost, (unsigned long)ooo,
+                        (unsigned long)jitter);
+            }
+        } else if (s->tx && rtt_cnt) {
+            iperf_line_add(run, ",\"rtt_us\":{\"n\":%lu,\"min\":%lu,\"avg\":%lu,\"max\":%lu}",
+                    (unsigned long)rtt_cnt, (unsigned long)rtt_min,
+                    (unsigned long)(rtt_sum / rtt_cnt), (unsigned long)rtt_max);
+        }
+        iperf_line_add(run, "}");
+    }
+    run->t_report = now;
+    if (partial && tx + rx == 0) {
+        return;
+    }
+    iperf_line_add(run, "],\"sum\":{\"tx_kbps\":%lu,\"rx_kbps\":%lu}",
+            (unsigned long)iperf_kbps(tx, dt), (unsigned long)iperf_kbps(rx, dt));
+    iperf_sys_json(run, &sys, dt / 1000);
+    iperf_line_add(run, "}");
+    iperf_port_output(run->line);
+}
+
+static void iperf_hist_json(iperf_run_t *run, const char *name, const uint32_t *hist, int cnt)
+{
+    int i;
+
+    iperf_line_add(run, ",\"%s\":[", name);
+    for (i = 0; i < cnt; i++) {
+        iperf_line_add(run, "%s%lu", i ? "," : "", (unsigned long)hist[i]);
+    }
+    iperf_line_add(run, "]");
+}
+
+static void iperf_report_summary(iperf_run_t *run, uint64_t now)
+{
+    iperf_stream_t *s;
+    uint64_t us = now - run->t_start;
+    uint64_t tx = 0, rx = 0;
+    char num[21];
+    int i, n = 0;
+
+    iperf_report_interval(run, now, 1);
+
+    iperf_line_reset(run);
+    iperf_line_add(run, "{\"event\":\"summary\",\"t_ms\":%lu,\"streams\":[", (unsigned long)(us / 1000));
+    for (i = 0; i < 2 * IPERF_STREAMS_MAX; i++) {
+        s = &run->streams[i];
+        if (!s->used) {
+            continue;
+        }
+        if (s->tx) {
+            tx += s->total_bytes;
+        } else {
+            rx += s->total_bytes;
+        }
+        iperf_line_add(run, "%s{\"id\":%d,\"dir\":\"%s\",\"bytes\":%s,\"kbps\":%lu",
+                n++ ? "," : "", i, s->tx ? "tx" : "rx", iperf_u64(num, s->total_bytes),
+                (unsigned long)iperf_kbps(s->total_bytes, us));
+        if (run->cfg.proto == IPERF_PROTO_TCP) {
+            if (s->total_rtt_cnt) {
+                iperf_line_add(run, ",\"rtt_us\":{\"n\":%lu,\"min\":%lu,\"avg\":%lu,\"max\":%lu}",
+                        (unsigned long)s->total_rtt_cnt, (unsigned long)s->total_rtt_min,
+                        (unsigned long)(s->total_rtt_sum / s->total_rtt_cnt),
+                        (unsigned long)s->total_rtt_max);
+            }
+        } else if (s->tx) {
+            iperf_line_add(run, ",\"datagrams\":%lu,\"send_err\":%lu",
+                    (unsigned long)s->total_datagrams, (unsigned long)s->total_send_err);
+            if (s->have_report) {
+                iperf_line_add(run, ",\"server\":{\"datagrams\":%lu,\"lost\":%lu,\"ooo\":%lu,\"jitter_us\":%lu}",
+                        (unsigned long)s->rep_datagrams, (unsigned long)s->rep_lost,
+                        (unsigned long)s->rep_ooo, (unsigned long)s->rep_jitter_us);
+            }
+        } else {
+            iperf_line_add(run, ",\"datagrams\":%lu,\"lost\":%lu,\"ooo\":%lu,\"jitter_us\":%lu",
+                    (unsigned long)s->total_datagrams, (unsigned long)s->total_lost,
+                    (unsigned long)s->total_ooo, (unsigned long)(s->jitter16 >> 4));
+            iperf_hist_json(run, "jitter_hist", s->jitter_hist, IPERF_JITTER_HIST_CNT);
+            iperf_hist_json(run, "loss_hist", s->loss_hist, IPERF_LOSS_HIST_CNT);
+        }
+        iperf_line_add(run, "}");
+    }
+    iperf_line_add(run, "],\"sum\":{\"tx_kbps\":%lu,\"rx_kbps\":%lu}",
+            (unsigned long)iperf_kbps(tx, us), (unsigned long)iperf_kbps(rx, us));
+    iperf_line_add(run, ",\"sys\":{\"idle_permille\":%ld,\"heap_min\":%lu",
+            run->idle_ms ? (long)(run->idle_sum / run->idle_ms) : -1L, (unsigned long)run->heap_min);
+#if MEM_STATS
+    iperf_line_add(run, ",\"lwip_mem_max\":%lu", (unsigned long)lwip_stats.mem.max);
+#endif
+    iperf_line_add(run, "}}");
+    iperf_port_output(run->line);
+}
+
+static void iperf_report_start(iperf_run_t *run)
+{
+    const iperf_cfg_t *cfg = &run->cfg;
+    ip4_addr_t host;
+
+    ip4_addr_set_u32(&host, cfg->host);
+    iperf_line_reset(run);
+    iperf_line_add(run, "{\"event\":\"start\",\"role\":\"%s\",\"proto\":\"%s\",\"host\":\"%s\",\"port\":%u,"
+            "\"parallel\":%u,\"bidir\":%u,\"len\":%u,\"rate_kbps\":%lu,\"duration_ms\":%lu,\"interval_ms\":%lu",
+            cfg->role == IPERF_ROLE_CLIENT ? "client" : "server",
+            cfg->proto == IPERF_PROTO_TCP ? "tcp" : "udp",
+            ip4addr_ntoa(&host), cfg->port, cfg->parallel, cfg->bidir, cfg->len,
+            (unsigned long)cfg->rate_kbps, (unsigned long)cfg->duration_ms,
+            (unsigned long)cfg->interval_ms);
+    iperf_line_add(run, ",\"lwip\":{\"tcp_mss\":%u,\"tcp_wnd\":%lu,\"tcp_snd_buf\":%lu,\"core_locking\":%u}}",
+            (unsigned)TCP_MSS, (unsigned long)TCP_WND, (unsigned long)TCP_SND_BUF,
+            (unsigned)LWIP_TCPIP_CORE_LOCKING);
+    iperf_port_output(run->line);
+}
+
+static void iperf_start_tx(iperf_run_t *run, int streams, uint32_t addr, uint16_t port, uint16_t len,
+        uint32_t rate_kbps, uint32_t duration_ms, int header)
+{
+    iperf_stream_t *s;
+    iperf_stream_t *started[IPERF_STREAMS_MAX];
+    uint64_t now;
+    int i, n = 0, wait;
+
+    run->tx_go = 0;
+    for (i = 0; i < streams; i++) {
+        s = iperf_stream_alloc(run, 1);
+        if (s == NULL) {
+            break;
+        }
+        s->peer_addr = addr;
+        s->peer_port = port;
+        s->len = len;
+        s->rate_kbps = rate_kbps;
+        s->header = header;
+        if (iperf_stream_start(run, s, run->cfg.proto == IPERF_PROTO_TCP ? iperf_tcp_tx : iperf_udp_tx)) {
+            break;
+        }
+        /* Without ARP_QUEUEING only the last packet waiting for ARP is kept,
+         * let the first SYN resolve the peer before the others go out */
+        for (wait = 0; i == 0 && !s->connected && !s->done && wait < IPERF_CONNECT_WAIT_MS; wait += 10) {
+            sys_msleep(10);
+        }
+        started[n++] = s;
+    }
+
+    for (wait = 0; wait < 2 * IPERF_CONNECT_WAIT_MS && !run->stop; wait += 10) {
+        for (i = 0; i < n && (started[i]->connected || started[i]->done); i++) {
+        }
+        if (i == n) {
+            break;
+        }
+        sys_msleep(10);
+    }
+    /* durations count from here */
+    now = iperf_port_now_us();
+    for (i = 0; i < n; i++) {
+        started[i]->t_end = duration_ms ? now + (uint64_t)duration_ms * 1000 : 0;
+    }
+    run->tx_go = 1;
+}
+
+/* Server side of a dual test: send back to the client as it asked */
+static void iperf_start_reverse(iperf_run_t *run)
+{
+    const client_hdr *hdr = &run->reverse;
+    uint32_t duration_ms = IPERF_REVERSE_MS_DEF;
+    int streams = hdr->numThreads;
+    uint16_t len = hdr->bufferlen > 0 && hdr->bufferlen <= 0xFFFF ? hdr->bufferlen : run->cfg.len;
+
+    if (hdr->mAmount < 0) {
+        duration_ms = (uint32_t)(-hdr->mAmount) * 10;
+    }
+    if (streams < 1 || streams > IPERF_STREAMS_MAX) {
+        streams = 1;
+    }
+    run->reverse_pending = 0;
+    run->reverse_done = 1;
+    iperf_start_tx(run, streams, run->reverse_addr, (uint16_t)hdr->mPort, len,
+            run->cfg.proto == IPERF_PROTO_UDP ? (uint32_t)hdr->mWinBand / 1000 : 0, duration_ms, 0);
+}
+
+static int iperf_accept(iperf_run_t *run, int lsock)
+{
+    struct sockaddr_in from;
+    socklen_t fromlen = sizeof(from);
+    iperf_stream_t *s;
+    int sock;
+
+    sock = lwip_accept(lsock, (struct sockaddr *)&from, &fromlen);
+    if (sock < 0) {
+        return -1;
+    }
+    s = iperf_stream_alloc(run, 0);
+    if (s == NULL) {
+        lwip_close(sock);
+        return -1;
+    }
+    s->sock = sock;
+    s->peer_addr = from.sin_addr.s_addr;
+    s->peer_port = lwip_ntohs(from.sin_port);
+    if (s->len < IPERF_LEN_TCP_DEFAULT) {
+        s->len = IPERF_LEN_TCP_DEFAULT;
+    }
+    return iperf_stream_start(run, s, iperf_tcp_rx);
+}
+
+static int iperf_listen(const iperf_cfg_t *cfg)
+{
+    struct sockaddr_in addr;
+    struct timeval tv = { 0, IPERF_POLL_MS * 1000 };
+    int sock, on = 1;
+
+    sock = lwip_socket(AF_INET, cfg->proto == IPERF_PROTO_TCP ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    lwip_setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    lwip_setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = lwip_htons(cfg->port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (lwip_bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+            (cfg->proto == IPERF_PROTO_TCP && lwip_listen(sock, IPERF_STREAMS_MAX) < 0)) {
+        lwip_close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* Receive streams are finished: UDP ones on FIN or when idle */
+static int iperf_rx_idle(iperf_run_t *run, uint64_t now)
+{
+    iperf_stream_t *s;
+    int i, busy = 0;
+
+    if (run->cfg.proto != IPERF_PROTO_UDP) {
+        return 1;
+    }
+    for (i = IPERF_STREAMS_MAX; i < 2 * IPERF_STREAMS_MAX; i++) {
+        s = &run->streams[i];
+        if (s->used && !s->done) {
+            if (now - s->t_last > (uint64_t)IPERF_UDP_IDLE_MS * 1000) {
+                s->done = 1;
+            } else {
+                busy = 1;
+            }
+        }
+    }
+    return !busy;
+}
+
+static int iperf_threads(iperf_run_t *run)
+{
+    int threads;
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    SYS_ARCH_PROTECT(lev);
+    threads = run->threads;
+    SYS_ARCH_UNPROTECT(lev);
+    return threads;
+}
+
+static void iperf_run_reset(iperf_run_t *run)
+{
+    memset(run->streams, 0, sizeof(run->streams));
+    run->started = 0;
+    run->reverse_pending = 0;
+    run->reverse_done = 0;
+    run->idle_sum = 0;
+    run->idle_ms = 0;
+    run->heap_min = UINT32_MAX;
+    iperf_port_sys_begin();
+#if MEM_STATS
+    {
+        SYS_ARCH_DECL_PROTECT(lev);
+
+        SYS_ARCH_PROTECT(lev);
+        lwip_stats.mem.max = lwip_stats.mem.used;
+        SYS_ARCH_UNPROTECT(lev);
+    }
+#endif
+}
+
+/*
+ * The calling thread accepts TCP streams / receives UDP ones, reports every
+ * interval and decides when the run is over.
+ */
+static void iperf_control(iperf_run_t *run, int lsock, uint8_t *udp_buf)
+{
+    uint64_t now, interval = (uint64_t)run->cfg.interval_ms * 1000;
+    int finished;
+
+    for (;;) {
+        if (lsock >= 0 && run->cfg.proto == IPERF_PROTO_TCP) {
+            iperf_accept(run, lsock);
+        } else if (lsock >= 0) {
+            iperf_udp_rx_poll(run, lsock, udp_buf);
+        } else {
+            sys_msleep(IPERF_POLL_MS);
+        }
+
+        now = iperf_port_now_us();
+        if (!run->started) {
+            if (run->stop) {
+                return;
+            }
+            continue;
+        }
+        if (now - run->t_report >= interval) {
+            iperf_report_interval(run, now, 0);
+        }
+
+        if (run->cfg.role == IPERF_ROLE_CLIENT) {
+            finished = (run->stop || now >= run->t_end) && iperf_threads(run) == 0 &&
+                (!run->cfg.bidir || iperf_rx_idle(run, now) ||
+                 now - run->t_end > (uint64_t)IPERF_UDP_IDLE_MS * 1000);
+        } else {
+            if (run->reverse_pending && !(run->reverse.flags & IPERF_RUN_NOW)) {
+                /* tradeoff test: reverse once the forward streams are done */
+                if (iperf_threads(run) == 0 && iperf_rx_idle(run, now)) {
+                    iperf_start_reverse(run);
+                }
+            } else if (run->reverse_pending) {
+                iperf_start_reverse(run);
+            }
+            finished = run->stop || (!run->reverse_pending && iperf_threads(run) == 0 &&
+                    iperf_rx_idle(run, now));
+        }
+        if (!finished) {
+            continue;
+        }
+
+        iperf_report_summary(run, now);
+        if (run->cfg.role == IPERF_ROLE_CLIENT || run->cfg.once || run->stop) {
+            return;
+        }
+        iperf_run_reset(run);
+    }
+}
+
+int iperf_bench_run(const iperf_cfg_t *cfg)
+{
+    iperf_run_t *run;
+    uint8_t *udp_buf = NULL;
+    int lsock = -1, ret = 0;
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    if (cfg->parallel < 1 || cfg->parallel > IPERF_STREAMS_MAX || cfg->interval_ms == 0 ||
+            (cfg->role == IPERF_ROLE_CLIENT && cfg->host == 0)) {
+        return -EINVAL;
+    }
+    run = iperf_port_malloc(sizeof(*run) + IPERF_LINE_SIZE);
+    if (run == NULL) {
+        return -ENOMEM;
+    }
+    memset(run, 0, sizeof(*run));
+    run->line = (char *)(run + 1);
+    run->cfg = *cfg;
+    if (run->cfg.len == 0) {
+        run->cfg.len = cfg->proto == IPERF_PROTO_TCP ? IPERF_LEN_TCP_DEFAULT : IPERF_LEN_UDP_DEFAULT;
+    }
+
+    SYS_ARCH_PROTECT(lev);
+    if (iperf_run_active) {
+        ret = -EBUSY;
+    } else {
+        iperf_run_active = run;
+    }
+    SYS_ARCH_UNPROTECT(lev);
+    if (ret) {
+        iperf_port_free(run);
+        return ret;
+    }
+
+    iperf_run_reset(run);
+    if (cfg->proto == IPERF_PROTO_UDP) {
+        udp_buf = iperf_port_malloc(IPERF_UDP_RX_LEN);
+        if (udp_buf == NULL) {
+            ret = -ENOMEM;
+            goto exit;
+        }
+    }
+    if (cfg->role == IPERF_ROLE_SERVER || cfg->bidir) {
+        /* the reverse test connects to our port, listen before asking for it */
+        lsock = iperf_listen(&run->cfg);
+        if (lsock < 0) {
+            ret = -EADDRINUSE;
+            goto exit;
+        }
+    }
+
+    iperf_report_start(run);
+    if (cfg->role == IPERF_ROLE_CLIENT) {
+        iperf_start_tx(run, cfg->parallel, cfg->host, cfg->port, run->cfg.len, cfg->rate_kbps,
+                cfg->duration_ms, cfg->bidir);
+        /* the clock starts once the streams are connected */
+        run->started = 1;
+        run->t_start = iperf_port_now_us();
+        run->t_report = run->t_start;
+        run->t_end = cfg->duration_ms ? run->t_start + (uint64_t)cfg->duration_ms * 1000 : UINT64_MAX;
+    }
+    iperf_control(run, lsock, udp_buf);
+
+    /* stop leftovers and wait for every stream thread */
+    run->stop = 1;
+    while (iperf_threads(run)) {
+        sys_msleep(IPERF_POLL_MS);
+    }
+
+exit:
+    if (lsock >= 0) {
+        lwip_close(lsock);
+    }
+    if (udp_buf) {
+        iperf_port_free(udp_buf);
+    }
+    SYS_ARCH_PROTECT(lev);
+    iperf_run_active = NULL;
+    SYS_ARCH_UNPROTECT(lev);
+    iperf_port_free(run);
+    return ret;
+}
+
+void iperf_bench_stop(void)
+{
+    iperf_run_t *run;
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    SYS_ARCH_PROTECT(lev);
+    run = iperf_run_active;
+    if (run) {
+        run->stop = 1;
+    }
+    SYS_ARCH_UNPROTECT(lev);
+}
+
+int iperf_bench_running(void)
+{
+    return iperf_run_active != NULL;
+}
+
+static int iperf_arg_u32(const char *arg, uint32_t *val, uint32_t unit_k, uint32_t unit_m)
+{
+    char *end;
+    unsigned long v;
+
+    if (arg == NULL) {
+        return -1;
+    }
+    v = strtoul(arg, &end, 10);
+    if (end == arg) {
+        return -1;
+    }
+    if (*end == 'k' || *end == 'K') {
+        v *= unit_k;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        v *= unit_m;
+        end++;
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *val = v;
+    return 0;
+}
+
+int iperf_bench_parse(iperf_cfg_t *cfg, int argc, char **argv)
+{
+    ip4_addr_t host;
+    uint32_t v;
+    int i, rate = 0;
+
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->role = IPERF_ROLE_SERVER;
+    cfg->parallel = 1;
+    cfg->port = IPERF_PORT;
+    cfg->duration_ms = 10000;
+    cfg->interval_ms = 1000;
+
+    for (i = 1; i < argc; i++) {
+        const char *opt = argv[i];
+        const char *arg = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0') {
+            return -EINVAL;
+        }
+        switch (opt[1]) {
+        case 's':
+            cfg->role = IPERF_ROLE_SERVER;
+            continue;
+        case 'u':
+            cfg->proto = IPERF_PROTO_UDP;
+            continue;
+        case 'd':
+            cfg->bidir = 1;
+            continue;
+        case '1':
+            cfg->once = 1;
+            continue;
+        case 'c':
+            if (arg == NULL || !ip4addr_aton(arg, &host)) {
+                return -EINVAL;
+            }
+            cfg->role = IPERF_ROLE_CLIENT;
+            cfg->host = ip4_addr_get_u32(&host);
+            break;
+        case 'b':
+            /* kbit/s, k and M suffixes as iperf */
+            if (iperf_arg_u32(arg, &v, 1, 1000)) {
+                return -EINVAL;
+            }
+            cfg->rate_kbps = v;
+            rate = 1;
+            break;
+        case 't':
+            if (iperf_arg_u32(arg, &v, 1, 1) || v > 0xFFFFFFFFu / 1000) {
+                return -EINVAL;
+            }
+            cfg->duration_ms = v * 1000;
+            break;
+        case 'i':
+            if (iperf_arg_u32(arg, &v, 1, 1) || v == 0 || v > 3600) {
+                return -EINVAL;
+            }
+            cfg->interval_ms = v * 1000;
+            break;
+        case 'P':
+            if (iperf_arg_u32(arg, &v, 1, 1) || v < 1 || v > IPERF_STREAMS_MAX) {
+                return -EINVAL;
+            }
+            cfg->parallel = v;
+            break;
+        case 'l':
+            if (iperf_arg_u32(arg, &v, 1024, 1024 * 1024) || v > 0xFFFF) {
+                return -EINVAL;
+            }
+            cfg->len = v;
+            break;
+        case 'p':
+            if (iperf_arg_u32(arg, &v, 1, 1) || v == 0 || v > 0xFFFF) {
+                return -EINVAL;
+            }
+            cfg->port = v;
+            break;
+        default:
+            return -EINVAL;
+        }
+        i++;
+    }
+
+    if (cfg->proto == IPERF_PROTO_UDP && !rate) {
+        /* iperf2 default */
+        cfg->rate_kbps = 1000;
+    }
+    return 0;
+}
+
+void iperf_bench_usage(void)
+{
+    static const char * const usage[] = {
+        "iperf -s [-u] [-1] [-p port] [-i secs] [-l len]",
+        "iperf -c host [-u] [-P streams] [-d] [-b kbps[k|M]] [-t secs] [-i secs] [-l len] [-p port]",
+        "  -P    parallel streams per direction, 1.." IPERF_STR(IPERF_STREAMS_MAX),
+        "  -d    bidirectional, the server connects back to our -p port",
+        "  -b    UDP rate per stream, 0 sends as fast as possible (default 1M)",
+        "  -t    duration, 0 runs until stopped (default 10)",
+        "  -1    server: exit after the first client",
+    };
+    unsigned int i;
+
+    for (i = 0; i < sizeof(usage) / sizeof(usage[0]); i++) {
+        iperf_port_output(usage[i]);
+    }
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __IPERF_BENCH_H__
+#define __IPERF_BENCH_H__
+
+/*
+ * Multi-stream iperf2 compatible benchmark.
+ *
+ * The engine (iperf_bench.c) only uses lwIP sockets and sys_arch, so the
+ * same code runs on the device (iperf.c, "iperf" command) and as a Linux
+ * binary on lwIP's unix port (host/). Results go out as one JSON line per
+ * interval plus a start and a summary line.
+ *
+ * Wire format follows iperf 2.0: UDP datagrams start with UDP_datagram,
+ * the first TCP write / every UDP datagram carries client_hdr so that a
+ * server started with -d/-r style dual tests connects back, and UDP
+ * clients end with a negative id answered by a server_hdr report.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define IPERF_PORT                  5001
+#define IPERF_STREAMS_MAX           8
+#define IPERF_LEN_TCP_DEFAULT       (4 * 1300)
+#define IPERF_LEN_UDP_DEFAULT       (1 * 1300)
+
+/* log2 buckets, bucket 0 is below (1 << IPERF_JITTER_HIST_SHIFT) us */
+#define IPERF_JITTER_HIST_SHIFT     6
+#define IPERF_JITTER_HIST_CNT       12
+/* loss bursts of 1, 2, 3-4, 5-8, ... datagrams */
+#define IPERF_LOSS_HIST_CNT         8
+
+typedef struct UDP_datagram {
+    uint32_t id;
+    uint32_t tv_sec;
+    uint32_t tv_usec;
+} UDP_datagram;
+
+/*
+ * The server_hdr structure facilitates the server
+ * report of jitter and loss on the client side.
+ * It piggy_backs on the existing clear to close
+ * packet.
+ */
+typedef struct server_hdr_v1 {
+    /*
+     * flags is a bitmap for different options
+     * the most significant bits are for determining
+     * which information is available. So 1.7 uses
+     * 0x80000000 and the next time information is added
+     * the 1.7 bit will be set and 0x40000000 will be
+     * set signifying additional information. If no
+     * information bits are set then the header is ignored.
+     */
+    int32_t flags;
+    int32_t total_len1;
+    int32_t total_len2;
+    int32_t stop_sec;
+    int32_t stop_usec;
+    int32_t error_cnt;
+    int32_t outorder_cnt;
+    int32_t datagrams;
+    int32_t jitter1;
+    int32_t jitter2;
+} server_hdr;
+
+/* Sent by the client so the server can start the reverse test */
+typedef struct client_hdr_v1 {
+    int32_t flags;
+    int32_t numThreads;
+    int32_t mPort;
+    int32_t bufferlen;
+    int32_t mWinBand;
+    int32_t mAmount;
+} client_hdr;
+
+#define IPERF_HEADER_VERSION1       0x80000000u
+#define IPERF_RUN_NOW               0x00000001u
+
+typedef enum {
+    IPERF_ROLE_CLIENT = 0,
+    IPERF_ROLE_SERVER,
+} iperf_role_t;
+
+typedef enum {
+    IPERF_PROTO_TCP = 0,
+    IPERF_PROTO_UDP,
+} iperf_proto_t;
+
+typedef struct iperf_cfg {
+    uint8_t  role;              /* iperf_role_t */
+    uint8_t  proto;             /* iperf_proto_t */
+    uint8_t  parallel;          /* streams per direction, 1..IPERF_STREAMS_MAX */
+    uint8_t  bidir;             /* client: ask the server to send back at the same time */
+    uint8_t  once;              /* server: return after the first run */
+    uint32_t host;              /* client: server address, network order */
+    uint16_t port;              /* server port, and local port for the reverse test */
+    uint16_t len;               /* bytes per write / datagram, 0 for the default */
+    uint32_t rate_kbps;         /* UDP: per stream target rate, 0 sends as fast as possible */
+    uint32_t duration_ms;       /* client: 0 runs until iperf_bench_stop() */
+    uint32_t interval_ms;       /* report period */
+} iperf_cfg_t;
+
+/* System view sampled every interval by the port */
+typedef struct iperf_sys {
+    int32_t  idle_permille;     /* CPU idle over the interval, -1 when not available */
+    uint32_t heap_free;
+    uint32_t heap_min;          /* low-water mark since iperf_port_sys_begin() */
+} iperf_sys_t;
+
+/*
+ * Run one benchmark in the calling thread. Returns 0, or a negative errno
+ * when the run could not be set up. Only one run can be active at a time.
+ */
+int iperf_bench_run(const iperf_cfg_t *cfg);
+
+/* Ask the active run to finish, it prints its summary and returns */
+void iperf_bench_stop(void);
+
+/* 1 while iperf_bench_run() is active */
+int iperf_bench_running(void);
+
+/*
+ * Fill cfg from iperf style arguments, argv[0] is skipped.
+ * Returns 0 or -EINVAL, iperf_bench_usage() prints the options.
+ */
+int iperf_bench_parse(iperf_cfg_t *cfg, int argc, char **argv);
+void iperf_bench_usage(void);
+
+/*
+ * Port layer, provided by iperf.c on the device and by host/ on Linux.
+ */
+uint64_t iperf_port_now_us(void);
+void iperf_port_sys_begin(void);
+void iperf_port_sys_sample(iperf_sys_t *sys);
+void *iperf_port_malloc(size_t size);
+void iperf_port_free(void *ptr);
+/* Start fn(arg) in its own thread, fn returns when done. 0 on success */
+int iperf_port_thread_new(const char *name, void (*fn)(void *arg), void *arg);
+/* Emit one complete output line, without the line terminator */
+void iperf_port_output(const char *line);
+
+#endif
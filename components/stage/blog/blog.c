@@ -352,6 +352,10 @@ void blog_hexdump_out(const char *name, uint8_t width, const uint8_t *buf, uint1
 void blog_init(void)
 {
     blog_set_poweron_softlevel();
+#if (BLOG_DEFERRED == 1)
+    extern void blog_deferred_init(void);
+    blog_deferred_init();
+#endif
 }
 
 static const struct cli_command cmds_user[] STATIC_CLI_CMD_ATTRIBUTE = {
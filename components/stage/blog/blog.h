@@ -46,6 +46,56 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
+#if (BLOG_DEFERRED == 1)
+/*
+ * Deferred mode: the call site only stores the address of its format record
+ * and the raw arguments, see blog_deferred.c.  The record lives in .blog_fmt,
+ * which the linker scripts keep out of the loaded image, and holds the
+ * argument types followed by "N\x1fFILE\x1fLINE\x1fFORMAT".
+ */
+#define ATTR_BLOG_FMT                __attribute__((used, section(".blog_fmt")))
+
+#define _BLOG_STR_(x)                #x
+#define _BLOG_STR(x)                 _BLOG_STR_(x)
+#define _BLOG_CAT_(a, b)             a##b
+#define _BLOG_CAT(a, b)              _BLOG_CAT_(a, b)
+
+/* 4 bits per argument, sizes are the ones va_arg sees after promotion,
+ * any char pointer (uint8_t * included) is copied as a string
+ */
+#define _BLOG_TAG(x)                 _Generic((x),\
+                                         char *: BLOG_ARG_STR, const char *: BLOG_ARG_STR,\
+                                         signed char *: BLOG_ARG_STR, const signed char *: BLOG_ARG_STR,\
+                                         unsigned char *: BLOG_ARG_STR, const unsigned char *: BLOG_ARG_STR,\
+                                         float: BLOG_ARG_DOUBLE, double: BLOG_ARG_DOUBLE,\
+                                         default: (sizeof((x) + 0) > 4 ? BLOG_ARG_INT64 : BLOG_ARG_INT32))
+#define _BLOG_T0()                   0
+#define _BLOG_T1(a)                  ((uint64_t)_BLOG_TAG(a))
+#define _BLOG_T2(a, ...)             (_BLOG_T1(a) | (_BLOG_T1(__VA_ARGS__) << 4))
+#define _BLOG_T3(a, ...)             (_BLOG_T1(a) | (_BLOG_T2(__VA_ARGS__) << 4))
+#define _BLOG_T4(a, ...)             (_BLOG_T1(a) | (_BLOG_T3(__VA_ARGS__) << 4))
+#define _BLOG_T5(a, ...)             (_BLOG_T1(a) | (_BLOG_T4(__VA_ARGS__) << 4))
+#define _BLOG_T6(a, ...)             (_BLOG_T1(a) | (_BLOG_T5(__VA_ARGS__) << 4))
+#define _BLOG_T7(a, ...)             (_BLOG_T1(a) | (_BLOG_T6(__VA_ARGS__) << 4))
+#define _BLOG_T8(a, ...)             (_BLOG_T1(a) | (_BLOG_T7(__VA_ARGS__) << 4))
+#define _BLOG_T9(a, ...)             (_BLOG_T1(a) | (_BLOG_T8(__VA_ARGS__) << 4))
+#define _BLOG_T10(a, ...)            (_BLOG_T1(a) | (_BLOG_T9(__VA_ARGS__) << 4))
+#define _BLOG_T11(a, ...)            (_BLOG_T1(a) | (_BLOG_T10(__VA_ARGS__) << 4))
+#define _BLOG_T12(a, ...)            (_BLOG_T1(a) | (_BLOG_T11(__VA_ARGS__) << 4))
+#define _BLOG_NARG_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, N, ...) N
+#define _BLOG_NARG(...)              _BLOG_NARG_(0 __VA_OPT__(,) __VA_ARGS__, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define _BLOG_TYPES(...)             _BLOG_CAT(_BLOG_T, _BLOG_NARG(__VA_ARGS__))(__VA_ARGS__)
+
+#define _BLOG_RECORD(N, M)           N "\x1f" __FILENAME__ "\x1f" _BLOG_STR(__LINE__) "\x1f" M
+#define custom_deferred_log(N, M, ...) do {\
+    static const struct {\
+        uint64_t types;\
+        char fmt[sizeof(_BLOG_RECORD(N, M))];\
+    } _blog_fmt ATTR_BLOG_FMT = { _BLOG_TYPES(__VA_ARGS__), _BLOG_RECORD(N, M) };\
+    __blog_deferred(&_blog_fmt, _BLOG_TYPES(__VA_ARGS__) __VA_OPT__(,) __VA_ARGS__);\
+} while(0==1)
+#endif
+
 #if (CFG_COMPONENT_BLOG_ENABLE == 1)
 #define ATTR_BLOG_CODE1(name)        __attribute__((used, section(".static_blogcomponent_code." #name)))
 #define ATTR_BLOG_CODE2(name)        __attribute__((used, section(".static_blogfile_code." #name)))
@@ -97,6 +147,24 @@ DECLARE_F_INFO(__COMPONENT_FILE_NAME_DEQUOTED__, __COMPONENT_FILE_NAMED__);
 #define BLOG_DECLARE(name)           DECLARE_P_LEVEL(name);\
                                      DECLARE_P_INFO(name, __COMPONENT_FILE_NAMED__);
 
+#if (BLOG_DEFERRED == 1)
+#define custom_cflog(lowlevel, N, M, ...) do {\
+    if ( (lowlevel >= REFC_LEVEL(__COMPONENT_NAME_DEQUOTED__)) && \
+         (lowlevel >= REFF_LEVEL(__COMPONENT_FILE_NAME_DEQUOTED__))\
+       ) {\
+            custom_deferred_log(N, M, ##__VA_ARGS__);\
+    }\
+} while(0==1)
+
+#define custom_plog(priname, lowlevel, N, M, ...) do {\
+    if ( (lowlevel >= REFC_LEVEL(__COMPONENT_NAME_DEQUOTED__)) && \
+         (lowlevel >= REFF_LEVEL(__COMPONENT_FILE_NAME_DEQUOTED__)) && \
+         (lowlevel >= REFP_LEVEL(priname)) \
+       ) {\
+            custom_deferred_log(N, M, ##__VA_ARGS__);\
+    }\
+} while(0==1)
+#else
 #define custom_cflog(lowlevel, N, M, ...) do {\
     if ( (lowlevel >= REFC_LEVEL(__COMPONENT_NAME_DEQUOTED__)) && \
          (lowlevel >= REFF_LEVEL(__COMPONENT_FILE_NAME_DEQUOTED__))\
@@ -119,6 +187,7 @@ DECLARE_F_INFO(__COMPONENT_FILE_NAME_DEQUOTED__, __COMPONENT_FILE_NAMED__);
             ##__VA_ARGS__);\
     }\
 } while(0==1)
+#endif
 
 #define custom_hexdumplog(name, lowlevel, logo, buf, size) do {\
     if ( (lowlevel >= REFC_LEVEL(__COMPONENT_NAME_DEQUOTED__)) && \
@@ -199,6 +268,12 @@ DECLARE_F_INFO(__COMPONENT_FILE_NAME_DEQUOTED__, __COMPONENT_FILE_NAMED__);
 
 void blog_init(void);
 
+#if (BLOG_DEFERRED == 1)
+void __blog_deferred(const void *fmt, uint64_t types, ...);
+/* format everything still queued, for use before a reset */
+void blog_deferred_flush(void);
+#endif
+
 void blog_hexdump_out(const char *name, uint8_t width, uint8_t *buf, uint16_t size);
 
 #ifdef __cplusplus
@@ -41,4 +41,14 @@
 
 #define __blog_printf                       bl_printk
 
+/* deferred binary logging, enable with CONFIG_BLOG_DEFERRED:=1 */
+#ifndef BLOG_DEFERRED
+#define BLOG_DEFERRED                       (0)
+#endif
+#define BLOG_DEFERRED_BUF_SIZE              (4096) /* power of 2 */
+#define BLOG_DEFERRED_STR_MAX               (32)
+#define BLOG_DEFERRED_TASK_PRIORITY         (1)
+#define BLOG_DEFERRED_TASK_STACK            (512)
+#define BLOG_DEFERRED_DRAIN_MS              (20)
+
 #endif
@@ -0,0 +1,369 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Deferred binary logging.
+ *
+ * With BLOG_DEFERRED the blog_* macros no longer format at the call site.
+ * Each call stores a record of the address of its format record in .blog_fmt,
+ * the tick and the raw arguments in a ring, and returns.  A low priority task
+ * prints the records as "#blog#<hex>" lines, and tools/blog/blog_decode.py
+ * turns them back into the usual text using the .blog_fmt section of the ELF.
+ *
+ * Ring layout, in 32 bit words, with free running head and tail:
+ *   header   length in words | BLOG_REC_COMMIT [| BLOG_REC_PAD]
+ *   fmt      address of the call site's format record
+ *   tick     xTaskGetTickCount() at the call
+ *   args     int32: 1 word, int64/double: 2 words,
+ *            string: length word followed by the bytes, padded to a word
+ *
+ * The core has no atomic instructions, so a record is reserved with
+ * interrupts masked for the few instructions it takes to move the head.  The
+ * arguments are copied afterwards and the header is stored last, which is
+ * what makes the record visible to the drain task.  A record that does not
+ * fit is dropped and counted rather than waited for.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cli.h>
+
+#include "blog.h"
+#include <semphr.h>
+
+#define BLOG_RING_WORDS             (BLOG_DEFERRED_BUF_SIZE / 4)
+#define BLOG_REC_COMMIT             (1UL << 31)
+#define BLOG_REC_PAD                (1UL << 30)
+#define BLOG_REC_LEN_MASK           (0xffffUL)
+#define BLOG_REC_HEAD_WORDS         (3)
+#define BLOG_REC_MAX_ARGS           (12)
+#define BLOG_REC_MAX_WORDS          (BLOG_REC_HEAD_WORDS + BLOG_REC_MAX_ARGS * (1 + (BLOG_DEFERRED_STR_MAX + 3) / 4))
+
+#if (BLOG_RING_WORDS & (BLOG_RING_WORDS - 1))
+#error "BLOG_DEFERRED_BUF_SIZE must be a power of 2"
+#endif
+
+#if (BLOG_REC_MAX_WORDS * 2 > BLOG_RING_WORDS)
+#error "BLOG_DEFERRED_BUF_SIZE is too small for BLOG_DEFERRED_STR_MAX"
+#endif
+
+static uint32_t blog_ring[BLOG_RING_WORDS];
+static volatile uint32_t blog_ring_head;
+static volatile uint32_t blog_ring_tail;
+static volatile uint32_t blog_ring_dropped;
+static uint32_t blog_ring_dropped_reported;
+
+/* one drain at a time, the blog task and blog_deferred_flush() share the tail
+ * and blog_line */
+static SemaphoreHandle_t blog_drain_mutex;
+
+/* "#blog#" + two hex digits per byte of everything after the header + "\r\n" */
+static char blog_line[6 + (BLOG_REC_MAX_WORDS - 1) * 8 + 3];
+
+static inline uint32_t blog_ring_lock(void)
+{
+    uint32_t mstatus;
+
+    __asm volatile ("csrrci %0, mstatus, 8" : "=r"(mstatus) :: "memory");
+    return mstatus;
+}
+
+static inline void blog_ring_unlock(uint32_t mstatus)
+{
+    __asm volatile ("csrs mstatus, %0" :: "r"(mstatus & 8) : "memory");
+}
+
+static uint32_t *blog_ring_reserve(uint32_t words)
+{
+    uint32_t mstatus;
+    uint32_t head, off, pad;
+    uint32_t *rec = NULL;
+
+    mstatus = blog_ring_lock();
+
+    head = blog_ring_head;
+    off = head & (BLOG_RING_WORDS - 1);
+    /* records never wrap, the end of the ring is skipped with a pad record */
+    pad = (off + words > BLOG_RING_WORDS) ? (BLOG_RING_WORDS - off) : 0;
+
+    if (head + pad + words - blog_ring_tail > BLOG_RING_WORDS) {
+        blog_ring_dropped++;
+    } else {
+        if (pad) {
+            blog_ring[off] = BLOG_REC_COMMIT | BLOG_REC_PAD | pad;
+        }
+        blog_ring_head = head + pad + words;
+        rec = &blog_ring[(head + pad) & (BLOG_RING_WORDS - 1)];
+    }
+
+    blog_ring_unlock(mstatus);
+
+    return rec;
+}
+
+static const char *blog_arg_str(const char *s, uint32_t *len)
+{
+    if (NULL == s) {
+        s = "(null)";
+    }
+    *len = strnlen(s, BLOG_DEFERRED_STR_MAX);
+
+    return s;
+}
+
+void __blog_deferred(const void *fmt, uint64_t types, ...)
+{
+    va_list args, copy;
+    uint64_t t;
+    uint64_t v64;
+    uint32_t words = BLOG_REC_HEAD_WORDS;
+    uint32_t len;
+    uint32_t *rec, *p;
+    const char *s;
+
+    va_start(args, types);
+
+    /* first pass only sizes the record */
+    va_copy(copy, args);
+    for (t = types; t; t >>= 4) {
+        switch (t & 0xf) {
+            case BLOG_ARG_INT32:
+                (void)va_arg(copy, uint32_t);
+                words += 1;
+                break;
+            case BLOG_ARG_INT64:
+                (void)va_arg(copy, uint64_t);
+                words += 2;
+                break;
+            case BLOG_ARG_DOUBLE:
+                (void)va_arg(copy, double);
+                words += 2;
+                break;
+            case BLOG_ARG_STR:
+                blog_arg_str(va_arg(copy, const char *), &len);
+                words += 1 + (len + 3) / 4;
+                break;
+            default:
+                break;
+        }
+    }
+    va_end(copy);
+
+    rec = blog_ring_reserve(words);
+    if (NULL == rec) {
+        va_end(args);
+        return;
+    }
+
+    rec[1] = (uint32_t)fmt;
+    rec[2] = (xPortIsInsideInterrupt()) ? (xTaskGetTickCountFromISR()) : (xTaskGetTickCount());
+    p = &rec[BLOG_REC_HEAD_WORDS];
+
+    for (t = types; t; t >>= 4) {
+        switch (t & 0xf) {
+            case BLOG_ARG_INT32:
+                *p++ = va_arg(args, uint32_t);
+                break;
+            case BLOG_ARG_INT64:
+                v64 = va_arg(args, uint64_t);
+                memcpy(p, &v64, sizeof(v64));
+                p += 2;
+                break;
+            case BLOG_ARG_DOUBLE:
+                {
+                    double d = va_arg(args, double);
+                    memcpy(p, &d, sizeof(d));
+                    p += 2;
+                }
+                break;
+            case BLOG_ARG_STR:
+                s = blog_arg_str(va_arg(args, const char *), &len);
+                *p++ = len;
+                memcpy(p, s, len);
+                p += (len + 3) / 4;
+                break;
+            default:
+                break;
+        }
+    }
+    va_end(args);
+
+    /* publish: the drain task stops at the first header without the bit */
+    __asm volatile ("" ::: "memory");
+    rec[0] = BLOG_REC_COMMIT | words;
+}
+
+static void blog_deferred_emit(const uint32_t *rec, uint32_t words)
+{
+    static const char hex[] = "0123456789abcdef";
+    const uint8_t *b = (const uint8_t *)&rec[1];
+    uint32_t i, n = 0;
+
+    memcpy(blog_line, "#blog#", 6);
+    n = 6;
+    for (i = 0; i < (words - 1) * 4; i++) {
+        blog_line[n++] = hex[b[i] >> 4];
+        blog_line[n++] = hex[b[i] & 0xf];
+    }
+    blog_line[n++] = '\r';
+    blog_line[n++] = '\n';
+    blog_line[n] = '\0';
+
+    __blog_printf("%s", blog_line);
+}
+
+/* returns the number of records printed */
+static int blog_deferred_drain(void)
+{
+    uint32_t tail = blog_ring_tail;
+    uint32_t hdr, words, dropped;
+    uint32_t *rec;
+    int count = 0;
+
+    while (tail != blog_ring_head) {
+        rec = &blog_ring[tail & (BLOG_RING_WORDS - 1)];
+        hdr = rec[0];
+        if (0 == (hdr & BLOG_REC_COMMIT)) {
+            /* reserved, the writer has not finished yet */
+            break;
+        }
+        words = hdr & BLOG_REC_LEN_MASK;
+        if (0 == (hdr & BLOG_REC_PAD)) {
+            blog_deferred_emit(rec, words);
+            count++;
+        }
+        /* a stale header bit left in the ring would publish a record early */
+        memset(rec, 0, words * 4);
+        tail += words;
+        blog_ring_tail = tail;
+    }
+
+    dropped = blog_ring_dropped;
+    if (dropped != blog_ring_dropped_reported) {
+        __blog_printf("[blog] %u records dropped\r\n", (unsigned int)(dropped - blog_ring_dropped_reported));
+        blog_ring_dropped_reported = dropped;
+    }
+
+    return count;
+}
+
+void blog_deferred_flush(void)
+{
+    bool locked;
+
+    /* before a reset the scheduler may be stopped, then nothing else drains */
+    locked = (NULL != blog_drain_mutex) && (!xPortIsInsideInterrupt()) &&
+            (taskSCHEDULER_RUNNING == xTaskGetSchedulerState());
+    if (locked) {
+        xSemaphoreTake(blog_drain_mutex, portMAX_DELAY);
+    }
+
+    while (blog_deferred_drain()) {
+    }
+
+    if (locked) {
+        xSemaphoreGive(blog_drain_mutex);
+    }
+}
+
+static void blog_deferred_task([[gnu::unused]] void *arg)
+{
+    int count;
+
+    while (1) {
+        xSemaphoreTake(blog_drain_mutex, portMAX_DELAY);
+        count = blog_deferred_drain();
+        xSemaphoreGive(blog_drain_mutex);
+
+        if (0 == count) {
+            vTaskDelay(pdMS_TO_TICKS(BLOG_DEFERRED_DRAIN_MS));
+        }
+    }
+}
+
+void blog_deferred_init(void)
+{
+    static StackType_t blog_stack[BLOG_DEFERRED_TASK_STACK];
+    static StaticTask_t blog_task;
+    static StaticSemaphore_t blog_drain_mutex_buf;
+
+    blog_drain_mutex = xSemaphoreCreateMutexStatic(&blog_drain_mutex_buf);
+
+    xTaskCreateStatic(blog_deferred_task, (char*)"blog", BLOG_DEFERRED_TASK_STACK, NULL,
+            BLOG_DEFERRED_TASK_PRIORITY, blog_stack, &blog_task);
+}
+
+static inline uint32_t blog_cycles(void)
+{
+    uint32_t cycles;
+
+    __asm volatile ("csrr %0, mcycle" : "=r"(cycles));
+    return cycles;
+}
+
+static void cmd_blog_bench([[gnu::unused]] char *buf, [[gnu::unused]] int len, int argc, char **argv)
+{
+    uint32_t start, immediate = 0, deferred = 0;
+    int i, count = 64;
+
+    if (argc > 1) {
+        count = atoi(argv[1]);
+    }
+    if (count <= 0) {
+        count = 64;
+    }
+
+    for (i = 0; i < count; i++) {
+        start = blog_cycles();
+        __blog_printf("[%10u][%s: %s:%4d] bench %d %s 0x%08x\r\n", xTaskGetTickCount(),
+                "[BENCH]", __FILENAME__, __LINE__, i, "str", (unsigned int)start);
+        immediate += blog_cycles() - start;
+    }
+
+    /* keep the ring from filling up so no call takes the drop path */
+    for (i = 0; i < count; i++) {
+        if (0 == (i & 15)) {
+            blog_deferred_flush();
+        }
+        start = blog_cycles();
+        custom_deferred_log("[BENCH]", "bench %d %s 0x%08x\r\n", i, "str", (unsigned int)start);
+        deferred += blog_cycles() - start;
+    }
+    blog_deferred_flush();
+
+    printf("blog bench, %d calls, cycles per call: immediate %u, deferred %u\r\n",
+            count, (unsigned int)(immediate / count), (unsigned int)(deferred / count));
+}
+
+static const struct cli_command cmds_user[] STATIC_CLI_CMD_ATTRIBUTE = {
+    { "blogbench", "blog cycles per call, immediate vs deferred", cmd_blog_bench},
+};
@@ -45,4 +45,13 @@ typedef struct _blog_info {
     char *name;
 } blog_info_t;
 
+/* argument kinds recorded per call site in deferred mode */
+typedef enum _blog_arg {
+    BLOG_ARG_NONE = 0,
+    BLOG_ARG_INT32,
+    BLOG_ARG_INT64,
+    BLOG_ARG_DOUBLE,
+    BLOG_ARG_STR,
+} blog_arg_t;
+
 #endif
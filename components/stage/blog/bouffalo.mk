@@ -9,6 +9,10 @@ COMPONENT_PRIV_INCLUDEDIRS :=
 ## This component's src
 COMPONENT_SRCS := ./blog.c
 
+ifeq ($(CONFIG_BLOG_DEFERRED),1)
+COMPONENT_SRCS += ./blog_deferred.c
+endif
+
 COMPONENT_OBJS := $(patsubst %.c,%.o, $(COMPONENT_SRCS))
 
 COMPONENT_SRCDIRS := ./
@@ -7,7 +7,7 @@ COMPONENT_ADD_INCLUDEDIRS += cli/include
 COMPONENT_PRIV_INCLUDEDIRS :=
 
 ## This component's src
-COMPONENT_SRCS := cli/cli.c
+COMPONENT_SRCS := cli/cli.c cli/cli_parse.c
 
 COMPONENT_OBJS := $(patsubst %.c,%.o, $(COMPONENT_SRCS))
 
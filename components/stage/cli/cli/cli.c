@@ -48,6 +48,7 @@
 #include <utils_hexdump.h>
 
 #include "cli_internal.h"
+#include "cli_parse.h"
 
 
 #define RET_CHAR '\n'
@@ -69,6 +70,8 @@ char              esc_tag[64] = { 0 };
 static uint8_t    esc_tag_len = 0;
 static aos_task_t cli_task;
 static int fd_console;
+static struct cli_index cli_index;
+static struct cli_line cli_console_line;
 
 extern void log_cli_init(void);
 
@@ -100,8 +103,24 @@ static const struct cli_command *cli_command_get(int idx, int *is_static_cmd)
     return cli->dynamic_cmds[idx - cli->num_static_cmds];
 }
 
+static const struct cli_command *cli_index_get(int idx)
+{
+    return cli_command_get(idx, NULL);
+}
+
+static void cli_index_rebuild(void)
+{
+    int i;
+
+    cli_index_clear(&cli_index);
+    for (i = 0; i < cli->num_commands; i++) {
+        cli_index_add(&cli_index, i);
+    }
+}
+
 /* Find the command 'name' in the cli commands table.
- * If len is 0 then full match will be performed else upto len bytes.
+ * If len is 0 then full match will be performed through the hash index,
+ * else upto len bytes by scanning the table.
  * Returns: a pointer to the corresponding cli_command struct or NULL.
  */
 static const struct cli_command *lookup_command(char *name, int len)
@@ -109,6 +128,11 @@ static const struct cli_command *lookup_command(char *name, int len)
     int i = 0;
     int n = 0;
 
+    if (len == 0) {
+        i = cli_index_find(&cli_index, name);
+        return (i < 0) ? NULL : cli_command_get(i, NULL);
+    }
+
     while (i < cli->num_static_cmds + MAX_DYNAMIC_COMMANDS && n < cli->num_commands) {
         const struct cli_command *cmd = cli_command_get(i, NULL);
         if (cmd->name == NULL) {
@@ -180,9 +204,7 @@ int proc_onecmd(int argc, char *argv[])
 }
 
 
-/* Parse input line and locate arguments (if any), keeping count of the number
- * of arguments and their locations.  Look up and call the corresponding cli
- * function if one is found and pass it the argv array.
+/* Parse input line and call the cli function of each command in it.
  *
  * Returns: 0 on success: the input line contained at least a function name and
  *          that function exists and was called.
@@ -190,113 +212,17 @@ int proc_onecmd(int argc, char *argv[])
  *          input line.
  *          2 on invalid syntax: the arguments list couldn't be parsed
  */
-static int handle_input(char *inbuf)
+static int handle_input(char *inbuf, int len, struct cli_line *line)
 {
-    struct
-    {
-        unsigned inArg : 1;
-        unsigned inQuote : 1;
-        unsigned done : 1;
-    } stat;
-    static char *argvall[CLI_MAX_ONCECMD_NUM][CLI_MAX_ARG_NUM];
-    int          argcall[CLI_MAX_ONCECMD_NUM] = { 0 };
-    /*
-    static char *argv[CLI_MAX_ONCECMD_NUM][CLI_MAX_ARG_NUM];
-    int argc = 0;*/
-    int  cmdnum = 0;
-    int *pargc  = &argcall[0];
-    int  i      = 0;
-    int  ret    = 0;
-
-    memset((void *)&argvall, 0, sizeof(argvall));
-    memset((void *)&argcall, 0, sizeof(argcall));
-    memset(&stat, 0, sizeof(stat));
-
-    do {
-        switch (inbuf[i]) {
-            case '\0':
-                if (stat.inQuote) {
-                    return 2;
-                }
-                stat.done = 1;
-                break;
-
-            case '"':
-                if (i > 0 && inbuf[i - 1] == '\\' && stat.inArg) {
-                    memcpy(&inbuf[i - 1], &inbuf[i], strlen(&inbuf[i]) + 1);
-                    --i;
-                    break;
-                }
-                if (!stat.inQuote && stat.inArg) {
-                    break;
-                }
-                if (stat.inQuote && !stat.inArg) {
-                    return 2;
-                }
-
-                if (!stat.inQuote && !stat.inArg) {
-                    stat.inArg   = 1;
-                    stat.inQuote = 1;
-                    (*pargc)++;
-                    argvall[cmdnum][(*pargc) - 1] = &inbuf[i + 1];
-                } else if (stat.inQuote && stat.inArg) {
-                    stat.inArg   = 0;
-                    stat.inQuote = 0;
-                    inbuf[i]     = '\0';
-                }
-                break;
-
-            case ' ':
-                if (i > 0 && inbuf[i - 1] == '\\' && stat.inArg) {
-                    memcpy(&inbuf[i - 1], &inbuf[i], strlen(&inbuf[i]) + 1);
-                    --i;
-                    break;
-                }
-                if (!stat.inQuote && stat.inArg) {
-                    stat.inArg = 0;
-                    inbuf[i]   = '\0';
-                }
-                break;
-
-            case ';':
-                if (i > 0 && inbuf[i - 1] == '\\' && stat.inArg) {
-                    memcpy(&inbuf[i - 1], &inbuf[i], strlen(&inbuf[i]) + 1);
-                    --i;
-                    break;
-                }
-                if (stat.inQuote) {
-                    return 2;
-                }
-                if (!stat.inQuote && stat.inArg) {
-                    stat.inArg = 0;
-                    inbuf[i]   = '\0';
-
-                    if (*pargc) {
-                        if (++cmdnum < CLI_MAX_ONCECMD_NUM) {
-                            pargc = &argcall[cmdnum];
-                        }
-                    }
-                }
-
-                break;
-
-            default:
-                if (!stat.inArg) {
-                    stat.inArg = 1;
-                    (*pargc)++;
-                    argvall[cmdnum][(*pargc) - 1] = &inbuf[i];
-                }
-                break;
-        }
-    } while (!stat.done && ++i < INBUF_SIZE && cmdnum < CLI_MAX_ONCECMD_NUM &&
-             (*pargc) < CLI_MAX_ARG_NUM);
+    int i;
+    int ret = 0;
 
-    if (stat.inQuote) {
+    if (cli_parse_line(inbuf, len, line)) {
         return 2;
     }
 
-    for (i = 0; i <= cmdnum && i < CLI_MAX_ONCECMD_NUM; i++) {
-        ret |= proc_onecmd(argcall[i], argvall[i]);
+    for (i = 0; i < line->cmdnum; i++) {
+        ret |= proc_onecmd(line->argc[i], line->argv[i]);
     }
 
     return ret;
@@ -618,11 +544,197 @@ static void print_bad_command(char *cmd_string)
     }
 }
 
+/* Batch mode runs newline separated commands without echo, history or
+ * prompt and prints one "<n> <status>" line per command, so a script or a
+ * test rig can push commands as fast as they are handled and still match
+ * every result.  Input is taken as raw bytes, escape sequences and control
+ * characters have no special meaning.
+ */
+struct cli_batch {
+    char        *buf; /* line being collected, INBUF_SIZE bytes */
+    unsigned int len;
+    unsigned int count; /* commands run */
+    unsigned int failed;
+    int          overflow;
+    int          echo_disabled; /* restored when the batch ends */
+};
+
+static const char *const cli_batch_status[] = {
+    "ok", "not found", "syntax error", "line too long"
+};
+
+/* console batch mode, between "batch on" and "batch off" */
+static struct cli_batch cli_batch_console;
+static int cli_batch_running;
+
+static void cli_batch_line(struct cli_batch *batch, struct cli_line *line)
+{
+    unsigned int len      = batch->len;
+    int          overflow = batch->overflow;
+    char        *p;
+    int          ret;
+
+    /* reset first, the command may end the batch */
+    batch->len      = 0;
+    batch->overflow = 0;
+
+    batch->buf[len] = '\0';
+    for (p = batch->buf; *p == ' '; p++) {
+    }
+    /* blank lines and comments are not commands */
+    if (!overflow && (p == batch->buf + len || *p == '#')) {
+        return;
+    }
+
+    batch->count++;
+    if (overflow) {
+        ret = 3;
+    } else if (strlen(batch->buf) != len) {
+        /* a NUL would silently cut the command short */
+        ret = 2;
+    } else {
+        ret = handle_input(batch->buf, len + 1, line);
+    }
+    if (ret) {
+        batch->failed++;
+    }
+
+    aos_cli_printf("%u %s\r\n", batch->count, cli_batch_status[ret & 3]);
+}
+
+/* Returns the number of bytes consumed, less than len if the batch ended */
+static int cli_batch_feed(struct cli_batch *batch, struct cli_line *line, const char *data, int len)
+{
+    int i = 0;
+    int n;
+
+    while (i < len && batch->buf) {
+        for (n = i; n < len && data[n] != RET_CHAR && data[n] != END_CHAR; n++) {
+        }
+
+        if (batch->len + (n - i) < INBUF_SIZE) {
+            memcpy(batch->buf + batch->len, data + i, n - i);
+            batch->len += n - i;
+        } else {
+            batch->overflow = 1;
+        }
+        i = n;
+
+        if (i < len) {
+            /* "\r\n" ends a line and then an empty one, which is skipped */
+            i++;
+            cli_batch_line(batch, line);
+        }
+    }
+
+    return i;
+}
+
+static void cli_batch_begin(struct cli_batch *batch, char *buf)
+{
+    memset(batch, 0, sizeof(*batch));
+    batch->buf           = buf;
+    batch->echo_disabled = cli->echo_disabled;
+    cli->echo_disabled   = 1;
+}
+
+static int cli_batch_end(struct cli_batch *batch, struct cli_line *line)
+{
+    /* last line without a newline */
+    if (batch->len || batch->overflow) {
+        cli_batch_line(batch, line);
+    }
+    cli->echo_disabled = batch->echo_disabled;
+    batch->buf         = NULL;
+
+    aos_cli_printf("batch done, %u commands, %u failed\r\n", batch->count, batch->failed);
+
+    return batch->failed;
+}
+
+int aos_cli_batch(const char *script, int len)
+{
+    static char            buf[INBUF_SIZE];
+    static struct cli_line line;
+    struct cli_batch       batch;
+    int                    ret;
+
+    if (!cli) {
+        return -EPERM;
+    }
+    if (cli_batch_running) {
+        return -EBUSY;
+    }
+
+    cli_batch_running = 1;
+    cli_batch_begin(&batch, buf);
+    cli_batch_feed(&batch, &line, script, len);
+    /* the last line runs in cli_batch_end, buf and line are still in use */
+    ret = cli_batch_end(&batch, &line);
+    cli_batch_running = 0;
+
+    return ret;
+}
+
+int aos_cli_batch_file(const char *path)
+{
+    static char            buf[INBUF_SIZE];
+    static struct cli_line line;
+    struct cli_batch       batch;
+    romfs_filebuf_t        filebuf;
+    char                   chunk[64];
+    int                    fd;
+    int                    ret;
+
+    if (!cli) {
+        return -EPERM;
+    }
+
+    fd = aos_open(path, 0);
+    if (fd < 0) {
+        return -ENOENT;
+    }
+
+    /* romfs files are run in place */
+    memset(&filebuf, 0, sizeof(filebuf));
+    if (0 == aos_ioctl(fd, IOCTL_ROMFS_GET_FILEBUF, (long unsigned int)&filebuf) && filebuf.buf) {
+        aos_close(fd);
+        return aos_cli_batch(filebuf.buf, filebuf.bufsize);
+    }
+
+    if (cli_batch_running) {
+        aos_close(fd);
+        return -EBUSY;
+    }
+
+    cli_batch_running = 1;
+    cli_batch_begin(&batch, buf);
+    while ((ret = aos_read(fd, chunk, sizeof(chunk))) > 0) {
+        cli_batch_feed(&batch, &line, chunk, ret);
+    }
+    aos_close(fd);
+    ret = cli_batch_end(&batch, &line);
+    cli_batch_running = 0;
+
+    return ret;
+}
+
 static void cli_main_input(char *buffer, int count)
 {
     int   ret;
     char *msg = NULL;
 
+    if (cli_batch_console.buf && buffer) {
+        ret = cli_batch_feed(&cli_batch_console, &cli_console_line, buffer, count);
+        if (cli_batch_console.buf) {
+            return;
+        }
+        /* "batch off" was in this chunk, the rest is interactive again */
+        aos_cli_printf("\r\n" PROMPT);
+        buffer += ret;
+        count  -= ret;
+    }
+
     if (get_input(cli->inbuf, &cli->bp, buffer, count)) {
         msg = cli->inbuf;
 #if 0
@@ -636,7 +748,7 @@ static void cli_main_input(char *buffer, int count)
         }
 #endif
 
-        ret = handle_input(msg);
+        ret = handle_input(msg, INBUF_SIZE, &cli_console_line);
         if (ret == 1) {
             print_bad_command(msg);
         } else if (ret == 2) {
@@ -659,6 +771,9 @@ static void exit_cmd(char *buf, int len, int argc, char **argv);
 static void devname_cmd(char *buf, int len, int argc, char **argv);
 static void pmem_cmd(char *buf, int len, int argc, char **argv);
 static void mmem_cmd(char *buf, int len, int argc, char **argv);
+#if (configUSE_HEAP_TRACE == 1)
+static void heap_cmd(char *buf, int len, int argc, char **argv);
+#endif
 
 #endif
 static void reboot_cmd(char *buf, int len, int argc, char **argv);
@@ -670,6 +785,7 @@ static void ps_cmd(char *buf, int len, int argc, char **argv);
 static void ls_cmd(char *buf, int len, int argc, char **argv);
 static void hexdump_cmd(char *buf, int len, int argc, char **argv);
 static void cat_cmd(char *buf, int len, int argc, char **argv);
+static void batch_cmd(char *buf, int len, int argc, char **argv);
 
 const struct cli_command built_ins[] STATIC_CLI_CMD_ATTRIBUTE = {
     /*cli self*/
@@ -679,6 +795,9 @@ const struct cli_command built_ins[] STATIC_CLI_CMD_ATTRIBUTE = {
 
     { "p", "print memory", pmem_cmd },
     { "m", "modify memory", mmem_cmd },
+#if (configUSE_HEAP_TRACE == 1)
+    { "heap", "heap usage by task and call site", heap_cmd },
+#endif
     { "echo", "echo for command", echo_cmd },
     { "exit", "close CLI", exit_cmd },
     { "devname", "print device name", devname_cmd },
@@ -697,6 +816,7 @@ const struct cli_command built_ins[] STATIC_CLI_CMD_ATTRIBUTE = {
     { "ls", "file list", ls_cmd },
     { "hexdump", "dump file", hexdump_cmd },
     { "cat", "cat file", cat_cmd },
+    { "batch", "run commands as a script", batch_cmd },
 };
 
 /* Built-in "help" command: prints all registered commands and their help
@@ -912,6 +1032,80 @@ static void mmem_cmd([[gnu::unused]] char *buf, [[gnu::unused]] int len, int arg
                    old_value, new_value);
 }
 
+#if (configUSE_HEAP_TRACE == 1)
+#define HEAP_CMD_MAX_TASKS  32
+#define HEAP_CMD_MAX_SITES  64
+
+static void heap_cmd([[gnu::unused]] char *buf, [[gnu::unused]] int len, int argc, char **argv)
+{
+    HeapStats_t stats;
+    HeapTraceTask_t *tasks;
+    HeapTraceSite_t *sites;
+    UBaseType_t i, num;
+    int top = 10;
+
+    if (argc > 1) {
+        top = strtol(argv[1], NULL, 0);
+        if (top <= 0 || top > HEAP_CMD_MAX_SITES) {
+            aos_cli_printf("heap [top]\r\n"
+                           "top: number of call sites to list, 1~%d (default is 10)\r\n",
+                           HEAP_CMD_MAX_SITES);
+            return;
+        }
+    }
+
+    /* Taken before the snapshot, so this command shows up under its own task */
+    tasks = pvPortMalloc(sizeof(HeapTraceTask_t) * HEAP_CMD_MAX_TASKS);
+    sites = pvPortMalloc(sizeof(HeapTraceSite_t) * top);
+    if (NULL == tasks || NULL == sites) {
+        aos_cli_printf("Error! heap alloc mem fail!\r\n");
+        vPortFree(tasks);
+        vPortFree(sites);
+        return;
+    }
+
+    vPortGetHeapStats(&stats);
+    aos_cli_printf("Heap free %u Bytes, min ever %u Bytes, largest block %u Bytes in %u free blocks\r\n",
+            (unsigned int)stats.xAvailableHeapSpaceInBytes,
+            (unsigned int)stats.xMinimumEverFreeBytesRemaining,
+            (unsigned int)stats.xSizeOfLargestFreeBlockInBytes,
+            (unsigned int)stats.xNumberOfFreeBlocks);
+
+    num = uxPortHeapTraceGetTasks(tasks, HEAP_CMD_MAX_TASKS);
+    aos_cli_printf("\r\n%-16s %8s %8s %8s %8s\r\n", "Task", "Current", "Peak", "Allocs", "Frees");
+    for (i = 0; i < num; i++) {
+        aos_cli_printf("%-16s %8u %8u %8u %8u\r\n",
+                tasks[i].pcTaskName,
+                (unsigned int)tasks[i].xCurrentBytes,
+                (unsigned int)tasks[i].xPeakBytes,
+                (unsigned int)tasks[i].xNumberOfAllocations,
+                (unsigned int)tasks[i].xNumberOfFrees);
+    }
+
+    num = uxPortHeapTraceGetSites(sites, top);
+    aos_cli_printf("\r\nTop %d call sites by live bytes\r\n", top);
+    aos_cli_printf("%-10s %8s %8s %8s\r\n", "Caller", "Current", "Peak", "Blocks");
+    for (i = 0; i < num; i++) {
+        if (sites[i].pvCaller) {
+            aos_cli_printf("0x%08x %8u %8u %8u\r\n",
+                    (unsigned int)sites[i].pvCaller,
+                    (unsigned int)sites[i].xCurrentBytes,
+                    (unsigned int)sites[i].xPeakBytes,
+                    (unsigned int)sites[i].xCurrentBlocks);
+        } else {
+            aos_cli_printf("%-10s %8u %8u %8u\r\n",
+                    "(other)",
+                    (unsigned int)sites[i].xCurrentBytes,
+                    (unsigned int)sites[i].xPeakBytes,
+                    (unsigned int)sites[i].xCurrentBlocks);
+        }
+    }
+
+    vPortFree(tasks);
+    vPortFree(sites);
+}
+#endif
+
 #endif
 
 static void reboot_cmd([[gnu::unused]] char *buf, [[gnu::unused]] int len, [[gnu::unused]] int argc, [[gnu::unused]] char **argv)
@@ -1150,6 +1344,34 @@ static void cat_cmd([[gnu::unused]] char *buf, [[gnu::unused]] int len, int argc
     printf("\r\n");
     aos_close(fd);
 }
+
+static void batch_cmd([[gnu::unused]] char *buf, [[gnu::unused]] int len, int argc, char **argv)
+{
+    int ret;
+
+    if (argc != 2) {
+        aos_cli_printf("batch on/off/<file>\r\n"
+                       "on  : run console input as a script, one status line per command\r\n"
+                       "off : back to interactive input\r\n"
+                       "file: run a script file, e.g. /romfs/test.txt\r\n");
+        return;
+    }
+
+    if (!strcmp(argv[1], "on")) {
+        if (!cli_batch_console.buf) {
+            cli_batch_begin(&cli_batch_console, cli->inbuf);
+        }
+    } else if (!strcmp(argv[1], "off")) {
+        if (cli_batch_console.buf) {
+            cli_batch_end(&cli_batch_console, &cli_console_line);
+        }
+    } else {
+        ret = aos_cli_batch_file(argv[1]);
+        if (ret < 0) {
+            aos_cli_printf("batch %s failed: %d\r\n", argv[1], ret);
+        }
+    }
+}
 /* ------------------------------------------------------------------------- */
 
 int aos_cli_register_command(const struct cli_command *cmd)
@@ -1191,6 +1413,7 @@ int aos_cli_register_command(const struct cli_command *cmd)
 #endif
 
     cli->dynamic_cmds[cli->num_commands++ - cli->num_static_cmds] = cmd;
+    cli_index_add(&cli_index, cli->num_commands - 1);
 
     return 0;
 }
@@ -1219,6 +1442,7 @@ int aos_cli_unregister_command(const struct cli_command *cmd)
                         (remaining_cmds * sizeof(struct cli_command *)));
             }
             cli->dynamic_cmds[cli->num_commands - cli->num_static_cmds] = NULL;
+            cli_index_rebuild();
             return 0;
         }
     }
@@ -1273,6 +1497,7 @@ void *aos_cli_task_get(void)
 int aos_cli_init([[gnu::unused]] int use_thread)
 {
     extern char _ld_bl_static_cli_cmds_start, _ld_bl_static_cli_cmds_end;
+    uint16_t *slots;
 #if 0
     int ret;
 #endif
@@ -1296,6 +1521,15 @@ int aos_cli_init([[gnu::unused]] int use_thread)
             (struct cli_command *)&_ld_bl_static_cli_cmds_start;
     cli->num_commands = cli->num_static_cmds;
 
+    slots = aos_malloc(cli_index_size(cli->num_static_cmds + MAX_DYNAMIC_COMMANDS));
+    if (NULL == slots) {
+        aos_free(cli);
+        cli = NULL;
+        return ENOMEM;
+    }
+    cli_index_init(&cli_index, slots, cli->num_static_cmds + MAX_DYNAMIC_COMMANDS, cli_index_get);
+    cli_index_rebuild();
+
     cli->initialized   = 1;
     cli->echo_disabled = 0;
 
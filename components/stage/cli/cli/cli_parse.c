@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <cli.h>
+
+#include "cli_parse.h"
+
+/* Parse input line and locate arguments (if any), keeping count of the number
+ * of arguments and their locations.  Escaping backslashes are dropped while
+ * scanning by writing behind the read position, so each byte is visited once.
+ */
+int cli_parse_line(char *buf, int len, struct cli_line *line)
+{
+    struct
+    {
+        unsigned inArg : 1;
+        unsigned inQuote : 1;
+        unsigned done : 1;
+    } stat;
+    int  cmdnum = 0;
+    int *pargc  = &line->argc[0];
+    int  r      = 0; /* read position */
+    int  w      = 0; /* write position, behind r after an escape */
+    int  i;
+    char c;
+
+    memset(line->argc, 0, sizeof(line->argc));
+    memset(&stat, 0, sizeof(stat));
+
+    while (r < len) {
+        c      = buf[r];
+        buf[w] = c;
+
+        if ((c == '"' || c == ' ' || c == ';') && w > 0 && buf[w - 1] == '\\' && stat.inArg) {
+            /* escaped, keep the character in place of the backslash */
+            buf[w - 1] = c;
+        } else {
+            switch (c) {
+                case '\0':
+                    if (stat.inQuote) {
+                        return 2;
+                    }
+                    stat.done = 1;
+                    break;
+
+                case '"':
+                    if (!stat.inQuote && stat.inArg) {
+                        break;
+                    }
+                    if (stat.inQuote && !stat.inArg) {
+                        return 2;
+                    }
+
+                    if (!stat.inQuote && !stat.inArg) {
+                        stat.inArg   = 1;
+                        stat.inQuote = 1;
+                        (*pargc)++;
+                        line->argv[cmdnum][(*pargc) - 1] = &buf[w + 1];
+                    } else if (stat.inQuote && stat.inArg) {
+                        stat.inArg   = 0;
+                        stat.inQuote = 0;
+                        buf[w]       = '\0';
+                    }
+                    break;
+
+                case ' ':
+                    if (!stat.inQuote && stat.inArg) {
+                        stat.inArg = 0;
+                        buf[w]     = '\0';
+                    }
+                    break;
+
+                case ';':
+                    if (stat.inQuote) {
+                        return 2;
+                    }
+                    if (!stat.inQuote && stat.inArg) {
+                        stat.inArg = 0;
+                        buf[w]     = '\0';
+
+                        if (*pargc) {
+                            if (++cmdnum < CLI_MAX_ONCECMD_NUM) {
+                                pargc = &line->argc[cmdnum];
+                            }
+                        }
+                    }
+                    break;
+
+                default:
+                    if (!stat.inArg) {
+                        stat.inArg = 1;
+                        (*pargc)++;
+                        line->argv[cmdnum][(*pargc) - 1] = &buf[w];
+                    }
+                    break;
+            }
+            w++;
+        }
+        r++;
+
+        if (stat.done || cmdnum >= CLI_MAX_ONCECMD_NUM || (*pargc) >= CLI_MAX_ARG_NUM) {
+            break;
+        }
+    }
+
+    /* Stopped early, the last argument runs to the end of the line */
+    if (!stat.done && w != r) {
+        memmove(&buf[w], &buf[r], strlen(&buf[r]) + 1);
+    }
+
+    if (stat.inQuote) {
+        return 2;
+    }
+
+    line->cmdnum = (cmdnum < CLI_MAX_ONCECMD_NUM) ? cmdnum + 1 : CLI_MAX_ONCECMD_NUM;
+    for (i = 0; i < line->cmdnum; i++) {
+        if (line->argc[i] < CLI_MAX_ARG_NUM) {
+            line->argv[i][line->argc[i]] = NULL;
+        }
+    }
+
+    return 0;
+}
+
+/* FNV-1a */
+static unsigned int cli_hash(const char *name)
+{
+    uint32_t hash = 2166136261UL;
+
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+static unsigned int cli_index_slots(unsigned int max)
+{
+    unsigned int n = 4;
+
+    /* keep the load at or below 3/4, so probes stay short and end */
+    while (n * 3 < max * 4) {
+        n <<= 1;
+    }
+
+    return n;
+}
+
+unsigned int cli_index_size(unsigned int max)
+{
+    return cli_index_slots(max) * sizeof(uint16_t);
+}
+
+void cli_index_init(struct cli_index *index, uint16_t *slots, unsigned int max,
+        const struct cli_command *(*get)(int idx))
+{
+    index->slots = slots;
+    index->mask  = cli_index_slots(max) - 1;
+    index->get   = get;
+    cli_index_clear(index);
+}
+
+void cli_index_clear(struct cli_index *index)
+{
+    memset(index->slots, 0, (index->mask + 1) * sizeof(uint16_t));
+}
+
+void cli_index_add(struct cli_index *index, int idx)
+{
+    const char *name = index->get(idx)->name;
+    unsigned int i;
+
+    if (name == NULL) {
+        return;
+    }
+
+    for (i = cli_hash(name) & index->mask; index->slots[i]; i = (i + 1) & index->mask) {
+        /* the first command of a name wins, as with a linear search */
+        if (!strcmp(index->get(index->slots[i] - 1)->name, name)) {
+            return;
+        }
+    }
+    index->slots[i] = idx + 1;
+}
+
+int cli_index_find(const struct cli_index *index, const char *name)
+{
+    unsigned int i;
+
+    for (i = cli_hash(name) & index->mask; index->slots[i]; i = (i + 1) & index->mask) {
+        if (!strcmp(index->get(index->slots[i] - 1)->name, name)) {
+            return index->slots[i] - 1;
+        }
+    }
+
+    return -1;
+}
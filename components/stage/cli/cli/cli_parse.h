@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __CLI_PARSE_H__
+#define __CLI_PARSE_H__
+
+#include <stdint.h>
+#include <cli.h>
+
+/*
+ * Line parsing and command lookup, kept free of OS calls so they can be
+ * built and exercised on a host.
+ */
+
+/* commands of one input line, separated by ';' */
+struct cli_line {
+    int   cmdnum;
+    int   argc[CLI_MAX_ONCECMD_NUM];
+    char *argv[CLI_MAX_ONCECMD_NUM][CLI_MAX_ARG_NUM];
+};
+
+/* Split buf, at most len bytes or up to the first '\0', into commands and
+ * arguments in place.
+ *
+ * Returns: 0 on success, 2 on invalid syntax (unbalanced quotes).
+ */
+int cli_parse_line(char *buf, int len, struct cli_line *line);
+
+/* Open addressed index from command name to command number, so a lookup is
+ * one hash and usually one strcmp instead of a strcmp per command.
+ */
+struct cli_index {
+    uint16_t *slots; /* command number + 1, 0 is empty */
+    unsigned int mask;
+    const struct cli_command *(*get)(int idx);
+};
+
+/* Number of bytes for the slots of an index holding up to max commands */
+unsigned int cli_index_size(unsigned int max);
+void cli_index_init(struct cli_index *index, uint16_t *slots, unsigned int max,
+        const struct cli_command *(*get)(int idx));
+/* Add command idx, unless a command of the same name is already indexed */
+void cli_index_add(struct cli_index *index, int idx);
+void cli_index_clear(struct cli_index *index);
+/* Returns the number of the command called name, or -1 */
+int cli_index_find(const struct cli_index *index, const char *name);
+
+#endif
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test for the cli line parser and command index.  cli_parse_line() is
+ * run on random lines of words, quotes, escapes and ';' and must give the
+ * same result, commands and arguments as the parser it replaced, which is
+ * kept below.  The index is filled from random command tables with
+ * duplicate and empty names and must find the same command as a linear
+ * search for every name, and nothing for names not in the table.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cli_parse.c"
+
+#define TEST_LINES          300000
+#define TEST_TABLES         2000
+#define TEST_CMDS_MAX       200
+
+static int test_failed;
+
+/* the parser before cli_parse_line, it scanned up to the first '\0'; its
+ * overlapping memcpy is a memmove here
+ */
+static int ref_parse_line(char *inbuf, struct cli_line *line)
+{
+    struct
+    {
+        unsigned inArg : 1;
+        unsigned inQuote : 1;
+        unsigned done : 1;
+    } stat;
+    int  cmdnum = 0;
+    int *pargc  = &line->argc[0];
+    int  i      = 0;
+
+    memset(line->argv, 0, sizeof(line->argv));
+    memset(line->argc, 0, sizeof(line->argc));
+    memset(&stat, 0, sizeof(stat));
+
+    do {
+        switch (inbuf[i]) {
+            case '\0':
+                if (stat.inQuote) {
+                    return 2;
+                }
+                stat.done = 1;
+                break;
+
+            case '"':
+                if (i > 0 && inbuf[i - 1] == '\\' && stat.inArg) {
+                    memmove(&inbuf[i - 1], &inbuf[i], strlen(&inbuf[i]) + 1);
+                    --i;
+                    break;
+                }
+                if (!stat.inQuote && stat.inArg) {
+                    break;
+                }
+                if (stat.inQuote && !stat.inArg) {
+                    return 2;
+                }
+
+                if (!stat.inQuote && !stat.inArg) {
+                    stat.inArg   = 1;
+                    stat.inQuote = 1;
+                    (*pargc)++;
+                    line->argv[cmdnum][(*pargc) - 1] = &inbuf[i + 1];
+                } else if (stat.inQuote && stat.inArg) {
+                    stat.inArg   = 0;
+                    stat.inQuote = 0;
+                    inbuf[i]     = '\0';
+                }
+                break;
+
+            case ' ':
+                if (i > 0 && inbuf[i - 1] == '\\' && stat.inArg) {
+                    memmove(&inbuf[i - 1], &inbuf[i], strlen(&inbuf[i]) + 1);
+                    --i;
+                    break;
+                }
+                if (!stat.inQuote && stat.inArg) {
+                    stat.inArg = 0;
+                    inbuf[i]   = '\0';
+                }
+                break;
+
+            case ';':
+                if (i > 0 && inbuf[i - 1] == '\\' && stat.inArg) {
+                    memmove(&inbuf[i - 1], &inbuf[i], strlen(&inbuf[i]) + 1);
+                    --i;
+                    break;
+                }
+                if (stat.inQuote) {
+                    return 2;
+                }
+                if (!stat.inQuote && stat.inArg) {
+                    stat.inArg = 0;
+                    inbuf[i]   = '\0';
+
+                    if (*pargc) {
+                        if (++cmdnum < CLI_MAX_ONCECMD_NUM) {
+                            pargc = &line->argc[cmdnum];
+                        }
+                    }
+                }
+
+                break;
+
+            default:
+                if (!stat.inArg) {
+                    stat.inArg = 1;
+                    (*pargc)++;
+                    line->argv[cmdnum][(*pargc) - 1] = &inbuf[i];
+                }
+                break;
+        }
+    } while (!stat.done && ++i < INBUF_SIZE && cmdnum < CLI_MAX_ONCECMD_NUM &&
+             (*pargc) < CLI_MAX_ARG_NUM);
+
+    if (stat.inQuote) {
+        return 2;
+    }
+
+    line->cmdnum = (cmdnum < CLI_MAX_ONCECMD_NUM) ? cmdnum + 1 : CLI_MAX_ONCECMD_NUM;
+    return 0;
+}
+
+static void random_line(char *buf)
+{
+    static const char chars[] = "ab \"\\;";
+    int len = rand() % (INBUF_SIZE - 1);
+    int i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = (rand() % 3) ? chars[rand() % (sizeof(chars) - 1)] : 'a' + rand() % 26;
+    }
+    buf[len] = '\0';
+}
+
+static void test_parse(void)
+{
+    static char buf[INBUF_SIZE], ref_buf[INBUF_SIZE], line_str[INBUF_SIZE];
+    static struct cli_line line, ref_line;
+    int n, i, j, ret, ref_ret, errors = 0;
+
+    for (n = 0; n < TEST_LINES && errors < 5; n++) {
+        random_line(buf);
+        memcpy(line_str, buf, sizeof(buf));
+        memcpy(ref_buf, buf, sizeof(buf));
+
+        ret = cli_parse_line(buf, strlen(buf) + 1, &line);
+        ref_ret = ref_parse_line(ref_buf, &ref_line);
+        if (ret != ref_ret) {
+            printf("FAIL '%s' returns %d, %d before\n", line_str, ret, ref_ret);
+            errors++;
+            continue;
+        }
+        if (ret) {
+            continue;
+        }
+
+        if (line.cmdnum != ref_line.cmdnum) {
+            printf("FAIL '%s' has %d commands, %d before\n", line_str, line.cmdnum, ref_line.cmdnum);
+            errors++;
+            continue;
+        }
+        for (i = 0; i < line.cmdnum; i++) {
+            if (line.argc[i] != ref_line.argc[i]) {
+                printf("FAIL '%s' command %d has %d arguments, %d before\n",
+                       line_str, i, line.argc[i], ref_line.argc[i]);
+                errors++;
+                break;
+            }
+            for (j = 0; j < line.argc[i]; j++) {
+                if (strcmp(line.argv[i][j], ref_line.argv[i][j])) {
+                    printf("FAIL '%s' command %d argument %d is '%s', '%s' before\n",
+                           line_str, i, j, line.argv[i][j], ref_line.argv[i][j]);
+                    errors++;
+                    break;
+                }
+            }
+            if (j < line.argc[i]) {
+                break;
+            }
+            if (line.argc[i] < CLI_MAX_ARG_NUM && line.argv[i][line.argc[i]] != NULL) {
+                printf("FAIL '%s' command %d arguments do not end with NULL\n", line_str, i);
+                errors++;
+                break;
+            }
+        }
+    }
+
+    /* len bounds the scan, the '\0' does not have to be there */
+    strcpy(buf, "a b;c d;e");
+    if (cli_parse_line(buf, 3, &line) || line.cmdnum != 1 || line.argc[0] != 2 ||
+        strcmp(line.argv[0][0], "a") || line.argv[0][1][0] != 'b') {
+        printf("FAIL the line is not cut at len\n");
+        errors++;
+    }
+
+    if (errors) {
+        test_failed = 1;
+    }
+}
+
+/* command index */
+static struct cli_command cmds[TEST_CMDS_MAX];
+static char names[TEST_CMDS_MAX][8];
+static int cmds_num;
+
+static const struct cli_command *cmd_get(int idx)
+{
+    return &cmds[idx];
+}
+
+static int linear_find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < cmds_num; i++) {
+        if (cmds[i].name && !strcmp(cmds[i].name, name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void random_name(char *name)
+{
+    int len = 1 + rand() % 3;
+    int i;
+
+    /* a small alphabet, so names repeat */
+    for (i = 0; i < len; i++) {
+        name[i] = 'a' + rand() % 6;
+    }
+    name[len] = '\0';
+}
+
+static void test_index(void)
+{
+    static uint16_t slots[4 * TEST_CMDS_MAX];
+    struct cli_index index;
+    char name[8];
+    int n, i, found, want, errors = 0;
+
+    for (n = 0; n < TEST_TABLES && errors < 5; n++) {
+        cmds_num = 1 + rand() % TEST_CMDS_MAX;
+        for (i = 0; i < cmds_num; i++) {
+            random_name(names[i]);
+            cmds[i].name = (rand() % 10) ? names[i] : NULL;
+        }
+
+        if (cli_index_size(cmds_num) > sizeof(slots)) {
+            printf("FAIL %u bytes of slots for %d commands\n", cli_index_size(cmds_num), cmds_num);
+            errors++;
+            break;
+        }
+        cli_index_init(&index, slots, cmds_num, cmd_get);
+        /* rebuilt after a change, as cli.c does */
+        if (n % 2) {
+            for (i = 0; i < cmds_num; i++) {
+                cli_index_add(&index, i);
+            }
+            cli_index_clear(&index);
+        }
+        for (i = 0; i < cmds_num; i++) {
+            cli_index_add(&index, i);
+        }
+
+        for (i = 0; i < 200; i++) {
+            random_name(name);
+            found = cli_index_find(&index, name);
+            want = linear_find(name);
+            if (found != want) {
+                printf("FAIL '%s' is command %d, linear search finds %d\n", name, found, want);
+                errors++;
+                break;
+            }
+        }
+        if (cli_index_find(&index, "") != -1 || cli_index_find(&index, "zzzz") != -1) {
+            printf("FAIL a name not in the table is found\n");
+            errors++;
+        }
+    }
+
+    if (errors) {
+        test_failed = 1;
+    }
+}
+
+int main(void)
+{
+    srand(1);
+    test_parse();
+    test_index();
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
@@ -176,6 +176,26 @@ int aos_cli_printf(const char *buff, ...);
  */
 int aos_cli_init(int use_thread);
 
+/**
+ * Run newline separated commands without echo or prompt, printing one
+ * "<n> <status>" line per command and a summary at the end.
+ *
+ * @param[in]  script  Commands, need not be NUL terminated.
+ * @param[in]  len     Length of script in bytes.
+ *
+ * @return  number of failed commands, negative error code otherwise.
+ */
+int aos_cli_batch(const char *script, int len);
+
+/**
+ * Run a script file with aos_cli_batch(), romfs files are run in place.
+ *
+ * @param[in]  path  File path, e.g. /romfs/test.txt
+ *
+ * @return  number of failed commands, negative error code otherwise.
+ */
+int aos_cli_batch_file(const char *path);
+
 /**
  * CLI callback function for read
  *
@@ -264,6 +284,16 @@ RHINO_INLINE int aos_cli_stop(void)
     return 0;
 }
 
+RHINO_INLINE int aos_cli_batch(const char *script, int len)
+{
+    return 0;
+}
+
+RHINO_INLINE int aos_cli_batch_file(const char *path)
+{
+    return 0;
+}
+
 RHINO_INLINE void *aos_cli_task_get(void)
 {
     return NULL;
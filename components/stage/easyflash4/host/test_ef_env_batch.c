@@ -0,0 +1,358 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test and benchmark for the EasyFlash ENV batch.  The ENV area is a
+ * file with NOR semantics, so a reboot re-reads everything from it.  A
+ * profile of 20 fields is saved again and again, by one ef_set_env_blob()
+ * per field and by one batch, and the flash program operations and bytes per
+ * committed key are printed.  Then each flash write of a batch commit fails
+ * in turn: a batch which is not committed must leave its records dropped and
+ * every field at the old value, before and after a reboot, and a batch which
+ * is committed must show every field at the new value after a reboot.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* utils_log.h needs FreeRTOS, only log_warn() is used */
+#define __UTILS_LOG_H__
+#define log_warn(...)
+
+#include "../src/ef_env.c"
+#include "../src/ef_utils.c"
+#include "../../../utils/src/utils_crc.c"
+
+#define TEST_FIELD_NUM      20
+#define TEST_VALUE_MAX      24
+#define TEST_SNAPSHOT_NUM   500
+
+static int test_failed;
+
+/* ENV area in a file */
+static FILE *flash;
+static unsigned long flash_writes, flash_write_bytes, flash_erases;
+static int write_fail_countdown;//fail the nth write from now, 0 for never
+
+EfErrCode ef_port_read(uint32_t addr, uint32_t *buf, size_t size)
+{
+    if (addr + size > ENV_AREA_SIZE || pread(fileno(flash), buf, size, addr) != (ssize_t)size) {
+        return EF_READ_ERR;
+    }
+    return EF_NO_ERR;
+}
+
+EfErrCode ef_port_erase(uint32_t addr, size_t size)
+{
+    uint8_t buf[EF_ERASE_MIN_SIZE];
+
+    if (addr % EF_ERASE_MIN_SIZE || size % EF_ERASE_MIN_SIZE || addr + size > ENV_AREA_SIZE) {
+        printf("FAIL erase %08x/%u\n", (unsigned)addr, (unsigned)size);
+        test_failed = 1;
+        return EF_ERASE_ERR;
+    }
+    memset(buf, 0xFF, sizeof(buf));
+    for (; size; addr += EF_ERASE_MIN_SIZE, size -= EF_ERASE_MIN_SIZE) {
+        flash_erases++;
+        if (pwrite(fileno(flash), buf, sizeof(buf), addr) != sizeof(buf)) {
+            return EF_ERASE_ERR;
+        }
+    }
+    return EF_NO_ERR;
+}
+
+EfErrCode ef_port_write(uint32_t addr, const uint32_t *buf, size_t size)
+{
+    uint8_t old[EF_ERASE_MIN_SIZE];
+    size_t i;
+
+    if (write_fail_countdown && 0 == --write_fail_countdown) {
+        return EF_WRITE_ERR;
+    }
+    if (addr + size > ENV_AREA_SIZE || size > sizeof(old) || pread(fileno(flash), old, size, addr) != (ssize_t)size) {
+        printf("FAIL write %08x/%u\n", (unsigned)addr, (unsigned)size);
+        test_failed = 1;
+        return EF_WRITE_ERR;
+    }
+    flash_writes++;
+    flash_write_bytes += size;
+    for (i = 0; i < size; i++) {
+        old[i] &= ((const uint8_t *)buf)[i];
+    }
+    if (pwrite(fileno(flash), old, size, addr) != (ssize_t)size) {
+        return EF_WRITE_ERR;
+    }
+    return EF_NO_ERR;
+}
+
+void ef_port_env_lock(void)
+{
+}
+
+void ef_port_env_unlock(void)
+{
+}
+
+void ef_port_gc_pending(void)
+{
+}
+
+uint32_t ef_port_get_time_us(void)
+{
+    return 0;
+}
+
+void ef_log_debug(const char *file, const long line, const char *format, ...)
+{
+    (void)file;
+    (void)line;
+    (void)format;
+}
+
+void ef_log_info(const char *format, ...)
+{
+    (void)format;
+}
+
+void ef_print(const char *format, ...)
+{
+    (void)format;
+}
+
+/* the profile, each snapshot has a new value of every field */
+static char fields[TEST_FIELD_NUM][16];
+static uint8_t batch_buf[SECTOR_SIZE / 2];
+
+static const ef_env default_env[] = {
+    {"boot_times", "3", 1},
+};
+
+static void reboot(void)
+{
+    /*RAM state is lost*/
+    init_ok = false;
+    gc_request = false;
+    in_recovery_check = false;
+    gc_pending = false;
+    gc_stepping = false;
+    gc_sec_addr = FAILED_ADDR;
+    gc_env_addr = FAILED_ADDR;
+    if (ef_env_init(default_env, sizeof(default_env) / sizeof(default_env[0])) != EF_NO_ERR) {
+        printf("FAIL env init\n");
+        test_failed = 1;
+    }
+}
+
+static void format(void)
+{
+    init_ok = true;
+    ef_env_set_default();
+    reboot();
+}
+
+static void snapshot_value(int snapshot, int f, uint8_t *value, int *len)
+{
+    int i;
+
+    *len = 4 + (snapshot * 7 + f) % (TEST_VALUE_MAX - 4);
+    for (i = 0; i < *len; i++) {
+        value[i] = snapshot * 31 + f * 17 + i;
+    }
+}
+
+static EfErrCode save_snapshot(int snapshot, bool batched)
+{
+    ef_env_batch batch;
+    uint8_t value[TEST_VALUE_MAX];
+    EfErrCode result = EF_NO_ERR;
+    int f, len;
+
+    if (batched) {
+        ef_env_batch_begin(&batch, batch_buf, sizeof(batch_buf));
+    }
+    for (f = 0; f < TEST_FIELD_NUM && result == EF_NO_ERR; f++) {
+        snapshot_value(snapshot, f, value, &len);
+        if (batched) {
+            result = ef_env_batch_set(&batch, fields[f], value, len);
+        } else {
+            result = ef_set_env_blob(fields[f], value, len);
+        }
+    }
+    if (batched && result == EF_NO_ERR) {
+        result = ef_env_batch_commit(&batch);
+    }
+    return result;
+}
+
+/* the number of fields which hold the value of the snapshot */
+static int fields_at(int snapshot)
+{
+    uint8_t value[TEST_VALUE_MAX], buf[TEST_VALUE_MAX];
+    size_t saved_len;
+    int f, len, n = 0;
+
+    for (f = 0; f < TEST_FIELD_NUM; f++) {
+        snapshot_value(snapshot, f, value, &len);
+        if (ef_get_env_blob(fields[f], buf, sizeof(buf), &saved_len) == (size_t)len
+                && saved_len == (size_t)len && !memcmp(buf, value, len)) {
+            n++;
+        }
+    }
+    return n;
+}
+
+static bool check_write_cb(env_node_obj_t env, void *arg1, void *arg2)
+{
+    int *nodes = arg1;
+    int f;
+
+    (void)arg2;
+    if (!env->crc_is_ok || env->status != ENV_WRITE) {
+        return false;
+    }
+    for (f = 0; f < TEST_FIELD_NUM; f++) {
+        if (env->name_len == strlen(fields[f]) && !strncmp(env->name, fields[f], env->name_len)) {
+            nodes[f]++;
+        }
+    }
+    return false;
+}
+
+/* every field is ENV_WRITE exactly once on flash */
+static void check_write_nodes(const char *when)
+{
+    struct env_node_obj env;
+    int nodes[TEST_FIELD_NUM] = {0};
+    int f;
+
+    env_iterator(&env, nodes, NULL, check_write_cb);
+    for (f = 0; f < TEST_FIELD_NUM; f++) {
+        if (nodes[f] != 1) {
+            printf("FAIL %s: %s has %d ENV_WRITE nodes\n", when, fields[f], nodes[f]);
+            test_failed = 1;
+        }
+    }
+}
+
+static void bench(bool batched)
+{
+    unsigned long writes, bytes, erases;
+    int s;
+
+    format();
+    writes = flash_writes;
+    bytes = flash_write_bytes;
+    erases = flash_erases;
+    for (s = 0; s < TEST_SNAPSHOT_NUM; s++) {
+        if (save_snapshot(s, batched) != EF_NO_ERR || fields_at(s) != TEST_FIELD_NUM) {
+            printf("FAIL %s snapshot %d\n", batched ? "batch" : "single", s);
+            test_failed = 1;
+            return;
+        }
+    }
+    printf("%-6s: %.2f programs, %.1f bytes per key, %.2f erases per snapshot\n", batched ? "batch" : "single",
+            (double)(flash_writes - writes) / (TEST_SNAPSHOT_NUM * TEST_FIELD_NUM),
+            (double)(flash_write_bytes - bytes) / (TEST_SNAPSHOT_NUM * TEST_FIELD_NUM),
+            (double)(flash_erases - erases) / TEST_SNAPSHOT_NUM);
+    check_write_nodes("bench");
+}
+
+/*fail each write of the commit in turn*/
+static void test_write_fail(void)
+{
+    int snapshot = 0, fail, dropped = 0, committed = 0;
+    EfErrCode result;
+
+    format();
+    save_snapshot(snapshot, true);
+    for (fail = 1; ; fail++) {
+        write_fail_countdown = fail;
+        result = save_snapshot(snapshot + 1, true);
+        if (write_fail_countdown) {
+            /*the commit has less writes, done*/
+            write_fail_countdown = 0;
+            break;
+        }
+        if (result != EF_NO_ERR && fields_at(snapshot) == TEST_FIELD_NUM) {
+            /*not committed, the records must be dropped*/
+            dropped++;
+            check_write_nodes("dropped");
+            reboot();
+            if (fields_at(snapshot) != TEST_FIELD_NUM) {
+                printf("FAIL write %d: the dropped batch is visible after reboot\n", fail);
+                test_failed = 1;
+            }
+        } else {
+            /*committed, the reboot finishes it*/
+            committed++;
+            reboot();
+            if (fields_at(snapshot + 1) != TEST_FIELD_NUM) {
+                printf("FAIL write %d: the committed batch is lost after reboot\n", fail);
+                test_failed = 1;
+            }
+            snapshot++;
+        }
+        check_write_nodes("reboot");
+        /*the flash space of a failed batch is not reused*/
+        if (save_snapshot(snapshot + 1, false) != EF_NO_ERR || fields_at(snapshot + 1) != TEST_FIELD_NUM) {
+            printf("FAIL write %d: set after the failed commit\n", fail);
+            test_failed = 1;
+        }
+        snapshot++;
+        check_write_nodes("set");
+    }
+    printf("write fail: %d commits dropped, %d committed\n", dropped, committed);
+    if (0 == dropped || 0 == committed) {
+        test_failed = 1;
+    }
+}
+
+int main(void)
+{
+    int f;
+
+    flash = tmpfile();
+    if (NULL == flash || ftruncate(fileno(flash), ENV_AREA_SIZE)) {
+        printf("FAIL flash file\n");
+        return 1;
+    }
+    for (f = 0; f < TEST_FIELD_NUM; f++) {
+        snprintf(fields[f], sizeof(fields[f]), "profile_%d", f);
+    }
+    reboot();
+
+    bench(false);
+    bench(true);
+    test_write_fail();
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
@@ -0,0 +1,505 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test for the EasyFlash incremental GC on simulated NOR flash.  The
+ * flash charges 45 ms per sector erase and 1 us per 4 programmed bytes on a
+ * virtual clock, so the GC statistics give the stall a set would cause on the
+ * device.  Random rewrites at about 60% fill are checked against a model, and
+ * every blocking GC must stay within EF_GC_BLOCKING_SEC_NUM sector erases.
+ * Power is cut at random flash operations, with the last write torn, and
+ * after the reboot every ENV must hold its value (the one being set may hold
+ * the old or the new value) and no sector may be left in SECTOR_DIRTY_GC,
+ * including a sector an incremental step started above the GC threshold.
+ * With the steps run in the background after ef_port_gc_pending(), no set
+ * blocks, and once the live ENV outgrow the area a set fails with
+ * EF_ENV_FULL within the same bound.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* utils_log.h needs FreeRTOS, only log_warn() is used */
+#define __UTILS_LOG_H__
+#define log_warn(...)
+
+#include "../src/ef_env.c"
+#include "../src/ef_utils.c"
+#include "../../../utils/src/utils_crc.c"
+
+#define TEST_KEY_NUM        120
+#define TEST_VALUE_MAX      200
+#define TEST_ERASE_US       45000
+
+static int test_failed;
+
+/* NOR flash with a virtual clock, power can be cut at the nth operation */
+static uint8_t flash[ENV_AREA_SIZE];
+static uint32_t now_us;
+static unsigned long flash_ops;
+static unsigned long power_cut_at;//0 for never
+static jmp_buf power_cut;
+
+static void flash_op(void)
+{
+    if (power_cut_at && ++flash_ops == power_cut_at) {
+        longjmp(power_cut, 1);
+    }
+}
+
+EfErrCode ef_port_read(uint32_t addr, uint32_t *buf, size_t size)
+{
+    if (addr + size > ENV_AREA_SIZE) {
+        return EF_READ_ERR;
+    }
+    memcpy(buf, flash + addr, size);
+    return EF_NO_ERR;
+}
+
+EfErrCode ef_port_erase(uint32_t addr, size_t size)
+{
+    if (addr % EF_ERASE_MIN_SIZE || size % EF_ERASE_MIN_SIZE || addr + size > ENV_AREA_SIZE) {
+        printf("FAIL erase %08x/%u\n", (unsigned)addr, (unsigned)size);
+        test_failed = 1;
+        return EF_ERASE_ERR;
+    }
+    flash_op();
+    memset(flash + addr, 0xFF, size);
+    now_us += TEST_ERASE_US * (size / EF_ERASE_MIN_SIZE);
+    return EF_NO_ERR;
+}
+
+EfErrCode ef_port_write(uint32_t addr, const uint32_t *buf, size_t size)
+{
+    size_t i;
+
+    if (addr + size > ENV_AREA_SIZE) {
+        printf("FAIL write %08x/%u\n", (unsigned)addr, (unsigned)size);
+        test_failed = 1;
+        return EF_WRITE_ERR;
+    }
+    if (power_cut_at && flash_ops + 1 == power_cut_at) {
+        /*torn write, only a part of it is programmed*/
+        size = size ? rand() % size : 0;
+        for (i = 0; i < size; i++) {
+            flash[addr + i] &= ((const uint8_t *)buf)[i];
+        }
+    }
+    flash_op();
+    for (i = 0; i < size; i++) {
+        flash[addr + i] &= ((const uint8_t *)buf)[i];
+    }
+    now_us += (size + 3) / 4;
+    return EF_NO_ERR;
+}
+
+void ef_port_env_lock(void)
+{
+}
+
+void ef_port_env_unlock(void)
+{
+}
+
+uint32_t ef_port_get_time_us(void)
+{
+    return now_us;
+}
+
+/* the device wakes its GC task here, the test runs the steps after the set returns */
+static unsigned long gc_wakeups;
+
+void ef_port_gc_pending(void)
+{
+    gc_wakeups++;
+}
+
+void ef_log_debug(const char *file, const long line, const char *format, ...)
+{
+    (void)file;
+    (void)line;
+    (void)format;
+}
+
+void ef_log_info(const char *format, ...)
+{
+    (void)format;
+}
+
+void ef_print(const char *format, ...)
+{
+    (void)format;
+}
+
+/* model of the ENV */
+static char keys[TEST_KEY_NUM][16];
+static uint8_t values[TEST_KEY_NUM][TEST_VALUE_MAX];
+static int value_lens[TEST_KEY_NUM];//-1 for not set
+
+static const ef_env default_env[] = {
+    {"boot_times", "3", 1},
+};
+
+static void reboot(void)
+{
+    /*RAM state is lost*/
+    init_ok = false;
+    gc_request = false;
+    in_recovery_check = false;
+    gc_pending = false;
+    gc_stepping = false;
+    gc_sec_addr = FAILED_ADDR;
+    gc_env_addr = FAILED_ADDR;
+    if (ef_env_init(default_env, sizeof(default_env) / sizeof(default_env[0])) != EF_NO_ERR) {
+        printf("FAIL env init\n");
+        test_failed = 1;
+    }
+}
+
+static bool check_gc_sector_cb(sector_meta_data_t sector, void *arg1, void *arg2)
+{
+    int *gc_sectors = arg1;
+
+    (void)arg2;
+    if (sector->check_ok && sector->status.dirty == SECTOR_DIRTY_GC) {
+        (*gc_sectors)++;
+    }
+    return false;
+}
+
+static int count_gc_sectors(void)
+{
+    struct sector_meta_data sector;
+    int gc_sectors = 0;
+
+    sector_iterator(&sector, SECTOR_STORE_UNUSED, &gc_sectors, NULL, check_gc_sector_cb, false);
+    return gc_sectors;
+}
+
+/* every ENV against the model, the key being set may hold the old or the new value */
+static void check_model(const char *when, int key, const uint8_t *value, int len)
+{
+    uint8_t buf[TEST_VALUE_MAX];
+    size_t got, saved;
+    int k;
+
+    for (k = 0; k < TEST_KEY_NUM; k++) {
+        got = ef_get_env_blob(keys[k], buf, sizeof(buf), &saved);
+        if (k == key && (len < 0 ? (got == 0) : (got == (size_t)len && !memcmp(buf, value, got)))) {
+            if (len < 0) {
+                value_lens[k] = -1;
+            } else {
+                memcpy(values[k], value, len);
+                value_lens[k] = len;
+            }
+            continue;
+        }
+        if (value_lens[k] < 0 ? (got != 0) : (got != (size_t)value_lens[k] || memcmp(buf, values[k], got))) {
+            printf("FAIL %s: %s has %u bytes, expected %d\n", when, keys[k], (unsigned)got, value_lens[k]);
+            test_failed = 1;
+        }
+    }
+}
+
+/* one random set or delete, *key and *len are set before the flash is touched, *len is -1 for a delete */
+static void random_op(int *key, uint8_t *value, int *len)
+{
+    int k, i;
+
+    k = rand() % TEST_KEY_NUM;
+    if (value_lens[k] >= 0 && 0 == rand() % 8) {
+        *len = -1;
+        *key = k;
+        ef_del_env(keys[k]);
+        return;
+    }
+    *len = 1 + rand() % TEST_VALUE_MAX;
+    for (i = 0; i < *len; i++) {
+        value[i] = rand();
+    }
+    *key = k;
+    if (ef_set_env_blob(keys[k], value, *len) != EF_NO_ERR) {
+        printf("FAIL set %s %d bytes\n", keys[k], *len);
+        test_failed = 1;
+    }
+}
+
+static void test_stall(void)
+{
+    uint8_t value[TEST_VALUE_MAX];
+    ef_env_gc_stat stat;
+    uint32_t bound;
+    int i, k, len;
+
+    ef_env_gc_reset_stat();
+    for (i = 0; i < 5000; i++) {
+        random_op(&k, value, &len);
+        check_model("rewrite", k, value, len);
+    }
+    ef_env_gc_get_stat(&stat);
+    printf("rewrite: %u steps, %u blocking, %u sectors erased, moved %u bytes for %u written, max stall %u ms\n",
+            (unsigned)stat.steps, (unsigned)stat.full_collects, (unsigned)stat.erased_sectors,
+            (unsigned)stat.moved_bytes, (unsigned)stat.written_bytes, (unsigned)(stat.max_stall_us / 1000));
+    /*a blocking GC erases at most EF_GC_BLOCKING_SEC_NUM sectors and moves what they hold*/
+    bound = EF_GC_BLOCKING_SEC_NUM * (TEST_ERASE_US + SECTOR_SIZE);
+    if (stat.max_stall_us > bound || 0 == stat.steps) {
+        printf("FAIL max stall %u us, bound %u us\n", (unsigned)stat.max_stall_us, (unsigned)bound);
+        test_failed = 1;
+    }
+}
+
+/* the steps run in the background after every set, as the GC task does, the sets never block */
+static void test_background(void)
+{
+    uint8_t value[TEST_VALUE_MAX];
+    ef_env_gc_stat stat;
+    unsigned long wakeups;
+    int i, k, len;
+
+    ef_env_gc_reset_stat();
+    for (i = 0; i < 5000; i++) {
+        wakeups = gc_wakeups;
+        random_op(&k, value, &len);
+        check_model("background", k, value, len);
+        if (gc_pending && gc_wakeups == wakeups) {
+            printf("FAIL the GC is pending without a wakeup\n");
+            test_failed = 1;
+        }
+        while (ef_env_gc_step(0)) {
+        }
+    }
+    ef_env_gc_get_stat(&stat);
+    printf("background: %u steps, %u blocking, %lu wakeups\n", (unsigned)stat.steps, (unsigned)stat.full_collects,
+            gc_wakeups);
+    if (0 == gc_wakeups || stat.full_collects) {
+        printf("FAIL the background GC\n");
+        test_failed = 1;
+    }
+}
+
+/* a step starts a sector above the GC threshold, then the power goes */
+static void test_resume_gc_sector(void)
+{
+    uint8_t value[TEST_VALUE_MAX];
+    int i, k, len, found = 0;
+
+    for (i = 0; i < 20000 && !found; i++) {
+        random_op(&k, value, &len);
+        check_model("resume", k, value, len);
+        if (gc_sec_addr != FAILED_ADDR) {
+            struct sector_meta_data sector;
+            size_t empty_sec = 0;
+
+            sector_iterator(&sector, SECTOR_STORE_EMPTY, &empty_sec, NULL, gc_check_cb, false);
+            found = empty_sec > EF_GC_EMPTY_SEC_THRESHOLD;
+        }
+    }
+    if (!found || 0 == count_gc_sectors()) {
+        printf("FAIL no GC sector above the threshold\n");
+        test_failed = 1;
+        return;
+    }
+    reboot();
+    if (count_gc_sectors()) {
+        printf("FAIL the GC sector is not resumed at boot\n");
+        test_failed = 1;
+    }
+    check_model("resume reboot", -1, NULL, 0);
+}
+
+static void test_power_cut(void)
+{
+    static uint8_t value[TEST_VALUE_MAX];
+    static int round, k, len;
+    static unsigned long cuts;
+
+    for (round = 0; round < 1000; round++) {
+        k = -1;
+        flash_ops = 0;
+        power_cut_at = 1 + rand() % 40;
+        if (setjmp(power_cut) == 0) {
+            /*a few operations, one of them is cut*/
+            while (1) {
+                random_op(&k, value, &len);
+                check_model("before cut", k, value, len);
+                k = -1;
+            }
+        }
+        cuts++;
+        power_cut_at = 0;
+        reboot();
+        if (count_gc_sectors()) {
+            printf("FAIL round %d: a GC sector is left after boot\n", round);
+            test_failed = 1;
+        }
+        /*the ENV being set when the power went*/
+        check_model("power cut", k, value, len);
+    }
+    printf("power cut: %lu cuts\n", cuts);
+}
+
+/* the live ENV outgrow the area, a set that doesn't fit fails after a bounded GC */
+static void test_full(void)
+{
+    uint8_t value[TEST_VALUE_MAX];
+    ef_env_gc_stat stat;
+    uint32_t bound, start;
+    int i, k, fulls = 0;
+    EfErrCode result;
+
+    bound = EF_GC_BLOCKING_SEC_NUM * (TEST_ERASE_US + SECTOR_SIZE);
+    for (i = 0; i < 2 * TEST_KEY_NUM; i++) {
+        k = i % TEST_KEY_NUM;
+        memset(value, i, sizeof(value));
+        start = now_us;
+        result = ef_set_env_blob(keys[k], value, sizeof(value));
+        if (result == EF_ENV_FULL) {
+            fulls++;
+        } else if (result != EF_NO_ERR) {
+            printf("FAIL full: set %s returns %d\n", keys[k], result);
+            test_failed = 1;
+        }
+        if (now_us - start > bound) {
+            printf("FAIL full: set %s stalls %u us, bound %u us\n", keys[k], (unsigned)(now_us - start),
+                    (unsigned)bound);
+            test_failed = 1;
+        }
+        check_model("full", k, value, sizeof(value));
+    }
+    ef_env_gc_get_stat(&stat);
+    printf("full: %d sets failed, %u blocking\n", fulls, (unsigned)stat.full_collects);
+    if (0 == fulls) {
+        printf("FAIL the area is never full\n");
+        test_failed = 1;
+    }
+}
+
+/* a using sector which has room for an ENV of env_len bytes */
+static bool fit_using_cb(sector_meta_data_t sector, void *arg1, void *arg2)
+{
+    (void)arg2;
+    return sector->check_ok && sector->status.store == SECTOR_STORE_USING && sector->remain > *(size_t *)arg1;
+}
+
+static bool using_fits(size_t env_len)
+{
+    struct sector_meta_data sector;
+
+    sector.addr = FAILED_ADDR;
+    sector_iterator(&sector, SECTOR_STORE_USING, &env_len, NULL, fit_using_cb, true);
+    return sector.addr != FAILED_ADDR && fit_using_cb(&sector, &env_len, NULL);
+}
+
+/* set and check one model ENV */
+static void set_model(int k, uint8_t fill, int len)
+{
+    uint8_t value[TEST_VALUE_MAX];
+
+    memset(value, fill, len);
+    if (ef_set_env_blob(keys[k], value, len) != EF_NO_ERR) {
+        printf("FAIL set %s %d bytes\n", keys[k], len);
+        test_failed = 1;
+    }
+    check_model("using garbage", k, value, len);
+}
+
+/*
+ * The sectors which are left with a small room stay in the using status, all garbage is in them. No full sector can
+ * be picked, so the blocking GC collects one of the using sectors.
+ */
+static void test_using_garbage(void)
+{
+    struct sector_meta_data sector;
+    struct env_node_obj env;
+    ef_env_gc_stat stat;
+    size_t empty_sec, env_len;
+    int k, i;
+
+    memset(flash, 0xFF, sizeof(flash));
+    for (k = 0; k < TEST_KEY_NUM; k++) {
+        value_lens[k] = -1;
+    }
+    reboot();
+    k = 0;
+    do {
+        set_model(k, k, TEST_VALUE_MAX);
+        k++;
+        empty_sec = 0;
+        sector_iterator(&sector, SECTOR_STORE_EMPTY, &empty_sec, NULL, gc_check_cb, false);
+    } while (empty_sec > EF_GC_EMPTY_SEC_THRESHOLD);
+    /* rewrite the ENV in the using sectors until the next one doesn't fit */
+    env_len = ENV_HDR_DATA_SIZE + EF_WG_ALIGN(strlen(keys[k])) + EF_WG_ALIGN(TEST_VALUE_MAX);
+    for (i = 0; i < k && using_fits(env_len); i++) {
+        ef_get_env_obj(keys[i], &env);
+        read_sector_meta_data(env.addr.start / SECTOR_SIZE * SECTOR_SIZE, &sector, true);
+        if (sector.status.store == SECTOR_STORE_USING && sector.remain <= env_len) {
+            set_model(i, i + 1, TEST_VALUE_MAX);
+        }
+    }
+    if (using_fits(env_len)) {
+        printf("FAIL the using sectors always fit\n");
+        test_failed = 1;
+        return;
+    }
+    ef_env_gc_reset_stat();
+    set_model(k, k, TEST_VALUE_MAX);
+    ef_env_gc_get_stat(&stat);
+    printf("using garbage: %u blocking, %u sectors erased, max stall %u ms\n", (unsigned)stat.full_collects,
+            (unsigned)stat.erased_sectors, (unsigned)(stat.max_stall_us / 1000));
+    if (1 != stat.full_collects || 1 != stat.erased_sectors) {
+        printf("FAIL the using sector is not collected\n");
+        test_failed = 1;
+    }
+}
+
+int main(void)
+{
+    int k;
+
+    srand(1);
+    memset(flash, 0xFF, sizeof(flash));
+    for (k = 0; k < TEST_KEY_NUM; k++) {
+        snprintf(keys[k], sizeof(keys[k]), "key_%d", k);
+        value_lens[k] = -1;
+    }
+    reboot();
+
+    test_stall();
+    test_resume_gc_sector();
+    test_power_cut();
+    test_stall();
+    test_background();
+    test_full();
+    test_using_garbage();
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
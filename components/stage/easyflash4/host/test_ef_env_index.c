@@ -0,0 +1,432 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test for the EasyFlash ENV index.  The ENV area is a file with NOR
+ * semantics (programming only clears bits, a sector must be erased first),
+ * so a reboot re-reads everything from it.  Random sets, overwrites and
+ * deletes are checked against a model, and after each step every index slot
+ * must be reachable from its home slot, the deleted slot count must be exact
+ * and under the rehash threshold, and every ENV_WRITE node on flash must be in
+ * the index.  Also covers rehashing a table full of deleted slots, overflow
+ * of the table, a failing flash write at each step of a set (the failed node
+ * must not be indexed), and reboots.  Prints flash reads per lookup with the
+ * index and with the flash scan.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* utils_log.h needs FreeRTOS, only log_warn() is used */
+#define __UTILS_LOG_H__
+#define log_warn(...)
+
+#include <ef_cfg.h>
+/* a table that overflows with TEST_KEY_MAX ENVs */
+#undef EF_ENV_INDEX_TABLE_SIZE
+#define EF_ENV_INDEX_TABLE_SIZE   128
+
+#include "../src/ef_env.c"
+#include "../src/ef_utils.c"
+#include "../../../utils/src/utils_crc.c"
+
+#define TEST_KEY_MAX        300
+#define TEST_VALUE_MAX      40
+
+static int test_failed;
+
+/* ENV area in a file */
+static FILE *flash;
+static unsigned long flash_reads;
+static int write_fail_countdown;//fail the nth write from now, 0 for never
+
+EfErrCode ef_port_read(uint32_t addr, uint32_t *buf, size_t size)
+{
+    flash_reads++;
+    if (addr + size > ENV_AREA_SIZE || pread(fileno(flash), buf, size, addr) != (ssize_t)size) {
+        return EF_READ_ERR;
+    }
+    return EF_NO_ERR;
+}
+
+EfErrCode ef_port_erase(uint32_t addr, size_t size)
+{
+    uint8_t buf[EF_ERASE_MIN_SIZE];
+
+    if (addr % EF_ERASE_MIN_SIZE || size % EF_ERASE_MIN_SIZE || addr + size > ENV_AREA_SIZE) {
+        printf("FAIL erase %08x/%u\n", (unsigned)addr, (unsigned)size);
+        test_failed = 1;
+        return EF_ERASE_ERR;
+    }
+    memset(buf, 0xFF, sizeof(buf));
+    for (; size; addr += EF_ERASE_MIN_SIZE, size -= EF_ERASE_MIN_SIZE) {
+        if (pwrite(fileno(flash), buf, sizeof(buf), addr) != sizeof(buf)) {
+            return EF_ERASE_ERR;
+        }
+    }
+    return EF_NO_ERR;
+}
+
+EfErrCode ef_port_write(uint32_t addr, const uint32_t *buf, size_t size)
+{
+    uint8_t old[EF_ERASE_MIN_SIZE];
+    size_t i;
+
+    if (write_fail_countdown && 0 == --write_fail_countdown) {
+        return EF_WRITE_ERR;
+    }
+    if (addr + size > ENV_AREA_SIZE || size > sizeof(old) || pread(fileno(flash), old, size, addr) != (ssize_t)size) {
+        printf("FAIL write %08x/%u\n", (unsigned)addr, (unsigned)size);
+        test_failed = 1;
+        return EF_WRITE_ERR;
+    }
+    for (i = 0; i < size; i++) {
+        old[i] &= ((const uint8_t *)buf)[i];
+    }
+    if (pwrite(fileno(flash), old, size, addr) != (ssize_t)size) {
+        return EF_WRITE_ERR;
+    }
+    return EF_NO_ERR;
+}
+
+void ef_port_env_lock(void)
+{
+}
+
+void ef_port_env_unlock(void)
+{
+}
+
+void ef_port_gc_pending(void)
+{
+}
+
+uint32_t ef_port_get_time_us(void)
+{
+    return 0;
+}
+
+void ef_log_debug(const char *file, const long line, const char *format, ...)
+{
+    (void)file;
+    (void)line;
+    (void)format;
+}
+
+void ef_log_info(const char *format, ...)
+{
+    (void)format;
+}
+
+void ef_print(const char *format, ...)
+{
+    (void)format;
+}
+
+/* model of the ENV */
+static char keys[TEST_KEY_MAX][16];
+static uint8_t values[TEST_KEY_MAX][TEST_VALUE_MAX];
+static int value_lens[TEST_KEY_MAX];//-1 for not set
+
+static const ef_env default_env[] = {
+    {"boot_times", "3", 1},
+};
+
+static void reboot(void)
+{
+    init_ok = false;
+    if (ef_env_init(default_env, sizeof(default_env) / sizeof(default_env[0])) != EF_NO_ERR) {
+        printf("FAIL env init\n");
+        test_failed = 1;
+    }
+}
+
+static bool index_has(uint32_t name_crc, uint32_t addr)
+{
+    size_t i, slot;
+
+    slot = name_crc & (EF_ENV_INDEX_TABLE_SIZE - 1);
+    for (i = 0; i < EF_ENV_INDEX_TABLE_SIZE; i++, slot = (slot + 1) & (EF_ENV_INDEX_TABLE_SIZE - 1)) {
+        if (env_index_table[slot].addr == FAILED_ADDR) {
+            return false;
+        }
+        if (env_index_table[slot].addr == addr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool check_index_cb(env_node_obj_t env, void *arg1, void *arg2)
+{
+    int *missing = arg1;
+
+    (void)arg2;
+    if (env->crc_is_ok && env->status == ENV_WRITE
+            && !index_has(ef_calc_crc32(0, env->name, env->name_len), env->addr.start)) {
+        (*missing)++;
+    }
+    return false;
+}
+
+/* the index structure against the flash */
+static void check_index(const char *when)
+{
+    struct env_node_obj env;
+    size_t i, deleted = 0;
+    int missing = 0;
+
+    for (i = 0; i < EF_ENV_INDEX_TABLE_SIZE; i++) {
+        if (env_index_table[i].addr == INDEX_DELETED_ADDR) {
+            deleted++;
+        } else if (env_index_table[i].addr != FAILED_ADDR) {
+            if (!index_has(env_index_table[i].name_crc, env_index_table[i].addr)) {
+                printf("FAIL %s: slot %u is not reachable from its home\n", when, (unsigned)i);
+                test_failed = 1;
+            }
+            env.addr.start = env_index_table[i].addr;
+            read_env(&env);
+            if (!env.crc_is_ok || env.status == ENV_PRE_WRITE
+                    || ef_calc_crc32(0, env.name, env.name_len) != env_index_table[i].name_crc) {
+                printf("FAIL %s: slot %u points at a bad node %08x status %d\n", when, (unsigned)i,
+                        (unsigned)env.addr.start, env.status);
+                test_failed = 1;
+            }
+        }
+    }
+    if (deleted != env_index_deleted || deleted >= EF_ENV_INDEX_REHASH_THRESHOLD) {
+        printf("FAIL %s: %u deleted slots, counted %u\n", when, (unsigned)deleted, (unsigned)env_index_deleted);
+        test_failed = 1;
+    }
+    if (!env_index_overflow) {
+        env_iterator(&env, &missing, NULL, check_index_cb);
+        if (missing) {
+            printf("FAIL %s: %d ENV are not in the index\n", when, missing);
+            test_failed = 1;
+        }
+    }
+}
+
+static void check_model(const char *when)
+{
+    uint8_t buf[TEST_VALUE_MAX];
+    size_t len, saved;
+    int k;
+
+    for (k = 0; k < TEST_KEY_MAX; k++) {
+        len = ef_get_env_blob(keys[k], buf, sizeof(buf), &saved);
+        if (value_lens[k] < 0 ? (len != 0) : (len != (size_t)value_lens[k] || memcmp(buf, values[k], len))) {
+            printf("FAIL %s: %s has %u bytes, expected %d\n", when, keys[k], (unsigned)len, value_lens[k]);
+            test_failed = 1;
+        }
+    }
+}
+
+static void random_op(int key_num)
+{
+    uint8_t value[TEST_VALUE_MAX];
+    int k, len, i;
+
+    k = rand() % key_num;
+    if (value_lens[k] >= 0 && 0 == rand() % 4) {
+        if (ef_del_env(keys[k]) != EF_NO_ERR) {
+            printf("FAIL del %s\n", keys[k]);
+            test_failed = 1;
+        }
+        value_lens[k] = -1;
+        return;
+    }
+    len = 1 + rand() % TEST_VALUE_MAX;
+    for (i = 0; i < len; i++) {
+        value[i] = rand();
+    }
+    if (ef_set_env_blob(keys[k], value, len) != EF_NO_ERR) {
+        printf("FAIL set %s\n", keys[k]);
+        test_failed = 1;
+        return;
+    }
+    memcpy(values[k], value, len);
+    value_lens[k] = len;
+}
+
+/* fill the table with fake nodes, delete most of them, then rehash */
+static void test_rehash(void)
+{
+    static struct env_index_node saved[EF_ENV_INDEX_TABLE_SIZE];
+    static char names[EF_ENV_INDEX_TABLE_SIZE][8];
+    static bool live[EF_ENV_INDEX_TABLE_SIZE];
+    size_t saved_deleted = env_index_deleted;
+    bool saved_overflow = env_index_overflow;
+    int round, i, n;
+
+    memcpy(saved, env_index_table, sizeof(saved));
+    for (round = 0; round < 2000; round++) {
+        for (i = 0; i < EF_ENV_INDEX_TABLE_SIZE; i++) {
+            env_index_table[i].addr = FAILED_ADDR;
+        }
+        env_index_deleted = 0;
+        /*up to a full table, without any empty slot left*/
+        n = EF_ENV_INDEX_TABLE_SIZE / 2 + rand() % (EF_ENV_INDEX_TABLE_SIZE / 2 + 1);
+        for (i = 0; i < n; i++) {
+            snprintf(names[i], sizeof(names[i]), "%x", rand());
+            env_index_add(names[i], strlen(names[i]), 0x1000 + i * 4);
+            live[i] = true;
+        }
+        /*random deletes and adds, the adds reuse deleted slots*/
+        for (i = 0; i < 4 * n; i++) {
+            int j = rand() % n;
+
+            if (live[j]) {
+                env_index_del(names[j], strlen(names[j]), 0x1000 + j * 4);
+            } else {
+                env_index_add(names[j], strlen(names[j]), 0x1000 + j * 4);
+            }
+            live[j] = !live[j];
+        }
+        for (i = 0; i < n; i++) {
+            if (live[i] != index_has(ef_calc_crc32(0, names[i], strlen(names[i])), 0x1000 + i * 4)) {
+                printf("FAIL rehash round %d: node %d %s\n", round, i, live[i] ? "lost" : "not deleted");
+                test_failed = 1;
+                break;
+            }
+        }
+        for (i = 0, n = 0; i < EF_ENV_INDEX_TABLE_SIZE; i++) {
+            n += env_index_table[i].addr == INDEX_DELETED_ADDR;
+        }
+        if ((size_t)n != env_index_deleted || n >= EF_ENV_INDEX_REHASH_THRESHOLD) {
+            printf("FAIL rehash round %d: %d deleted slots, counted %u\n", round, n, (unsigned)env_index_deleted);
+            test_failed = 1;
+        }
+    }
+    memcpy(env_index_table, saved, sizeof(saved));
+    env_index_deleted = saved_deleted;
+    env_index_overflow = saved_overflow;
+}
+
+/* a set that fails half way must not leave its node in the index */
+static void test_write_fail(int key_num)
+{
+    uint8_t value[TEST_VALUE_MAX], buf[TEST_VALUE_MAX];
+    size_t len, saved;
+    int step, k;
+
+    for (step = 1; step <= 8; step++) {
+        k = rand() % key_num;
+        memset(value, step, sizeof(value));
+        write_fail_countdown = step;
+        ef_set_env_blob(keys[k], value, sizeof(value));
+        write_fail_countdown = 0;
+        check_index("write fail");
+        reboot();
+        check_index("write fail reboot");
+        /*either value is fine, the model follows the flash*/
+        len = ef_get_env_blob(keys[k], buf, sizeof(buf), &saved);
+        if (len == sizeof(value) && !memcmp(buf, value, len)) {
+            memcpy(values[k], value, len);
+            value_lens[k] = len;
+        }
+        check_model("write fail");
+    }
+}
+
+static void bench(int key_num)
+{
+    struct env_node_obj env;
+    unsigned long reads;
+    int k, found;
+
+    reads = flash_reads;
+    for (k = 0, found = 0; k < key_num; k++) {
+        found += find_env(keys[k], &env);
+    }
+    printf("%d keys, %d set: %.1f flash reads per lookup with the index", key_num, found,
+            (double)(flash_reads - reads) / key_num);
+    reads = flash_reads;
+    for (k = 0; k < key_num; k++) {
+        find_env_no_cache(keys[k], &env);
+    }
+    printf(", %.1f with the scan\n", (double)(flash_reads - reads) / key_num);
+}
+
+int main(void)
+{
+    int k, i;
+
+    srand(1);
+    flash = tmpfile();
+    if (NULL == flash || ftruncate(fileno(flash), ENV_AREA_SIZE)) {
+        printf("FAIL flash file\n");
+        return 1;
+    }
+    for (k = 0; k < TEST_KEY_MAX; k++) {
+        snprintf(keys[k], sizeof(keys[k]), "key_%d", k);
+        value_lens[k] = -1;
+    }
+    reboot();
+
+    test_rehash();
+
+    /*fits the table*/
+    for (i = 0; i < 8000; i++) {
+        random_op(90);
+        check_index("set");
+        if (0 == i % 1000) {
+            check_model("set");
+            reboot();
+            check_index("reboot");
+            check_model("reboot");
+        }
+    }
+    if (env_index_overflow) {
+        printf("FAIL index overflow with 90 keys\n");
+        test_failed = 1;
+    }
+    bench(90);
+    test_write_fail(90);
+
+    /*more ENV than slots, the missed lookups scan the flash*/
+    for (i = 0; i < 10000; i++) {
+        random_op(TEST_KEY_MAX);
+        if (0 == i % 1000) {
+            check_index("overflow");
+            check_model("overflow");
+        }
+    }
+    check_model("overflow");
+    if (!env_index_overflow) {
+        printf("FAIL no index overflow with %d keys\n", TEST_KEY_MAX);
+        test_failed = 1;
+    }
+    bench(TEST_KEY_MAX);
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
@@ -49,6 +49,12 @@ size_t ef_get_env_blob(const char *key, void *value_buf, size_t buf_len, size_t
 bool ef_get_env_obj(const char *key, env_node_obj_t env);
 size_t ef_read_env_value(env_node_obj_t env, uint8_t *value_buf, size_t buf_len);
 EfErrCode ef_set_env_blob(const char *key, const void *value_buf, size_t buf_len);
+EfErrCode ef_env_batch_begin(ef_env_batch_t batch, void *buf, size_t size);
+EfErrCode ef_env_batch_set(ef_env_batch_t batch, const char *key, const void *value_buf, size_t buf_len);
+EfErrCode ef_env_batch_commit(ef_env_batch_t batch);
+bool ef_env_gc_step(size_t env_num);
+void ef_env_gc_get_stat(ef_env_gc_stat_t stat);
+void ef_env_gc_reset_stat(void);
 
 /* ef_env.c, ef_env_legacy_wl.c and ef_env_legacy.c */
 EfErrCode ef_load_env(void);
@@ -101,6 +107,8 @@ EfErrCode ef_port_erase(uint32_t addr, size_t size);
 EfErrCode ef_port_write(uint32_t addr, const uint32_t *buf, size_t size);
 void ef_port_env_lock(void);
 void ef_port_env_unlock(void);
+void ef_port_gc_pending(void);
+uint32_t ef_port_get_time_us(void);
 void ef_log_debug(const char *file, const long line, const char *format, ...);
 void ef_log_info(const char *format, ...);
 void ef_print(const char *format, ...);
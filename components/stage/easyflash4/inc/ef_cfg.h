@@ -53,6 +53,20 @@
  */
 #define EF_ENV_VER_NUM            0 /* @note you must define it for a value, such as 0 */
 
+/* Incremental GC, set ENV only moves a few ENV per call, the GC task of the port runs ef_env_gc_step() for the rest. */
+#define EF_ENV_USING_INCREMENTAL_GC
+
+/**
+ * ENV index table size in slots (power of 2, 8 bytes RAM per slot), it finds an ENV without scanning the flash.
+ * Set it above the ENV number. 0: disabled.
+ * The default 128 slots take 1KB of RAM and stay under a 3/4 load up to 96 ENVs, a 4K PSM holds about 64 ENVs of
+ * 64 bytes (24 byte header, short name and value). Raise it for a larger PSM with many small ENVs; an ENV that
+ * does not fit is still found, by scanning the flash.
+ */
+#ifndef EF_ENV_INDEX_TABLE_SIZE
+#define EF_ENV_INDEX_TABLE_SIZE   128
+#endif
+
 #endif /* EF_USING_ENV */
 
 /* using IAP function */
@@ -76,6 +76,26 @@ typedef struct _ef_env {
     size_t value_len;
 } ef_env, *ef_env_t;
 
+/* ENV GC statistics */
+typedef struct _ef_env_gc_stat {
+    uint32_t steps;                              /**< incremental GC step count */
+    uint32_t full_collects;                      /**< blocking GC count, full or for a new ENV which doesn't fit */
+    uint32_t moved_envs;                         /**< ENV number moved by GC */
+    uint32_t moved_bytes;                        /**< ENV bytes moved by GC */
+    uint32_t erased_sectors;                     /**< sector number erased by GC */
+    uint32_t written_bytes;                      /**< ENV bytes written by user, write amplification is (written + moved) / written */
+    uint32_t total_us;                           /**< total GC time */
+    uint32_t max_stall_us;                       /**< the worst GC time in one call */
+} ef_env_gc_stat, *ef_env_gc_stat_t;
+
+/* ENV batch, the records are packed in the user buffer until commit */
+typedef struct _ef_env_batch {
+    uint8_t *buf;                                /**< records buffer */
+    size_t size;                                 /**< records buffer size */
+    size_t used;                                 /**< used size of records buffer */
+    size_t num;                                  /**< ENV number in batch */
+} ef_env_batch, *ef_env_batch_t;
+
 /* EasyFlash error code */
 typedef enum {
     EF_NO_ERR,
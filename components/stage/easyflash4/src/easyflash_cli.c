@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 
 #include <cli.h>
 #include <easyflash.h>
@@ -39,6 +40,30 @@ static void psm_erase_cmd([[gnu::unused]] char *buf, [[gnu::unused]] int len, [[
     ef_env_set_default();
 }
 
+#ifndef EF_ENV_USING_LEGACY_MODE
+static void psm_gc_cmd([[gnu::unused]] char *buf, [[gnu::unused]] int len, int argc, char **argv)
+{
+    ef_env_gc_stat stat;
+
+    if (argc == 2 && !strcmp(argv[1], "reset")) {
+        ef_env_gc_reset_stat();
+        return;
+    } else if (argc == 2 && !strcmp(argv[1], "step")) {
+        printf("gc %s\r\n", ef_env_gc_step(0) ? "pending" : "done");
+    } else if (argc != 1) {
+        printf("usage: psm_gc [step|reset]\r\n");
+        return;
+    }
+
+    ef_env_gc_get_stat(&stat);
+    printf("steps %lu, full collects %lu\r\n", stat.steps, stat.full_collects);
+    printf("moved %lu envs, %lu bytes, erased %lu sectors\r\n", stat.moved_envs, stat.moved_bytes, stat.erased_sectors);
+    printf("written %lu bytes, write amplification %lu%%\r\n", stat.written_bytes,
+            stat.written_bytes ? (stat.written_bytes + stat.moved_bytes) * 100 / stat.written_bytes : 0);
+    printf("gc time %luus, max stall %luus\r\n", stat.total_us, stat.max_stall_us);
+}
+#endif
+
 void psm_test_cmd([[gnu::unused]] char *buf, [[gnu::unused]] int len, [[gnu::unused]] int argc, [[gnu::unused]] char **argv)
 {
     const char *def_name = "1234567890123456789012345678901234567890123456789012345678901234";
@@ -104,6 +129,9 @@ static const struct cli_command cmds_user[] STATIC_CLI_CMD_ATTRIBUTE = {
         { "psm_dump", "psm dump", psm_dump_cmd },
         { "psm_erase", "psm dump", psm_erase_cmd },
         { "psm_test", "psm test", psm_test_cmd },
+#ifndef EF_ENV_USING_LEGACY_MODE
+        { "psm_gc", "psm gc statistics [step|reset]", psm_gc_cmd },
+#endif
 };
 
 int easyflash_cli_init(void)
@@ -65,6 +65,26 @@
 #define EF_GC_EMPTY_SEC_THRESHOLD                1
 #endif
 
+/* the total remain empty sector threshold before incremental GC, it starts early to leave room for the steps */
+#ifndef EF_GC_INCREMENTAL_SEC_THRESHOLD
+#define EF_GC_INCREMENTAL_SEC_THRESHOLD          (EF_GC_EMPTY_SEC_THRESHOLD + 1)
+#endif
+
+/* the min garbage size of a sector which is collected by incremental GC before the GC threshold */
+#ifndef EF_GC_INCREMENTAL_MIN_GARBAGE
+#define EF_GC_INCREMENTAL_MIN_GARBAGE            (SECTOR_SIZE / 4)
+#endif
+
+/* the max ENV number which will be moved by the incremental GC step in set ENV */
+#ifndef EF_GC_STEP_ENV_NUM
+#define EF_GC_STEP_ENV_NUM                       4
+#endif
+
+/* the max sector number which is collected by the blocking GC when a new ENV doesn't fit, with incremental GC */
+#ifndef EF_GC_BLOCKING_SEC_NUM
+#define EF_GC_BLOCKING_SEC_NUM                   2
+#endif
+
 /* the ENV cache table size, it will improve ENV search speed when using cache */
 #ifndef EF_ENV_CACHE_TABLE_SIZE
 #define EF_ENV_CACHE_TABLE_SIZE                  16
@@ -83,10 +103,30 @@
 #define EF_ENV_USING_CACHE
 #endif
 
+/* the ENV index table size, it's set in ef_cfg.h, 0: disable the index */
+#ifndef EF_ENV_INDEX_TABLE_SIZE
+#define EF_ENV_INDEX_TABLE_SIZE                  0
+#endif
+
+/* the deleted index slots threshold before the index is rehashed, they make the lookups longer */
+#ifndef EF_ENV_INDEX_REHASH_THRESHOLD
+#define EF_ENV_INDEX_REHASH_THRESHOLD            (EF_ENV_INDEX_TABLE_SIZE / 4)
+#endif
+
+#if (EF_ENV_INDEX_TABLE_SIZE & (EF_ENV_INDEX_TABLE_SIZE - 1)) != 0
+#error "The ENV index table size must be a power of 2"
+#endif
+
+#if EF_ENV_INDEX_TABLE_SIZE > 0
+#define EF_ENV_USING_INDEX
+#endif
+
 /* the sector is not combined value */
 #define SECTOR_NOT_COMBINED                      0xFFFFFFFF
 /* the next address is get failed */
 #define FAILED_ADDR                              0xFFFFFFFF
+/* the index slot is deleted, the probe sequence continues over it */
+#define INDEX_DELETED_ADDR                       0xFFFFFFFE
 
 /* Return the most contiguous size aligned at specified width. RT_ALIGN(13, 4)
  * would return 16.
@@ -131,6 +171,10 @@
 #define ENV_NAME_LEN_OFFSET                      ((unsigned long)(&((struct env_hdr_data *)0)->name_len))
 
 #define VER_NUM_ENV_NAME                         "__ver_num__"
+/* the batch commit marker, it is in front of the batch records, value is the records size */
+#define BATCH_ENV_NAME                           "__ef_batch__"
+#define BATCH_ENV_NAME_LEN                       (sizeof(BATCH_ENV_NAME) - 1)
+#define BATCH_HDR_SIZE                           (ENV_HDR_DATA_SIZE + EF_WG_ALIGN(BATCH_ENV_NAME_LEN) + EF_WG_ALIGN(sizeof(uint32_t)))
 
 enum sector_store_status {
     SECTOR_STORE_UNUSED,
@@ -198,7 +242,18 @@ struct sector_cache_node {
 };
 typedef struct sector_cache_node *sector_cache_node_t;
 
+struct env_index_node {
+    uint32_t addr;                               /**< ENV node address, FAILED_ADDR: empty slot */
+    uint32_t name_crc;                           /**< ENV name's CRC32 value, it's the home slot too */
+};
+typedef struct env_index_node *env_index_node_t;
+
 static void gc_collect(void);
+static bool do_gc(sector_meta_data_t sector, void *arg1, void *arg2);
+static void gc_stat_stall(uint32_t start_time);
+#ifdef EF_ENV_USING_INCREMENTAL_GC
+static bool gc_collect_step(size_t env_num);
+#endif
 
 /* ENV start address in flash */
 static uint32_t env_start_addr = 0;
@@ -212,6 +267,16 @@ static bool init_ok = false;
 static bool gc_request = false;
 /* is in recovery check status when first reboot */
 static bool in_recovery_check = false;
+/* the incremental GC has work to do */
+static bool gc_pending = false;
+/* the incremental GC step is moving ENV, it only collects one sector, so the other dirty sectors can be used */
+static bool gc_stepping = false;
+/* the sector which is collecting by the incremental GC */
+static uint32_t gc_sec_addr = FAILED_ADDR;
+/* the last checked ENV address in the collecting sector */
+static uint32_t gc_env_addr = FAILED_ADDR;
+/* GC statistics */
+static ef_env_gc_stat gc_stat = { 0 };
 
 #ifdef EF_ENV_USING_CACHE
 /* ENV cache table */
@@ -220,6 +285,17 @@ struct env_cache_node env_cache_table[EF_ENV_CACHE_TABLE_SIZE] = { 0 };
 struct sector_cache_node sector_cache_table[EF_SECTOR_CACHE_TABLE_SIZE] = { 0 };
 #endif /* EF_ENV_USING_CACHE */
 
+#ifdef EF_ENV_USING_INDEX
+/* ENV index table, open addressing by ENV name's CRC32, holds every ENV_WRITE node */
+static struct env_index_node env_index_table[EF_ENV_INDEX_TABLE_SIZE];
+/* the index is built and all ENV changes are tracked in it */
+static bool env_index_ready = false;
+/* some ENV is not in the index (table full), a missed lookup must scan the flash */
+static bool env_index_overflow = false;
+/* the deleted slots number in the index */
+static size_t env_index_deleted = 0;
+#endif /* EF_ENV_USING_INDEX */
+
 static size_t set_status(uint8_t status_table[], size_t status_num, size_t status_index)
 {
     size_t byte_index = ~0UL;
@@ -471,9 +547,9 @@ static uint32_t find_next_env_addr(uint32_t start, uint32_t end)
         ef_port_read(start, (uint32_t *) buf, sizeof(buf));
         for (i = 0; i < sizeof(buf) - sizeof(uint32_t) && start + i < end; i++) {
 #ifndef EF_BIG_ENDIAN            /* Little Endian Order */
-            magic = buf[i] + (buf[i + 1] << 8) + (buf[i + 2] << 16) + (buf[i + 3] << 24);
+            magic = buf[i] + (buf[i + 1] << 8) + (buf[i + 2] << 16) + ((uint32_t)buf[i + 3] << 24);
 #else                       /* Big Endian Order */
-            magic = buf[i + 3] + (buf[i + 2] << 8) + (buf[i + 1] << 16) + (buf[i] << 24);
+            magic = buf[i + 3] + (buf[i + 2] << 8) + (buf[i + 1] << 16) + ((uint32_t)buf[i] << 24);
 #endif
             if (magic == ENV_MAGIC_WORD && (start + i - ENV_MAGIC_OFFSET) >= start_bak) {
                 return start + i - ENV_MAGIC_OFFSET;
@@ -734,6 +810,190 @@ static bool find_env_no_cache(const char *key, env_node_obj_t env)
     return find_ok;
 }
 
+#ifdef EF_ENV_USING_INDEX
+static void env_index_add(const char *name, size_t name_len, uint32_t addr)
+{
+    uint32_t name_crc32, slot_addr;
+    size_t i, slot, free_slot = EF_ENV_INDEX_TABLE_SIZE;
+
+    if (!env_index_ready) {
+        return;
+    }
+
+    name_crc32 = ef_calc_crc32(0, name, name_len);
+    slot = name_crc32 & (EF_ENV_INDEX_TABLE_SIZE - 1);
+    for (i = 0; i < EF_ENV_INDEX_TABLE_SIZE; i++, slot = (slot + 1) & (EF_ENV_INDEX_TABLE_SIZE - 1)) {
+        slot_addr = env_index_table[slot].addr;
+        if (slot_addr == addr) {
+            /* already indexed */
+            return;
+        } else if (slot_addr == FAILED_ADDR) {
+            if (free_slot == EF_ENV_INDEX_TABLE_SIZE) {
+                free_slot = slot;
+            }
+            break;
+        } else if (slot_addr == INDEX_DELETED_ADDR && free_slot == EF_ENV_INDEX_TABLE_SIZE) {
+            free_slot = slot;
+        }
+    }
+
+    if (free_slot == EF_ENV_INDEX_TABLE_SIZE) {
+        EF_DEBUG("Warning: The ENV index table is full, (%.*s) is not indexed.\r\n", name_len, name);
+        env_index_overflow = true;
+        return;
+    }
+
+    if (env_index_table[free_slot].addr == INDEX_DELETED_ADDR) {
+        env_index_deleted--;
+    }
+    env_index_table[free_slot].addr = addr;
+    env_index_table[free_slot].name_crc = name_crc32;
+}
+
+/*
+ * remove all deleted slots when there are too many of them, the index holds the same ENV after it.
+ * The deleted slots are emptied and every node is placed again, in the first slot from its home which has no
+ * placed node: it's moved to an empty slot or swapped with a node not placed yet. A placed slot is never emptied,
+ * so every probe sequence still reaches its node, also in a table without empty slots.
+ */
+static void env_index_rehash(void)
+{
+    uint32_t placed[(EF_ENV_INDEX_TABLE_SIZE + 31) / 32] = { 0 };
+    struct env_index_node node;
+    size_t i, slot;
+
+    if (env_index_deleted < EF_ENV_INDEX_REHASH_THRESHOLD) {
+        return;
+    }
+
+    for (i = 0; i < EF_ENV_INDEX_TABLE_SIZE; i++) {
+        if (env_index_table[i].addr == INDEX_DELETED_ADDR) {
+            env_index_table[i].addr = FAILED_ADDR;
+        }
+    }
+    for (i = 0; i < EF_ENV_INDEX_TABLE_SIZE; i++) {
+        while (env_index_table[i].addr != FAILED_ADDR && !(placed[i / 32] & (1UL << (i % 32)))) {
+            slot = env_index_table[i].name_crc & (EF_ENV_INDEX_TABLE_SIZE - 1);
+            while (env_index_table[slot].addr != FAILED_ADDR && (placed[slot / 32] & (1UL << (slot % 32)))) {
+                slot = (slot + 1) & (EF_ENV_INDEX_TABLE_SIZE - 1);
+            }
+            placed[slot / 32] |= 1UL << (slot % 32);
+            if (slot == i) {
+                break;
+            }
+            /* an empty slot takes the node, a node not placed yet is swapped in and placed next */
+            node = env_index_table[slot];
+            env_index_table[slot] = env_index_table[i];
+            env_index_table[i] = node;
+        }
+    }
+    env_index_deleted = 0;
+}
+
+static void env_index_del(const char *name, size_t name_len, uint32_t addr)
+{
+    uint32_t slot_addr;
+    size_t i, slot;
+
+    if (!env_index_ready) {
+        return;
+    }
+
+    slot = ef_calc_crc32(0, name, name_len) & (EF_ENV_INDEX_TABLE_SIZE - 1);
+    for (i = 0; i < EF_ENV_INDEX_TABLE_SIZE; i++, slot = (slot + 1) & (EF_ENV_INDEX_TABLE_SIZE - 1)) {
+        slot_addr = env_index_table[slot].addr;
+        if (slot_addr == FAILED_ADDR) {
+            return;
+        } else if (slot_addr == addr) {
+            env_index_table[slot].addr = INDEX_DELETED_ADDR;
+            env_index_deleted++;
+            env_index_rehash();
+            return;
+        }
+    }
+}
+
+/*
+ * drop all index slots which point into the sector, the sector will be erased
+ */
+static void env_index_del_sector(uint32_t sec_addr)
+{
+    size_t i;
+
+    if (!env_index_ready) {
+        return;
+    }
+
+    for (i = 0; i < EF_ENV_INDEX_TABLE_SIZE; i++) {
+        if (env_index_table[i].addr >= sec_addr && env_index_table[i].addr < sec_addr + SECTOR_SIZE) {
+            env_index_table[i].addr = INDEX_DELETED_ADDR;
+            env_index_deleted++;
+        }
+    }
+    env_index_rehash();
+}
+
+static bool env_index_find(const char *key, size_t key_len, env_node_obj_t env)
+{
+    uint32_t name_crc32, slot_addr;
+    size_t i, slot;
+
+    name_crc32 = ef_calc_crc32(0, key, key_len);
+    slot = name_crc32 & (EF_ENV_INDEX_TABLE_SIZE - 1);
+    for (i = 0; i < EF_ENV_INDEX_TABLE_SIZE; i++, slot = (slot + 1) & (EF_ENV_INDEX_TABLE_SIZE - 1)) {
+        slot_addr = env_index_table[slot].addr;
+        if (slot_addr == FAILED_ADDR) {
+            break;
+        }
+        if (slot_addr == INDEX_DELETED_ADDR || env_index_table[slot].name_crc != name_crc32) {
+            continue;
+        }
+        /* the CRC32 only filter the candidates, check the name on flash */
+        env->addr.start = slot_addr;
+        read_env(env);
+        if (env->crc_is_ok && env->status == ENV_WRITE && env->name_len == key_len
+                && !strncmp(env->name, key, key_len)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool env_index_build_cb(env_node_obj_t env, void *arg1, [[gnu::unused]] void *arg2)
+{
+    size_t *count = arg1;
+
+    if (env->crc_is_ok && env->status == ENV_WRITE) {
+        env_index_add(env->name, env->name_len, env->addr.start);
+        (*count)++;
+    }
+
+    return false;
+}
+
+/*
+ * build the ENV index by scan all ENV once, the later ENV changes will keep it update
+ */
+static void env_index_build(void)
+{
+    struct env_node_obj env;
+    size_t i, count = 0;
+
+    for (i = 0; i < EF_ENV_INDEX_TABLE_SIZE; i++) {
+        env_index_table[i].addr = FAILED_ADDR;
+    }
+    env_index_overflow = false;
+    env_index_deleted = 0;
+    env_index_ready = true;
+
+    env_iterator(&env, &count, NULL, env_index_build_cb);
+
+    EF_DEBUG("The ENV index has %d nodes, table size is %d%s.\r\n", count, EF_ENV_INDEX_TABLE_SIZE,
+            env_index_overflow ? " (overflow)" : "");
+}
+#endif /* EF_ENV_USING_INDEX */
+
 static bool find_env(const char *key, env_node_obj_t env)
 {
     bool find_ok = false;
@@ -747,7 +1007,19 @@ static bool find_env(const char *key, env_node_obj_t env)
     }
 #endif /* EF_ENV_USING_CACHE */
 
+#ifdef EF_ENV_USING_INDEX
+    if (env_index_ready) {
+        find_ok = env_index_find(key, strlen(key), env);
+        /* the ENV is not exist when the index hold all ENV */
+        if (!find_ok && env_index_overflow) {
+            find_ok = find_env_no_cache(key, env);
+        }
+    } else {
+        find_ok = find_env_no_cache(key, env);
+    }
+#else
     find_ok = find_env_no_cache(key, env);
+#endif /* EF_ENV_USING_INDEX */
 
 #ifdef EF_ENV_USING_CACHE
     if (find_ok) {
@@ -964,6 +1236,10 @@ static EfErrCode format_sector(uint32_t addr, uint32_t combined_value)
         /* delete the sector cache */
         update_sector_cache(addr, addr + SECTOR_SIZE);
 #endif /* EF_ENV_USING_CACHE */
+
+#ifdef EF_ENV_USING_INDEX
+        env_index_del_sector(addr);
+#endif /* EF_ENV_USING_INDEX */
     }
 
     return result;
@@ -1039,10 +1315,10 @@ static bool alloc_env_cb(sector_meta_data_t sector, void *arg1, void *arg2)
 
     /* 1. sector has space
      * 2. the NO dirty sector
-     * 3. the dirty sector only when the gc_request is false */
+     * 3. the dirty sector only when the gc_request is false or in the incremental GC step */
     if (sector->check_ok && sector->remain > *env_size
             && ((sector->status.dirty == SECTOR_DIRTY_FALSE)
-                    || (sector->status.dirty == SECTOR_DIRTY_TRUE && !gc_request))) {
+                    || (sector->status.dirty == SECTOR_DIRTY_TRUE && (!gc_request || gc_stepping)))) {
         *empty_env = sector->empty_env;
         return true;
     }
@@ -1078,6 +1354,8 @@ static EfErrCode del_env(const char *key, env_node_obj_t old_env, bool complete_
     EfErrCode result = EF_NO_ERR;
     uint32_t dirty_status_addr;
     static bool last_is_complete_del = false;
+    /* the found ENV, old_env points to it until the end */
+    struct env_node_obj env;
 
 #if (ENV_STATUS_TABLE_SIZE >= DIRTY_STATUS_TABLE_SIZE)
     uint8_t status_table[ENV_STATUS_TABLE_SIZE];
@@ -1087,7 +1365,6 @@ static EfErrCode del_env(const char *key, env_node_obj_t old_env, bool complete_
 
     /* need find ENV */
     if (!old_env) {
-        struct env_node_obj env;
         /* find ENV */
         if (find_env(key, &env)) {
             old_env = &env;
@@ -1103,6 +1380,12 @@ static EfErrCode del_env(const char *key, env_node_obj_t old_env, bool complete_
     } else {
         result = write_status(old_env->addr.start, status_table, ENV_STATUS_NUM, ENV_DELETED);
 
+#ifdef EF_ENV_USING_INDEX
+        if (result == EF_NO_ERR) {
+            env_index_del(old_env->name, old_env->name_len, old_env->addr.start);
+        }
+#endif /* EF_ENV_USING_INDEX */
+
         if (!last_is_complete_del && result == EF_NO_ERR) {
 #ifdef EF_ENV_USING_CACHE
             /* delete the ENV in flash and cache */
@@ -1139,12 +1422,11 @@ static EfErrCode move_env(env_node_obj_t env)
     uint32_t env_addr;
     struct sector_meta_data sector;
 
-    /* prepare to delete the current ENV */
-    if (env->status == ENV_WRITE) {
-        del_env(NULL, env, false);
-    }
-
     if ((env_addr = alloc_env(&sector, env->len)) != FAILED_ADDR) {
+        /* prepare to delete the current ENV, only when it has new space, or it will lost on alloc failed */
+        if (env->status == ENV_WRITE) {
+            del_env(NULL, env, false);
+        }
         if (in_recovery_check) {
             struct env_node_obj env_bak;
             char name[EF_ENV_NAME_MAX + 1] = { 0 };
@@ -1178,15 +1460,25 @@ static EfErrCode move_env(env_node_obj_t env)
             ef_port_read(env->addr.start + ENV_MAGIC_OFFSET + len, (uint32_t *) buf, EF_WG_ALIGN(size));
             result = ef_port_write(env_addr + ENV_MAGIC_OFFSET + len, (uint32_t *) buf, size);
         }
-        write_status(env_addr, status_table, ENV_STATUS_NUM, ENV_WRITE);
+        result = write_status(env_addr, status_table, ENV_STATUS_NUM, ENV_WRITE);
 
 #ifdef EF_ENV_USING_CACHE
         update_sector_cache(EF_ALIGN_DOWN(env_addr, SECTOR_SIZE),
                 env_addr + ENV_HDR_DATA_SIZE + EF_WG_ALIGN(env->name_len) + EF_WG_ALIGN(env->value_len));
         update_env_cache(env->name, env->name_len, env_addr);
 #endif /* EF_ENV_USING_CACHE */
+
+#ifdef EF_ENV_USING_INDEX
+        /* only an ENV_WRITE node is indexed */
+        if (result == EF_NO_ERR) {
+            env_index_add(env->name, env->name_len, env_addr);
+        }
+#endif /* EF_ENV_USING_INDEX */
     }
 
+    gc_stat.moved_envs++;
+    gc_stat.moved_bytes += env->len;
+
     EF_DEBUG("Moved the ENV (%.*s) from 0x%08X to 0x%08X.\r\n", env->name_len, env->name, env->addr.start, env_addr);
 
 __exit:
@@ -1195,18 +1487,73 @@ __exit:
     return result;
 }
 
+#ifdef EF_ENV_USING_INCREMENTAL_GC
+static bool gc_one_cb(sector_meta_data_t sector, void *arg1, void *arg2)
+{
+    if (sector->check_ok && (sector->status.dirty == SECTOR_DIRTY_TRUE || sector->status.dirty == SECTOR_DIRTY_GC)) {
+        do_gc(sector, arg1, arg2);
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * The blocking GC when a new ENV doesn't fit. It collects the full dirty sector which has the most garbage, one by
+ * one until the ENV fits, at most EF_GC_BLOCKING_SEC_NUM sectors. A dirty using sector is only collected when no
+ * full sector has garbage. The ENV is full when it still doesn't fit.
+ */
+static uint32_t gc_collect_for_env(sector_meta_data_t sector, size_t env_size)
+{
+    uint32_t empty_env = FAILED_ADDR, erased_sectors, stall, start_time = ef_port_get_time_us();
+    struct sector_meta_data gc_sector;
+    size_t i;
+
+    for (i = 0; i < EF_GC_BLOCKING_SEC_NUM; i++) {
+        erased_sectors = gc_stat.erased_sectors;
+        /* finish the collecting sector or pick a new one, all ENV in it are moved */
+        gc_collect_step(SIZE_MAX);
+        if (gc_stat.erased_sectors == erased_sectors) {
+            if (gc_sec_addr != FAILED_ADDR) {
+                /* an ENV in the collecting sector can't be moved, no more space */
+                break;
+            }
+            /* no full sector has garbage, collect one dirty sector of any status */
+            gc_request = true;
+            sector_iterator(&gc_sector, SECTOR_STORE_UNUSED, NULL, NULL, gc_one_cb, false);
+            gc_request = false;
+            if (gc_stat.erased_sectors == erased_sectors) {
+                break;
+            }
+        }
+        if ((empty_env = alloc_env(sector, env_size)) != FAILED_ADDR) {
+            break;
+        }
+    }
+    gc_stat.full_collects++;
+
+    /* the steps count their own time, only the whole stall is recorded here */
+    stall = ef_port_get_time_us() - start_time;
+    if (stall > gc_stat.max_stall_us) {
+        gc_stat.max_stall_us = stall;
+    }
+
+    return empty_env;
+}
+#endif /* EF_ENV_USING_INCREMENTAL_GC */
+
 static uint32_t new_env(sector_meta_data_t sector, size_t env_size)
 {
-    bool already_gc = false;
     uint32_t empty_env = FAILED_ADDR;
 
-__retry:
-
-    if ((empty_env = alloc_env(sector, env_size)) == FAILED_ADDR && gc_request && !already_gc) {
+    if ((empty_env = alloc_env(sector, env_size)) == FAILED_ADDR && gc_request) {
         EF_DEBUG("Warning: Alloc an ENV (size %d) failed when new ENV. Now will GC then retry.\r\n", env_size);
+#ifdef EF_ENV_USING_INCREMENTAL_GC
+        empty_env = gc_collect_for_env(sector, env_size);
+#else
         gc_collect();
-        already_gc = true;
-        goto __retry;
+        empty_env = alloc_env(sector, env_size);
+#endif
     }
 
     return empty_env;
@@ -1219,6 +1566,16 @@ static uint32_t new_env_by_kv(sector_meta_data_t sector, size_t key_len, size_t
     return new_env(sector, env_len);
 }
 
+static void gc_stat_stall(uint32_t start_time)
+{
+    uint32_t stall = ef_port_get_time_us() - start_time;
+
+    gc_stat.total_us += stall;
+    if (stall > gc_stat.max_stall_us) {
+        gc_stat.max_stall_us = stall;
+    }
+}
+
 static bool gc_check_cb(sector_meta_data_t sector, void *arg1, [[gnu::unused]] void *arg2)
 {
     size_t *empty_sec = arg1;
@@ -1251,6 +1608,7 @@ static bool do_gc(sector_meta_data_t sector, [[gnu::unused]] void *arg1, [[gnu::
             }
         }
         format_sector(sector->addr, SECTOR_NOT_COMBINED);
+        gc_stat.erased_sectors++;
         EF_DEBUG("Collect a sector @0x%08X\r\n", sector->addr);
     }
 
@@ -1266,6 +1624,7 @@ static void gc_collect(void)
 {
     struct sector_meta_data sector;
     size_t empty_sec = 0;
+    uint32_t start_time = ef_port_get_time_us();
 
     /* GC check the empty sector number */
     sector_iterator(&sector, SECTOR_STORE_EMPTY, &empty_sec, NULL, gc_check_cb, false);
@@ -1274,9 +1633,122 @@ static void gc_collect(void)
     EF_DEBUG("The remain empty sector is %d, GC threshold is %d.\r\n", empty_sec, EF_GC_EMPTY_SEC_THRESHOLD);
     if (empty_sec <= EF_GC_EMPTY_SEC_THRESHOLD) {
         sector_iterator(&sector, SECTOR_STORE_UNUSED, NULL, NULL, do_gc, false);
+        gc_stat.full_collects++;
+        /* the collecting sector of incremental GC is done too */
+        gc_sec_addr = FAILED_ADDR;
+        gc_pending = false;
     }
 
     gc_request = false;
+    gc_stat_stall(start_time);
+}
+
+static bool gc_pick_cb(sector_meta_data_t sector, void *arg1, void *arg2)
+{
+    uint32_t *sec_addr = arg1;
+    size_t *max_garbage = arg2, garbage = 0;
+    struct env_node_obj env;
+
+    if (!sector->check_ok) {
+        return false;
+    }
+    if (sector->status.dirty == SECTOR_DIRTY_GC) {
+        /* resume the interrupted collecting first */
+        *sec_addr = sector->addr;
+        return true;
+    }
+    /* the using sector is still filling, pick the full sector which has the most garbage */
+    if (sector->status.dirty == SECTOR_DIRTY_TRUE && sector->status.store == SECTOR_STORE_FULL) {
+        env.addr.start = FAILED_ADDR;
+        while ((env.addr.start = get_next_env_addr(sector, &env)) != FAILED_ADDR) {
+            read_env(&env);
+            if (!env.crc_is_ok || (env.status != ENV_WRITE && env.status != ENV_PRE_DELETE)) {
+                garbage += env.crc_is_ok ? env.len : EF_WG_ALIGN(1);
+            }
+        }
+        if (garbage > *max_garbage) {
+            *max_garbage = garbage;
+            *sec_addr = sector->addr;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * The incremental GC step, it moves at most env_num ENV or erases one sector.
+ * The GC state is kept between steps, the sector is marked as SECTOR_DIRTY_GC
+ * when collecting, so the recovery after power off is the same as gc_collect.
+ *
+ * @return true when there is more GC work
+ */
+static bool gc_collect_step(size_t env_num)
+{
+    struct sector_meta_data sector;
+    struct env_node_obj env;
+    size_t moved = 0, empty_sec = 0, max_garbage;
+    uint32_t start_time = ef_port_get_time_us();
+    uint8_t status_table[DIRTY_STATUS_TABLE_SIZE];
+
+    if (gc_sec_addr == FAILED_ADDR) {
+        sector_iterator(&sector, SECTOR_STORE_EMPTY, &empty_sec, NULL, gc_check_cb, false);
+        if (empty_sec <= EF_GC_INCREMENTAL_SEC_THRESHOLD) {
+            /* collecting a sector which has little garbage only moves the ENV around, it is worth only at the GC threshold */
+            max_garbage = empty_sec > EF_GC_EMPTY_SEC_THRESHOLD ? EF_GC_INCREMENTAL_MIN_GARBAGE - 1 : 0;
+            sector_iterator(&sector, SECTOR_STORE_UNUSED, &gc_sec_addr, &max_garbage, gc_pick_cb, false);
+        }
+        if (gc_sec_addr == FAILED_ADDR) {
+            /* enough empty sectors or no dirty sector */
+            gc_pending = false;
+            return false;
+        }
+        gc_env_addr = FAILED_ADDR;
+    }
+
+    read_sector_meta_data(gc_sec_addr, &sector, false);
+    if (!sector.check_ok || (sector.status.dirty != SECTOR_DIRTY_TRUE && sector.status.dirty != SECTOR_DIRTY_GC)) {
+        /* the sector is already collected */
+        gc_sec_addr = FAILED_ADDR;
+        return gc_pending;
+    }
+    if (sector.status.dirty == SECTOR_DIRTY_TRUE) {
+        write_status(sector.addr + SECTOR_DIRTY_OFFSET, status_table, SECTOR_DIRTY_STATUS_NUM, SECTOR_DIRTY_GC);
+    }
+
+    /* the moved ENV can use the empty sectors which are reserved for GC */
+    gc_request = true;
+    gc_stepping = true;
+    env.addr.start = gc_env_addr;
+    if (env.addr.start != FAILED_ADDR) {
+        read_env(&env);
+    }
+    while (moved < env_num && (env.addr.start = get_next_env_addr(&sector, &env)) != FAILED_ADDR) {
+        read_env(&env);
+        if (env.crc_is_ok && (env.status == ENV_WRITE || env.status == ENV_PRE_DELETE)) {
+            if (move_env(&env) != EF_NO_ERR) {
+                /* keep the sector, the full GC will collect it when the space is released */
+                EF_DEBUG("Error: Moved the ENV (%.*s) for GC failed.\r\n", env.name_len, env.name);
+                break;
+            }
+            moved++;
+        }
+        gc_env_addr = env.addr.start;
+    }
+    gc_request = false;
+    gc_stepping = false;
+
+    if (env.addr.start == FAILED_ADDR) {
+        /* all ENV in the sector are moved */
+        format_sector(sector.addr, SECTOR_NOT_COMBINED);
+        gc_stat.erased_sectors++;
+        gc_sec_addr = FAILED_ADDR;
+        EF_DEBUG("Collect a sector @0x%08X by step\r\n", sector.addr);
+    }
+
+    gc_stat.steps++;
+    gc_stat_stall(start_time);
+
+    return gc_pending;
 }
 
 static EfErrCode align_write(uint32_t addr, const uint32_t *buf, size_t size)
@@ -1373,6 +1845,13 @@ static EfErrCode create_env_blob(sector_meta_data_t sector, const char *key, con
         if (result == EF_NO_ERR) {
             result = write_status(env_addr, env_hdr.status_table, ENV_STATUS_NUM, ENV_WRITE);
         }
+        if (result == EF_NO_ERR) {
+            gc_stat.written_bytes += env_hdr.len;
+#ifdef EF_ENV_USING_INDEX
+            /* index it only after it's ENV_WRITE, a failed node must not take a slot */
+            env_index_add(key, env_hdr.name_len, env_addr);
+#endif /* EF_ENV_USING_INDEX */
+        }
         /* trigger GC collect when current sector is full */
         if (result == EF_NO_ERR && is_full) {
             EF_DEBUG("Trigger a GC check after created ENV.\r\n");
@@ -1432,6 +1911,27 @@ EfErrCode ef_del_and_save_env(const char *key)
     return ef_del_env(key);
 }
 
+/*
+ * process the GC which is requested by set ENV
+ */
+static void gc_after_set(void)
+{
+    if (gc_request) {
+#ifdef EF_ENV_USING_INCREMENTAL_GC
+        gc_request = false;
+        gc_pending = true;
+#else
+        gc_collect();
+#endif
+    }
+#ifdef EF_ENV_USING_INCREMENTAL_GC
+    if (gc_pending && gc_collect_step(EF_GC_STEP_ENV_NUM)) {
+        /* the rest steps run in the background */
+        ef_port_gc_pending();
+    }
+#endif
+}
+
 static EfErrCode set_env(const char *key, const void *value_buf, size_t buf_len)
 {
     EfErrCode result = EF_NO_ERR;
@@ -1460,11 +1960,227 @@ static EfErrCode set_env(const char *key, const void *value_buf, size_t buf_len)
             result = del_env(key, &env, true);
         }
         /* process the GC after set ENV */
-        if (gc_request) {
-            gc_collect();
+        gc_after_set();
+    }
+
+    return result;
+}
+
+/*
+ * make the ENV node image in buf, the same as it on flash, return the node length
+ */
+static size_t make_env_image(uint8_t *buf, size_t status, const char *key, size_t key_len, const void *value,
+        size_t len)
+{
+    struct env_hdr_data env_hdr;
+
+    memset(&env_hdr, 0xFF, sizeof(struct env_hdr_data));
+    set_status(env_hdr.status_table, ENV_STATUS_NUM, status);
+    env_hdr.magic = ENV_MAGIC_WORD;
+    env_hdr.name_len = key_len;
+    env_hdr.value_len = len;
+    env_hdr.len = ENV_HDR_DATA_SIZE + EF_WG_ALIGN(key_len) + EF_WG_ALIGN(len);
+
+    memset(buf, 0xFF, env_hdr.len);
+    memcpy(buf, &env_hdr, sizeof(struct env_hdr_data));
+    memcpy(buf + ENV_HDR_DATA_SIZE, key, key_len);
+    memcpy(buf + ENV_HDR_DATA_SIZE + EF_WG_ALIGN(key_len), value, len);
+    /* the CRC32 is calculated as same as read_env */
+    env_hdr.crc32 = ef_calc_crc32(0, buf + ENV_NAME_LEN_OFFSET, env_hdr.len - ENV_NAME_LEN_OFFSET);
+    memcpy(buf, &env_hdr, sizeof(struct env_hdr_data));
+
+    return env_hdr.len;
+}
+
+/*
+ * get the ENV node image in batch buffer by offset, the image may be unaligned
+ */
+static void get_env_image(ef_env_batch_t batch, size_t offset, env_node_obj_t env)
+{
+    struct env_hdr_data env_hdr;
+
+    memcpy(&env_hdr, batch->buf + offset, sizeof(struct env_hdr_data));
+    env->len = env_hdr.len;
+    env->name_len = env_hdr.name_len;
+    env->value_len = env_hdr.value_len;
+    memcpy(env->name, batch->buf + offset + ENV_HDR_DATA_SIZE, env_hdr.name_len);
+}
+
+static bool batch_has_name(ef_env_batch_t batch, const char *name, size_t name_len)
+{
+    struct env_node_obj env;
+    size_t offset;
+
+    for (offset = BATCH_HDR_SIZE; offset < batch->used; offset += env.len) {
+        get_env_image(batch, offset, &env);
+        if (env.name_len == name_len && !strncmp(env.name, name, name_len)) {
+            return true;
         }
     }
 
+    return false;
+}
+
+static bool span_has_name(uint32_t start, uint32_t end, const char *name, size_t name_len)
+{
+    struct env_node_obj env;
+
+    for (env.addr.start = start; env.addr.start < end; env.addr.start += env.len) {
+        if (read_env(&env) == EF_NO_ERR && env.name_len == name_len && !strncmp(env.name, name, name_len)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+struct batch_span {
+    uint32_t start;                              /**< the first batch record address */
+    uint32_t end;                                /**< the end address of batch records */
+    ef_env_batch_t batch;                        /**< the batch in RAM, NULL: the record names are read from flash */
+    EfErrCode result;                            /**< the first error of deleting the old ENV */
+};
+
+static bool batch_del_old_cb(env_node_obj_t env, void *arg1, [[gnu::unused]] void *arg2)
+{
+    struct batch_span *span = arg1;
+    bool found;
+
+    if (!env->crc_is_ok || env->status != ENV_WRITE || (env->addr.start >= span->start && env->addr.start < span->end)) {
+        return false;
+    }
+    if (span->batch) {
+        found = batch_has_name(span->batch, env->name, env->name_len);
+    } else {
+        found = span_has_name(span->start, span->end, env->name, env->name_len);
+    }
+    if (found && del_env(NULL, env, true) != EF_NO_ERR && span->result == EF_NO_ERR) {
+        span->result = EF_WRITE_ERR;
+    }
+
+    return false;
+}
+
+/*
+ * delete the old ENV which are replaced by the committed batch records
+ *
+ * @return EF_NO_ERR: all of them are deleted, the batch marker can be deleted
+ */
+static EfErrCode batch_del_old(struct batch_span *span)
+{
+    struct env_node_obj env;
+
+    span->result = EF_NO_ERR;
+#ifdef EF_ENV_USING_INDEX
+    /* the batch records are not indexed yet, so the index only finds the old ENV */
+    if (span->batch && env_index_ready && !env_index_overflow) {
+        struct env_node_obj image;
+        size_t offset;
+
+        for (offset = BATCH_HDR_SIZE; offset < span->batch->used; offset += image.len) {
+            get_env_image(span->batch, offset, &image);
+            while (env_index_find(image.name, image.name_len, &env)) {
+                /* the failed one is still indexed */
+                if (del_env(NULL, &env, true) != EF_NO_ERR) {
+                    span->result = EF_WRITE_ERR;
+                    break;
+                }
+            }
+        }
+        return span->result;
+    }
+#endif /* EF_ENV_USING_INDEX */
+
+    env_iterator(&env, span, NULL, batch_del_old_cb);
+
+    return span->result;
+}
+
+/*
+ * drop the records of an uncommitted batch, they are ENV_WRITE on flash
+ */
+static void batch_drop_records(struct batch_span *span)
+{
+    struct env_node_obj record;
+    uint8_t status_table[ENV_STATUS_TABLE_SIZE];
+
+    for (record.addr.start = span->start; record.addr.start < span->end; record.addr.start += record.len) {
+        /* the unwritten record is marked as ENV_ERR_HDR by read_env, and the rest is not written */
+        if (read_env(&record) != EF_NO_ERR && !record.crc_is_ok && record.status == ENV_ERR_HDR) {
+            break;
+        }
+        write_status(record.addr.start, status_table, ENV_STATUS_NUM, ENV_ERR_HDR);
+    }
+}
+
+static EfErrCode commit_batch(ef_env_batch_t batch)
+{
+    EfErrCode result = EF_NO_ERR;
+    struct sector_meta_data sector;
+    struct env_node_obj env;
+    struct batch_span span;
+    uint8_t status_table[ENV_STATUS_TABLE_SIZE];
+    uint32_t addr, records_size = batch->used - BATCH_HDR_SIZE;
+    bool is_full = false;
+
+    sector.empty_env = FAILED_ADDR;
+    if ((addr = new_env(&sector, batch->used)) == FAILED_ADDR) {
+        return EF_ENV_FULL;
+    }
+    result = update_sec_status(&sector, batch->used, &is_full);
+    /* the marker is PRE_WRITE and the records are WRITE, all of them are programmed by one write */
+    make_env_image(batch->buf, ENV_PRE_WRITE, BATCH_ENV_NAME, BATCH_ENV_NAME_LEN, &records_size, sizeof(uint32_t));
+    if (result != EF_NO_ERR) {
+        return result;
+    }
+    result = align_write(addr, (uint32_t *) batch->buf, batch->used);
+
+#ifdef EF_ENV_USING_CACHE
+    /* the space is used even if the write failed */
+    if (!is_full) {
+        update_sector_cache(sector.addr, addr + batch->used);
+    }
+#endif /* EF_ENV_USING_CACHE */
+
+    span.start = addr + BATCH_HDR_SIZE;
+    span.end = addr + batch->used;
+    span.batch = batch;
+    /* the records are visible after the marker changed to WRITE */
+    if (result == EF_NO_ERR) {
+        result = write_status(addr, status_table, ENV_STATUS_NUM, ENV_WRITE);
+    }
+    if (result != EF_NO_ERR) {
+        /* the records are ENV_WRITE on flash already, drop them as the recovery of an uncommitted batch */
+        batch_drop_records(&span);
+        write_status(addr, status_table, ENV_STATUS_NUM, ENV_ERR_HDR);
+        return result;
+    }
+
+    result = batch_del_old(&span);
+
+    for (env.addr.start = span.start; env.addr.start < span.end; env.addr.start += env.len) {
+        get_env_image(batch, env.addr.start - addr, &env);
+#ifdef EF_ENV_USING_CACHE
+        update_env_cache(env.name, env.name_len, env.addr.start);
+#endif /* EF_ENV_USING_CACHE */
+#ifdef EF_ENV_USING_INDEX
+        env_index_add(env.name, env.name_len, env.addr.start);
+#endif /* EF_ENV_USING_INDEX */
+    }
+
+    /* the batch is done, delete the marker, or keep it for the recovery to delete the old ENV left */
+    if (result == EF_NO_ERR) {
+        env.addr.start = addr;
+        read_env(&env);
+        result = del_env(NULL, &env, true);
+    }
+
+    gc_stat.written_bytes += batch->used;
+    if (is_full) {
+        EF_DEBUG("Trigger a GC check after committed batch.\r\n");
+        gc_request = true;
+    }
+
     return result;
 }
 
@@ -1514,6 +2230,117 @@ EfErrCode ef_set_env_blob(const char *key, const void *value_buf, size_t buf_len
     return result;
 }
 
+/**
+ * Begin an ENV batch. The batch records are packed in the buffer, and written
+ * to flash by one write on ef_env_batch_commit(), they are visible atomically.
+ *
+ * @param batch ENV batch
+ * @param buf records buffer, the batch can not be larger than a sector
+ * @param size records buffer size
+ *
+ * @return result
+ */
+EfErrCode ef_env_batch_begin(ef_env_batch_t batch, void *buf, size_t size)
+{
+    if (!batch || !buf || size <= BATCH_HDR_SIZE) {
+        log_warn("batch = %p, buf = %p, size = %d\r\n", batch, buf, size);
+        return EF_ENV_ARG_ERR;
+    }
+
+    batch->buf = buf;
+    batch->size = size;
+    /* reserve the marker in front of records */
+    batch->used = BATCH_HDR_SIZE;
+    batch->num = 0;
+
+    return EF_NO_ERR;
+}
+
+/**
+ * Set a blob ENV in batch, it replaces the same name ENV in the batch.
+ *
+ * @param batch ENV batch
+ * @param key ENV name
+ * @param value_buf ENV value
+ * @param buf_len ENV value length
+ *
+ * @return result
+ */
+EfErrCode ef_env_batch_set(ef_env_batch_t batch, const char *key, const void *value_buf, size_t buf_len)
+{
+    struct env_node_obj env;
+    size_t key_len, env_len, offset;
+
+    if (!batch || !key || !value_buf) {
+        log_warn("batch = %p, key = %p, value_buf = %p\r\n", batch, key, value_buf);
+        return EF_ENV_ARG_ERR;
+    }
+
+    key_len = strlen(key);
+    if (key_len > EF_ENV_NAME_MAX || buf_len > EF_STR_ENV_VALUE_MAX_SIZE) {
+        log_warn("key len %d, buf_len %d\r\n", key_len, buf_len);
+        return EF_ENV_ARG_ERR;
+    }
+
+    /* remove the same name ENV in batch */
+    for (offset = BATCH_HDR_SIZE; offset < batch->used; offset += env.len) {
+        get_env_image(batch, offset, &env);
+        if (env.name_len == key_len && !strncmp(env.name, key, key_len)) {
+            memmove(batch->buf + offset, batch->buf + offset + env.len, batch->used - offset - env.len);
+            batch->used -= env.len;
+            batch->num--;
+            break;
+        }
+    }
+
+    env_len = ENV_HDR_DATA_SIZE + EF_WG_ALIGN(key_len) + EF_WG_ALIGN(buf_len);
+    if (batch->used + env_len > batch->size || batch->used + env_len > SECTOR_SIZE - SECTOR_HDR_DATA_SIZE) {
+        return EF_ENV_FULL;
+    }
+
+    batch->used += make_env_image(batch->buf + batch->used, ENV_WRITE, key, key_len, value_buf, buf_len);
+    batch->num++;
+
+    return EF_NO_ERR;
+}
+
+/**
+ * Commit the ENV batch, the old ENV which have the same name are deleted.
+ * The batch is empty after commit.
+ *
+ * @param batch ENV batch
+ *
+ * @return result
+ */
+EfErrCode ef_env_batch_commit(ef_env_batch_t batch)
+{
+    EfErrCode result = EF_NO_ERR;
+
+    if (!init_ok) {
+        EF_INFO("ENV isn't initialize OK.\r\n");
+        return EF_ENV_INIT_FAILED;
+    }
+
+    if (!batch || batch->used <= BATCH_HDR_SIZE) {
+        return EF_NO_ERR;
+    }
+
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    result = commit_batch(batch);
+    /* process the GC after commit */
+    gc_after_set();
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+
+    batch->used = BATCH_HDR_SIZE;
+    batch->num = 0;
+
+    return result;
+}
+
 /**
  * Set a string ENV. If it value is NULL, delete it.
  * If not find it in flash, then create it.
@@ -1555,6 +2382,60 @@ EfErrCode ef_save_env(void)
     return EF_NO_ERR;
 }
 
+/**
+ * Run one incremental GC step, it can be called from an idle hook or a background task.
+ * Set ENV calls ef_port_gc_pending() when it leaves more steps, the port wakes its GC task there.
+ * It moves at most env_num ENV or erases one sector, so the ENV lock is held for a bounded time.
+ *
+ * @param env_num the max ENV number to move, 0: use EF_GC_STEP_ENV_NUM
+ *
+ * @return true when there is more GC work
+ */
+bool ef_env_gc_step(size_t env_num)
+{
+    bool pending;
+
+    if (!init_ok) {
+        return false;
+    }
+
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    if (gc_request) {
+        gc_request = false;
+        gc_pending = true;
+    }
+    pending = gc_pending ? gc_collect_step(env_num ? env_num : EF_GC_STEP_ENV_NUM) : false;
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+
+    return pending;
+}
+
+/**
+ * Get the GC statistics.
+ *
+ * @param stat the GC statistics
+ */
+void ef_env_gc_get_stat(ef_env_gc_stat_t stat)
+{
+    ef_port_env_lock();
+    *stat = gc_stat;
+    ef_port_env_unlock();
+}
+
+/**
+ * Reset the GC statistics.
+ */
+void ef_env_gc_reset_stat(void)
+{
+    ef_port_env_lock();
+    memset(&gc_stat, 0, sizeof(gc_stat));
+    ef_port_env_unlock();
+}
+
 /**
  * ENV set default.
  *
@@ -1730,15 +2611,47 @@ static bool check_sec_hdr_cb(sector_meta_data_t sector, void *arg1, [[gnu::unuse
 static bool check_and_recovery_gc_cb(sector_meta_data_t sector, [[gnu::unused]] void *arg1, [[gnu::unused]] void *arg2)
 {
     if (sector->check_ok && sector->status.dirty == SECTOR_DIRTY_GC) {
-        /* make sure the GC request flag to true */
+        /* make sure the GC request flag to true, the moved ENV can use the empty sectors */
         gc_request = true;
-        /* resume the GC operate */
+        /* resume the GC of this sector, the incremental GC starts it above the GC threshold too */
+        do_gc(sector, NULL, NULL);
+        /* resume the full GC when it's at the GC threshold */
         gc_collect();
     }
 
     return false;
 }
 
+static bool check_and_recovery_batch_cb(env_node_obj_t env, [[gnu::unused]] void *arg1, [[gnu::unused]] void *arg2)
+{
+    struct batch_span span;
+    uint32_t records_size = 0;
+
+    if (!env->crc_is_ok || env->name_len != BATCH_ENV_NAME_LEN || strncmp(env->name, BATCH_ENV_NAME, BATCH_ENV_NAME_LEN)
+            || (env->status != ENV_PRE_WRITE && env->status != ENV_WRITE)) {
+        return false;
+    }
+
+    ef_port_read(env->addr.value, &records_size, sizeof(uint32_t));
+    span.start = env->addr.start + env->len;
+    span.end = span.start + records_size;
+    span.batch = NULL;
+
+    if (env->status == ENV_WRITE) {
+        EF_INFO("Found a committed ENV batch (@0x%08X), now will finish it.\r\n", env->addr.start);
+        if (batch_del_old(&span) != EF_NO_ERR) {
+            /* keep the marker, finish it on the next boot */
+            return false;
+        }
+    } else {
+        EF_INFO("Found an uncommitted ENV batch (@0x%08X), now will drop it.\r\n", env->addr.start);
+        batch_drop_records(&span);
+    }
+    del_env(NULL, env, true);
+
+    return false;
+}
+
 static bool check_and_recovery_env_cb(env_node_obj_t env, [[gnu::unused]] void *arg1, [[gnu::unused]] void *arg2)
 {
     /* recovery the prepare deleted ENV */
@@ -1756,7 +2669,7 @@ static bool check_and_recovery_env_cb(env_node_obj_t env, [[gnu::unused]] void *
         /* the ENV has not write finish, change the status to error */
         //TODO 绘制异常处理的状态装换图
         write_status(env->addr.start, status_table, ENV_STATUS_NUM, ENV_ERR_HDR);
-        return true;
+        /* go on, a PRE_DELETE ENV after it still needs the recovery */
     }
 
     return false;
@@ -1785,6 +2698,8 @@ EfErrCode ef_load_env(void)
 
     /* lock the ENV cache */
     ef_port_env_lock();
+    /* check all batch marker for recovery, finish or drop the batch */
+    env_iterator(&env, NULL, NULL, check_and_recovery_batch_cb);
     /* check all sector header for recovery GC */
     sector_iterator(&sector, SECTOR_STORE_UNUSED, NULL, NULL, check_and_recovery_gc_cb, false);
 
@@ -1798,6 +2713,10 @@ __retry:
 
     in_recovery_check = false;
 
+#ifdef EF_ENV_USING_INDEX
+    env_index_build();
+#endif /* EF_ENV_USING_INDEX */
+
     /* unlock the ENV cache */
     ef_port_env_unlock();
 
@@ -32,7 +32,9 @@
 #include <string.h>
 #include <FreeRTOS.h>
 #include <semphr.h>
+#include <task.h>
 #include <bl_mtd.h>
+#include <bl_timer.h>
 
 static bl_mtd_handle_t handle;
 
@@ -43,6 +45,27 @@ static const ef_env default_env_set[] = {
 
 static SemaphoreHandle_t env_cache_lock = NULL;
 
+#ifdef EF_ENV_USING_INCREMENTAL_GC
+/* the GC task runs the incremental GC steps which are left by set ENV */
+#ifndef EF_PORT_GC_TASK_STACK_SIZE
+#define EF_PORT_GC_TASK_STACK_SIZE    512
+#endif
+#ifndef EF_PORT_GC_TASK_PRIORITY
+#define EF_PORT_GC_TASK_PRIORITY      (tskIDLE_PRIORITY + 1)
+#endif
+
+static TaskHandle_t gc_task = NULL;
+
+static void ef_port_gc_task([[gnu::unused]] void *arg) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        /* each step holds the ENV lock for a few ENV only */
+        while (ef_env_gc_step(0)) {
+        }
+    }
+}
+#endif /* EF_ENV_USING_INCREMENTAL_GC */
+
 /**
  * Flash port for hardware initialize.
  *
@@ -75,6 +98,12 @@ EfErrCode ef_port_init(ef_env const **default_env, size_t *default_env_size) {
     printf("*default_env_size = 0x%08x\r\n", *default_env_size);
 
     env_cache_lock = xSemaphoreCreateMutex();
+#ifdef EF_ENV_USING_INCREMENTAL_GC
+    if (xTaskCreate(ef_port_gc_task, "ef_gc", EF_PORT_GC_TASK_STACK_SIZE, NULL, EF_PORT_GC_TASK_PRIORITY,
+            &gc_task) != pdPASS) {
+        EF_INFO("[EF] create GC task failed, the GC steps only run on set ENV\r\n");
+    }
+#endif
 
     return EF_NO_ERR;
 }
@@ -168,6 +197,25 @@ void ef_port_env_unlock(void) {
     xSemaphoreGive( env_cache_lock );
 }
 
+/**
+ * The incremental GC has more steps after set ENV, wake the GC task to run them.
+ * It's called with the ENV lock held.
+ */
+void ef_port_gc_pending(void) {
+#ifdef EF_ENV_USING_INCREMENTAL_GC
+    if (gc_task) {
+        xTaskNotifyGive(gc_task);
+    }
+#endif
+}
+
+/**
+ * Get the current time in microsecond, it is used for the GC statistics.
+ */
+uint32_t ef_port_get_time_us(void) {
+    return bl_timer_now_us();
+}
+
 extern void vprint(const char *fmt, va_list argp);
 /**
  * This function is print flash debug info.
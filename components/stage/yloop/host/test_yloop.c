@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test for the yloop timeouts and the event device.  The loop runs on a
+ * virtual millisecond clock: aos_poll() returns at once when the event
+ * device has data and otherwise moves the clock by its timeout.
+ *   - 2000 timeouts due over 50 ms all fire once, in deadline order and not
+ *     before their deadline, in about one poll per distinct deadline.
+ *   - A callback can cancel a timeout due in the same pass, and a zero delay
+ *     timeout posted from a callback runs in a later pass.
+ *   - A burst of 200 calls posted by another task while the loop sleeps
+ *     wakes it once and is drained 16 events per poll, in order, with the
+ *     urgent call first.
+ *   - Up to YLOOP_TIMEOUT_POOL_SIZE pending timeouts take nothing from the
+ *     heap.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FreeRTOS.h needs the port, yloop only takes its heap from it */
+#define INC_FREERTOS_H
+
+static long heap_allocs;
+
+static void *test_malloc(size_t size)
+{
+    heap_allocs++;
+    return malloc(size);
+}
+
+#define pvPortMalloc        test_malloc
+#define vPortFree           free
+
+#include "../src/yloop.c"
+#include "../src/local_event.c"
+#include "../src/device.c"
+
+static int test_failed;
+
+/* kernel */
+static long long now;
+static void *task_key_value;
+
+int aos_task_key_create(aos_task_key_t *key)
+{
+    *key = 0;
+    return 0;
+}
+
+int aos_task_setspecific(aos_task_key_t key, void *vp)
+{
+    (void)key;
+    task_key_value = vp;
+    return 0;
+}
+
+void *aos_task_getspecific(aos_task_key_t key)
+{
+    (void)key;
+    return task_key_value;
+}
+
+int aos_mutex_new(aos_mutex_t *mutex)
+{
+    mutex->hdl = NULL;
+    return 0;
+}
+
+void aos_mutex_free(aos_mutex_t *mutex)
+{
+    (void)mutex;
+}
+
+int aos_mutex_lock(aos_mutex_t *mutex, unsigned int timeout)
+{
+    (void)mutex;
+    (void)timeout;
+    return 0;
+}
+
+int aos_mutex_unlock(aos_mutex_t *mutex)
+{
+    (void)mutex;
+    return 0;
+}
+
+void *aos_malloc(unsigned int size)
+{
+    return test_malloc(size);
+}
+
+void aos_free(void *mem)
+{
+    free(mem);
+}
+
+long long aos_now_ms(void)
+{
+    return now;
+}
+
+/* vfs, the event device is the only file */
+static file_ops_t *dev_ops;
+static inode_t dev_node;
+static file_t dev_file;
+static int polls, wakeups;
+static void (*remote_task)(void);
+
+int aos_register_driver(const char *path, file_ops_t *fops, void *arg)
+{
+    (void)path;
+    (void)arg;
+    dev_ops = fops;
+    dev_node.ops.i_ops = fops;
+    return VFS_SUCCESS;
+}
+
+int aos_open(const char *path, int flags)
+{
+    (void)path;
+    (void)flags;
+    dev_file.node = &dev_node;
+    dev_ops->open(&dev_node, &dev_file);
+    return AOS_CONFIG_VFS_FD_OFFSET;
+}
+
+int aos_close(int fd)
+{
+    (void)fd;
+    return dev_ops->close(&dev_file);
+}
+
+ssize_t aos_read(int fd, void *buf, size_t nbytes)
+{
+    (void)fd;
+    return dev_ops->read(&dev_file, buf, nbytes);
+}
+
+int aos_ioctl(int fd, int cmd, unsigned long arg)
+{
+    (void)fd;
+    return dev_ops->ioctl(&dev_file, cmd, arg);
+}
+
+int aos_fcntl(int fd, int cmd, int val)
+{
+    (void)fd;
+    (void)cmd;
+    (void)val;
+    return 0;
+}
+
+static void poll_notify(struct pollfd *fd, void *arg)
+{
+    (void)fd;
+    (*(int *)arg)++;
+    wakeups++;
+}
+
+int aos_poll(struct pollfd *fds, int nfds, int timeout)
+{
+    int i, ready = 0, signalled = 0;
+
+    polls++;
+    for (i = 0; i < nfds; i++) {
+        fds[i].revents = 0;
+        dev_ops->poll(&dev_file, true, poll_notify, &fds[i], &signalled);
+    }
+    if (!signalled && remote_task) {
+        /* another task runs while the loop sleeps */
+        remote_task();
+        remote_task = NULL;
+    }
+    if (!signalled) {
+        if (timeout < 0) {
+            printf("FAIL the loop sleeps forever\nFAILED\n");
+            exit(1);
+        }
+        now += timeout;
+    }
+    for (i = 0; i < nfds; i++) {
+        dev_ops->poll(&dev_file, false, NULL, NULL, NULL);
+        if (fds[i].revents) {
+            ready++;
+        }
+    }
+    return ready;
+}
+
+/* timeouts fire in deadline order */
+#define TEST_TIMEOUTS       2000
+#define TEST_TIMEOUT_SPAN   50
+
+static long long deadline[TEST_TIMEOUTS];
+static int fired[TEST_TIMEOUTS];
+static long long last_deadline;
+
+static void timeout_cb(void *arg)
+{
+    int i = (int)(long)arg;
+
+    if (now < deadline[i] || deadline[i] < last_deadline) {
+        printf("FAIL timeout %d due at %lld fired at %lld, after one due at %lld\n",
+               i, deadline[i], now, last_deadline);
+        test_failed = 1;
+    }
+    last_deadline = deadline[i];
+    fired[i]++;
+}
+
+static void exit_cb(void *arg)
+{
+    (void)arg;
+    aos_loop_exit();
+}
+
+static void test_timeouts(void)
+{
+    int i, missing = 0, polls_start = polls;
+
+    last_deadline = now;
+    for (i = 0; i < TEST_TIMEOUTS; i++) {
+        deadline[i] = now + rand() % TEST_TIMEOUT_SPAN;
+        aos_post_delayed_action(deadline[i] - now, timeout_cb, (void *)(long)i);
+    }
+    aos_post_delayed_action(TEST_TIMEOUT_SPAN, exit_cb, NULL);
+    aos_loop_run();
+
+    for (i = 0; i < TEST_TIMEOUTS; i++) {
+        if (fired[i] != 1) {
+            missing++;
+        }
+    }
+    if (missing || polls - polls_start > TEST_TIMEOUT_SPAN + 2) {
+        printf("FAIL %d timeouts fired wrong, %d polls\n", missing, polls - polls_start);
+        test_failed = 1;
+    }
+    printf("%d timeouts in %d polls\n", TEST_TIMEOUTS, polls - polls_start);
+}
+
+/* cancel and repost from a callback */
+static int cancelled_ran, repost_poll, first_poll;
+
+static void cancelled_cb(void *arg)
+{
+    (void)arg;
+    cancelled_ran = 1;
+}
+
+static void repost_cb(void *arg)
+{
+    (void)arg;
+    repost_poll = polls;
+}
+
+static void first_cb(void *arg)
+{
+    (void)arg;
+    first_poll = polls;
+    aos_cancel_delayed_action(5, cancelled_cb, NULL);
+    aos_post_delayed_action(0, repost_cb, NULL);
+}
+
+static void test_cancel(void)
+{
+    repost_poll = 0;
+    aos_post_delayed_action(5, first_cb, NULL);
+    aos_post_delayed_action(5, cancelled_cb, NULL);
+    aos_post_delayed_action(10, exit_cb, NULL);
+    aos_loop_run();
+
+    if (cancelled_ran || repost_poll <= first_poll) {
+        printf("FAIL cancelled timeout ran %d, zero delay repost in poll %d, poster in %d\n",
+               cancelled_ran, repost_poll, first_poll);
+        test_failed = 1;
+    }
+}
+
+/* calls posted by another task */
+#define TEST_CALLS          200
+#define TEST_CALLS_PER_POLL 16
+
+static int calls_handled, calls_failed, urgent_seen;
+
+static void call_cb(void *arg)
+{
+    if ((long)arg != calls_handled - urgent_seen) {
+        calls_failed++;
+    }
+    if (++calls_handled == TEST_CALLS + 1) {
+        aos_loop_exit();
+    }
+}
+
+static void urgent_cb(void *arg)
+{
+    (void)arg;
+    if (calls_handled != 0) {
+        calls_failed++;
+    }
+    urgent_seen = 1;
+    calls_handled++;
+}
+
+static int burst_wakeups;
+
+static void remote_burst(void)
+{
+    long i;
+    int wakeups_start = wakeups;
+
+    for (i = 0; i < TEST_CALLS; i++) {
+        aos_schedule_call(call_cb, (void *)i);
+    }
+    aos_loop_schedule_urgent_call(NULL, urgent_cb, NULL);
+    burst_wakeups = wakeups - wakeups_start;
+}
+
+static void burst_start_cb(void *arg)
+{
+    (void)arg;
+    remote_task = remote_burst;
+}
+
+static void test_calls(void)
+{
+    int polls_start;
+
+    aos_post_delayed_action(1, burst_start_cb, NULL);
+    polls_start = polls;
+    aos_loop_run();
+
+    if (calls_failed || !urgent_seen || burst_wakeups != 1 ||
+        polls - polls_start > (TEST_CALLS + 1) / TEST_CALLS_PER_POLL + 3) {
+        printf("FAIL %d of %d calls out of order, %d wakeups, %d polls\n",
+               calls_failed, calls_handled, burst_wakeups, polls - polls_start);
+        test_failed = 1;
+    }
+    printf("%d calls in %d polls, %d wakeups\n", calls_handled, polls - polls_start, burst_wakeups);
+}
+
+/* pending timeouts come from the pool */
+#define TEST_CHAIN_RUNS     1000
+
+static int chain_runs[YLOOP_TIMEOUT_POOL_SIZE], chains_left;
+
+static void chain_cb(void *arg)
+{
+    long i = (long)arg;
+
+    if (++chain_runs[i] < TEST_CHAIN_RUNS) {
+        aos_post_delayed_action(rand() % 3, chain_cb, arg);
+    } else if (--chains_left == 0) {
+        aos_loop_exit();
+    }
+}
+
+static void test_pool(void)
+{
+    long i, allocs_start = heap_allocs;
+
+    chains_left = YLOOP_TIMEOUT_POOL_SIZE;
+    for (i = 0; i < YLOOP_TIMEOUT_POOL_SIZE; i++) {
+        aos_post_delayed_action(rand() % 3, chain_cb, (void *)i);
+    }
+    aos_loop_run();
+
+    if (heap_allocs != allocs_start) {
+        printf("FAIL %ld heap allocations for %d timeouts\n",
+               heap_allocs - allocs_start, YLOOP_TIMEOUT_POOL_SIZE * TEST_CHAIN_RUNS);
+        test_failed = 1;
+    }
+}
+
+int main(void)
+{
+    srand(1);
+    vfs_device_init();
+    aos_loop_init();
+
+    test_timeouts();
+    test_cancel();
+    test_calls();
+    test_pool();
+
+    aos_loop_destroy();
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
@@ -13,8 +13,27 @@ typedef struct {
     aos_poll_call_t  cb;
 } yloop_sock_t;
 
+typedef struct yloop_timeout_s {
+    dlist_t          next;
+    long long        timeout_ms;
+    void            *private_data;
+    aos_call_t       cb;
+    int              ms;
+} yloop_timeout_t;
+
+/* Delayed actions are taken from this per-loop pool first, the heap is only
+ * used once it runs out.
+ */
+#ifndef YLOOP_TIMEOUT_POOL_SIZE
+#define YLOOP_TIMEOUT_POOL_SIZE 8
+#endif
+
 typedef struct {
     dlist_t          timeouts;
+    /* timeouts due in the pass being run */
+    dlist_t          expired;
+    dlist_t          timeout_free;
+    yloop_timeout_t  timeout_pool[YLOOP_TIMEOUT_POOL_SIZE];
     struct pollfd   *pollfds;
     yloop_sock_t    *readers;
     int              eventfd;
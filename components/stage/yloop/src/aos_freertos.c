@@ -370,7 +370,7 @@ void *aos_zalloc(unsigned int size)
 {
     void *mem;
 
-    mem = pvPortMalloc(size);
+    mem = pvPortMallocFrom(size, __builtin_return_address(0));
     if (mem) {
         memset(mem, 9, size);
     }
@@ -379,7 +379,7 @@ void *aos_zalloc(unsigned int size)
 
 void *aos_malloc(unsigned int size)
 {
-    return pvPortMalloc(size);
+    return pvPortMallocFrom(size, __builtin_return_address(0));
 }
 
 #if !defined(USE_STDLIB_MALLOC)
@@ -389,7 +389,7 @@ void *calloc(size_t nmemb, size_t size)
     size_t total;
 
     total = nmemb * size;
-    ptr = pvPortMalloc(total);
+    ptr = pvPortMallocFrom(total, __builtin_return_address(0));
     if (ptr) {
         memset(ptr, 0, total);
     }
@@ -417,7 +417,7 @@ void aos_msleep(int ms)
 #if !defined(USE_STDLIB_MALLOC)
 void *malloc(size_t size)
 {
-    return pvPortMalloc(size);
+    return pvPortMallocFrom(size, __builtin_return_address(0));
 }
 #endif
 
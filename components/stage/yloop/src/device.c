@@ -97,7 +97,8 @@ static ssize_t _event_write(file_t *f, const void *buf, size_t len, bool urgent)
         dlist_add_tail(&evt->node, &pdev->bufs);
     }
 
-    if (pdev->poll_cb != NULL) {
+    /* the poller was already woken for the events queued before this one */
+    if (pdev->poll_cb != NULL && pdev->counter == 1) {
         pdev->fd->revents |= POLLIN;
         pdev->poll_cb(pdev->fd, pdev->poll_data);
     }
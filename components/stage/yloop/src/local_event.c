@@ -72,11 +72,23 @@ static int input_add_event(int fd, input_event_t *event)
     return aos_ioctl(fd, cmd, (unsigned long)event);
 }
 
+/* Events posted from other tasks are drained in batches, so a burst of
+ * aos_schedule_call costs one poll wakeup instead of one per call.  The batch
+ * is bounded to keep timeouts and other readers running; what is left makes
+ * the next poll return at once.
+ */
+#define EVENT_READ_BATCH 16
+
 void event_read_cb(int fd, [[gnu::unused]] void *param)
 {
     input_event_t event;
-    int ret = aos_read(fd, &event, sizeof(event));
-    if (ret == sizeof(event)) {
+    int i;
+
+    for (i = 0; i < EVENT_READ_BATCH; i++) {
+        int ret = aos_read(fd, &event, sizeof(event));
+        if (ret != sizeof(event)) {
+            break;
+        }
         handle_events(&event);
     }
 }
@@ -203,7 +215,7 @@ int aos_schedule_call(aos_call_t fun, void *arg)
 
 #if (RHINO_CONFIG_WORKQUEUE>0)
 typedef struct work_para {
-    aos_work_t *work;
+    aos_work_t work;
     aos_loop_t loop;
     aos_call_t action;
     void *arg1;
@@ -213,8 +225,7 @@ typedef struct work_para {
 
 static void free_wpar(work_par_t *wpar)
 {
-    aos_work_destroy(wpar->work);
-    aos_free(wpar->work);
+    aos_work_destroy(&wpar->work);
     aos_free(wpar);
 }
 
@@ -247,7 +258,7 @@ void aos_cancel_work(void *w, aos_call_t action, void *arg1)
         return;
     }
 
-    int ret = aos_work_cancel(wpar->work);
+    int ret = aos_work_cancel(&wpar->work);
     if (ret != 0) {
         return;
     }
@@ -264,32 +275,31 @@ void *aos_loop_schedule_work(int ms, aos_call_t action, void *arg1,
         return NULL;
     }
 
-    aos_work_t *work = aos_malloc(sizeof(*work));
+    /* the work handle lives in wpar, one allocation per work */
     work_par_t *wpar = aos_malloc(sizeof(*wpar));
 
-    if (!work || !wpar) {
-        goto err_out;
+    if (!wpar) {
+        return NULL;
     }
 
-    wpar->work = work;
     wpar->loop = aos_current_loop();
     wpar->action = action;
     wpar->arg1 = arg1;
     wpar->fini_cb = fini_cb;
     wpar->arg2 = arg2;
 
-    ret = aos_work_init(work, run_my_work, wpar, ms);
+    ret = aos_work_init(&wpar->work, run_my_work, wpar, ms);
     if (ret != 0) {
         goto err_out;
     }
-    ret = aos_work_sched(work);
+    ret = aos_work_sched(&wpar->work);
     if (ret != 0) {
+        aos_work_destroy(&wpar->work);
         goto err_out;
     }
 
     return wpar;
 err_out:
-    aos_free(work);
     aos_free(wpar);
     return NULL;
 }
@@ -20,15 +20,6 @@
 
 #define TAG "yloop"
 
-typedef struct yloop_timeout_s {
-    dlist_t          next;
-    long long        timeout_ms;
-    void            *private_data;
-    aos_call_t       cb;
-    int              ms;
-} yloop_timeout_t;
-
-
 yloop_ctx_t    *g_main_ctx = NULL;
 static aos_task_key_t  g_loop_key;
 
@@ -89,6 +80,11 @@ aos_loop_t aos_loop_init(void)
     }
 
     dlist_init(&ctx->timeouts);
+    dlist_init(&ctx->expired);
+    dlist_init(&ctx->timeout_free);
+    for (int i = 0; i < YLOOP_TIMEOUT_POOL_SIZE; i++) {
+        dlist_add_tail(&ctx->timeout_pool[i].next, &ctx->timeout_free);
+    }
     ctx->eventfd = -1;
     _set_context(ctx);
 
@@ -123,12 +119,16 @@ int aos_poll_read_fd(int sock, aos_poll_call_t cb, void *private_data)
 
     ctx->reader_count++;
 
-    memcpy(new_sock, ctx->readers, (cnt - 1) * sizeof(yloop_sock_t));
-    vPortFree(ctx->readers);
+    if (ctx->readers) {
+        memcpy(new_sock, ctx->readers, (cnt - 1) * sizeof(yloop_sock_t));
+        vPortFree(ctx->readers);
+    }
     ctx->readers = new_sock;
 
-    memcpy(new_loop_pollfds, ctx->pollfds, (cnt - 1) * sizeof(struct pollfd));
-    vPortFree(ctx->pollfds);
+    if (ctx->pollfds) {
+        memcpy(new_loop_pollfds, ctx->pollfds, (cnt - 1) * sizeof(struct pollfd));
+        vPortFree(ctx->pollfds);
+    }
     ctx->pollfds = new_loop_pollfds;
 
     new_sock += cnt - 1;
@@ -170,6 +170,29 @@ void aos_cancel_poll_read_fd(int sock, [[gnu::unused]] aos_poll_call_t action, [
     ctx->reader_count--;
 }
 
+static yloop_timeout_t *timeout_alloc(yloop_ctx_t *ctx)
+{
+    yloop_timeout_t *timeout;
+
+    if (dlist_empty(&ctx->timeout_free)) {
+        return pvPortMalloc(sizeof(*timeout));
+    }
+
+    timeout = dlist_first_entry(&ctx->timeout_free, yloop_timeout_t, next);
+    dlist_del(&timeout->next);
+    return timeout;
+}
+
+static void timeout_free(yloop_ctx_t *ctx, yloop_timeout_t *timeout)
+{
+    if (timeout >= ctx->timeout_pool &&
+        timeout < ctx->timeout_pool + YLOOP_TIMEOUT_POOL_SIZE) {
+        dlist_add(&timeout->next, &ctx->timeout_free);
+    } else {
+        vPortFree(timeout);
+    }
+}
+
 int aos_post_delayed_action(int ms, aos_call_t action, void *param)
 {
     if (action == NULL) {
@@ -177,7 +200,7 @@ int aos_post_delayed_action(int ms, aos_call_t action, void *param)
     }
 
     yloop_ctx_t *ctx = get_context();
-    yloop_timeout_t *timeout = pvPortMalloc(sizeof(*timeout));
+    yloop_timeout_t *timeout = timeout_alloc(ctx);
     if (timeout == NULL) {
         return -ENOMEM;
     }
@@ -189,23 +212,23 @@ int aos_post_delayed_action(int ms, aos_call_t action, void *param)
 
     yloop_timeout_t *tmp;
 
-    dlist_for_each_entry(&ctx->timeouts, tmp, yloop_timeout_t, next) {
-        if (timeout->timeout_ms < tmp->timeout_ms) {
+    /* most actions are posted with a later deadline, so look from the tail */
+    dlist_for_each_entry_reverse(tmp, &ctx->timeouts, next, yloop_timeout_t) {
+        if (timeout->timeout_ms >= tmp->timeout_ms) {
             break;
         }
     }
 
-    dlist_add_tail(&timeout->next, &tmp->next);
+    dlist_add(&timeout->next, &tmp->next);
 
     return 0;
 }
 
-void aos_cancel_delayed_action(int ms, aos_call_t cb, void *private_data)
+static yloop_timeout_t *timeout_find(dlist_t *list, int ms, aos_call_t cb, void *private_data)
 {
-    yloop_ctx_t *ctx = get_context();
     yloop_timeout_t *tmp;
 
-    dlist_for_each_entry(&ctx->timeouts, tmp, yloop_timeout_t, next) {
+    dlist_for_each_entry(list, tmp, yloop_timeout_t, next) {
         if (ms != -1 && tmp->ms != ms) {
             continue;
         }
@@ -218,9 +241,56 @@ void aos_cancel_delayed_action(int ms, aos_call_t cb, void *private_data)
             continue;
         }
 
+        return tmp;
+    }
+
+    return NULL;
+}
+
+void aos_cancel_delayed_action(int ms, aos_call_t cb, void *private_data)
+{
+    yloop_ctx_t *ctx = get_context();
+    yloop_timeout_t *tmp;
+
+    /* may be called from a callback of the pass still running */
+    tmp = timeout_find(&ctx->expired, ms, cb, private_data);
+    if (tmp == NULL) {
+        tmp = timeout_find(&ctx->timeouts, ms, cb, private_data);
+    }
+
+    if (tmp != NULL) {
         dlist_del(&tmp->next);
-        vPortFree(tmp);
-        return;
+        timeout_free(ctx, tmp);
+    }
+}
+
+/* Run every timeout due by now in one pass.  Timeouts the callbacks post are
+ * left for the next pass, so a zero delay repost can not starve the readers.
+ */
+static void timeout_run_expired(yloop_ctx_t *ctx)
+{
+    yloop_timeout_t *tmo;
+    aos_call_t cb;
+    void *private_data;
+    long long now = aos_now_ms();
+
+    while (!dlist_empty(&ctx->timeouts)) {
+        tmo = dlist_first_entry(&ctx->timeouts, yloop_timeout_t, next);
+        if (now < tmo->timeout_ms) {
+            break;
+        }
+        dlist_del(&tmo->next);
+        dlist_add_tail(&tmo->next, &ctx->expired);
+    }
+
+    while (!dlist_empty(&ctx->expired)) {
+        tmo = dlist_first_entry(&ctx->expired, yloop_timeout_t, next);
+        dlist_del(&tmo->next);
+        cb = tmo->cb;
+        private_data = tmo->private_data;
+        /* freed first, so a callback posting itself again reuses the node */
+        timeout_free(ctx, tmo);
+        cb(private_data);
     }
 }
 
@@ -257,17 +327,8 @@ void aos_loop_run(void)
             return;
         }
 
-        /* check if some registered timeouts have occurred */
-        if (!dlist_empty(&ctx->timeouts)) {
-            yloop_timeout_t *tmo = dlist_first_entry(&ctx->timeouts, yloop_timeout_t, next);
-            long long now = aos_now_ms();
-
-            if (now >= tmo->timeout_ms) {
-                dlist_del(&tmo->next);
-                tmo->cb(tmo->private_data);
-                vPortFree(tmo);
-            }
-        }
+        /* run all registered timeouts that have occurred */
+        timeout_run_expired(ctx);
 
         if (res <= 0) {
             continue;
@@ -305,7 +366,7 @@ void aos_loop_destroy(void)
         yloop_timeout_t *timeout = dlist_first_entry(&ctx->timeouts, yloop_timeout_t,
                                                      next);
         dlist_del(&timeout->next);
-        vPortFree(timeout);
+        timeout_free(ctx, timeout);
     }
 
     vPortFree(ctx->readers);
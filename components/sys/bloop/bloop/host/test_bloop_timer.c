@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test for the bloop timer wheel and message dispatch.  The looper runs
+ * on a virtual tick: ulTaskNotifyTake() advances the tick by the timeout it
+ * is asked to sleep, and returns to main once the loop waits forever.  3000
+ * timers from 0 ms to 50 minutes, one in five repeating, must each fire the
+ * expected number of times and never before their target.  Without oversleep
+ * every timer must fire exactly on its tick, also when the tick counter wraps
+ * while they are pending; with random oversleep they may be late but never
+ * missed.  Some callbacks send a message, which must reach the handler
+ * registered on its priority.
+ */
+#include <setjmp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* FreeRTOS.h and task.h need the port, the looper only uses these */
+#define INC_FREERTOS_H
+#define INC_TASK_H
+#define __BL_TIMER_H__
+#define __BLOG_H__
+#define __UTILS_DEBUG_H__
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+
+#define pdTRUE                          1
+#define pdFALSE                         0
+#define portMAX_DELAY                   ( ( TickType_t ) 0xffffffffUL )
+#define pdMS_TO_TICKS( xTimeInMs )      ( ( TickType_t ) ( xTimeInMs ) )
+#define portYIELD_FROM_ISR( x )         ( void ) ( x )
+#define pvPortMalloc                    malloc
+#define vPortFree                       free
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define taskENTER_CRITICAL_FROM_ISR()   0
+#define taskEXIT_CRITICAL_FROM_ISR( x ) ( void ) ( x )
+
+#define blog_debug(...)
+#define blog_warn(...)                  printf(__VA_ARGS__)
+#define BL_ASSERT_ERROR(cond) do { \
+    if (!(cond)) { \
+        printf("FAIL assert %s:%d\n", __FILE__, __LINE__); \
+        exit(1); \
+    } \
+} while (0)
+
+static TickType_t tick;
+static int notified;
+static int oversleep;
+static uint64_t slept;
+static jmp_buf loop_exit;
+
+/* every timer is done well within this, more means a timer was lost */
+#define TEST_SLEEP_MAX      (1ULL << 30)
+
+static TickType_t xTaskGetTickCount(void)
+{
+    return tick;
+}
+
+static TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return (TaskHandle_t)1;
+}
+
+static uint32_t bl_timer_now_us(void)
+{
+    return tick * 1000u;
+}
+
+static void xTaskNotifyGive(TaskHandle_t task)
+{
+    (void)task;
+    notified = 1;
+}
+
+static void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    (void)task;
+    (void)woken;
+    notified = 1;
+}
+
+static void vTaskDelay(TickType_t ticks)
+{
+    tick += ticks;
+}
+
+static uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    (void)clear;
+    if (notified) {
+        notified = 0;
+        return 1;
+    }
+    if (wait == portMAX_DELAY || slept > TEST_SLEEP_MAX) {
+        /* nothing is pending any more */
+        longjmp(loop_exit, 1);
+    }
+    wait += oversleep ? rand() % (oversleep + 1) : 0;
+    tick += wait;
+    slept += wait;
+    return 0;
+}
+
+#include "../../../../utils/src/utils_list.c"
+#include "../src/bloop_base.c"
+
+#define TEST_TIMERS         3000
+#define TEST_MSG_EVERY      97
+
+static int test_failed;
+
+static struct loop_ctx loop;
+static struct loop_timer timers[TEST_TIMERS];
+static int fired[TEST_TIMERS], want[TEST_TIMERS];
+static struct loop_msg msgs[TEST_TIMERS / TEST_MSG_EVERY + 1];
+static int msgs_sent, msgs_handled;
+static TickType_t tick_start;
+static unsigned int late_max;
+static long early, wrong_late;
+
+static void timer_cb(struct loop_ctx *l, struct loop_timer *timer, void *arg)
+{
+    int i = (int)(long)arg;
+    unsigned int late = tick - timer->time_target;
+    struct loop_msg *msg;
+
+    /* timers which were due before the loop started fire when it starts */
+    if ((int)(tick_start - timer->time_target) > 0 && fired[i] == 0) {
+        late = tick - tick_start;
+    }
+    if ((int)late < 0) {
+        if (early++ < 5) {
+            printf("FAIL timer %d fired at %u, target %u\n", i, tick, timer->time_target);
+        }
+    } else if (!oversleep && late) {
+        if (wrong_late++ < 5) {
+            printf("FAIL timer %d fired at %u, %u late\n", i, tick, late);
+        }
+    } else if (late > late_max) {
+        late_max = late;
+    }
+
+    fired[i]++;
+    if (fired[i] == want[i] && LOOP_TIMER_IS_AUTO_REPEAT(timer)) {
+        timer->flags &= ~LOOP_TIMER_FLAG_AUTO_REPEAT;
+    }
+    if (i % TEST_MSG_EVERY == 0 && fired[i] == 1) {
+        msg = &msgs[i / TEST_MSG_EVERY];
+        msg->u.header.priority = 5;
+        msg->u.header.id_msg = i & 0xff;
+        msg->arg1 = arg;
+        bloop_msg_send(l, msg);
+        msgs_sent++;
+    }
+}
+
+static int test_evt(struct loop_ctx *l, const struct loop_evt_handler *handler, uint32_t *bitmap_evt, uint32_t *evt_type_map)
+{
+    (void)l;
+    (void)handler;
+    (void)bitmap_evt;
+    *evt_type_map = 0;
+    return 0;
+}
+
+static int test_handle(struct loop_ctx *l, const struct loop_evt_handler *handler, struct loop_msg *msg)
+{
+    (void)l;
+    (void)handler;
+    if ((long)msg->arg1 % TEST_MSG_EVERY || msg->u.header.id_msg != ((long)msg->arg1 & 0xff)) {
+        printf("FAIL message %ld is wrong\n", (long)msg->arg1);
+        test_failed = 1;
+    }
+    msgs_handled++;
+    return 0;
+}
+
+static const struct loop_evt_handler handler_timer = {"timer", test_evt, NULL};
+static const struct loop_evt_handler handler_msg = {"msg", test_evt, test_handle};
+
+static void run(TickType_t start, int sleep_extra)
+{
+    unsigned int delay;
+    int i, missing;
+
+    tick = start;
+    oversleep = sleep_extra;
+    notified = 0;
+    slept = 0;
+    memset(fired, 0, sizeof(fired));
+    msgs_sent = msgs_handled = 0;
+    late_max = 0;
+    early = wrong_late = 0;
+
+    bloop_init(&loop);
+    bloop_handler_register(&loop, &handler_timer, 0);
+    bloop_handler_register(&loop, &handler_msg, 5);
+    for (i = 0; i < TEST_TIMERS; i++) {
+        switch (rand() % 4) {
+            case 0: delay = rand() % 40; break;
+            case 1: delay = rand() % 2000; break;
+            case 2: delay = rand() % 100000; break;
+            default: delay = rand() % 3000000; break;
+        }
+        bloop_timer_init(&timers[i], 0);
+        bloop_timer_configure(&timers[i], delay, timer_cb, (void *)(long)i, 0, 1);
+        want[i] = 1;
+        if (i % 5 == 0) {
+            bloop_timer_repeat_enable(&timers[i]);
+            want[i] = 1 + rand() % 20;
+        }
+        bloop_timer_register(&loop, &timers[i]);
+        /* some time passes while the timers are registered */
+        if (i % 100 == 0) {
+            tick += rand() % 50;
+        }
+    }
+    tick_start = tick;
+
+    if (!setjmp(loop_exit)) {
+        bloop_run(&loop);
+    }
+
+    missing = 0;
+    for (i = 0; i < TEST_TIMERS; i++) {
+        if (fired[i] != want[i]) {
+            missing++;
+        }
+    }
+    if (slept > TEST_SLEEP_MAX) {
+        printf("FAIL the loop still waits after %llu ticks\n", (unsigned long long)slept);
+        test_failed = 1;
+    }
+    if (early || wrong_late || missing || msgs_handled != msgs_sent) {
+        printf("FAIL %ld early, %ld late, %d timers fired wrong, %d of %d messages handled\n",
+               early, wrong_late, missing, msgs_handled, msgs_sent);
+        test_failed = 1;
+    }
+    printf("start %08x oversleep %d: %u fired in %u ticks, late max %u, wheel late max %u\n",
+           (unsigned int)start, sleep_extra, loop.timer_count_fired, (unsigned int)(tick - tick_start),
+           late_max, loop.timer_late_max);
+}
+
+static void watchdog(int sig)
+{
+    (void)sig;
+    printf("FAIL the loop is stuck\nFAILED\n");
+    fflush(stdout);
+    _exit(1);
+}
+
+int main(void)
+{
+    signal(SIGALRM, watchdog);
+    alarm(60);
+    srand(1);
+    run(0, 0);
+    run(0xFFFFFFF0, 0);
+    run(0x7FFFFF00, 0);
+    run(0, 7);
+    run(0xFFFF0000, 30);
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
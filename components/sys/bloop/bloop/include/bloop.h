@@ -52,8 +52,8 @@ struct loop_msg {
     } u;
     void *arg1;
     void *arg2;
-    unsigned int time_added;
-    unsigned int time_consumed;
+    unsigned int time_added;    /* us, stamped by bloop_msg_send */
+    unsigned int time_consumed; /* us spent queued, filled in before handle is called */
 };
 
 struct loop_evt_handler_statistic {
@@ -61,6 +61,12 @@ struct loop_evt_handler_statistic {
     unsigned int time_consumed;
     unsigned int time_accumulated;
     unsigned int count_triggered;
+    /* msg dispatch, latency is the time from bloop_msg_send to handle, all in us */
+    unsigned int msg_count;
+    unsigned int msg_latency_max;
+    unsigned int msg_latency_accumulated;
+    unsigned int msg_time_max;
+    unsigned int msg_time_accumulated;
 };
 
 struct loop_evt_handler {
@@ -72,6 +78,14 @@ struct loop_evt_handler {
 #define LOOP_TASK_MAX  (32)
 #define LOOP_TASK_PRIORITY_HIGHEST  (31)
 
+/* Timer wheel: level n has 32 slots of 32^n ticks each, covering 2^20 ticks.
+ * Timers further out are parked in the last slot reachable and re-placed
+ * when that slot cascades.
+ */
+#define LOOP_TIMER_WHEEL_BITS       (5)
+#define LOOP_TIMER_WHEEL_SLOTS      (1 << LOOP_TIMER_WHEEL_BITS)
+#define LOOP_TIMER_WHEEL_LEVELS     (4)
+
 struct loop_ctx {
     TaskHandle_t looper;
     uint32_t bitmap_evt_async;
@@ -82,9 +96,14 @@ struct loop_ctx {
     struct utils_list list[LOOP_TASK_MAX];
     struct loop_evt_handler_statistic statistic[LOOP_TASK_MAX];
     const struct loop_evt_handler *handlers[LOOP_TASK_MAX];
-    /* List for timer */
-    utils_dlist_t timer_dlist;
+    /* Timer wheel, protected by critical section since timers may be registered from other tasks */
+    unsigned int timer_tick;    /* first tick not expired yet */
+    uint32_t timer_bitmap[LOOP_TIMER_WHEEL_LEVELS];
+    utils_dlist_t timer_wheel[LOOP_TIMER_WHEEL_LEVELS][LOOP_TIMER_WHEEL_SLOTS];
+    utils_dlist_t timer_expired;
     utils_dlist_t timer_dued;
+    unsigned int timer_count_fired;
+    unsigned int timer_late_max;
 };
 
 struct loop_timer {
@@ -125,6 +144,9 @@ void bloop_wait_startup(struct loop_ctx *loop);
 /* ASYNC API is used in another code routine, such as Thread or IRQ Handler*/
 void bloop_evt_set_async(struct loop_ctx *loop, unsigned int evt, uint32_t evt_map);
 void bloop_evt_set_async_fromISR(struct loop_ctx *loop, unsigned int evt, uint32_t evt_map);
+/* msg is queued to the handler registered at msg->u.header.priority and must stay valid until its handle returns */
+int bloop_msg_send(struct loop_ctx *loop, struct loop_msg *msg);
+int bloop_msg_send_fromISR(struct loop_ctx *loop, struct loop_msg *msg);
 /* SYNC API is used in loop contex*/
 void bloop_evt_set_sync(struct loop_ctx *loop, unsigned int evt, uint32_t evt_map);
 void bloop_evt_unset_sync(struct loop_ctx *loop, unsigned int evt);
@@ -36,17 +36,26 @@
 #include <bloop.h>
 #include <utils_debug.h>
 
+#define TIMER_WHEEL_MASK    (LOOP_TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_RANGE   (1U << (LOOP_TIMER_WHEEL_BITS * LOOP_TIMER_WHEEL_LEVELS))
+
 int bloop_init(struct loop_ctx *loop)
 {
-    unsigned int i;
+    unsigned int i, j;
 
     memset(loop, 0, sizeof(struct loop_ctx));
     for (i = 0; i < sizeof(loop->list)/sizeof(loop->list[0]); i++) {
         utils_list_init(&(loop->list[i]));
     }
-    INIT_UTILS_DLIST_HEAD(&(loop->timer_dlist));
+    for (j = 0; j < LOOP_TIMER_WHEEL_LEVELS; j++) {
+        for (i = 0; i < LOOP_TIMER_WHEEL_SLOTS; i++) {
+            INIT_UTILS_DLIST_HEAD(&(loop->timer_wheel[j][i]));
+        }
+    }
+    INIT_UTILS_DLIST_HEAD(&(loop->timer_expired));
     INIT_UTILS_DLIST_HEAD(&(loop->timer_dued));
-    printf("=== %d task inited\r\n", i);
+    loop->timer_tick = xTaskGetTickCount();
+    printf("=== %d task inited\r\n", LOOP_TASK_MAX);
 
     return 0;
 }
@@ -64,7 +73,7 @@ int bloop_handler_register(struct loop_ctx *loop, const struct loop_evt_handler
         i = priority;
     } else {
         for (i = priority; i < LOOP_TASK_MAX; i++) {
-            if (NULL == loop->handlers[priority]) {
+            if (NULL == loop->handlers[i]) {
                 break;
             }
         }
@@ -125,44 +134,138 @@ void bloop_timer_repeat_reconfigure(struct loop_timer *timer)
 {
     int delay_ms;
 
-    delay_ms = (int)timer->time_target - (int)timer->time_added;
+    delay_ms = (int)(timer->time_target - timer->time_added);
     timer->time_added = xTaskGetTickCount();
     timer->time_target = timer->time_added + delay_ms;
 }
 
-void bloop_timer_register(struct loop_ctx *loop, struct loop_timer *timer)
+static inline int _timer_wheel_empty(struct loop_ctx *loop)
 {
-    int found = 0;
-    struct loop_timer *node = NULL, *node_pre = NULL;
+    int level;
 
-    if (utils_dlist_empty(&loop->timer_dlist)) {
-        utils_dlist_add(&timer->dlist_item, &loop->timer_dlist);
-    } else {
-        utils_dlist_for_each_entry(&loop->timer_dlist, node, struct loop_timer, dlist_item) {
-            if ((int)timer->time_target - (int)node->time_target <= 0) {
-                /* ascend list on time_target*/
-                if (NULL == node_pre) {
-                    /* Still add to the head*/
-                    utils_dlist_add(&timer->dlist_item, &loop->timer_dlist);
-                } else {
-                    utils_dlist_add(&timer->dlist_item, &node_pre->dlist_item);
-                }
-                found = 1;
-                break;
-            } else {
-                node_pre = node;
-            }
+    for (level = 0; level < LOOP_TIMER_WHEEL_LEVELS; level++) {
+        if (loop->timer_bitmap[level]) {
+            return 0;
         }
-        if (0 == found) {
-            /*add to the tail*/
-            utils_dlist_add(&timer->dlist_item, &node_pre->dlist_item);
+    }
+    return utils_dlist_empty(&loop->timer_expired);
+}
+
+/* Must be called in critical section */
+static void _timer_wheel_insert(struct loop_ctx *loop, struct loop_timer *timer)
+{
+    unsigned int delta, expires, slot;
+    int level;
+
+    expires = timer->time_target;
+    delta = expires - loop->timer_tick;
+    if ((int)delta < 0) {
+        /* already due, fire on the next pass*/
+        utils_dlist_add_tail(&timer->dlist_item, &loop->timer_expired);
+        return;
+    }
+    if (delta >= TIMER_WHEEL_RANGE) {
+        /* park in the farthest slot, placed again on cascade*/
+        delta = TIMER_WHEEL_RANGE - 1;
+        expires = loop->timer_tick + delta;
+    }
+    for (level = 0; delta >> (LOOP_TIMER_WHEEL_BITS * (level + 1)); level++) {
+    }
+
+    slot = (expires >> (LOOP_TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+    utils_dlist_add_tail(&timer->dlist_item, &loop->timer_wheel[level][slot]);
+    loop->timer_bitmap[level] |= (1U << slot);
+}
+
+/* First tick at or after timer_tick with a slot to expire or cascade.
+ * Must be called in critical section
+ */
+static int _timer_wheel_next(struct loop_ctx *loop, unsigned int *tick)
+{
+    unsigned int base, rot, shift, candidate;
+    uint32_t bitmap;
+    int level, found = 0;
+
+    for (level = 0; level < LOOP_TIMER_WHEEL_LEVELS; level++) {
+        bitmap = loop->timer_bitmap[level];
+        if (0 == bitmap) {
+            continue;
+        }
+        /* first slot boundary of this level not passed yet*/
+        shift = LOOP_TIMER_WHEEL_BITS * level;
+        base = (loop->timer_tick + ((1U << shift) - 1)) >> shift;
+        rot = base & TIMER_WHEEL_MASK;
+        if (rot) {
+            bitmap = (bitmap >> rot) | (bitmap << (LOOP_TIMER_WHEEL_SLOTS - rot));
+        }
+        candidate = (base + __builtin_ctz(bitmap)) << shift;
+        if (0 == found || (int)(candidate - *tick) < 0) {
+            *tick = candidate;
+            found = 1;
         }
     }
+
+    return found;
+}
+
+/* Must be called in critical section */
+static void _timer_wheel_cascade(struct loop_ctx *loop, unsigned int tick)
+{
+    struct loop_timer *timer;
+    utils_dlist_t list, *tmp;
+    unsigned int slot, shift;
+    int level;
+
+    for (level = 1; level < LOOP_TIMER_WHEEL_LEVELS; level++) {
+        shift = LOOP_TIMER_WHEEL_BITS * level;
+        if (tick & ((1U << shift) - 1)) {
+            break;
+        }
+        slot = (tick >> shift) & TIMER_WHEEL_MASK;
+        if (0 == (loop->timer_bitmap[level] & (1U << slot))) {
+            continue;
+        }
+        loop->timer_bitmap[level] &= ~(1U << slot);
+
+        INIT_UTILS_DLIST_HEAD(&list);
+        utils_dlist_for_each_entry_safe(&loop->timer_wheel[level][slot], tmp, timer, struct loop_timer, dlist_item) {
+            utils_dlist_del(&timer->dlist_item);
+            utils_dlist_add_tail(&timer->dlist_item, &list);
+        }
+        utils_dlist_for_each_entry_safe(&list, tmp, timer, struct loop_timer, dlist_item) {
+            utils_dlist_del(&timer->dlist_item);
+            _timer_wheel_insert(loop, timer);
+        }
+    }
+}
+
+void bloop_timer_register(struct loop_ctx *loop, struct loop_timer *timer)
+{
+    taskENTER_CRITICAL();
+    if (_timer_wheel_empty(loop)) {
+        /* nothing pending, so skip the idle ticks*/
+        loop->timer_tick = xTaskGetTickCount();
+    }
+    _timer_wheel_insert(loop, timer);
+    taskEXIT_CRITICAL();
+
+    /* looper may be sleeping on a later timer*/
+    if (loop->looper && xTaskGetCurrentTaskHandle() != loop->looper) {
+        xTaskNotifyGive(loop->looper);
+    }
 }
 
 /* timer maybe free after this function*/
-static inline void _timer_is_up_handle(struct loop_ctx *loop, struct loop_timer *timer)
+static inline void _timer_is_up_handle(struct loop_ctx *loop, struct loop_timer *timer, unsigned int time_now)
 {
+    unsigned int late;
+
+    late = time_now - timer->time_target;
+    if (loop->timer_late_max < late) {
+        loop->timer_late_max = late;
+    }
+    loop->timer_count_fired++;
+
     bloop_evt_set_sync(loop, timer->idx_task, timer->evt_type_map);
 
     if (timer->cb) {
@@ -191,28 +294,73 @@ static inline void _timer_dued_clean(struct loop_ctx *loop)
     }
 }
 
+/* Expire every timer due at time_now, callbacks run outside critical section */
+static void _timer_wheel_advance(struct loop_ctx *loop, unsigned int time_now)
+{
+    struct loop_timer *timer;
+    utils_dlist_t list, *tmp;
+    unsigned int tick, slot;
+    int has_slot;
+
+    INIT_UTILS_DLIST_HEAD(&list);
+    taskENTER_CRITICAL();
+    utils_dlist_for_each_entry_safe(&loop->timer_expired, tmp, timer, struct loop_timer, dlist_item) {
+        utils_dlist_del(&timer->dlist_item);
+        utils_dlist_add_tail(&timer->dlist_item, &list);
+    }
+    taskEXIT_CRITICAL();
+
+    do {
+        utils_dlist_for_each_entry_safe(&list, tmp, timer, struct loop_timer, dlist_item) {
+            _timer_is_up_handle(loop, timer, time_now);
+        }
+
+        taskENTER_CRITICAL();
+        has_slot = _timer_wheel_next(loop, &tick) && (int)(tick - time_now) <= 0;
+        if (has_slot) {
+            loop->timer_tick = tick;
+            _timer_wheel_cascade(loop, tick);
+            slot = tick & TIMER_WHEEL_MASK;
+            if (loop->timer_bitmap[0] & (1U << slot)) {
+                loop->timer_bitmap[0] &= ~(1U << slot);
+                utils_dlist_for_each_entry_safe(&loop->timer_wheel[0][slot], tmp, timer, struct loop_timer, dlist_item) {
+                    utils_dlist_del(&timer->dlist_item);
+                    utils_dlist_add_tail(&timer->dlist_item, &list);
+                }
+            }
+            loop->timer_tick = tick + 1;
+        } else {
+            loop->timer_tick = time_now + 1;
+        }
+        taskEXIT_CRITICAL();
+    } while (has_slot);
+}
+
 static int _bloop_wait(struct loop_ctx *loop)
 {
-    struct loop_timer *timer = NULL;
-    utils_dlist_t *tmp;
-    int time2wait;
-    unsigned int time_now;
+    int time2wait, has_timer;
+    unsigned int tick;
 
 copy_evt:
     /* Copy latest evt from ASYNC evt */
     taskENTER_CRITICAL();
     loop->bitmap_evt_sync |= loop->bitmap_evt_async;
     loop->bitmap_evt_async = 0;
+    if (!utils_dlist_empty(&loop->timer_expired)) {
+        has_timer = 1;
+        tick = loop->timer_tick - 1;
+    } else {
+        has_timer = _timer_wheel_next(loop, &tick);
+    }
     taskEXIT_CRITICAL();
 
-    if (0 == loop->bitmap_evt_sync) {
-        if (utils_dlist_empty(&loop->timer_dlist)) {
-            /* timer list is empty*/
+    if (0 == loop->bitmap_evt_sync && 0 == loop->bitmap_msg) {
+        if (0 == has_timer) {
+            /* timer wheel is empty*/
             ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
         } else {
-            /* timer list is NOT empty, so wait with timeout*/
-            timer = utils_dlist_first_entry(&loop->timer_dlist, struct loop_timer, dlist_item);
-            time2wait = (int)timer->time_target - (int)xTaskGetTickCount();
+            /* timer wheel is NOT empty, so wait with timeout*/
+            time2wait = (int)(tick - xTaskGetTickCount());
             if (time2wait > 0) {
                 ulTaskNotifyTake(pdTRUE, time2wait);
             } else {
@@ -224,17 +372,9 @@ copy_evt:
     }
 
 handle_timer:
-    if (!utils_dlist_empty(&loop->timer_dlist)) {
-        time_now = xTaskGetTickCount(); //must use time_now to skeep the snapshot of tiemstamp
-        utils_dlist_for_each_entry_safe(&loop->timer_dlist, tmp, timer, struct loop_timer, dlist_item) {
-            if ((int)time_now - (int)timer->time_target >= 0) {
-                /*this timer is up*/
-                _timer_is_up_handle(loop, timer);
-            } else {
-                /* Break now, since timer list is ascend*/
-                break;
-            }
-        }
+    if (has_timer) {
+        //must use time_now to skeep the snapshot of tiemstamp
+        _timer_wheel_advance(loop, xTaskGetTickCount());
         _timer_dued_clean(loop);
     }
 
@@ -243,12 +383,12 @@ handle_timer:
 
 static inline int _evt_highest(struct loop_ctx *loop)
 {
-    return 31 - __builtin_clz(loop->bitmap_evt_sync);
+    return loop->bitmap_evt_sync ? 31 - __builtin_clz(loop->bitmap_evt_sync) : -1;
 }
 
 static inline int _msg_highest(struct loop_ctx *loop)
 {
-    return 31 - __builtin_clz(loop->bitmap_msg);
+    return loop->bitmap_msg ? 31 - __builtin_clz(loop->bitmap_msg) : -1;
 }
 
 static inline void _evt_handle(struct loop_ctx *loop, int highest_evt)
@@ -282,28 +422,43 @@ static inline void _evt_handle(struct loop_ctx *loop, int highest_evt)
 
 static inline void _msg_handle(struct loop_ctx *loop, int highest_msg)
 {
-#if 0
     const struct loop_evt_handler *handler;
-#endif
+    struct loop_evt_handler_statistic *statistic;
     struct loop_msg *msg;
+    unsigned int time_start, time_consumed;
 
     //TODO use containerof
+    taskENTER_CRITICAL();
     msg = (struct loop_msg*)utils_list_pop_front(&loop->list[highest_msg]);
+    if (utils_list_is_empty(&loop->list[highest_msg])) {
+        loop->bitmap_msg &= (~(1 << highest_msg));
+    }
+    taskEXIT_CRITICAL();
     BL_ASSERT_ERROR(msg);
 
-#if 0
-    handler = loop->handlers[msg->u.header.priority];
-#endif
-
-#if 0
-            uint8_t priority;
-            uint8_t id_dst;
-            uint8_t id_msg;
-            uint8_t id_src;
-        } header;
-    } u;
-    BL_ASSERT_ERROR(handler);
-#endif
+    handler = loop->handlers[highest_msg];
+    if (NULL == handler || NULL == handler->handle) {
+        blog_warn("drop msg %u from %u, no handler on task %d\r\n",
+                msg->u.header.id_msg, msg->u.header.id_src, highest_msg);
+        return;
+    }
+
+    time_start = bl_timer_now_us();
+    msg->time_consumed = time_start - msg->time_added;
+    statistic = &loop->statistic[highest_msg];
+    statistic->msg_latency_accumulated += msg->time_consumed;
+    if (statistic->msg_latency_max < msg->time_consumed) {
+        statistic->msg_latency_max = msg->time_consumed;
+    }
+
+    /* msg belongs to handler from now on, it may be freed or sent again*/
+    handler->handle(loop, handler, msg);
+    time_consumed = bl_timer_now_us() - time_start;
+    statistic->msg_time_accumulated += time_consumed;
+    if (statistic->msg_time_max < time_consumed) {
+        statistic->msg_time_max = time_consumed;
+    }
+    statistic->msg_count++;
 }
 
 static void _bloop_handle_set(struct loop_ctx *loop)
@@ -370,6 +525,51 @@ void bloop_evt_set_async_fromISR(struct loop_ctx *loop, unsigned int evt, uint32
     }
 }
 
+int bloop_msg_send(struct loop_ctx *loop, struct loop_msg *msg)
+{
+    unsigned int priority = msg->u.header.priority;
+
+    if (priority >= LOOP_TASK_MAX) {
+        return -1;
+    }
+
+    msg->time_added = bl_timer_now_us();
+    taskENTER_CRITICAL();
+    utils_list_push_back(&loop->list[priority], &msg->item);
+    loop->bitmap_msg |= (1 << priority);
+    taskEXIT_CRITICAL();
+
+    /*wait up looper in case*/
+    if (xTaskGetCurrentTaskHandle() != loop->looper) {
+        xTaskNotifyGive(loop->looper);
+    }
+    return 0;
+}
+
+int bloop_msg_send_fromISR(struct loop_ctx *loop, struct loop_msg *msg)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    UBaseType_t uxSavedInterruptStatus;
+    unsigned int priority = msg->u.header.priority;
+
+    if (priority >= LOOP_TASK_MAX) {
+        return -1;
+    }
+
+    msg->time_added = bl_timer_now_us();
+    uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+    utils_list_push_back(&loop->list[priority], &msg->item);
+    loop->bitmap_msg |= (1 << priority);
+    taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+
+    /*wait up looper in case*/
+    vTaskNotifyGiveFromISR(loop->looper, &xHigherPriorityTaskWoken);
+    if (pdTRUE == xHigherPriorityTaskWoken) {
+        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    }
+    return 0;
+}
+
 void bloop_evt_set_sync(struct loop_ctx *loop, unsigned int evt, uint32_t evt_map)
 {
     BL_ASSERT_ERROR(evt < LOOP_TASK_MAX);
@@ -399,26 +599,50 @@ static void _dump_task_handler(const struct loop_evt_handler *handler,
         statistic->time_accumulated/1000,
         statistic->time_max
     );
+    if (statistic->msg_count) {
+        printf("      msg cnt %u, latency avg %uus max %uus, time acc %ums max %uus\r\n",
+            statistic->msg_count,
+            statistic->msg_latency_accumulated/statistic->msg_count,
+            statistic->msg_latency_max,
+            statistic->msg_time_accumulated/1000,
+            statistic->msg_time_max
+        );
+    }
 }
 
-static void _dump_timer_dlist(utils_dlist_t *dlist)
+static void _dump_timer_dlist(utils_dlist_t *dlist, unsigned int time_now, int *count)
 {
     struct loop_timer *node;
-    unsigned int time_now;
-    int count = 0;
 
-    time_now = xTaskGetTickCount();
-    puts("--->>> timer list:\r\n");
     utils_dlist_for_each_entry(dlist, node, struct loop_timer, dlist_item) {
         printf("    timer[%02d]: %u(diff %d)ms, \t\t task idx %02d, evt map %08lx, ptr %p\r\n",
-                count,
+                *count,
                 node->time_target,
-                (int)time_now - (int)node->time_target,
+                (int)(time_now - node->time_target),
                 node->idx_task,
                 node->evt_type_map,
                 node->cb
         );
-        count++;
+        (*count)++;
+    }
+}
+
+static void _dump_timer_wheel(struct loop_ctx *loop)
+{
+    unsigned int time_now;
+    int level, slot, count = 0;
+
+    time_now = xTaskGetTickCount();
+    printf("--->>> timer wheel: tick %u, fired %u, late max %ums\r\n",
+            loop->timer_tick,
+            loop->timer_count_fired,
+            loop->timer_late_max
+    );
+    _dump_timer_dlist(&loop->timer_expired, time_now, &count);
+    for (level = 0; level < LOOP_TIMER_WHEEL_LEVELS; level++) {
+        for (slot = 0; slot < LOOP_TIMER_WHEEL_SLOTS; slot++) {
+            _dump_timer_dlist(&loop->timer_wheel[level][slot], time_now, &count);
+        }
     }
 }
 
@@ -429,7 +653,7 @@ int bloop_status_dump(struct loop_ctx *loop)
     puts("====== bloop dump ======\r\n");
     printf("  bitmap_evt %lx\r\n", loop->bitmap_evt_sync);
     printf("  bitmap_msg %lx\r\n", loop->bitmap_msg);
-    _dump_timer_dlist(&loop->timer_dlist);
+    _dump_timer_wheel(loop);
     printf("  %d task:\r\n", sizeof(loop->list)/sizeof(loop->list[0]));
     for (i = sizeof(loop->list)/sizeof(loop->list[0]) - 1; i >= 0; i--) {
         printf("    task[%02d] : %s\r\n",
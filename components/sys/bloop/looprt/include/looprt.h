@@ -38,6 +38,8 @@ int looprt_start_auto(void);
 void looprt_evt_status_dump(void);
 void looprt_evt_notify_async(unsigned int task, uint32_t evt_map);
 void looprt_evt_notify_async_fromISR(unsigned int task, uint32_t evt_map);
+int looprt_msg_send(struct loop_msg *msg);
+int looprt_msg_send_fromISR(struct loop_msg *msg);
 void looprt_evt_schedule(int task, uint32_t evt_map, int delay_ms);
 
 /* API for register EVT handlers on looprt looper*/
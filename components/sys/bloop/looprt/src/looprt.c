@@ -56,6 +56,16 @@ void looprt_evt_notify_async_fromISR(unsigned int task, uint32_t evt_map)
     bloop_evt_set_async_fromISR(&looprt, task, evt_map);
 }
 
+int looprt_msg_send(struct loop_msg *msg)
+{
+    return bloop_msg_send(&looprt, msg);
+}
+
+int looprt_msg_send_fromISR(struct loop_msg *msg)
+{
+    return bloop_msg_send_fromISR(&looprt, msg);
+}
+
 void looprt_evt_status_dump(void)
 {
     bloop_status_dump(&looprt);
@@ -27,4 +27,544 @@
  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include <stdio.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <semphr.h>
+
+#include <lwip/sockets.h>
+
+#include <hal_boot2.h>
+#include <bl_sec.h>
+#include <bl_mtd.h>
+#include <utils_sha256.h>
 #include <bl_sys_ota.h>
+
+#define OTA_STREAM_WRITER_PRIORITY_DEFAULT  (15)
+#define OTA_STREAM_WRITER_STACK_DEFAULT     (512)
+
+#define OTA_MS_NOW() ((uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS))
+
+typedef enum {
+    OTA_STREAM_STATE_HEADER,
+    OTA_STREAM_STATE_BODY,
+    OTA_STREAM_STATE_DONE,
+    OTA_STREAM_STATE_ERROR,
+} ota_stream_state_t;
+
+typedef struct ota_stream_item {
+    int idx;//-1 for stopping writer
+    uint32_t offset;
+    uint32_t len;
+} ota_stream_item_t;
+
+struct bl_ota_stream {
+    ota_stream_state_t state;
+    const bl_ota_flash_ops_t *flash;
+    void *flash_arg;
+    const bl_ota_hash_ops_t *hash;
+    void *hash_ctx;
+
+    ota_header_t header;
+    uint32_t header_got;
+    uint32_t body_len;
+    unsigned int flash_size;
+    uint32_t erased;//erase cursor, always sector aligned
+
+    uint8_t *buf[BL_OTA_STREAM_BUF_NUM];
+    int buf_cur;//buffer being filled, -1 for none
+    uint32_t buf_used;
+    uint32_t buf_offset;//image offset of buf_cur
+
+    QueueHandle_t queue_free;
+    QueueHandle_t queue_full;
+    SemaphoreHandle_t writer_done;
+    TaskHandle_t writer;
+    int writer_running;
+    volatile int error;
+
+    uint8_t sha256[32];
+    int verified;
+    uint32_t ms_start;
+    bl_ota_stream_stat_t stat;
+};
+
+static int _mtd_erase(void *arg, unsigned int offset, unsigned int size)
+{
+    return bl_mtd_erase((bl_mtd_handle_t)arg, offset, size);
+}
+
+static int _mtd_write(void *arg, unsigned int offset, unsigned int size, const uint8_t *data)
+{
+    return bl_mtd_write((bl_mtd_handle_t)arg, offset, size, data);
+}
+
+static int _mtd_size(void *arg, unsigned int *size)
+{
+    return bl_mtd_size((bl_mtd_handle_t)arg, size);
+}
+
+const bl_ota_flash_ops_t bl_ota_flash_ops_mtd = {
+    .erase = _mtd_erase,
+    .program = _mtd_write,
+    .size = _mtd_size,
+};
+
+/*
+ * The running SHA state lives in ctx, SEC_ENG is only taken around each
+ * update, so other users can hash between two OTA writes.
+ */
+static int _hash_hw_init(void *ctx)
+{
+    bl_sha_init((bl_sha_ctx_t*)ctx, BL_SHA256);
+    return 0;
+}
+
+static int _hash_hw_update(void *ctx, const uint8_t *data, uint32_t len)
+{
+    int ret;
+
+    bl_sha_mutex_take();
+    ret = bl_sha_update((bl_sha_ctx_t*)ctx, data, len);
+    bl_sha_mutex_give();
+    return ret;
+}
+
+static int _hash_hw_finish(void *ctx, uint8_t hash[32])
+{
+    int ret;
+
+    ret = bl_sha_finish((bl_sha_ctx_t*)ctx, hash);
+    bl_sha_free((bl_sha_ctx_t*)ctx);
+    return ret;
+}
+
+const bl_ota_hash_ops_t bl_ota_hash_ops_hw = {
+    .init = _hash_hw_init,
+    .update = _hash_hw_update,
+    .finish = _hash_hw_finish,
+    .ctx_size = sizeof(bl_sha_ctx_t),
+};
+
+static int _hash_sw_init(void *ctx)
+{
+    utils_sha256_init((iot_sha256_context*)ctx);
+    utils_sha256_starts((iot_sha256_context*)ctx);
+    return 0;
+}
+
+static int _hash_sw_update(void *ctx, const uint8_t *data, uint32_t len)
+{
+    utils_sha256_update((iot_sha256_context*)ctx, data, len);
+    return 0;
+}
+
+static int _hash_sw_finish(void *ctx, uint8_t hash[32])
+{
+    utils_sha256_finish((iot_sha256_context*)ctx, hash);
+    utils_sha256_free((iot_sha256_context*)ctx);
+    return 0;
+}
+
+const bl_ota_hash_ops_t bl_ota_hash_ops_sw = {
+    .init = _hash_sw_init,
+    .update = _hash_sw_update,
+    .finish = _hash_sw_finish,
+    .ctx_size = sizeof(iot_sha256_context),
+};
+
+static int _socket_read(void *arg, uint8_t *buf, unsigned int len)
+{
+    return read((int)(intptr_t)arg, buf, len);
+}
+
+/* arg is the socket fd */
+const bl_ota_transport_t bl_ota_transport_socket = {
+    .name = "socket",
+    .fetch = _socket_read,
+};
+
+static void _ota_writer_task(void *arg)
+{
+    bl_ota_stream_t *stream = (bl_ota_stream_t*)arg;
+    ota_stream_item_t item;
+    uint32_t end, ms;
+    int hash_started = 0;
+
+    if (stream->hash->init(stream->hash_ctx)) {
+        printf("[OTA] [STREAM] hash init failed\r\n");
+        stream->error = 1;
+    } else {
+        hash_started = 1;
+    }
+    while (1) {
+        xQueueReceive(stream->queue_full, &item, portMAX_DELAY);
+        if (item.idx < 0) {
+            break;
+        }
+        if (0 == stream->error) {
+            /*erase lazily, only sectors the chunk lands in*/
+            end = item.offset + item.len;
+            ms = OTA_MS_NOW();
+            while (stream->erased < end) {
+                if (stream->flash->erase(stream->flash_arg, stream->erased, BL_OTA_STREAM_SECTOR_SIZE)) {
+                    printf("[OTA] [STREAM] erase failed @%08lx\r\n", stream->erased);
+                    stream->error = 1;
+                    break;
+                }
+                stream->erased += BL_OTA_STREAM_SECTOR_SIZE;
+                stream->stat.sectors_erased++;
+            }
+            stream->stat.ms_erase += OTA_MS_NOW() - ms;
+
+            ms = OTA_MS_NOW();
+            if (0 == stream->error && stream->hash->update(stream->hash_ctx, stream->buf[item.idx], item.len)) {
+                printf("[OTA] [STREAM] hash update failed\r\n");
+                stream->error = 1;
+            }
+            stream->stat.ms_hash += OTA_MS_NOW() - ms;
+
+            ms = OTA_MS_NOW();
+            if (0 == stream->error && stream->flash->program(stream->flash_arg, item.offset, item.len, stream->buf[item.idx])) {
+                printf("[OTA] [STREAM] write failed @%08lx\r\n", item.offset);
+                stream->error = 1;
+            }
+            stream->stat.ms_write += OTA_MS_NOW() - ms;
+            if (0 == stream->error) {
+                stream->stat.written += item.len;
+            }
+        }
+        xQueueSend(stream->queue_free, &(item.idx), portMAX_DELAY);
+    }
+    /*only a started hash is finished, it frees the backend state*/
+    if (0 == hash_started || stream->hash->finish(stream->hash_ctx, stream->sha256)) {
+        stream->error = 1;
+    }
+    xSemaphoreGive(stream->writer_done);
+    vTaskDelete(NULL);
+}
+
+static int _ota_writer_stop(bl_ota_stream_t *stream)
+{
+    ota_stream_item_t item;
+
+    if (0 == stream->writer_running) {
+        return 0;
+    }
+    item.idx = -1;
+    item.offset = 0;
+    item.len = 0;
+    xQueueSend(stream->queue_full, &item, portMAX_DELAY);
+    xSemaphoreTake(stream->writer_done, portMAX_DELAY);
+    stream->writer_running = 0;
+
+    return 0;
+}
+
+bl_ota_stream_t *bl_ota_stream_create(const bl_ota_stream_config_t *config)
+{
+    bl_ota_stream_t *stream;
+    int i;
+
+    stream = pvPortMalloc(sizeof(bl_ota_stream_t));
+    if (NULL == stream) {
+        return NULL;
+    }
+    memset(stream, 0, sizeof(bl_ota_stream_t));
+    stream->state = OTA_STREAM_STATE_HEADER;
+    stream->buf_cur = -1;
+    stream->flash = config->flash ? config->flash : &bl_ota_flash_ops_mtd;
+    stream->flash_arg = config->flash_arg;
+    stream->hash = config->hash ? config->hash : &bl_ota_hash_ops_hw;
+
+    if (stream->flash->size(stream->flash_arg, &(stream->flash_size))) {
+        goto fail;
+    }
+    stream->hash_ctx = pvPortMalloc(stream->hash->ctx_size);
+    stream->queue_free = xQueueCreate(BL_OTA_STREAM_BUF_NUM, sizeof(int));
+    /*one more slot for the stop item*/
+    stream->queue_full = xQueueCreate(BL_OTA_STREAM_BUF_NUM + 1, sizeof(ota_stream_item_t));
+    stream->writer_done = xSemaphoreCreateBinary();
+    if (NULL == stream->hash_ctx || NULL == stream->queue_free ||
+            NULL == stream->queue_full || NULL == stream->writer_done) {
+        goto fail;
+    }
+    for (i = 0; i < BL_OTA_STREAM_BUF_NUM; i++) {
+        stream->buf[i] = pvPortMalloc(BL_OTA_STREAM_BUF_SIZE);
+        if (NULL == stream->buf[i]) {
+            goto fail;
+        }
+        xQueueSend(stream->queue_free, &i, 0);
+    }
+
+    if (pdPASS != xTaskCreate(_ota_writer_task, "ota_writer",
+                config->writer_stack ? config->writer_stack : OTA_STREAM_WRITER_STACK_DEFAULT,
+                stream,
+                config->writer_priority ? config->writer_priority : OTA_STREAM_WRITER_PRIORITY_DEFAULT,
+                &(stream->writer))) {
+        goto fail;
+    }
+    stream->writer_running = 1;
+    stream->ms_start = OTA_MS_NOW();
+
+    return stream;
+
+fail:
+    printf("[OTA] [STREAM] create failed\r\n");
+    bl_ota_stream_destroy(stream);
+    return NULL;
+}
+
+static int _ota_stream_check_header(bl_ota_stream_t *stream)
+{
+    ota_header_t *header = &(stream->header);
+
+    memcpy(&(stream->body_len), &(header->u.s.len), sizeof(stream->body_len));
+    printf("[OTA] [STREAM] %.16s, type %.4s, body %lu bytes\r\n",
+            (char*)header->u.s.header, (char*)header->u.s.type, stream->body_len);
+    if (0 == stream->body_len || stream->body_len > stream->flash_size) {
+        printf("[OTA] [STREAM] body len %lu is invalid, partition size %u\r\n",
+                stream->body_len, stream->flash_size);
+        return -1;
+    }
+    stream->stat.body_len = stream->body_len;
+
+    return 0;
+}
+
+/*
+ * Get the space data should go to next, *ptr is set to NULL when the stream
+ * doesn't accept data anymore
+ */
+static unsigned int _ota_stream_space(bl_ota_stream_t *stream, uint8_t **ptr)
+{
+    uint32_t space, left, ms;
+
+    *ptr = NULL;
+    if (stream->error) {
+        stream->state = OTA_STREAM_STATE_ERROR;
+    }
+    switch (stream->state) {
+        case OTA_STREAM_STATE_HEADER:
+        {
+            *ptr = (uint8_t*)&(stream->header) + stream->header_got;
+            return OTA_HEADER_SIZE - stream->header_got;
+        }
+        case OTA_STREAM_STATE_BODY:
+        {
+            if (stream->buf_cur < 0) {
+                ms = OTA_MS_NOW();
+                xQueueReceive(stream->queue_free, &(stream->buf_cur), portMAX_DELAY);
+                stream->stat.ms_wait_buf += OTA_MS_NOW() - ms;
+                stream->buf_used = 0;
+                stream->buf_offset = stream->stat.received;
+            }
+            space = BL_OTA_STREAM_BUF_SIZE - stream->buf_used;
+            left = stream->body_len - stream->stat.received;
+            *ptr = stream->buf[stream->buf_cur] + stream->buf_used;
+            return space < left ? space : left;
+        }
+        default:
+        {
+            return 0;
+        }
+    }
+}
+
+static int _ota_stream_put(bl_ota_stream_t *stream, unsigned int len)
+{
+    ota_stream_item_t item;
+
+    switch (stream->state) {
+        case OTA_STREAM_STATE_HEADER:
+        {
+            stream->header_got += len;
+            if (OTA_HEADER_SIZE == stream->header_got) {
+                if (_ota_stream_check_header(stream)) {
+                    stream->state = OTA_STREAM_STATE_ERROR;
+                    return -1;
+                }
+                stream->state = OTA_STREAM_STATE_BODY;
+            }
+        }
+        break;
+        case OTA_STREAM_STATE_BODY:
+        {
+            stream->buf_used += len;
+            stream->stat.received += len;
+            if (BL_OTA_STREAM_BUF_SIZE == stream->buf_used || stream->stat.received == stream->body_len) {
+                /*hand over to writer, receiving goes on with the other buffer*/
+                item.idx = stream->buf_cur;
+                item.offset = stream->buf_offset;
+                item.len = stream->buf_used;
+                xQueueSend(stream->queue_full, &item, portMAX_DELAY);
+                stream->buf_cur = -1;
+            }
+            if (stream->stat.received == stream->body_len) {
+                stream->state = OTA_STREAM_STATE_DONE;
+            }
+        }
+        break;
+        default:
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int bl_ota_stream_feed(bl_ota_stream_t *stream, const uint8_t *data, unsigned int len)
+{
+    unsigned int space;
+    uint8_t *ptr;
+
+    while (len) {
+        space = _ota_stream_space(stream, &ptr);
+        if (NULL == ptr) {
+            /*data after image end or stream error*/
+            return -1;
+        }
+        if (space > len) {
+            space = len;
+        }
+        memcpy(ptr, data, space);
+        if (_ota_stream_put(stream, space)) {
+            return -1;
+        }
+        data += space;
+        len -= space;
+    }
+
+    return 0;
+}
+
+int bl_ota_stream_run(bl_ota_stream_t *stream, const bl_ota_transport_t *transport, void *arg)
+{
+    unsigned int space;
+    uint8_t *ptr;
+    int ret;
+
+    while (OTA_STREAM_STATE_DONE != stream->state) {
+        space = _ota_stream_space(stream, &ptr);
+        if (NULL == ptr) {
+            return -1;
+        }
+        /*receive straight into the stream buffer, no extra copy*/
+        ret = transport->fetch(arg, ptr, space);
+        if (ret <= 0) {
+            printf("[OTA] [STREAM] %s ends unexpectedly %d, got %lu\r\n",
+                    transport->name, ret, stream->stat.received);
+            return -1;
+        }
+        if (_ota_stream_put(stream, ret)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int bl_ota_stream_done(bl_ota_stream_t *stream)
+{
+    return OTA_STREAM_STATE_DONE == stream->state;
+}
+
+int bl_ota_stream_finish(bl_ota_stream_t *stream)
+{
+    unsigned int i;
+
+    _ota_writer_stop(stream);
+    stream->stat.ms_total = OTA_MS_NOW() - stream->ms_start;
+
+    printf("[OTA] [STREAM] %lu/%lu bytes in %lums, erase %lums (%lu sectors), write %lums, hash %lums, wait %lums\r\n",
+            stream->stat.written,
+            stream->body_len,
+            stream->stat.ms_total,
+            stream->stat.ms_erase,
+            stream->stat.sectors_erased,
+            stream->stat.ms_write,
+            stream->stat.ms_hash,
+            stream->stat.ms_wait_buf
+    );
+    if (OTA_STREAM_STATE_DONE != stream->state || stream->error || stream->stat.written != stream->body_len) {
+        printf("[OTA] [STREAM] image is NOT complete\r\n");
+        return -1;
+    }
+
+    puts("[OTA] [STREAM] Calculated SHA256 Checksum:");
+    for (i = 0; i < sizeof(stream->sha256); i++) {
+        printf("%02X", stream->sha256[i]);
+    }
+    puts("\r\n[OTA] [STREAM] Header SET SHA256 Checksum:");
+    for (i = 0; i < sizeof(stream->header.u.s.sha256); i++) {
+        printf("%02X", stream->header.u.s.sha256[i]);
+    }
+    puts("\r\n");
+    if (memcmp(stream->sha256, stream->header.u.s.sha256, sizeof(stream->sha256))) {
+        printf("[OTA] [STREAM] SHA256 NOT Correct\r\n");
+        return -1;
+    }
+    stream->verified = 1;
+
+    return 0;
+}
+
+int bl_ota_stream_commit(bl_ota_stream_t *stream)
+{
+    HALPartition_Entry_Config ptEntry;
+
+    if (0 == stream->verified) {
+        return -1;
+    }
+    if (hal_boot2_get_active_entries(BOOT2_PARTITION_TYPE_FW, &ptEntry)) {
+        printf("[OTA] [STREAM] PtTable_Get_Active_Entries fail\r\n");
+        return -1;
+    }
+    ptEntry.len = stream->body_len;
+    printf("[OTA] [STREAM] Update PARTITION, partition len is %lu\r\n", ptEntry.len);
+    return hal_boot2_update_ptable(&ptEntry);
+}
+
+int bl_ota_stream_header(bl_ota_stream_t *stream, ota_header_t *header)
+{
+    if (OTA_STREAM_STATE_HEADER == stream->state) {
+        return -1;
+    }
+    memcpy(header, &(stream->header), sizeof(ota_header_t));
+    return 0;
+}
+
+int bl_ota_stream_stat(bl_ota_stream_t *stream, bl_ota_stream_stat_t *stat)
+{
+    memcpy(stat, &(stream->stat), sizeof(bl_ota_stream_stat_t));
+    return 0;
+}
+
+void bl_ota_stream_destroy(bl_ota_stream_t *stream)
+{
+    int i;
+
+    if (NULL == stream) {
+        return;
+    }
+    stream->error = 1;
+    _ota_writer_stop(stream);
+    for (i = 0; i < BL_OTA_STREAM_BUF_NUM; i++) {
+        vPortFree(stream->buf[i]);
+    }
+    if (stream->queue_free) {
+        vQueueDelete(stream->queue_free);
+    }
+    if (stream->queue_full) {
+        vQueueDelete(stream->queue_full);
+    }
+    if (stream->writer_done) {
+        vSemaphoreDelete(stream->writer_done);
+    }
+    vPortFree(stream->hash_ctx);
+    vPortFree(stream);
+}
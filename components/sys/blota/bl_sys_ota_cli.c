@@ -43,29 +43,9 @@
 #include <cli.h>
 #include <hal_boot2.h>
 #include <hal_sys.h>
-#include <utils_sha256.h>
 #include <bl_sys_ota.h>
 #include <bl_mtd.h>
 
-typedef struct ota_header {
-    union {
-        struct {
-            uint8_t header[16];
-
-            uint8_t type[4];//RAW XZ
-            uint32_t len;//body len
-            uint8_t pad0[8];
-
-            uint8_t ver_hardware[16];
-            uint8_t ver_software[16];
-
-            uint8_t sha256[32];
-        } s;
-        uint8_t _pad[512];
-    } u;
-} ota_header_t;
-#define OTA_HEADER_SIZE (sizeof(ota_header_t))
-
 static int _check_ota_header(ota_header_t *ota_header, uint32_t *ota_len, int *use_xz)
 {
     char str[33];//assume max segment size
@@ -114,19 +94,18 @@ static int _check_ota_header(ota_header_t *ota_header, uint32_t *ota_len, int *u
     return 0;
 }
 
-#define OTA_PROGRAM_SIZE (512)
 static void ota_tcp_cmd([[gnu::unused]] char *buf, [[gnu::unused]] int len, int argc, char **argv)
 {
     int sockfd;
-    unsigned int i;
     int ret;
     struct hostent *hostinfo;
-    uint8_t *recv_buffer;
     struct sockaddr_in dest;
-    iot_sha256_context ctx;
-    uint8_t sha256_result[32];
-    uint8_t sha256_img[32];
     bl_mtd_handle_t handle;
+    bl_ota_stream_t *stream;
+    bl_ota_stream_config_t config;
+    ota_header_t *ota_header;
+    uint32_t bin_size;
+    int use_xz;
 
     if (2 != argc) {
         printf("Usage: %s IP\r\n", argv[0]);
@@ -160,154 +139,51 @@ static void ota_tcp_cmd([[gnu::unused]] char *buf, [[gnu::unused]] int len, int
     uint32_t address = dest.sin_addr.s_addr;
     char *ip = inet_ntoa(address);
 
-    uint32_t total = 0;
-    int ota_header_found, use_xz;
-    ota_header_t *ota_header;
-
-    recv_buffer = pvPortMalloc(OTA_PROGRAM_SIZE);
-
-    unsigned int buffer_offset, flash_offset, ota_addr;
-    uint32_t bin_size, part_size;
-    uint8_t activeID;
-    HALPartition_Entry_Config ptEntry;
-
-    activeID = hal_boot2_get_active_partition();
-
-    printf("Starting OTA test. OTA bin addr is %p\r\n", recv_buffer);
+    printf("[OTA] [TCP] activeID is %u\r\n", hal_boot2_get_active_partition());
 
-    printf("[OTA] [TEST] activeID is %u\r\n", activeID);
-
-    if (hal_boot2_get_active_entries(BOOT2_PARTITION_TYPE_FW, &ptEntry)) {
-        printf("PtTable_Get_Active_Entries fail\r\n");
-        vPortFree(recv_buffer);
+    /*flash is erased sector by sector by the stream writer, just ahead of programming*/
+    memset(&config, 0, sizeof(config));
+    config.flash = &bl_ota_flash_ops_mtd;
+    config.flash_arg = handle;
+    config.hash = &bl_ota_hash_ops_hw;
+    stream = bl_ota_stream_create(&config);
+    if (NULL == stream) {
+        close(sockfd);
         bl_mtd_close(handle);
         return;
     }
-    ota_addr = ptEntry.Address[!ptEntry.activeIndex];
-    bin_size = ptEntry.maxLen[!ptEntry.activeIndex];
-    part_size = ptEntry.maxLen[!ptEntry.activeIndex];
-    (void) part_size;
-    /*XXX if you use bin_size is product env, you may want to set bin_size to the actual
-     * OTA BIN size, and also you need to splilt XIP_SFlash_Erase_With_Lock into
-     * serveral pieces. Partition size vs bin_size check is also needed
-     */
-    printf("Starting OTA test. OTA size is %lu\r\n", bin_size);
-
-    printf("[OTA] [TEST] activeIndex is %u, use OTA address=%08x\r\n", ptEntry.activeIndex, (unsigned int)ota_addr);
-
-    printf("[OTA] [TEST] Erase flash with size %lu...", bin_size);
-    bl_mtd_erase_all(handle);
-    printf("Done\r\n");
 
     printf("Server ip Address : %s\r\n", ip);
     /*---Connect to server---*/
     if (connect(sockfd, (struct sockaddr *)&dest, sizeof(dest)) != 0) {
         printf("Error in connect\r\n");
         close(sockfd);
-        vPortFree(recv_buffer);
+        bl_ota_stream_destroy(stream);
         bl_mtd_close(handle);
         return;
     }
 
-    buffer_offset = 0;
-    flash_offset = 0;
-    ota_header_found = 0;
-    use_xz = 0;
-
-    utils_sha256_init(&ctx);
-    utils_sha256_starts(&ctx);
-    memset(sha256_result, 0, sizeof(sha256_result));
-    while (1) {
-        /*first 512 bytes of TCP stream is OTA header*/
-        ret = read(sockfd, recv_buffer + buffer_offset, OTA_PROGRAM_SIZE - buffer_offset);
-        if (ret < 0) {
-            printf("ret = %d, err = %d\n\r", ret, errno);
-            break;
-        } else {
-            total += ret;
-            if (0 == ret) {
-                printf("[OTA] [TEST] seems ota file ends unexpectedly, already transfer %lu\r\n", total);
-                break;
-            }
-            printf("total = %ld, ret = %d\n\r", total, ret);
-            buffer_offset += ret;
-
-            /*Only handle this case when ota header is NOT found*/
-            if (0 == ota_header_found) {
-                if (buffer_offset < OTA_PROGRAM_SIZE) {
-                    continue;
-                } else if (buffer_offset > OTA_PROGRAM_SIZE) {
-                    printf("[OTA] [TCP] Assert for unexpected error %d\r\n", buffer_offset);
-                    while (1) {
-                        /*empty*/
-                    }
-                }
-                /*ota_header is got, we assume alignment of recv_buffer is OK*/
-                ota_header_found = 1;
-                ota_header = (ota_header_t*)recv_buffer;
-                if (_check_ota_header(ota_header, &bin_size, &use_xz)) {
-                    /*ota header is NOT OK*/
-                    break;
-                }
-                memcpy(sha256_img, ota_header->u.s.sha256, sizeof(sha256_img));
-                /*we think OTA_PROGRAM_SIZE is the same OTA_HEADER_SIZE, and refix total to exclude OTA_PROGRAM_SIZE*/
-                total -= OTA_PROGRAM_SIZE;
-                buffer_offset = 0;
-                printf("[OTA] [TCP] Update bin_size to %lu, file status %s\r\n", bin_size, use_xz ? "XZ" : "RAW");
-                continue;
-            }
+    /*first 512 bytes of TCP stream is OTA header*/
+    ret = bl_ota_stream_run(stream, &bl_ota_transport_socket, (void*)(intptr_t)sockfd);
+    close(sockfd);
 
-            if (bin_size != total) {
-                if (buffer_offset < OTA_PROGRAM_SIZE) {
-                    continue;
-                } else if (buffer_offset > OTA_PROGRAM_SIZE) {
-                    printf("[OTA] [TCP] Assert for unexpected error %d\r\n", buffer_offset);
-                    while (1) {
-                        /*empty*/
-                    }
-                }
-            } else if (total > bin_size) {
-                printf("[OTA] [TCP] Server has bug?\r\n");
-                while (1) {
-                }
-            }
+    ota_header = pvPortMalloc(OTA_HEADER_SIZE);
+    if (ota_header && 0 == bl_ota_stream_header(stream, ota_header)) {
+        _check_ota_header(ota_header, &bin_size, &use_xz);
+        printf("[OTA] [TCP] bin_size %lu, file status %s\r\n", bin_size, use_xz ? "XZ" : "RAW");
+    }
+    vPortFree(ota_header);
 
-            printf("Will Write %u to %08X from %p\r\n", buffer_offset, ota_addr + flash_offset, recv_buffer);
-            utils_sha256_update(&ctx, recv_buffer, buffer_offset);
-            bl_mtd_write(handle, flash_offset, buffer_offset, recv_buffer);
-            flash_offset += buffer_offset;
-            buffer_offset = 0;
-            if (bin_size == total) {
-                utils_sha256_finish(&ctx, sha256_result);
-                puts("\r\nCalculated SHA256 Checksum:");
-                for (i = 0; i < sizeof(sha256_result); i++) {
-                    printf("%02X", sha256_result[i]);
-                }
-                puts("\r\nHeader SET SHA256 Checksum:");
-                for (i = 0; i < sizeof(sha256_img); i++) {
-                    printf("%02X", sha256_img[i]);
-                }
-                puts("\r\n");
-                if (memcmp(sha256_img, sha256_result, sizeof(sha256_img))) {
-                    /*Error found*/
-                    printf("[OTA] [TCP] SHA256 NOT Correct\r\n");
-                    break;
-                }
-                printf("[OTA] [TCP] prepare OTA partition info\r\n");
-                ptEntry.len = bin_size;
-                printf("[OTA] [TCP] Update PARTITION, partition len is %lu\r\n", ptEntry.len);
-                hal_boot2_update_ptable(&ptEntry);
-                printf("[OTA] [TCP] Rebooting\r\n");
-                hal_reboot();
-            }
+    if (0 == bl_ota_stream_finish(stream) && 0 == ret) {
+        printf("[OTA] [TCP] prepare OTA partition info\r\n");
+        if (0 == bl_ota_stream_commit(stream)) {
+            printf("[OTA] [TCP] Rebooting\r\n");
+            hal_reboot();
         }
     }
 
-
     /*---Clean up---*/
-    close(sockfd);
-    vPortFree(recv_buffer);
-    utils_sha256_free(&ctx);
+    bl_ota_stream_destroy(stream);
     bl_mtd_close(handle);
 
     return;
@@ -0,0 +1,598 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test for the streaming OTA writer.  bl_mtd is a RAM partition that
+ * starts with garbage and only lets bits go from 1 to 0, so programming a
+ * sector that was not erased shows up, FreeRTOS queues, semaphores and the
+ * writer task run on POSIX threads.  Images of random sizes are pushed with
+ * random splits through bl_ota_stream_feed and pulled through
+ * bl_ota_stream_run, with both hash backends (SEC_ENG is replaced by the
+ * software SHA backend), then checked for flash contents, lazily erased
+ * sectors, SHA mismatch, bad headers, truncated streams, failing flash and a
+ * hash that fails to start.  The SHA mutex must never be held while flash is
+ * programmed.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* only read() is used from the socket API, take the host one */
+#define LWIP_HDR_SOCKETS_H
+#include "../bl_sys_ota.c"
+#include "../../../hal_drv/bl602_hal/bl_sec_hash.c"
+#include "../../../hal_drv/bl602_hal/bl_sec_sha_sw.c"
+#include "../../../utils/src/utils_sha256.c"
+
+#define TEST_PART_SIZE      (256 * 1024)
+
+static int test_failed;
+
+/* FreeRTOS on POSIX threads */
+struct QueueDefinition {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t len;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t *items;
+};
+
+QueueHandle_t xQueueGenericCreate(const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize, const uint8_t ucQueueType)
+{
+    QueueHandle_t q;
+
+    (void)ucQueueType;
+    q = calloc(1, sizeof(*q));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    q->len = uxQueueLength;
+    q->item_size = uxItemSize;
+    q->items = calloc(uxQueueLength, uxItemSize ? uxItemSize : 1);
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    pthread_mutex_destroy(&xQueue->lock);
+    pthread_cond_destroy(&xQueue->cond);
+    free(xQueue->items);
+    free(xQueue);
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void * const pvItemToQueue, TickType_t xTicksToWait, const BaseType_t xCopyPosition)
+{
+    (void)xCopyPosition;
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == xQueue->len) {
+        if (0 == xTicksToWait) {
+            pthread_mutex_unlock(&xQueue->lock);
+            return errQUEUE_FULL;
+        }
+        pthread_cond_wait(&xQueue->cond, &xQueue->lock);
+    }
+    if (xQueue->item_size) {
+        memcpy(xQueue->items + ((xQueue->head + xQueue->count) % xQueue->len) * xQueue->item_size,
+                pvItemToQueue, xQueue->item_size);
+    }
+    xQueue->count++;
+    pthread_cond_broadcast(&xQueue->cond);
+    pthread_mutex_unlock(&xQueue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void * const pvBuffer, TickType_t xTicksToWait)
+{
+    pthread_mutex_lock(&xQueue->lock);
+    while (0 == xQueue->count) {
+        if (0 == xTicksToWait) {
+            pthread_mutex_unlock(&xQueue->lock);
+            return pdFAIL;
+        }
+        pthread_cond_wait(&xQueue->cond, &xQueue->lock);
+    }
+    if (xQueue->item_size) {
+        memcpy(pvBuffer, xQueue->items + xQueue->head * xQueue->item_size, xQueue->item_size);
+    }
+    xQueue->head = (xQueue->head + 1) % xQueue->len;
+    xQueue->count--;
+    pthread_cond_broadcast(&xQueue->cond);
+    pthread_mutex_unlock(&xQueue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueSemaphoreTake(QueueHandle_t xQueue, TickType_t xTicksToWait)
+{
+    return xQueueReceive(xQueue, NULL, xTicksToWait);
+}
+
+typedef struct {
+    TaskFunction_t func;
+    void *arg;
+} test_task_t;
+
+static void *_task_entry(void *arg)
+{
+    test_task_t task = *(test_task_t*)arg;
+
+    free(arg);
+    task.func(task.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char * const pcName, const configSTACK_DEPTH_TYPE usStackDepth,
+        void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask)
+{
+    test_task_t *task;
+    pthread_t thread;
+
+    (void)pcName;
+    (void)usStackDepth;
+    (void)uxPriority;
+    task = malloc(sizeof(test_task_t));
+    task->func = pxTaskCode;
+    task->arg = pvParameters;
+    if (pthread_create(&thread, NULL, _task_entry, task)) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    if (pxCreatedTask) {
+        *pxCreatedTask = (TaskHandle_t)task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    (void)xTaskToDelete;
+    pthread_exit(NULL);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+void *pvPortMalloc(size_t xWantedSize)
+{
+    return malloc(xWantedSize);
+}
+
+void vPortFree(void *pv)
+{
+    free(pv);
+}
+
+/* SEC_ENG is replaced by the software backend, the mutex is only counted */
+static volatile int sha_mutex_depth, sha_mutex_takes;
+
+int bl_sha_mutex_take()
+{
+    __atomic_add_fetch(&sha_mutex_depth, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&sha_mutex_takes, 1, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+int bl_sha_mutex_give()
+{
+    if (__atomic_sub_fetch(&sha_mutex_depth, 1, __ATOMIC_SEQ_CST) < 0) {
+        printf("FAIL sha mutex given more than taken\n");
+        test_failed = 1;
+    }
+    return 0;
+}
+
+const bl_sha_backend_t bl_sha_backend_hw = {
+    .name = "test",
+    .process = NULL,
+};
+
+/* RAM bl_mtd partition, NOR semantics */
+typedef struct {
+    uint8_t data[TEST_PART_SIZE];
+    unsigned int erases;
+    unsigned int writes;
+    unsigned int fail_write;//fail the nth write, 0 for never
+    unsigned int delay_us;//per write, makes the writer slower than the receiver
+} ram_mtd_t;
+
+int bl_mtd_size(bl_mtd_handle_t handle, unsigned int *size)
+{
+    (void)handle;
+    *size = TEST_PART_SIZE;
+    return 0;
+}
+
+int bl_mtd_erase(bl_mtd_handle_t handle, unsigned int addr, unsigned int size)
+{
+    ram_mtd_t *mtd = (ram_mtd_t*)handle;
+
+    if ((addr % BL_OTA_STREAM_SECTOR_SIZE) || (size % BL_OTA_STREAM_SECTOR_SIZE) || addr + size > TEST_PART_SIZE) {
+        printf("FAIL erase %08x/%u\n", addr, size);
+        test_failed = 1;
+        return -1;
+    }
+    memset(mtd->data + addr, 0xFF, size);
+    mtd->erases += size / BL_OTA_STREAM_SECTOR_SIZE;
+    return 0;
+}
+
+int bl_mtd_write(bl_mtd_handle_t handle, unsigned int addr, unsigned int size, const uint8_t *data)
+{
+    ram_mtd_t *mtd = (ram_mtd_t*)handle;
+    unsigned int i;
+
+    if (sha_mutex_depth) {
+        printf("FAIL sha mutex held while programming flash\n");
+        test_failed = 1;
+    }
+    if (addr + size > TEST_PART_SIZE) {
+        printf("FAIL write %08x/%u out of partition\n", addr, size);
+        test_failed = 1;
+        return -1;
+    }
+    if (mtd->fail_write && ++mtd->writes == mtd->fail_write) {
+        return -1;
+    }
+    if (mtd->delay_us) {
+        usleep(mtd->delay_us);
+    }
+    for (i = 0; i < size; i++) {
+        if (0xFF != mtd->data[addr + i]) {
+            printf("FAIL write %08x not erased\n", addr + i);
+            test_failed = 1;
+            return -1;
+        }
+        mtd->data[addr + i] &= data[i];
+    }
+    return 0;
+}
+
+/* boot2 partition table */
+static uint32_t ptable_len;
+
+int hal_boot2_get_active_entries(int type, HALPartition_Entry_Config *ptEntry)
+{
+    (void)type;
+    memset(ptEntry, 0, sizeof(HALPartition_Entry_Config));
+    return 0;
+}
+
+int hal_boot2_update_ptable(HALPartition_Entry_Config *ptEntry)
+{
+    ptable_len = ptEntry->len;
+    return 0;
+}
+
+/* software hash that can be made to fail */
+static int hash_fail_init, hash_fail_update, hash_finishes;
+
+static int _test_hash_init(void *ctx)
+{
+    if (hash_fail_init) {
+        return -1;
+    }
+    return bl_ota_hash_ops_sw.init(ctx);
+}
+
+static int _test_hash_update(void *ctx, const uint8_t *data, uint32_t len)
+{
+    if (hash_fail_update) {
+        return -1;
+    }
+    return bl_ota_hash_ops_sw.update(ctx, data, len);
+}
+
+static int _test_hash_finish(void *ctx, uint8_t hash[32])
+{
+    hash_finishes++;
+    return bl_ota_hash_ops_sw.finish(ctx, hash);
+}
+
+static const bl_ota_hash_ops_t test_hash_ops = {
+    .init = _test_hash_init,
+    .update = _test_hash_update,
+    .finish = _test_hash_finish,
+    .ctx_size = sizeof(iot_sha256_context),
+};
+
+/* pull transport reading an image in random pieces */
+typedef struct {
+    const uint8_t *data;
+    unsigned int len;
+    unsigned int pos;
+} test_source_t;
+
+static int _test_fetch(void *arg, uint8_t *buf, unsigned int len)
+{
+    test_source_t *src = (test_source_t*)arg;
+    unsigned int n;
+
+    n = 1 + rand() % 3000;
+    if (n > len) {
+        n = len;
+    }
+    if (n > src->len - src->pos) {
+        n = src->len - src->pos;
+    }
+    memcpy(buf, src->data + src->pos, n);
+    src->pos += n;
+    return n;
+}
+
+static const bl_ota_transport_t test_transport = {
+    .name = "test",
+    .fetch = _test_fetch,
+};
+
+static ram_mtd_t mtd;
+static uint8_t image[OTA_HEADER_SIZE + TEST_PART_SIZE + 1];
+
+static unsigned int make_image(uint32_t body_len, int bad_sha)
+{
+    ota_header_t *header = (ota_header_t*)image;
+    unsigned int i;
+
+    memset(header, 0, sizeof(ota_header_t));
+    memcpy(header->u.s.header, "BL60X_OTA_Ver1.0", 16);
+    memcpy(header->u.s.type, "RAW", 4);
+    header->u.s.len = body_len;
+    for (i = 0; i < body_len; i++) {
+        image[OTA_HEADER_SIZE + i] = rand();
+    }
+    utils_sha256(image + OTA_HEADER_SIZE, body_len, header->u.s.sha256);
+    if (bad_sha) {
+        header->u.s.sha256[rand() % 32] ^= 1 << (rand() % 8);
+    }
+    return OTA_HEADER_SIZE + body_len;
+}
+
+/* run one image through a stream, returns bl_ota_stream_finish */
+static int run_image(const bl_ota_hash_ops_t *hash, unsigned int len, int pull)
+{
+    bl_ota_stream_config_t config;
+    bl_ota_stream_t *stream;
+    test_source_t src;
+    unsigned int pos, n;
+    int ret;
+
+    memset(&config, 0, sizeof(config));
+    config.flash_arg = &mtd;
+    config.hash = hash;
+    stream = bl_ota_stream_create(&config);
+    if (NULL == stream) {
+        printf("FAIL stream create\n");
+        test_failed = 1;
+        return -1;
+    }
+    if (pull) {
+        src.data = image;
+        src.len = len;
+        src.pos = 0;
+        bl_ota_stream_run(stream, &test_transport, &src);
+    } else {
+        for (pos = 0; pos < len; pos += n) {
+            n = 1 + rand() % 5000;
+            if (n > len - pos) {
+                n = len - pos;
+            }
+            if (bl_ota_stream_feed(stream, image + pos, n)) {
+                break;
+            }
+        }
+    }
+    ret = bl_ota_stream_finish(stream);
+    if (0 == ret) {
+        ptable_len = 0;
+        if (bl_ota_stream_commit(stream) || ptable_len != len - OTA_HEADER_SIZE) {
+            printf("FAIL commit len %u\n", ptable_len);
+            test_failed = 1;
+        }
+    } else if (0 == bl_ota_stream_commit(stream)) {
+        printf("FAIL commit of a failed image\n");
+        test_failed = 1;
+    }
+    bl_ota_stream_destroy(stream);
+    if (sha_mutex_depth) {
+        printf("FAIL sha mutex depth %d after stream\n", sha_mutex_depth);
+        test_failed = 1;
+    }
+    return ret;
+}
+
+static void reset_mtd(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < TEST_PART_SIZE; i++) {
+        mtd.data[i] = rand();
+    }
+    mtd.erases = 0;
+    mtd.writes = 0;
+    mtd.fail_write = 0;
+    mtd.delay_us = 0;
+}
+
+static void test_images(void)
+{
+    static const uint32_t fixed[] = {1, 63, 64, 4095, 4096, 4097, 8192, TEST_PART_SIZE - 1, TEST_PART_SIZE};
+    const bl_ota_hash_ops_t *hash;
+    uint32_t body_len;
+    unsigned int len, i;
+    int round;
+
+    for (round = 0; round < 60; round++) {
+        if (round < (int)(sizeof(fixed) / sizeof(fixed[0]))) {
+            body_len = fixed[round];
+        } else {
+            body_len = 1 + rand() % TEST_PART_SIZE;
+        }
+        hash = (round & 1) ? &bl_ota_hash_ops_hw : &bl_ota_hash_ops_sw;
+        len = make_image(body_len, 0);
+        reset_mtd();
+        if (run_image(hash, len, round & 2)) {
+            printf("FAIL image %u bytes\n", body_len);
+            test_failed = 1;
+            continue;
+        }
+        if (memcmp(mtd.data, image + OTA_HEADER_SIZE, body_len)) {
+            printf("FAIL flash contents, image %u bytes\n", body_len);
+            test_failed = 1;
+        }
+        /*only the sectors the image lands in are erased, each once*/
+        if (mtd.erases != (body_len + BL_OTA_STREAM_SECTOR_SIZE - 1) / BL_OTA_STREAM_SECTOR_SIZE) {
+            printf("FAIL %u sectors erased for %u bytes\n", mtd.erases, body_len);
+            test_failed = 1;
+        }
+        for (i = body_len; i < TEST_PART_SIZE && (i % BL_OTA_STREAM_SECTOR_SIZE); i++) {
+            if (0xFF != mtd.data[i]) {
+                printf("FAIL sector tail not erased @%u\n", i);
+                test_failed = 1;
+                break;
+            }
+        }
+    }
+    if (0 == sha_mutex_takes) {
+        printf("FAIL hardware hash never took the sha mutex\n");
+        test_failed = 1;
+    }
+}
+
+static void test_errors(void)
+{
+    unsigned int len;
+
+    /*sha mismatch*/
+    len = make_image(10000, 1);
+    reset_mtd();
+    if (0 == run_image(&bl_ota_hash_ops_hw, len, 0)) {
+        printf("FAIL bad sha accepted\n");
+        test_failed = 1;
+    }
+
+    /*body larger than the partition, and an empty body*/
+    len = make_image(TEST_PART_SIZE + 1, 0);
+    reset_mtd();
+    if (0 == run_image(&bl_ota_hash_ops_sw, len, 0) || mtd.erases) {
+        printf("FAIL oversized image accepted\n");
+        test_failed = 1;
+    }
+    len = make_image(0, 0);
+    if (0 == run_image(&bl_ota_hash_ops_sw, len, 1)) {
+        printf("FAIL empty image accepted\n");
+        test_failed = 1;
+    }
+
+    /*stream ends early, in the header and in the body*/
+    len = make_image(20000, 0);
+    reset_mtd();
+    if (0 == run_image(&bl_ota_hash_ops_sw, 100, 1) ||
+            0 == run_image(&bl_ota_hash_ops_sw, len - 1, 1) ||
+            0 == run_image(&bl_ota_hash_ops_hw, len - 1, 0)) {
+        printf("FAIL truncated image accepted\n");
+        test_failed = 1;
+    }
+
+    /*flash program fails half way*/
+    reset_mtd();
+    mtd.fail_write = 3;
+    if (0 == run_image(&bl_ota_hash_ops_hw, len, 1)) {
+        printf("FAIL image accepted after a write error\n");
+        test_failed = 1;
+    }
+
+    /*hash update fails, then hash init fails: nothing to finish*/
+    reset_mtd();
+    hash_fail_update = 1;
+    hash_finishes = 0;
+    if (0 == run_image(&test_hash_ops, len, 0) || 1 != hash_finishes) {
+        printf("FAIL hash update error, %d finishes\n", hash_finishes);
+        test_failed = 1;
+    }
+    hash_fail_update = 0;
+    hash_fail_init = 1;
+    hash_finishes = 0;
+    if (0 == run_image(&test_hash_ops, len, 0) || hash_finishes || mtd.writes) {
+        printf("FAIL hash init error, %d finishes %u writes\n", hash_finishes, mtd.writes);
+        test_failed = 1;
+    }
+    hash_fail_init = 0;
+}
+
+/* slow flash: the receiver should run ahead by a buffer, not per write */
+static void test_pipeline(void)
+{
+    bl_ota_stream_config_t config;
+    bl_ota_stream_stat_t stat;
+    bl_ota_stream_t *stream;
+    unsigned int len;
+
+    len = make_image(64 * 1024, 0);
+    reset_mtd();
+    mtd.delay_us = 20000;
+    memset(&config, 0, sizeof(config));
+    config.flash_arg = &mtd;
+    stream = bl_ota_stream_create(&config);
+    if (NULL == stream || bl_ota_stream_feed(stream, image, len) || bl_ota_stream_finish(stream)) {
+        printf("FAIL slow flash image\n");
+        test_failed = 1;
+    } else {
+        bl_ota_stream_stat(stream, &stat);
+        printf("slow flash: %u ms total, write %u ms, receiver waited %u ms\n",
+                (unsigned)stat.ms_total, (unsigned)stat.ms_write, (unsigned)stat.ms_wait_buf);
+        if (stat.ms_write < 16 * 20 || stat.ms_wait_buf > stat.ms_total) {
+            printf("FAIL slow flash stats\n");
+            test_failed = 1;
+        }
+    }
+    bl_ota_stream_destroy(stream);
+}
+
+int main(void)
+{
+    srand(1);
+    if (bl_sha_backend_set(&bl_sha_backend_sw)) {
+        printf("FAIL sha backend\n");
+        return 1;
+    }
+    test_images();
+    test_errors();
+    test_pipeline();
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
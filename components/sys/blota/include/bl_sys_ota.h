@@ -30,6 +30,100 @@
 #ifndef __BL_SYS_OTA_H__
 #define __BL_SYS_OTA_H__
 #include <stdint.h>
+
+typedef struct ota_header {
+    union {
+        struct {
+            uint8_t header[16];
+
+            uint8_t type[4];//RAW XZ
+            uint32_t len;//body len
+            uint8_t pad0[8];
+
+            uint8_t ver_hardware[16];
+            uint8_t ver_software[16];
+
+            uint8_t sha256[32];
+        } s;
+        uint8_t _pad[512];
+    } u;
+} ota_header_t;
+#define OTA_HEADER_SIZE (sizeof(ota_header_t))
+
+/*
+ * Streaming OTA writer
+ *
+ * Image is received into BL_OTA_STREAM_BUF_NUM buffers in turn. Full buffers
+ * are handed to a writer task, which erases flash sector by sector just
+ * ahead of the write cursor, updates the hash and programs flash, while the
+ * transport is filling the next buffer.
+ *
+ * Pull transports (sockets) use bl_ota_stream_run, push transports (httpc
+ * recv callback, BLE write handler) call bl_ota_stream_feed with each piece
+ * of data they get.
+ */
+#define BL_OTA_STREAM_BUF_SIZE          (4096)
+#define BL_OTA_STREAM_BUF_NUM           (2)
+#define BL_OTA_STREAM_SECTOR_SIZE       (4096)
+
+typedef struct bl_ota_stream bl_ota_stream_t;
+
+/* flash the image is written to, offset is relative to the partition */
+typedef struct bl_ota_flash_ops {
+    int (*erase)(void *arg, unsigned int offset, unsigned int size);
+    int (*program)(void *arg, unsigned int offset, unsigned int size, const uint8_t *data);
+    int (*size)(void *arg, unsigned int *size);
+} bl_ota_flash_ops_t;
+
+/* SHA-256 over the image body */
+typedef struct bl_ota_hash_ops {
+    int (*init)(void *ctx);
+    int (*update)(void *ctx, const uint8_t *data, uint32_t len);
+    int (*finish)(void *ctx, uint8_t hash[32]);
+    unsigned int ctx_size;
+} bl_ota_hash_ops_t;
+
+/* pull transport, fetch returns bytes got, 0 for end of stream, negative for error */
+typedef struct bl_ota_transport {
+    const char *name;
+    int (*fetch)(void *arg, uint8_t *buf, unsigned int len);
+} bl_ota_transport_t;
+
+typedef struct bl_ota_stream_stat {
+    uint32_t body_len;
+    uint32_t received;
+    uint32_t written;
+    uint32_t sectors_erased;
+    uint32_t ms_total;
+    uint32_t ms_erase;
+    uint32_t ms_write;
+    uint32_t ms_hash;
+    uint32_t ms_wait_buf;//receiver stalled waiting for a free buffer
+} bl_ota_stream_stat_t;
+
+typedef struct bl_ota_stream_config {
+    const bl_ota_flash_ops_t *flash;//NULL for bl_mtd backend
+    void *flash_arg;//bl_mtd_handle_t for bl_mtd backend
+    const bl_ota_hash_ops_t *hash;//NULL for SEC_ENG SHA-256
+    int writer_priority;
+    int writer_stack;
+} bl_ota_stream_config_t;
+
+extern const bl_ota_flash_ops_t bl_ota_flash_ops_mtd;
+extern const bl_ota_hash_ops_t bl_ota_hash_ops_hw;
+extern const bl_ota_hash_ops_t bl_ota_hash_ops_sw;
+extern const bl_ota_transport_t bl_ota_transport_socket;
+
+bl_ota_stream_t *bl_ota_stream_create(const bl_ota_stream_config_t *config);
+int bl_ota_stream_feed(bl_ota_stream_t *stream, const uint8_t *data, unsigned int len);
+int bl_ota_stream_run(bl_ota_stream_t *stream, const bl_ota_transport_t *transport, void *arg);
+int bl_ota_stream_finish(bl_ota_stream_t *stream);
+int bl_ota_stream_commit(bl_ota_stream_t *stream);
+void bl_ota_stream_destroy(bl_ota_stream_t *stream);
+int bl_ota_stream_header(bl_ota_stream_t *stream, ota_header_t *header);
+int bl_ota_stream_stat(bl_ota_stream_t *stream, bl_ota_stream_stat_t *stat);
+int bl_ota_stream_done(bl_ota_stream_t *stream);
+
 int bl_sys_ota_cli_init(void);
 
 #endif
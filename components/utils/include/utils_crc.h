@@ -31,7 +31,49 @@
 #define __UTILS_CRC_H__
 #include <stdint.h>
 
+/*
+ * Table driven CRCs, UTILS_CRC_SLICE (1, 4 or 8) bytes per lookup step.  The
+ * tables live in RAM and are built on first use, UTILS_CRC_SLICE * 1KB for
+ * each CRC32 and half that for each CRC16 actually used.
+ *
+ * utils_crc16 is CRC-16/MODBUS (0x8005 reflected, init 0xFFFF).
+ * utils_crc32 is the zlib/Ethernet CRC-32 (0x04C11DB7 reflected).
+ * With UTILS_CRC32C_ENABLE, utils_crc32c is CRC-32C (0x1EDC6F41 reflected).
+ * With UTILS_CRC16_CCITT_ENABLE, utils_crc16_ccitt is CRC-16/XMODEM (0x1021,
+ * init 0x0000); set ctx.crc to 0xFFFF after init for CRC-16/CCITT-FALSE.
+ *
+ * The streaming contexts give the same result as one call over all the data.
+ */
+typedef struct utils_crc16_ctx {
+    uint16_t crc;
+} utils_crc16_ctx_t;
+
+typedef struct utils_crc32_ctx {
+    uint32_t crc;
+} utils_crc32_ctx_t;
+
 uint16_t utils_crc16(void *dataIn, uint32_t len);
+void utils_crc16_init(utils_crc16_ctx_t *ctx);
+void utils_crc16_update(utils_crc16_ctx_t *ctx, const void *dataIn, uint32_t len);
+uint16_t utils_crc16_final(utils_crc16_ctx_t *ctx);
+
 uint32_t utils_crc32(void *dataIn, uint32_t len);
+void utils_crc32_init(utils_crc32_ctx_t *ctx);
+void utils_crc32_update(utils_crc32_ctx_t *ctx, const void *dataIn, uint32_t len);
+uint32_t utils_crc32_final(utils_crc32_ctx_t *ctx);
+
+#ifdef UTILS_CRC16_CCITT_ENABLE
+uint16_t utils_crc16_ccitt(const void *dataIn, uint32_t len);
+void utils_crc16_ccitt_init(utils_crc16_ctx_t *ctx);
+void utils_crc16_ccitt_update(utils_crc16_ctx_t *ctx, const void *dataIn, uint32_t len);
+uint16_t utils_crc16_ccitt_final(utils_crc16_ctx_t *ctx);
+#endif
+
+#ifdef UTILS_CRC32C_ENABLE
+uint32_t utils_crc32c(const void *dataIn, uint32_t len);
+void utils_crc32c_init(utils_crc32_ctx_t *ctx);
+void utils_crc32c_update(utils_crc32_ctx_t *ctx, const void *dataIn, uint32_t len);
+uint32_t utils_crc32c_final(utils_crc32_ctx_t *ctx);
+#endif
 
 #endif
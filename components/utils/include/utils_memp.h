@@ -30,7 +30,13 @@
 #ifndef __UTILS_MEMP_H__
 #define __UTILS_MEMP_H__
 
+#include <stddef.h>
+#include <stdint.h>
 
+/*
+ * Fixed size node pools.  utils_memp_malloc() and utils_memp_free() take a
+ * short critical section, so a pool may be shared by tasks and interrupts.
+ */
 struct utils_memp_node {
     struct utils_memp_node *next;
 };
@@ -44,6 +50,8 @@ typedef struct pool {
     void *first_node;
     void *last_node;
     struct utils_memp_node *mem;
+    uint32_t pool_peak;  /* most nodes ever in use */
+    uint32_t alloc_fail; /* allocations that found the pool empty */
 }utils_memp_pool_t;
 
 int utils_memp_init(utils_memp_pool_t **pool, uint16_t node_size, uint16_t pool_cap, uint8_t align_req);
@@ -51,4 +59,34 @@ int utils_memp_deinit(utils_memp_pool_t *pool);
 void *utils_memp_malloc(utils_memp_pool_t *pool);
 int utils_memp_free(utils_memp_pool_t *pool, void *node);
 
+/*
+ * Slab: a set of pools of increasing node size behind one malloc/free pair,
+ * e.g. for packet buffers or pbuf_alloced_custom() backing memory shared by
+ * several users.  A request takes a node of the smallest class that fits and
+ * spills to larger classes when that one is empty.  With
+ * UTILS_MEMP_SLAB_FALLBACK set, requests no class can serve go to
+ * pvPortMalloc() instead of failing; that path is not taken in interrupts.
+ */
+#define UTILS_MEMP_SLAB_FALLBACK    (1 << 0)
+
+typedef struct utils_memp_class {
+    uint16_t node_size;
+    uint16_t pool_cap;
+} utils_memp_class_t;
+
+typedef struct utils_memp_slab {
+    uint32_t flags;
+    uint32_t fallback_used; /* blocks currently from pvPortMalloc() */
+    uint32_t fallback_peak;
+    uint8_t class_num;
+    utils_memp_pool_t *pools[];
+} utils_memp_slab_t;
+
+/* classes must be given in increasing node_size */
+int utils_memp_slab_init(utils_memp_slab_t **slab, const utils_memp_class_t *classes, uint8_t class_num, uint32_t flags);
+int utils_memp_slab_deinit(utils_memp_slab_t *slab);
+void *utils_memp_slab_malloc(utils_memp_slab_t *slab, size_t size);
+int utils_memp_slab_free(utils_memp_slab_t *slab, void *ptr);
+void utils_memp_slab_dump(utils_memp_slab_t *slab);
+
 #endif
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test and benchmark for utils_crc.  Checks every CRC against published
+ * check values and a bit at a time reference over random buffers, lengths,
+ * alignments and streaming splits, then compares throughput with the old one
+ * byte per lookup loop.  Build and run on Linux for each slice width:
+ *
+ *   gcc -O2 -I../../include -DUTILS_CRC_SLICE=8 test_utils_crc.c -o test_utils_crc
+ *   ./test_utils_crc
+ */
+#define UTILS_CRC32C_ENABLE
+#define UTILS_CRC16_CCITT_ENABLE
+
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../utils_crc.c"
+
+#define TEST_BUF_SIZE   (1024 * 1024)
+
+static int test_failed;
+
+static uint32_t ref_reflected(uint32_t poly, uint32_t crc, const uint8_t *p, uint32_t len)
+{
+    int k;
+
+    while (len--) {
+        crc ^= *p++;
+        for (k = 0; k < 8; k++) {
+            crc = (crc & 1) ? (crc >> 1) ^ poly : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+static uint16_t ref_ccitt(uint16_t crc, const uint8_t *p, uint32_t len)
+{
+    int k;
+
+    while (len--) {
+        crc ^= *p++ << 8;
+        for (k = 0; k < 8; k++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+/* what utils_crc32 did before: one lookup per byte */
+static uint32_t old_crc32(const uint8_t *p, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (len--) {
+        crc = crc32_tab[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+static void expect(const char *what, uint32_t got, uint32_t want)
+{
+    if (got != want) {
+        printf("%s: got 0x%08x want 0x%08x\r\n", what, (unsigned int)got, (unsigned int)want);
+        test_failed = 1;
+    }
+}
+
+static void test_vectors(void)
+{
+    char check[] = "123456789";
+
+    expect("crc16 check", utils_crc16(check, 9), 0x4B37);
+    expect("crc32 check", utils_crc32(check, 9), 0xCBF43926);
+    expect("crc16_ccitt check", utils_crc16_ccitt(check, 9), 0x31C3);
+    expect("crc32c check", utils_crc32c(check, 9), 0xE3069283);
+    expect("crc32 empty", utils_crc32(check, 0), 0);
+}
+
+static void test_random(const uint8_t *buf)
+{
+    utils_crc16_ctx_t c16;
+    utils_crc32_ctx_t c32;
+    uint32_t off, len, split, i;
+    uint32_t want;
+
+    for (i = 0; i < 20000; i++) {
+        off = rand() % 64;
+        len = (i < 1000) ? i % 100 : (uint32_t)rand() % 4096;
+        split = len ? rand() % (len + 1) : 0;
+
+        want = ref_reflected(0xEDB88320, 0xFFFFFFFF, buf + off, len) ^ 0xFFFFFFFF;
+        expect("crc32", utils_crc32((void *)(buf + off), len), want);
+        utils_crc32_init(&c32);
+        utils_crc32_update(&c32, buf + off, split);
+        utils_crc32_update(&c32, buf + off + split, len - split);
+        expect("crc32 stream", utils_crc32_final(&c32), want);
+
+        want = ref_reflected(0x82F63B78, 0xFFFFFFFF, buf + off, len) ^ 0xFFFFFFFF;
+        expect("crc32c", utils_crc32c(buf + off, len), want);
+        utils_crc32c_init(&c32);
+        utils_crc32c_update(&c32, buf + off, split);
+        utils_crc32c_update(&c32, buf + off + split, len - split);
+        expect("crc32c stream", utils_crc32c_final(&c32), want);
+
+        want = ref_reflected(0xA001, 0xFFFF, buf + off, len);
+        expect("crc16", utils_crc16((void *)(buf + off), len), want);
+        utils_crc16_init(&c16);
+        utils_crc16_update(&c16, buf + off, split);
+        utils_crc16_update(&c16, buf + off + split, len - split);
+        expect("crc16 stream", utils_crc16_final(&c16), want);
+
+        want = ref_ccitt(0x0000, buf + off, len);
+        expect("crc16_ccitt", utils_crc16_ccitt(buf + off, len), want);
+        utils_crc16_ccitt_init(&c16);
+        utils_crc16_ccitt_update(&c16, buf + off, split);
+        utils_crc16_ccitt_update(&c16, buf + off + split, len - split);
+        expect("crc16_ccitt stream", utils_crc16_ccitt_final(&c16), want);
+
+        if (test_failed) {
+            printf("at offset %u length %u split %u\r\n", (unsigned int)off, (unsigned int)len, (unsigned int)split);
+            return;
+        }
+    }
+}
+
+static uint64_t test_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static volatile uint32_t test_sink;
+
+#define BENCH(name, expr) do {                                              \
+        uint64_t t = test_cycles();                                         \
+        for (r = 0; r < 16; r++) {                                          \
+            test_sink = (expr);                                             \
+        }                                                                   \
+        t = test_cycles() - t;                                              \
+        printf("%-12s %6.3f bytes/cycle\r\n", name, 16.0 * TEST_BUF_SIZE / t); \
+    } while (0)
+
+static void test_bench(uint8_t *buf)
+{
+    int r;
+
+    printf("UTILS_CRC_SLICE %d, 1MB buffer\r\n", UTILS_CRC_SLICE);
+    BENCH("old crc32", old_crc32(buf, TEST_BUF_SIZE));
+    BENCH("crc32", utils_crc32(buf, TEST_BUF_SIZE));
+    BENCH("crc32c", utils_crc32c(buf, TEST_BUF_SIZE));
+    BENCH("crc16", utils_crc16(buf, TEST_BUF_SIZE));
+    BENCH("crc16_ccitt", utils_crc16_ccitt(buf, TEST_BUF_SIZE));
+}
+
+int main(void)
+{
+    uint8_t *buf = malloc(TEST_BUF_SIZE);
+    int i;
+
+    if (!buf) {
+        return 1;
+    }
+    srand(1);
+    for (i = 0; i < TEST_BUF_SIZE; i++) {
+        buf[i] = rand();
+    }
+
+    test_vectors();
+    test_random(buf);
+    test_bench(buf);
+    printf("%s\r\n", test_failed ? "FAIL" : "PASS");
+    free(buf);
+
+    return test_failed;
+}
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host stress test and benchmark for the utils_memp slab.  Threads allocate,
+ * fill, check and free blocks of random sizes, handing part of them to other
+ * threads to free; some threads play interrupts, never get the heap
+ * fallback and only free their own blocks.  Build and run on Linux:
+ *
+ *   gcc -O2 -pthread -I../../include test_utils_memp.c -o test_utils_memp
+ *   ./test_utils_memp [threads] [seconds]
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef unsigned long UBaseType_t;
+
+static pthread_mutex_t memp_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread int memp_in_isr;
+
+#define UTILS_MEMP_PORT
+#define memp_port_malloc(size)      malloc(size)
+#define memp_port_free(ptr)         free(ptr)
+#define memp_port_in_isr()          memp_in_isr
+#define memp_port_lock()            (pthread_mutex_lock(&memp_mutex), 0UL)
+#define memp_port_unlock(state)     ((void)(state), pthread_mutex_unlock(&memp_mutex))
+
+#include "../utils_memp.c"
+
+#define TEST_HELD           64
+#define TEST_EXCHANGE       256
+#define TEST_MAX_SIZE       1600
+
+static const utils_memp_class_t test_classes[] = {
+    { 32, 256 }, { 128, 128 }, { 512, 64 }, { 1536, 16 },
+};
+
+static utils_memp_slab_t *slab;
+static void *exchange[TEST_EXCHANGE];
+static int test_stop;
+static int test_failed;
+
+struct test_thread {
+    pthread_t tid;
+    int isr;
+    unsigned int seed;
+    unsigned long ops;
+    unsigned long nomem;
+};
+
+/* the first word holds the size, the rest a pattern derived from it */
+static void test_fill(uint8_t *p, size_t size)
+{
+    memcpy(p, &size, sizeof(size));
+    memset(p + sizeof(size), (uint8_t)size, size - sizeof(size));
+}
+
+static void test_check_free(void *ptr)
+{
+    uint8_t *p = ptr;
+    size_t size, i;
+
+    memcpy(&size, p, sizeof(size));
+    for (i = sizeof(size); i < size; i++) {
+        if (p[i] != (uint8_t)size) {
+            printf("corrupted block %p size %u at %u\r\n", ptr, (unsigned int)size, (unsigned int)i);
+            __atomic_store_n(&test_failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    if (utils_memp_slab_free(slab, ptr)) {
+        printf("free %p failed\r\n", ptr);
+        __atomic_store_n(&test_failed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void *test_thread(void *arg)
+{
+    struct test_thread *t = arg;
+    void *held[TEST_HELD] = { NULL };
+    void *ptr;
+    size_t size;
+    int i;
+
+    memp_in_isr = t->isr;
+    while (!__atomic_load_n(&test_stop, __ATOMIC_RELAXED) && !__atomic_load_n(&test_failed, __ATOMIC_RELAXED)) {
+        i = rand_r(&t->seed) % TEST_HELD;
+        if (held[i]) {
+            /* hand every other block to whoever picks the slot up next, an
+             * interrupt could be given a heap block it is not allowed to free */
+            if (!t->isr && (rand_r(&t->seed) & 1)) {
+                ptr = __atomic_exchange_n(&exchange[rand_r(&t->seed) % TEST_EXCHANGE], held[i], __ATOMIC_ACQ_REL);
+            } else {
+                ptr = held[i];
+            }
+            held[i] = NULL;
+            if (ptr) {
+                test_check_free(ptr);
+            }
+        } else {
+            size = sizeof(size_t) + rand_r(&t->seed) % (TEST_MAX_SIZE - sizeof(size_t));
+            held[i] = utils_memp_slab_malloc(slab, size);
+            if (held[i]) {
+                test_fill(held[i], size);
+            } else {
+                t->nomem++;
+            }
+        }
+        t->ops++;
+    }
+
+    for (i = 0; i < TEST_HELD; i++) {
+        if (held[i]) {
+            test_check_free(held[i]);
+        }
+    }
+
+    return NULL;
+}
+
+static double test_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void test_bench(void)
+{
+    static void *ptrs[32];
+    const int rounds = 200000;
+    double t;
+    int r, i;
+
+    t = test_now();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < 32; i++) {
+            ptrs[i] = utils_memp_slab_malloc(slab, 24 + (i * 37) % 480);
+        }
+        for (i = 0; i < 32; i++) {
+            utils_memp_slab_free(slab, ptrs[i]);
+        }
+    }
+    printf("slab   : %.1f ns per malloc/free pair\r\n", (test_now() - t) * 1e9 / (rounds * 32));
+
+    t = test_now();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < 32; i++) {
+            ptrs[i] = malloc(24 + (i * 37) % 480);
+        }
+        for (i = 0; i < 32; i++) {
+            free(ptrs[i]);
+        }
+    }
+    printf("malloc : %.1f ns per malloc/free pair\r\n", (test_now() - t) * 1e9 / (rounds * 32));
+}
+
+int main(int argc, char *argv[])
+{
+    struct test_thread threads[16];
+    int num = argc > 1 ? atoi(argv[1]) : 8;
+    int seconds = argc > 2 ? atoi(argv[2]) : 3;
+    unsigned long ops = 0, nomem = 0;
+    int i;
+
+    if (num < 1 || num > 16) {
+        num = 8;
+    }
+    if (utils_memp_slab_init(&slab, test_classes, sizeof(test_classes) / sizeof(test_classes[0]), UTILS_MEMP_SLAB_FALLBACK)) {
+        printf("slab init failed\r\n");
+        return 1;
+    }
+
+    test_bench();
+
+    for (i = 0; i < num; i++) {
+        threads[i].isr = (i % 4 == 3);
+        threads[i].seed = i + 1;
+        threads[i].ops = 0;
+        threads[i].nomem = 0;
+        pthread_create(&threads[i].tid, NULL, test_thread, &threads[i]);
+    }
+    sleep(seconds);
+    __atomic_store_n(&test_stop, 1, __ATOMIC_RELAXED);
+    for (i = 0; i < num; i++) {
+        pthread_join(threads[i].tid, NULL);
+        ops += threads[i].ops;
+        nomem += threads[i].nomem;
+    }
+    for (i = 0; i < TEST_EXCHANGE; i++) {
+        if (exchange[i]) {
+            test_check_free(exchange[i]);
+        }
+    }
+
+    utils_memp_slab_dump(slab);
+    for (i = 0; i < slab->class_num; i++) {
+        if (slab->pools[i]->pool_size) {
+            printf("class %d leaked %u nodes\r\n", i, (unsigned int)slab->pools[i]->pool_size);
+            test_failed = 1;
+        }
+    }
+    if (slab->fallback_used) {
+        printf("heap fallback leaked %u blocks\r\n", (unsigned int)slab->fallback_used);
+        test_failed = 1;
+    }
+    printf("%d threads, %lu ops, %lu out of memory (interrupt threads only): %s\r\n",
+            num, ops, nomem, test_failed ? "FAIL" : "PASS");
+    utils_memp_slab_deinit(slab);
+
+    return test_failed;
+}
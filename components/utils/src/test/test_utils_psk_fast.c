@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2020 Bouffalolab.
+ *
+ * This file is part of
+ *     *** Bouffalolab Software Dev Kit ***
+ *      (see www.bouffalolab.com).
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright notice,
+ *      this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *   3. Neither the name of Bouffalo Lab nor the names of its contributors
+ *      may be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host test and benchmark for the bl_sha/bl_hmac front end, the software SHA
+ * backend and the PSK/HMAC-SHA1 helpers built on them.  SEC_ENG is replaced
+ * by the software backend.  Checks FIPS 180 SHA, RFC 2202/4231 HMAC, RFC 6070
+ * PBKDF2 and the 802.11 PSK vectors, random streaming splits, unaligned input
+ * and interleaved contexts, then times PBKDF2 with the keyed states against
+ * setting the key up on every iteration.  Build and run on Linux:
+ *
+ *   gcc -O2 -D__riscv_xlen=32 -I../../include -I../../../hal_drv/bl602_hal \
+ *       -I../../../freertos/include -I../../../freertos/portable/GCC/RISC-V \
+ *       -I../../../bl602/bl602/config test_utils_psk_fast.c -o test_utils_psk_fast
+ *   ./test_utils_psk_fast
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../../../hal_drv/bl602_hal/bl_sec_hash.c"
+#include "../../../hal_drv/bl602_hal/bl_sec_sha_sw.c"
+#include "../utils_hex.c"
+#include "../utils_hmac_sha1_fast.c"
+#include "../utils_psk_fast.c"
+
+static int sha_mutex_depth;
+
+int bl_sha_mutex_take()
+{
+    sha_mutex_depth++;
+    return 0;
+}
+
+int bl_sha_mutex_give()
+{
+    sha_mutex_depth--;
+    return 0;
+}
+
+/* SEC_ENG stand in, counts blocks so the PBKDF2 saving shows up */
+static uint64_t hw_blocks;
+
+static int _hw_process(bl_sha_ctx_t *ctx, const uint8_t *input, uint32_t nblk)
+{
+    hw_blocks += nblk;
+    return bl_sha_backend_sw.process(ctx, input, nblk);
+}
+
+const bl_sha_backend_t bl_sha_backend_hw = {
+    .name = "sec_eng (host: software)",
+    .process = _hw_process,
+};
+
+static int test_failed;
+
+static void hex2bin(const char *hex, uint8_t *bin, int *len)
+{
+    int n = 0;
+
+    while (hex[0] && hex[1]) {
+        sscanf(hex, "%2hhx", &bin[n++]);
+        hex += 2;
+    }
+    *len = n;
+}
+
+static void check(const char *name, const uint8_t *out, const char *expect_hex)
+{
+    uint8_t expect[64];
+    int len;
+
+    hex2bin(expect_hex, expect, &len);
+    if (memcmp(out, expect, len)) {
+        printf("FAIL %s\n", name);
+        test_failed = 1;
+    }
+}
+
+static void test_sha_vectors(void)
+{
+    static const char *msg_448 = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    static const struct {
+        bl_sha_type_t type;
+        const char *msg;
+        const char *digest;
+    } vec[] = {
+        {BL_SHA1, "", "da39a3ee5e6b4b0d3255bfef95601890afd80709"},
+        {BL_SHA1, "abc", "a9993e364706816aba3e25717850c26c9cd0d89d"},
+        {BL_SHA1, NULL, "84983e441c3bd26ebaae4aa1f95129e5e54670f1"},
+        {BL_SHA224, "abc", "23097d223405d8228642a477bda255b32aadbce4bda0b3f7e36c9da7"},
+        {BL_SHA224, NULL, "75388b16512776cc5dba5da1fd890150b0c6455cb4f58b1952522525"},
+        {BL_SHA256, "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+        {BL_SHA256, "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+        {BL_SHA256, NULL, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+    };
+    static const char *million_a[] = {
+        [BL_SHA256] = "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+        [BL_SHA224] = "20794655980c91d8bbb4c1ea97618a4bf03f42581948b2ee4ee7ad67",
+        [BL_SHA1] = "34aa973cd4c4daa4f61eeb2bdbad27316534016f",
+    };
+    uint8_t hash[32], a[1000];
+    bl_sha_ctx_t ctx;
+    unsigned int i, j;
+
+    for (i = 0; i < sizeof(vec) / sizeof(vec[0]); i++) {
+        const char *msg = vec[i].msg ? vec[i].msg : msg_448;
+
+        bl_sha(vec[i].type, (const uint8_t*)msg, strlen(msg), hash);
+        check("sha vector", hash, vec[i].digest);
+    }
+
+    memset(a, 'a', sizeof(a));
+    for (i = BL_SHA256; i <= BL_SHA1; i++) {
+        bl_sha_init(&ctx, i);
+        for (j = 0; j < 1000; j++) {
+            bl_sha_update(&ctx, a, sizeof(a));
+        }
+        bl_sha_finish(&ctx, hash);
+        check("sha million a", hash, million_a[i]);
+    }
+}
+
+static void test_hmac_vectors(void)
+{
+    static const char *what_do = "what do ya want for nothing?";
+    static const char *large_key = "Test Using Larger Than Block-Size Key - Hash Key First";
+    uint8_t key[131], data[50], mac[32];
+    int i;
+
+    /* RFC 2202 */
+    memset(key, 0x0b, 20);
+    bl_hmac(BL_SHA1, key, 20, (const uint8_t*)"Hi There", 8, mac);
+    check("hmac-sha1 1", mac, "b617318655057264e28bc0b6fb378c8ef146be00");
+    bl_hmac(BL_SHA1, (const uint8_t*)"Jefe", 4, (const uint8_t*)what_do, strlen(what_do), mac);
+    check("hmac-sha1 2", mac, "effcdf6ae5eb2fa2d27416d5f184df9c259a7c79");
+    memset(key, 0xaa, 80);
+    bl_hmac(BL_SHA1, key, 80, (const uint8_t*)large_key, strlen(large_key), mac);
+    check("hmac-sha1 6", mac, "aa4ae5e15272d00e95705637ce8a3b55ed402112");
+
+    /* RFC 4231 */
+    memset(key, 0x0b, 20);
+    bl_hmac(BL_SHA256, key, 20, (const uint8_t*)"Hi There", 8, mac);
+    check("hmac-sha256 1", mac, "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7");
+    bl_hmac(BL_SHA224, key, 20, (const uint8_t*)"Hi There", 8, mac);
+    check("hmac-sha224 1", mac, "896fb1128abbdf196832107cd49df33f47b4b1169912ba4f53684b22");
+    bl_hmac(BL_SHA256, (const uint8_t*)"Jefe", 4, (const uint8_t*)what_do, strlen(what_do), mac);
+    check("hmac-sha256 2", mac, "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+    for (i = 0; i < 20; i++) {
+        key[i] = 0xaa;
+    }
+    memset(data, 0xdd, sizeof(data));
+    bl_hmac(BL_SHA256, key, 20, data, sizeof(data), mac);
+    check("hmac-sha256 3", mac, "773ea91e36800e46854db8ebd09181a72959098b3ef8c122d9635514ced565fe");
+    memset(key, 0xaa, 131);
+    bl_hmac(BL_SHA256, key, 131, (const uint8_t*)large_key, strlen(large_key), mac);
+    check("hmac-sha256 6", mac, "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54");
+
+    /* utils wrapper, text split over buffers, long key must stay untouched */
+    {
+        unsigned char *text[2] = {(unsigned char*)"Test Using Larger Than Block-Size Key", (unsigned char*)" - Hash Key First"};
+        int text_len[2] = {37, 17};
+
+        memset(key, 0xaa, 80);
+        utils_hmac_sha1_fast(text, text_len, 2, key, 80, mac, 20);
+        check("utils_hmac_sha1_fast", mac, "aa4ae5e15272d00e95705637ce8a3b55ed402112");
+        for (i = 0; i < 80; i++) {
+            if (key[i] != 0xaa) {
+                printf("FAIL utils_hmac_sha1_fast changed the key\n");
+                test_failed = 1;
+                break;
+            }
+        }
+    }
+}
+
+/* PBKDF2-HMAC-SHA1, one block */
+static void pbkdf2_sha1(const char *pw, const char *salt, int iterations, uint8_t out[20])
+{
+    bl_hmac_ctx_t hmac;
+    uint8_t s[64], u[20];
+    int n = strlen(salt), i, j;
+
+    memcpy(s, salt, n);
+    s[n] = 0;
+    s[n + 1] = 0;
+    s[n + 2] = 0;
+    s[n + 3] = 1;
+    bl_hmac_init(&hmac, BL_SHA1, (const uint8_t*)pw, strlen(pw));
+    bl_hmac_update(&hmac, s, n + 4);
+    bl_hmac_finish(&hmac, u);
+    memcpy(out, u, 20);
+    for (i = 1; i < iterations; i++) {
+        bl_hmac_update(&hmac, u, 20);
+        bl_hmac_finish(&hmac, u);
+        for (j = 0; j < 20; j++) {
+            out[j] ^= u[j];
+        }
+    }
+    bl_hmac_free(&hmac);
+}
+
+/* same, with the key set up again for every iteration as before */
+static void pbkdf2_sha1_rekey(const char *pw, const char *salt, int iterations, uint8_t out[20])
+{
+    uint8_t s[64], u[20];
+    int n = strlen(salt), i, j;
+
+    memcpy(s, salt, n);
+    s[n] = 0;
+    s[n + 1] = 0;
+    s[n + 2] = 0;
+    s[n + 3] = 1;
+    bl_hmac(BL_SHA1, (const uint8_t*)pw, strlen(pw), s, n + 4, u);
+    memcpy(out, u, 20);
+    for (i = 1; i < iterations; i++) {
+        bl_hmac(BL_SHA1, (const uint8_t*)pw, strlen(pw), u, 20, u);
+        for (j = 0; j < 20; j++) {
+            out[j] ^= u[j];
+        }
+    }
+}
+
+static void test_pbkdf2_psk(void)
+{
+    uint8_t out[32];
+    char hex[65];
+
+    /* RFC 6070 */
+    pbkdf2_sha1("password", "salt", 1, out);
+    check("pbkdf2 1", out, "0c60c80f961f0e71f3a9b524af6012062fe037a6");
+    pbkdf2_sha1("password", "salt", 2, out);
+    check("pbkdf2 2", out, "ea6c014dc72d6f8ccd1ed92ace1d41f0d8de8957");
+    pbkdf2_sha1("password", "salt", 4096, out);
+    check("pbkdf2 4096", out, "4b007901b765489abead49d926f721d065a429c1");
+
+    /* IEEE 802.11i H.4 */
+    utils_wifi_psk_cal_fast_bin("password", (unsigned char*)"IEEE", 4, out);
+    check("psk IEEE", out, "f42c6fc52df0ebef9ebb4b90b38a5f902e83fe1b135a70e23aed762e9710a12e");
+    utils_wifi_psk_cal_fast("ThisIsAPassword", "ThisIsASSID", 11, hex);
+    hex2bin(hex, out, &(int){0});
+    check("psk hex", out, "0dc0d6eb90555ed6419756b9a15ec3e3209b63df707dd508d14581f8982721af");
+    if (sha_mutex_depth) {
+        printf("FAIL psk left the mutex taken\n");
+        test_failed = 1;
+    }
+}
+
+static void test_streaming(void)
+{
+    static uint8_t buf[4096 + 8];
+    uint8_t ref[32], hash[32];
+    bl_sha_ctx_t ctx[3], saved;
+    int round, t;
+    uint32_t len, off, n, align;
+
+    for (len = 0; len < sizeof(buf); len++) {
+        buf[len] = rand();
+    }
+
+    for (round = 0; round < 2000; round++) {
+        t = round % 3;
+        len = rand() % 4096;
+        align = rand() % 8;
+        bl_sha(t, buf, len, ref);
+
+        /* unaligned source, random splits */
+        memmove(buf + align, buf, len);
+        bl_sha_init(&ctx[t], t);
+        for (off = 0; off < len; off += n) {
+            n = rand() % 200;
+            if (n > len - off) {
+                n = len - off;
+            }
+            bl_sha_update(&ctx[t], buf + align + off, n);
+        }
+        bl_sha_finish(&ctx[t], hash);
+        memmove(buf, buf + align, len);
+        if (memcmp(hash, ref, bl_sha_digest_size(t))) {
+            printf("FAIL streaming type %d len %u align %u\n", t, (unsigned)len, (unsigned)align);
+            test_failed = 1;
+            return;
+        }
+    }
+
+    /* three open contexts and a saved copy, updated turn about */
+    for (t = 0; t < 3; t++) {
+        bl_sha_init(&ctx[t], t);
+    }
+    for (off = 0; off < 4096; off += 100) {
+        n = off + 100 > 4096 ? 4096 - off : 100;
+        for (t = 0; t < 3; t++) {
+            bl_sha_update(&ctx[t], buf + off, n);
+        }
+        if (off == 2000) {
+            bl_sha_clone(&saved, &ctx[0]);
+        }
+    }
+    for (t = 0; t < 3; t++) {
+        bl_sha_finish(&ctx[t], hash);
+        bl_sha(t, buf, 4096, ref);
+        if (memcmp(hash, ref, bl_sha_digest_size(t))) {
+            printf("FAIL interleaved type %d\n", t);
+            test_failed = 1;
+        }
+    }
+    bl_sha_update(&saved, buf + 2100, 4096 - 2100);
+    bl_sha_finish(&saved, hash);
+    bl_sha(BL_SHA256, buf, 4096, ref);
+    if (memcmp(hash, ref, 32)) {
+        printf("FAIL restored context\n");
+        test_failed = 1;
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(void)
+{
+    static uint8_t buf[1024 * 1024];
+    uint8_t out[32];
+    uint64_t blocks;
+    double t;
+    int i;
+
+    t = now();
+    for (i = 0; i < 32; i++) {
+        bl_sha(BL_SHA256, buf, sizeof(buf), out);
+    }
+    t = now() - t;
+    printf("sha256 software:       %8.1f MB/s\n", 32 / t);
+
+    blocks = hw_blocks;
+    t = now();
+    for (i = 0; i < 8; i++) {
+        utils_wifi_psk_cal_fast_bin("ThisIsAPassword", (unsigned char*)"ThisIsASSID", 11, out);
+    }
+    t = now() - t;
+    printf("psk, keyed states:     %8.2f ms, %llu blocks\n", t * 1000 / 8, (unsigned long long)(hw_blocks - blocks) / 8);
+
+    blocks = hw_blocks;
+    t = now();
+    for (i = 0; i < 8; i++) {
+        pbkdf2_sha1_rekey("ThisIsAPassword", "ThisIsASSID", 4096, out);
+        pbkdf2_sha1_rekey("ThisIsAPassword", "ThisIsASSID", 4096, out);
+    }
+    t = now() - t;
+    printf("psk, key per iteration:%8.2f ms, %llu blocks\n", t * 1000 / 8, (unsigned long long)(hw_blocks - blocks) / 8);
+}
+
+int main(void)
+{
+    srand(1);
+    printf("backend %s\n", bl_sha_backend_get()->name);
+
+    test_sha_vectors();
+    test_hmac_vectors();
+    test_pbkdf2_psk();
+    test_streaming();
+    bench();
+
+    printf("%s\n", test_failed ? "FAILED" : "PASSED");
+    return test_failed;
+}
@@ -36,135 +36,334 @@
 // ---------------- POPULAR POLYNOMIALS ----------------
 // CCITT:      x^16 + x^12 + x^5 + x^0                 (0x1021,init 0x0000)
 // CRC-16:     x^16 + x^15 + x^2 + x^0                 (0x8005,init 0xFFFF)
-// we use 0x8005 here and
-
-static const uint8_t chCRCHTalbe[] =
-{
-0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
-0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
-0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
-0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
-0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
-0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
-0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
-0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
-0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
-0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
-0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
-0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
-0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
-0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
-0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
-0x00, 0xC1, 0x81, 0x40
-};
-
-static const uint8_t chCRCLTalbe[] =
-{
-0x00, 0xC0, 0xC1, 0x01, 0xC3, 0x03, 0x02, 0xC2, 0xC6, 0x06, 0x07, 0xC7,
-0x05, 0xC5, 0xC4, 0x04, 0xCC, 0x0C, 0x0D, 0xCD, 0x0F, 0xCF, 0xCE, 0x0E,
-0x0A, 0xCA, 0xCB, 0x0B, 0xC9, 0x09, 0x08, 0xC8, 0xD8, 0x18, 0x19, 0xD9,
-0x1B, 0xDB, 0xDA, 0x1A, 0x1E, 0xDE, 0xDF, 0x1F, 0xDD, 0x1D, 0x1C, 0xDC,
-0x14, 0xD4, 0xD5, 0x15, 0xD7, 0x17, 0x16, 0xD6, 0xD2, 0x12, 0x13, 0xD3,
-0x11, 0xD1, 0xD0, 0x10, 0xF0, 0x30, 0x31, 0xF1, 0x33, 0xF3, 0xF2, 0x32,
-0x36, 0xF6, 0xF7, 0x37, 0xF5, 0x35, 0x34, 0xF4, 0x3C, 0xFC, 0xFD, 0x3D,
-0xFF, 0x3F, 0x3E, 0xFE, 0xFA, 0x3A, 0x3B, 0xFB, 0x39, 0xF9, 0xF8, 0x38,
-0x28, 0xE8, 0xE9, 0x29, 0xEB, 0x2B, 0x2A, 0xEA, 0xEE, 0x2E, 0x2F, 0xEF,
-0x2D, 0xED, 0xEC, 0x2C, 0xE4, 0x24, 0x25, 0xE5, 0x27, 0xE7, 0xE6, 0x26,
-0x22, 0xE2, 0xE3, 0x23, 0xE1, 0x21, 0x20, 0xE0, 0xA0, 0x60, 0x61, 0xA1,
-0x63, 0xA3, 0xA2, 0x62, 0x66, 0xA6, 0xA7, 0x67, 0xA5, 0x65, 0x64, 0xA4,
-0x6C, 0xAC, 0xAD, 0x6D, 0xAF, 0x6F, 0x6E, 0xAE, 0xAA, 0x6A, 0x6B, 0xAB,
-0x69, 0xA9, 0xA8, 0x68, 0x78, 0xB8, 0xB9, 0x79, 0xBB, 0x7B, 0x7A, 0xBA,
-0xBE, 0x7E, 0x7F, 0xBF, 0x7D, 0xBD, 0xBC, 0x7C, 0xB4, 0x74, 0x75, 0xB5,
-0x77, 0xB7, 0xB6, 0x76, 0x72, 0xB2, 0xB3, 0x73, 0xB1, 0x71, 0x70, 0xB0,
-0x50, 0x90, 0x91, 0x51, 0x93, 0x53, 0x52, 0x92, 0x96, 0x56, 0x57, 0x97,
-0x55, 0x95, 0x94, 0x54, 0x9C, 0x5C, 0x5D, 0x9D, 0x5F, 0x9F, 0x9E, 0x5E,
-0x5A, 0x9A, 0x9B, 0x5B, 0x99, 0x59, 0x58, 0x98, 0x88, 0x48, 0x49, 0x89,
-0x4B, 0x8B, 0x8A, 0x4A, 0x4E, 0x8E, 0x8F, 0x4F, 0x8D, 0x4D, 0x4C, 0x8C,
-0x44, 0x84, 0x85, 0x45, 0x87, 0x47, 0x46, 0x86, 0x82, 0x42, 0x43, 0x83,
-0x41, 0x81, 0x80, 0x40
-};
-
-uint16_t utils_crc16(void * dataIn, uint32_t len)
-{
-    uint8_t chCRCHi = 0xFF;
-    uint8_t chCRCLo = 0xFF;
-    uint16_t wIndex;
-  uint8_t* data=(uint8_t *) dataIn;
-
-    while (len--)
-    {
-        wIndex = chCRCLo ^ *data++ ;
-        chCRCLo = chCRCHi ^ chCRCHTalbe[wIndex];
-        chCRCHi = chCRCLTalbe[wIndex] ;
-    }
-
-    return ((chCRCHi << 8) | chCRCLo) ;
+// CRC-32:     x^32+x^26+x^23+x^22+x^16+x^12+x^11+x^10+x^8+x^7+x^5+x^4+x^2+x+1
+// CRC-32C:    0x1EDC6F41, better error detection than CRC-32 for the same cost
+// we use 0x8005 and CRC-32 by default, the others are compiled in on request
+
+#ifndef UTILS_CRC_SLICE
+#define UTILS_CRC_SLICE 4
+#endif
+
+#if (UTILS_CRC_SLICE != 1) && (UTILS_CRC_SLICE != 4) && (UTILS_CRC_SLICE != 8)
+#error "UTILS_CRC_SLICE must be 1, 4 or 8"
+#endif
+
+#if (UTILS_CRC_SLICE > 1) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#error "word at a time CRC expects a little endian core"
+#endif
+
+/*
+ * Slice k of a table holds the CRC of byte n followed by k zero bytes, so
+ * UTILS_CRC_SLICE bytes fold into the CRC with one lookup each and no
+ * dependency between the lookups.
+ */
+static void crc_build_reflected32(uint32_t (*t)[256], uint32_t poly)
+{
+    uint32_t c;
+    int n, k;
+
+    for (n = 0; n < 256; n++) {
+        c = n;
+        for (k = 0; k < 8; k++) {
+            c = (c >> 1) ^ (poly & (0 - (c & 1)));
+        }
+        t[0][n] = c;
+    }
+    for (k = 1; k < UTILS_CRC_SLICE; k++) {
+        for (n = 0; n < 256; n++) {
+            t[k][n] = (t[k - 1][n] >> 8) ^ t[0][t[k - 1][n] & 0xFF];
+        }
+    }
+}
+
+static void crc_build_reflected16(uint16_t (*t)[256], uint16_t poly)
+{
+    uint16_t c;
+    int n, k;
+
+    for (n = 0; n < 256; n++) {
+        c = n;
+        for (k = 0; k < 8; k++) {
+            c = (c >> 1) ^ (poly & (0 - (c & 1)));
+        }
+        t[0][n] = c;
+    }
+    for (k = 1; k < UTILS_CRC_SLICE; k++) {
+        for (n = 0; n < 256; n++) {
+            t[k][n] = (t[k - 1][n] >> 8) ^ t[0][t[k - 1][n] & 0xFF];
+        }
+    }
+}
+
+/* callers align p first, so this stays a single load on cores that trap on
+ * misaligned access */
+static inline uint32_t crc_load32(const uint8_t *p)
+{
+    uint32_t w;
+
+    memcpy(&w, __builtin_assume_aligned(p, 4), sizeof(w));
+    return w;
+}
+
+static uint32_t crc_update_reflected32(uint32_t (*t)[256], uint32_t crc, const uint8_t *p, uint32_t len)
+{
+#if UTILS_CRC_SLICE > 1
+    uint32_t w;
+
+    while (len && ((uintptr_t)p & 3)) {
+        crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+    while (len >= UTILS_CRC_SLICE) {
+        w = crc_load32(p) ^ crc;
+#if UTILS_CRC_SLICE == 8
+        crc = t[7][w & 0xFF] ^ t[6][(w >> 8) & 0xFF] ^ t[5][(w >> 16) & 0xFF] ^ t[4][w >> 24];
+        w = crc_load32(p + 4);
+        crc ^= t[3][w & 0xFF] ^ t[2][(w >> 8) & 0xFF] ^ t[1][(w >> 16) & 0xFF] ^ t[0][w >> 24];
+#else
+        crc = t[3][w & 0xFF] ^ t[2][(w >> 8) & 0xFF] ^ t[1][(w >> 16) & 0xFF] ^ t[0][w >> 24];
+#endif
+        p += UTILS_CRC_SLICE;
+        len -= UTILS_CRC_SLICE;
+    }
+#endif
+    while (len--) {
+        crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+static uint16_t crc_update_reflected16(uint16_t (*t)[256], uint16_t crc, const uint8_t *p, uint32_t len)
+{
+#if UTILS_CRC_SLICE > 1
+    uint32_t w;
+
+    while (len && ((uintptr_t)p & 3)) {
+        crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+    while (len >= UTILS_CRC_SLICE) {
+        w = crc_load32(p) ^ crc;
+#if UTILS_CRC_SLICE == 8
+        crc = t[7][w & 0xFF] ^ t[6][(w >> 8) & 0xFF] ^ t[5][(w >> 16) & 0xFF] ^ t[4][w >> 24];
+        w = crc_load32(p + 4);
+        crc ^= t[3][w & 0xFF] ^ t[2][(w >> 8) & 0xFF] ^ t[1][(w >> 16) & 0xFF] ^ t[0][w >> 24];
+#else
+        crc = t[3][w & 0xFF] ^ t[2][(w >> 8) & 0xFF] ^ t[1][(w >> 16) & 0xFF] ^ t[0][w >> 24];
+#endif
+        p += UTILS_CRC_SLICE;
+        len -= UTILS_CRC_SLICE;
+    }
+#endif
+    while (len--) {
+        crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
 }
 
 /*
-x^32+x^26+x^23+x^22+x^16+x^12+x^11+x^10+x^8+x^7+x^5+x^4+x^2+x+1
-*/
-static const uint32_t crc32Tab[256] = {
-    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
-    0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
-    0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
-    0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
-    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
-    0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
-    0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
-    0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
-    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
-    0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
-    0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
-    0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
-    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
-    0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
-    0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
-    0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
-    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
-    0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
-    0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
-    0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
-    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
-    0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
-    0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
-    0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
-    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
-    0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
-    0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
-    0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
-    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
-    0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
-    0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
-    0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
-    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
-    0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
-    0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
-    0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
-    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
-    0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
-    0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
-    0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
-    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
-    0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
-    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
-};
+ * Tables are built the first time they are needed.  Two tasks racing here
+ * write the same values, and the flag is only set once the table is complete.
+ */
+static uint16_t crc16_tab[UTILS_CRC_SLICE][256];
+static uint8_t crc16_ready;
+
+static uint16_t (*crc16_table(void))[256]
+{
+    if (!crc16_ready) {
+        crc_build_reflected16(crc16_tab, 0xA001);
+        __asm__ volatile ("" ::: "memory");
+        crc16_ready = 1;
+    }
+    return crc16_tab;
+}
+
+void utils_crc16_init(utils_crc16_ctx_t *ctx)
+{
+    ctx->crc = 0xFFFF;
+}
+
+void utils_crc16_update(utils_crc16_ctx_t *ctx, const void *dataIn, uint32_t len)
+{
+    ctx->crc = crc_update_reflected16(crc16_table(), ctx->crc, dataIn, len);
+}
+
+uint16_t utils_crc16_final(utils_crc16_ctx_t *ctx)
+{
+    return ctx->crc;
+}
+
+uint16_t utils_crc16(void *dataIn, uint32_t len)
+{
+    utils_crc16_ctx_t ctx;
+
+    utils_crc16_init(&ctx);
+    utils_crc16_update(&ctx, dataIn, len);
+    return utils_crc16_final(&ctx);
+}
+
+static uint32_t crc32_tab[UTILS_CRC_SLICE][256];
+static uint8_t crc32_ready;
+
+static uint32_t (*crc32_table(void))[256]
+{
+    if (!crc32_ready) {
+        crc_build_reflected32(crc32_tab, 0xEDB88320);
+        __asm__ volatile ("" ::: "memory");
+        crc32_ready = 1;
+    }
+    return crc32_tab;
+}
+
+void utils_crc32_init(utils_crc32_ctx_t *ctx)
+{
+    ctx->crc = 0xFFFFFFFF;
+}
+
+void utils_crc32_update(utils_crc32_ctx_t *ctx, const void *dataIn, uint32_t len)
+{
+    ctx->crc = crc_update_reflected32(crc32_table(), ctx->crc, dataIn, len);
+}
+
+uint32_t utils_crc32_final(utils_crc32_ctx_t *ctx)
+{
+    return ctx->crc ^ 0xFFFFFFFF;
+}
 
 uint32_t utils_crc32(void *dataIn, uint32_t len)
 {
-    uint32_t crc=0;
-  uint8_t *data=(uint8_t *)dataIn;
+    utils_crc32_ctx_t ctx;
+
+    utils_crc32_init(&ctx);
+    utils_crc32_update(&ctx, dataIn, len);
+    return utils_crc32_final(&ctx);
+}
+
+#ifdef UTILS_CRC16_CCITT_ENABLE
+/* CCITT is not reflected, bytes enter at the top of the register */
+static void crc_build_normal16(uint16_t (*t)[256], uint16_t poly)
+{
+    uint16_t c;
+    int n, k;
+
+    for (n = 0; n < 256; n++) {
+        c = n << 8;
+        for (k = 0; k < 8; k++) {
+            c = (c << 1) ^ (poly & (0 - (c >> 15)));
+        }
+        t[0][n] = c;
+    }
+    for (k = 1; k < UTILS_CRC_SLICE; k++) {
+        for (n = 0; n < 256; n++) {
+            t[k][n] = (t[k - 1][n] << 8) ^ t[0][t[k - 1][n] >> 8];
+        }
+    }
+}
+
+static uint16_t crc_update_normal16(uint16_t (*t)[256], uint16_t crc, const uint8_t *p, uint32_t len)
+{
+#if UTILS_CRC_SLICE > 1
+    uint32_t w;
+
+    while (len && ((uintptr_t)p & 3)) {
+        crc = (crc << 8) ^ t[0][(crc >> 8) ^ *p++];
+        len--;
+    }
+    while (len >= UTILS_CRC_SLICE) {
+        w = __builtin_bswap32(crc_load32(p)) ^ ((uint32_t)crc << 16);
+#if UTILS_CRC_SLICE == 8
+        crc = t[7][w >> 24] ^ t[6][(w >> 16) & 0xFF] ^ t[5][(w >> 8) & 0xFF] ^ t[4][w & 0xFF];
+        w = __builtin_bswap32(crc_load32(p + 4));
+        crc ^= t[3][w >> 24] ^ t[2][(w >> 16) & 0xFF] ^ t[1][(w >> 8) & 0xFF] ^ t[0][w & 0xFF];
+#else
+        crc = t[3][w >> 24] ^ t[2][(w >> 16) & 0xFF] ^ t[1][(w >> 8) & 0xFF] ^ t[0][w & 0xFF];
+#endif
+        p += UTILS_CRC_SLICE;
+        len -= UTILS_CRC_SLICE;
+    }
+#endif
+    while (len--) {
+        crc = (crc << 8) ^ t[0][(crc >> 8) ^ *p++];
+    }
+
+    return crc;
+}
+
+static uint16_t crc16_ccitt_tab[UTILS_CRC_SLICE][256];
+static uint8_t crc16_ccitt_ready;
+
+static uint16_t (*crc16_ccitt_table(void))[256]
+{
+    if (!crc16_ccitt_ready) {
+        crc_build_normal16(crc16_ccitt_tab, 0x1021);
+        __asm__ volatile ("" ::: "memory");
+        crc16_ccitt_ready = 1;
+    }
+    return crc16_ccitt_tab;
+}
+
+void utils_crc16_ccitt_init(utils_crc16_ctx_t *ctx)
+{
+    ctx->crc = 0x0000;
+}
+
+void utils_crc16_ccitt_update(utils_crc16_ctx_t *ctx, const void *dataIn, uint32_t len)
+{
+    ctx->crc = crc_update_normal16(crc16_ccitt_table(), ctx->crc, dataIn, len);
+}
+
+uint16_t utils_crc16_ccitt_final(utils_crc16_ctx_t *ctx)
+{
+    return ctx->crc;
+}
+
+uint16_t utils_crc16_ccitt(const void *dataIn, uint32_t len)
+{
+    utils_crc16_ctx_t ctx;
+
+    utils_crc16_ccitt_init(&ctx);
+    utils_crc16_ccitt_update(&ctx, dataIn, len);
+    return utils_crc16_ccitt_final(&ctx);
+}
+#endif
 
-    crc = crc ^ 0xffffffff;
+#ifdef UTILS_CRC32C_ENABLE
+static uint32_t crc32c_tab[UTILS_CRC_SLICE][256];
+static uint8_t crc32c_ready;
 
-    while (len--)
-        crc = crc32Tab[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+static uint32_t (*crc32c_table(void))[256]
+{
+    if (!crc32c_ready) {
+        crc_build_reflected32(crc32c_tab, 0x82F63B78);
+        __asm__ volatile ("" ::: "memory");
+        crc32c_ready = 1;
+    }
+    return crc32c_tab;
+}
+
+void utils_crc32c_init(utils_crc32_ctx_t *ctx)
+{
+    ctx->crc = 0xFFFFFFFF;
+}
+
+void utils_crc32c_update(utils_crc32_ctx_t *ctx, const void *dataIn, uint32_t len)
+{
+    ctx->crc = crc_update_reflected32(crc32c_table(), ctx->crc, dataIn, len);
+}
+
+uint32_t utils_crc32c_final(utils_crc32_ctx_t *ctx)
+{
+    return ctx->crc ^ 0xFFFFFFFF;
+}
+
+uint32_t utils_crc32c(const void *dataIn, uint32_t len)
+{
+    utils_crc32_ctx_t ctx;
 
-    return crc ^ 0xffffffff;
+    utils_crc32c_init(&ctx);
+    utils_crc32c_update(&ctx, dataIn, len);
+    return utils_crc32c_final(&ctx);
 }
+#endif
@@ -34,6 +34,7 @@
 #include <utils_hmac_sha1_fast.h>
 
 
+/* HMAC-SHA1 over the concatenation of textNum buffers */
 void utils_hmac_sha1_fast(unsigned char ** ppText,
                     int * pTextLen,
                     int textNum,
@@ -42,72 +43,17 @@ void utils_hmac_sha1_fast(unsigned char ** ppText,
                     unsigned char *output,
                     int outputLen)
 {
-    uint64_t pBuf[(64 + 20) / 8 + 1]; /*BIG stack*/
-    bl_sha_ctx_t sha_ctx;
-    unsigned char *k_pad; /* padding - key XORd with i/opad */
-    unsigned char *digest;
+    bl_hmac_ctx_t ctx;
+    unsigned char digest[20];
     int i;
 
-    /* k_pad start at a UINT32 boundary */
-    k_pad = (unsigned char *)pBuf;
-    digest = k_pad + 64;
-
-    /* if key is longer than 64 bytes reset it to key=SHA1(key) */
-    if (key_len > 64)
-    {
-        bl_sha_init(&sha_ctx, BL_SHA1);
-        bl_sha_update(&sha_ctx, key, key_len);
-        bl_sha_finish(&sha_ctx, key);
-
-        key_len = 20;
-    }
-
-    /*
-     * the HMAC_SHA1 transform looks like:
-     *
-     * SHA1(K XOR opad, SHA1(K XOR ipad, text))
-     *
-     * where K is an n byte key
-     * ipad is the byte 0x36 repeated 64 times
-     * opad is the byte 0x5c repeated 64 times
-     * and text is the data being protected
-     */
-
-    /* perform inner SHA1*/
-    /* start out by storing key in pads */
-    memset(k_pad, 0, 64);
-    memcpy(k_pad, key, key_len);
-
-    /* XOR key with ipad and opad values */
-    for (i = 0; i < 8; i++)
-    {
-        ((uint64_t *)k_pad)[i] ^= 0x3636363636363636;
-    }
-
-    bl_sha_init(&sha_ctx, BL_SHA1); /* init context for 1st pass */
-    bl_sha_update(&sha_ctx, k_pad, 64); /* start with inner pad */
+    bl_hmac_init(&ctx, BL_SHA1, key, key_len);
     for (i = 0; i < textNum; i++)
     {
-        /* then text of datagram */
-        bl_sha_update(&sha_ctx, ppText[i], pTextLen[i]);
-    }
-
-    bl_sha_finish(&sha_ctx, digest); /* finish up 1st pass */
-
-    /* perform outer SHA1 */
-    /* start out by storing key in pads */
-    memset(k_pad, 0, 64);
-    memcpy(k_pad, key, key_len);
-
-    /* XOR key with ipad and opad values */
-    for (i = 0; i < 8; i++)
-    {
-        ((uint64_t *)k_pad)[i] ^= 0x5c5c5c5c5c5c5c5c;
+        bl_hmac_update(&ctx, ppText[i], pTextLen[i]);
     }
+    bl_hmac_finish(&ctx, digest);
+    bl_hmac_free(&ctx);
 
-    bl_sha_init(&sha_ctx, BL_SHA1); /* init context for 2nd pass */
-    bl_sha_update(&sha_ctx, k_pad, 64); /* start with outer pad */
-    bl_sha_update(&sha_ctx, digest, 20); /* then results of 1st hash */
-    bl_sha_finish(&sha_ctx, digest); /* finish up 2nd pass */
     memcpy(output, digest, outputLen);
 }
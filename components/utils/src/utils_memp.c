@@ -28,9 +28,40 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <stdint.h>
-#include <FreeRTOS.h>
+#include <stdio.h>
+#include <string.h>
 #include <utils_memp.h>
 
+/* OS hooks, an includer may provide its own, see test/test_utils_memp.c */
+#ifndef UTILS_MEMP_PORT
+#include <FreeRTOS.h>
+#include <task.h>
+
+#define memp_port_malloc(size)      pvPortMalloc(size)
+#define memp_port_free(ptr)         vPortFree(ptr)
+#define memp_port_in_isr()          xPortIsInsideInterrupt()
+
+/* no atomics on this core, and interrupts do not nest, so the lock is
+ * interrupts off in tasks and nothing in interrupts */
+static inline UBaseType_t memp_port_lock(void)
+{
+    if (xPortIsInsideInterrupt()) {
+        return taskENTER_CRITICAL_FROM_ISR();
+    }
+    taskENTER_CRITICAL();
+    return 0;
+}
+
+static inline void memp_port_unlock(UBaseType_t state)
+{
+    if (xPortIsInsideInterrupt()) {
+        taskEXIT_CRITICAL_FROM_ISR(state);
+        return;
+    }
+    taskEXIT_CRITICAL();
+}
+#endif
+
 #define UTILS_MEMP_ALLOCED_NODE_PATTERN 0XA5
 #define MEM_ALIGN(addr, align) (((addr) + (align) -1) & ~((align)-1))
 
@@ -51,7 +82,7 @@ int utils_memp_init(utils_memp_pool_t **pool, uint16_t node_size, uint16_t pool_
     size = MEM_ALIGN(size, align_req);
     size += padded_node_size * pool_cap;
 
-    npool = pvPortMalloc(size);
+    npool = memp_port_malloc(size);
 
     if (!npool) {
         return -1;
@@ -62,6 +93,8 @@ int utils_memp_init(utils_memp_pool_t **pool, uint16_t node_size, uint16_t pool_
     npool->node_size = node_size;
     npool->pool_cap = pool_cap;
     npool->pool_size = 0;
+    npool->pool_peak = 0;
+    npool->alloc_fail = 0;
     npool->align_req = align_req;
     npool->padded_node_size = padded_node_size;
     npool->mem = NULL;
@@ -84,7 +117,7 @@ int utils_memp_deinit(utils_memp_pool_t *pool)
     if (!pool) {
         return -1;
     }
-    vPortFree(pool);
+    memp_port_free(pool);
 
     return 0;
 }
@@ -93,52 +126,211 @@ void *utils_memp_malloc(utils_memp_pool_t *pool)
 {
     struct utils_memp_node *node;
     uint32_t *pat;
+    UBaseType_t state;
+
     if (!pool) {
         return NULL;
     }
-    if (pool->pool_size == pool->pool_cap) {
-        return NULL;
-    }
+
+    state = memp_port_lock();
     node = pool->mem;
     if (node != NULL) {
         pool->mem = node->next;
         pool->pool_size++;
+        if (pool->pool_size > pool->pool_peak) {
+            pool->pool_peak = pool->pool_size;
+        }
         pat = (uint32_t *)&node->next;
         *pat = UTILS_MEMP_ALLOCED_NODE_PATTERN;
-        return (void *)node + sizeof(struct utils_memp_node);
     } else {
+        pool->alloc_fail++;
+    }
+    memp_port_unlock(state);
+
+    if (node == NULL) {
         return NULL;
     }
+    return (uint8_t *)node + sizeof(struct utils_memp_node);
+}
+
+/* node is the address of the header in front of the user data */
+static int utils_memp_owns(utils_memp_pool_t *pool, void *node)
+{
+    if (!((uint8_t *)node >= (uint8_t *)pool->first_node && (uint8_t *)node <= (uint8_t *)pool->last_node)) {
+        return 0;
+    }
+    if (((uint8_t *)node - (uint8_t *)pool->first_node) % pool->padded_node_size) {
+        return 0;
+    }
+
+    return 1;
 }
 
 int utils_memp_free(utils_memp_pool_t *pool, void *node)
 {
     struct utils_memp_node *utils_memp_node;
-    node = node - sizeof(struct utils_memp_node);
     uint32_t *pat;
-    int diff;
+    UBaseType_t state;
+    int ret = -1;
 
     if (!pool || !node) {
         return -1;
     }
-    if (pool->pool_size == 0) {
+    node = (uint8_t *)node - sizeof(struct utils_memp_node);
+    if (!utils_memp_owns(pool, node)) {
         return -1;
     }
-    if (!(node >= pool->first_node && node <= pool->last_node)) {
+
+    state = memp_port_lock();
+    /* checked under the lock, so a double free racing with itself is caught */
+    pat = (uint32_t *)(&((struct utils_memp_node *)node)->next);
+    if (pool->pool_size != 0 && *pat == UTILS_MEMP_ALLOCED_NODE_PATTERN) {
+        utils_memp_node = (struct utils_memp_node*)node;
+        utils_memp_node->next = pool->mem;
+        pool->mem = utils_memp_node;
+        pool->pool_size--;
+        ret = 0;
+    }
+    memp_port_unlock(state);
+
+    return ret;
+}
+
+int utils_memp_slab_init(utils_memp_slab_t **slab, const utils_memp_class_t *classes, uint8_t class_num, uint32_t flags)
+{
+    utils_memp_slab_t *nslab;
+    int i;
+
+    if (!slab || !classes || !class_num) {
         return -1;
     }
-    diff = node - pool->first_node;
-    if (diff % pool->padded_node_size) {
+    for (i = 1; i < class_num; i++) {
+        if (classes[i].node_size <= classes[i - 1].node_size) {
+            return -1;
+        }
+    }
+
+    nslab = memp_port_malloc(sizeof(utils_memp_slab_t) + class_num * sizeof(utils_memp_pool_t *));
+    if (!nslab) {
         return -1;
     }
+    memset(nslab, 0, sizeof(utils_memp_slab_t) + class_num * sizeof(utils_memp_pool_t *));
+    nslab->flags = flags;
+    nslab->class_num = class_num;
 
-    pat = (uint32_t *)(&((struct utils_memp_node *)node)->next);
-    if (*pat != UTILS_MEMP_ALLOCED_NODE_PATTERN) {
+    for (i = 0; i < class_num; i++) {
+        if (utils_memp_init(&nslab->pools[i], classes[i].node_size, classes[i].pool_cap, sizeof(void *))) {
+            utils_memp_slab_deinit(nslab);
+            return -1;
+        }
+    }
+    *slab = nslab;
+
+    return 0;
+}
+
+int utils_memp_slab_deinit(utils_memp_slab_t *slab)
+{
+    int i;
+
+    if (!slab) {
         return -1;
     }
-    utils_memp_node = (struct utils_memp_node*)node;
-    utils_memp_node->next = pool->mem;
-    pool->mem = utils_memp_node;
-    pool->pool_size--;
+    for (i = 0; i < slab->class_num; i++) {
+        if (slab->pools[i]) {
+            utils_memp_deinit(slab->pools[i]);
+        }
+    }
+    memp_port_free(slab);
+
     return 0;
 }
+
+void *utils_memp_slab_malloc(utils_memp_slab_t *slab, size_t size)
+{
+    UBaseType_t state;
+    void *ptr;
+    int i;
+
+    if (!slab) {
+        return NULL;
+    }
+
+    for (i = 0; i < slab->class_num; i++) {
+        if (slab->pools[i]->node_size < size) {
+            continue;
+        }
+        ptr = utils_memp_malloc(slab->pools[i]);
+        if (ptr) {
+            return ptr;
+        }
+    }
+
+    if (!(slab->flags & UTILS_MEMP_SLAB_FALLBACK) || memp_port_in_isr()) {
+        return NULL;
+    }
+    ptr = memp_port_malloc(size);
+    if (ptr) {
+        state = memp_port_lock();
+        slab->fallback_used++;
+        if (slab->fallback_used > slab->fallback_peak) {
+            slab->fallback_peak = slab->fallback_used;
+        }
+        memp_port_unlock(state);
+    }
+
+    return ptr;
+}
+
+int utils_memp_slab_free(utils_memp_slab_t *slab, void *ptr)
+{
+    UBaseType_t state;
+    int i;
+
+    if (!slab || !ptr) {
+        return -1;
+    }
+
+    for (i = 0; i < slab->class_num; i++) {
+        if (utils_memp_owns(slab->pools[i], (uint8_t *)ptr - sizeof(struct utils_memp_node))) {
+            return utils_memp_free(slab->pools[i], ptr);
+        }
+    }
+
+    if (!(slab->flags & UTILS_MEMP_SLAB_FALLBACK) || memp_port_in_isr()) {
+        return -1;
+    }
+    state = memp_port_lock();
+    slab->fallback_used--;
+    memp_port_unlock(state);
+    memp_port_free(ptr);
+
+    return 0;
+}
+
+void utils_memp_slab_dump(utils_memp_slab_t *slab)
+{
+    utils_memp_pool_t *pool;
+    int i;
+
+    if (!slab) {
+        return;
+    }
+
+    printf("%-6s %6s %6s %6s %6s %8s\r\n", "class", "size", "cap", "used", "peak", "fail");
+    for (i = 0; i < slab->class_num; i++) {
+        pool = slab->pools[i];
+        printf("%-6d %6u %6u %6u %6u %8u\r\n",
+                i,
+                (unsigned int)pool->node_size,
+                (unsigned int)pool->pool_cap,
+                (unsigned int)pool->pool_size,
+                (unsigned int)pool->pool_peak,
+                (unsigned int)pool->alloc_fail);
+    }
+    if (slab->flags & UTILS_MEMP_SLAB_FALLBACK) {
+        printf("%-6s %6s %6s %6u %6u\r\n", "heap", "-", "-",
+                (unsigned int)slab->fallback_used,
+                (unsigned int)slab->fallback_peak);
+    }
+}
@@ -33,15 +33,17 @@
 #include <bl_sec.h>
 #include <utils_psk_fast.h>
 #include <utils_hex.h>
-#include <utils_hmac_sha1_fast.h>
 
 #define A_SHA_DIGEST_LEN 20
-static void Bl_F_fast(unsigned char digest[36], unsigned char digest1[A_SHA_DIGEST_LEN], char *password, unsigned char *ssid, int ssidlength, int iterations, int count, unsigned char *output)
+
+/*
+ * PBKDF2-HMAC-SHA1 block. The password is the HMAC key of every iteration,
+ * so hmac carries its padded states and each iteration hashes two blocks
+ * instead of four.
+ */
+static int Bl_F_fast(bl_hmac_ctx_t *hmac, unsigned char digest[36], unsigned char digest1[A_SHA_DIGEST_LEN], unsigned char *ssid, int ssidlength, int iterations, int count, unsigned char *output)
 {
     int i, j;
-    int len = strlen(password);
-    int tmpLen = ssidlength + 4;
-    unsigned char * pTemp = digest;
 
     /* U1 = PRF(P, S || int(i)) */
     memcpy(digest, ssid, ssidlength);
@@ -50,55 +52,53 @@ static void Bl_F_fast(unsigned char digest[36], unsigned char digest1[A_SHA_DIGE
     digest[ssidlength+2] = (unsigned char)((count>>8) & 0xff);
     digest[ssidlength+3] = (unsigned char)(count & 0xff);
 
-    bl_sha_mutex_take();
-    utils_hmac_sha1_fast(&pTemp,
-                   &tmpLen,
-                   1,
-                   (unsigned char*) password,
-                   len,
-                   digest1,
-                   A_SHA_DIGEST_LEN);
+    if (bl_hmac_update(hmac, digest, ssidlength + 4) || bl_hmac_finish(hmac, digest1)) {
+        return -1;
+    }
 
     /* output = U1 */
     memcpy(output, digest1, A_SHA_DIGEST_LEN);
-    pTemp = digest1;
     for (i = 1; i < iterations; i++)
     {
-        tmpLen = A_SHA_DIGEST_LEN;
-
         /* Un = PRF(P, Un-1) */
-        utils_hmac_sha1_fast(&pTemp,
-                       &tmpLen,
-                       1,
-                       (unsigned char*) password,
-                       len,
-                       digest,
-                       A_SHA_DIGEST_LEN);
-
-        memcpy(digest1, digest, A_SHA_DIGEST_LEN);
+        if (bl_hmac_update(hmac, digest1, A_SHA_DIGEST_LEN) || bl_hmac_finish(hmac, digest1)) {
+            return -1;
+        }
 
         /* output = output xor Un */
         for (j = 0; j < A_SHA_DIGEST_LEN; j++)
         {
-            output[j] ^= digest[j];
+            output[j] ^= digest1[j];
         }
     }
-    bl_sha_mutex_give();
+
+    return 0;
 }
 
 int utils_wifi_psk_cal_fast_bin(char *password, unsigned char *ssid, int ssidlength, unsigned char *output)
 {
     unsigned char digest[36], digest1[A_SHA_DIGEST_LEN];
+    bl_hmac_ctx_t hmac;
+    int ret;
 
     if ((strlen(password) > 63) || (ssidlength > 32)) {
         return -1;
     }
 
-    Bl_F_fast(digest, digest1, password, ssid, ssidlength, 4096, 2, output);
-    memcpy(output + A_SHA_DIGEST_LEN, output, 12);
-    Bl_F_fast(digest, digest1, password, ssid, ssidlength, 4096, 1, output);
+    /* keep SEC_ENG for the 8192 HMACs rather than take it for each block */
+    bl_sha_mutex_take();
+    ret = bl_hmac_init(&hmac, BL_SHA1, (unsigned char*)password, strlen(password));
+    if (0 == ret) {
+        ret = Bl_F_fast(&hmac, digest, digest1, ssid, ssidlength, 4096, 2, output);
+    }
+    if (0 == ret) {
+        memcpy(output + A_SHA_DIGEST_LEN, output, 12);
+        ret = Bl_F_fast(&hmac, digest, digest1, ssid, ssidlength, 4096, 1, output);
+    }
+    bl_hmac_free(&hmac);
+    bl_sha_mutex_give();
 
-    return 0;
+    return ret;
 }
 
 int utils_wifi_psk_cal_fast(char *password, char *ssid, int ssid_len, char *output)
@@ -24,6 +24,10 @@ CONFIG_ENABLE_PSM_RAM:=1
 #CONFIG_ENABLE_BLSYNC:=1
 #CONFIG_ENABLE_VFS_SPI:=1
 CONFIG_ENABLE_VFS_ROMFS:=1
+#set CONFIG_LWIP_PROFILE_THROUGHPUT to 1 for full-MTU MSS and lwIP core locking, costs ~8KB of wifi heap
+#CONFIG_LWIP_PROFILE_THROUGHPUT:=1
+#set CONFIG_FREERTOS_RUNTIME_STATS to 1 for per task CPU time, iperf then reports CPU idle
+#CONFIG_FREERTOS_RUNTIME_STATS:=1
 
 # set easyflash env psm size, only support 4K、8K、16K options
 CONFIG_ENABLE_PSM_EF_SIZE:=16K
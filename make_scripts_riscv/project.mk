@@ -253,6 +253,9 @@ endif
 ifeq ($(CONFIG_ENABLE_PSM_RAM),1)
 CPPFLAGS += -DCONF_USER_ENABLE_PSRAM
 endif
+ifeq ($(CONFIG_LWIP_PROFILE_THROUGHPUT),1)
+CPPFLAGS += -DCONF_USER_LWIP_PROFILE_THROUGHPUT
+endif
 EXTRA_CPPFLAGS ?=
 CPPFLAGS := -D BL_SDK_VER=\"$(BL_SDK_VER)\"
 CPPFLAGS += -D BL_SDK_PHY_VER=\"$(BL_SDK_PHY_VER)\"
@@ -19,6 +19,37 @@ CPPFLAGS += -DconfigUSE_TICKLESS_IDLE=0
 CFLAGS += -DconfigUSE_TICKLESS_IDLE=0
 endif
 
+ifeq ($(CONFIG_FREERTOS_HEAP_TRACE),1)
+CPPFLAGS += -DconfigUSE_HEAP_TRACE=1
+CFLAGS += -DconfigUSE_HEAP_TRACE=1
+endif
+
+ifeq ($(CONFIG_FREERTOS_RUNTIME_STATS),1)
+CPPFLAGS += -DconfigGENERATE_RUN_TIME_STATS=1
+CFLAGS += -DconfigGENERATE_RUN_TIME_STATS=1
+endif
+
+ifeq ($(CONFIG_BLOG_DEFERRED),1)
+CPPFLAGS += -DBLOG_DEFERRED=1
+CFLAGS += -DBLOG_DEFERRED=1
+endif
+
+# utils_crc bytes per table step (1, 4 or 8) and optional CRC variants
+ifdef CONFIG_UTILS_CRC_SLICE
+CPPFLAGS += -DUTILS_CRC_SLICE=$(CONFIG_UTILS_CRC_SLICE)
+CFLAGS += -DUTILS_CRC_SLICE=$(CONFIG_UTILS_CRC_SLICE)
+endif
+
+ifeq ($(CONFIG_UTILS_CRC32C),1)
+CPPFLAGS += -DUTILS_CRC32C_ENABLE=1
+CFLAGS += -DUTILS_CRC32C_ENABLE=1
+endif
+
+ifeq ($(CONFIG_UTILS_CRC16_CCITT),1)
+CPPFLAGS += -DUTILS_CRC16_CCITT_ENABLE=1
+CFLAGS += -DUTILS_CRC16_CCITT_ENABLE=1
+endif
+
 ifeq ($(CONFIG_WIFI),0)
 CPPFLAGS += -DFEATURE_WIFI_DISABLE=1
 CFLAGS += -DFEATURE_WIFI_DISABLE=1
@@ -0,0 +1,207 @@
+#!/bin/env python3
+"""
+Decode the output of a firmware built with CONFIG_BLOG_DEFERRED:=1.
+
+The firmware prints every blog_* call as a "#blog#<hex>" line holding the
+address of the call site's format record, the tick and the raw arguments.
+The format records are in the .blog_fmt section of the ELF, which is never
+flashed, so the ELF of the exact build that produced the log is required.
+
+Lines without a record are passed through unchanged, so this can sit on the
+whole console output:
+
+    blog_decode.py build_out/app.elf -d /dev/ttyUSB0
+    blog_decode.py build_out/app.elf uart.log > uart.txt
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+ARG_INT32 = 1
+ARG_INT64 = 2
+ARG_DOUBLE = 3
+ARG_STR = 4
+
+MARK = "#blog#"
+
+SPEC = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|j|z|t|L)?([diouxXeEfFgGcspn%])")
+
+
+class Elf:
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF":
+            raise ValueError(f"{path} is not an ELF file")
+        self.bits = 64 if self.data[4] == 2 else 32
+        self.endian = "<" if self.data[5] == 1 else ">"
+
+    def section(self, name):
+        e = self.endian
+        if self.bits == 32:
+            shoff, = struct.unpack_from(e + "I", self.data, 0x20)
+            shentsize, shnum, shstrndx = struct.unpack_from(e + "HHH", self.data, 0x2e)
+            shdr = e + "IIIIII"
+        else:
+            shoff, = struct.unpack_from(e + "Q", self.data, 0x28)
+            shentsize, shnum, shstrndx = struct.unpack_from(e + "HHH", self.data, 0x3a)
+            shdr = e + "IIQQQQ"
+
+        headers = [struct.unpack_from(shdr, self.data, shoff + i * shentsize) for i in range(shnum)]
+        strtab = headers[shstrndx]
+        for sh_name, sh_type, _, sh_addr, sh_offset, sh_size in headers:
+            start = strtab[4] + sh_name
+            if self.data[start:self.data.index(b"\0", start)].decode() == name:
+                return sh_addr, self.data[sh_offset:sh_offset + sh_size]
+        return None
+
+
+class Decoder:
+    def __init__(self, elf):
+        elf = Elf(elf)
+        sec = elf.section(".blog_fmt")
+        if sec is None:
+            raise ValueError("no .blog_fmt section, was the firmware built with CONFIG_BLOG_DEFERRED:=1?")
+        self.addr, self.data = sec
+        self.endian = elf.endian
+        self.cache = {}
+
+    def record(self, fid):
+        if fid in self.cache:
+            return self.cache[fid]
+        off = (fid - self.addr) & 0xffffffff
+        if off + 8 >= len(self.data):
+            return None
+        types, = struct.unpack_from(self.endian + "Q", self.data, off)
+        end = self.data.index(b"\0", off + 8)
+        fields = self.data[off + 8:end].decode(errors="replace").split("\x1f", 3)
+        if len(fields) != 4:
+            return None
+        rec = (types, fields)
+        self.cache[fid] = rec
+        return rec
+
+    def args(self, types, raw):
+        args = []
+        pos = 0
+        e = self.endian
+        while types:
+            kind = types & 0xf
+            types >>= 4
+            if kind == ARG_INT32:
+                args.append((kind, struct.unpack_from(e + "I", raw, pos)[0], 32))
+                pos += 4
+            elif kind == ARG_INT64:
+                args.append((kind, struct.unpack_from(e + "Q", raw, pos)[0], 64))
+                pos += 8
+            elif kind == ARG_DOUBLE:
+                args.append((kind, struct.unpack_from(e + "d", raw, pos)[0], 64))
+                pos += 8
+            elif kind == ARG_STR:
+                n, = struct.unpack_from(e + "I", raw, pos)
+                s = raw[pos + 4:pos + 4 + n].decode(errors="replace")
+                args.append((kind, s, 0))
+                pos += 4 + (n + 3) // 4 * 4
+            else:
+                break
+        return args
+
+    @staticmethod
+    def convert(flags, width, prec, conv, arg):
+        kind, value, bits = arg
+        if conv == "p":
+            return "0x%x" % value if kind != ARG_STR else value
+        if conv == "s":
+            if kind == ARG_STR:
+                return ("%" + flags + width + prec + "s") % value
+            return ("%" + flags + width + "s") % ("0x%08x" % value)
+        if kind == ARG_STR:
+            return value
+        if conv in "di":
+            if kind != ARG_DOUBLE and value >> (bits - 1):
+                value -= 1 << bits
+            return ("%" + flags + width + prec + "d") % int(value)
+        if conv in "ouxX":
+            return ("%" + flags + width + prec + ("d" if conv == "u" else conv)) % (int(value) & ((1 << bits) - 1 if bits else -1))
+        if conv == "c":
+            return ("%" + flags + width + "c") % chr(int(value) & 0xff)
+        return ("%" + flags + width + prec + conv) % float(value)
+
+    def format(self, fmt, args):
+        out = []
+        last = 0
+        for m in SPEC.finditer(fmt):
+            out.append(fmt[last:m.start()])
+            last = m.end()
+            flags, width, prec, _, conv = m.groups()
+            if conv == "%":
+                out.append("%")
+                continue
+            if width == "*":
+                width = str(args.pop(0)[1]) if args else ""
+            if prec == "*":
+                prec = str(args.pop(0)[1]) if args else ""
+            if conv == "n":
+                continue
+            if not args:
+                out.append("<?>")
+                continue
+            out.append(self.convert(flags, width or "", "." + prec if prec is not None else "", conv, args.pop(0)))
+        out.append(fmt[last:])
+        return "".join(out)
+
+    def line(self, text):
+        at = text.find(MARK)
+        if at < 0:
+            return text
+        hexstr = text[at + len(MARK):].strip()
+        try:
+            raw = bytes.fromhex(hexstr)
+            fid, tick = struct.unpack_from(self.endian + "II", raw, 0)
+        except (ValueError, struct.error):
+            return text
+        rec = self.record(fid)
+        if rec is None:
+            return text[:at] + "[blog] unknown record 0x%08x, wrong ELF?\r\n" % fid
+        types, (name, file, line, fmt) = rec
+        head = "[%10u][%s: %s:%4d] " % (tick, name, file, int(line))
+        return text[:at] + head + self.format(fmt, self.args(types, raw[8:]))
+
+
+def lines_from_device(device, baudrate):
+    import serial
+    port = serial.Serial(device, baudrate)
+    buf = b""
+    while True:
+        buf += port.read(port.in_waiting or 1)
+        while b"\n" in buf:
+            line, buf = buf.split(b"\n", 1)
+            yield line.decode(errors="replace") + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode deferred blog output")
+    parser.add_argument("elf", help="ELF of the firmware that produced the log")
+    parser.add_argument("log", nargs="*", help="log files to decode (default: stdin)")
+    parser.add_argument("-d", "--device", help="read from a serial device instead, needs pyserial")
+    parser.add_argument("-b", "--baudrate", type=int, default=2000000, help="baudrate for --device (default: 2000000)")
+    args = parser.parse_args()
+
+    decoder = Decoder(args.elf)
+
+    if args.device:
+        source = lines_from_device(args.device, args.baudrate)
+    elif args.log:
+        source = (line for path in args.log for line in open(path, errors="replace"))
+    else:
+        source = sys.stdin
+
+    for text in source:
+        sys.stdout.write(decoder.line(text))
+        sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()